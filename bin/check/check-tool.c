@@ -729,10 +729,12 @@ load_zone(isc_mem_t *mctx, const char *zonename, const char *filename,
 	CHECK(dns_zone_load(zone, false));
 
 	/*
-	 * When loading map files we can't catch oversize TTLs during
-	 * load, so we check for them here.
+	 * When loading map or image files we can't catch oversize TTLs
+	 * during load, so we check for them here.
 	 */
-	if (fileformat == dns_masterformat_map && maxttl != 0) {
+	if ((fileformat == dns_masterformat_map ||
+	     fileformat == dns_masterformat_image) &&
+	    maxttl != 0) {
 		CHECK(check_ttls(zone, maxttl));
 	}
 
@@ -437,6 +437,8 @@ configure_zone(const char *vclass, const char *view, const cfg_obj_t *zconfig,
 			masterformat = dns_masterformat_raw;
 		} else if (strcasecmp(masterformatstr, "map") == 0) {
 			masterformat = dns_masterformat_map;
+		} else if (strcasecmp(masterformatstr, "image") == 0) {
+			masterformat = dns_masterformat_image;
 		} else {
 			INSIST(0);
 			ISC_UNREACHABLE();
@@ -456,6 +456,8 @@ main(int argc, char **argv) {
 					"ignored\n");
 		} else if (strcasecmp(inputformatstr, "map") == 0) {
 			inputformat = dns_masterformat_map;
+		} else if (strcasecmp(inputformatstr, "image") == 0) {
+			inputformat = dns_masterformat_image;
 		} else {
 			fprintf(stderr, "unknown file format: %s\n",
 				inputformatstr);
@@ -480,6 +482,8 @@ main(int argc, char **argv) {
 			}
 		} else if (strcasecmp(outputformatstr, "map") == 0) {
 			outputformat = dns_masterformat_map;
+		} else if (strcasecmp(outputformatstr, "image") == 0) {
+			outputformat = dns_masterformat_image;
 		} else {
 			fprintf(stderr, "unknown file format: %s\n",
 				outputformatstr);
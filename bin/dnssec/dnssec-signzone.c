@@ -3696,6 +3696,8 @@ main(int argc, char *argv[]) {
 			inputformat = dns_masterformat_text;
 		} else if (strcasecmp(inputformatstr, "map") == 0) {
 			inputformat = dns_masterformat_map;
+		} else if (strcasecmp(inputformatstr, "image") == 0) {
+			inputformat = dns_masterformat_image;
 		} else if (strcasecmp(inputformatstr, "raw") == 0) {
 			inputformat = dns_masterformat_raw;
 		} else if (strncasecmp(inputformatstr, "raw=", 4) == 0) {
@@ -3715,6 +3717,8 @@ main(int argc, char *argv[]) {
 			masterstyle = &dns_master_style_full;
 		} else if (strcasecmp(outputformatstr, "map") == 0) {
 			outputformat = dns_masterformat_map;
+		} else if (strcasecmp(outputformatstr, "image") == 0) {
+			outputformat = dns_masterformat_image;
 		} else if (strcasecmp(outputformatstr, "raw") == 0) {
 			outputformat = dns_masterformat_raw;
 		} else if (strncasecmp(outputformatstr, "raw=", 4) == 0) {
@@ -46,10 +46,13 @@
 static char defaultconf[] = "\
 options {\n\
 	answer-cookie true;\n\
+	auth-fast-path no;\n\
 	automatic-interface-scan yes;\n\
 	bindkeys-file \"" NAMED_SYSCONFDIR "/bind.keys\";\n\
 #	blackhole {none;};\n"
+			    "	cache-snapshot-interval 3600;\n"
 			    "	cookie-algorithm siphash24;\n"
+			    "	cpu-affinity yes;\n"
 #ifndef WIN32
 			    "	coresize default;\n\
 	datasize default;\n"
@@ -100,6 +103,7 @@ options {\n\
 	request-nsid false;\n\
 	reserved-sockets 512;\n\
 	resolver-query-timeout 10;\n\
+	response-cache-size 0;\n\
 	rrset-order { order random; };\n\
 	secroots-file \"named.secroots\";\n\
 	send-cookie true;\n\
@@ -121,6 +125,7 @@ options {\n\
 	tcp-initial-timeout 300;\n\
 	tcp-keepalive-timeout 300;\n\
 	tcp-listen-queue 10;\n\
+	tcp-pipeline-limit 23;\n\
 #	tkey-dhkey <none>\n\
 #	tkey-domain <none>\n\
 #	tkey-gssapi-credential <none>\n\
@@ -130,8 +135,12 @@ options {\n\
 	transfers-per-ns 2;\n\
 #	treat-cr-as-space <obsolete>;\n\
 	trust-anchor-telemetry yes;\n\
+	udp-io-uring no;\n\
+	udp-send-batch-deadline 200;\n\
+	udp-send-batch-size 32;\n\
 #	use-id-pool <obsolete>;\n\
 #	use-ixfr <obsolete>;\n\
+	zone-load-threads 0;\n\
 \n\
 	/* view */\n\
 	allow-new-zones no;\n\
@@ -143,6 +152,7 @@ options {\n\
 	allow-update-forwarding {none;};\n\
 #	allow-v6-synthesis <obsolete>;\n\
 	auth-nxdomain false;\n\
+	cache-shards 1;\n\
 	check-dup-records warn;\n\
 	check-mx warn;\n\
 	check-names master fail;\n\
@@ -161,6 +171,7 @@ options {\n\
 	fetches-per-server 0;\n\
 	fetches-per-zone 0;\n\
 	glue-cache yes;\n\
+	hedged-queries 0%;\n\
 	lame-ttl 600;\n"
 #ifdef HAVE_LMDB
 			    "	lmdb-mapsize 32M;\n"
@@ -226,6 +237,7 @@ options {\n\
 	inline-signing no;\n\
 	ixfr-from-differences false;\n\
 #	maintain-ixfr-base <obsolete>;\n\
+	masterfile-load-threads 1;\n\
 #	max-ixfr-log-size <obsolete>\n\
 	max-journal-size default;\n\
 	max-records 0;\n\
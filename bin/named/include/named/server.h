@@ -35,11 +35,12 @@
 
 #include <named/types.h>
 
-#define NAMED_EVENTCLASS    ISC_EVENTCLASS(0x4E43)
-#define NAMED_EVENT_RELOAD  (NAMED_EVENTCLASS + 0)
-#define NAMED_EVENT_DELZONE (NAMED_EVENTCLASS + 1)
-#define NAMED_EVENT_COMMAND (NAMED_EVENTCLASS + 2)
-#define NAMED_EVENT_TATSEND (NAMED_EVENTCLASS + 3)
+#define NAMED_EVENTCLASS     ISC_EVENTCLASS(0x4E43)
+#define NAMED_EVENT_RELOAD   (NAMED_EVENTCLASS + 0)
+#define NAMED_EVENT_DELZONE  (NAMED_EVENTCLASS + 1)
+#define NAMED_EVENT_COMMAND  (NAMED_EVENTCLASS + 2)
+#define NAMED_EVENT_TATSEND  (NAMED_EVENTCLASS + 3)
+#define NAMED_EVENT_SNAPSHOT (NAMED_EVENTCLASS + 4)
 
 /*%
  * Name server state.  Better here than in lots of separate global variables.
@@ -76,11 +77,16 @@ struct named_server {
 
 	isc_timer_t *interface_timer;
 	isc_timer_t *heartbeat_timer;
+	isc_timer_t *snapshot_timer;
 	isc_timer_t *pps_timer;
 	isc_timer_t *tat_timer;
 
 	uint32_t interface_interval;
 	uint32_t heartbeat_interval;
+	uint32_t snapshot_interval;
+
+	isc_task_t *	     snapshot_task; /*%< Writes cache snapshots */
+	atomic_uint_fast32_t snapshots;	    /*%< Snapshots being written */
 
 	atomic_int reload_status;
 
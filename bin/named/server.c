@@ -107,6 +107,7 @@
 #include <ns/hooks.h>
 #include <ns/interfacemgr.h>
 #include <ns/listenlist.h>
+#include <ns/respcache.h>
 
 #include <bind9/check.h>
 
@@ -1858,7 +1859,8 @@ cache_reusable(dns_view_t *originview, dns_view_t *view,
 	    originview->acceptexpired != view->acceptexpired ||
 	    originview->enablevalidation != view->enablevalidation ||
 	    originview->maxcachettl != view->maxcachettl ||
-	    originview->maxncachettl != view->maxncachettl)
+	    originview->maxncachettl != view->maxncachettl ||
+	    originview->cacheshards != view->cacheshards)
 	{
 		return (false);
 	}
@@ -4357,6 +4359,11 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist, cfg_obj_t *config,
 	INSIST(result == ISC_R_SUCCESS);
 	view->mincachettl = cfg_obj_asduration(obj);
 
+	obj = NULL;
+	result = named_config_get(maps, "cache-shards", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	view->cacheshards = cfg_obj_asuint32(obj);
+
 	obj = NULL;
 	result = named_config_get(maps, "min-ncache-ttl", &obj);
 	INSIST(result == ISC_R_SUCCESS);
@@ -4495,10 +4502,23 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist, cfg_obj_t *config,
 			isc_mem_setname(cmctx, "cache", NULL);
 			isc_mem_create(&hmctx);
 			isc_mem_setname(hmctx, "cache_heap", NULL);
-			CHECK(dns_cache_create(cmctx, hmctx, named_g_taskmgr,
-					       named_g_timermgr, view->rdclass,
-					       cachename, "rbt", 0, NULL,
-					       &cache));
+			if (view->cacheshards > 1) {
+				char shards[sizeof("4294967295")];
+				char *argv[1] = { shards };
+
+				snprintf(shards, sizeof(shards), "%u",
+					 view->cacheshards);
+				CHECK(dns_cache_create(
+					cmctx, hmctx, named_g_taskmgr,
+					named_g_timermgr, view->rdclass,
+					cachename, "shardcache", 1, argv,
+					&cache));
+			} else {
+				CHECK(dns_cache_create(
+					cmctx, hmctx, named_g_taskmgr,
+					named_g_timermgr, view->rdclass,
+					cachename, "rbt", 0, NULL, &cache));
+			}
 			isc_mem_detach(&cmctx);
 			isc_mem_detach(&hmctx);
 		}
@@ -4530,6 +4550,40 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist, cfg_obj_t *config,
 	dns_cache_setcachesize(cache, max_cache_size);
 	dns_cache_setservestalettl(cache, max_stale_ttl);
 
+	/*
+	 * The cache snapshot is loaded after the cache size and the
+	 * stale TTL are set, so that stale data in it is kept if it may
+	 * be served.  Like cache-file, cache-snapshot cannot be inherited
+	 * if views are present.
+	 */
+	if (!shared_cache) {
+		obj = NULL;
+		result = named_config_get(maps, "cache-snapshot", &obj);
+		if (result == ISC_R_SUCCESS && strcmp(view->name, "_bind") != 0)
+		{
+			const char *snapshot = cfg_obj_asstring(obj);
+
+			CHECK(dns_cache_setsnapshot(cache, snapshot));
+			if (!reused_cache) {
+				result = dns_cache_loadsnapshot(cache);
+				if (result != ISC_R_SUCCESS &&
+				    result != ISC_R_FILENOTFOUND) {
+					isc_log_write(
+						named_g_lctx,
+						NAMED_LOGCATEGORY_GENERAL,
+						NAMED_LOGMODULE_SERVER,
+						ISC_LOG_WARNING,
+						"view '%s': unable to load "
+						"cache snapshot '%s': %s",
+						view->name, snapshot,
+						isc_result_totext(result));
+				}
+			}
+		} else {
+			CHECK(dns_cache_setsnapshot(cache, NULL));
+		}
+	}
+
 	dns_cache_detach(&cache);
 
 	obj = NULL;
@@ -5309,6 +5363,12 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist, cfg_obj_t *config,
 	INSIST(result == ISC_R_SUCCESS);
 	dns_resolver_setmaxqueries(view->resolver, cfg_obj_asuint32(obj));
 
+	obj = NULL;
+	result = named_config_get(maps, "hedged-queries", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	dns_resolver_sethedgebudget(view->resolver,
+				    ISC_MIN(cfg_obj_aspercentage(obj), 100));
+
 	obj = NULL;
 	result = named_config_get(maps, "fetches-per-zone", &obj);
 	INSIST(result == ISC_R_SUCCESS);
@@ -6877,6 +6937,67 @@ interface_timer_tick(isc_task_t *task, isc_event_t *event) {
 	ns_interfacemgr_scan(server->interfacemgr, false);
 }
 
+/*
+ * Write one cache snapshot on the snapshot task, so that walking a
+ * large cache does not hold up the server task.
+ */
+static void
+snapshot_write(isc_task_t *task, isc_event_t *event) {
+	named_server_t *server = (named_server_t *)event->ev_sender;
+	dns_cache_t *cache = (dns_cache_t *)event->ev_arg;
+	isc_result_t result;
+
+	INSIST(task == server->snapshot_task);
+	UNUSED(task);
+
+	isc_event_free(&event);
+	result = dns_cache_dumpsnapshot(cache);
+	if (result != ISC_R_SUCCESS) {
+		isc_log_write(named_g_lctx, NAMED_LOGCATEGORY_GENERAL,
+			      NAMED_LOGMODULE_SERVER, ISC_LOG_WARNING,
+			      "unable to write snapshot of cache '%s': %s",
+			      dns_cache_getname(cache),
+			      isc_result_totext(result));
+	}
+	dns_cache_detach(&cache);
+	atomic_fetch_sub_release(&server->snapshots, 1);
+}
+
+/*
+ * This event callback is invoked to write cache snapshots periodically.
+ * The snapshots themselves are written by the snapshot task.
+ */
+static void
+snapshot_timer_tick(isc_task_t *task, isc_event_t *event) {
+	named_server_t *server = (named_server_t *)event->ev_arg;
+	named_cache_t *nsc;
+
+	INSIST(task == server->task);
+	UNUSED(task);
+
+	isc_event_free(&event);
+	if (atomic_load_acquire(&server->snapshots) != 0) {
+		isc_log_write(named_g_lctx, NAMED_LOGCATEGORY_GENERAL,
+			      NAMED_LOGMODULE_SERVER, ISC_LOG_WARNING,
+			      "previous cache snapshots are still being "
+			      "written; skipping this interval");
+		return;
+	}
+
+	for (nsc = ISC_LIST_HEAD(server->cachelist); nsc != NULL;
+	     nsc = ISC_LIST_NEXT(nsc, link))
+	{
+		dns_cache_t *cache = NULL;
+
+		dns_cache_attach(nsc->cache, &cache);
+		event = isc_event_allocate(server->mctx, server,
+					   NAMED_EVENT_SNAPSHOT, snapshot_write,
+					   cache, sizeof(isc_event_t));
+		atomic_fetch_add_relaxed(&server->snapshots, 1);
+		isc_task_send(server->snapshot_task, &event);
+	}
+}
+
 static void
 heartbeat_timer_tick(isc_task_t *task, isc_event_t *event) {
 	named_server_t *server = (named_server_t *)event->ev_arg;
@@ -8341,9 +8462,11 @@ load_configuration(const char *filename, named_server_t *server,
 	isc_result_t result, tresult;
 	uint32_t heartbeat_interval;
 	uint32_t interface_interval;
+	uint32_t snapshot_interval;
 	uint32_t reserved;
 	uint32_t udpsize;
 	uint32_t transfer_message_size;
+	uint32_t loadthreads;
 	named_cache_t *nsc;
 	named_cachelist_t cachelist, tmpcachelist;
 	ns_altsecret_t *altsecret;
@@ -8352,6 +8475,8 @@ load_configuration(const char *filename, named_server_t *server,
 	uint32_t softquota = 0;
 	uint32_t max;
 	unsigned int initial, idle, keepalive, advertised;
+	uint32_t batchsize, batchdeadline;
+	size_t respcachesize;
 	dns_aclenv_t *env =
 		ns_interfacemgr_getaclenv(named_g_server->interfacemgr);
 
@@ -8669,6 +8794,33 @@ load_configuration(const char *filename, named_server_t *server,
 	isc_nm_tcp_settimeouts(named_g_nm, initial, idle, keepalive,
 			       advertised);
 
+	obj = NULL;
+	result = named_config_get(maps, "udp-send-batch-size", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	batchsize = cfg_obj_asuint32(obj);
+
+	obj = NULL;
+	result = named_config_get(maps, "udp-send-batch-deadline", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	batchdeadline = cfg_obj_asuint32(obj);
+
+	isc_nm_udp_setbatch(named_g_nm, batchsize, batchdeadline);
+
+	obj = NULL;
+	result = named_config_get(maps, "tcp-pipeline-limit", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	isc_nm_tcpdns_setpipeline(named_g_nm, cfg_obj_asuint32(obj));
+
+	obj = NULL;
+	result = named_config_get(maps, "udp-io-uring", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	isc_nm_udp_setiouring(named_g_nm, cfg_obj_asboolean(obj));
+
+	obj = NULL;
+	result = named_config_get(maps, "cpu-affinity", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	isc_nm_setaffinity(named_g_nm, cfg_obj_asboolean(obj));
+
 	/*
 	 * Configure sets of UDP query source ports.
 	 */
@@ -8794,6 +8946,23 @@ load_configuration(const char *filename, named_server_t *server,
 	INSIST(result == ISC_R_SUCCESS);
 	dns_zonemgr_setserialqueryrate(server->zonemgr, cfg_obj_asuint32(obj));
 
+	/*
+	 * Zones are read by the loader threads, or if there are none by
+	 * the worker threads.  Let as many zone files be open at once as
+	 * there are loader threads; without them, the zone manager's
+	 * default limit applies.
+	 */
+	obj = NULL;
+	result = named_config_get(maps, "zone-load-threads", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	loadthreads = cfg_obj_asuint32(obj);
+	if (loadthreads > 0) {
+		dns_zonemgr_setiolimit(server->zonemgr, loadthreads);
+	} else if (dns_zonemgr_getloaders(server->zonemgr) > 0) {
+		dns_zonemgr_setiolimit(server->zonemgr, 1);
+	}
+	dns_zonemgr_setloaders(server->zonemgr, loadthreads);
+
 	/*
 	 * Determine which port to use for listening for incoming connections.
 	 */
@@ -8952,6 +9121,25 @@ load_configuration(const char *filename, named_server_t *server,
 	}
 	server->heartbeat_interval = heartbeat_interval;
 
+	/*
+	 * Configure the cache snapshot timer.
+	 */
+	obj = NULL;
+	result = named_config_get(maps, "cache-snapshot-interval", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	snapshot_interval = cfg_obj_asduration(obj);
+	if (snapshot_interval == 0) {
+		CHECK(isc_timer_reset(server->snapshot_timer,
+				      isc_timertype_inactive, NULL, NULL,
+				      true));
+	} else if (server->snapshot_interval != snapshot_interval) {
+		isc_interval_set(&interval, snapshot_interval, 0);
+		CHECK(isc_timer_reset(server->snapshot_timer,
+				      isc_timertype_ticker, NULL, &interval,
+				      false));
+	}
+	server->snapshot_interval = snapshot_interval;
+
 	isc_interval_set(&interval, 1200, 0);
 	CHECK(isc_timer_reset(server->pps_timer, isc_timertype_ticker, NULL,
 			      &interval, false));
@@ -9419,6 +9607,31 @@ load_configuration(const char *filename, named_server_t *server,
 	INSIST(result == ISC_R_SUCCESS);
 	server->sctx->answercookie = cfg_obj_asboolean(obj);
 
+	obj = NULL;
+	result = named_config_get(maps, "auth-fast-path", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	server->sctx->authfastpath = cfg_obj_asboolean(obj);
+
+	/*
+	 * Responses in the response cache refer to the old views, so
+	 * the cache is always emptied, and replaced if its size changed.
+	 */
+	obj = NULL;
+	result = named_config_get(maps, "response-cache-size", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	respcachesize = (size_t)ISC_MIN(cfg_obj_asuint64(obj), SIZE_MAX);
+	if (server->sctx->respcache != NULL &&
+	    ns_respcache_getmaxsize(server->sctx->respcache) != respcachesize)
+	{
+		ns_respcache_destroy(&server->sctx->respcache);
+	}
+	if (server->sctx->respcache != NULL) {
+		ns_respcache_flush(server->sctx->respcache);
+	} else if (respcachesize != 0) {
+		CHECK(ns_respcache_create(named_g_mctx, respcachesize,
+					  &server->sctx->respcache));
+	}
+
 	obj = NULL;
 	result = named_config_get(maps, "cookie-algorithm", &obj);
 	INSIST(result == ISC_R_SUCCESS);
@@ -9773,6 +9986,7 @@ run_server(isc_task_t *task, isc_event_t *event) {
 		   "creating dispatch manager");
 
 	dns_dispatchmgr_setstats(named_g_dispatchmgr, server->resolverstats);
+	dns_dispatchmgr_setnetmgr(named_g_dispatchmgr, named_g_nm);
 
 #if defined(HAVE_GEOIP2)
 	geoip = named_g_geoip;
@@ -9799,6 +10013,12 @@ run_server(isc_task_t *task, isc_event_t *event) {
 				    &server->heartbeat_timer),
 		   "creating heartbeat timer");
 
+	CHECKFATAL(isc_timer_create(named_g_timermgr, isc_timertype_inactive,
+				    NULL, NULL, server->task,
+				    snapshot_timer_tick, server,
+				    &server->snapshot_timer),
+		   "creating cache snapshot timer");
+
 	CHECKFATAL(isc_timer_create(named_g_timermgr, isc_timertype_inactive,
 				    NULL, NULL, server->task, tat_timer_tick,
 				    server, &server->tat_timer),
@@ -9904,6 +10124,8 @@ shutdown_server(isc_task_t *task, isc_event_t *event) {
 
 	isc_timer_detach(&server->interface_timer);
 	isc_timer_detach(&server->heartbeat_timer);
+	isc_timer_detach(&server->snapshot_timer);
+	isc_task_detach(&server->snapshot_task);
 	isc_timer_detach(&server->pps_timer);
 	isc_timer_detach(&server->tat_timer);
 
@@ -10018,6 +10240,15 @@ named_server_create(isc_mem_t *mctx, named_server_t **serverp) {
 	isc_task_setname(server->task, "server", server);
 	isc_taskmgr_setexcltask(named_g_taskmgr, server->task);
 
+	/*
+	 * Cache snapshots are written by their own task so that dumping
+	 * a large cache does not stall the server task.
+	 */
+	CHECKFATAL(isc_task_create(named_g_taskmgr, 0, &server->snapshot_task),
+		   "creating snapshot task");
+	isc_task_setname(server->snapshot_task, "snapshot", server);
+	atomic_init(&server->snapshots, 0);
+
 	server->sctx = NULL;
 	CHECKFATAL(ns_server_create(mctx, get_matching_view, &server->sctx),
 		   "creating server context");
@@ -10044,11 +10275,13 @@ named_server_create(isc_mem_t *mctx, named_server_t **serverp) {
 
 	server->interface_timer = NULL;
 	server->heartbeat_timer = NULL;
+	server->snapshot_timer = NULL;
 	server->pps_timer = NULL;
 	server->tat_timer = NULL;
 
 	server->interface_interval = 0;
 	server->heartbeat_interval = 0;
+	server->snapshot_interval = 0;
 
 	CHECKFATAL(dns_zonemgr_create(named_g_mctx, named_g_taskmgr,
 				      named_g_timermgr, named_g_socketmgr,
@@ -10057,6 +10290,12 @@ named_server_create(isc_mem_t *mctx, named_server_t **serverp) {
 	CHECKFATAL(dns_zonemgr_setsize(server->zonemgr, 1000), "dns_zonemgr_"
 							       "setsize");
 
+	/*
+	 * Large zone files are loaded in parallel by a pool of threads,
+	 * one per CPU, that all zones share (see "masterfile-load-threads").
+	 */
+	dns_zonemgr_setloadpool(server->zonemgr, named_g_cpus);
+
 	server->statsfile = isc_mem_strdup(server->mctx, "named.stats");
 	CHECKFATAL(server->statsfile == NULL ? ISC_R_NOMEMORY : ISC_R_SUCCESS,
 		   "isc_mem_strdup");
@@ -10862,9 +11101,10 @@ ns_listenelt_fromconfig(const cfg_obj_t *listener, const cfg_obj_t *config,
 			cfg_aclconfctx_t *actx, isc_mem_t *mctx,
 			uint16_t family, ns_listenelt_t **target) {
 	isc_result_t result;
-	const cfg_obj_t *tlsobj, *portobj, *dscpobj;
+	const cfg_obj_t *tlsobj, *portobj, *dscpobj, *steerobj;
 	in_port_t port;
 	isc_dscp_t dscp = -1;
+	isc_nm_steering_t steering = isc_nm_steering_none;
 	const char *key = NULL, *cert = NULL;
 	bool tls = false;
 	ns_listenelt_t *delt = NULL;
@@ -10956,11 +11196,22 @@ ns_listenelt_fromconfig(const cfg_obj_t *listener, const cfg_obj_t *config,
 		dscp = (isc_dscp_t)cfg_obj_asuint32(dscpobj);
 	}
 
+	steerobj = cfg_tuple_get(listener, "steering");
+	if (cfg_obj_isstring(steerobj)) {
+		const char *str = cfg_obj_asstring(steerobj);
+		if (strcasecmp(str, "cpu") == 0) {
+			steering = isc_nm_steering_cpu;
+		} else if (strcasecmp(str, "random") == 0) {
+			steering = isc_nm_steering_random;
+		}
+	}
+
 	result = ns_listenelt_create(mctx, port, dscp, NULL, tls, key, cert,
 				     &delt);
 	if (result != ISC_R_SUCCESS) {
 		return (result);
 	}
+	delt->steering = steering;
 
 	result = cfg_acl_fromconfig2(cfg_tuple_get(listener, "acl"), config,
 				     named_g_lctx, actx, mctx, 0, family,
@@ -11868,6 +12119,9 @@ named_server_status(named_server_t *server, isc_buffer_t **text) {
 	char configtime[ISC_FORMATHTTPTIMESTAMP_SIZE];
 	char line[1024], hostname[256];
 	named_reload_t reload_status;
+	uint64_t nmevents, nmwakeups;
+	uint32_t nmdepth;
+	dns_zoneloadprogress_t progress;
 
 	if (named_g_server->version_set) {
 		ob = " (";
@@ -11935,6 +12189,37 @@ named_server_status(named_server_t *server, isc_buffer_t **text) {
 		 zonecount, automatic);
 	CHECK(putstr(text, line));
 
+	dns_zonemgr_getloadprogress(server->zonemgr, &progress);
+	if (progress.queued > 0) {
+		double rate = 0.0;
+
+		if (progress.elapsed > 0) {
+			rate = progress.loaded * 1000000.0 / progress.elapsed;
+		}
+		if (progress.loaded < progress.queued && rate > 0.0) {
+			snprintf(line, sizeof(line),
+				 "zones loading: %" PRIu64 "/%" PRIu64
+				 " loaded, %" PRIu64 " failed "
+				 "(%.0f zones/sec, ETA %.0f seconds)\n",
+				 progress.loaded, progress.queued,
+				 progress.failed, rate,
+				 (progress.queued - progress.loaded) / rate);
+		} else if (progress.loaded < progress.queued) {
+			snprintf(line, sizeof(line),
+				 "zones loading: %" PRIu64 "/%" PRIu64
+				 " loaded, %" PRIu64 " failed\n",
+				 progress.loaded, progress.queued,
+				 progress.failed);
+		} else {
+			snprintf(line, sizeof(line),
+				 "zones loaded: %" PRIu64 " in %.3f seconds, "
+				 "%" PRIu64 " failed (%.0f zones/sec)\n",
+				 progress.loaded, progress.elapsed / 1000000.0,
+				 progress.failed, rate);
+		}
+		CHECK(putstr(text, line));
+	}
+
 	snprintf(line, sizeof(line), "debug level: %u\n", named_g_debuglevel);
 	CHECK(putstr(text, line));
 
@@ -11970,6 +12255,18 @@ named_server_status(named_server_t *server, isc_buffer_t **text) {
 						ns_statscounter_tcphighwater));
 	CHECK(putstr(text, line));
 
+	isc_nm_queuestats(named_g_nm, &nmevents, &nmwakeups, &nmdepth);
+	snprintf(line, sizeof(line),
+		 "network events: %" PRIu64 " (%.2f wakeups/event, "
+		 "max depth %" PRIu32 ")\n",
+		 nmevents, nmevents > 0 ? (double)nmwakeups / nmevents : 0.0,
+		 nmdepth);
+	CHECK(putstr(text, line));
+
+	if (server->interfacemgr != NULL) {
+		CHECK(ns_interfacemgr_dumpbalance(server->interfacemgr, text));
+	}
+
 	reload_status = atomic_load(&server->reload_status);
 	if (reload_status != NAMED_RELOAD_DONE) {
 		snprintf(line, sizeof(line), "reload/reconfig %s\n",
@@ -33,6 +33,7 @@
 #include <dns/resolver.h>
 #include <dns/stats.h>
 #include <dns/view.h>
+#include <dns/zone.h>
 #include <dns/zt.h>
 
 #include <ns/stats.h>
@@ -141,6 +142,7 @@ static const char *nsstats_desc[ns_statscounter_max];
 static const char *resstats_desc[dns_resstatscounter_max];
 static const char *adbstats_desc[dns_adbstats_max];
 static const char *zonestats_desc[dns_zonestatscounter_max];
+static const char *zoneloadstats_desc[dns_zoneloadstatscounter_max];
 static const char *sockstats_desc[isc_sockstatscounter_max];
 static const char *dnssecstats_desc[dns_dnssecstats_max];
 static const char *udpinsizestats_desc[dns_sizecounter_in_max];
@@ -154,6 +156,7 @@ static const char *nsstats_xmldesc[ns_statscounter_max];
 static const char *resstats_xmldesc[dns_resstatscounter_max];
 static const char *adbstats_xmldesc[dns_adbstats_max];
 static const char *zonestats_xmldesc[dns_zonestatscounter_max];
+static const char *zoneloadstats_xmldesc[dns_zoneloadstatscounter_max];
 static const char *sockstats_xmldesc[isc_sockstatscounter_max];
 static const char *dnssecstats_xmldesc[dns_dnssecstats_max];
 static const char *udpinsizestats_xmldesc[dns_sizecounter_in_max];
@@ -167,6 +170,7 @@ static const char *gluecachestats_xmldesc[dns_gluecachestatscounter_max];
 #define resstats_xmldesc	NULL
 #define adbstats_xmldesc	NULL
 #define zonestats_xmldesc	NULL
+#define zoneloadstats_xmldesc	NULL
 #define sockstats_xmldesc	NULL
 #define dnssecstats_xmldesc	NULL
 #define udpinsizestats_xmldesc	NULL
@@ -193,6 +197,7 @@ static int nsstats_index[ns_statscounter_max];
 static int resstats_index[dns_resstatscounter_max];
 static int adbstats_index[dns_adbstats_max];
 static int zonestats_index[dns_zonestatscounter_max];
+static int zoneloadstats_index[dns_zoneloadstatscounter_max];
 static int sockstats_index[isc_sockstatscounter_max];
 static int dnssecstats_index[dns_dnssecstats_max];
 static int udpinsizestats_index[dns_sizecounter_in_max];
@@ -342,6 +347,17 @@ init_desc(void) {
 	SET_NSSTATDESC(reclimitdropped,
 		       "queries dropped due to recursive client limit",
 		       "RecLimitDropped");
+	SET_NSSTATDESC(fastpath,
+		       "queries answered on the receiving network thread",
+		       "FastPath");
+	SET_NSSTATDESC(threadhop,
+		       "responses sent from another network thread",
+		       "ThreadHop");
+	SET_NSSTATDESC(respcachehit, "responses sent from the response cache",
+		       "RespCacheHit");
+	SET_NSSTATDESC(respcachemiss,
+		       "responses not found in the response cache",
+		       "RespCacheMiss");
 
 	INSIST(i == ns_statscounter_max);
 
@@ -433,6 +449,17 @@ init_desc(void) {
 			"ServerQuota");
 	SET_RESSTATDESC(nextitem, "waited for next item", "NextItem");
 	SET_RESSTATDESC(priming, "priming queries", "Priming");
+	SET_RESSTATDESC(coalesced, "queries not sent as identical ones were "
+				   "in flight",
+			"QryCoalesced");
+	SET_RESSTATDESC(bucketwait, "fetch bucket lock waits",
+			"FetchBucketWait");
+	SET_RESSTATDESC(zonebucketwait, "zone counter bucket lock waits",
+			"ZoneBucketWait");
+	SET_RESSTATDESC(bucketresize, "fetch bucket index resizes",
+			"FetchBucketResize");
+	SET_RESSTATDESC(hedged, "queries hedged to another server",
+			"QryHedged");
 
 	INSIST(i == dns_resstatscounter_max);
 
@@ -495,6 +522,37 @@ init_desc(void) {
 	SET_ZONESTATDESC(xfrfail, "transfer requests failed", "XfrFail");
 	INSIST(i == dns_zonestatscounter_max);
 
+	/* Initialize zone loading statistics */
+	for (i = 0; i < dns_zoneloadstatscounter_max; i++) {
+		zoneloadstats_desc[i] = NULL;
+	}
+#if defined(EXTENDED_STATS)
+	for (i = 0; i < dns_zoneloadstatscounter_max; i++) {
+		zoneloadstats_xmldesc[i] = NULL;
+	}
+#endif /* if defined(EXTENDED_STATS) */
+
+#define SET_ZONELOADSTATDESC(counterid, desc, xmldesc)                  \
+	do {                                                            \
+		set_desc(dns_zoneloadstatscounter_##counterid,          \
+			 dns_zoneloadstatscounter_max, desc,            \
+			 zoneloadstats_desc, xmldesc,                   \
+			 zoneloadstats_xmldesc);                        \
+		zoneloadstats_index[i++] =                              \
+			dns_zoneloadstatscounter_##counterid;           \
+	} while (0)
+
+	i = 0;
+	SET_ZONELOADSTATDESC(queued, "zone loads queued", "Queued");
+	SET_ZONELOADSTATDESC(loaded, "zone loads finished", "Loaded");
+	SET_ZONELOADSTATDESC(failed, "zone loads failed", "Failed");
+	SET_ZONELOADSTATDESC(elapsed, "milliseconds spent loading",
+			     "ElapsedMs");
+	SET_ZONELOADSTATDESC(rate, "zones loaded per second", "Rate");
+	SET_ZONELOADSTATDESC(eta, "seconds until all zones are loaded",
+			     "ETA");
+	INSIST(i == dns_zoneloadstatscounter_max);
+
 	/* Initialize socket statistics */
 	for (i = 0; i < isc_sockstatscounter_max; i++) {
 		sockstats_desc[i] = NULL;
@@ -614,6 +672,32 @@ init_desc(void) {
 	SET_SOCKSTATDESC(unixactive, "Unix domain sockets active",
 			 "UnixActive");
 	SET_SOCKSTATDESC(rawactive, "Raw sockets active", "RawActive");
+	SET_SOCKSTATDESC(udp4sendbatch, "UDP/IPv4 send batches",
+			 "UDP4SendBatch");
+	SET_SOCKSTATDESC(udp6sendbatch, "UDP/IPv6 send batches",
+			 "UDP6SendBatch");
+	SET_SOCKSTATDESC(udp4sendbatchmsg, "UDP/IPv4 batched messages sent",
+			 "UDP4SendBatchMsg");
+	SET_SOCKSTATDESC(udp6sendbatchmsg, "UDP/IPv6 batched messages sent",
+			 "UDP6SendBatchMsg");
+	SET_SOCKSTATDESC(nmreqcached, "network requests reused",
+			 "NMReqCached");
+	SET_SOCKSTATDESC(nmreqalloc, "network requests allocated",
+			 "NMReqAlloc");
+	SET_SOCKSTATDESC(nmeventcached, "network events reused",
+			 "NMEventCached");
+	SET_SOCKSTATDESC(nmeventalloc, "network events allocated",
+			 "NMEventAlloc");
+	SET_SOCKSTATDESC(nmhandlecached, "network handles reused",
+			 "NMHandleCached");
+	SET_SOCKSTATDESC(nmhandlealloc, "network handles allocated",
+			 "NMHandleAlloc");
+	SET_SOCKSTATDESC(tcpdnswrites, "TCP DNS message writes",
+			 "TCPDNSWrites");
+	SET_SOCKSTATDESC(tcpdnswritemsgs, "TCP DNS messages written",
+			 "TCPDNSWriteMsgs");
+	SET_SOCKSTATDESC(tcpdnsbacklog, "TCP pipeline limit reductions",
+			 "TCPDNSBacklog");
 	INSIST(i == isc_sockstatscounter_max);
 
 	/* Initialize DNSSEC statistics */
@@ -706,6 +790,9 @@ init_desc(void) {
 	for (i = 0; i < dns_zonestatscounter_max; i++) {
 		INSIST(zonestats_desc[i] != NULL);
 	}
+	for (i = 0; i < dns_zoneloadstatscounter_max; i++) {
+		INSIST(zoneloadstats_desc[i] != NULL);
+	}
 	for (i = 0; i < isc_sockstatscounter_max; i++) {
 		INSIST(sockstats_desc[i] != NULL);
 	}
@@ -731,6 +818,9 @@ init_desc(void) {
 	for (i = 0; i < dns_zonestatscounter_max; i++) {
 		INSIST(zonestats_xmldesc[i] != NULL);
 	}
+	for (i = 0; i < dns_zoneloadstatscounter_max; i++) {
+		INSIST(zoneloadstats_xmldesc[i] != NULL);
+	}
 	for (i = 0; i < isc_sockstatscounter_max; i++) {
 		INSIST(sockstats_xmldesc[i] != NULL);
 	}
@@ -1439,6 +1529,43 @@ cleanup:
 #endif /* ifdef HAVE_LIBXML2 */
 }
 
+/*
+ * Make a statistics set holding the progress of the zone loads, so that
+ * it can be dumped like the other counters.
+ */
+static isc_result_t
+zoneloadstats_create(named_server_t *server, isc_stats_t **statsp) {
+	dns_zoneloadprogress_t progress;
+	isc_stats_t *stats = NULL;
+	uint64_t rate = 0, eta = 0;
+	isc_result_t result;
+
+	result = isc_stats_create(server->mctx, &stats,
+				  dns_zoneloadstatscounter_max);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+
+	dns_zonemgr_getloadprogress(server->zonemgr, &progress);
+	if (progress.elapsed > 0) {
+		rate = progress.loaded * 1000000 / progress.elapsed;
+	}
+	if (rate > 0) {
+		eta = (progress.queued - progress.loaded) / rate;
+	}
+
+	isc_stats_set(stats, progress.queued, dns_zoneloadstatscounter_queued);
+	isc_stats_set(stats, progress.loaded, dns_zoneloadstatscounter_loaded);
+	isc_stats_set(stats, progress.failed, dns_zoneloadstatscounter_failed);
+	isc_stats_set(stats, progress.elapsed / 1000,
+		      dns_zoneloadstatscounter_elapsed);
+	isc_stats_set(stats, rate, dns_zoneloadstatscounter_rate);
+	isc_stats_set(stats, eta, dns_zoneloadstatscounter_eta);
+
+	*statsp = stats;
+	return (ISC_R_SUCCESS);
+}
+
 static void
 rdtypestat_dump(dns_rdatastatstype_t type, uint64_t val, void *arg) {
 	char typebuf[64];
@@ -1967,6 +2094,7 @@ generatexml(named_server_t *server, uint32_t flags, int *buflen,
 	uint64_t resstat_values[dns_resstatscounter_max];
 	uint64_t adbstat_values[dns_adbstats_max];
 	uint64_t zonestat_values[dns_zonestatscounter_max];
+	uint64_t zoneloadstat_values[dns_zoneloadstatscounter_max];
 	uint64_t sockstat_values[isc_sockstatscounter_max];
 	uint64_t udpinsizestat_values[dns_sizecounter_in_max];
 	uint64_t udpoutsizestat_values[dns_sizecounter_out_max];
@@ -1975,6 +2103,7 @@ generatexml(named_server_t *server, uint32_t flags, int *buflen,
 #ifdef HAVE_DNSTAP
 	uint64_t dnstapstat_values[dns_dnstapcounter_max];
 #endif /* ifdef HAVE_DNSTAP */
+	isc_stats_t *zoneloadstats = NULL;
 	isc_result_t result;
 
 	isc_time_now(&now);
@@ -2071,6 +2200,21 @@ generatexml(named_server_t *server, uint32_t flags, int *buflen,
 
 		TRY0(xmlTextWriterEndElement(writer)); /* /zonestat */
 
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
+		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
+						 ISC_XMLCHAR "zoneloadstat"));
+
+		CHECK(zoneloadstats_create(server, &zoneloadstats));
+		result = dump_counters(zoneloadstats, isc_statsformat_xml,
+				       writer, NULL, zoneloadstats_xmldesc,
+				       dns_zoneloadstatscounter_max,
+				       zoneloadstats_index, zoneloadstat_values,
+				       ISC_STATSDUMP_VERBOSE);
+		isc_stats_detach(&zoneloadstats);
+		CHECK(result);
+
+		TRY0(xmlTextWriterEndElement(writer)); /* /zoneloadstat */
+
 		/*
 		 * Most of the common resolver statistics entries are 0, so
 		 * we don't use the verbose dump here.
@@ -2762,6 +2906,7 @@ generatejson(named_server_t *server, size_t *msglen, const char **msg,
 	uint64_t resstat_values[dns_resstatscounter_max];
 	uint64_t adbstat_values[dns_adbstats_max];
 	uint64_t zonestat_values[dns_zonestatscounter_max];
+	uint64_t zoneloadstat_values[dns_zoneloadstatscounter_max];
 	uint64_t sockstat_values[isc_sockstatscounter_max];
 	uint64_t udpinsizestat_values[dns_sizecounter_in_max];
 	uint64_t udpoutsizestat_values[dns_sizecounter_out_max];
@@ -2770,6 +2915,7 @@ generatejson(named_server_t *server, size_t *msglen, const char **msg,
 #ifdef HAVE_DNSTAP
 	uint64_t dnstapstat_values[dns_dnstapcounter_max];
 #endif /* ifdef HAVE_DNSTAP */
+	isc_stats_t *zoneloadstats = NULL;
 	stats_dumparg_t dumparg;
 	char boottime[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
 	char configtime[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
@@ -2915,6 +3061,26 @@ generatejson(named_server_t *server, size_t *msglen, const char **msg,
 			json_object_put(counters);
 		}
 
+		/* zone loading progress */
+		result = zoneloadstats_create(server, &zoneloadstats);
+		if (result != ISC_R_SUCCESS) {
+			goto cleanup;
+		}
+
+		counters = json_object_new_object();
+		result = dump_counters(zoneloadstats, isc_statsformat_json,
+				       counters, NULL, zoneloadstats_xmldesc,
+				       dns_zoneloadstatscounter_max,
+				       zoneloadstats_index, zoneloadstat_values,
+				       ISC_STATSDUMP_VERBOSE);
+		isc_stats_detach(&zoneloadstats);
+		if (result != ISC_R_SUCCESS) {
+			json_object_put(counters);
+			goto cleanup;
+		}
+
+		json_object_object_add(bindstats, "zoneloadstats", counters);
+
 		/* resolver stat counters */
 		counters = json_object_new_object();
 
@@ -3894,8 +4060,10 @@ named_stats_dump(named_server_t *server, FILE *fp) {
 	uint64_t resstat_values[dns_resstatscounter_max];
 	uint64_t adbstat_values[dns_adbstats_max];
 	uint64_t zonestat_values[dns_zonestatscounter_max];
+	uint64_t zoneloadstat_values[dns_zoneloadstatscounter_max];
 	uint64_t sockstat_values[isc_sockstatscounter_max];
 	uint64_t gluecachestats_values[dns_gluecachestatscounter_max];
+	isc_stats_t *zoneloadstats = NULL;
 
 	RUNTIME_CHECK(isc_once_do(&once, init_desc) == ISC_R_SUCCESS);
 
@@ -3945,6 +4113,16 @@ named_stats_dump(named_server_t *server, FILE *fp) {
 			    zonestats_desc, dns_zonestatscounter_max,
 			    zonestats_index, zonestat_values, 0);
 
+	fprintf(fp, "++ Zone Loading Statistics ++\n");
+	if (zoneloadstats_create(server, &zoneloadstats) == ISC_R_SUCCESS) {
+		(void)dump_counters(zoneloadstats, isc_statsformat_file, fp,
+				    NULL, zoneloadstats_desc,
+				    dns_zoneloadstatscounter_max,
+				    zoneloadstats_index, zoneloadstat_values,
+				    0);
+		isc_stats_detach(&zoneloadstats);
+	}
+
 	fprintf(fp, "++ Resolver Statistics ++\n");
 	fprintf(fp, "[Common]\n");
 	(void)dump_counters(server->resolverstats, isc_statsformat_file, fp,
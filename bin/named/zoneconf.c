@@ -1051,12 +1051,26 @@ named_zone_configure(const cfg_obj_t *config, const cfg_obj_t *vconfig,
 			masterformat = dns_masterformat_raw;
 		} else if (strcasecmp(masterformatstr, "map") == 0) {
 			masterformat = dns_masterformat_map;
+		} else if (strcasecmp(masterformatstr, "image") == 0) {
+			masterformat = dns_masterformat_image;
 		} else {
 			INSIST(0);
 			ISC_UNREACHABLE();
 		}
 	}
 
+	/*
+	 * Zone images are served straight from the mapped file by an
+	 * "image" database unless another database was configured.
+	 */
+	if (masterformat == dns_masterformat_image && raw == NULL &&
+	    cpval == default_dbtype)
+	{
+		const char *imageargv[] = { "image" };
+
+		dns_zone_setdbtype(zone, 1, imageargv);
+	}
+
 	obj = NULL;
 	result = named_config_get(maps, "masterfile-style", &obj);
 	if (result == ISC_R_SUCCESS) {
@@ -1083,12 +1097,16 @@ named_zone_configure(const cfg_obj_t *config, const cfg_obj_t *vconfig,
 
 	obj = NULL;
 	result = named_config_get(maps, "max-zone-ttl", &obj);
-	if (result == ISC_R_SUCCESS && masterformat == dns_masterformat_map) {
+	if (result == ISC_R_SUCCESS && (masterformat == dns_masterformat_map ||
+					masterformat == dns_masterformat_image))
+	{
 		isc_log_write(named_g_lctx, NAMED_LOGCATEGORY_GENERAL,
 			      NAMED_LOGMODULE_SERVER, ISC_LOG_ERROR,
 			      "zone '%s': 'max-zone-ttl' is not compatible "
-			      "with 'masterfile-format map'",
-			      zname);
+			      "with 'masterfile-format %s'",
+			      zname,
+			      masterformat == dns_masterformat_map ? "map"
+								   : "image");
 		return (ISC_R_FAILURE);
 	} else if (result == ISC_R_SUCCESS) {
 		dns_ttl_t maxttl = 0; /* unlimited */
@@ -1110,6 +1128,15 @@ named_zone_configure(const cfg_obj_t *config, const cfg_obj_t *vconfig,
 		dns_zone_setmaxrecords(zone, 0);
 	}
 
+	obj = NULL;
+	result = named_config_get(maps, "masterfile-load-threads", &obj);
+	INSIST(result == ISC_R_SUCCESS && obj != NULL);
+	if (cfg_obj_asuint32(obj) == 0) {
+		dns_zone_setloadthreads(mayberaw, named_g_cpus);
+	} else {
+		dns_zone_setloadthreads(mayberaw, cfg_obj_asuint32(obj));
+	}
+
 	if (raw != NULL && filename != NULL) {
 #define SIGNED ".signed"
 		size_t signedlen = strlen(filename) + sizeof(SIGNED);
@@ -1701,12 +1728,13 @@ named_zone_configure(const cfg_obj_t *config, const cfg_obj_t *vconfig,
 		dns_zone_setoption(mayberaw, DNS_ZONEOPT_CHECKWILDCARD, check);
 
 		/*
-		 * With map files, the default is ignore duplicate
-		 * records.  With other master formats, the default is
-		 * taken from the global configuration.
+		 * With map and image files, the default is ignore
+		 * duplicate records.  With other master formats, the
+		 * default is taken from the global configuration.
 		 */
 		obj = NULL;
-		if (masterformat != dns_masterformat_map) {
+		if (masterformat != dns_masterformat_map &&
+		    masterformat != dns_masterformat_image) {
 			result = named_config_get(maps, "check-dup-records",
 						  &obj);
 			INSIST(result == ISC_R_SUCCESS && obj != NULL);
@@ -1752,12 +1780,13 @@ named_zone_configure(const cfg_obj_t *config, const cfg_obj_t *vconfig,
 		dns_zone_setoption(mayberaw, DNS_ZONEOPT_CHECKMXFAIL, fail);
 
 		/*
-		 * With map files, the default is *not* to check
-		 * integrity.  With other master formats, the default is
-		 * taken from the global configuration.
+		 * With map and image files, the default is *not* to
+		 * check integrity.  With other master formats, the
+		 * default is taken from the global configuration.
 		 */
 		obj = NULL;
-		if (masterformat != dns_masterformat_map) {
+		if (masterformat != dns_masterformat_map &&
+		    masterformat != dns_masterformat_image) {
 			result = named_config_get(maps, "check-integrity",
 						  &obj);
 			INSIST(result == ISC_R_SUCCESS && obj != NULL);
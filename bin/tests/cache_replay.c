@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*
+ * Replay a query trace against a cache database of limited size and
+ * report the hit ratio, how many records were evicted and how fast the
+ * lookups were.  The trace is in the format used by dnsperf: one query
+ * per line, a name optionally followed by a type (A if omitted); empty
+ * lines and lines starting with ';' are ignored.  Every query that isn't
+ * answered from the cache is "resolved" by adding a record of the
+ * queried type with a dummy value, as the resolver would.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <isc/buffer.h>
+#include <isc/commandline.h>
+#include <isc/mem.h>
+#include <isc/print.h>
+#include <isc/stats.h>
+#include <isc/stdtime.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/rdatatype.h>
+#include <dns/result.h>
+#include <dns/stats.h>
+
+static isc_mem_t *mctx = NULL;
+static dns_ttl_t ttl = 86400;
+
+static uint64_t queries = 0, hits = 0, misses = 0, skipped = 0;
+
+static inline void
+CHECKRESULT(isc_result_t result, const char *msg) {
+	if (result != ISC_R_SUCCESS) {
+		fprintf(stderr, "%s: %s\n", msg, dns_result_totext(result));
+
+		exit(1);
+	}
+}
+
+static void
+usage(void) {
+	fprintf(stderr, "cache_replay [-c size] [-r passes] [-t ttl] "
+			"[filename]\n\n");
+	fprintf(stderr, "\t-c\tLimit the cache to 'size' bytes "
+			"(k, m or g may follow)\n");
+	fprintf(stderr, "\t-r\tReplay the trace 'passes' times\n");
+	fprintf(stderr, "\t-t\tTTL of the records added on a miss\n");
+}
+
+static void
+water(void *arg, int mark) {
+	UNUSED(arg);
+	UNUSED(mark);
+}
+
+static uint64_t
+parse_size(const char *arg) {
+	uint64_t size;
+	char *end = NULL;
+
+	size = strtoull(arg, &end, 10);
+	switch (*end) {
+	case 'k':
+	case 'K':
+		size <<= 10;
+		end++;
+		break;
+	case 'm':
+	case 'M':
+		size <<= 20;
+		end++;
+		break;
+	case 'g':
+	case 'G':
+		size <<= 30;
+		end++;
+		break;
+	}
+	if (end == arg || *end != '\0') {
+		fprintf(stderr, "bad cache size: %s\n", arg);
+		exit(1);
+	}
+
+	return (size);
+}
+
+/*
+ * Add a record of type 'type' with a value derived from 'serial' at 'name'.
+ */
+static void
+add(dns_db_t *db, dns_dbnode_t *node, dns_rdatatype_t type, isc_stdtime_t now,
+    uint64_t serial) {
+	unsigned char data[32];
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	isc_result_t result;
+
+	memset(data, 0, sizeof(data));
+	memmove(data, &serial, sizeof(serial));
+	rdata.data = data;
+	rdata.length = (type == dns_rdatatype_a)	? 4
+		       : (type == dns_rdatatype_aaaa) ? 16
+						      : sizeof(data);
+	rdata.rdclass = dns_rdataclass_in;
+	rdata.type = type;
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = type;
+	rdatalist.ttl = ttl;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	CHECKRESULT(result, "dns_rdatalist_tordataset");
+	rdataset.trust = dns_trust_answer;
+
+	result = dns_db_addrdataset(db, node, NULL, now, &rdataset, 0, NULL);
+	if (result != DNS_R_UNCHANGED) {
+		CHECKRESULT(result, "dns_db_addrdataset");
+	}
+	dns_rdataset_disassociate(&rdataset);
+}
+
+static void
+query(dns_db_t *db, char *line, isc_stdtime_t now) {
+	dns_fixedname_t fname, ffound;
+	dns_name_t *name = dns_fixedname_initname(&fname);
+	dns_name_t *found = dns_fixedname_initname(&ffound);
+	dns_rdatatype_t type = dns_rdatatype_a;
+	dns_rdataset_t rdataset;
+	dns_dbnode_t *node = NULL;
+	isc_buffer_t source;
+	isc_result_t result;
+	char *qname, *qtype, *last = NULL;
+
+	qname = strtok_r(line, " \t\r\n", &last);
+	if (qname == NULL || *qname == ';') {
+		return;
+	}
+	qtype = strtok_r(NULL, " \t\r\n", &last);
+
+	queries++;
+
+	isc_buffer_constinit(&source, qname, strlen(qname));
+	isc_buffer_add(&source, strlen(qname));
+	result = dns_name_fromtext(name, &source, dns_rootname, 0, NULL);
+	if (result == ISC_R_SUCCESS && qtype != NULL) {
+		isc_textregion_t r;
+
+		r.base = qtype;
+		r.length = strlen(qtype);
+		result = dns_rdatatype_fromtext(&type, &r);
+	}
+	if (result != ISC_R_SUCCESS || dns_rdatatype_ismeta(type) ||
+	    type == dns_rdatatype_rrsig || type == dns_rdatatype_sig)
+	{
+		skipped++;
+		return;
+	}
+
+	dns_rdataset_init(&rdataset);
+	result = dns_db_find(db, name, NULL, type, 0, now, &node, found,
+			     &rdataset, NULL);
+	switch (result) {
+	case ISC_R_SUCCESS:
+	case DNS_R_CNAME:
+	case DNS_R_DNAME:
+	case DNS_R_NCACHENXDOMAIN:
+	case DNS_R_NCACHENXRRSET:
+		hits++;
+		break;
+	default:
+		misses++;
+		if (node != NULL) {
+			dns_db_detachnode(db, &node);
+		}
+		result = dns_db_findnode(db, name, true, &node);
+		CHECKRESULT(result, "dns_db_findnode");
+		add(db, node, type, now, misses);
+	}
+
+	if (dns_rdataset_isassociated(&rdataset)) {
+		dns_rdataset_disassociate(&rdataset);
+	}
+	if (node != NULL) {
+		dns_db_detachnode(db, &node);
+	}
+}
+
+int
+main(int argc, char *argv[]) {
+	uint64_t values[dns_cachestatscounter_max];
+	uint64_t size = 0, elapsed;
+	unsigned int passes = 1, pass;
+	isc_stats_t *stats = NULL;
+	isc_mem_t *cmctx = NULL;
+	dns_db_t *db = NULL;
+	isc_time_t start, finish;
+	isc_stdtime_t now;
+	isc_result_t result;
+	char *dbargv[1];
+	char line[BUFSIZ];
+	FILE *f;
+	int ch, i;
+
+	while ((ch = isc_commandline_parse(argc, argv, "c:r:t:")) != -1) {
+		switch (ch) {
+		case 'c':
+			size = parse_size(isc_commandline_argument);
+			break;
+		case 'r':
+			passes = atoi(isc_commandline_argument);
+			break;
+		case 't':
+			ttl = atoi(isc_commandline_argument);
+			break;
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	argc -= isc_commandline_index;
+	argv += isc_commandline_index;
+
+	if (argc >= 1) {
+		f = fopen(argv[0], "r");
+		if (f == NULL) {
+			fprintf(stderr, "%s: fopen failed\n", argv[0]);
+			exit(1);
+		}
+	} else if (passes == 1) {
+		f = stdin;
+	} else {
+		fprintf(stderr, "a file name is needed to replay the trace "
+				"more than once\n");
+		exit(1);
+	}
+
+	dns_result_register();
+	isc_mem_create(&mctx);
+	isc_mem_create(&cmctx);
+
+	dbargv[0] = (char *)mctx;
+	result = dns_db_create(cmctx, "rbt", dns_rootname, dns_dbtype_cache,
+			       dns_rdataclass_in, 1, dbargv, &db);
+	CHECKRESULT(result, "dns_db_create");
+
+	isc_stats_create(mctx, &stats, dns_cachestatscounter_max);
+	dns_db_setcachestats(db, stats);
+
+	/* The same limits as dns_cache_setcachesize() */
+	if (size != 0) {
+		isc_mem_setwater(cmctx, water, NULL, size - (size >> 3),
+				 size - (size >> 2));
+		dns_db_adjusthashsize(db, size);
+	}
+
+	isc_stdtime_get(&now);
+	isc_time_now_hires(&start);
+	for (pass = 0; pass < passes; pass++) {
+		rewind(f);
+		while (fgets(line, sizeof(line), f) != NULL) {
+			query(db, line, now);
+		}
+	}
+	isc_time_now_hires(&finish);
+	elapsed = isc_time_microdiff(&finish, &start);
+
+	for (i = 0; i < dns_cachestatscounter_max; i++) {
+		values[i] = isc_stats_get_counter(stats, i);
+	}
+
+	printf("%20" PRIu64 " queries\n", queries);
+	printf("%20" PRIu64 " queries skipped\n", skipped);
+	printf("%20" PRIu64 " cache hits\n", hits);
+	printf("%20" PRIu64 " cache misses\n", misses);
+	printf("%20.2f%% hit ratio\n",
+	       hits + misses == 0 ? 0.0 : 100.0 * hits / (hits + misses));
+	printf("%20" PRIu64 " records evicted\n",
+	       values[dns_cachestatscounter_deletelru]);
+	printf("%20" PRIu64 " records expired\n",
+	       values[dns_cachestatscounter_deletettl]);
+	printf("%20" PRIu64 " records examined for eviction\n",
+	       values[dns_cachestatscounter_evictscanned]);
+	printf("%20" PRIu64 " records spared from eviction\n",
+	       values[dns_cachestatscounter_evictspared]);
+	printf("%20u cache database nodes\n", dns_db_nodecount(db));
+	printf("%20zu bytes of cache memory in use\n", isc_mem_inuse(cmctx));
+	printf("%20.3f seconds\n", elapsed / 1000000.0);
+	printf("%20.0f queries per second\n",
+	       elapsed == 0 ? 0.0 : queries * 1000000.0 / elapsed);
+
+	if (f != stdin) {
+		fclose(f);
+	}
+
+	dns_db_detach(&db);
+	isc_stats_detach(&stats);
+	isc_mem_detach(&cmctx);
+	isc_mem_destroy(&mctx);
+
+	return (0);
+}
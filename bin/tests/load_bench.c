@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*
+ * Load a text zone file into a zone database with different numbers of
+ * threads and report how many records per second were loaded.  If no
+ * file is given, a synthetic zone with the requested number of records
+ * is generated in a temporary file in the current directory: mostly A
+ * records, with AAAA, MX and TXT records at some of the names.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <isc/buffer.h>
+#include <isc/commandline.h>
+#include <isc/file.h>
+#include <isc/mem.h>
+#include <isc/os.h>
+#include <isc/print.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/callbacks.h>
+#include <dns/db.h>
+#include <dns/fixedname.h>
+#include <dns/master.h>
+#include <dns/name.h>
+#include <dns/rdataset.h>
+#include <dns/result.h>
+
+#define MAXRUNS 32
+
+static isc_mem_t *mctx = NULL;
+
+static dns_addrdatasetfunc_t add;
+static void *add_private;
+static uint64_t records;
+
+static inline void
+CHECKRESULT(isc_result_t result, const char *msg) {
+	if (result != ISC_R_SUCCESS) {
+		fprintf(stderr, "%s: %s\n", msg, dns_result_totext(result));
+
+		exit(1);
+	}
+}
+
+static void
+usage(void) {
+	fprintf(stderr, "load_bench [-n records] [-o origin] "
+			"[-t threads[,threads...]] [filename]\n\n");
+	fprintf(stderr, "\t-n\tGenerate a zone with 'records' records "
+			"(default 1000000)\n");
+	fprintf(stderr, "\t-o\tOrigin of the zone (default example.)\n");
+	fprintf(stderr, "\t-t\tLoad the zone with each of these numbers of "
+			"threads\n\t\t(default 1 and the number of CPUs)\n");
+}
+
+/*
+ * Write a zone with 'count' records, including its SOA and NS records,
+ * to 'f'.
+ */
+static void
+generate(FILE *f, const char *origin, uint64_t count) {
+	uint64_t n = 2, i;
+
+	fprintf(f, "$ORIGIN %s\n$TTL 3600\n", origin);
+	fprintf(f, "@\tSOA\tns1 hostmaster 1 3600 900 604800 300\n");
+	fprintf(f, "\tNS\tns1\n");
+
+	for (i = 0; n < count; i++) {
+		fprintf(f, "host%" PRIu64 "\tA\t10.%u.%u.%u\n", i,
+			(unsigned int)(i >> 16) & 0xff,
+			(unsigned int)(i >> 8) & 0xff, (unsigned int)i & 0xff);
+		n++;
+		if (i % 4 == 0 && n < count) {
+			fprintf(f, "\tAAAA\tfd00::%x:%x\n",
+				(unsigned int)(i >> 16) & 0xffff,
+				(unsigned int)i & 0xffff);
+			n++;
+		}
+		if (i % 8 == 0 && n < count) {
+			fprintf(f, "\tMX\t10 mail%" PRIu64 "\n", i % 100);
+			n++;
+		}
+		if (i % 16 == 0 && n < count) {
+			fprintf(f, "\tTXT\t\"v=spf1 ip4:10.0.0.0/8 -all\"\n");
+			n++;
+		}
+	}
+}
+
+/*
+ * Count the records that are added to the database.  Calls are never
+ * concurrent.
+ */
+static isc_result_t
+countadd(void *arg, const dns_name_t *owner, dns_rdataset_t *rdataset) {
+	UNUSED(arg);
+
+	records += dns_rdataset_count(rdataset);
+
+	return ((*add)(add_private, owner, rdataset));
+}
+
+static void
+load(const char *filename, dns_name_t *origin, unsigned int nthreads) {
+	dns_rdatacallbacks_t callbacks;
+	dns_loadpool_t *pool = NULL;
+	dns_db_t *db = NULL;
+	isc_time_t start, finish;
+	uint64_t elapsed;
+	isc_result_t result;
+
+	result = dns_db_create(mctx, "rbt", origin, dns_dbtype_zone,
+			       dns_rdataclass_in, 0, NULL, &db);
+	CHECKRESULT(result, "dns_db_create");
+
+	dns_rdatacallbacks_init(&callbacks);
+	result = dns_db_beginload(db, &callbacks);
+	CHECKRESULT(result, "dns_db_beginload");
+	add = callbacks.add;
+	add_private = callbacks.add_private;
+	callbacks.add = countadd;
+	callbacks.add_private = NULL;
+	records = 0;
+
+	dns_loadpool_create(mctx, nthreads, &pool);
+
+	isc_time_now_hires(&start);
+	result = dns_master_loadfileparallel(
+		filename, origin, origin, dns_rdataclass_in, 0, 0, &callbacks,
+		NULL, NULL, NULL, NULL, NULL, NULL, mctx, 0, pool, nthreads);
+	CHECKRESULT(result, "dns_master_loadfileparallel");
+	callbacks.add = add;
+	callbacks.add_private = add_private;
+	result = dns_db_endload(db, &callbacks);
+	CHECKRESULT(result, "dns_db_endload");
+	isc_time_now_hires(&finish);
+	elapsed = isc_time_microdiff(&finish, &start);
+	dns_loadpool_destroy(&pool);
+
+	printf("%8u %12" PRIu64 " %10u %10.3f %14.0f\n", nthreads, records,
+	       dns_db_nodecount(db), elapsed / 1000000.0,
+	       elapsed == 0 ? 0.0 : records * 1000000.0 / elapsed);
+
+	dns_db_detach(&db);
+}
+
+int
+main(int argc, char *argv[]) {
+	unsigned int threads[MAXRUNS];
+	unsigned int nruns = 0, i;
+	uint64_t count = 1000000;
+	const char *origintext = "example.";
+	char *filename = NULL, *p, *last = NULL;
+	char templet[] = "load_bench.XXXXXX";
+	dns_fixedname_t forigin;
+	dns_name_t *origin;
+	isc_buffer_t source;
+	isc_result_t result;
+	FILE *f = NULL;
+	int ch;
+
+	while ((ch = isc_commandline_parse(argc, argv, "n:o:t:")) != -1) {
+		switch (ch) {
+		case 'n':
+			count = strtoull(isc_commandline_argument, NULL, 10);
+			break;
+		case 'o':
+			origintext = isc_commandline_argument;
+			break;
+		case 't':
+			for (p = strtok_r(isc_commandline_argument, ",", &last);
+			     p != NULL && nruns < MAXRUNS;
+			     p = strtok_r(NULL, ",", &last))
+			{
+				threads[nruns] = atoi(p);
+				if (threads[nruns] == 0) {
+					usage();
+					exit(1);
+				}
+				nruns++;
+			}
+			break;
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	argc -= isc_commandline_index;
+	argv += isc_commandline_index;
+
+	if (nruns == 0) {
+		threads[nruns++] = 1;
+		if (isc_os_ncpus() > 1) {
+			threads[nruns++] = isc_os_ncpus();
+		}
+	}
+
+	dns_result_register();
+	isc_mem_create(&mctx);
+
+	origin = dns_fixedname_initname(&forigin);
+	isc_buffer_constinit(&source, origintext, strlen(origintext));
+	isc_buffer_add(&source, strlen(origintext));
+	result = dns_name_fromtext(origin, &source, dns_rootname, 0, NULL);
+	CHECKRESULT(result, "dns_name_fromtext");
+
+	if (argc >= 1) {
+		filename = argv[0];
+	} else {
+		result = isc_file_openunique(templet, &f);
+		CHECKRESULT(result, "isc_file_openunique");
+		generate(f, origintext, count);
+		if (fclose(f) != 0) {
+			fprintf(stderr, "%s: fclose failed\n", templet);
+			(void)isc_file_remove(templet);
+			exit(1);
+		}
+		filename = templet;
+	}
+
+	printf("%8s %12s %10s %10s %14s\n", "threads", "records", "nodes",
+	       "seconds", "records/sec");
+	for (i = 0; i < nruns; i++) {
+		load(filename, origin, threads[i]);
+	}
+
+	if (filename == templet) {
+		(void)isc_file_remove(templet);
+	}
+
+	isc_mem_destroy(&mctx);
+
+	return (0);
+}
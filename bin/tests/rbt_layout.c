@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*
+ * Print the layout of dns_rbtnode_t: the offset and size of each member
+ * that isn't a bit-field.  Members that dns_rbt_findnode() reads on its
+ * way down the tree are marked with '*'; the exit status is 1 if one of
+ * them doesn't lie within the first DNS_RBTNODE_HOTSIZE bytes of the
+ * node.  Nodes aren't allocated on cache line boundaries, so the number
+ * of cache lines the marked members span depends on where the node
+ * starts; the span printed at the end is the worst case.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <isc/print.h>
+#include <isc/util.h>
+
+#include <dns/rbt.h>
+
+#define CACHELINE 64
+
+/* The least alignment that isc_mem_get() guarantees. */
+#define NODEALIGN sizeof(void *)
+
+#define MEMBER(m, hot)                                                   \
+	{ #m, offsetof(dns_rbtnode_t, m), sizeof(((dns_rbtnode_t *)0)->m), \
+	  hot }
+
+static struct {
+	const char *name;
+	size_t offset;
+	size_t size;
+	bool hot;
+} members[] = {
+#if DNS_RBT_USEMAGIC
+	MEMBER(magic, false),
+#endif /* if DNS_RBT_USEMAGIC */
+	MEMBER(hashval, true),	 MEMBER(hashnext, true),
+	MEMBER(uppernode, true), MEMBER(down, true),
+	MEMBER(data, true),	 MEMBER(parent, true),
+	MEMBER(left, false),	 MEMBER(right, false),
+	MEMBER(deadlink, false), MEMBER(locknum, false),
+	MEMBER(references, false),
+};
+
+int
+main(void) {
+	int status = 0;
+	size_t hotend = 0;
+	size_t lines = 0;
+
+	printf("dns_rbtnode_t: %zu bytes, name data follows at offset "
+	       "%zu\n\n",
+	       sizeof(dns_rbtnode_t), sizeof(dns_rbtnode_t));
+	printf("  %-12s %6s %4s\n", "member", "offset", "size");
+
+	for (size_t i = 0; i < ARRAY_SIZE(members); i++) {
+		size_t end = members[i].offset + members[i].size;
+
+		printf("%c %-12s %6zu %4zu\n", members[i].hot ? '*' : ' ',
+		       members[i].name, members[i].offset, members[i].size);
+
+		if (!members[i].hot) {
+			continue;
+		}
+		hotend = ISC_MAX(hotend, end);
+		if (end > DNS_RBTNODE_HOTSIZE) {
+			status = 1;
+		}
+	}
+
+	/*
+	 * The lookup members and the bit-fields before them start at the
+	 * beginning of the node; try every position of the node within a
+	 * cache line that its alignment allows.
+	 */
+	for (size_t start = 0; start < CACHELINE; start += NODEALIGN) {
+		lines = ISC_MAX(lines, (start + hotend - 1) / CACHELINE + 1);
+	}
+
+	printf("\nlookup members: bytes 0-%zu, at most %zu cache line%s\n",
+	       hotend - 1, lines, lines == 1 ? "" : "s");
+
+	if (status != 0) {
+		printf("\nlookup members exceed DNS_RBTNODE_HOTSIZE (%u)\n",
+		       DNS_RBTNODE_HOTSIZE);
+	}
+
+	return (status);
+}
@@ -0,0 +1,184 @@
+#!/bin/sh
+#
+# Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, you can obtain one at https://mozilla.org/MPL/2.0/.
+#
+# See the COPYRIGHT file distributed with this work for additional
+# information regarding copyright ownership.
+
+# shellcheck source=conf.sh
+. ../conf.sh
+
+RNDCCMD="$RNDC -c ../common/rndc.conf -p ${CONTROLPORT} -s"
+
+status=0
+n=0
+
+dig_with_opts() {
+	"$DIG" -p "${PORT}" +norec +nosearch +nostat +nocmd +ignore "$@" @10.53.0.1
+}
+
+# Print the value of the server statistics counter described as "$1".
+getstat() {
+	rm -f ns1/named.stats
+	$RNDCCMD 10.53.0.1 stats > /dev/null 2>&1
+	for try in 1 2 3 4 5; do
+		[ -f ns1/named.stats ] && break
+		sleep 1
+	done
+	value=$(sed -n "s/^ *\([0-9][0-9]*\) $1\$/\1/p" ns1/named.stats)
+	echo "${value:-0}"
+}
+
+hits() {
+	getstat "responses sent from the response cache"
+}
+
+misses() {
+	getstat "responses not found in the response cache"
+}
+
+n=$((n+1))
+echo_i "checking that a repeated query is answered from the response cache ($n)"
+ret=0
+dig_with_opts a.example A > dig.out.1.test$n || ret=1
+hits=$(hits)
+dig_with_opts a.example A > dig.out.2.test$n || ret=1
+[ "$(hits)" -eq $((hits+1)) ] || ret=1
+grep "status: NOERROR" dig.out.2.test$n > /dev/null || ret=1
+grep "^a\.example\..*A.*10\.0\.0\.1" dig.out.2.test$n > /dev/null || ret=1
+digcomp dig.out.1.test$n dig.out.2.test$n || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=$((status+ret))
+
+n=$((n+1))
+echo_i "checking that a cached response gets the ID and RD flag of the query ($n)"
+ret=0
+hits=$(hits)
+dig_with_opts +qid=4660 +rec a.example A > dig.out.1.test$n || ret=1
+dig_with_opts +qid=22136 +norec a.example A > dig.out.2.test$n || ret=1
+[ "$(hits)" -eq $((hits+2)) ] || ret=1
+grep "status: NOERROR, id: 4660$" dig.out.1.test$n > /dev/null || ret=1
+grep "status: NOERROR, id: 22136$" dig.out.2.test$n > /dev/null || ret=1
+grep "flags: qr aa rd;" dig.out.1.test$n > /dev/null || ret=1
+grep "flags: qr aa;" dig.out.2.test$n > /dev/null || ret=1
+digcomp dig.out.1.test$n dig.out.2.test$n || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=$((status+ret))
+
+n=$((n+1))
+echo_i "checking that a cached response gets the OPT record of the query ($n)"
+ret=0
+hits=$(hits)
+dig_with_opts +noedns a.example A > dig.out.1.test$n || ret=1
+dig_with_opts +nsid a.example A > dig.out.2.test$n || ret=1
+[ "$(hits)" -eq $((hits+2)) ] || ret=1
+grep "OPT PSEUDOSECTION" dig.out.1.test$n > /dev/null && ret=1
+grep "ADDITIONAL: 1$" dig.out.1.test$n > /dev/null || ret=1
+grep "OPT PSEUDOSECTION" dig.out.2.test$n > /dev/null || ret=1
+grep "ADDITIONAL: 2$" dig.out.2.test$n > /dev/null || ret=1
+grep "; NSID: .*(\"ns1.example\")" dig.out.2.test$n > /dev/null || ret=1
+grep "; COOKIE: .* (good)" dig.out.2.test$n > /dev/null || ret=1
+digcomp dig.out.1.test$n dig.out.2.test$n || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=$((status+ret))
+
+n=$((n+1))
+echo_i "checking that DO queries are cached separately ($n)"
+ret=0
+misses=$(misses)
+dig_with_opts +dnssec a.example A > dig.out.1.test$n || ret=1
+[ "$(misses)" -eq $((misses+1)) ] || ret=1
+hits=$(hits)
+dig_with_opts +dnssec a.example A > dig.out.2.test$n || ret=1
+dig_with_opts a.example A > dig.out.3.test$n || ret=1
+[ "$(hits)" -eq $((hits+2)) ] || ret=1
+grep "flags: do;" dig.out.2.test$n > /dev/null || ret=1
+grep "^a\.example\..*RRSIG.*A" dig.out.2.test$n > /dev/null || ret=1
+grep "RRSIG" dig.out.3.test$n > /dev/null && ret=1
+digcomp dig.out.1.test$n dig.out.2.test$n || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=$((status+ret))
+
+n=$((n+1))
+echo_i "checking that a negative response is cached ($n)"
+ret=0
+dig_with_opts b.example A > dig.out.1.test$n || ret=1
+hits=$(hits)
+dig_with_opts b.example A > dig.out.2.test$n || ret=1
+[ "$(hits)" -eq $((hits+1)) ] || ret=1
+grep "status: NXDOMAIN" dig.out.2.test$n > /dev/null || ret=1
+digcomp dig.out.1.test$n dig.out.2.test$n || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=$((status+ret))
+
+n=$((n+1))
+echo_i "updating the zone ($n)"
+ret=0
+$NSUPDATE > nsupdate.out.test$n 2>&1 << END || ret=1
+server 10.53.0.1 ${PORT}
+zone example
+update delete a.example A
+update add a.example 300 A 10.0.0.2
+update add b.example 300 A 10.0.0.3
+send
+END
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=$((status+ret))
+
+n=$((n+1))
+echo_i "checking that cached responses are not sent after an update ($n)"
+ret=0
+hits=$(hits)
+misses=$(misses)
+dig_with_opts a.example A > dig.out.1.test$n || ret=1
+dig_with_opts +dnssec a.example A > dig.out.2.test$n || ret=1
+dig_with_opts b.example A > dig.out.3.test$n || ret=1
+[ "$(hits)" -eq "$hits" ] || ret=1
+[ "$(misses)" -eq $((misses+3)) ] || ret=1
+grep "^a\.example\..*A.*10\.0\.0\.2" dig.out.1.test$n > /dev/null || ret=1
+grep "10\.0\.0\.1" dig.out.1.test$n > /dev/null && ret=1
+grep "^a\.example\..*A.*10\.0\.0\.2" dig.out.2.test$n > /dev/null || ret=1
+grep "^a\.example\..*RRSIG.*A" dig.out.2.test$n > /dev/null || ret=1
+grep "status: NOERROR" dig.out.3.test$n > /dev/null || ret=1
+grep "^b\.example\..*A.*10\.0\.0\.3" dig.out.3.test$n > /dev/null || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=$((status+ret))
+
+n=$((n+1))
+echo_i "checking that responses are cached again after an update ($n)"
+ret=0
+hits=$(hits)
+dig_with_opts a.example A > dig.out.1.test$n || ret=1
+dig_with_opts +dnssec a.example A > dig.out.2.test$n || ret=1
+[ "$(hits)" -eq $((hits+2)) ] || ret=1
+grep "^a\.example\..*A.*10\.0\.0\.2" dig.out.1.test$n > /dev/null || ret=1
+grep "^a\.example\..*A.*10\.0\.0\.2" dig.out.2.test$n > /dev/null || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=$((status+ret))
+
+n=$((n+1))
+echo_i "checking that a cached response too large for the query is rendered ($n)"
+ret=0
+dig_with_opts +bufsize=4096 big.example TXT > dig.out.1.test$n || ret=1
+hits=$(hits)
+dig_with_opts +bufsize=4096 big.example TXT > dig.out.2.test$n || ret=1
+[ "$(hits)" -eq $((hits+1)) ] || ret=1
+misses=$(misses)
+dig_with_opts +bufsize=512 big.example TXT > dig.out.3.test$n || ret=1
+[ "$(misses)" -eq $((misses+1)) ] || ret=1
+hits=$(hits)
+dig_with_opts +bufsize=4096 big.example TXT > dig.out.4.test$n || ret=1
+[ "$(hits)" -eq $((hits+1)) ] || ret=1
+grep "flags: qr aa;" dig.out.2.test$n > /dev/null || ret=1
+grep -c "^big\.example\..*TXT" dig.out.2.test$n | grep "^4$" > /dev/null || ret=1
+grep "flags: qr aa tc;" dig.out.3.test$n > /dev/null || ret=1
+digcomp dig.out.1.test$n dig.out.4.test$n || ret=1
+if [ $ret != 0 ]; then echo_i "failed"; fi
+status=$((status+ret))
+
+echo_i "exit status: $status"
+[ $status -eq 0 ] || exit 1
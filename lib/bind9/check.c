@@ -913,6 +913,7 @@ check_options(const cfg_obj_t *options, isc_log_t *logctx, isc_mem_t *mctx,
 	 * (scale * value) <= UINT32_MAX
 	 */
 	static intervaltable intervals[] = {
+		{ "cache-snapshot-interval", 1, 24 * 60 * 60 }, /* 24 hours */
 		{ "heartbeat-interval", 60, 28 * 24 * 60 },    /* 28 days */
 		{ "interface-interval", 60, 28 * 24 * 60 },    /* 28 days */
 		{ "max-transfer-idle-in", 60, 28 * 24 * 60 },  /* 28 days */
@@ -980,6 +981,18 @@ check_options(const cfg_obj_t *options, isc_log_t *logctx, isc_mem_t *mctx,
 		}
 	}
 
+	obj = NULL;
+	(void)cfg_map_get(options, "cache-shards", &obj);
+	if (obj != NULL) {
+		uint32_t shards = cfg_obj_asuint32(obj);
+		if (shards < 1 || shards > MAX_CACHE_SHARDS) {
+			cfg_obj_log(obj, logctx, ISC_LOG_ERROR,
+				    "cache-shards '%u' is out of range (1..%u)",
+				    shards, MAX_CACHE_SHARDS);
+			result = ISC_R_RANGE;
+		}
+	}
+
 	/*
 	 * Check dnssec-policy.
 	 */
@@ -1586,6 +1599,16 @@ check_options(const cfg_obj_t *options, isc_log_t *logctx, isc_mem_t *mctx,
 		}
 	}
 
+	obj = NULL;
+	(void)cfg_map_get(options, "hedged-queries", &obj);
+	if (obj != NULL && cfg_obj_aspercentage(obj) > 100) {
+		cfg_obj_log(obj, logctx, ISC_LOG_ERROR,
+			    "'hedged-queries' must not exceed 100%%");
+		if (result == ISC_R_SUCCESS) {
+			result = ISC_R_RANGE;
+		}
+	}
+
 	obj = NULL;
 	(void)cfg_map_get(options, "check-names", &obj);
 	if (obj != NULL && !cfg_obj_islist(obj)) {
@@ -2974,6 +2997,8 @@ check_zoneconf(const cfg_obj_t *zconfig, const cfg_obj_t *voptions,
 
 	/*
 	 * Check that max-zone-ttl isn't used with masterfile-format map
+	 * or image, and that zones served from an image aren't expected
+	 * to change.
 	 */
 	masterformat = dns_masterformat_text;
 	obj = NULL;
@@ -2986,13 +3011,16 @@ check_zoneconf(const cfg_obj_t *zconfig, const cfg_obj_t *voptions,
 			masterformat = dns_masterformat_raw;
 		} else if (strcasecmp(masterformatstr, "map") == 0) {
 			masterformat = dns_masterformat_map;
+		} else if (strcasecmp(masterformatstr, "image") == 0) {
+			masterformat = dns_masterformat_image;
 		} else {
 			INSIST(0);
 			ISC_UNREACHABLE();
 		}
 	}
 
-	if (masterformat == dns_masterformat_map) {
+	if (masterformat == dns_masterformat_map ||
+	    masterformat == dns_masterformat_image) {
 		obj = NULL;
 		(void)cfg_map_get(zoptions, "max-zone-ttl", &obj);
 		if (obj == NULL && voptions != NULL) {
@@ -3004,8 +3032,43 @@ check_zoneconf(const cfg_obj_t *zconfig, const cfg_obj_t *voptions,
 		if (obj != NULL) {
 			cfg_obj_log(zconfig, logctx, ISC_LOG_ERROR,
 				    "zone '%s': 'max-zone-ttl' is not "
-				    "compatible with 'masterfile-format map'",
-				    znamestr);
+				    "compatible with 'masterfile-format %s'",
+				    znamestr,
+				    masterformat == dns_masterformat_map
+					    ? "map"
+					    : "image");
+			result = ISC_R_FAILURE;
+		}
+	}
+
+	if (masterformat == dns_masterformat_image) {
+		const char *what = NULL;
+
+		obj = NULL;
+		(void)cfg_map_get(zoptions, "inline-signing", &obj);
+		if (obj != NULL && cfg_obj_asboolean(obj)) {
+			what = "inline-signing";
+		}
+		obj = NULL;
+		(void)cfg_map_get(zoptions, "auto-dnssec", &obj);
+		if (obj != NULL && strcasecmp(cfg_obj_asstring(obj), "off") != 0)
+		{
+			what = "auto-dnssec";
+		}
+		if (has_dnssecpolicy) {
+			what = "dnssec-policy";
+		}
+		if (ddns) {
+			what = "dynamic updates";
+		}
+		if (ztype == CFG_ZONE_STUB) {
+			what = "stub zones";
+		}
+		if (what != NULL) {
+			cfg_obj_log(zconfig, logctx, ISC_LOG_ERROR,
+				    "zone '%s': %s can't be used with "
+				    "'masterfile-format image'",
+				    znamestr, what);
 			result = ISC_R_FAILURE;
 		}
 	}
@@ -5027,6 +5090,15 @@ bind9_check_namedconf(const cfg_obj_t *config, bool check_plugins,
 				    "option if views are present");
 			result = ISC_R_FAILURE;
 		}
+
+		obj = NULL;
+		tresult = cfg_map_get(options, "cache-snapshot", &obj);
+		if (tresult == ISC_R_SUCCESS) {
+			cfg_obj_log(obj, logctx, ISC_LOG_ERROR,
+				    "'cache-snapshot' cannot be a global "
+				    "option if views are present");
+			result = ISC_R_FAILURE;
+		}
 	}
 
 	cfg_map_get(config, "acl", &acls);
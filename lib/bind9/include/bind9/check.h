@@ -31,6 +31,10 @@
 #define MAX_MAX_NCACHE_TTL 7 * 24 * 3600
 #endif /* MAX_MAX_NCACHE_TTL */
 
+#ifndef MAX_CACHE_SHARDS
+#define MAX_CACHE_SHARDS 64 /* DNS_SHARDCACHE_MAX in lib/dns/shardcache.h */
+#endif /* MAX_CACHE_SHARDS */
+
 ISC_LANG_BEGINDECLS
 
 isc_result_t
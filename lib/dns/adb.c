@@ -84,6 +84,18 @@
 
 #define DNS_ADB_MINADBSIZE (1024U * 1024U) /*%< 1 Megabyte */
 
+/*%
+ * The round trip times of the responses from an address are counted in
+ * a histogram with two buckets per power of two, from 256 microseconds
+ * up.  When it holds ADB_RTT_MAXSAMPLES samples, every bucket is halved
+ * so that older samples weigh less.  Percentiles are only reported once
+ * there are ADB_RTT_MINSAMPLES samples.
+ */
+#define ADB_RTT_BUCKETS	   32
+#define ADB_RTT_MINSHIFT   8
+#define ADB_RTT_MAXSAMPLES 1024
+#define ADB_RTT_MINSAMPLES 16
+
 typedef ISC_LIST(dns_adbname_t) dns_adbnamelist_t;
 typedef struct dns_adbnamehook dns_adbnamehook_t;
 typedef ISC_LIST(dns_adbnamehook_t) dns_adbnamehooklist_t;
@@ -243,6 +255,8 @@ struct dns_adbentry {
 
 	unsigned int flags;
 	unsigned int srtt;
+	uint16_t rtthist[ADB_RTT_BUCKETS];
+	uint16_t rttsamples;
 	uint16_t udpsize;
 	unsigned int completed;
 	unsigned int timeouts;
@@ -372,6 +386,8 @@ dump_entry(FILE *, dns_adb_t *, dns_adbentry_t *, bool, isc_stdtime_t);
 static void
 adjustsrtt(dns_adbaddrinfo_t *addr, unsigned int rtt, unsigned int factor,
 	   isc_stdtime_t now);
+static unsigned int
+rttpercentile(dns_adbentry_t *entry, unsigned int percent);
 static void
 shutdown_task(isc_task_t *task, isc_event_t *ev);
 static void
@@ -1894,6 +1910,8 @@ new_adbentry(dns_adb_t *adb) {
 	e->cookie = NULL;
 	e->cookielen = 0;
 	e->srtt = (isc_random_uniform(0x1f)) + 1;
+	memset(e->rtthist, 0, sizeof(e->rtthist));
+	e->rttsamples = 0;
 	e->lastage = 0;
 	e->expires = 0;
 	atomic_init(&e->active, 0);
@@ -3649,6 +3667,10 @@ dump_entry(FILE *f, dns_adb_t *adb, dns_adbentry_t *entry, bool debug,
 		"[plain %u/%u]",
 		addrbuf, entry->srtt, entry->flags, entry->edns, entry->ednsto,
 		entry->plain, entry->plainto);
+	if (entry->rttsamples >= ADB_RTT_MINSAMPLES) {
+		fprintf(f, " [p50 %u] [p99 %u]", rttpercentile(entry, 50),
+			rttpercentile(entry, 99));
+	}
 	if (entry->udpsize != 0U) {
 		fprintf(f, " [udpsize %u]", entry->udpsize);
 	}
@@ -4317,6 +4339,114 @@ adjustsrtt(dns_adbaddrinfo_t *addr, unsigned int rtt, unsigned int factor,
 	}
 }
 
+/*
+ * Return the histogram bucket for a round trip time of 'rtt'
+ * microseconds.
+ */
+static unsigned int
+rttbucket(unsigned int rtt) {
+	unsigned int shift = ADB_RTT_MINSHIFT;
+	unsigned int b;
+
+	if (rtt < (1U << ADB_RTT_MINSHIFT)) {
+		return (0);
+	}
+	while (shift < 31 && (rtt >> (shift + 1)) != 0) {
+		shift++;
+	}
+	b = 2 * (shift - ADB_RTT_MINSHIFT) + ((rtt >> (shift - 1)) & 1);
+
+	return (ISC_MIN(b, ADB_RTT_BUCKETS - 1));
+}
+
+/*
+ * Estimate the round trip time below which 'percent' percent of the
+ * samples of 'entry' fall, assuming that they are evenly spread
+ * within each bucket.
+ *
+ * Caller must be holding the entry lock.
+ */
+static unsigned int
+rttpercentile(dns_adbentry_t *entry, unsigned int percent) {
+	unsigned int target, count = 0, shift, low = 0, width = 0, b;
+
+	target = (entry->rttsamples * percent + 99) / 100;
+	if (target == 0) {
+		target = 1;
+	}
+
+	for (b = 0; b < ADB_RTT_BUCKETS; b++) {
+		shift = b / 2 + ADB_RTT_MINSHIFT;
+		width = 1U << (shift - 1);
+		low = (1U << shift) + (b % 2) * width;
+		if (count + entry->rtthist[b] >= target) {
+			return (low + width * (target - count) /
+					      entry->rtthist[b]);
+		}
+		count += entry->rtthist[b];
+	}
+
+	return (low + width);
+}
+
+/*
+ * Count a round trip time of 'rtt' microseconds in the histogram of
+ * 'entry', halving it first if it is full.
+ *
+ * Caller must be holding the entry lock.
+ */
+static void
+rttsample(dns_adbentry_t *entry, unsigned int rtt) {
+	unsigned int b;
+
+	if (entry->rttsamples >= ADB_RTT_MAXSAMPLES) {
+		entry->rttsamples = 0;
+		for (b = 0; b < ADB_RTT_BUCKETS; b++) {
+			entry->rtthist[b] /= 2;
+			entry->rttsamples += entry->rtthist[b];
+		}
+	}
+	entry->rtthist[rttbucket(rtt)]++;
+	entry->rttsamples++;
+}
+
+void
+dns_adb_samplertt(dns_adb_t *adb, dns_adbaddrinfo_t *addr, unsigned int rtt) {
+	int bucket;
+
+	REQUIRE(DNS_ADB_VALID(adb));
+	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
+
+	bucket = addr->entry->lock_bucket;
+	LOCK(&adb->entrylocks[bucket]);
+	rttsample(addr->entry, rtt);
+	UNLOCK(&adb->entrylocks[bucket]);
+}
+
+isc_result_t
+dns_adb_getrttpercentile(dns_adb_t *adb, dns_adbaddrinfo_t *addr,
+			 unsigned int percent, unsigned int *rttp) {
+	isc_result_t result = ISC_R_NOTFOUND;
+	int bucket;
+
+	REQUIRE(DNS_ADB_VALID(adb));
+	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
+	REQUIRE(percent > 0 && percent <= 100);
+	REQUIRE(rttp != NULL);
+
+	bucket = addr->entry->lock_bucket;
+	LOCK(&adb->entrylocks[bucket]);
+
+	if (addr->entry->rttsamples >= ADB_RTT_MINSAMPLES) {
+		*rttp = rttpercentile(addr->entry, percent);
+		result = ISC_R_SUCCESS;
+	}
+
+	UNLOCK(&adb->entrylocks[bucket]);
+
+	return (result);
+}
+
 void
 dns_adb_changeflags(dns_adb_t *adb, dns_adbaddrinfo_t *addr, unsigned int bits,
 		    unsigned int mask) {
@@ -14,10 +14,23 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#ifndef WIN32
+#include <sys/mman.h>
+#else /* ifndef WIN32 */
+#define PROT_READ   0x01
+#define MAP_PRIVATE 0x0002
+#define MAP_FAILED  ((void *)-1)
+#endif /* ifndef WIN32 */
+
+#include <isc/buffer.h>
+#include <isc/crc64.h>
+#include <isc/file.h>
 #include <isc/mem.h>
 #include <isc/print.h>
 #include <isc/refcount.h>
 #include <isc/stats.h>
+#include <isc/stdio.h>
+#include <isc/stdtime.h>
 #include <isc/string.h>
 #include <isc/task.h>
 #include <isc/time.h>
@@ -25,13 +38,16 @@
 #include <isc/util.h>
 
 #include <dns/cache.h>
+#include <dns/compress.h>
 #include <dns/db.h>
 #include <dns/dbiterator.h>
 #include <dns/events.h>
+#include <dns/fixedname.h>
 #include <dns/lib.h>
 #include <dns/log.h>
 #include <dns/masterdump.h>
 #include <dns/rdata.h>
+#include <dns/rdatalist.h>
 #include <dns/rdataset.h>
 #include <dns/rdatasetiter.h>
 #include <dns/result.h>
@@ -64,6 +80,53 @@
  */
 #define DNS_CACHE_CLEANERINCREMENT 1000U /*%< Number of nodes. */
 
+/*%
+ * Cache snapshots.  A snapshot file starts with a fixed size header:
+ *
+ *	magic		8 bytes, "BIND9CS" and a NUL
+ *	version		uint32
+ *	class		uint16
+ *	reserved	uint16, zero
+ *	dumped		uint32, the time the snapshot was written
+ *	nodes		uint32, the number of nodes that follow
+ *	crc		uint64, CRC-64 of everything after the header
+ *
+ * followed by the nodes, each of which is an uncompressed owner name in
+ * wire format, a uint16 number of rdatasets and the rdatasets:
+ *
+ *	type		uint16, zero for a negative entry
+ *	covers		uint16
+ *	trust		uint8
+ *	flags		uint8, SNAPSHOT_* below
+ *	expire		uint32, the time the rdataset expires
+ *	count		uint16, the number of rdatas that follow
+ *	rdata		a uint16 length and the rdata in wire format
+ *
+ * All integers are in network byte order.  Expiry times are absolute so
+ * that the time that passed between writing and loading a snapshot is
+ * taken off the TTLs when it is loaded.
+ */
+#define SNAPSHOT_MAGIC	   "BIND9CS"
+#define SNAPSHOT_VERSION   1
+#define SNAPSHOT_HEADERLEN 32
+
+#define SNAPSHOT_NEGATIVE 0x01
+#define SNAPSHOT_NXDOMAIN 0x02
+#define SNAPSHOT_OPTOUT	  0x04
+#define SNAPSHOT_PREFETCH 0x08
+
+/*%
+ * How much of a snapshot is buffered before it is written out.
+ */
+#define SNAPSHOT_BUFSIZE 65536
+
+/*%
+ * Whether a cache database of type 'type' is made of RBT databases,
+ * which take hmctx as their first argument and clean themselves.
+ */
+#define RBTCACHE(type) \
+	(strcmp(type, "rbt") == 0 || strcmp(type, "shardcache") == 0)
+
 /***
  ***	Types
  ***/
@@ -146,7 +209,8 @@ struct dns_cache {
 
 	/* Locked by 'filelock'. */
 	char *filename;
-	/* Access to the on-disk cache file is also locked by 'filelock'. */
+	char *snapshot;
+	/* Access to the on-disk cache files is also locked by 'filelock'. */
 };
 
 /***
@@ -223,11 +287,13 @@ dns_cache_create(isc_mem_t *cmctx, isc_mem_t *hmctx, isc_taskmgr_t *taskmgr,
 	cache->db_type = isc_mem_strdup(cmctx, db_type);
 
 	/*
-	 * For databases of type "rbt" we pass hmctx to dns_db_create()
-	 * via cache->db_argv, followed by the rest of the arguments in
-	 * db_argv (of which there really shouldn't be any).
+	 * For databases of type "rbt" (or "shardcache", which is made of
+	 * "rbt" databases) we pass hmctx to dns_db_create() via
+	 * cache->db_argv, followed by the rest of the arguments in db_argv
+	 * (of which there really shouldn't be any, except for the number
+	 * of shards).
 	 */
-	if (strcmp(cache->db_type, "rbt") == 0) {
+	if (RBTCACHE(cache->db_type)) {
 		extra = 1;
 	}
 
@@ -270,6 +336,7 @@ dns_cache_create(isc_mem_t *cmctx, isc_mem_t *hmctx, isc_taskmgr_t *taskmgr,
 	}
 
 	cache->filename = NULL;
+	cache->snapshot = NULL;
 
 	cache->magic = CACHE_MAGIC;
 
@@ -277,7 +344,7 @@ dns_cache_create(isc_mem_t *cmctx, isc_mem_t *hmctx, isc_taskmgr_t *taskmgr,
 	 * RBT-type cache DB has its own mechanism of cache cleaning and doesn't
 	 * need the control of the generic cleaner.
 	 */
-	if (strcmp(db_type, "rbt") == 0) {
+	if (RBTCACHE(db_type)) {
 		result = cache_cleaner_init(cache, NULL, NULL, &cache->cleaner);
 	} else {
 		result = cache_cleaner_init(cache, taskmgr, timermgr,
@@ -352,6 +419,11 @@ cache_free(dns_cache_t *cache) {
 		cache->filename = NULL;
 	}
 
+	if (cache->snapshot != NULL) {
+		isc_mem_free(cache->mctx, cache->snapshot);
+		cache->snapshot = NULL;
+	}
+
 	if (cache->db != NULL) {
 		dns_db_detach(&cache->db);
 	}
@@ -362,7 +434,7 @@ cache_free(dns_cache_t *cache) {
 		 * as it's a pointer to hmctx
 		 */
 		int extra = 0;
-		if (strcmp(cache->db_type, "rbt") == 0) {
+		if (RBTCACHE(cache->db_type)) {
 			extra = 1;
 		}
 		for (int i = extra; i < cache->db_argc; i++) {
@@ -426,6 +498,13 @@ dns_cache_detach(dns_cache_t **cachep) {
 				      "error dumping cache: %s ",
 				      isc_result_totext(result));
 		}
+		result = dns_cache_dumpsnapshot(cache);
+		if (result != ISC_R_SUCCESS) {
+			isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE,
+				      DNS_LOGMODULE_CACHE, ISC_LOG_WARNING,
+				      "error writing cache snapshot: %s",
+				      isc_result_totext(result));
+		}
 
 		/*
 		 * If the cleaner task exists, let it free the cache.
@@ -504,6 +583,592 @@ dns_cache_dump(dns_cache_t *cache) {
 	return (result);
 }
 
+isc_result_t
+dns_cache_setsnapshot(dns_cache_t *cache, const char *filename) {
+	char *newname = NULL;
+
+	REQUIRE(VALID_CACHE(cache));
+
+	if (filename != NULL) {
+		newname = isc_mem_strdup(cache->mctx, filename);
+	}
+
+	LOCK(&cache->filelock);
+	if (cache->snapshot != NULL) {
+		isc_mem_free(cache->mctx, cache->snapshot);
+	}
+	cache->snapshot = newname;
+	UNLOCK(&cache->filelock);
+
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Fill in the uint16 count that was left as zero at 'offset' in 'buffer'.
+ */
+static void
+snapshot_setcount(isc_buffer_t *buffer, unsigned int offset, uint16_t count) {
+	unsigned char *p = (unsigned char *)isc_buffer_base(buffer) + offset;
+
+	p[0] = (count >> 8) & 0xff;
+	p[1] = count & 0xff;
+}
+
+/*
+ * Append 'rdataset' to the snapshot being built in 'buffer', unless it
+ * isn't worth keeping.  Returns true if it was appended.
+ */
+static bool
+snapshot_rdataset(dns_rdataset_t *rdataset, isc_stdtime_t now,
+		  dns_ttl_t stalettl, isc_buffer_t *buffer) {
+	isc_result_t result;
+	unsigned int countoffset;
+	uint32_t expire;
+	uint16_t count = 0;
+	uint8_t flags = 0;
+
+	/*
+	 * Answers that come with a wildcard or closest encloser proof are
+	 * left out, as the proofs aren't kept; they will simply be looked
+	 * up again.
+	 */
+	if ((rdataset->attributes &
+	     (DNS_RDATASETATTR_NOQNAME | DNS_RDATASETATTR_CLOSEST)) != 0)
+	{
+		return (false);
+	}
+
+	/*
+	 * Work out when the rdataset expires.  For stale and ancient
+	 * rdatasets, 'stale_ttl' holds the time left to serve them stale
+	 * and the expiry time respectively (see bind_rdataset() in rbtdb.c).
+	 */
+	if ((rdataset->attributes & DNS_RDATASETATTR_STALE) != 0) {
+		expire = now + rdataset->stale_ttl - stalettl;
+	} else if ((rdataset->attributes & DNS_RDATASETATTR_ANCIENT) != 0) {
+		expire = rdataset->stale_ttl;
+	} else if (rdataset->ttl != 0) {
+		expire = now + rdataset->ttl;
+	} else {
+		return (false);
+	}
+	if (expire + stalettl <= now) {
+		return (false);
+	}
+
+	if ((rdataset->attributes & DNS_RDATASETATTR_NEGATIVE) != 0) {
+		flags |= SNAPSHOT_NEGATIVE;
+	}
+	if ((rdataset->attributes & DNS_RDATASETATTR_NXDOMAIN) != 0) {
+		flags |= SNAPSHOT_NXDOMAIN;
+	}
+	if ((rdataset->attributes & DNS_RDATASETATTR_OPTOUT) != 0) {
+		flags |= SNAPSHOT_OPTOUT;
+	}
+	if ((rdataset->attributes & DNS_RDATASETATTR_PREFETCH) != 0) {
+		flags |= SNAPSHOT_PREFETCH;
+	}
+
+	isc_buffer_putuint16(buffer, rdataset->type);
+	isc_buffer_putuint16(buffer, rdataset->covers);
+	isc_buffer_putuint8(buffer, rdataset->trust);
+	isc_buffer_putuint8(buffer, flags);
+	isc_buffer_putuint32(buffer, expire);
+	countoffset = isc_buffer_usedlength(buffer);
+	isc_buffer_putuint16(buffer, 0);
+
+	for (result = dns_rdataset_first(rdataset); result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(rdataset))
+	{
+		dns_rdata_t rdata = DNS_RDATA_INIT;
+
+		dns_rdataset_current(rdataset, &rdata);
+		isc_buffer_putuint16(buffer, rdata.length);
+		isc_buffer_putmem(buffer, rdata.data, rdata.length);
+		count++;
+	}
+	snapshot_setcount(buffer, countoffset, count);
+
+	return (true);
+}
+
+/*
+ * Append 'node' and its rdatasets to the snapshot being built in
+ * 'buffer'.  Returns ISC_R_NOTFOUND if none of its rdatasets were worth
+ * keeping, in which case nothing is appended.
+ */
+static isc_result_t
+snapshot_node(dns_db_t *db, dns_dbnode_t *node, const dns_name_t *name,
+	      isc_stdtime_t now, dns_ttl_t stalettl, isc_buffer_t *buffer) {
+	dns_rdatasetiter_t *iter = NULL;
+	dns_rdataset_t rdataset;
+	isc_region_t r;
+	isc_result_t result;
+	unsigned int start, countoffset;
+	uint16_t count = 0;
+
+	result = dns_db_allrdatasets(db, node, NULL, now, &iter);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+
+	start = isc_buffer_usedlength(buffer);
+	dns_name_toregion(name, &r);
+	isc_buffer_putmem(buffer, r.base, r.length);
+	countoffset = isc_buffer_usedlength(buffer);
+	isc_buffer_putuint16(buffer, 0);
+
+	dns_rdataset_init(&rdataset);
+	for (result = dns_rdatasetiter_first(iter); result == ISC_R_SUCCESS;
+	     result = dns_rdatasetiter_next(iter))
+	{
+		dns_rdatasetiter_current(iter, &rdataset);
+		if (snapshot_rdataset(&rdataset, now, stalettl, buffer)) {
+			count++;
+		}
+		dns_rdataset_disassociate(&rdataset);
+	}
+	dns_rdatasetiter_destroy(&iter);
+
+	if (result != ISC_R_NOMORE || count == 0) {
+		isc_buffer_subtract(buffer,
+				    isc_buffer_usedlength(buffer) - start);
+		return (result == ISC_R_NOMORE ? ISC_R_NOTFOUND : result);
+	}
+	snapshot_setcount(buffer, countoffset, count);
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+snapshot_flush(isc_buffer_t *buffer, FILE *fp, uint64_t *crc) {
+	isc_region_t r;
+	isc_result_t result;
+
+	isc_buffer_usedregion(buffer, &r);
+	isc_crc64_update(crc, r.base, r.length);
+	result = isc_stdio_write(r.base, 1, r.length, fp, NULL);
+	isc_buffer_clear(buffer);
+
+	return (result);
+}
+
+static isc_result_t
+snapshot_write(dns_cache_t *cache, FILE *fp, uint32_t *nodesp) {
+	dns_db_t *db = NULL;
+	dns_dbiterator_t *dbiter = NULL;
+	dns_fixedname_t fixed;
+	dns_name_t *name = dns_fixedname_initname(&fixed);
+	isc_buffer_t *buffer = NULL;
+	isc_buffer_t header;
+	unsigned char headerdata[SNAPSHOT_HEADERLEN];
+	dns_ttl_t stalettl = 0;
+	isc_stdtime_t now;
+	isc_result_t result;
+	uint64_t crc;
+	uint32_t nodes = 0;
+
+	dns_cache_attachdb(cache, &db);
+	(void)dns_db_getservestalettl(db, &stalettl);
+	isc_stdtime_get(&now);
+	isc_crc64_init(&crc);
+
+	/*
+	 * The header is filled in last, once the CRC is known.
+	 */
+	memset(headerdata, 0, sizeof(headerdata));
+	result = isc_stdio_write(headerdata, 1, sizeof(headerdata), fp, NULL);
+	if (result != ISC_R_SUCCESS) {
+		goto cleanup;
+	}
+
+	result = dns_db_createiterator(db, 0, &dbiter);
+	if (result != ISC_R_SUCCESS) {
+		goto cleanup;
+	}
+
+	isc_buffer_allocate(cache->mctx, &buffer, SNAPSHOT_BUFSIZE);
+	isc_buffer_setautorealloc(buffer, true);
+
+	for (result = dns_dbiterator_first(dbiter); result == ISC_R_SUCCESS;
+	     result = dns_dbiterator_next(dbiter))
+	{
+		dns_dbnode_t *node = NULL;
+
+		result = dns_dbiterator_current(dbiter, &node, name);
+		if (result != ISC_R_SUCCESS) {
+			break;
+		}
+		(void)dns_dbiterator_pause(dbiter);
+
+		result = snapshot_node(db, node, name, now, stalettl, buffer);
+		dns_db_detachnode(db, &node);
+		if (result == ISC_R_NOTFOUND) {
+			continue;
+		} else if (result != ISC_R_SUCCESS) {
+			break;
+		}
+		nodes++;
+
+		if (isc_buffer_usedlength(buffer) >= SNAPSHOT_BUFSIZE) {
+			result = snapshot_flush(buffer, fp, &crc);
+			if (result != ISC_R_SUCCESS) {
+				break;
+			}
+		}
+	}
+	if (result != ISC_R_NOMORE) {
+		goto cleanup;
+	}
+
+	result = snapshot_flush(buffer, fp, &crc);
+	if (result != ISC_R_SUCCESS) {
+		goto cleanup;
+	}
+	isc_crc64_final(&crc);
+
+	isc_buffer_init(&header, headerdata, sizeof(headerdata));
+	isc_buffer_putmem(&header, (const unsigned char *)SNAPSHOT_MAGIC,
+			  sizeof(SNAPSHOT_MAGIC));
+	isc_buffer_putuint32(&header, SNAPSHOT_VERSION);
+	isc_buffer_putuint16(&header, cache->rdclass);
+	isc_buffer_putuint16(&header, 0);
+	isc_buffer_putuint32(&header, now);
+	isc_buffer_putuint32(&header, nodes);
+	isc_buffer_putuint32(&header, (uint32_t)(crc >> 32));
+	isc_buffer_putuint32(&header, (uint32_t)crc);
+	INSIST(isc_buffer_usedlength(&header) == SNAPSHOT_HEADERLEN);
+
+	result = isc_stdio_seek(fp, 0, SEEK_SET);
+	if (result == ISC_R_SUCCESS) {
+		result = isc_stdio_write(headerdata, 1, sizeof(headerdata), fp,
+					 NULL);
+	}
+	if (result == ISC_R_SUCCESS) {
+		*nodesp = nodes;
+	}
+
+cleanup:
+	if (buffer != NULL) {
+		isc_buffer_free(&buffer);
+	}
+	if (dbiter != NULL) {
+		dns_dbiterator_destroy(&dbiter);
+	}
+	dns_db_detach(&db);
+
+	return (result);
+}
+
+isc_result_t
+dns_cache_dumpsnapshot(dns_cache_t *cache) {
+	char tmpname[PATH_MAX];
+	FILE *fp = NULL;
+	isc_result_t result, tresult;
+	uint32_t nodes = 0;
+
+	REQUIRE(VALID_CACHE(cache));
+
+	LOCK(&cache->filelock);
+	if (cache->snapshot == NULL) {
+		UNLOCK(&cache->filelock);
+		return (ISC_R_SUCCESS);
+	}
+
+	/*
+	 * Write the snapshot to a temporary file and rename it when done,
+	 * so that a failed dump doesn't destroy the previous snapshot.
+	 */
+	result = isc_file_template(cache->snapshot, "cache-XXXXXXXX", tmpname,
+				   sizeof(tmpname));
+	if (result == ISC_R_SUCCESS) {
+		result = isc_file_openuniqueprivate(tmpname, &fp);
+	}
+	if (result != ISC_R_SUCCESS) {
+		goto unlock;
+	}
+
+	result = snapshot_write(cache, fp, &nodes);
+	if (result == ISC_R_SUCCESS) {
+		result = isc_stdio_flush(fp);
+	}
+	if (result == ISC_R_SUCCESS) {
+		result = isc_stdio_sync(fp);
+	}
+	tresult = isc_stdio_close(fp);
+	if (result == ISC_R_SUCCESS) {
+		result = tresult;
+	}
+	if (result == ISC_R_SUCCESS) {
+		result = isc_file_rename(tmpname, cache->snapshot);
+	}
+	if (result != ISC_R_SUCCESS) {
+		(void)isc_file_remove(tmpname);
+		goto unlock;
+	}
+
+	isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE, DNS_LOGMODULE_CACHE,
+		      ISC_LOG_INFO, "wrote %u names to cache snapshot '%s'",
+		      nodes, cache->snapshot);
+
+unlock:
+	UNLOCK(&cache->filelock);
+	return (result);
+}
+
+/*
+ * Read an rdataset from the snapshot in 'b' and add it to 'node',
+ * taking the time that has passed since the snapshot was written off
+ * its TTL.  '*addedp' is set to true if it was added.
+ */
+static isc_result_t
+snapshot_loadrdataset(dns_cache_t *cache, dns_db_t *db, dns_dbnode_t *node,
+		      isc_buffer_t *b, isc_stdtime_t now, dns_ttl_t stalettl,
+		      bool *addedp) {
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_rdata_t *rdatas = NULL;
+	dns_trust_t trust;
+	isc_stdtime_t when;
+	isc_result_t result = ISC_R_SUCCESS;
+	unsigned int i, count;
+	uint32_t expire;
+	uint8_t flags;
+
+	*addedp = false;
+
+	if (isc_buffer_remaininglength(b) < 12) {
+		return (ISC_R_UNEXPECTEDEND);
+	}
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = cache->rdclass;
+	rdatalist.type = isc_buffer_getuint16(b);
+	rdatalist.covers = isc_buffer_getuint16(b);
+	trust = isc_buffer_getuint8(b);
+	flags = isc_buffer_getuint8(b);
+	expire = isc_buffer_getuint32(b);
+	count = isc_buffer_getuint16(b);
+	if (count == 0) {
+		return (ISC_R_INVALIDFILE);
+	}
+
+	rdatas = isc_mem_get(cache->mctx, count * sizeof(*rdatas));
+	for (i = 0; i < count; i++) {
+		dns_rdata_t *rdata = &rdatas[i];
+
+		dns_rdata_init(rdata);
+		if (isc_buffer_remaininglength(b) < 2) {
+			result = ISC_R_UNEXPECTEDEND;
+			goto cleanup;
+		}
+		rdata->length = isc_buffer_getuint16(b);
+		if (isc_buffer_remaininglength(b) < rdata->length) {
+			result = ISC_R_UNEXPECTEDEND;
+			goto cleanup;
+		}
+		rdata->data = isc_buffer_current(b);
+		rdata->rdclass = rdatalist.rdclass;
+		rdata->type = rdatalist.type;
+		isc_buffer_forward(b, rdata->length);
+		ISC_LIST_APPEND(rdatalist.rdata, rdata, link);
+	}
+
+	/*
+	 * Data that has expired since the snapshot was written, but may
+	 * still be served stale, is added as if it had been added just
+	 * before it expired.
+	 */
+	if (expire > now) {
+		when = now;
+		rdatalist.ttl = expire - now;
+	} else if (expire + stalettl > now) {
+		when = expire - 1;
+		rdatalist.ttl = 1;
+	} else {
+		goto cleanup;
+	}
+
+	dns_rdataset_init(&rdataset);
+	RUNTIME_CHECK(dns_rdatalist_tordataset(&rdatalist, &rdataset) ==
+		      ISC_R_SUCCESS);
+	rdataset.trust = trust;
+	if ((flags & SNAPSHOT_NEGATIVE) != 0) {
+		rdataset.attributes |= DNS_RDATASETATTR_NEGATIVE;
+	}
+	if ((flags & SNAPSHOT_NXDOMAIN) != 0) {
+		rdataset.attributes |= DNS_RDATASETATTR_NXDOMAIN;
+	}
+	if ((flags & SNAPSHOT_OPTOUT) != 0) {
+		rdataset.attributes |= DNS_RDATASETATTR_OPTOUT;
+	}
+	if ((flags & SNAPSHOT_PREFETCH) != 0) {
+		rdataset.attributes |= DNS_RDATASETATTR_PREFETCH;
+	}
+
+	result = dns_db_addrdataset(db, node, NULL, when, &rdataset, 0, NULL);
+	dns_rdataset_disassociate(&rdataset);
+	if (result == ISC_R_SUCCESS) {
+		*addedp = true;
+	} else if (result == DNS_R_UNCHANGED) {
+		result = ISC_R_SUCCESS;
+	}
+
+cleanup:
+	isc_mem_put(cache->mctx, rdatas, count * sizeof(*rdatas));
+	return (result);
+}
+
+static isc_result_t
+snapshot_read(dns_cache_t *cache, const unsigned char *base, size_t size) {
+	dns_db_t *db = NULL;
+	dns_fixedname_t fixed;
+	dns_name_t *name = dns_fixedname_initname(&fixed);
+	dns_decompress_t dctx;
+	isc_buffer_t b;
+	isc_region_t r;
+	dns_ttl_t stalettl = 0;
+	isc_stdtime_t now;
+	isc_result_t result = ISC_R_SUCCESS;
+	uint64_t crc, filecrc;
+	uint32_t dumped, nodes, n;
+	unsigned int added = 0, skipped = 0;
+
+	if (size < SNAPSHOT_HEADERLEN) {
+		return (ISC_R_UNEXPECTEDEND);
+	}
+	if (memcmp(base, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+		return (ISC_R_INVALIDFILE);
+	}
+
+	isc_buffer_constinit(&b, base, size);
+	isc_buffer_add(&b, size);
+	isc_buffer_forward(&b, sizeof(SNAPSHOT_MAGIC));
+	if (isc_buffer_getuint32(&b) != SNAPSHOT_VERSION ||
+	    isc_buffer_getuint16(&b) != cache->rdclass)
+	{
+		return (ISC_R_INVALIDFILE);
+	}
+	(void)isc_buffer_getuint16(&b);
+	dumped = isc_buffer_getuint32(&b);
+	nodes = isc_buffer_getuint32(&b);
+	filecrc = (uint64_t)isc_buffer_getuint32(&b) << 32;
+	filecrc |= isc_buffer_getuint32(&b);
+
+	isc_buffer_remainingregion(&b, &r);
+	isc_crc64_init(&crc);
+	isc_crc64_update(&crc, r.base, r.length);
+	isc_crc64_final(&crc);
+	if (crc != filecrc) {
+		return (ISC_R_INVALIDFILE);
+	}
+
+	dns_cache_attachdb(cache, &db);
+	(void)dns_db_getservestalettl(db, &stalettl);
+	isc_stdtime_get(&now);
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_NONE);
+
+	for (n = 0; n < nodes && result == ISC_R_SUCCESS; n++) {
+		dns_dbnode_t *node = NULL;
+		unsigned int i, nrdatasets;
+
+		isc_buffer_setactive(&b, isc_buffer_remaininglength(&b));
+		result = dns_name_fromwire(name, &b, &dctx, 0, NULL);
+		if (result != ISC_R_SUCCESS) {
+			break;
+		}
+		if (isc_buffer_remaininglength(&b) < 2) {
+			result = ISC_R_UNEXPECTEDEND;
+			break;
+		}
+		nrdatasets = isc_buffer_getuint16(&b);
+
+		result = dns_db_findnode(db, name, true, &node);
+		if (result != ISC_R_SUCCESS) {
+			break;
+		}
+		for (i = 0; i < nrdatasets && result == ISC_R_SUCCESS; i++) {
+			bool added_one;
+
+			result = snapshot_loadrdataset(cache, db, node, &b, now,
+						       stalettl, &added_one);
+			if (added_one) {
+				added++;
+			} else {
+				skipped++;
+			}
+		}
+		dns_db_detachnode(db, &node);
+	}
+	if (result == ISC_R_SUCCESS && isc_buffer_remaininglength(&b) != 0) {
+		result = ISC_R_INVALIDFILE;
+	}
+
+	dns_decompress_invalidate(&dctx);
+	dns_db_detach(&db);
+
+	isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE, DNS_LOGMODULE_CACHE,
+		      ISC_LOG_INFO,
+		      "loaded %u rdatasets from cache snapshot '%s' written "
+		      "%u seconds ago, %u expired or skipped",
+		      added, cache->snapshot, now > dumped ? now - dumped : 0,
+		      skipped);
+
+	return (result);
+}
+
+isc_result_t
+dns_cache_loadsnapshot(dns_cache_t *cache) {
+	FILE *fp = NULL;
+	off_t size = 0;
+	void *base = NULL;
+	isc_result_t result;
+	int flags;
+
+	REQUIRE(VALID_CACHE(cache));
+
+	LOCK(&cache->filelock);
+	if (cache->snapshot == NULL) {
+		result = ISC_R_SUCCESS;
+		goto unlock;
+	}
+
+	result = isc_stdio_open(cache->snapshot, "rb", &fp);
+	if (result != ISC_R_SUCCESS) {
+		goto unlock;
+	}
+
+	result = isc_file_getsizefd(fileno(fp), &size);
+	if (result != ISC_R_SUCCESS) {
+		goto close;
+	}
+	if (size < SNAPSHOT_HEADERLEN) {
+		result = ISC_R_UNEXPECTEDEND;
+		goto close;
+	}
+
+	/* Map in the whole file in one go */
+	flags = MAP_PRIVATE;
+#ifdef MAP_FILE
+	flags |= MAP_FILE;
+#endif /* ifdef MAP_FILE */
+	base = isc_file_mmap(NULL, (size_t)size, PROT_READ, flags, fileno(fp),
+			     0);
+	if (base == NULL || base == MAP_FAILED) {
+		result = ISC_R_FAILURE;
+		goto close;
+	}
+
+	result = snapshot_read(cache, base, (size_t)size);
+	(void)isc_file_munmap(base, (size_t)size);
+
+close:
+	(void)isc_stdio_close(fp);
+unlock:
+	UNLOCK(&cache->filelock);
+	return (result);
+}
+
 const char *
 dns_cache_getname(dns_cache_t *cache) {
 	REQUIRE(VALID_CACHE(cache));
@@ -1290,6 +1955,21 @@ getcounters(isc_stats_t *stats, isc_statsformat_t type, int ncounters,
 	isc_stats_dump(stats, getcounter, &dumparg, ISC_STATSDUMP_VERBOSE);
 }
 
+/*
+ * The share of the queries answered from the cache, in thousandths.
+ */
+static uint64_t
+queryhitratio(const uint64_t *values) {
+	uint64_t hits = values[dns_cachestatscounter_queryhits];
+	uint64_t total = hits + values[dns_cachestatscounter_querymisses];
+
+	if (total == 0) {
+		return (0);
+	}
+
+	return (hits * 1000 / total);
+}
+
 void
 dns_cache_dumpstats(dns_cache_t *cache, FILE *fp) {
 	int indices[dns_cachestatscounter_max];
@@ -1310,9 +1990,17 @@ dns_cache_dumpstats(dns_cache_t *cache, FILE *fp) {
 	fprintf(fp, "%20" PRIu64 " %s\n",
 		values[dns_cachestatscounter_querymisses],
 		"cache misses (from query)");
+	fprintf(fp, "%20" PRIu64 " %s\n", queryhitratio(values),
+		"cache hit ratio (from query, per mille)");
 	fprintf(fp, "%20" PRIu64 " %s\n",
 		values[dns_cachestatscounter_deletelru],
 		"cache records deleted due to memory exhaustion");
+	fprintf(fp, "%20" PRIu64 " %s\n",
+		values[dns_cachestatscounter_evictscanned],
+		"cache records examined for eviction");
+	fprintf(fp, "%20" PRIu64 " %s\n",
+		values[dns_cachestatscounter_evictspared],
+		"cache records spared from eviction as recently used");
 	fprintf(fp, "%20" PRIu64 " %s\n",
 		values[dns_cachestatscounter_deletettl],
 		"cache records deleted due to TTL expiration");
@@ -1320,6 +2008,24 @@ dns_cache_dumpstats(dns_cache_t *cache, FILE *fp) {
 		"cache database nodes");
 	fprintf(fp, "%20" PRIu64 " %s\n", (uint64_t)dns_db_hashsize(cache->db),
 		"cache database hash buckets");
+	fprintf(fp, "%20" PRIu64 " %s\n",
+		values[dns_cachestatscounter_rehashing],
+		"cache database rehashes in progress");
+	fprintf(fp, "%20" PRIu64 " %s\n",
+		values[dns_cachestatscounter_rehashstall10us],
+		"cache database rehash stalls under 10us");
+	fprintf(fp, "%20" PRIu64 " %s\n",
+		values[dns_cachestatscounter_rehashstall100us],
+		"cache database rehash stalls under 100us");
+	fprintf(fp, "%20" PRIu64 " %s\n",
+		values[dns_cachestatscounter_rehashstall1ms],
+		"cache database rehash stalls under 1ms");
+	fprintf(fp, "%20" PRIu64 " %s\n",
+		values[dns_cachestatscounter_rehashstall10ms],
+		"cache database rehash stalls under 10ms");
+	fprintf(fp, "%20" PRIu64 " %s\n",
+		values[dns_cachestatscounter_rehashstallmax],
+		"cache database rehash stalls of 10ms or more");
 
 	fprintf(fp, "%20" PRIu64 " %s\n", (uint64_t)isc_mem_total(cache->mctx),
 		"cache tree memory total");
@@ -1378,13 +2084,31 @@ dns_cache_renderxml(dns_cache_t *cache, void *writer0) {
 			writer));
 	TRY0(renderstat("QueryMisses",
 			values[dns_cachestatscounter_querymisses], writer));
+	TRY0(renderstat("QueryHitRatio", queryhitratio(values), writer));
 	TRY0(renderstat("DeleteLRU", values[dns_cachestatscounter_deletelru],
 			writer));
+	TRY0(renderstat("EvictScanned",
+			values[dns_cachestatscounter_evictscanned], writer));
+	TRY0(renderstat("EvictSpared",
+			values[dns_cachestatscounter_evictspared], writer));
 	TRY0(renderstat("DeleteTTL", values[dns_cachestatscounter_deletettl],
 			writer));
 
 	TRY0(renderstat("CacheNodes", dns_db_nodecount(cache->db), writer));
 	TRY0(renderstat("CacheBuckets", dns_db_hashsize(cache->db), writer));
+	TRY0(renderstat("CacheRehashing",
+			values[dns_cachestatscounter_rehashing], writer));
+	TRY0(renderstat("RehashStall10us",
+			values[dns_cachestatscounter_rehashstall10us], writer));
+	TRY0(renderstat("RehashStall100us",
+			values[dns_cachestatscounter_rehashstall100us],
+			writer));
+	TRY0(renderstat("RehashStall1ms",
+			values[dns_cachestatscounter_rehashstall1ms], writer));
+	TRY0(renderstat("RehashStall10ms",
+			values[dns_cachestatscounter_rehashstall10ms], writer));
+	TRY0(renderstat("RehashStallMax",
+			values[dns_cachestatscounter_rehashstallmax], writer));
 
 	TRY0(renderstat("TreeMemTotal", isc_mem_total(cache->mctx), writer));
 	TRY0(renderstat("TreeMemInUse", isc_mem_inuse(cache->mctx), writer));
@@ -1436,10 +2160,23 @@ dns_cache_renderjson(dns_cache_t *cache, void *cstats0) {
 	CHECKMEM(obj);
 	json_object_object_add(cstats, "QueryMisses", obj);
 
+	obj = json_object_new_int64(queryhitratio(values));
+	CHECKMEM(obj);
+	json_object_object_add(cstats, "QueryHitRatio", obj);
+
 	obj = json_object_new_int64(values[dns_cachestatscounter_deletelru]);
 	CHECKMEM(obj);
 	json_object_object_add(cstats, "DeleteLRU", obj);
 
+	obj = json_object_new_int64(
+		values[dns_cachestatscounter_evictscanned]);
+	CHECKMEM(obj);
+	json_object_object_add(cstats, "EvictScanned", obj);
+
+	obj = json_object_new_int64(values[dns_cachestatscounter_evictspared]);
+	CHECKMEM(obj);
+	json_object_object_add(cstats, "EvictSpared", obj);
+
 	obj = json_object_new_int64(values[dns_cachestatscounter_deletettl]);
 	CHECKMEM(obj);
 	json_object_object_add(cstats, "DeleteTTL", obj);
@@ -1452,6 +2189,35 @@ dns_cache_renderjson(dns_cache_t *cache, void *cstats0) {
 	CHECKMEM(obj);
 	json_object_object_add(cstats, "CacheBuckets", obj);
 
+	obj = json_object_new_int64(values[dns_cachestatscounter_rehashing]);
+	CHECKMEM(obj);
+	json_object_object_add(cstats, "CacheRehashing", obj);
+
+	obj = json_object_new_int64(
+		values[dns_cachestatscounter_rehashstall10us]);
+	CHECKMEM(obj);
+	json_object_object_add(cstats, "RehashStall10us", obj);
+
+	obj = json_object_new_int64(
+		values[dns_cachestatscounter_rehashstall100us]);
+	CHECKMEM(obj);
+	json_object_object_add(cstats, "RehashStall100us", obj);
+
+	obj = json_object_new_int64(
+		values[dns_cachestatscounter_rehashstall1ms]);
+	CHECKMEM(obj);
+	json_object_object_add(cstats, "RehashStall1ms", obj);
+
+	obj = json_object_new_int64(
+		values[dns_cachestatscounter_rehashstall10ms]);
+	CHECKMEM(obj);
+	json_object_object_add(cstats, "RehashStall10ms", obj);
+
+	obj = json_object_new_int64(
+		values[dns_cachestatscounter_rehashstallmax]);
+	CHECKMEM(obj);
+	json_object_object_add(cstats, "RehashStallMax", obj);
+
 	obj = json_object_new_int64(isc_mem_total(cache->mctx));
 	CHECKMEM(obj);
 	json_object_object_add(cstats, "TreeMemTotal", obj);
@@ -56,13 +56,17 @@ struct dns_dbimplementation {
  * Built in database implementations are registered here.
  */
 
+#include "imagedb.h"
 #include "rbtdb.h"
+#include "shardcache.h"
 
 static ISC_LIST(dns_dbimplementation_t) implementations;
 static isc_rwlock_t implock;
 static isc_once_t once = ISC_ONCE_INIT;
 
+static dns_dbimplementation_t imageimp;
 static dns_dbimplementation_t rbtimp;
+static dns_dbimplementation_t shardcacheimp;
 
 static void
 initialize(void) {
@@ -74,8 +78,22 @@ initialize(void) {
 	rbtimp.driverarg = NULL;
 	ISC_LINK_INIT(&rbtimp, link);
 
+	shardcacheimp.name = "shardcache";
+	shardcacheimp.create = dns_shardcache_create;
+	shardcacheimp.mctx = NULL;
+	shardcacheimp.driverarg = NULL;
+	ISC_LINK_INIT(&shardcacheimp, link);
+
+	imageimp.name = "image";
+	imageimp.create = dns_imagedb_create;
+	imageimp.mctx = NULL;
+	imageimp.driverarg = NULL;
+	ISC_LINK_INIT(&imageimp, link);
+
 	ISC_LIST_INIT(implementations);
 	ISC_LIST_APPEND(implementations, &rbtimp, link);
+	ISC_LIST_APPEND(implementations, &shardcacheimp, link);
+	ISC_LIST_APPEND(implementations, &imageimp, link);
 }
 
 static inline dns_dbimplementation_t *
@@ -12,13 +12,18 @@
 /*! \file */
 
 #include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <isc/atomic.h>
+#include <isc/hash.h>
 #include <isc/mem.h>
 #include <isc/mutex.h>
+#include <isc/netmgr.h>
+#include <isc/os.h>
 #include <isc/portset.h>
 #include <isc/print.h>
 #include <isc/random.h>
@@ -38,7 +43,7 @@
 #include <dns/tcpmsg.h>
 #include <dns/types.h>
 
-typedef ISC_LIST(dns_dispentry_t) dns_displist_t;
+#include "dispatch_p.h"
 
 typedef struct dispsocket dispsocket_t;
 typedef ISC_LIST(dispsocket_t) dispsocketlist_t;
@@ -46,12 +51,45 @@ typedef ISC_LIST(dispsocket_t) dispsocketlist_t;
 typedef struct dispportentry dispportentry_t;
 typedef ISC_LIST(dispportentry_t) dispportlist_t;
 
+typedef struct dispsend dispsend_t;
+
+typedef ISC_LIST(dns_dispentry_t) dns_displist_t;
+
+/*%
+ * The buckets of the QID table are split among shards: bucket 'b' is
+ * bucket 'b / qid_nshards' of shard 'b % qid_nshards'.  Each shard has
+ * its own lock, which must be held to change its hash chains or the
+ * responses in them.
+ *
+ * Responses are looked up on receipt without taking the lock, to find
+ * out whether a packet matches anything at all.  The chains are singly
+ * linked through atomic pointers, and 'seq' is odd while a chain of the
+ * shard is being changed, so that a reader can tell whether it saw a
+ * consistent chain.  Entries come from the manager's 'rpool', which
+ * never returns memory while the manager exists, so a reader following
+ * a stale pointer still reads a dns_dispentry_t.  Only the 'hashnext'
+ * and 'key' members of an entry are read without the lock.
+ *
+ * Responses received by udp_nmrecv() on the netmgr sockets of exclusive
+ * UDP dispatches are not looked up here at all: the connected socket
+ * already identifies the entry.  For those dispatches the table only
+ * keeps query ID and port pairs unique; lookups on receipt come from
+ * shared UDP dispatches and TCP.
+ */
+typedef struct qid_shard {
+	isc_mutex_t lock;
+	atomic_uint_fast32_t seq;
+	atomic_uintptr_t *table; /*%< chains of dns_dispentry_t */
+	char pad[128];		 /*%< keep shards in separate cache lines */
+} qid_shard_t;
+
 typedef struct dns_qid {
 	unsigned int magic;
 	unsigned int qid_nbuckets;  /*%< hash table size */
 	unsigned int qid_increment; /*%< id increment on collision */
-	isc_mutex_t lock;
-	dns_displist_t *qid_table;    /*%< the table itself */
+	unsigned int qid_nshards;   /*%< number of shards, a power of 2 */
+	qid_shard_t *qid_shards;    /*%< the table itself */
+	isc_mutex_t lock;	    /*%< protects sock_table, port buffers */
 	dispsocketlist_t *sock_table; /*%< socket table */
 } dns_qid_t;
 
@@ -61,6 +99,7 @@ struct dns_dispatchmgr {
 	isc_mem_t *mctx;
 	dns_acl_t *blackhole;
 	isc_stats_t *stats;
+	isc_nm_t *nm;
 
 	/* Locked by "lock". */
 	isc_mutex_t lock;
@@ -114,6 +153,8 @@ struct dns_dispatchmgr {
 
 struct dns_dispentry {
 	unsigned int magic;
+	atomic_uintptr_t hashnext; /*%< QID table chain */
+	atomic_uint_fast32_t key;  /*%< qid_key() of host, id and port */
 	dns_dispatch_t *disp;
 	dns_messageid_t id;
 	in_port_t port;
@@ -124,10 +165,40 @@ struct dns_dispentry {
 	void *arg;
 	bool item_out;
 	dispsocket_t *dispsocket;
+	isc_nmhandle_t *handle;
 	ISC_LIST(dns_dispatchevent_t) items;
-	ISC_LINK(dns_dispentry_t) link;
+
+	/*
+	 * Query coalescing, see dns_dispatch_coalesce().  An entry is
+	 * either in a bucket of 'disp->coalesced', with a copy of its
+	 * query, or in the 'waiters' list of its 'leader'.  Locked by
+	 * disp->lock.
+	 */
+	unsigned char *query;
+	unsigned int querylen;
+	uint32_t queryhash;
+	dns_dispentry_t *leader;
+	dns_displist_t waiters;
+	ISC_LINK(dns_dispentry_t) clink;
 };
 
+/*%
+ * Maximum number of outstanding responses per manager.
+ */
+#define DISPATCH_MAXRESPONSES 131072
+
+/*%
+ * Maximum number of shards of the manager's QID table.  One shard is
+ * used per CPU, up to this limit.
+ */
+#define DISPATCH_MAXQIDSHARDS 64
+
+/*%
+ * Number of buckets of the table of queries that other identical
+ * queries can wait for.  Must be a power of 2.
+ */
+#define DISPATCH_COALESCEBUCKETS 1024
+
 /*%
  * Maximum number of dispatch sockets that can be pooled for reuse.  The
  * appropriate value may vary, but experiments have shown a busy caching server
@@ -152,6 +223,10 @@ struct dns_dispentry {
 struct dispsocket {
 	unsigned int magic;
 	isc_socket_t *socket;
+	isc_nmhandle_t *handle;
+	bool connecting; /* netmgr socket not yet given to a response */
+	bool reading;	 /* netmgr read callback will be called again */
+	bool canceled;	 /* netmgr read has been canceled */
 	dns_dispatch_t *disp;
 	isc_sockaddr_t host;
 	in_port_t localport; /* XXX: should be removed later */
@@ -174,6 +249,17 @@ struct dispportentry {
 	ISC_LINK(struct dispportentry) link;
 };
 
+/*%
+ * A send on a netmgr dispatch socket, see dns_dispatch_send().
+ */
+struct dispsend {
+	isc_mem_t *mctx;
+	isc_task_t *task;
+	isc_socketevent_t *event;
+	unsigned char *buf; /*%< query sent by the dispatch itself */
+	unsigned int length;
+};
+
 #ifndef DNS_DISPATCH_PORTTABLESIZE
 #define DNS_DISPATCH_PORTTABLESIZE 1024
 #endif /* ifndef DNS_DISPATCH_PORTTABLESIZE */
@@ -199,6 +285,7 @@ struct dns_dispatch {
 	 */
 	isc_task_t *task[MAX_INTERNAL_TASKS];
 	isc_socket_t *socket;	  /*%< isc socket attached to */
+	isc_nm_t *nm;		  /*%< netmgr for exclusive sockets */
 	isc_sockaddr_t local;	  /*%< local address */
 	in_port_t localport;	  /*%< local UDP port */
 	isc_sockaddr_t peer;	  /*%< peer address (TCP) */
@@ -233,6 +320,7 @@ struct dns_dispatch {
 	dns_qid_t *qid;
 	dispportlist_t *port_table; /*%< hold ports 'owned' by us */
 	isc_mempool_t *portpool;    /*%< port table entries  */
+	dns_displist_t *coalesced;  /*%< queries others can wait for */
 };
 
 #define QID_MAGIC    ISC_MAGIC('Q', 'i', 'd', ' ')
@@ -289,6 +377,10 @@ udp_shrecv(isc_task_t *, isc_event_t *);
 static void
 udp_recv(isc_event_t *, dns_dispatch_t *, dispsocket_t *);
 static void
+udp_nmrecv(isc_nmhandle_t *, isc_result_t, isc_region_t *, void *);
+static void
+udp_nmsenddone(isc_nmhandle_t *, isc_result_t, void *);
+static void
 tcp_recv(isc_task_t *, isc_event_t *);
 static isc_result_t
 startrecv(dns_dispatch_t *, dispsocket_t *);
@@ -305,9 +397,8 @@ allocate_devent(dns_dispatch_t *disp);
 static void
 do_cancel(dns_dispatch_t *disp);
 static dns_dispentry_t *
-linear_first(dns_qid_t *disp);
-static dns_dispentry_t *
-linear_next(dns_qid_t *disp, dns_dispentry_t *resp);
+qid_find(dns_qid_t *qid, const isc_sockaddr_t *dest, dns_messageid_t id,
+	 in_port_t port, unsigned int *bucketp);
 static void
 dispatch_free(dns_dispatch_t **dispp);
 static isc_result_t
@@ -325,7 +416,8 @@ static void
 destroy_mgr(dns_dispatchmgr_t **mgrp);
 static isc_result_t
 qid_allocate(dns_dispatchmgr_t *mgr, unsigned int buckets,
-	     unsigned int increment, dns_qid_t **qidp, bool needaddrtable);
+	     unsigned int increment, unsigned int nshards, dns_qid_t **qidp,
+	     bool needaddrtable);
 static void
 qid_destroy(isc_mem_t *mctx, dns_qid_t **qidp);
 static isc_result_t
@@ -429,6 +521,14 @@ request_log(dns_dispatch_t *disp, dns_dispentry_t *resp, int level,
 	}
 }
 
+/*
+ * Return the key of the destination, message id and port.
+ */
+static inline uint32_t
+qid_key(const isc_sockaddr_t *dest, dns_messageid_t id, in_port_t port) {
+	return (isc_sockaddr_hash(dest, true) ^ (((uint32_t)id << 16) | port));
+}
+
 /*
  * Return a hash of the destination and message id.
  */
@@ -437,61 +537,150 @@ dns_hash(dns_qid_t *qid, const isc_sockaddr_t *dest, dns_messageid_t id,
 	 in_port_t port) {
 	uint32_t ret;
 
-	ret = isc_sockaddr_hash(dest, true);
-	ret ^= ((uint32_t)id << 16) | port;
-	ret %= qid->qid_nbuckets;
+	ret = qid_key(dest, id, port) % qid->qid_nbuckets;
 
 	INSIST(ret < qid->qid_nbuckets);
 
 	return (ret);
 }
 
+#define QID_SHARD(qid, bucket) \
+	(&(qid)->qid_shards[(bucket) & ((qid)->qid_nshards - 1)])
+#define QID_CHAIN(qid, bucket) \
+	(&QID_SHARD(qid, bucket)->table[(bucket) / (qid)->qid_nshards])
+#define QID_SHARDBUCKETS(qid) \
+	(((qid)->qid_nbuckets + (qid)->qid_nshards - 1) / (qid)->qid_nshards)
+
+static atomic_bool qid_lockfree = ATOMIC_VAR_INIT(true);
+
+void
+dns__dispatch_setlockfree(bool enable) {
+	atomic_store(&qid_lockfree, enable);
+}
+
 /*
- * Find the first entry in 'qid'.  Returns NULL if there are no entries.
+ * Add 'res' to the chain of its bucket.  The shard must be locked.
  */
-static dns_dispentry_t *
-linear_first(dns_qid_t *qid) {
-	dns_dispentry_t *ret;
-	unsigned int bucket;
+static void
+qid_link(dns_qid_t *qid, dns_dispentry_t *res) {
+	qid_shard_t *shard = QID_SHARD(qid, res->bucket);
+	atomic_uintptr_t *chain = QID_CHAIN(qid, res->bucket);
+	uint_fast32_t seq = atomic_load_relaxed(&shard->seq);
+
+	(void)atomic_exchange_acq_rel(&shard->seq, seq + 1);
+	atomic_store_release(&res->hashnext, atomic_load_relaxed(chain));
+	atomic_store_release(chain, (uintptr_t)res);
+	atomic_store_release(&shard->seq, seq + 2);
+}
 
-	bucket = 0;
+/*
+ * Remove 'res' from the chain of its bucket.  The shard must be locked.
+ */
+static void
+qid_unlink(dns_qid_t *qid, dns_dispentry_t *res) {
+	qid_shard_t *shard = QID_SHARD(qid, res->bucket);
+	atomic_uintptr_t *nextp = QID_CHAIN(qid, res->bucket);
+	uint_fast32_t seq = atomic_load_relaxed(&shard->seq);
+	dns_dispentry_t *prev;
 
-	while (bucket < qid->qid_nbuckets) {
-		ret = ISC_LIST_HEAD(qid->qid_table[bucket]);
-		if (ret != NULL) {
-			return (ret);
+	while ((prev = (dns_dispentry_t *)atomic_load_relaxed(nextp)) != res) {
+		INSIST(prev != NULL);
+		nextp = &prev->hashnext;
+	}
+
+	(void)atomic_exchange_acq_rel(&shard->seq, seq + 1);
+	atomic_store_release(nextp, atomic_load_relaxed(&res->hashnext));
+	atomic_store_release(&shard->seq, seq + 2);
+}
+
+/*
+ * Check, without locking, whether the chain of 'bucket' may hold an
+ * entry with key 'key'.  Returns false only if the whole chain was read
+ * while it didn't change and no entry had that key.
+ */
+static bool
+qid_maybefound(dns_qid_t *qid, uint32_t key, unsigned int bucket) {
+	qid_shard_t *shard = QID_SHARD(qid, bucket);
+	atomic_uintptr_t *chain = QID_CHAIN(qid, bucket);
+	dns_dispentry_t *res;
+	uint_fast32_t seq;
+	int tries;
+
+	for (tries = 0; tries < 4; tries++) {
+		seq = atomic_load_acquire(&shard->seq);
+		if ((seq & 1) != 0) {
+			continue;
+		}
+
+		/*
+		 * A stale pointer can lead into another chain, or around
+		 * in a circle, but only after 'seq' has changed.
+		 */
+		res = (dns_dispentry_t *)atomic_load_acquire(chain);
+		while (res != NULL && atomic_load_relaxed(&shard->seq) == seq) {
+			if (atomic_load_acquire(&res->key) == key) {
+				return (true);
+			}
+			res = (dns_dispentry_t *)atomic_load_acquire(
+				&res->hashnext);
+		}
+		if (atomic_load_relaxed(&shard->seq) == seq) {
+			return (false);
 		}
-		bucket++;
 	}
 
-	return (NULL);
+	return (true);
 }
 
 /*
- * Find the next entry after 'resp' in 'qid'.  Return NULL if there are
- * no more entries.
+ * Find the response entry for query ID 'id', socket address 'dest', and
+ * port number 'port', and store its bucket in '*bucketp'.  If an entry
+ * is found, its shard is returned locked, and the caller must unlock it
+ * with QID_SHARD(qid, *bucketp)->lock.  Packets that match nothing are
+ * normally turned away without taking the lock.
  */
 static dns_dispentry_t *
-linear_next(dns_qid_t *qid, dns_dispentry_t *resp) {
-	dns_dispentry_t *ret;
-	unsigned int bucket;
+qid_find(dns_qid_t *qid, const isc_sockaddr_t *dest, dns_messageid_t id,
+	 in_port_t port, unsigned int *bucketp) {
+	dns_dispentry_t *res;
+	qid_shard_t *shard;
+	uint32_t key;
+
+	key = qid_key(dest, id, port);
+	*bucketp = key % qid->qid_nbuckets;
 
-	ret = ISC_LIST_NEXT(resp, link);
-	if (ret != NULL) {
-		return (ret);
+	if (atomic_load_relaxed(&qid_lockfree) &&
+	    !qid_maybefound(qid, key, *bucketp)) {
+		return (NULL);
 	}
 
-	bucket = resp->bucket;
-	bucket++;
-	while (bucket < qid->qid_nbuckets) {
-		ret = ISC_LIST_HEAD(qid->qid_table[bucket]);
-		if (ret != NULL) {
-			return (ret);
-		}
-		bucket++;
+	shard = QID_SHARD(qid, *bucketp);
+	LOCK(&shard->lock);
+	res = entry_search(qid, dest, id, port, *bucketp);
+	if (res == NULL) {
+		UNLOCK(&shard->lock);
 	}
 
-	return (NULL);
+	return (res);
+}
+
+bool
+dns__dispatch_findresponse(dns_dispatch_t *disp, const isc_sockaddr_t *dest,
+			   dns_messageid_t id) {
+	dns_dispentry_t *res;
+	unsigned int bucket;
+	dns_qid_t *qid;
+
+	REQUIRE(VALID_DISPATCH(disp));
+
+	qid = DNS_QID(disp);
+	res = qid_find(qid, dest, id, disp->localport, &bucket);
+	if (res == NULL) {
+		return (false);
+	}
+	UNLOCK(&QID_SHARD(qid, bucket)->lock);
+
+	return (true);
 }
 
 /*
@@ -710,6 +899,10 @@ get_dispsocket(dns_dispatch_t *disp, const isc_sockaddr_t *dest,
 
 		disp->nsockets++;
 		dispsock->socket = NULL;
+		dispsock->handle = NULL;
+		dispsock->connecting = false;
+		dispsock->reading = false;
+		dispsock->canceled = false;
 		dispsock->disp = disp;
 		dispsock->resp = NULL;
 		dispsock->portentry = NULL;
@@ -823,6 +1016,9 @@ destroy_dispsocket(dns_dispatch_t *disp, dispsocket_t **dispsockp) {
 	if (dispsock->socket != NULL) {
 		isc_socket_detach(&dispsock->socket);
 	}
+	if (dispsock->handle != NULL) {
+		isc_nmhandle_detach(&dispsock->handle);
+	}
 	if (ISC_LINK_LINKED(dispsock, blink)) {
 		LOCK(&qid->lock);
 		ISC_LIST_UNLINK(qid->sock_table[dispsock->bucket], dispsock,
@@ -883,10 +1079,206 @@ deactivate_dispsocket(dns_dispatch_t *disp, dispsocket_t *dispsock) {
 	}
 }
 
+/*
+ * Called by the network manager when a netmgr dispatch socket has been
+ * connected: keep the handle, and start reading.  The dispatch isn't
+ * locked, but nothing else uses the socket while it is connecting.
+ */
+static void
+udp_nmconnected(isc_nmhandle_t *handle, isc_result_t eresult, void *arg) {
+	dispsocket_t *dispsock = arg;
+
+	REQUIRE(VALID_DISPSOCK(dispsock));
+	INSIST(dispsock->connecting);
+
+	if (eresult != ISC_R_SUCCESS) {
+		return;
+	}
+
+	isc_nmhandle_attach(handle, &dispsock->handle);
+	dispsock->reading = true;
+	isc_nm_read(handle, udp_nmrecv, dispsock);
+}
+
+/*%
+ * Stop using a netmgr dispatch socket.  If its read callback will be
+ * called again, cancel the read and let the callback destroy the socket;
+ * otherwise, destroy it now.  The dispatch must be locked.
+ */
+static void
+close_nmdispsocket(dns_dispatch_t *disp, dispsocket_t *dispsock) {
+	INSIST(!dispsock->connecting);
+
+	if (dispsock->resp != NULL) {
+		INSIST(dispsock->resp->dispsocket == dispsock);
+		dispsock->resp->dispsocket = NULL;
+		dispsock->resp = NULL;
+	}
+
+	if (dispsock->reading) {
+		if (!dispsock->canceled) {
+			dispsock->canceled = true;
+			isc_nm_cancelread(dispsock->handle);
+		}
+		return;
+	}
+
+	ISC_LIST_UNLINK(disp->activesockets, dispsock, link);
+	destroy_dispsocket(disp, &dispsock);
+}
+
+/*%
+ * Make a new netmgr socket for a single dispatch with a random port
+ * number, connected to 'dest'.  The socket is added to the active sockets
+ * at once, so that the dispatch isn't destroyed while it is connecting.
+ *
+ * The caller must hold the disp->lock, which is released while the socket
+ * is being connected: the network manager may need to deliver events to
+ * other sockets of this dispatch first.
+ */
+static isc_result_t
+get_nmdispsocket(dns_dispatch_t *disp, const isc_sockaddr_t *dest,
+		 dispsocket_t **dispsockp, in_port_t *portp) {
+	dns_dispatchmgr_t *mgr = disp->mgr;
+	dns_qid_t *qid = DNS_QID(disp);
+	dispportentry_t *portentry = NULL;
+	dispsocket_t *dispsock = NULL;
+	isc_sockaddr_t local, peer;
+	isc_result_t result = ISC_R_FAILURE;
+	unsigned int nports, bucket;
+	in_port_t *ports, port = 0;
+	int i;
+
+	if (isc_sockaddr_pf(&disp->local) == AF_INET) {
+		nports = mgr->nv4ports;
+		ports = mgr->v4ports;
+	} else {
+		nports = mgr->nv6ports;
+		ports = mgr->v6ports;
+	}
+	if (nports == 0) {
+		return (ISC_R_ADDRNOTAVAIL);
+	}
+
+	dispsock = isc_mempool_get(mgr->spool);
+	if (dispsock == NULL) {
+		return (ISC_R_NOMEMORY);
+	}
+	*dispsock = (dispsocket_t){ .disp = disp,
+				    .host = *dest,
+				    .connecting = true };
+	ISC_LINK_INIT(dispsock, link);
+	ISC_LINK_INIT(dispsock, blink);
+	dispsock->magic = DISPSOCK_MAGIC;
+	disp->nsockets++;
+
+	local = disp->local;
+	peer = *dest;
+
+	/*
+	 * Pick up a random UDP port, avoiding ports that are already used
+	 * for the same destination, and reserve it while connecting.
+	 */
+	for (i = 0; i < 64; i++) {
+		port = ports[isc_random_uniform(nports)];
+
+		LOCK(&qid->lock);
+		bucket = dns_hash(qid, dest, 0, port);
+		if (socket_search(qid, dest, port, bucket) != NULL) {
+			UNLOCK(&qid->lock);
+			continue;
+		}
+		UNLOCK(&qid->lock);
+
+		portentry = port_search(disp, port);
+		if (portentry == NULL) {
+			portentry = new_portentry(disp, port);
+			if (portentry == NULL) {
+				result = ISC_R_NOMEMORY;
+				break;
+			}
+		} else {
+			isc_refcount_increment(&portentry->refs);
+		}
+
+		LOCK(&qid->lock);
+		dispsock->portentry = portentry;
+		dispsock->bucket = bucket;
+		ISC_LIST_APPEND(qid->sock_table[bucket], dispsock, blink);
+		UNLOCK(&qid->lock);
+		ISC_LIST_APPEND(disp->activesockets, dispsock, link);
+
+		isc_sockaddr_setport(&local, port);
+		UNLOCK(&disp->lock);
+		result = isc_nm_udpconnect(disp->nm, (isc_nmiface_t *)&local,
+					   (isc_nmiface_t *)&peer,
+					   udp_nmconnected, dispsock, 0, 0);
+		LOCK(&disp->lock);
+		if (result == ISC_R_SUCCESS) {
+			break;
+		}
+
+		ISC_LIST_UNLINK(disp->activesockets, dispsock, link);
+		LOCK(&qid->lock);
+		ISC_LIST_UNLINK(qid->sock_table[bucket], dispsock, blink);
+		deref_portentry(disp, &dispsock->portentry);
+		UNLOCK(&qid->lock);
+
+		if (result == ISC_R_NOPERM) {
+			char buf[ISC_SOCKADDR_FORMATSIZE];
+			isc_sockaddr_format(&local, buf, sizeof(buf));
+			dispatch_log(disp, ISC_LOG_WARNING,
+				     "isc_nm_udpconnect(%s) -> %s: continuing",
+				     buf, isc_result_totext(result));
+		} else if (result != ISC_R_ADDRINUSE) {
+			break;
+		}
+	}
+
+	if (result != ISC_R_SUCCESS) {
+		destroy_dispsocket(disp, &dispsock);
+		return (result);
+	}
+
+	/*
+	 * The network manager may have shut the socket down already, or
+	 * the dispatch may have been shut down while we weren't holding
+	 * the lock.
+	 */
+	if (!dispsock->reading || disp->shutting_down == 1) {
+		dispsock->connecting = false;
+		close_nmdispsocket(disp, dispsock);
+		return (ISC_R_SHUTTINGDOWN);
+	}
+
+	*dispsockp = dispsock;
+	*portp = port;
+
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Give up a dispatch socket that was obtained for a response that could
+ * not be added.  The dispatch must be locked.
+ */
+static void
+release_dispsocket(dns_dispatch_t *disp, dispsocket_t **dispsockp) {
+	dispsocket_t *dispsock = *dispsockp;
+
+	*dispsockp = NULL;
+	if (disp->nm != NULL) {
+		dispsock->connecting = false;
+		close_nmdispsocket(disp, dispsock);
+	} else {
+		destroy_dispsocket(disp, &dispsock);
+	}
+}
+
 /*
  * Find an entry for query ID 'id', socket address 'dest', and port number
  * 'port'.
- * Return NULL if no such entry exists.
+ * Return NULL if no such entry exists.  Requires the shard of 'bucket' to
+ * be locked.
  */
 static dns_dispentry_t *
 entry_search(dns_qid_t *qid, const isc_sockaddr_t *dest, dns_messageid_t id,
@@ -896,14 +1288,14 @@ entry_search(dns_qid_t *qid, const isc_sockaddr_t *dest, dns_messageid_t id,
 	REQUIRE(VALID_QID(qid));
 	REQUIRE(bucket < qid->qid_nbuckets);
 
-	res = ISC_LIST_HEAD(qid->qid_table[bucket]);
+	res = (dns_dispentry_t *)atomic_load_relaxed(QID_CHAIN(qid, bucket));
 
 	while (res != NULL) {
 		if (res->id == id && isc_sockaddr_equal(dest, &res->host) &&
 		    res->port == port) {
 			return (res);
 		}
-		res = ISC_LIST_NEXT(res, link);
+		res = (dns_dispentry_t *)atomic_load_relaxed(&res->hashnext);
 	}
 
 	return (NULL);
@@ -1016,6 +1408,140 @@ allocate_devent(dns_dispatch_t *disp) {
 	return (ev);
 }
 
+/*
+ * Stop other queries from waiting for the response to the query of
+ * 'resp'.  Entries that are already waiting for it are left to time out
+ * if 'rev' is NULL; otherwise they are sent a copy of 'rev', the first
+ * event for 'resp', with their own message ID.
+ *
+ * disp must be locked.
+ */
+static void
+coalesce_respond(dns_dispatch_t *disp, dns_dispentry_t *resp,
+		 dns_dispatchevent_t *rev) {
+	dns_dispentry_t *waiter;
+	dns_dispatchevent_t *wev;
+	unsigned char *buf;
+	unsigned int length;
+
+	if (resp->query == NULL) {
+		return;
+	}
+
+	ISC_LIST_UNLINK(disp->coalesced[resp->queryhash &
+					(DISPATCH_COALESCEBUCKETS - 1)],
+			resp, clink);
+	isc_mem_put(disp->mgr->mctx, resp->query, resp->querylen);
+	resp->query = NULL;
+
+	while ((waiter = ISC_LIST_HEAD(resp->waiters)) != NULL) {
+		ISC_LIST_UNLINK(resp->waiters, waiter, clink);
+		waiter->leader = NULL;
+
+		if (rev == NULL) {
+			continue;
+		}
+
+		wev = allocate_devent(disp);
+		if (wev == NULL) {
+			continue;
+		}
+		if (rev->buffer.base != NULL) {
+			buf = allocate_udp_buffer(disp);
+			if (buf == NULL) {
+				free_devent(disp, wev);
+				continue;
+			}
+			length = isc_buffer_usedlength(&rev->buffer);
+			memmove(buf, rev->buffer.base, length);
+			buf[0] = (waiter->id >> 8) & 0xff;
+			buf[1] = waiter->id & 0xff;
+			isc_buffer_init(&wev->buffer, buf,
+					disp->mgr->buffersize);
+			isc_buffer_add(&wev->buffer, length);
+		} else {
+			isc_buffer_initnull(&wev->buffer);
+		}
+		wev->result = rev->result;
+		wev->id = waiter->id;
+		wev->addr = rev->addr;
+		wev->pktinfo = rev->pktinfo;
+		wev->attributes = rev->attributes;
+		if (waiter->item_out) {
+			ISC_LIST_APPEND(waiter->items, wev, ev_link);
+		} else {
+			ISC_EVENT_INIT(wev, sizeof(*wev), 0, NULL,
+				       DNS_EVENT_DISPATCH, waiter->action,
+				       waiter->arg, waiter, NULL, NULL);
+			request_log(disp, waiter, LVL(90),
+				    "[w] Sent event %p buffer %p len %d to "
+				    "task %p",
+				    wev, wev->buffer.base, wev->buffer.length,
+				    waiter->task);
+			waiter->item_out = true;
+			isc_task_send(waiter->task, ISC_EVENT_PTR(&wev));
+		}
+	}
+}
+
+/*
+ * 'resp' is being removed before it got an event.  If other entries are
+ * waiting for its response, make the first of them the leader instead:
+ * send it the query of 'resp' with its own message ID, and let the rest
+ * wait for its response.
+ *
+ * disp must be locked.
+ */
+static void
+coalesce_promote(dns_dispatch_t *disp, dns_dispentry_t *resp) {
+	dns_displist_t *bucket;
+	dns_dispentry_t *leader, *waiter;
+	dispsend_t *send;
+	isc_region_t region;
+
+	leader = ISC_LIST_HEAD(resp->waiters);
+	if (leader == NULL) {
+		coalesce_respond(disp, resp, NULL);
+		return;
+	}
+
+	INSIST(leader->handle != NULL);
+	ISC_LIST_UNLINK(resp->waiters, leader, clink);
+	leader->leader = NULL;
+	while ((waiter = ISC_LIST_HEAD(resp->waiters)) != NULL) {
+		ISC_LIST_UNLINK(resp->waiters, waiter, clink);
+		waiter->leader = leader;
+		ISC_LIST_APPEND(leader->waiters, waiter, clink);
+	}
+
+	bucket = &disp->coalesced[resp->queryhash &
+				  (DISPATCH_COALESCEBUCKETS - 1)];
+	ISC_LIST_UNLINK(*bucket, resp, clink);
+	leader->query = resp->query;
+	leader->querylen = resp->querylen;
+	leader->queryhash = resp->queryhash;
+	leader->query[0] = (leader->id >> 8) & 0xff;
+	leader->query[1] = leader->id & 0xff;
+	resp->query = NULL;
+	ISC_LIST_APPEND(*bucket, leader, clink);
+
+	/*
+	 * The copy being sent must outlive 'leader', which may be removed
+	 * before the send completes.
+	 */
+	send = isc_mem_get(disp->mgr->mctx, sizeof(*send));
+	*send = (dispsend_t){ .length = leader->querylen };
+	isc_mem_attach(disp->mgr->mctx, &send->mctx);
+	send->buf = isc_mem_get(send->mctx, send->length);
+	memmove(send->buf, leader->query, send->length);
+
+	request_log(disp, leader, LVL(90), "sending query of removed %u",
+		    resp->id);
+	region.base = send->buf;
+	region.length = send->length;
+	isc_nm_send(leader->handle, &region, udp_nmsenddone, send);
+}
+
 static void
 udp_exrecv(isc_task_t *task, isc_event_t *ev) {
 	dispsocket_t *dispsock = ev->ev_arg;
@@ -1208,11 +1734,8 @@ udp_recv(isc_event_t *ev_in, dns_dispatch_t *disp, dispsocket_t *dispsock) {
 	 * the ID and the address must match the expected ones.
 	 */
 	if (resp == NULL) {
-		bucket = dns_hash(qid, &ev->address, id, disp->localport);
-		LOCK(&qid->lock);
-		qidlocked = true;
-		resp = entry_search(qid, &ev->address, id, disp->localport,
-				    bucket);
+		resp = qid_find(qid, &ev->address, id, disp->localport,
+				&bucket);
 		dispatch_log(disp, LVL(90),
 			     "search for response in bucket %d: %s", bucket,
 			     (resp == NULL ? "not found" : "found"));
@@ -1222,6 +1745,7 @@ udp_recv(isc_event_t *ev_in, dns_dispatch_t *disp, dispsocket_t *dispsock) {
 			free_buffer(disp, ev->region.base, ev->region.length);
 			goto unlock;
 		}
+		qidlocked = true;
 	} else if (resp->id != id ||
 		   !isc_sockaddr_equal(&ev->address, &resp->host)) {
 		dispatch_log(disp, LVL(90),
@@ -1298,6 +1822,7 @@ sendresponse:
 	rev->addr = ev->address;
 	rev->pktinfo = ev->pktinfo;
 	rev->attributes = ev->attributes;
+	coalesce_respond(disp, resp, rev);
 	if (queue_response) {
 		ISC_LIST_APPEND(resp->items, rev, ev_link);
 	} else {
@@ -1312,7 +1837,7 @@ sendresponse:
 	}
 unlock:
 	if (qidlocked) {
-		UNLOCK(&qid->lock);
+		UNLOCK(&QID_SHARD(qid, bucket)->lock);
 	}
 
 	/*
@@ -1333,6 +1858,177 @@ restart:
 	UNLOCK(&disp->lock);
 }
 
+/*
+ * Called by the network manager with a datagram received on a netmgr
+ * dispatch socket, or with the result of a failed or canceled read, after
+ * which it isn't called again.
+ *
+ * The socket is connected to the server the query was sent to, so the
+ * response is known without looking it up in the QID table; only the
+ * message ID needs to be checked.
+ */
+static void
+udp_nmrecv(isc_nmhandle_t *handle, isc_result_t eresult, isc_region_t *region,
+	   void *arg) {
+	dispsocket_t *dispsock = arg;
+	dns_dispatch_t *disp;
+	dns_dispatchmgr_t *mgr;
+	dns_dispentry_t *resp;
+	dns_dispatchevent_t *rev;
+	dns_messageid_t id;
+	isc_sockaddr_t peer;
+	isc_netaddr_t netaddr;
+	isc_buffer_t source;
+	isc_result_t dres;
+	unsigned int flags, length = 0;
+	void *buf = NULL;
+	bool killit = false, again = false;
+	int match;
+
+	REQUIRE(VALID_DISPSOCK(dispsock));
+
+	disp = dispsock->disp;
+	mgr = disp->mgr;
+
+	LOCK(&disp->lock);
+
+	if (eresult != ISC_R_SUCCESS) {
+		dispsock->reading = false;
+	}
+
+	/*
+	 * Nothing can be expected before the socket is used for a query.
+	 */
+	if (dispsock->connecting) {
+		again = dispsock->reading;
+		goto unlock;
+	}
+
+	resp = dispsock->resp;
+	if (resp == NULL || dispsock->canceled || disp->shutting_down == 1 ||
+	    eresult == ISC_R_CANCELED || eresult == ISC_R_EOF)
+	{
+		close_nmdispsocket(disp, dispsock);
+		killit = destroy_disp_ok(disp);
+		goto unlock;
+	}
+
+	if (eresult != ISC_R_SUCCESS) {
+		/*
+		 * This is most likely a network error on the connected
+		 * socket; return it to the caller.
+		 */
+		id = resp->id;
+		peer = resp->host;
+		goto sendresponse;
+	}
+
+	/*
+	 * If this is from a blackholed address, drop it.
+	 */
+	peer = isc_nmhandle_peeraddr(handle);
+	isc_netaddr_fromsockaddr(&netaddr, &peer);
+	if (mgr->blackhole != NULL &&
+	    dns_acl_match(&netaddr, NULL, mgr->blackhole, NULL, &match,
+			  NULL) == ISC_R_SUCCESS &&
+	    match > 0)
+	{
+		if (isc_log_wouldlog(dns_lctx, LVL(10))) {
+			char netaddrstr[ISC_NETADDR_FORMATSIZE];
+			isc_netaddr_format(&netaddr, netaddrstr,
+					   sizeof(netaddrstr));
+			dispatch_log(disp, LVL(10), "blackholed packet from %s",
+				     netaddrstr);
+		}
+		again = true;
+		goto unlock;
+	}
+
+	isc_buffer_init(&source, region->base, region->length);
+	isc_buffer_add(&source, region->length);
+	dres = dns_message_peekheader(&source, &id, &flags);
+	if (dres != ISC_R_SUCCESS) {
+		dispatch_log(disp, LVL(10), "got garbage packet");
+		again = true;
+		goto unlock;
+	}
+
+	dispatch_log(disp, LVL(92),
+		     "got valid DNS message header, /QR %c, id %u",
+		     (((flags & DNS_MESSAGEFLAG_QR) != 0) ? '1' : '0'), id);
+
+	if ((flags & DNS_MESSAGEFLAG_QR) == 0) {
+		again = true;
+		goto unlock;
+	}
+
+	if (resp->id != id) {
+		dispatch_log(disp, LVL(90),
+			     "response to an exclusive socket doesn't match");
+		inc_stats(mgr, dns_resstatscounter_mismatch);
+		again = true;
+		goto unlock;
+	}
+
+	buf = allocate_udp_buffer(disp);
+	if (buf == NULL) {
+		again = true;
+		goto unlock;
+	}
+	length = ISC_MIN(region->length, mgr->buffersize);
+	memmove(buf, region->base, length);
+
+sendresponse:
+	again = dispsock->reading;
+	rev = allocate_devent(disp);
+	if (rev == NULL) {
+		if (buf != NULL) {
+			free_buffer(disp, buf, mgr->buffersize);
+		}
+		goto unlock;
+	}
+
+	if (buf != NULL) {
+		isc_buffer_init(&rev->buffer, buf, mgr->buffersize);
+		isc_buffer_add(&rev->buffer, length);
+	} else {
+		isc_buffer_initnull(&rev->buffer);
+	}
+	rev->result = eresult;
+	rev->id = id;
+	rev->addr = peer;
+	memset(&rev->pktinfo, 0, sizeof(rev->pktinfo));
+	rev->attributes = 0;
+	coalesce_respond(disp, resp, rev);
+	if (resp->item_out) {
+		ISC_LIST_APPEND(resp->items, rev, ev_link);
+	} else {
+		ISC_EVENT_INIT(rev, sizeof(*rev), 0, NULL, DNS_EVENT_DISPATCH,
+			       resp->action, resp->arg, resp, NULL, NULL);
+		request_log(disp, resp, LVL(90),
+			    "[n] Sent event %p buffer %p len %d to task %p",
+			    rev, rev->buffer.base, rev->buffer.length,
+			    resp->task);
+		resp->item_out = true;
+		isc_task_send(resp->task, ISC_EVENT_PTR(&rev));
+	}
+
+unlock:
+	UNLOCK(&disp->lock);
+
+	if (killit) {
+		isc_task_send(disp->task[0], &disp->ctlevent);
+	}
+
+	/*
+	 * The socket can't be destroyed while its read callback will be
+	 * called again, so it is safe to use after unlocking.
+	 */
+	if (again) {
+		isc_nm_read(handle, udp_nmrecv, dispsock);
+	}
+}
+
 /*
  * General flow:
  *
@@ -1469,14 +2165,12 @@ tcp_recv(isc_task_t *task, isc_event_t *ev_in) {
 	/*
 	 * Response.
 	 */
-	bucket = dns_hash(qid, &tcpmsg->address, id, disp->localport);
-	LOCK(&qid->lock);
-	resp = entry_search(qid, &tcpmsg->address, id, disp->localport, bucket);
+	resp = qid_find(qid, &tcpmsg->address, id, disp->localport, &bucket);
 	dispatch_log(disp, LVL(90), "search for response in bucket %d: %s",
 		     bucket, (resp == NULL ? "not found" : "found"));
 
 	if (resp == NULL) {
-		goto unlock;
+		goto restart;
 	}
 	queue_response = resp->item_out;
 	rev = allocate_devent(disp);
@@ -1507,7 +2201,7 @@ tcp_recv(isc_task_t *task, isc_event_t *ev_in) {
 		isc_task_send(resp->task, ISC_EVENT_PTR(&rev));
 	}
 unlock:
-	UNLOCK(&qid->lock);
+	UNLOCK(&QID_SHARD(qid, bucket)->lock);
 
 	/*
 	 * Restart recv() to get the next packet.
@@ -1545,6 +2239,14 @@ startrecv(dns_dispatch_t *disp, dispsocket_t *dispsock) {
 		return (ISC_R_SUCCESS);
 	}
 
+	/*
+	 * Netmgr dispatch sockets start reading as soon as they are
+	 * connected.
+	 */
+	if (disp->nm != NULL) {
+		return (ISC_R_SUCCESS);
+	}
+
 	if (dispsock != NULL) {
 		sock = dispsock->socket;
 	} else {
@@ -1796,6 +2498,7 @@ dns_dispatchmgr_create(isc_mem_t *mctx, dns_dispatchmgr_t **mgrp) {
 
 	mgr->blackhole = NULL;
 	mgr->stats = NULL;
+	mgr->nm = NULL;
 
 	isc_mutex_init(&mgr->lock);
 	isc_mutex_init(&mgr->buffer_lock);
@@ -1821,9 +2524,13 @@ dns_dispatchmgr_create(isc_mem_t *mctx, dns_dispatchmgr_t **mgrp) {
 	isc_mempool_associatelock(mgr->depool, &mgr->depool_lock);
 	isc_mempool_setfillcount(mgr->depool, 32);
 
+	/*
+	 * Response entries are never given back to the memory context
+	 * while the manager exists; see the comment above qid_shard_t.
+	 */
 	isc_mempool_setname(mgr->rpool, "dispmgr_rpool");
-	isc_mempool_setmaxalloc(mgr->rpool, 32768);
-	isc_mempool_setfreemax(mgr->rpool, 32768);
+	isc_mempool_setmaxalloc(mgr->rpool, DISPATCH_MAXRESPONSES);
+	isc_mempool_setfreemax(mgr->rpool, UINT_MAX);
 	isc_mempool_associatelock(mgr->rpool, &mgr->rpool_lock);
 	isc_mempool_setfillcount(mgr->rpool, 32);
 
@@ -1958,6 +2665,7 @@ dns_dispatchmgr_setudp(dns_dispatchmgr_t *mgr, unsigned int buffersize,
 		       unsigned int maxbuffers, unsigned int maxrequests,
 		       unsigned int buckets, unsigned int increment) {
 	isc_result_t result;
+	unsigned int nshards = 1;
 
 	REQUIRE(VALID_DISPATCHMGR(mgr));
 	REQUIRE(buffersize >= 512 && buffersize < (64 * 1024));
@@ -2027,7 +2735,12 @@ dns_dispatchmgr_setudp(dns_dispatchmgr_t *mgr, unsigned int buffersize,
 	isc_mempool_associatelock(mgr->spool, &mgr->spool_lock);
 	isc_mempool_setfillcount(mgr->spool, 32);
 
-	result = qid_allocate(mgr, buckets, increment, &mgr->qid, true);
+	while (nshards < isc_os_ncpus() &&
+	       nshards < DISPATCH_MAXQIDSHARDS) {
+		nshards *= 2;
+	}
+	result = qid_allocate(mgr, buckets, increment, nshards, &mgr->qid,
+			      true);
 	if (result != ISC_R_SUCCESS) {
 		goto cleanup;
 	}
@@ -2078,6 +2791,15 @@ dns_dispatchmgr_setstats(dns_dispatchmgr_t *mgr, isc_stats_t *stats) {
 	isc_stats_attach(stats, &mgr->stats);
 }
 
+void
+dns_dispatchmgr_setnetmgr(dns_dispatchmgr_t *mgr, isc_nm_t *nm) {
+	REQUIRE(VALID_DISPATCHMGR(mgr));
+	REQUIRE(ISC_LIST_EMPTY(mgr->list));
+	REQUIRE(nm != NULL);
+
+	mgr->nm = nm;
+}
+
 static int
 port_cmp(const void *key, const void *ent) {
 	in_port_t p1 = *(const in_port_t *)key;
@@ -2233,19 +2955,35 @@ out:
 
 static isc_result_t
 qid_allocate(dns_dispatchmgr_t *mgr, unsigned int buckets,
-	     unsigned int increment, dns_qid_t **qidp, bool needsocktable) {
+	     unsigned int increment, unsigned int nshards, dns_qid_t **qidp,
+	     bool needsocktable) {
 	dns_qid_t *qid;
-	unsigned int i;
+	unsigned int i, j;
 
 	REQUIRE(VALID_DISPATCHMGR(mgr));
 	REQUIRE(buckets < 2097169); /* next prime > 65536 * 32 */
 	REQUIRE(increment > buckets);
+	REQUIRE(nshards > 0 && (nshards & (nshards - 1)) == 0);
 	REQUIRE(qidp != NULL && *qidp == NULL);
 
 	qid = isc_mem_get(mgr->mctx, sizeof(*qid));
 
-	qid->qid_table = isc_mem_get(mgr->mctx,
-				     buckets * sizeof(dns_displist_t));
+	qid->qid_nbuckets = buckets;
+	qid->qid_nshards = nshards;
+	qid->qid_shards = isc_mem_get(mgr->mctx,
+				      nshards * sizeof(qid_shard_t));
+	for (i = 0; i < nshards; i++) {
+		qid_shard_t *shard = &qid->qid_shards[i];
+
+		isc_mutex_init(&shard->lock);
+		atomic_init(&shard->seq, 0);
+		shard->table = isc_mem_get(mgr->mctx,
+					   QID_SHARDBUCKETS(qid) *
+						   sizeof(atomic_uintptr_t));
+		for (j = 0; j < QID_SHARDBUCKETS(qid); j++) {
+			atomic_init(&shard->table[j], 0);
+		}
+	}
 
 	qid->sock_table = NULL;
 	if (needsocktable) {
@@ -2255,14 +2993,12 @@ qid_allocate(dns_dispatchmgr_t *mgr, unsigned int buckets,
 
 	isc_mutex_init(&qid->lock);
 
-	for (i = 0; i < buckets; i++) {
-		ISC_LIST_INIT(qid->qid_table[i]);
-		if (qid->sock_table != NULL) {
+	if (qid->sock_table != NULL) {
+		for (i = 0; i < buckets; i++) {
 			ISC_LIST_INIT(qid->sock_table[i]);
 		}
 	}
 
-	qid->qid_nbuckets = buckets;
 	qid->qid_increment = increment;
 	qid->magic = QID_MAGIC;
 	*qidp = qid;
@@ -2272,6 +3008,7 @@ qid_allocate(dns_dispatchmgr_t *mgr, unsigned int buckets,
 static void
 qid_destroy(isc_mem_t *mctx, dns_qid_t **qidp) {
 	dns_qid_t *qid;
+	unsigned int i;
 
 	REQUIRE(qidp != NULL);
 	qid = *qidp;
@@ -2280,8 +3017,15 @@ qid_destroy(isc_mem_t *mctx, dns_qid_t **qidp) {
 	REQUIRE(VALID_QID(qid));
 
 	qid->magic = 0;
-	isc_mem_put(mctx, qid->qid_table,
-		    qid->qid_nbuckets * sizeof(dns_displist_t));
+	for (i = 0; i < qid->qid_nshards; i++) {
+		qid_shard_t *shard = &qid->qid_shards[i];
+
+		isc_mem_put(mctx, shard->table,
+			    QID_SHARDBUCKETS(qid) * sizeof(atomic_uintptr_t));
+		isc_mutex_destroy(&shard->lock);
+	}
+	isc_mem_put(mctx, qid->qid_shards,
+		    qid->qid_nshards * sizeof(qid_shard_t));
 	if (qid->sock_table != NULL) {
 		isc_mem_put(mctx, qid->sock_table,
 			    qid->qid_nbuckets * sizeof(dispsocketlist_t));
@@ -2335,7 +3079,9 @@ dispatch_allocate(dns_dispatchmgr_t *mgr, unsigned int maxrequests,
 	disp->nsockets = 0;
 	disp->port_table = NULL;
 	disp->portpool = NULL;
+	disp->nm = NULL;
 	disp->dscp = -1;
+	disp->coalesced = NULL;
 
 	isc_mutex_init(&disp->lock);
 
@@ -2406,6 +3152,15 @@ dispatch_free(dns_dispatch_t **dispp) {
 		isc_mempool_destroy(&disp->portpool);
 	}
 
+	if (disp->coalesced != NULL) {
+		for (int i = 0; i < DISPATCH_COALESCEBUCKETS; i++) {
+			INSIST(ISC_LIST_EMPTY(disp->coalesced[i]));
+		}
+		isc_mem_put(mgr->mctx, disp->coalesced,
+			    sizeof(disp->coalesced[0]) *
+				    DISPATCH_COALESCEBUCKETS);
+	}
+
 	disp->mgr = NULL;
 	isc_mutex_destroy(&disp->lock);
 	disp->magic = 0;
@@ -2447,7 +3202,7 @@ dns_dispatch_createtcp(dns_dispatchmgr_t *mgr, isc_socket_t *sock,
 		return (result);
 	}
 
-	result = qid_allocate(mgr, buckets, increment, &disp->qid, false);
+	result = qid_allocate(mgr, buckets, increment, 1, &disp->qid, false);
 	if (result != ISC_R_SUCCESS) {
 		goto deallocate_dispatch;
 	}
@@ -2890,11 +3645,18 @@ dispatch_createudp(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 				   &disp->portpool);
 		isc_mempool_setname(disp->portpool, "disp_portpool");
 		isc_mempool_setfreemax(disp->portpool, 128);
+
+		disp->nm = mgr->nm;
 	}
 	disp->socket = sock;
 	disp->local = *localaddr;
 
-	if ((attributes & DNS_DISPATCHATTR_EXCLUSIVE) != 0) {
+	/*
+	 * Netmgr sockets are read by the network threads, so the internal
+	 * tasks are only needed for sockets from the socket manager.
+	 */
+	if ((attributes & DNS_DISPATCHATTR_EXCLUSIVE) != 0 && disp->nm == NULL)
+	{
 		disp->ntasks = MAX_INTERNAL_TASKS;
 	} else {
 		disp->ntasks = 1;
@@ -2981,7 +3743,7 @@ dns_dispatch_attach(dns_dispatch_t *disp, dns_dispatch_t **dispp) {
 void
 dns_dispatch_detach(dns_dispatch_t **dispp) {
 	dns_dispatch_t *disp;
-	dispsocket_t *dispsock;
+	dispsocket_t *dispsock, *next;
 	bool killit;
 
 	REQUIRE(dispp != NULL && VALID_DISPATCH(*dispp));
@@ -2999,10 +3761,16 @@ dns_dispatch_detach(dns_dispatch_t **dispp) {
 					  ISC_SOCKCANCEL_RECV);
 		}
 		for (dispsock = ISC_LIST_HEAD(disp->activesockets);
-		     dispsock != NULL; dispsock = ISC_LIST_NEXT(dispsock, link))
+		     dispsock != NULL; dispsock = next)
 		{
-			isc_socket_cancel(dispsock->socket, dispsock->task,
-					  ISC_SOCKCANCEL_RECV);
+			next = ISC_LIST_NEXT(dispsock, link);
+			if (disp->nm == NULL) {
+				isc_socket_cancel(dispsock->socket,
+						  dispsock->task,
+						  ISC_SOCKCANCEL_RECV);
+			} else if (!dispsock->connecting) {
+				close_nmdispsocket(disp, dispsock);
+			}
 		}
 		disp->shutting_down = 1;
 	}
@@ -3029,6 +3797,7 @@ dns_dispatch_addresponse(dns_dispatch_t *disp, unsigned int options,
 	int i;
 	bool ok;
 	dns_qid_t *qid;
+	qid_shard_t *shard;
 	dispsocket_t *dispsocket = NULL;
 	isc_result_t result;
 
@@ -3037,7 +3806,8 @@ dns_dispatch_addresponse(dns_dispatch_t *disp, unsigned int options,
 	REQUIRE(dest != NULL);
 	REQUIRE(resp != NULL && *resp == NULL);
 	REQUIRE(idp != NULL);
-	if ((disp->attributes & DNS_DISPATCHATTR_EXCLUSIVE) != 0) {
+	if ((disp->attributes & DNS_DISPATCHATTR_EXCLUSIVE) != 0 &&
+	    disp->nm == NULL) {
 		REQUIRE(sockmgr != NULL);
 	}
 
@@ -3099,8 +3869,13 @@ dns_dispatch_addresponse(dns_dispatch_t *disp, unsigned int options,
 		/*
 		 * Get a separate UDP socket with a random port number.
 		 */
-		result = get_dispsocket(disp, dest, sockmgr, &dispsocket,
-					&localport);
+		if (disp->nm != NULL) {
+			result = get_nmdispsocket(disp, dest, &dispsocket,
+						  &localport);
+		} else {
+			result = get_dispsocket(disp, dest, sockmgr,
+						&dispsocket, &localport);
+		}
 		if (result != ISC_R_SUCCESS) {
 			UNLOCK(&disp->lock);
 			inc_stats(disp->mgr, dns_resstatscounter_dispsockfail);
@@ -3114,7 +3889,6 @@ dns_dispatch_addresponse(dns_dispatch_t *disp, unsigned int options,
 	 * Try somewhat hard to find an unique ID unless FIXEDID is set
 	 * in which case we use the id passed in via *idp.
 	 */
-	LOCK(&qid->lock);
 	if ((options & DNS_DISPATCHOPT_FIXEDID) != 0) {
 		id = *idp;
 	} else {
@@ -3124,19 +3898,23 @@ dns_dispatch_addresponse(dns_dispatch_t *disp, unsigned int options,
 	i = 0;
 	do {
 		bucket = dns_hash(qid, dest, id, localport);
+		shard = QID_SHARD(qid, bucket);
+		LOCK(&shard->lock);
 		if (entry_search(qid, dest, id, localport, bucket) == NULL) {
 			ok = true;
-			break;
 		}
-		if ((disp->attributes & DNS_DISPATCHATTR_FIXEDID) != 0) {
+		UNLOCK(&shard->lock);
+		if (ok || (disp->attributes & DNS_DISPATCHATTR_FIXEDID) != 0) {
 			break;
 		}
 		id += qid->qid_increment;
 		id &= 0x0000ffff;
 	} while (i++ < 64);
-	UNLOCK(&qid->lock);
 
 	if (!ok) {
+		if (dispsocket != NULL) {
+			release_dispsocket(disp, &dispsocket);
+		}
 		UNLOCK(&disp->lock);
 		return (ISC_R_NOMORE);
 	}
@@ -3144,7 +3922,7 @@ dns_dispatch_addresponse(dns_dispatch_t *disp, unsigned int options,
 	res = isc_mempool_get(disp->mgr->rpool);
 	if (res == NULL) {
 		if (dispsocket != NULL) {
-			destroy_dispsocket(disp, &dispsocket);
+			release_dispsocket(disp, &dispsocket);
 		}
 		UNLOCK(&disp->lock);
 		return (ISC_R_NOMEMORY);
@@ -3162,17 +3940,28 @@ dns_dispatch_addresponse(dns_dispatch_t *disp, unsigned int options,
 	res->action = action;
 	res->arg = arg;
 	res->dispsocket = dispsocket;
+	res->handle = NULL;
 	if (dispsocket != NULL) {
 		dispsocket->resp = res;
+		dispsocket->connecting = false;
+		if (dispsocket->handle != NULL) {
+			isc_nmhandle_attach(dispsocket->handle, &res->handle);
+		}
 	}
 	res->item_out = false;
 	ISC_LIST_INIT(res->items);
-	ISC_LINK_INIT(res, link);
+	res->query = NULL;
+	res->querylen = 0;
+	res->queryhash = 0;
+	res->leader = NULL;
+	ISC_LIST_INIT(res->waiters);
+	ISC_LINK_INIT(res, clink);
+	atomic_store_release(&res->key, qid_key(dest, id, localport));
 	res->magic = RESPONSE_MAGIC;
 
-	LOCK(&qid->lock);
-	ISC_LIST_APPEND(qid->qid_table[bucket], res, link);
-	UNLOCK(&qid->lock);
+	LOCK(&shard->lock);
+	qid_link(qid, res);
+	UNLOCK(&shard->lock);
 
 	inc_stats(disp->mgr, (qid == disp->mgr->qid)
 				     ? dns_resstatscounter_disprequdp
@@ -3185,12 +3974,15 @@ dns_dispatch_addresponse(dns_dispatch_t *disp, unsigned int options,
 	{
 		result = startrecv(disp, dispsocket);
 		if (result != ISC_R_SUCCESS) {
-			LOCK(&qid->lock);
-			ISC_LIST_UNLINK(qid->qid_table[bucket], res, link);
-			UNLOCK(&qid->lock);
+			LOCK(&shard->lock);
+			qid_unlink(qid, res);
+			UNLOCK(&shard->lock);
 
+			if (res->handle != NULL) {
+				isc_nmhandle_detach(&res->handle);
+			}
 			if (dispsocket != NULL) {
-				destroy_dispsocket(disp, &dispsocket);
+				release_dispsocket(disp, &dispsocket);
 			}
 
 			disp->refcount--;
@@ -3208,7 +4000,7 @@ dns_dispatch_addresponse(dns_dispatch_t *disp, unsigned int options,
 		}
 	}
 
-	if (dispsocket != NULL) {
+	if (dispsocket != NULL && disp->nm == NULL) {
 		ISC_LIST_APPEND(disp->activesockets, dispsocket, link);
 	}
 
@@ -3287,9 +4079,9 @@ dns_dispatch_removeresponse(dns_dispentry_t **resp,
 	dns_dispatchmgr_t *mgr;
 	dns_dispatch_t *disp;
 	dns_dispentry_t *res;
-	dispsocket_t *dispsock;
+	dispsocket_t *dispsock, *next;
 	dns_dispatchevent_t *ev;
-	unsigned int bucket;
+	qid_shard_t *shard;
 	bool killit;
 	unsigned int n;
 	isc_eventlist_t events;
@@ -3331,19 +4123,32 @@ dns_dispatch_removeresponse(dns_dispentry_t **resp,
 					  ISC_SOCKCANCEL_RECV);
 		}
 		for (dispsock = ISC_LIST_HEAD(disp->activesockets);
-		     dispsock != NULL; dispsock = ISC_LIST_NEXT(dispsock, link))
+		     dispsock != NULL; dispsock = next)
 		{
-			isc_socket_cancel(dispsock->socket, dispsock->task,
-					  ISC_SOCKCANCEL_RECV);
+			next = ISC_LIST_NEXT(dispsock, link);
+			if (disp->nm == NULL) {
+				isc_socket_cancel(dispsock->socket,
+						  dispsock->task,
+						  ISC_SOCKCANCEL_RECV);
+			} else if (!dispsock->connecting) {
+				close_nmdispsocket(disp, dispsock);
+			}
 		}
 		disp->shutting_down = 1;
 	}
 
-	bucket = res->bucket;
+	shard = QID_SHARD(qid, res->bucket);
+	LOCK(&shard->lock);
+	qid_unlink(qid, res);
+	UNLOCK(&shard->lock);
 
-	LOCK(&qid->lock);
-	ISC_LIST_UNLINK(qid->qid_table[bucket], res, link);
-	UNLOCK(&qid->lock);
+	if (res->leader != NULL) {
+		ISC_LIST_UNLINK(res->leader->waiters, res, clink);
+		res->leader = NULL;
+	}
+	if (res->query != NULL) {
+		coalesce_promote(disp, res);
+	}
 
 	if (ev == NULL && res->item_out) {
 		/*
@@ -3372,11 +4177,16 @@ dns_dispatch_removeresponse(dns_dispentry_t **resp,
 	request_log(disp, res, LVL(90), "detaching from task %p", res->task);
 	isc_task_detach(&res->task);
 
-	if (res->dispsocket != NULL) {
+	if (res->dispsocket != NULL && disp->nm != NULL) {
+		close_nmdispsocket(disp, res->dispsocket);
+	} else if (res->dispsocket != NULL) {
 		isc_socket_cancel(res->dispsocket->socket,
 				  res->dispsocket->task, ISC_SOCKCANCEL_RECV);
 		res->dispsocket->resp = NULL;
 	}
+	if (res->handle != NULL) {
+		isc_nmhandle_detach(&res->handle);
+	}
 
 	/*
 	 * Free any buffered responses as well
@@ -3411,8 +4221,10 @@ dns_dispatch_removeresponse(dns_dispentry_t **resp,
 static void
 do_cancel(dns_dispatch_t *disp) {
 	dns_dispatchevent_t *ev;
-	dns_dispentry_t *resp;
+	dns_dispentry_t *resp = NULL;
 	dns_qid_t *qid;
+	qid_shard_t *shard = NULL;
+	unsigned int i, j;
 
 	if (disp->shutdown_out == 1) {
 		return;
@@ -3422,20 +4234,30 @@ do_cancel(dns_dispatch_t *disp) {
 
 	/*
 	 * Search for the first response handler without packets outstanding
-	 * unless a specific handler is given.
+	 * unless a specific handler is given.  The shard it was found in is
+	 * left locked.
 	 */
-	LOCK(&qid->lock);
-	for (resp = linear_first(qid); resp != NULL && resp->item_out;
-	     /* Empty. */)
-	{
-		resp = linear_next(qid, resp);
+	for (i = 0; i < qid->qid_nshards && resp == NULL; i++) {
+		shard = &qid->qid_shards[i];
+		LOCK(&shard->lock);
+		for (j = 0; j < QID_SHARDBUCKETS(qid) && resp == NULL; j++) {
+			resp = (dns_dispentry_t *)atomic_load_relaxed(
+				&shard->table[j]);
+			while (resp != NULL && resp->item_out) {
+				resp = (dns_dispentry_t *)atomic_load_relaxed(
+					&resp->hashnext);
+			}
+		}
+		if (resp == NULL) {
+			UNLOCK(&shard->lock);
+		}
 	}
 
 	/*
 	 * No one to send the cancel event to, so nothing to do.
 	 */
 	if (resp == NULL) {
-		goto unlock;
+		return;
 	}
 
 	/*
@@ -3452,8 +4274,7 @@ do_cancel(dns_dispatch_t *disp) {
 		    ev, resp->task);
 	resp->item_out = true;
 	isc_task_send(resp->task, ISC_EVENT_PTR(&ev));
-unlock:
-	UNLOCK(&qid->lock);
+	UNLOCK(&shard->lock);
 }
 
 isc_socket_t *
@@ -3474,6 +4295,139 @@ dns_dispatch_getentrysocket(dns_dispentry_t *resp) {
 	}
 }
 
+isc_nmhandle_t *
+dns_dispatch_getentryhandle(dns_dispentry_t *resp) {
+	REQUIRE(VALID_RESPONSE(resp));
+
+	return (resp->handle);
+}
+
+static void
+udp_nmsenddone(isc_nmhandle_t *handle, isc_result_t eresult, void *arg) {
+	dispsend_t *send = arg;
+	isc_socketevent_t *event = send->event;
+	isc_task_t *task = send->task;
+
+	UNUSED(handle);
+
+	if (event == NULL) {
+		/*
+		 * A query sent by coalesce_promote(); a failure is noticed
+		 * when the query times out.
+		 */
+		isc_mem_put(send->mctx, send->buf, send->length);
+		isc_mem_putanddetach(&send->mctx, send, sizeof(*send));
+		return;
+	}
+
+	event->result = eresult;
+	event->n = (eresult == ISC_R_SUCCESS) ? send->length : 0;
+	isc_mem_putanddetach(&send->mctx, send, sizeof(*send));
+	isc_task_sendanddetach(&task, ISC_EVENT_PTR(&event));
+}
+
+void
+dns_dispatch_send(dns_dispentry_t *resp, isc_region_t *region,
+		  isc_task_t *task, isc_socketevent_t *sendevent) {
+	dispsend_t *send;
+
+	REQUIRE(VALID_RESPONSE(resp));
+	REQUIRE(resp->handle != NULL);
+	REQUIRE(region != NULL);
+	REQUIRE(task != NULL);
+	REQUIRE(sendevent != NULL);
+
+	send = isc_mem_get(resp->disp->mgr->mctx, sizeof(*send));
+	*send = (dispsend_t){ .event = sendevent, .length = region->length };
+	isc_mem_attach(resp->disp->mgr->mctx, &send->mctx);
+	isc_task_attach(task, &send->task);
+
+	isc_nm_send(resp->handle, region, udp_nmsenddone, send);
+}
+
+bool
+dns_dispatch_coalesce(dns_dispentry_t *resp, const isc_region_t *query) {
+	dns_dispatch_t *disp;
+	dns_dispentry_t *leader;
+	dns_displist_t *bucket;
+	uint32_t hash;
+	bool coalesced = false;
+
+	REQUIRE(VALID_RESPONSE(resp));
+	REQUIRE(resp->query == NULL && resp->leader == NULL);
+	REQUIRE(query != NULL && query->length >= DNS_MESSAGE_HEADERLEN);
+
+	disp = resp->disp;
+	REQUIRE(VALID_DISPATCH(disp));
+
+	/*
+	 * Responses to other sockets may arrive through another dispatch,
+	 * which can't reach the entries waiting in this one.  A waiting
+	 * entry needs a netmgr handle, so that it can send the query itself
+	 * if the one it waits for is removed; see coalesce_promote().
+	 */
+	if ((disp->attributes & DNS_DISPATCHATTR_EXCLUSIVE) == 0 ||
+	    (disp->attributes & DNS_DISPATCHATTR_UDP) == 0 || disp->nm == NULL)
+	{
+		return (false);
+	}
+
+	/*
+	 * The message ID is left out of the hash and the comparison.
+	 */
+	hash = isc_sockaddr_hash(&resp->host, true) ^
+	       isc_hash32(query->base + 2, query->length - 2, true);
+
+	LOCK(&disp->lock);
+
+	if (disp->shutting_down == 1) {
+		UNLOCK(&disp->lock);
+		return (false);
+	}
+
+	if (disp->coalesced == NULL) {
+		disp->coalesced = isc_mem_get(disp->mgr->mctx,
+					      sizeof(disp->coalesced[0]) *
+						      DISPATCH_COALESCEBUCKETS);
+		for (int i = 0; i < DISPATCH_COALESCEBUCKETS; i++) {
+			ISC_LIST_INIT(disp->coalesced[i]);
+		}
+	}
+
+	bucket = &disp->coalesced[hash & (DISPATCH_COALESCEBUCKETS - 1)];
+	for (leader = ISC_LIST_HEAD(*bucket); leader != NULL;
+	     leader = ISC_LIST_NEXT(leader, clink))
+	{
+		if (leader->queryhash == hash &&
+		    leader->querylen == query->length &&
+		    isc_sockaddr_equal(&leader->host, &resp->host) &&
+		    memcmp(leader->query + 2, query->base + 2,
+			   query->length - 2) == 0)
+		{
+			break;
+		}
+	}
+
+	if (leader != NULL) {
+		resp->leader = leader;
+		ISC_LIST_APPEND(leader->waiters, resp, clink);
+		inc_stats(disp->mgr, dns_resstatscounter_coalesced);
+		request_log(disp, resp, LVL(90), "waiting for response to %u",
+			    leader->id);
+		coalesced = true;
+	} else {
+		resp->query = isc_mem_get(disp->mgr->mctx, query->length);
+		memmove(resp->query, query->base, query->length);
+		resp->querylen = query->length;
+		resp->queryhash = hash;
+		ISC_LIST_APPEND(*bucket, resp, clink);
+	}
+
+	UNLOCK(&disp->lock);
+
+	return (coalesced);
+}
+
 isc_result_t
 dns_dispatch_getlocaladdress(dns_dispatch_t *disp, isc_sockaddr_t *addrp) {
 	REQUIRE(VALID_DISPATCH(disp));
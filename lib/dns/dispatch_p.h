@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef DNS_DISPATCH_P_H
+#define DNS_DISPATCH_P_H
+
+#include <stdbool.h>
+
+#include <isc/sockaddr.h>
+
+#include <dns/types.h>
+
+/*! \file */
+
+/*%
+ *     Functions below not be used outside this module and its associated
+ *     unit tests.
+ */
+
+ISC_LANG_BEGINDECLS
+
+void
+dns__dispatch_setlockfree(bool enable);
+/*%<
+ * Enable or disable matching responses against the QID table without
+ * locking first, which is enabled by default.  For benchmarking and
+ * testing only.
+ */
+
+bool
+dns__dispatch_findresponse(dns_dispatch_t *disp, const isc_sockaddr_t *dest,
+			   dns_messageid_t id);
+/*%<
+ * Return true if a response from 'dest' with message ID 'id', received
+ * by 'disp', would be matched to an outstanding query, as it is when a
+ * response arrives.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_DISPATCH_P_H */
@@ -0,0 +1,3036 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#else /* ifndef WIN32 */
+#define PROT_READ  0x01
+#define MAP_SHARED 0x0001
+#define MAP_FAILED ((void *)-1)
+#endif /* ifndef WIN32 */
+
+#include <isc/atomic.h>
+#include <isc/buffer.h>
+#include <isc/crc64.h>
+#include <isc/file.h>
+#include <isc/mem.h>
+#include <isc/print.h>
+#include <isc/refcount.h>
+#include <isc/stdio.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/callbacks.h>
+#include <dns/compress.h>
+#include <dns/db.h>
+#include <dns/dbiterator.h>
+#include <dns/fixedname.h>
+#include <dns/masterdump.h>
+#include <dns/nsec3.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/rdatasetiter.h>
+#include <dns/rdatastruct.h>
+#include <dns/result.h>
+#include <dns/zonekey.h>
+
+#include "imagedb.h"
+
+#define IMAGEDB_MAGIC ISC_MAGIC('I', 'm', 'g', 'D')
+#define VALID_IMAGEDB(idb) \
+	((idb) != NULL && (idb)->common.impmagic == IMAGEDB_MAGIC)
+
+/*
+ * Image Layout
+ *
+ * All integers are stored in network byte order, and all references
+ * are offsets from the start of the image.  The image starts with a
+ * header:
+ *
+ *	magic		8	"BIND9ZI\0"
+ *	version		4	IMAGE_VERSION
+ *	header length	4	IMAGE_HEADERLEN
+ *	length		4	of the whole image
+ *	flags		4	IMAGE_SECURE, IMAGE_NSEC3
+ *	class		4
+ *	node count	4	and offset of the node array
+ *	NSEC3 count	4	and offset of the NSEC3 node array
+ *	buckets		4	and offset of the hash table of the nodes
+ *	NSEC3 buckets	4	and offset of the hash table of the NSEC3 nodes
+ *	records		8	the size of the zone, as for dns_db_getsize()
+ *	transfer size	8
+ *	CRC-64		8	of everything after the header
+ *	NSEC3PARAM	257	hash, flags, iterations, salt length and salt
+ *				of the NSEC3 chain in use, if IMAGE_NSEC3
+ *
+ * The header is followed by the node arrays, the hash tables, the
+ * owner names and the rdatasets.
+ *
+ * Nodes are sorted in DNSSEC order, so the node of the origin comes
+ * first.  The main node array also holds the empty non-terminals (nodes
+ * without data), so that every node but the origin has a parent node;
+ * NSEC3 nodes have none.  Each node is:
+ *
+ *	name		4	offset of the owner name: a length byte,
+ *				followed by the name in uncompressed wire
+ *				format
+ *	data		4	offset of the rdatasets, 0 if none
+ *	parent		4	index of the parent node, IMAGE_NOPARENT
+ *				for the origin and NSEC3 nodes
+ *	flags		4	NODE_WILD, NODE_NS, NODE_DNAME
+ *
+ * The rdatasets of a node are a 2 byte count followed by the rdatasets,
+ * each of which is:
+ *
+ *	type		2
+ *	covers		2
+ *	TTL		4
+ *	trust		1
+ *	(pad)		1
+ *	count		2	of the rdatas
+ *	length		4	of the rdatas
+ *
+ * followed by the rdatas, a 2 byte length and the rdata each.
+ *
+ * A hash table is an array of a power of two buckets, at least twice
+ * as many as there are nodes, each of which holds the index of a node
+ * plus one, or 0 if empty.  Collisions are resolved by linear probing.
+ */
+#define IMAGE_MAGIC	"BIND9ZI"
+#define IMAGE_VERSION	1
+#define IMAGE_HEADERLEN 344
+
+#define HDR_VERSION	 8
+#define HDR_HEADERLEN	 12
+#define HDR_LENGTH	 16
+#define HDR_FLAGS	 20
+#define HDR_CLASS	 24
+#define HDR_NODECOUNT	 28
+#define HDR_NODES	 32
+#define HDR_NSEC3COUNT	 36
+#define HDR_NSEC3NODES	 40
+#define HDR_BUCKETS	 44
+#define HDR_HASHTABLE	 48
+#define HDR_NSEC3BUCKETS 52
+#define HDR_NSEC3HASH	 56
+#define HDR_RECORDS	 60
+#define HDR_XFRSIZE	 68
+#define HDR_CRC		 76
+#define HDR_NSEC3PARAM	 84
+
+#define IMAGE_SECURE 0x00000001
+#define IMAGE_NSEC3  0x00000002
+
+#define NODE_NAME   0
+#define NODE_DATA   4
+#define NODE_PARENT 8
+#define NODE_FLAGS  12
+#define NODE_SIZE   16
+
+#define NODE_WILD  0x00000001 /*%< has a wildcard child */
+#define NODE_NS	   0x00000002 /*%< has NS and isn't the origin */
+#define NODE_DNAME 0x00000004 /*%< has DNAME */
+
+#define IMAGE_NOPARENT 0xffffffffU
+
+#define IMAGE_MAXLABELS 128 /*%< the most labels a name can have */
+
+#define ENTRY_TYPE   0
+#define ENTRY_COVERS 2
+#define ENTRY_TTL    4
+#define ENTRY_TRUST  8
+#define ENTRY_COUNT  10
+#define ENTRY_LENGTH 12
+#define ENTRY_SIZE   16
+
+typedef struct imagetree {
+	uint32_t count;
+	const unsigned char *nodes;
+	uint32_t buckets;
+	const unsigned char *hashtable;
+} imagetree_t;
+
+typedef struct imagedb {
+	/* Unlocked. */
+	dns_db_t common;
+	isc_refcount_t references;
+	/* The image, and the mapping or the buffer holding it. */
+	const unsigned char *image;
+	size_t length;
+	void *map;
+	size_t maplength;
+	isc_buffer_t *buffer;
+	uint32_t flags;
+	imagetree_t tree;
+	imagetree_t nsec3;
+	uint64_t records;
+	uint64_t xfrsize;
+	dns_hash_t hash;
+	uint8_t nsec3flags;
+	uint16_t iterations;
+	size_t saltlength;
+	unsigned char salt[DNS_NSEC3_SALTSIZE];
+	atomic_uint_fast32_t count;
+	/*%
+	 * Data loaded by any other means than from an image is loaded
+	 * into a temporary database first.
+	 */
+	dns_db_t *loaddb;
+	dns_rdatacallbacks_t loadcallbacks;
+	/*% The one and only version. */
+	unsigned char version;
+} imagedb_t;
+
+typedef struct imagesearch {
+	imagedb_t *idb;
+	const imagetree_t *tree;
+	unsigned int options;
+	const unsigned char *zonecut;
+	const unsigned char *zonecut_rdataset;
+	const unsigned char *zonecut_sigrdataset;
+} imagesearch_t;
+
+typedef struct image_rdatasetiter {
+	dns_rdatasetiter_t common;
+	unsigned int index;
+	const unsigned char *entry;
+} image_rdatasetiter_t;
+
+typedef struct image_dbiterator {
+	dns_dbiterator_t common;
+	bool nsec3only;
+	bool nonsec3;
+	const imagetree_t *tree; /* NULL if there is no current node */
+	uint32_t index;
+	bool new_origin;
+	dns_fixedname_t origin;
+} image_dbiterator_t;
+
+static void
+detachnode(dns_db_t *db, dns_dbnode_t **targetp);
+
+static isc_result_t
+image_build(isc_mem_t *mctx, dns_db_t *db, dns_dbversion_t *version,
+	    isc_buffer_t **imagep);
+
+/*
+ * Image Access
+ */
+
+static inline uint16_t
+get16(const unsigned char *p) {
+	return ((uint16_t)p[0] << 8 | p[1]);
+}
+
+static inline uint32_t
+get32(const unsigned char *p) {
+	return ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+		(uint32_t)p[2] << 8 | p[3]);
+}
+
+static inline uint64_t
+get64(const unsigned char *p) {
+	return ((uint64_t)get32(p) << 32 | get32(p + 4));
+}
+
+static inline void
+set16(unsigned char *p, uint16_t val) {
+	p[0] = (unsigned char)(val >> 8);
+	p[1] = (unsigned char)val;
+}
+
+static inline void
+set32(unsigned char *p, uint32_t val) {
+	p[0] = (unsigned char)(val >> 24);
+	p[1] = (unsigned char)(val >> 16);
+	p[2] = (unsigned char)(val >> 8);
+	p[3] = (unsigned char)val;
+}
+
+static inline unsigned char
+lower(unsigned char c) {
+	return ((c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c);
+}
+
+/*%
+ * FNV-1a over the lowercased wire format of a name.  Unlike the key of
+ * isc_hash_function(), it is the same in every process, so the hash
+ * tables can be stored in the image.
+ */
+static uint32_t
+hashname(const unsigned char *ndata, unsigned int length) {
+	uint32_t h = 2166136261U;
+
+	for (unsigned int i = 0; i < length; i++) {
+		h ^= lower(ndata[i]);
+		h *= 16777619U;
+	}
+
+	return (h);
+}
+
+static inline bool
+nameequal(const unsigned char *a, const unsigned char *b,
+	  unsigned int length) {
+	for (unsigned int i = 0; i < length; i++) {
+		if (a[i] != b[i] && lower(a[i]) != lower(b[i])) {
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
+static inline const unsigned char *
+nodeat(const imagetree_t *tree, uint32_t index) {
+	return (tree->nodes + (size_t)index * NODE_SIZE);
+}
+
+static inline uint32_t
+nodeindex(const imagetree_t *tree, const unsigned char *node) {
+	return ((uint32_t)((node - tree->nodes) / NODE_SIZE));
+}
+
+static inline const unsigned char *
+nodedata(const imagedb_t *idb, const unsigned char *node) {
+	uint32_t offset = get32(node + NODE_DATA);
+
+	return (offset == 0 ? NULL : idb->image + offset);
+}
+
+static inline uint32_t
+nodeflags(const unsigned char *node) {
+	return (get32(node + NODE_FLAGS));
+}
+
+static inline const unsigned char *
+nodeparent(const imagedb_t *idb, const unsigned char *node) {
+	uint32_t parent = get32(node + NODE_PARENT);
+
+	return (parent == IMAGE_NOPARENT ? NULL : nodeat(&idb->tree, parent));
+}
+
+/*%
+ * Make 'name', which has been initialized with offsets, point at the
+ * owner name of 'node'.
+ */
+static inline void
+nodename(const imagedb_t *idb, const unsigned char *node, dns_name_t *name) {
+	const unsigned char *p = idb->image + get32(node + NODE_NAME);
+	isc_region_t r;
+
+	DE_CONST(p + 1, r.base);
+	r.length = p[0];
+	dns_name_fromregion(name, &r);
+}
+
+static inline const unsigned char *
+nextentry(const unsigned char *entry) {
+	return (entry + ENTRY_SIZE + get32(entry + ENTRY_LENGTH));
+}
+
+static const unsigned char *
+lookup(const imagedb_t *idb, const imagetree_t *tree, const dns_name_t *name) {
+	isc_region_t r;
+	uint32_t mask, i;
+
+	if (tree->count == 0) {
+		return (NULL);
+	}
+
+	dns_name_toregion(name, &r);
+	mask = tree->buckets - 1;
+	i = hashname(r.base, r.length) & mask;
+	for (uint32_t n = 0; n < tree->buckets; n++) {
+		uint32_t slot = get32(tree->hashtable + (size_t)i * 4);
+		const unsigned char *node, *p;
+
+		if (slot == 0) {
+			break;
+		}
+		node = nodeat(tree, slot - 1);
+		p = idb->image + get32(node + NODE_NAME);
+		if (p[0] == r.length && nameequal(p + 1, r.base, r.length)) {
+			return (node);
+		}
+		i = (i + 1) & mask;
+	}
+
+	return (NULL);
+}
+
+/*%
+ * Find the node of the longest proper superdomain of 'name' in the
+ * main tree, i.e. its closest encloser if 'name' doesn't exist.
+ */
+static const unsigned char *
+lookup_encloser(const imagedb_t *idb, const dns_name_t *name) {
+	unsigned int labels = dns_name_countlabels(name);
+	unsigned int olabels = dns_name_countlabels(&idb->common.origin);
+	dns_name_t suffix;
+
+	dns_name_init(&suffix, NULL);
+	for (unsigned int l = labels - 1; l >= olabels && l > 0; l--) {
+		const unsigned char *node;
+
+		dns_name_getlabelsequence(name, labels - l, l, &suffix);
+		node = lookup(idb, &idb->tree, &suffix);
+		if (node != NULL) {
+			return (node);
+		}
+	}
+
+	return (NULL);
+}
+
+/*%
+ * Find the last node of 'tree' whose name sorts before 'name'.
+ */
+static bool
+predecessor(const imagedb_t *idb, const imagetree_t *tree,
+	    const dns_name_t *name, uint32_t *indexp) {
+	uint32_t lo = 0, hi = tree->count;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		dns_offsets_t offsets;
+		dns_name_t nname;
+
+		dns_name_init(&nname, offsets);
+		nodename(idb, nodeat(tree, mid), &nname);
+		if (dns_name_compare(&nname, name) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo == 0) {
+		return (false);
+	}
+	*indexp = lo - 1;
+	return (true);
+}
+
+/*
+ * DB Routines
+ */
+
+static void
+attach(dns_db_t *source, dns_db_t **targetp) {
+	imagedb_t *idb = (imagedb_t *)source;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+
+	isc_refcount_increment(&idb->references);
+
+	*targetp = source;
+}
+
+static void
+free_imagedb(imagedb_t *idb) {
+	if (idb->loaddb != NULL) {
+		dns_db_detach(&idb->loaddb);
+	}
+	if (idb->map != NULL) {
+		isc_file_munmap(idb->map, idb->maplength);
+	}
+	if (idb->buffer != NULL) {
+		isc_buffer_free(&idb->buffer);
+	}
+	if (dns_name_dynamic(&idb->common.origin)) {
+		dns_name_free(&idb->common.origin, idb->common.mctx);
+	}
+	isc_refcount_destroy(&idb->references);
+	idb->common.magic = 0;
+	idb->common.impmagic = 0;
+	isc_mem_putanddetach(&idb->common.mctx, idb, sizeof(*idb));
+}
+
+static void
+detach(dns_db_t **dbp) {
+	imagedb_t *idb = (imagedb_t *)(*dbp);
+
+	REQUIRE(VALID_IMAGEDB(idb));
+
+	*dbp = NULL;
+
+	if (isc_refcount_decrement(&idb->references) == 1) {
+		free_imagedb(idb);
+	}
+}
+
+/*%
+ * Check the header of the image of 'length' bytes at 'image' and make
+ * 'idb' use it.  The rest of the image is not looked at.
+ */
+static isc_result_t
+setimage(imagedb_t *idb, const unsigned char *image, size_t length) {
+	imagetree_t *trees[2] = { &idb->tree, &idb->nsec3 };
+	uint64_t end;
+
+	if (length < IMAGE_HEADERLEN ||
+	    memcmp(image, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0)
+	{
+		return (ISC_R_INVALIDFILE);
+	}
+	if (get32(image + HDR_VERSION) > IMAGE_VERSION) {
+		return (ISC_R_NOTIMPLEMENTED);
+	}
+	if (get32(image + HDR_VERSION) != IMAGE_VERSION ||
+	    get32(image + HDR_HEADERLEN) != IMAGE_HEADERLEN ||
+	    get32(image + HDR_LENGTH) > length ||
+	    get32(image + HDR_CLASS) != idb->common.rdclass)
+	{
+		return (ISC_R_INVALIDFILE);
+	}
+	length = get32(image + HDR_LENGTH);
+
+	for (unsigned int i = 0; i < 2; i++) {
+		imagetree_t *tree = trees[i];
+		const unsigned char *h = image + HDR_NODECOUNT + i * 8;
+
+		tree->count = get32(h);
+		end = (uint64_t)get32(h + 4) + (uint64_t)tree->count * NODE_SIZE;
+		if (get32(h + 4) < IMAGE_HEADERLEN || end > length) {
+			return (ISC_R_INVALIDFILE);
+		}
+		tree->nodes = image + get32(h + 4);
+
+		h = image + HDR_BUCKETS + i * 8;
+		tree->buckets = get32(h);
+		end = (uint64_t)get32(h + 4) + (uint64_t)tree->buckets * 4;
+		if (tree->buckets == 0 ||
+		    (tree->buckets & (tree->buckets - 1)) != 0 ||
+		    tree->buckets < tree->count ||
+		    get32(h + 4) < IMAGE_HEADERLEN || end > length)
+		{
+			return (ISC_R_INVALIDFILE);
+		}
+		tree->hashtable = image + get32(h + 4);
+	}
+
+	idb->image = image;
+	idb->length = length;
+	idb->flags = get32(image + HDR_FLAGS);
+	idb->records = get64(image + HDR_RECORDS);
+	idb->xfrsize = get64(image + HDR_XFRSIZE);
+	idb->hash = image[HDR_NSEC3PARAM];
+	idb->nsec3flags = image[HDR_NSEC3PARAM + 1];
+	idb->iterations = get16(image + HDR_NSEC3PARAM + 2);
+	idb->saltlength = image[HDR_NSEC3PARAM + 4];
+	memmove(idb->salt, image + HDR_NSEC3PARAM + 5, idb->saltlength);
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+image_add(void *arg, const dns_name_t *name, dns_rdataset_t *rdataset) {
+	imagedb_t *idb = (imagedb_t *)arg;
+	isc_result_t result;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+
+	if (idb->image != NULL) {
+		return (DNS_R_NOTZONETOP);
+	}
+
+	if (idb->loaddb == NULL) {
+		result = dns_db_create(idb->common.mctx, "rbt",
+				       &idb->common.origin, dns_dbtype_zone,
+				       idb->common.rdclass, 0, NULL,
+				       &idb->loaddb);
+		if (result != ISC_R_SUCCESS) {
+			return (result);
+		}
+		dns_rdatacallbacks_init(&idb->loadcallbacks);
+		result = dns_db_beginload(idb->loaddb, &idb->loadcallbacks);
+		if (result != ISC_R_SUCCESS) {
+			dns_db_detach(&idb->loaddb);
+			return (result);
+		}
+	}
+
+	return ((*idb->loadcallbacks.add)(idb->loadcallbacks.add_private, name,
+					  rdataset));
+}
+
+static isc_result_t
+beginload(dns_db_t *db, dns_rdatacallbacks_t *callbacks) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	REQUIRE(DNS_CALLBACK_VALID(callbacks));
+	REQUIRE(idb->image == NULL && idb->loaddb == NULL);
+
+	callbacks->add = image_add;
+	callbacks->add_private = idb;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+endload(dns_db_t *db, dns_rdatacallbacks_t *callbacks) {
+	imagedb_t *idb = (imagedb_t *)db;
+	dns_dbversion_t *version = NULL;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	REQUIRE(DNS_CALLBACK_VALID(callbacks));
+	REQUIRE(callbacks->add_private == idb);
+
+	callbacks->add = NULL;
+	callbacks->add_private = NULL;
+
+	if (idb->image != NULL) {
+		return (ISC_R_SUCCESS);
+	}
+
+	/*
+	 * Compile whatever has been loaded, possibly nothing, into an
+	 * image.
+	 */
+	if (idb->loaddb != NULL) {
+		result = dns_db_endload(idb->loaddb, &idb->loadcallbacks);
+		if (result != ISC_R_SUCCESS) {
+			goto cleanup;
+		}
+		dns_db_currentversion(idb->loaddb, &version);
+	}
+
+	result = image_build(idb->common.mctx, idb->loaddb, version,
+			     &idb->buffer);
+	if (version != NULL) {
+		dns_db_closeversion(idb->loaddb, &version, false);
+	}
+	if (result == ISC_R_SUCCESS) {
+		result = setimage(idb, isc_buffer_base(idb->buffer),
+				  isc_buffer_usedlength(idb->buffer));
+		INSIST(result == ISC_R_SUCCESS);
+	}
+
+cleanup:
+	if (idb->loaddb != NULL) {
+		dns_db_detach(&idb->loaddb);
+	}
+
+	return (result);
+}
+
+static isc_result_t
+dump(dns_db_t *db, dns_dbversion_t *version, const char *filename,
+     dns_masterformat_t masterformat) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+
+	return (dns_master_dump(idb->common.mctx, db, version,
+				&dns_master_style_default, filename,
+				masterformat, NULL));
+}
+
+/*
+ * An image database has a single version, which never changes.
+ */
+static void
+currentversion(dns_db_t *db, dns_dbversion_t **versionp) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	REQUIRE(versionp != NULL && *versionp == NULL);
+
+	*versionp = (dns_dbversion_t *)&idb->version;
+}
+
+static isc_result_t
+newversion(dns_db_t *db, dns_dbversion_t **versionp) {
+	UNUSED(db);
+	UNUSED(versionp);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+static void
+attachversion(dns_db_t *db, dns_dbversion_t *source,
+	      dns_dbversion_t **targetp) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	REQUIRE(source == (dns_dbversion_t *)&idb->version);
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	*targetp = source;
+}
+
+static void
+closeversion(dns_db_t *db, dns_dbversion_t **versionp, bool commit) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	REQUIRE(versionp != NULL &&
+		*versionp == (dns_dbversion_t *)&idb->version);
+	REQUIRE(!commit);
+
+	*versionp = NULL;
+}
+
+static void
+attachnode(dns_db_t *db, dns_dbnode_t *source, dns_dbnode_t **targetp) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	isc_refcount_increment(&idb->references);
+
+	*targetp = source;
+}
+
+/*
+ * Nodes are part of the image, so a reference to a node is a
+ * reference to the database.
+ */
+static void
+detachnode(dns_db_t *db, dns_dbnode_t **targetp) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	REQUIRE(targetp != NULL && *targetp != NULL);
+
+	*targetp = NULL;
+
+	if (isc_refcount_decrement(&idb->references) == 1) {
+		free_imagedb(idb);
+	}
+}
+
+static inline void
+newnode(imagedb_t *idb, const unsigned char *node, dns_dbnode_t **nodep) {
+	if (nodep != NULL) {
+		isc_refcount_increment(&idb->references);
+		DE_CONST(node, *nodep);
+	}
+}
+
+static isc_result_t
+findnode(dns_db_t *db, const dns_name_t *name, bool create,
+	 dns_dbnode_t **nodep) {
+	imagedb_t *idb = (imagedb_t *)db;
+	const unsigned char *node;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+
+	node = lookup(idb, &idb->tree, name);
+	if (node == NULL) {
+		return (create ? ISC_R_NOTIMPLEMENTED : ISC_R_NOTFOUND);
+	}
+	newnode(idb, node, nodep);
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+findnsec3node(dns_db_t *db, const dns_name_t *name, bool create,
+	      dns_dbnode_t **nodep) {
+	imagedb_t *idb = (imagedb_t *)db;
+	const unsigned char *node;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+
+	node = lookup(idb, &idb->nsec3, name);
+	if (node == NULL) {
+		return (create ? ISC_R_NOTIMPLEMENTED : ISC_R_NOTFOUND);
+	}
+	newnode(idb, node, nodep);
+
+	return (ISC_R_SUCCESS);
+}
+
+static dns_rdatasetmethods_t rdataset_methods;
+
+static void
+bind_rdataset(imagedb_t *idb, const unsigned char *node,
+	      const unsigned char *entry, dns_rdataset_t *rdataset) {
+	if (rdataset == NULL || entry == NULL) {
+		return;
+	}
+
+	INSIST(rdataset->methods == NULL); /* We must be disassociated. */
+
+	isc_refcount_increment(&idb->references);
+
+	rdataset->methods = &rdataset_methods;
+	rdataset->rdclass = idb->common.rdclass;
+	rdataset->type = get16(entry + ENTRY_TYPE);
+	rdataset->covers = get16(entry + ENTRY_COVERS);
+	rdataset->ttl = get32(entry + ENTRY_TTL);
+	rdataset->trust = entry[ENTRY_TRUST];
+	rdataset->private1 = idb;
+	DE_CONST(node, rdataset->private2);
+	DE_CONST(entry, rdataset->private3);
+	rdataset->count = atomic_fetch_add_relaxed(&idb->count, 1);
+	if (rdataset->count == UINT32_MAX) {
+		rdataset->count = 0;
+	}
+	rdataset->privateuint4 = 0;
+	rdataset->private5 = NULL;
+}
+
+static isc_result_t
+setup_delegation(imagesearch_t *search, dns_dbnode_t **nodep,
+		 dns_name_t *foundname, dns_rdataset_t *rdataset,
+		 dns_rdataset_t *sigrdataset) {
+	imagedb_t *idb = search->idb;
+	dns_offsets_t offsets;
+	dns_name_t zcname;
+
+	if (foundname != NULL) {
+		dns_name_init(&zcname, offsets);
+		nodename(idb, search->zonecut, &zcname);
+		dns_name_copynf(&zcname, foundname);
+	}
+	newnode(idb, search->zonecut, nodep);
+	bind_rdataset(idb, search->zonecut, search->zonecut_rdataset,
+		      rdataset);
+	if (sigrdataset != NULL) {
+		bind_rdataset(idb, search->zonecut,
+			      search->zonecut_sigrdataset, sigrdataset);
+	}
+
+	if (get16(search->zonecut_rdataset + ENTRY_TYPE) ==
+	    dns_rdatatype_dname) {
+		return (DNS_R_DNAME);
+	}
+	return (DNS_R_DELEGATION);
+}
+
+/*%
+ * Remember 'node' as the zone cut if it is the first one seen with an
+ * NS or DNAME rdataset.
+ */
+static void
+check_zonecut(imagesearch_t *search, const unsigned char *node) {
+	const unsigned char *data, *entry;
+	const unsigned char *ns = NULL, *dname = NULL, *sigdname = NULL;
+	unsigned int count;
+
+	if (search->zonecut != NULL ||
+	    (nodeflags(node) & (NODE_NS | NODE_DNAME)) == 0)
+	{
+		return;
+	}
+
+	data = nodedata(search->idb, node);
+	count = get16(data);
+	entry = data + 2;
+	for (unsigned int i = 0; i < count; i++, entry = nextentry(entry)) {
+		dns_rdatatype_t type = get16(entry + ENTRY_TYPE);
+		dns_rdatatype_t covers = get16(entry + ENTRY_COVERS);
+
+		if (type == dns_rdatatype_ns && covers == 0 &&
+		    (nodeflags(node) & NODE_NS) != 0)
+		{
+			ns = entry;
+		} else if (type == dns_rdatatype_dname && covers == 0) {
+			dname = entry;
+		} else if (type == dns_rdatatype_rrsig &&
+			   covers == dns_rdatatype_dname) {
+			sigdname = entry;
+		}
+	}
+
+	/*
+	 * Note that NS has precedence over DNAME if both exist in a zone.
+	 */
+	if (ns != NULL) {
+		search->zonecut = node;
+		search->zonecut_rdataset = ns;
+		search->zonecut_sigrdataset = NULL;
+	} else if (dname != NULL) {
+		search->zonecut = node;
+		search->zonecut_rdataset = dname;
+		search->zonecut_sigrdataset = sigdname;
+	}
+}
+
+static bool
+matchparams(const imagedb_t *idb, const unsigned char *entry) {
+	const unsigned char *raw = entry + ENTRY_SIZE;
+	unsigned int count = get16(entry + ENTRY_COUNT);
+
+	while (count-- > 0) {
+		dns_rdata_t rdata = DNS_RDATA_INIT;
+		dns_rdata_nsec3_t nsec3;
+		isc_region_t region;
+		isc_result_t result;
+
+		region.length = get16(raw);
+		DE_CONST(raw + 2, region.base);
+		raw += 2 + region.length;
+		dns_rdata_fromregion(&rdata, idb->common.rdclass,
+				     dns_rdatatype_nsec3, &region);
+		result = dns_rdata_tostruct(&rdata, &nsec3, NULL);
+		INSIST(result == ISC_R_SUCCESS);
+		if (nsec3.hash == idb->hash &&
+		    nsec3.iterations == idb->iterations &&
+		    nsec3.salt_length == idb->saltlength &&
+		    memcmp(nsec3.salt, idb->salt, nsec3.salt_length) == 0)
+		{
+			return (true);
+		}
+	}
+
+	return (false);
+}
+
+static bool
+valid_glue(imagesearch_t *search, const dns_name_t *name,
+	   dns_rdatatype_t type, const unsigned char *node) {
+	const unsigned char *raw;
+	unsigned int count;
+
+	/*
+	 * Valid glue types are A, AAAA, A6.  NS is also a valid glue type
+	 * if it occurs at a zone cut, but is not valid below it.
+	 */
+	if (type == dns_rdatatype_ns) {
+		if (node != search->zonecut) {
+			return (false);
+		}
+	} else if (type != dns_rdatatype_a && type != dns_rdatatype_aaaa &&
+		   type != dns_rdatatype_a6)
+	{
+		return (false);
+	}
+
+	raw = search->zonecut_rdataset + ENTRY_SIZE;
+	count = get16(search->zonecut_rdataset + ENTRY_COUNT);
+	while (count-- > 0) {
+		dns_offsets_t offsets;
+		dns_name_t ns_name;
+		isc_region_t region;
+
+		region.length = get16(raw);
+		DE_CONST(raw + 2, region.base);
+		raw += 2 + region.length;
+		dns_name_init(&ns_name, offsets);
+		dns_name_fromregion(&ns_name, &region);
+		if (dns_name_compare(&ns_name, name) == 0) {
+			return (true);
+		}
+	}
+
+	return (false);
+}
+
+/*%
+ * Find the NSEC or NSEC3 record at 'node' or, if 'node' is NULL, at the
+ * last node before 'name' with one.  For NSEC3 records, only the
+ * ones that match the NSEC3PARAM record in use are considered.
+ */
+static isc_result_t
+find_closest_nsec(imagesearch_t *search, const dns_name_t *name,
+		  const unsigned char *node, dns_dbnode_t **nodep,
+		  dns_name_t *foundname, dns_rdataset_t *rdataset,
+		  dns_rdataset_t *sigrdataset) {
+	imagedb_t *idb = search->idb;
+	const imagetree_t *tree = search->tree;
+	bool need_sig = ((idb->flags & IMAGE_SECURE) != 0);
+	bool havensec3 = ((idb->flags & IMAGE_NSEC3) != 0);
+	bool wraps = (tree == &idb->nsec3);
+	dns_rdatatype_t type = wraps ? dns_rdatatype_nsec3
+				     : dns_rdatatype_nsec;
+	uint32_t index;
+
+	if (node != NULL) {
+		index = nodeindex(tree, node);
+	} else if (!predecessor(idb, tree, name, &index)) {
+		if (!wraps || tree->count == 0) {
+			return (ISC_R_NOMORE);
+		}
+		index = tree->count - 1;
+	}
+
+	for (uint32_t n = 0; n < tree->count; n++) {
+		const unsigned char *data, *entry;
+		const unsigned char *found = NULL, *foundsig = NULL;
+		unsigned int count;
+
+		node = nodeat(tree, index);
+		data = nodedata(idb, node);
+		count = (data != NULL) ? get16(data) : 0;
+		entry = (data != NULL) ? data + 2 : NULL;
+		for (unsigned int i = 0; i < count; i++) {
+			dns_rdatatype_t etype = get16(entry + ENTRY_TYPE);
+			dns_rdatatype_t covers = get16(entry + ENTRY_COVERS);
+
+			if (etype == type && covers == 0) {
+				found = entry;
+			} else if (etype == dns_rdatatype_rrsig &&
+				   covers == type) {
+				foundsig = entry;
+			}
+			entry = nextentry(entry);
+		}
+
+		if (count != 0) {
+			if (found != NULL && havensec3 &&
+			    type == dns_rdatatype_nsec3 &&
+			    !matchparams(idb, found))
+			{
+				/* Not the chain in use; keep looking. */
+			} else if (found != NULL &&
+				   (foundsig != NULL || !need_sig)) {
+				dns_offsets_t offsets;
+				dns_name_t nname;
+
+				dns_name_init(&nname, offsets);
+				nodename(idb, node, &nname);
+				dns_name_copynf(&nname, foundname);
+				newnode(idb, node, nodep);
+				bind_rdataset(idb, node, found, rdataset);
+				bind_rdataset(idb, node, foundsig,
+					      sigrdataset);
+				return (ISC_R_SUCCESS);
+			} else if (found != NULL || foundsig != NULL) {
+				/*
+				 * Either the NSEC/NSEC3 or its RRSIG is
+				 * missing.  This shouldn't happen.
+				 */
+				return (DNS_R_BADDB);
+			}
+			/*
+			 * Glue or other obscured zone data; treat the node
+			 * as if it were empty and keep looking.
+			 */
+		}
+
+		if (index == 0) {
+			if (!wraps) {
+				return (ISC_R_NOMORE);
+			}
+			index = tree->count;
+		}
+		index--;
+	}
+
+	return (ISC_R_NOTFOUND);
+}
+
+static isc_result_t
+find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
+     dns_rdatatype_t type, unsigned int options, isc_stdtime_t now,
+     dns_dbnode_t **nodep, dns_name_t *foundname, dns_rdataset_t *rdataset,
+     dns_rdataset_t *sigrdataset) {
+	imagedb_t *idb = (imagedb_t *)db;
+	imagesearch_t search;
+	const unsigned char *node, *encloser = NULL, *data, *entry;
+	const unsigned char *found, *foundsig, *nsecentry, *nsecsig;
+	const unsigned char *cnamesig;
+	dns_rdatatype_t sigtype;
+	dns_offsets_t offsets;
+	dns_name_t nname;
+	bool cname_ok = true, maybe_zonecut = false;
+	bool wild = false, active = false;
+	bool secure = ((idb->flags & IMAGE_SECURE) != 0);
+	bool havensec3 = ((idb->flags & IMAGE_NSEC3) != 0);
+	unsigned int count;
+	isc_result_t result;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	INSIST(version == NULL || version == (dns_dbversion_t *)&idb->version);
+
+	/*
+	 * We don't care about 'now'.
+	 */
+	UNUSED(now);
+
+	if (!dns_name_issubdomain(name, &idb->common.origin)) {
+		return (ISC_R_NOTFOUND);
+	}
+
+	search.idb = idb;
+	search.options = options;
+	search.zonecut = NULL;
+	search.zonecut_rdataset = NULL;
+	search.zonecut_sigrdataset = NULL;
+	search.tree = (options & DNS_DBFIND_FORCENSEC3) != 0 ? &idb->nsec3
+							     : &idb->tree;
+
+	node = lookup(idb, search.tree, name);
+	if (search.tree == &idb->tree) {
+		const unsigned char *path[IMAGE_MAXLABELS];
+		const unsigned char *ancestor;
+		unsigned int n = 0;
+
+		/*
+		 * Look for the topmost zone cut above 'name', as an RBT
+		 * search would on its way down the tree.
+		 */
+		encloser = (node != NULL) ? nodeparent(idb, node)
+					  : lookup_encloser(idb, name);
+		for (ancestor = encloser;
+		     ancestor != NULL && n < IMAGE_MAXLABELS;
+		     ancestor = nodeparent(idb, ancestor))
+		{
+			path[n++] = ancestor;
+		}
+		while (n-- > 0 && search.zonecut == NULL) {
+			check_zonecut(&search, path[n]);
+		}
+		if (search.zonecut != NULL && (options & DNS_DBFIND_GLUEOK) == 0)
+		{
+			/*
+			 * The caller does not want to find glue, so this is
+			 * the best answer.
+			 */
+			return (setup_delegation(&search, nodep, foundname,
+						 rdataset, sigrdataset));
+		}
+		if (node != NULL) {
+			encloser = node;
+		}
+	}
+
+	if (node == NULL) {
+		goto partial_match;
+	}
+
+	dns_name_init(&nname, offsets);
+	nodename(idb, node, &nname);
+	dns_name_copynf(&nname, foundname);
+
+found:
+	/*
+	 * We have found a node whose name is the desired name, or we
+	 * have matched a wildcard.
+	 */
+	if (search.zonecut != NULL) {
+		/*
+		 * If we're beneath a zone cut, we don't want to look for
+		 * CNAMEs because they're not legitimate zone glue.
+		 */
+		cname_ok = false;
+	} else if ((nodeflags(node) & NODE_NS) != 0 &&
+		   !dns_rdatatype_atparent(type)) {
+		/*
+		 * The node may be a zone cut itself.  DS records live
+		 * above the zone cut, so we want to ignore any referral.
+		 */
+		maybe_zonecut = true;
+	}
+
+	/*
+	 * Certain DNSSEC types are not subject to CNAME matching
+	 * (RFC4035, section 2.5 and RFC3007).
+	 */
+	if (type == dns_rdatatype_key || type == dns_rdatatype_nsec) {
+		cname_ok = false;
+	}
+
+	found = NULL;
+	foundsig = NULL;
+	sigtype = type;
+	nsecentry = NULL;
+	nsecsig = NULL;
+	cnamesig = NULL;
+	data = nodedata(idb, node);
+	count = (data != NULL) ? get16(data) : 0;
+	entry = (data != NULL) ? data + 2 : NULL;
+	for (unsigned int i = 0; i < count; i++, entry = nextentry(entry)) {
+		dns_rdatatype_t etype = get16(entry + ENTRY_TYPE);
+		dns_rdatatype_t covers = get16(entry + ENTRY_COVERS);
+
+		/*
+		 * Do special zone cut handling, if requested.
+		 */
+		if (maybe_zonecut && etype == dns_rdatatype_ns && covers == 0)
+		{
+			search.zonecut = node;
+			search.zonecut_rdataset = entry;
+			search.zonecut_sigrdataset = NULL;
+			maybe_zonecut = false;
+			if ((options & DNS_DBFIND_GLUEOK) == 0 &&
+			    type != dns_rdatatype_nsec &&
+			    type != dns_rdatatype_key)
+			{
+				/*
+				 * Glue is not OK, but any answer we could
+				 * return would be glue.  Return the
+				 * delegation.
+				 */
+				found = NULL;
+				break;
+			}
+			if (found != NULL && foundsig != NULL) {
+				break;
+			}
+		}
+
+		/*
+		 * If the NSEC3 record doesn't match the chain we are
+		 * using, behave as if it isn't here.
+		 */
+		if (etype == dns_rdatatype_nsec3 && covers == 0 &&
+		    !matchparams(idb, entry)) {
+			goto partial_match;
+		}
+
+		if ((etype == type && covers == 0) ||
+		    type == dns_rdatatype_any ||
+		    (etype == dns_rdatatype_cname && covers == 0 && cname_ok))
+		{
+			found = entry;
+			if (etype == dns_rdatatype_cname && cname_ok) {
+				if (cnamesig != NULL) {
+					foundsig = cnamesig;
+				} else {
+					sigtype = dns_rdatatype_cname;
+				}
+			}
+			if (!maybe_zonecut && foundsig != NULL) {
+				break;
+			}
+		} else if (etype == dns_rdatatype_rrsig && covers == sigtype) {
+			foundsig = entry;
+			if (!maybe_zonecut && found != NULL) {
+				break;
+			}
+		} else if (etype == dns_rdatatype_nsec && covers == 0 &&
+			   !havensec3) {
+			nsecentry = entry;
+		} else if (etype == dns_rdatatype_rrsig &&
+			   covers == dns_rdatatype_nsec && !havensec3)
+		{
+			nsecsig = entry;
+		} else if (cname_ok && etype == dns_rdatatype_rrsig &&
+			   covers == dns_rdatatype_cname)
+		{
+			cnamesig = entry;
+		}
+	}
+
+	if (count == 0 && !wild) {
+		/*
+		 * An empty non-terminal: the name exists, but has no data.
+		 */
+		active = true;
+		goto partial_match;
+	}
+
+	if (found == NULL) {
+		if (search.zonecut != NULL) {
+			/*
+			 * We were trying to find glue at a node beneath a
+			 * zone cut, but didn't.  Return the delegation.
+			 */
+			return (setup_delegation(&search, nodep, foundname,
+						 rdataset, sigrdataset));
+		}
+
+		/*
+		 * The desired type doesn't exist.
+		 */
+		result = DNS_R_NXRRSET;
+		if (secure && !havensec3 &&
+		    (nsecentry == NULL || nsecsig == NULL)) {
+			/*
+			 * The zone is secure but there's no NSEC, or the
+			 * NSEC has no signature!
+			 */
+			if (!wild) {
+				return (DNS_R_BADDB);
+			}
+			result = find_closest_nsec(&search, name, NULL, nodep,
+						   foundname, rdataset,
+						   sigrdataset);
+			if (result == ISC_R_SUCCESS) {
+				result = DNS_R_EMPTYWILD;
+			}
+			return (result);
+		}
+		if ((options & DNS_DBFIND_FORCENSEC) != 0 && nsecentry == NULL)
+		{
+			/*
+			 * There's no NSEC record, and we were told to find
+			 * one.
+			 */
+			return (DNS_R_BADDB);
+		}
+		newnode(idb, node, nodep);
+		if ((secure && !havensec3) ||
+		    (options & DNS_DBFIND_FORCENSEC) != 0) {
+			bind_rdataset(idb, node, nsecentry, rdataset);
+			bind_rdataset(idb, node, nsecsig, sigrdataset);
+		}
+		if (wild) {
+			foundname->attributes |= DNS_NAMEATTR_WILDCARD;
+		}
+		return (result);
+	}
+
+	/*
+	 * We found what we were looking for, or we found a CNAME.
+	 */
+	if (type != get16(found + ENTRY_TYPE) && type != dns_rdatatype_any &&
+	    get16(found + ENTRY_TYPE) == dns_rdatatype_cname)
+	{
+		result = DNS_R_CNAME;
+	} else if (search.zonecut != NULL) {
+		/*
+		 * If we're beneath a zone cut, we must indicate that the
+		 * result is glue, unless we're actually at the zone cut
+		 * and the type is NSEC or KEY.
+		 */
+		if (search.zonecut == node) {
+			if (type == dns_rdatatype_nsec ||
+			    type == dns_rdatatype_nsec3 ||
+			    type == dns_rdatatype_key)
+			{
+				result = ISC_R_SUCCESS;
+			} else if (type == dns_rdatatype_any) {
+				result = DNS_R_ZONECUT;
+			} else {
+				result = DNS_R_GLUE;
+			}
+		} else {
+			result = DNS_R_GLUE;
+		}
+		if (result == DNS_R_GLUE &&
+		    (options & DNS_DBFIND_VALIDATEGLUE) != 0 &&
+		    !valid_glue(&search, foundname, type, node))
+		{
+			return (setup_delegation(&search, nodep, foundname,
+						 rdataset, sigrdataset));
+		}
+	} else {
+		/*
+		 * An ordinary successful query!
+		 */
+		result = ISC_R_SUCCESS;
+	}
+
+	newnode(idb, node, nodep);
+	if (type != dns_rdatatype_any) {
+		bind_rdataset(idb, node, found, rdataset);
+		bind_rdataset(idb, node, foundsig, sigrdataset);
+	}
+	if (wild) {
+		foundname->attributes |= DNS_NAMEATTR_WILDCARD;
+	}
+
+	return (result);
+
+partial_match:
+	if (search.zonecut != NULL) {
+		return (setup_delegation(&search, nodep, foundname, rdataset,
+					 sigrdataset));
+	}
+
+	/*
+	 * Since empty non-terminals are nodes too, the only wildcard
+	 * that can match is the one at the closest encloser (RFC 4592).
+	 */
+	if (!active && encloser != NULL &&
+	    (nodeflags(encloser) & NODE_WILD) != 0 &&
+	    (options & DNS_DBFIND_NOWILD) == 0)
+	{
+		const unsigned char *wnode = NULL;
+		dns_fixedname_t fwname;
+		dns_name_t *wname = dns_fixedname_initname(&fwname);
+
+		dns_name_init(&nname, offsets);
+		nodename(idb, encloser, &nname);
+		result = dns_name_concatenate(dns_wildcardname, &nname, wname,
+					      NULL);
+		if (result == ISC_R_SUCCESS) {
+			wnode = lookup(idb, &idb->tree, wname);
+		}
+		if (wnode != NULL) {
+			dns_name_copynf(name, foundname);
+			node = wnode;
+			wild = true;
+			goto found;
+		}
+	}
+
+	/*
+	 * If we're here, then the name does not exist, is not beneath a
+	 * zonecut, and there's no matching wildcard.
+	 */
+	if ((secure && !havensec3) ||
+	    (options & (DNS_DBFIND_FORCENSEC | DNS_DBFIND_FORCENSEC3)) != 0)
+	{
+		result = find_closest_nsec(&search, name, node, nodep,
+					   foundname, rdataset, sigrdataset);
+		if (result == ISC_R_SUCCESS) {
+			result = active ? DNS_R_EMPTYNAME : DNS_R_NXDOMAIN;
+		}
+	} else {
+		if (!active && encloser != NULL) {
+			/*
+			 * Like the RBT, report the closest encloser.
+			 */
+			dns_name_init(&nname, offsets);
+			nodename(idb, encloser, &nname);
+			dns_name_copynf(&nname, foundname);
+		}
+		result = active ? DNS_R_EMPTYNAME : DNS_R_NXDOMAIN;
+	}
+
+	return (result);
+}
+
+static isc_result_t
+findzonecut(dns_db_t *db, const dns_name_t *name, unsigned int options,
+	    isc_stdtime_t now, dns_dbnode_t **nodep, dns_name_t *foundname,
+	    dns_name_t *dcname, dns_rdataset_t *rdataset,
+	    dns_rdataset_t *sigrdataset) {
+	UNUSED(db);
+	UNUSED(name);
+	UNUSED(options);
+	UNUSED(now);
+	UNUSED(nodep);
+	UNUSED(foundname);
+	UNUSED(dcname);
+	UNUSED(rdataset);
+	UNUSED(sigrdataset);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+static isc_result_t
+expirenode(dns_db_t *db, dns_dbnode_t *node, isc_stdtime_t now) {
+	UNUSED(db);
+	UNUSED(node);
+	UNUSED(now);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+static void
+printnode(dns_db_t *db, dns_dbnode_t *node, FILE *out) {
+	imagedb_t *idb = (imagedb_t *)db;
+	const unsigned char *data;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+
+	data = nodedata(idb, node);
+	fprintf(out, "node %p, %u rdatasets\n", node,
+		data != NULL ? get16(data) : 0);
+}
+
+static dns_dbiteratormethods_t dbiterator_methods;
+
+static isc_result_t
+createiterator(dns_db_t *db, unsigned int options,
+	       dns_dbiterator_t **iteratorp) {
+	imagedb_t *idb = (imagedb_t *)db;
+	image_dbiterator_t *iter;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	REQUIRE((options & (DNS_DB_NSEC3ONLY | DNS_DB_NONSEC3)) !=
+		(DNS_DB_NSEC3ONLY | DNS_DB_NONSEC3));
+
+	iter = isc_mem_get(idb->common.mctx, sizeof(*iter));
+
+	iter->common.methods = &dbiterator_methods;
+	iter->common.db = NULL;
+	dns_db_attach(db, &iter->common.db);
+	iter->common.relative_names = ((options & DNS_DB_RELATIVENAMES) !=
+				       0);
+	iter->common.magic = DNS_DBITERATOR_MAGIC;
+	iter->common.cleaning = false;
+	iter->nsec3only = ((options & DNS_DB_NSEC3ONLY) != 0);
+	iter->nonsec3 = ((options & DNS_DB_NONSEC3) != 0);
+	iter->tree = NULL;
+	iter->index = 0;
+	iter->new_origin = false;
+	dns_fixedname_init(&iter->origin);
+
+	*iteratorp = (dns_dbiterator_t *)iter;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+findrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+	     dns_rdatatype_t type, dns_rdatatype_t covers, isc_stdtime_t now,
+	     dns_rdataset_t *rdataset, dns_rdataset_t *sigrdataset) {
+	imagedb_t *idb = (imagedb_t *)db;
+	const unsigned char *data, *entry;
+	const unsigned char *found = NULL, *foundsig = NULL;
+	unsigned int count;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	REQUIRE(type != dns_rdatatype_any);
+	INSIST(version == NULL || version == (dns_dbversion_t *)&idb->version);
+
+	UNUSED(now);
+
+	data = nodedata(idb, node);
+	count = (data != NULL) ? get16(data) : 0;
+	entry = (data != NULL) ? data + 2 : NULL;
+	for (unsigned int i = 0; i < count; i++, entry = nextentry(entry)) {
+		dns_rdatatype_t etype = get16(entry + ENTRY_TYPE);
+		dns_rdatatype_t ecovers = get16(entry + ENTRY_COVERS);
+
+		if (etype == type && ecovers == covers) {
+			found = entry;
+		} else if (covers == 0 && etype == dns_rdatatype_rrsig &&
+			   ecovers == type) {
+			foundsig = entry;
+		}
+	}
+
+	if (found == NULL) {
+		return (ISC_R_NOTFOUND);
+	}
+
+	bind_rdataset(idb, node, found, rdataset);
+	bind_rdataset(idb, node, foundsig, sigrdataset);
+
+	return (ISC_R_SUCCESS);
+}
+
+static dns_rdatasetitermethods_t rdatasetiter_methods;
+
+static isc_result_t
+allrdatasets(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+	     isc_stdtime_t now, dns_rdatasetiter_t **iteratorp) {
+	imagedb_t *idb = (imagedb_t *)db;
+	image_rdatasetiter_t *iter;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	INSIST(version == NULL || version == (dns_dbversion_t *)&idb->version);
+
+	iter = isc_mem_get(idb->common.mctx, sizeof(*iter));
+
+	iter->common.magic = DNS_RDATASETITER_MAGIC;
+	iter->common.methods = &rdatasetiter_methods;
+	iter->common.db = db;
+	iter->common.node = NULL;
+	attachnode(db, node, &iter->common.node);
+	iter->common.version = version;
+	iter->common.now = now;
+	iter->index = 0;
+	iter->entry = NULL;
+
+	*iteratorp = (dns_rdatasetiter_t *)iter;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+	    isc_stdtime_t now, dns_rdataset_t *rdataset, unsigned int options,
+	    dns_rdataset_t *addedrdataset) {
+	UNUSED(db);
+	UNUSED(node);
+	UNUSED(version);
+	UNUSED(now);
+	UNUSED(rdataset);
+	UNUSED(options);
+	UNUSED(addedrdataset);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+static isc_result_t
+subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+		 dns_rdataset_t *rdataset, unsigned int options,
+		 dns_rdataset_t *newrdataset) {
+	UNUSED(db);
+	UNUSED(node);
+	UNUSED(version);
+	UNUSED(rdataset);
+	UNUSED(options);
+	UNUSED(newrdataset);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+static isc_result_t
+deleterdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+	       dns_rdatatype_t type, dns_rdatatype_t covers) {
+	UNUSED(db);
+	UNUSED(node);
+	UNUSED(version);
+	UNUSED(type);
+	UNUSED(covers);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+static bool
+issecure(dns_db_t *db) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+
+	return ((idb->flags & IMAGE_SECURE) != 0);
+}
+
+static unsigned int
+nodecount(dns_db_t *db) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+
+	return (idb->tree.count + idb->nsec3.count);
+}
+
+static bool
+ispersistent(dns_db_t *db) {
+	UNUSED(db);
+
+	return (false);
+}
+
+static void
+overmem(dns_db_t *db, bool over) {
+	UNUSED(db);
+	UNUSED(over);
+}
+
+static void
+settask(dns_db_t *db, isc_task_t *task) {
+	UNUSED(db);
+	UNUSED(task);
+}
+
+static isc_result_t
+getoriginnode(dns_db_t *db, dns_dbnode_t **nodep) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	REQUIRE(nodep != NULL && *nodep == NULL);
+
+	if (idb->tree.count == 0) {
+		return (ISC_R_NOTFOUND);
+	}
+	newnode(idb, nodeat(&idb->tree, 0), nodep);
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+getnsec3parameters(dns_db_t *db, dns_dbversion_t *version, dns_hash_t *hash,
+		   uint8_t *flags, uint16_t *iterations, unsigned char *salt,
+		   size_t *salt_length) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	INSIST(version == NULL || version == (dns_dbversion_t *)&idb->version);
+
+	if ((idb->flags & IMAGE_NSEC3) == 0) {
+		return (ISC_R_NOTFOUND);
+	}
+
+	if (hash != NULL) {
+		*hash = idb->hash;
+	}
+	if (salt != NULL && salt_length != NULL) {
+		REQUIRE(*salt_length >= idb->saltlength);
+		memmove(salt, idb->salt, idb->saltlength);
+	}
+	if (salt_length != NULL) {
+		*salt_length = idb->saltlength;
+	}
+	if (iterations != NULL) {
+		*iterations = idb->iterations;
+	}
+	if (flags != NULL) {
+		*flags = idb->nsec3flags;
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+setsigningtime(dns_db_t *db, dns_rdataset_t *rdataset, isc_stdtime_t resign) {
+	UNUSED(db);
+	UNUSED(rdataset);
+	UNUSED(resign);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+static isc_result_t
+getsigningtime(dns_db_t *db, dns_rdataset_t *rdataset, dns_name_t *name) {
+	UNUSED(db);
+	UNUSED(rdataset);
+	UNUSED(name);
+
+	return (ISC_R_NOTFOUND);
+}
+
+static void
+resigned(dns_db_t *db, dns_rdataset_t *rdataset, dns_dbversion_t *version) {
+	UNUSED(db);
+	UNUSED(rdataset);
+	UNUSED(version);
+}
+
+static bool
+isdnssec(dns_db_t *db) {
+	return (issecure(db));
+}
+
+static size_t
+hashsize(dns_db_t *db) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+
+	return (idb->tree.buckets);
+}
+
+static isc_result_t
+nodefullname(dns_db_t *db, dns_dbnode_t *node, dns_name_t *name) {
+	imagedb_t *idb = (imagedb_t *)db;
+	dns_offsets_t offsets;
+	dns_name_t nname;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	REQUIRE(node != NULL);
+	REQUIRE(name != NULL);
+
+	dns_name_init(&nname, offsets);
+	nodename(idb, node, &nname);
+
+	return (dns_name_copy(&nname, name, NULL));
+}
+
+static isc_result_t
+getsize(dns_db_t *db, dns_dbversion_t *version, uint64_t *records,
+	uint64_t *bytes) {
+	imagedb_t *idb = (imagedb_t *)db;
+
+	REQUIRE(VALID_IMAGEDB(idb));
+	INSIST(version == NULL || version == (dns_dbversion_t *)&idb->version);
+
+	if (records != NULL) {
+		*records = idb->records;
+	}
+	if (bytes != NULL) {
+		*bytes = idb->xfrsize;
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
+static dns_dbmethods_t imagedb_methods = { attach,
+					   detach,
+					   beginload,
+					   endload,
+					   NULL, /* serialize */
+					   dump,
+					   currentversion,
+					   newversion,
+					   attachversion,
+					   closeversion,
+					   findnode,
+					   find,
+					   findzonecut,
+					   attachnode,
+					   detachnode,
+					   expirenode,
+					   printnode,
+					   createiterator,
+					   findrdataset,
+					   allrdatasets,
+					   addrdataset,
+					   subtractrdataset,
+					   deleterdataset,
+					   issecure,
+					   nodecount,
+					   ispersistent,
+					   overmem,
+					   settask,
+					   getoriginnode,
+					   NULL, /* transfernode */
+					   getnsec3parameters,
+					   findnsec3node,
+					   setsigningtime,
+					   getsigningtime,
+					   resigned,
+					   isdnssec,
+					   NULL, /* getrrsetstats */
+					   NULL, /* rpz_attach */
+					   NULL, /* rpz_ready */
+					   NULL, /* findnodeext */
+					   NULL, /* findext */
+					   NULL, /* setcachestats */
+					   hashsize,
+					   nodefullname,
+					   getsize,
+					   NULL, /* setservestalettl */
+					   NULL, /* getservestalettl */
+					   NULL, /* setgluecachestats */
+					   NULL /* adjusthashsize */ };
+
+isc_result_t
+dns_imagedb_create(isc_mem_t *mctx, const dns_name_t *base, dns_dbtype_t type,
+		   dns_rdataclass_t rdclass, unsigned int argc, char *argv[],
+		   void *driverarg, dns_db_t **dbp) {
+	imagedb_t *idb;
+	isc_result_t result;
+
+	UNUSED(argc);
+	UNUSED(argv);
+	UNUSED(driverarg);
+
+	if (type != dns_dbtype_zone) {
+		return (ISC_R_NOTIMPLEMENTED);
+	}
+
+	idb = isc_mem_get(mctx, sizeof(*idb));
+	memset(idb, 0, sizeof(*idb));
+	dns_name_init(&idb->common.origin, NULL);
+	idb->common.methods = &imagedb_methods;
+	idb->common.attributes = 0;
+	idb->common.rdclass = rdclass;
+	idb->common.mctx = NULL;
+	ISC_LIST_INIT(idb->common.update_listeners);
+	isc_mem_attach(mctx, &idb->common.mctx);
+	isc_refcount_init(&idb->references, 1);
+	atomic_init(&idb->count, 0);
+
+	idb->common.magic = DNS_DB_MAGIC;
+	idb->common.impmagic = IMAGEDB_MAGIC;
+
+	result = dns_name_dupwithoffsets(base, mctx, &idb->common.origin);
+	if (result != ISC_R_SUCCESS) {
+		isc_refcount_decrementz(&idb->references);
+		free_imagedb(idb);
+		return (result);
+	}
+
+	*dbp = (dns_db_t *)idb;
+
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Rdataset Methods
+ */
+
+static void
+rdataset_disassociate(dns_rdataset_t *rdataset) {
+	dns_db_t *db = rdataset->private1;
+	dns_dbnode_t *node = rdataset->private2;
+
+	detachnode(db, &node);
+}
+
+static isc_result_t
+rdataset_first(dns_rdataset_t *rdataset) {
+	unsigned char *entry = rdataset->private3;
+	unsigned int count = get16(entry + ENTRY_COUNT);
+
+	if (count == 0) {
+		rdataset->private5 = NULL;
+		return (ISC_R_NOMORE);
+	}
+
+	rdataset->privateuint4 = count - 1;
+	rdataset->private5 = entry + ENTRY_SIZE;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+rdataset_next(dns_rdataset_t *rdataset) {
+	unsigned char *raw = rdataset->private5;
+
+	if (raw == NULL || rdataset->privateuint4 == 0) {
+		rdataset->private5 = NULL;
+		return (ISC_R_NOMORE);
+	}
+
+	rdataset->privateuint4--;
+	rdataset->private5 = raw + 2 + get16(raw);
+
+	return (ISC_R_SUCCESS);
+}
+
+static void
+rdataset_current(dns_rdataset_t *rdataset, dns_rdata_t *rdata) {
+	unsigned char *raw = rdataset->private5;
+	isc_region_t r;
+
+	REQUIRE(raw != NULL);
+
+	r.length = get16(raw);
+	r.base = raw + 2;
+	dns_rdata_fromregion(rdata, rdataset->rdclass, rdataset->type, &r);
+}
+
+static void
+rdataset_clone(dns_rdataset_t *source, dns_rdataset_t *target) {
+	dns_db_t *db = source->private1;
+	dns_dbnode_t *node = source->private2;
+	dns_dbnode_t *cloned_node = NULL;
+
+	attachnode(db, node, &cloned_node);
+	INSIST(!ISC_LINK_LINKED(target, link));
+	*target = *source;
+	ISC_LINK_INIT(target, link);
+
+	/*
+	 * Reset iterator state.
+	 */
+	target->privateuint4 = 0;
+	target->private5 = NULL;
+}
+
+static unsigned int
+rdataset_count(dns_rdataset_t *rdataset) {
+	unsigned char *entry = rdataset->private3;
+
+	return (get16(entry + ENTRY_COUNT));
+}
+
+static dns_rdatasetmethods_t rdataset_methods = { rdataset_disassociate,
+						  rdataset_first,
+						  rdataset_next,
+						  rdataset_current,
+						  rdataset_clone,
+						  rdataset_count,
+						  NULL, /* addnoqname */
+						  NULL, /* getnoqname */
+						  NULL, /* addclosest */
+						  NULL, /* getclosest */
+						  NULL, /* settrust */
+						  NULL, /* expire */
+						  NULL, /* clearprefetch */
+						  NULL, /* setownercase */
+						  NULL, /* getownercase */
+						  NULL /* addglue */ };
+
+/*
+ * Rdataset Iterator Methods
+ */
+
+static void
+rdatasetiter_destroy(dns_rdatasetiter_t **iteratorp) {
+	image_rdatasetiter_t *iter = (image_rdatasetiter_t *)(*iteratorp);
+	dns_db_t *db = iter->common.db;
+
+	*iteratorp = NULL;
+
+	detachnode(db, &iter->common.node);
+	iter->common.magic = 0;
+	isc_mem_put(db->mctx, iter, sizeof(*iter));
+}
+
+static isc_result_t
+rdatasetiter_first(dns_rdatasetiter_t *iterator) {
+	image_rdatasetiter_t *iter = (image_rdatasetiter_t *)iterator;
+	imagedb_t *idb = (imagedb_t *)iter->common.db;
+	const unsigned char *data = nodedata(idb, iter->common.node);
+
+	iter->index = 0;
+	if (data == NULL || get16(data) == 0) {
+		iter->entry = NULL;
+		return (ISC_R_NOMORE);
+	}
+	iter->entry = data + 2;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+rdatasetiter_next(dns_rdatasetiter_t *iterator) {
+	image_rdatasetiter_t *iter = (image_rdatasetiter_t *)iterator;
+	imagedb_t *idb = (imagedb_t *)iter->common.db;
+	const unsigned char *data = nodedata(idb, iter->common.node);
+
+	if (iter->entry == NULL || ++iter->index >= get16(data)) {
+		iter->entry = NULL;
+		return (ISC_R_NOMORE);
+	}
+	iter->entry = nextentry(iter->entry);
+
+	return (ISC_R_SUCCESS);
+}
+
+static void
+rdatasetiter_current(dns_rdatasetiter_t *iterator, dns_rdataset_t *rdataset) {
+	image_rdatasetiter_t *iter = (image_rdatasetiter_t *)iterator;
+	imagedb_t *idb = (imagedb_t *)iter->common.db;
+
+	REQUIRE(iter->entry != NULL);
+
+	bind_rdataset(idb, iter->common.node, iter->entry, rdataset);
+}
+
+static dns_rdatasetitermethods_t rdatasetiter_methods = {
+	rdatasetiter_destroy, rdatasetiter_first, rdatasetiter_next,
+	rdatasetiter_current
+};
+
+/*
+ * Database Iterator Methods
+ *
+ * The iterator goes through the main node array, then through the
+ * NSEC3 node array.
+ */
+
+static void
+dbiterator_destroy(dns_dbiterator_t **iteratorp) {
+	image_dbiterator_t *iter = (image_dbiterator_t *)(*iteratorp);
+	isc_mem_t *mctx = iter->common.db->mctx;
+
+	*iteratorp = NULL;
+
+	iter->common.magic = 0;
+	dns_db_detach(&iter->common.db);
+	isc_mem_put(mctx, iter, sizeof(*iter));
+}
+
+static isc_result_t
+dbiterator_set(image_dbiterator_t *iter, const imagetree_t *tree,
+	       uint32_t index) {
+	if (tree == NULL) {
+		iter->tree = NULL;
+		return (ISC_R_NOMORE);
+	}
+
+	iter->tree = tree;
+	iter->index = index;
+	iter->new_origin = true;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+dbiterator_first(dns_dbiterator_t *iterator) {
+	image_dbiterator_t *iter = (image_dbiterator_t *)iterator;
+	imagedb_t *idb = (imagedb_t *)iterator->db;
+
+	if (!iter->nsec3only && idb->tree.count > 0) {
+		return (dbiterator_set(iter, &idb->tree, 0));
+	}
+	if (!iter->nonsec3 && idb->nsec3.count > 0) {
+		return (dbiterator_set(iter, &idb->nsec3, 0));
+	}
+
+	return (dbiterator_set(iter, NULL, 0));
+}
+
+static isc_result_t
+dbiterator_last(dns_dbiterator_t *iterator) {
+	image_dbiterator_t *iter = (image_dbiterator_t *)iterator;
+	imagedb_t *idb = (imagedb_t *)iterator->db;
+
+	if (!iter->nonsec3 && idb->nsec3.count > 0) {
+		return (dbiterator_set(iter, &idb->nsec3,
+				       idb->nsec3.count - 1));
+	}
+	if (!iter->nsec3only && idb->tree.count > 0) {
+		return (dbiterator_set(iter, &idb->tree, idb->tree.count - 1));
+	}
+
+	return (dbiterator_set(iter, NULL, 0));
+}
+
+static isc_result_t
+dbiterator_seek(dns_dbiterator_t *iterator, const dns_name_t *name) {
+	image_dbiterator_t *iter = (image_dbiterator_t *)iterator;
+	imagedb_t *idb = (imagedb_t *)iterator->db;
+	const imagetree_t *tree;
+	const unsigned char *node;
+	uint32_t index;
+
+	tree = iter->nsec3only ? &idb->nsec3 : &idb->tree;
+	node = lookup(idb, tree, name);
+	if (node == NULL && !iter->nsec3only && !iter->nonsec3) {
+		node = lookup(idb, &idb->nsec3, name);
+		if (node != NULL) {
+			tree = &idb->nsec3;
+		}
+	}
+	if (node != NULL) {
+		return (dbiterator_set(iter, tree, nodeindex(tree, node)));
+	}
+
+	/*
+	 * Stay on the main tree if not found in either tree.
+	 */
+	if (!predecessor(idb, tree, name, &index)) {
+		iter->tree = NULL;
+		return (ISC_R_NOTFOUND);
+	}
+	(void)dbiterator_set(iter, tree, index);
+
+	return (DNS_R_PARTIALMATCH);
+}
+
+static isc_result_t
+dbiterator_prev(dns_dbiterator_t *iterator) {
+	image_dbiterator_t *iter = (image_dbiterator_t *)iterator;
+	imagedb_t *idb = (imagedb_t *)iterator->db;
+
+	if (iter->tree == NULL) {
+		return (ISC_R_NOMORE);
+	}
+
+	if (iter->index > 0) {
+		iter->index--;
+		return (ISC_R_SUCCESS);
+	}
+	if (iter->tree == &idb->nsec3 && !iter->nsec3only &&
+	    idb->tree.count > 0) {
+		return (dbiterator_set(iter, &idb->tree, idb->tree.count - 1));
+	}
+
+	return (dbiterator_set(iter, NULL, 0));
+}
+
+static isc_result_t
+dbiterator_next(dns_dbiterator_t *iterator) {
+	image_dbiterator_t *iter = (image_dbiterator_t *)iterator;
+	imagedb_t *idb = (imagedb_t *)iterator->db;
+
+	if (iter->tree == NULL) {
+		return (ISC_R_NOMORE);
+	}
+
+	if (iter->index + 1 < iter->tree->count) {
+		iter->index++;
+		return (ISC_R_SUCCESS);
+	}
+	if (iter->tree == &idb->tree && !iter->nonsec3 &&
+	    idb->nsec3.count > 0) {
+		return (dbiterator_set(iter, &idb->nsec3, 0));
+	}
+
+	return (dbiterator_set(iter, NULL, 0));
+}
+
+static isc_result_t
+dbiterator_current(dns_dbiterator_t *iterator, dns_dbnode_t **nodep,
+		   dns_name_t *name) {
+	image_dbiterator_t *iter = (image_dbiterator_t *)iterator;
+	imagedb_t *idb = (imagedb_t *)iterator->db;
+	const unsigned char *node;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(iter->tree != NULL);
+
+	node = nodeat(iter->tree, iter->index);
+	if (name != NULL) {
+		dns_offsets_t offsets;
+		dns_name_t nname, prefix, suffix;
+		dns_name_t *origin = dns_fixedname_name(&iter->origin);
+		unsigned int labels;
+
+		dns_name_init(&nname, offsets);
+		nodename(idb, node, &nname);
+		labels = dns_name_countlabels(&nname);
+		if (iterator->relative_names && labels > 1) {
+			/*
+			 * A name is made relative to its parent name,
+			 * which is then the origin of the iterator.
+			 */
+			dns_name_init(&suffix, NULL);
+			dns_name_getlabelsequence(&nname, 1, labels - 1,
+						  &suffix);
+			if (iter->new_origin || !dns_name_equal(&suffix, origin))
+			{
+				dns_name_copynf(&suffix, origin);
+				result = DNS_R_NEWORIGIN;
+			}
+			iter->new_origin = false;
+			dns_name_init(&prefix, NULL);
+			dns_name_getlabelsequence(&nname, 0, 1, &prefix);
+			dns_name_copynf(&prefix, name);
+		} else {
+			dns_name_copynf(&nname, name);
+		}
+	}
+
+	newnode(idb, node, nodep);
+
+	return (result);
+}
+
+static isc_result_t
+dbiterator_pause(dns_dbiterator_t *iterator) {
+	UNUSED(iterator);
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+dbiterator_origin(dns_dbiterator_t *iterator, dns_name_t *name) {
+	image_dbiterator_t *iter = (image_dbiterator_t *)iterator;
+	imagedb_t *idb = (imagedb_t *)iterator->db;
+	dns_offsets_t offsets;
+	dns_name_t nname;
+	unsigned int labels;
+
+	REQUIRE(iter->tree != NULL);
+
+	dns_name_init(&nname, offsets);
+	nodename(idb, nodeat(iter->tree, iter->index), &nname);
+	labels = dns_name_countlabels(&nname);
+	if (labels > 1) {
+		dns_name_t suffix;
+
+		dns_name_init(&suffix, NULL);
+		dns_name_getlabelsequence(&nname, 1, labels - 1, &suffix);
+		return (dns_name_copy(&suffix, name, NULL));
+	}
+
+	return (dns_name_copy(&nname, name, NULL));
+}
+
+static dns_dbiteratormethods_t dbiterator_methods = {
+	dbiterator_destroy, dbiterator_first, dbiterator_last,
+	dbiterator_seek,    dbiterator_prev,  dbiterator_next,
+	dbiterator_current, dbiterator_pause, dbiterator_origin
+};
+
+/*
+ * Image Building
+ */
+
+typedef struct buildnode {
+	uint32_t name; /* offset in 'names' */
+	uint32_t data; /* offset in 'data' plus one, 0 if none */
+	uint32_t parent;
+	uint32_t flags;
+} buildnode_t;
+
+typedef struct buildtree {
+	buildnode_t *nodes;
+	uint32_t count;
+	uint32_t size;
+} buildtree_t;
+
+typedef struct imagebuild {
+	isc_mem_t *mctx;
+	dns_db_t *db;
+	dns_dbversion_t *version;
+	buildtree_t tree;
+	buildtree_t nsec3;
+	isc_buffer_t *names;
+	isc_buffer_t *data;
+	uint64_t records;
+	uint64_t xfrsize;
+	uint32_t flags;
+	dns_rdata_nsec3param_t nsec3param;
+	unsigned char salt[DNS_NSEC3_SALTSIZE];
+} imagebuild_t;
+
+/*%
+ * Space left in a buffer holding part of an image, whose offsets must
+ * fit in 32 bits.
+ */
+static inline uint64_t
+build_space(isc_buffer_t *b) {
+	return (UINT32_MAX - (uint64_t)isc_buffer_usedlength(b));
+}
+
+static isc_result_t
+build_addnode(imagebuild_t *b, buildtree_t *tree, const dns_name_t *name,
+	      uint32_t data, uint32_t parent, uint32_t *indexp) {
+	buildnode_t *node;
+	isc_region_t r;
+
+	if (tree->count == tree->size) {
+		uint32_t size = (tree->size == 0) ? 1024 : tree->size * 2;
+		buildnode_t *nodes;
+
+		if (size > UINT32_MAX / NODE_SIZE) {
+			return (ISC_R_RANGE);
+		}
+		nodes = isc_mem_get(b->mctx, size * sizeof(nodes[0]));
+		if (tree->nodes != NULL) {
+			memmove(nodes, tree->nodes,
+				tree->count * sizeof(nodes[0]));
+			isc_mem_put(b->mctx, tree->nodes,
+				    tree->size * sizeof(nodes[0]));
+		}
+		tree->nodes = nodes;
+		tree->size = size;
+	}
+
+	dns_name_toregion(name, &r);
+	if (build_space(b->names) < 1 + r.length) {
+		return (ISC_R_RANGE);
+	}
+
+	node = &tree->nodes[tree->count];
+	node->name = isc_buffer_usedlength(b->names);
+	node->data = data;
+	node->parent = parent;
+	node->flags = 0;
+	isc_buffer_putuint8(b->names, (uint8_t)r.length);
+	isc_buffer_putmem(b->names, r.base, r.length);
+
+	*indexp = tree->count++;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+build_addrdataset(imagebuild_t *b, const dns_name_t *name,
+		  dns_rdataset_t *rdataset) {
+	isc_buffer_t *d = b->data;
+	unsigned int start = isc_buffer_usedlength(d);
+	unsigned int count = 0;
+	uint64_t size = 0;
+	unsigned char *p;
+	isc_result_t result;
+
+	if (build_space(d) < ENTRY_SIZE) {
+		return (ISC_R_RANGE);
+	}
+	isc_buffer_putuint16(d, rdataset->type);
+	isc_buffer_putuint16(d, rdataset->covers);
+	isc_buffer_putuint32(d, rdataset->ttl);
+	isc_buffer_putuint8(d, rdataset->trust);
+	isc_buffer_putuint8(d, 0);
+	isc_buffer_putuint16(d, 0); /* count, filled in below */
+	isc_buffer_putuint32(d, 0); /* length, filled in below */
+
+	for (result = dns_rdataset_first(rdataset); result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(rdataset))
+	{
+		dns_rdata_t rdata = DNS_RDATA_INIT;
+
+		dns_rdataset_current(rdataset, &rdata);
+		if (count == 0xffff || build_space(d) < 2 + rdata.length) {
+			return (ISC_R_RANGE);
+		}
+		isc_buffer_putuint16(d, rdata.length);
+		isc_buffer_putmem(d, rdata.data, rdata.length);
+		count++;
+		size += rdata.length;
+	}
+	if (result != ISC_R_NOMORE) {
+		return (result);
+	}
+
+	p = (unsigned char *)isc_buffer_base(d) + start;
+	set16(p + ENTRY_COUNT, count);
+	set32(p + ENTRY_LENGTH, isc_buffer_usedlength(d) - start - ENTRY_SIZE);
+
+	/* The same sizes as for an RBT database. */
+	b->records += count;
+	b->xfrsize += size + sizeof(dns_ttl_t) + sizeof(dns_rdatatype_t) +
+		      sizeof(dns_rdataclass_t) + name->length;
+
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Add the rdatasets of 'node' to the data of the image; '*datap' is
+ * set to their offset plus one, or to 0 if the node has no rdatasets.
+ */
+static isc_result_t
+build_addnodedata(imagebuild_t *b, dns_dbnode_t *node, const dns_name_t *name,
+		  uint32_t *datap, uint32_t *flagsp) {
+	dns_rdatasetiter_t *rdsiter = NULL;
+	unsigned int start, count = 0;
+	unsigned char *p;
+	isc_result_t result;
+
+	*datap = 0;
+	*flagsp = 0;
+
+	result = dns_db_allrdatasets(b->db, node, b->version, 0, &rdsiter);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+
+	if (build_space(b->data) < 2) {
+		result = ISC_R_RANGE;
+		goto cleanup;
+	}
+	start = isc_buffer_usedlength(b->data);
+	isc_buffer_putuint16(b->data, 0); /* count, filled in below */
+
+	for (result = dns_rdatasetiter_first(rdsiter); result == ISC_R_SUCCESS;
+	     result = dns_rdatasetiter_next(rdsiter))
+	{
+		dns_rdataset_t rdataset;
+
+		dns_rdataset_init(&rdataset);
+		dns_rdatasetiter_current(rdsiter, &rdataset);
+		if ((rdataset.attributes & DNS_RDATASETATTR_NEGATIVE) != 0) {
+			dns_rdataset_disassociate(&rdataset);
+			continue;
+		}
+		if (count == 0xffff) {
+			result = ISC_R_RANGE;
+		} else {
+			result = build_addrdataset(b, name, &rdataset);
+		}
+		if (rdataset.covers == 0) {
+			if (rdataset.type == dns_rdatatype_ns) {
+				*flagsp |= NODE_NS;
+			} else if (rdataset.type == dns_rdatatype_dname) {
+				*flagsp |= NODE_DNAME;
+			}
+		}
+		dns_rdataset_disassociate(&rdataset);
+		if (result != ISC_R_SUCCESS) {
+			goto cleanup;
+		}
+		count++;
+	}
+	if (result != ISC_R_NOMORE) {
+		goto cleanup;
+	}
+	result = ISC_R_SUCCESS;
+
+	if (count == 0) {
+		isc_buffer_subtract(b->data, 2);
+	} else {
+		p = (unsigned char *)isc_buffer_base(b->data) + start;
+		set16(p, count);
+		*datap = start + 1;
+	}
+
+cleanup:
+	dns_rdatasetiter_destroy(&rdsiter);
+	return (result);
+}
+
+/*%
+ * Add the nodes of 'b->db' that the iterator 'options' select to
+ * 'tree'.  For the main tree, empty non-terminals are added between
+ * the origin and each node with data.
+ */
+static isc_result_t
+build_addtree(imagebuild_t *b, buildtree_t *tree, unsigned int options) {
+	const dns_name_t *origin = dns_db_origin(b->db);
+	unsigned int olabels = dns_name_countlabels(origin);
+	uint32_t path[IMAGE_MAXLABELS + 1];
+	bool main = ((options & DNS_DB_NSEC3ONLY) == 0);
+	dns_dbiterator_t *dbiter = NULL;
+	dns_fixedname_t fname, fprev;
+	dns_name_t *name = dns_fixedname_initname(&fname);
+	dns_name_t *prev = dns_fixedname_initname(&fprev);
+	bool first = true;
+	isc_result_t result;
+
+	result = dns_db_createiterator(b->db, options, &dbiter);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+
+	for (result = dns_dbiterator_first(dbiter); result == ISC_R_SUCCESS;
+	     result = dns_dbiterator_next(dbiter))
+	{
+		dns_dbnode_t *node = NULL;
+		unsigned int labels, start, common;
+		uint32_t data, flags, parent, index;
+		dns_name_t label;
+		int order;
+
+		result = dns_dbiterator_current(dbiter, &node, name);
+		if (result != ISC_R_SUCCESS && result != DNS_R_NEWORIGIN) {
+			break;
+		}
+		(void)dns_dbiterator_pause(dbiter);
+
+		if (!dns_name_issubdomain(name, origin)) {
+			dns_db_detachnode(b->db, &node);
+			continue;
+		}
+		result = build_addnodedata(b, node, name, &data, &flags);
+		dns_db_detachnode(b->db, &node);
+		if (result != ISC_R_SUCCESS) {
+			break;
+		}
+		if (data == 0) {
+			continue;
+		}
+
+		labels = dns_name_countlabels(name);
+		if (!main) {
+			result = build_addnode(b, tree, name, data,
+					       IMAGE_NOPARENT, &index);
+			if (result != ISC_R_SUCCESS) {
+				break;
+			}
+			continue;
+		}
+
+		/*
+		 * The ancestors of 'name' that are also ancestors of the
+		 * previous name have been added already; add the others.
+		 */
+		start = olabels;
+		if (!first) {
+			(void)dns_name_fullcompare(name, prev, &order, &common);
+			if (common + 1 > start) {
+				start = common + 1;
+			}
+		}
+		dns_name_init(&label, NULL);
+		for (unsigned int l = start; l < labels; l++) {
+			dns_name_getlabelsequence(name, labels - l, l, &label);
+			parent = (l == olabels) ? IMAGE_NOPARENT : path[l - 1];
+			result = build_addnode(b, tree, &label, 0, parent,
+					       &path[l]);
+			if (result != ISC_R_SUCCESS) {
+				goto cleanup;
+			}
+		}
+
+		parent = (labels == olabels) ? IMAGE_NOPARENT
+					     : path[labels - 1];
+		result = build_addnode(b, tree, name, data, parent,
+				       &path[labels]);
+		if (result != ISC_R_SUCCESS) {
+			break;
+		}
+		if (labels == olabels) {
+			/* NS at the origin is not a zone cut. */
+			flags &= ~NODE_NS;
+		}
+		tree->nodes[path[labels]].flags |= flags;
+		if (parent != IMAGE_NOPARENT && dns_name_iswildcard(name)) {
+			tree->nodes[parent].flags |= NODE_WILD;
+		}
+
+		dns_name_copynf(name, prev);
+		first = false;
+	}
+	if (result == ISC_R_NOMORE) {
+		result = ISC_R_SUCCESS;
+	}
+
+cleanup:
+	dns_dbiterator_destroy(&dbiter);
+	return (result);
+}
+
+/*%
+ * Work out whether the zone is secure and which NSEC3 chain is in use,
+ * the way an RBT database does.
+ */
+static void
+build_security(imagebuild_t *b) {
+	dns_dbnode_t *node = NULL;
+	dns_rdataset_t rdataset, sigrdataset;
+	bool haszonekey = false, hasnsec = false, havensec3 = false;
+	isc_result_t result;
+
+	result = dns_db_getoriginnode(b->db, &node);
+	if (result != ISC_R_SUCCESS) {
+		return;
+	}
+
+	dns_rdataset_init(&rdataset);
+	dns_rdataset_init(&sigrdataset);
+	result = dns_db_findrdataset(b->db, node, b->version,
+				     dns_rdatatype_dnskey, 0, 0, &rdataset,
+				     NULL);
+	if (result == ISC_R_SUCCESS) {
+		for (result = dns_rdataset_first(&rdataset);
+		     result == ISC_R_SUCCESS && !haszonekey;
+		     result = dns_rdataset_next(&rdataset))
+		{
+			dns_rdata_t rdata = DNS_RDATA_INIT;
+
+			dns_rdataset_current(&rdataset, &rdata);
+			haszonekey = dns_zonekey_iszonekey(&rdata);
+		}
+		dns_rdataset_disassociate(&rdataset);
+	}
+	if (!haszonekey) {
+		goto detach;
+	}
+
+	result = dns_db_findrdataset(b->db, node, b->version,
+				     dns_rdatatype_nsec, 0, 0, &rdataset,
+				     &sigrdataset);
+	if (result == ISC_R_SUCCESS) {
+		if (dns_rdataset_isassociated(&sigrdataset)) {
+			hasnsec = true;
+			dns_rdataset_disassociate(&sigrdataset);
+		}
+		dns_rdataset_disassociate(&rdataset);
+	}
+
+	result = dns_db_findrdataset(b->db, node, b->version,
+				     dns_rdatatype_nsec3param, 0, 0, &rdataset,
+				     NULL);
+	if (result == ISC_R_SUCCESS) {
+		for (result = dns_rdataset_first(&rdataset);
+		     result == ISC_R_SUCCESS;
+		     result = dns_rdataset_next(&rdataset))
+		{
+			dns_rdata_t rdata = DNS_RDATA_INIT;
+			dns_rdata_nsec3param_t nsec3param;
+
+			dns_rdataset_current(&rdataset, &rdata);
+			result = dns_rdata_tostruct(&rdata, &nsec3param, NULL);
+			INSIST(result == ISC_R_SUCCESS);
+			if ((nsec3param.hash != DNS_NSEC3_UNKNOWNALG &&
+			     !dns_nsec3_supportedhash(nsec3param.hash)) ||
+			    nsec3param.flags != 0)
+			{
+				continue;
+			}
+			b->nsec3param = nsec3param;
+			memmove(b->salt, nsec3param.salt,
+				nsec3param.salt_length);
+			havensec3 = true;
+			/*
+			 * Look for a better algorithm than the unknown
+			 * test algorithm.
+			 */
+			if (nsec3param.hash != DNS_NSEC3_UNKNOWNALG) {
+				break;
+			}
+		}
+		dns_rdataset_disassociate(&rdataset);
+	}
+
+	if (havensec3) {
+		b->flags |= IMAGE_NSEC3;
+	}
+	if (havensec3 || hasnsec) {
+		b->flags |= IMAGE_SECURE;
+	}
+
+detach:
+	dns_db_detachnode(b->db, &node);
+}
+
+static uint32_t
+build_buckets(uint32_t count) {
+	uint32_t buckets = 1;
+
+	while (buckets < 2 * (uint64_t)count) {
+		buckets <<= 1;
+	}
+
+	return (buckets);
+}
+
+static void
+build_puthash(imagebuild_t *b, isc_buffer_t *image, buildtree_t *tree,
+	      uint32_t buckets) {
+	unsigned char *table = (unsigned char *)isc_buffer_used(image);
+	unsigned char *names = isc_buffer_base(b->names);
+	uint32_t mask = buckets - 1;
+
+	memset(table, 0, (size_t)buckets * 4);
+	for (uint32_t n = 0; n < tree->count; n++) {
+		unsigned char *name = names + tree->nodes[n].name;
+		uint32_t i = hashname(name + 1, name[0]) & mask;
+
+		while (get32(table + (size_t)i * 4) != 0) {
+			i = (i + 1) & mask;
+		}
+		set32(table + (size_t)i * 4, n + 1);
+	}
+	isc_buffer_add(image, buckets * 4);
+}
+
+static void
+build_putnodes(isc_buffer_t *image, buildtree_t *tree, uint32_t namesoff,
+	       uint32_t dataoff) {
+	for (uint32_t n = 0; n < tree->count; n++) {
+		buildnode_t *node = &tree->nodes[n];
+
+		isc_buffer_putuint32(image, namesoff + node->name);
+		isc_buffer_putuint32(image,
+				     node->data == 0
+					     ? 0
+					     : dataoff + node->data - 1);
+		isc_buffer_putuint32(image, node->parent);
+		isc_buffer_putuint32(image, node->flags);
+	}
+}
+
+/*%
+ * Compile 'version' of 'db', or an empty zone if 'db' is NULL, into an
+ * image in a newly allocated buffer.
+ */
+static isc_result_t
+image_build(isc_mem_t *mctx, dns_db_t *db, dns_dbversion_t *version,
+	    isc_buffer_t **imagep) {
+	imagebuild_t b;
+	isc_buffer_t *image = NULL;
+	uint32_t buckets, nsec3buckets;
+	uint64_t nodesoff, nsec3off, hashoff, nsec3hashoff, namesoff, dataoff;
+	uint64_t length, crc;
+	unsigned char *p;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	memset(&b, 0, sizeof(b));
+	b.mctx = mctx;
+	b.db = db;
+	b.version = version;
+	isc_buffer_allocate(mctx, &b.names, 65536);
+	isc_buffer_setautorealloc(b.names, true);
+	isc_buffer_allocate(mctx, &b.data, 65536);
+	isc_buffer_setautorealloc(b.data, true);
+
+	if (db != NULL) {
+		result = build_addtree(&b, &b.tree, DNS_DB_NONSEC3);
+		if (result == ISC_R_SUCCESS) {
+			result = build_addtree(&b, &b.nsec3, DNS_DB_NSEC3ONLY);
+		}
+		if (result != ISC_R_SUCCESS) {
+			goto cleanup;
+		}
+		build_security(&b);
+	}
+
+	buckets = build_buckets(b.tree.count);
+	nsec3buckets = build_buckets(b.nsec3.count);
+	nodesoff = IMAGE_HEADERLEN;
+	nsec3off = nodesoff + (uint64_t)b.tree.count * NODE_SIZE;
+	hashoff = nsec3off + (uint64_t)b.nsec3.count * NODE_SIZE;
+	nsec3hashoff = hashoff + (uint64_t)buckets * 4;
+	namesoff = nsec3hashoff + (uint64_t)nsec3buckets * 4;
+	dataoff = namesoff + isc_buffer_usedlength(b.names);
+	length = dataoff + isc_buffer_usedlength(b.data);
+	if (length > UINT32_MAX) {
+		result = ISC_R_RANGE;
+		goto cleanup;
+	}
+
+	isc_buffer_allocate(mctx, &image, (unsigned int)length);
+
+	isc_buffer_putmem(image, (const unsigned char *)IMAGE_MAGIC,
+			  sizeof(IMAGE_MAGIC));
+	isc_buffer_putuint32(image, IMAGE_VERSION);
+	isc_buffer_putuint32(image, IMAGE_HEADERLEN);
+	isc_buffer_putuint32(image, (uint32_t)length);
+	isc_buffer_putuint32(image, b.flags);
+	isc_buffer_putuint32(image, (db != NULL) ? dns_db_class(db) : 0);
+	isc_buffer_putuint32(image, b.tree.count);
+	isc_buffer_putuint32(image, (uint32_t)nodesoff);
+	isc_buffer_putuint32(image, b.nsec3.count);
+	isc_buffer_putuint32(image, (uint32_t)nsec3off);
+	isc_buffer_putuint32(image, buckets);
+	isc_buffer_putuint32(image, (uint32_t)hashoff);
+	isc_buffer_putuint32(image, nsec3buckets);
+	isc_buffer_putuint32(image, (uint32_t)nsec3hashoff);
+	isc_buffer_putuint32(image, (uint32_t)(b.records >> 32));
+	isc_buffer_putuint32(image, (uint32_t)b.records);
+	isc_buffer_putuint32(image, (uint32_t)(b.xfrsize >> 32));
+	isc_buffer_putuint32(image, (uint32_t)b.xfrsize);
+	isc_buffer_putuint32(image, 0); /* CRC, filled in below */
+	isc_buffer_putuint32(image, 0);
+	isc_buffer_putuint8(image, b.nsec3param.hash);
+	isc_buffer_putuint8(image, b.nsec3param.flags);
+	isc_buffer_putuint16(image, b.nsec3param.iterations);
+	isc_buffer_putuint8(image, b.nsec3param.salt_length);
+	p = isc_buffer_used(image);
+	memset(p, 0, DNS_NSEC3_SALTSIZE);
+	memmove(p, b.salt, b.nsec3param.salt_length);
+	isc_buffer_add(image, DNS_NSEC3_SALTSIZE);
+	INSIST(isc_buffer_usedlength(image) == IMAGE_HEADERLEN);
+
+	build_putnodes(image, &b.tree, (uint32_t)namesoff, (uint32_t)dataoff);
+	build_putnodes(image, &b.nsec3, (uint32_t)namesoff,
+		       (uint32_t)dataoff);
+	build_puthash(&b, image, &b.tree, buckets);
+	build_puthash(&b, image, &b.nsec3, nsec3buckets);
+	isc_buffer_putmem(image, isc_buffer_base(b.names),
+			  isc_buffer_usedlength(b.names));
+	isc_buffer_putmem(image, isc_buffer_base(b.data),
+			  isc_buffer_usedlength(b.data));
+	INSIST(isc_buffer_usedlength(image) == length);
+
+	p = isc_buffer_base(image);
+	isc_crc64_init(&crc);
+	isc_crc64_update(&crc, p + IMAGE_HEADERLEN, length - IMAGE_HEADERLEN);
+	isc_crc64_final(&crc);
+	set32(p + HDR_CRC, (uint32_t)(crc >> 32));
+	set32(p + HDR_CRC + 4, (uint32_t)crc);
+
+	*imagep = image;
+
+cleanup:
+	if (b.tree.nodes != NULL) {
+		isc_mem_put(mctx, b.tree.nodes,
+			    b.tree.size * sizeof(b.tree.nodes[0]));
+	}
+	if (b.nsec3.nodes != NULL) {
+		isc_mem_put(mctx, b.nsec3.nodes,
+			    b.nsec3.size * sizeof(b.nsec3.nodes[0]));
+	}
+	isc_buffer_free(&b.names);
+	isc_buffer_free(&b.data);
+	return (result);
+}
+
+isc_result_t
+dns_imagedb_write(isc_mem_t *mctx, dns_db_t *db, dns_dbversion_t *version,
+		  FILE *f) {
+	imagedb_t *idb = (imagedb_t *)db;
+	isc_buffer_t *image = NULL;
+	isc_result_t result;
+
+	REQUIRE(DNS_DB_VALID(db));
+
+	/*
+	 * The image of an image database is written as it is.
+	 */
+	if (VALID_IMAGEDB(idb) && idb->image != NULL) {
+		return (isc_stdio_write(idb->image, 1, idb->length, f, NULL));
+	}
+
+	result = image_build(mctx, db, version, &image);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+	result = isc_stdio_write(isc_buffer_base(image), 1,
+				 isc_buffer_usedlength(image), f, NULL);
+	isc_buffer_free(&image);
+
+	return (result);
+}
+
+/*
+ * Image Loading
+ */
+
+/*%
+ * Check the integrity of the image of 'idb', which only has its
+ * header checked, and pass its rdatasets to 'callbacks'.
+ */
+static isc_result_t
+image_feed(isc_mem_t *mctx, imagedb_t *idb, dns_rdatacallbacks_t *callbacks) {
+	const unsigned char *image = idb->image;
+	size_t length = idb->length;
+	imagetree_t *trees[2] = { &idb->tree, &idb->nsec3 };
+	dns_rdata_t *rdatas = NULL;
+	unsigned int size = 0;
+	dns_decompress_t dctx;
+	uint64_t crc;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	isc_crc64_init(&crc);
+	isc_crc64_update(&crc, image + IMAGE_HEADERLEN,
+			 length - IMAGE_HEADERLEN);
+	isc_crc64_final(&crc);
+	if (crc != get64(image + HDR_CRC)) {
+		return (ISC_R_INVALIDFILE);
+	}
+
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_NONE);
+	for (unsigned int t = 0; t < 2; t++) {
+		for (uint32_t n = 0; n < trees[t]->count; n++) {
+			const unsigned char *node = nodeat(trees[t], n);
+			const unsigned char *entry, *end;
+			uint32_t offset = get32(node + NODE_NAME);
+			dns_fixedname_t fname;
+			dns_name_t *name = dns_fixedname_initname(&fname);
+			isc_buffer_t source;
+			unsigned int count;
+
+			if (offset >= length || offset + 1 + image[offset] >
+							length) {
+				result = ISC_R_INVALIDFILE;
+				goto cleanup;
+			}
+			isc_buffer_constinit(&source, image + offset + 1,
+					     image[offset]);
+			isc_buffer_add(&source, image[offset]);
+			isc_buffer_setactive(&source, image[offset]);
+			result = dns_name_fromwire(name, &source, &dctx, 0,
+						   NULL);
+			if (result != ISC_R_SUCCESS) {
+				result = ISC_R_INVALIDFILE;
+				goto cleanup;
+			}
+
+			offset = get32(node + NODE_DATA);
+			if (offset == 0) {
+				continue;
+			}
+			if (offset > length - 2) {
+				result = ISC_R_INVALIDFILE;
+				goto cleanup;
+			}
+			count = get16(image + offset);
+			entry = image + offset + 2;
+			end = image + length;
+			while (count-- > 0) {
+				dns_rdatalist_t rdatalist;
+				dns_rdataset_t rdataset;
+				const unsigned char *raw, *rawend;
+				unsigned int rcount;
+
+				if (end - entry < ENTRY_SIZE ||
+				    (uint64_t)(end - entry - ENTRY_SIZE) <
+					    get32(entry + ENTRY_LENGTH))
+				{
+					result = ISC_R_INVALIDFILE;
+					goto cleanup;
+				}
+				rcount = get16(entry + ENTRY_COUNT);
+				if (rcount > size) {
+					if (rdatas != NULL) {
+						isc_mem_put(mctx, rdatas,
+							    size * sizeof(*rdatas));
+					}
+					size = rcount;
+					rdatas = isc_mem_get(mctx,
+							     size * sizeof(*rdatas));
+				}
+
+				dns_rdatalist_init(&rdatalist);
+				rdatalist.rdclass = idb->common.rdclass;
+				rdatalist.type = get16(entry + ENTRY_TYPE);
+				rdatalist.covers = get16(entry + ENTRY_COVERS);
+				rdatalist.ttl = get32(entry + ENTRY_TTL);
+
+				raw = entry + ENTRY_SIZE;
+				rawend = nextentry(entry);
+				for (unsigned int i = 0; i < rcount; i++) {
+					isc_region_t r;
+
+					if (rawend - raw < 2 ||
+					    rawend - raw - 2 < get16(raw)) {
+						result = ISC_R_INVALIDFILE;
+						goto cleanup;
+					}
+					r.length = get16(raw);
+					DE_CONST(raw + 2, r.base);
+					raw += 2 + r.length;
+					dns_rdata_init(&rdatas[i]);
+					dns_rdata_fromregion(
+						&rdatas[i], rdatalist.rdclass,
+						rdatalist.type, &r);
+					ISC_LIST_APPEND(rdatalist.rdata,
+							&rdatas[i], link);
+				}
+				if (raw != rawend) {
+					result = ISC_R_INVALIDFILE;
+					goto cleanup;
+				}
+
+				dns_rdataset_init(&rdataset);
+				RUNTIME_CHECK(dns_rdatalist_tordataset(
+						      &rdatalist, &rdataset) ==
+					      ISC_R_SUCCESS);
+				rdataset.trust = entry[ENTRY_TRUST];
+				result = (*callbacks->add)(
+					callbacks->add_private, name,
+					&rdataset);
+				dns_rdataset_disassociate(&rdataset);
+				if (result != ISC_R_SUCCESS) {
+					goto cleanup;
+				}
+				entry = rawend;
+			}
+		}
+	}
+
+cleanup:
+	dns_decompress_invalidate(&dctx);
+	if (rdatas != NULL) {
+		isc_mem_put(mctx, rdatas, size * sizeof(rdatas[0]));
+	}
+	return (result);
+}
+
+isc_result_t
+dns_imagedb_load(isc_mem_t *mctx, FILE *f, off_t offset,
+		 dns_rdatacallbacks_t *callbacks) {
+	imagedb_t *idb = NULL, tmp;
+	off_t size = 0;
+	int flags = MAP_SHARED;
+	unsigned char *base;
+	isc_result_t result;
+
+	REQUIRE(DNS_CALLBACK_VALID(callbacks));
+
+	if (callbacks->add == image_add) {
+		idb = callbacks->add_private;
+		REQUIRE(VALID_IMAGEDB(idb));
+		if (idb->image != NULL || idb->loaddb != NULL) {
+			/* Something has been loaded already. */
+			idb = NULL;
+		}
+	}
+
+	result = isc_file_getsizefd(fileno(f), &size);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+	if (size <= offset) {
+		return (ISC_R_INVALIDFILE);
+	}
+
+#ifdef MAP_FILE
+	flags |= MAP_FILE;
+#endif /* ifdef MAP_FILE */
+	base = isc_file_mmap(NULL, (size_t)size, PROT_READ, flags, fileno(f),
+			     0);
+	if (base == NULL || base == MAP_FAILED) {
+		return (ISC_R_FAILURE);
+	}
+
+	if (idb != NULL) {
+		/*
+		 * Use the image as it is.
+		 */
+		result = setimage(idb, base + offset, (size_t)(size - offset));
+		if (result == ISC_R_SUCCESS && idb->tree.count > 0) {
+			dns_offsets_t offsets;
+			dns_name_t name;
+
+			dns_name_init(&name, offsets);
+			nodename(idb, idb->tree.nodes, &name);
+			if (!dns_name_equal(&name, &idb->common.origin)) {
+				result = DNS_R_NOTZONETOP;
+			}
+		}
+		if (result == ISC_R_SUCCESS) {
+			idb->map = base;
+			idb->maplength = (size_t)size;
+			return (ISC_R_SUCCESS);
+		}
+		idb->image = NULL;
+	} else {
+		/*
+		 * Use a temporary database structure to get at the
+		 * sections of the image.
+		 */
+		memset(&tmp, 0, sizeof(tmp));
+		tmp.common.rdclass = dns_rdataclass_in;
+		if (size - offset >= IMAGE_HEADERLEN) {
+			tmp.common.rdclass = get32(base + offset + HDR_CLASS);
+		}
+		result = setimage(&tmp, base + offset,
+				  (size_t)(size - offset));
+		if (result == ISC_R_SUCCESS) {
+			result = image_feed(mctx, &tmp, callbacks);
+		}
+	}
+
+	(void)isc_file_munmap(base, (size_t)size);
+	return (result);
+}
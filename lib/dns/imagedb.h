@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef DNS_IMAGEDB_H
+#define DNS_IMAGEDB_H 1
+
+#include <stdio.h>
+
+#include <isc/lang.h>
+
+#include <dns/types.h>
+
+/*****
+***** Module Info
+*****/
+
+/*! \file
+ * \brief
+ * Zone Image DB Implementation
+ *
+ * A database of type "image" is a read-only zone database that answers
+ * queries directly from a zone image: a versioned, position-independent
+ * layout of a whole zone in which every integer has a fixed size and
+ * byte order and every reference is an offset from the start of the
+ * image.  Zone files in the "image" master file format hold such an
+ * image after the usual raw format header; loading one into an "image"
+ * database maps the file read-only and uses it as it is, with no pass
+ * over its contents, so that processes mapping the same file share the
+ * memory it occupies.
+ *
+ * Data loaded into an "image" database by any other means (text or raw
+ * zone files, zone transfers) is compiled into an image in memory when
+ * the load ends.  An "image" database can't be changed once loaded.
+ */
+
+ISC_LANG_BEGINDECLS
+
+isc_result_t
+dns_imagedb_create(isc_mem_t *mctx, const dns_name_t *base, dns_dbtype_t type,
+		   dns_rdataclass_t rdclass, unsigned int argc, char *argv[],
+		   void *driverarg, dns_db_t **dbp);
+/*%<
+ * Create a new database of type "image".  Called via dns_db_create();
+ * see documentation for that function for more details.
+ *
+ * Returns:
+ *
+ * \li #ISC_R_SUCCESS
+ * \li #ISC_R_NOTIMPLEMENTED	'type' isn't dns_dbtype_zone.
+ */
+
+isc_result_t
+dns_imagedb_load(isc_mem_t *mctx, FILE *f, off_t offset,
+		 dns_rdatacallbacks_t *callbacks);
+/*%<
+ * Load the zone image found at 'offset' in 'f'.  If 'callbacks' were
+ * set up by dns_db_beginload() on an "image" database, the database
+ * takes over the image; otherwise the integrity of the image is checked
+ * and its rdatasets are passed to callbacks->add.
+ *
+ * Returns:
+ *
+ * \li #ISC_R_SUCCESS
+ * \li #ISC_R_INVALIDFILE	'f' doesn't hold a valid zone image.
+ * \li #ISC_R_NOTIMPLEMENTED	the image was written in a later version
+ *				of the format.
+ */
+
+isc_result_t
+dns_imagedb_write(isc_mem_t *mctx, dns_db_t *db, dns_dbversion_t *version,
+		  FILE *f);
+/*%<
+ * Write the zone image of 'version' of 'db', which may be a database of
+ * any type, to 'f'.
+ *
+ * Returns:
+ *
+ * \li #ISC_R_SUCCESS
+ * \li #ISC_R_RANGE		the zone is too large for an image.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_IMAGEDB_H */
@@ -564,6 +564,45 @@ dns_adb_agesrtt(dns_adb_t *adb, dns_adbaddrinfo_t *addr, isc_stdtime_t now);
  *	srtt value.  This may include changes made by others.
  */
 
+void
+dns_adb_samplertt(dns_adb_t *adb, dns_adbaddrinfo_t *addr, unsigned int rtt);
+/*%<
+ * Count a response that was received 'rtt' microseconds after its
+ * query was sent in the latency histogram of 'addr'.  A query that
+ * had no response after 'rtt' microseconds, because it timed out or
+ * another server answered it first, is counted the same way.
+ *
+ * Requires:
+ *
+ *\li	adb be valid.
+ *
+ *\li	addr be valid.
+ */
+
+isc_result_t
+dns_adb_getrttpercentile(dns_adb_t *adb, dns_adbaddrinfo_t *addr,
+			 unsigned int percent, unsigned int *rttp);
+/*%<
+ * Estimate from the latency histogram of 'addr' the round trip time,
+ * in microseconds, within which 'percent' percent of its responses
+ * arrive, and return it in '*rttp'.
+ *
+ * Requires:
+ *
+ *\li	adb be valid.
+ *
+ *\li	addr be valid.
+ *
+ *\li	0 < percent <= 100
+ *
+ *\li	rttp != NULL
+ *
+ * Returns:
+ *
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOTFOUND		not enough responses have been counted yet.
+ */
+
 void
 dns_adb_changeflags(dns_adb_t *adb, dns_adbaddrinfo_t *addr, unsigned int bits,
 		    unsigned int mask);
@@ -208,6 +208,65 @@ dns_cache_dump(dns_cache_t *cache);
  *  \li    Various failures depending on the database implementation type
  */
 
+isc_result_t
+dns_cache_setsnapshot(dns_cache_t *cache, const char *filename);
+/*%<
+ * If 'filename' is non-NULL, keep snapshots of the cache in the given
+ * file: the cache can be written to it with dns_cache_dumpsnapshot(),
+ * which also happens when the last reference to the cache goes away,
+ * and loaded from it with dns_cache_loadsnapshot().  If 'filename' is
+ * NULL, stop keeping snapshots.
+ *
+ * Snapshots are in a binary format which keeps the expiry times, trust
+ * levels and negative cache entries of the cached data, as well as data
+ * that has expired but may still be served stale.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ */
+
+isc_result_t
+dns_cache_dumpsnapshot(dns_cache_t *cache);
+/*%<
+ * If the cache has a snapshot file, write a snapshot of the cache to
+ * it, replacing the previous snapshot only once the new one has been
+ * written completely.  If no snapshot file has been set, do nothing and
+ * return success.
+ *
+ * MT:
+ *\li	The cache may be read and updated while the snapshot is being
+ *	written.  Updates performed meanwhile may or may not be reflected
+ *	in the snapshot.
+ *
+ * Returns:
+ *
+ *\li	#ISC_R_SUCCESS
+ *  \li    Various file-related failures
+ */
+
+isc_result_t
+dns_cache_loadsnapshot(dns_cache_t *cache);
+/*%<
+ * If the cache has a snapshot file, add the data in it to the cache.
+ * The time that has passed since the snapshot was written is taken off
+ * the TTLs of the data; data that has expired in the meantime is only
+ * added if it may still be served stale.  Previous cache contents are
+ * not discarded.  If no snapshot file has been set, do nothing and
+ * return success.
+ *
+ * This should be called after dns_cache_setservestalettl(), so that
+ * stale data is kept if it may be served.
+ *
+ * Returns:
+ *
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_FILENOTFOUND	there is no snapshot yet.
+ *\li	#ISC_R_INVALIDFILE	the file isn't a snapshot of a cache of
+ *				this class, or it has been damaged.
+ *\li	#ISC_R_UNEXPECTEDEND	the file has been truncated.
+ *  \li    Various other failures
+ */
+
 isc_result_t
 dns_cache_clean(dns_cache_t *cache, isc_stdtime_t now);
 /*%<
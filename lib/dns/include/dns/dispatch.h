@@ -223,6 +223,21 @@ dns_dispatchmgr_setstats(dns_dispatchmgr_t *mgr, isc_stats_t *stats);
  *	(see dns/stats.h).
  */
 
+void
+dns_dispatchmgr_setnetmgr(dns_dispatchmgr_t *mgr, isc_nm_t *nm);
+/*%<
+ * Use the network manager 'nm' for the sockets of UDP dispatches that
+ * are created from now on with the _EXCLUSIVE attribute.  Each
+ * transaction on such a dispatch gets a connected netmgr UDP socket,
+ * which is read and written by the network threads instead of the
+ * socket manager; queries must then be sent with dns_dispatch_send().
+ * Other dispatches still use the socket manager.
+ *
+ * Requires:
+ *\li	mgr is a valid dispatchmgr with no managed dispatch.
+ *\li	nm is a valid netmgr, which outlives 'mgr'.
+ */
+
 isc_result_t
 dns_dispatch_getudp(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 		    isc_taskmgr_t *taskmgr, const isc_sockaddr_t *localaddr,
@@ -411,6 +426,58 @@ dns_dispatch_removeresponse(dns_dispentry_t **	  resp,
 isc_socket_t *
 dns_dispatch_getentrysocket(dns_dispentry_t *resp);
 
+isc_nmhandle_t *
+dns_dispatch_getentryhandle(dns_dispentry_t *resp);
+/*%<
+ * Return the netmgr handle of the socket used by 'resp', if its dispatch
+ * uses the network manager (see dns_dispatchmgr_setnetmgr()), or NULL.
+ * The handle remains valid until dns_dispatch_removeresponse() is called.
+ *
+ * Requires:
+ *\li	resp is valid.
+ */
+
+void
+dns_dispatch_send(dns_dispentry_t *resp, isc_region_t *region,
+		  isc_task_t *task, isc_socketevent_t *sendevent);
+/*%<
+ * Send the message in 'region' to the peer of 'resp' over its netmgr
+ * socket.  When the send has completed, 'sendevent' is sent to 'task'
+ * with its result set, as isc_socket_sendto2() would.  'region' is not
+ * copied and must remain valid until then.  DSCP values set in
+ * 'sendevent' are ignored.
+ *
+ * Requires:
+ *\li	resp is valid, and dns_dispatch_getentryhandle(resp) is not NULL.
+ *\li	'sendevent' is an ISC_SOCKEVENT_SENDDONE event with its action set.
+ */
+
+bool
+dns_dispatch_coalesce(dns_dispentry_t *resp, const isc_region_t *query);
+/*%<
+ * Find out whether 'query', which is about to be sent for 'resp', can
+ * share the response to an identical query that was sent to the same
+ * server through the same dispatch and is still waiting for it.  The
+ * queries are compared as they are on the wire, apart from the message
+ * ID.
+ *
+ * If so, true is returned, and 'query' must not be sent: 'resp' is sent
+ * a copy of the first event for the other query, with its own message
+ * ID.  If the other query is removed before it gets an event, the
+ * dispatch sends the query for the first entry waiting for it, and the
+ * other entries wait for the response to that one instead.
+ *
+ * Otherwise false is returned, and 'query' must be sent: later identical
+ * queries can wait for its response until it gets its first event.
+ * Queries are only coalesced in exclusive UDP dispatches that use the
+ * network manager.
+ *
+ * Requires:
+ *\li	resp is valid, and dns_dispatch_coalesce() hasn't been called
+ *	for it yet.
+ *\li	'query' holds at least a DNS message header.
+ */
+
 isc_socket_t *
 dns_dispatch_getsocket(dns_dispatch_t *disp);
 /*%<
@@ -79,9 +79,10 @@ ISC_LANG_BEGINDECLS
 /* Common header */
 struct dns_masterrawheader {
 	uint32_t format;       /* must be
-				* dns_masterformat_raw
+				* dns_masterformat_raw,
+				* dns_masterformat_map
 				* or
-				* dns_masterformat_map */
+				* dns_masterformat_image */
 	uint32_t version;      /* compatibility for future
 				* extensions */
 	uint32_t dumptime;     /* timestamp on creation
@@ -220,6 +221,70 @@ dns_master_loadlexerinc(isc_lex_t *lex, dns_name_t *top, dns_name_t *origin,
  *\li	Any error code from callbacks->commit().
  */
 
+isc_result_t
+dns_master_loadfileparallel(const char *master_file, dns_name_t *top,
+			    dns_name_t *origin, dns_rdataclass_t zclass,
+			    unsigned int options, uint32_t resign,
+			    dns_rdatacallbacks_t *callbacks, isc_task_t *task,
+			    dns_loaddonefunc_t done, void *done_arg,
+			    dns_loadctx_t **ctxp,
+			    dns_masterincludecb_t include_cb, void *include_arg,
+			    isc_mem_t *mctx, uint32_t maxttl,
+			    dns_loadpool_t *pool, unsigned int nthreads);
+/*%<
+ * Load a text master file like dns_master_loadfile() if 'task' is NULL,
+ * or like dns_master_loadfileinc() otherwise, using up to 'nthreads'
+ * threads of 'pool'.  If 'task' is NULL, the caller is one of these
+ * threads.
+ *
+ * The file is split into parts at lines that start with an owner name,
+ * which are parsed in parallel.  'callbacks->add' is never called by more
+ * than one thread at a time, but it may be called from threads other than
+ * the caller's or the task's, and rdatasets are not added in the order
+ * they appear in the file.  An rdataset may be added in more than one
+ * part if its records are not next to each other in the file.
+ *
+ * Files that are too small to be worth splitting, and files that can't
+ * be split because they contain $INCLUDE or $DATE directives or have no
+ * default TTL, are loaded by a single thread.
+ *
+ * Requires:
+ *\li	As for dns_master_loadfile() or dns_master_loadfileinc().
+ *\li	'pool' is a valid load pool.
+ *\li	'nthreads' is greater than zero.
+ *
+ * Returns:
+ *\li	As for dns_master_loadfile() or dns_master_loadfileinc().
+ */
+
+void
+dns_loadpool_create(isc_mem_t *mctx, unsigned int nthreads,
+		    dns_loadpool_t **poolp);
+/*%<
+ * Create a pool of 'nthreads' threads for dns_master_loadfileparallel().
+ * However many files are loaded in parallel at the same time, no more
+ * than 'nthreads' threads load them, besides the callers of loads that
+ * are not incremental.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	'nthreads' is greater than zero.
+ *\li	'poolp' is not NULL and '*poolp' is NULL.
+ */
+
+void
+dns_loadpool_destroy(dns_loadpool_t **poolp);
+/*%<
+ * Wait for the loads that use the pool to finish their work in it, and
+ * destroy it.
+ *
+ * Requires:
+ *\li	'*poolp' is a valid load pool.
+ *
+ * Ensures:
+ *\li	'*poolp' is NULL.
+ */
+
 void
 dns_loadctx_detach(dns_loadctx_t **ctxp);
 /*%<
@@ -42,6 +42,21 @@ ISC_LANG_BEGINDECLS
 
 #define DNS_RBT_LOCKLENGTH (sizeof(((dns_rbtnode_t *)0)->locknum) * 8)
 
+/*%
+ * The members of dns_rbtnode_t that dns_rbt_findnode() reads on its way
+ * down the tree lie within the first DNS_RBTNODE_HOTSIZE bytes of the
+ * node.  Nodes are allocated with isc_mem_get(), which doesn't align
+ * them to cache lines, so these members span at most two cache lines
+ * (one if the node happens to start on a cache line boundary).
+ */
+#define DNS_RBTNODE_HOTSIZE 64
+
+/*%
+ * The largest shard number a node can be tagged with; see
+ * dns_rbt_setshard().
+ */
+#define DNS_RBT_SHARD_MAX 255
+
 #define DNS_RBTNODE_MAGIC ISC_MAGIC('R', 'B', 'N', 'O')
 #if DNS_RBT_USEMAGIC
 #define DNS_RBTNODE_VALID(n) ISC_MAGIC_VALID(n, DNS_RBTNODE_MAGIC)
@@ -114,7 +129,10 @@ struct dns_rbtnode {
 
 	/* node needs to be cleaned from rpz */
 	unsigned int rpz : 1;
-	unsigned int : 0; /* end of bitfields c/o tree lock */
+
+	/* the shard of a sharded cache the node's tree belongs to */
+	unsigned int shard : 8; /*%< range is 0..DNS_RBT_SHARD_MAX */
+	unsigned int : 0;	/* end of bitfields c/o tree lock */
 
 	/*%
 	 * These are needed for hashing. The 'uppernode' points to the
@@ -122,13 +140,26 @@ struct dns_rbtnode {
 	 * be reached from a child that was found by a hash lookup.
 	 */
 	unsigned int   hashval;
-	dns_rbtnode_t *uppernode;
 	dns_rbtnode_t *hashnext;
+	dns_rbtnode_t *uppernode;
 
+	/*%
+	 * The members above and these, i.e. everything that
+	 * dns_rbt_findnode() looks at on the way down, come first so that
+	 * they are close together; see DNS_RBTNODE_HOTSIZE.  'data' is
+	 * only compared with NULL here, the data itself is protected by
+	 * the node lock (see below).
+	 */
+	dns_rbtnode_t *down;
+	void *data;
 	dns_rbtnode_t *parent;
+
+	/*
+	 * The rest is only used when the tree is changed or walked, or
+	 * by the RBT DB implementation.
+	 */
 	dns_rbtnode_t *left;
 	dns_rbtnode_t *right;
-	dns_rbtnode_t *down;
 
 	/*%
 	 * Used for LRU cache.  This linked list is used to mark nodes which
@@ -155,7 +186,6 @@ struct dns_rbtnode {
 	 * members. Leave these members here so that they occupy a
 	 * separate region of memory.
 	 */
-	void *data;
 	uint8_t : 0; /* start of bitfields c/o node lock */
 	uint8_t dirty : 1;
 	uint8_t wild : 1;
@@ -695,6 +725,61 @@ dns_rbt_adjusthashsize(dns_rbt_t *rbt, size_t size);
  * \li  size is expected maximum memory footprint of rbt.
  */
 
+bool
+dns_rbt_rehashing(dns_rbt_t *rbt);
+/*%<
+ * Return true if the 'rbt' hash table is being grown, that is, if
+ * lookups have to check both the old and the new table until all the
+ * old buckets have been moved over.
+ *
+ * Requires:
+ * \li  rbt is a valid rbt manager.
+ */
+
+void
+dns_rbt_rehashfinish(dns_rbt_t *rbt);
+/*%<
+ * Move all the remaining buckets of the old hash table of 'rbt' to the
+ * new one, if it is being grown.  The buckets are otherwise only moved
+ * as the tree is modified, so this should be called when a tree is
+ * not going to change for a while, such as after a zone was loaded.
+ *
+ * Requires:
+ * \li  rbt is a valid rbt manager.
+ *
+ * Ensures:
+ * \li  dns_rbt_rehashing(rbt) is false.
+ */
+
+void
+dns_rbt_setstats(dns_rbt_t *rbt, isc_stats_t *stats);
+/*%<
+ * Have 'rbt' keep its hash table statistics in 'stats', a set of cache
+ * statistics counters: dns_cachestatscounter_rehashing counts hash
+ * table rehashes in progress, and dns_cachestatscounter_rehashstall*
+ * count the times the tree was held up by rehashing, by how long it
+ * took.
+ *
+ * Requires:
+ * \li  rbt is a valid rbt manager.
+ * \li  stats is a valid statistics set with dns_cachestatscounter_max
+ *      counters.
+ * \li  no statistics have been set for rbt yet.
+ */
+
+void
+dns_rbt_setshard(dns_rbt_t *rbt, unsigned int shard);
+/*%<
+ * Tag every node subsequently created in 'rbt' with 'shard', so that
+ * a database made of several trees can tell which one a node belongs
+ * to from the node alone (see dns_rbtnode_t.shard).
+ *
+ * Requires:
+ * \li  rbt is a valid rbt manager.
+ * \li  rbt is empty.
+ * \li  shard <= DNS_RBT_SHARD_MAX.
+ */
+
 void
 dns_rbt_destroy(dns_rbt_t **rbtp);
 isc_result_t
@@ -704,6 +704,21 @@ dns_resolver_getmaxqueries(dns_resolver_t *resolver);
  * \li	resolver to be valid.
  */
 
+void
+dns_resolver_sethedgebudget(dns_resolver_t *resolver, unsigned int percent);
+unsigned int
+dns_resolver_gethedgebudget(dns_resolver_t *resolver);
+/*%
+ * Get and set the percentage of the queries sent that may be hedged:
+ * sent to the next server when the first server has not responded in
+ * the time it takes to send 95% of its responses.  Zero, the default,
+ * disables hedging.
+ *
+ * Requires:
+ * \li	resolver to be valid.
+ * \li	percent <= 100.
+ */
+
 void
 dns_resolver_setquotaresponse(dns_resolver_t *resolver, dns_quotatype_t which,
 			      isc_result_t resp);
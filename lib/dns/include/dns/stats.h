@@ -70,7 +70,12 @@ enum {
 	dns_resstatscounter_serverquota = 42,
 	dns_resstatscounter_nextitem = 43,
 	dns_resstatscounter_priming = 44,
-	dns_resstatscounter_max = 45,
+	dns_resstatscounter_coalesced = 45,
+	dns_resstatscounter_bucketwait = 46,
+	dns_resstatscounter_zonebucketwait = 47,
+	dns_resstatscounter_bucketresize = 48,
+	dns_resstatscounter_hedged = 49,
+	dns_resstatscounter_max = 50,
 
 	/*
 	 * DNSSEC stats.
@@ -101,6 +106,18 @@ enum {
 
 	dns_zonestatscounter_max = 13,
 
+	/*%
+	 * Zone loading progress, from dns_zonemgr_getloadprogress().
+	 */
+	dns_zoneloadstatscounter_queued = 0,
+	dns_zoneloadstatscounter_loaded = 1,
+	dns_zoneloadstatscounter_failed = 2,
+	dns_zoneloadstatscounter_elapsed = 3,
+	dns_zoneloadstatscounter_rate = 4,
+	dns_zoneloadstatscounter_eta = 5,
+
+	dns_zoneloadstatscounter_max = 6,
+
 	/*
 	 * Adb statistics values.
 	 */
@@ -120,8 +137,16 @@ enum {
 	dns_cachestatscounter_querymisses = 4,
 	dns_cachestatscounter_deletelru = 5,
 	dns_cachestatscounter_deletettl = 6,
-
-	dns_cachestatscounter_max = 7,
+	dns_cachestatscounter_rehashing = 7,
+	dns_cachestatscounter_rehashstall10us = 8,
+	dns_cachestatscounter_rehashstall100us = 9,
+	dns_cachestatscounter_rehashstall1ms = 10,
+	dns_cachestatscounter_rehashstall10ms = 11,
+	dns_cachestatscounter_rehashstallmax = 12,
+	dns_cachestatscounter_evictscanned = 13,
+	dns_cachestatscounter_evictspared = 14,
+
+	dns_cachestatscounter_max = 15,
 
 	/*%
 	 * Query statistics counters (obsolete).
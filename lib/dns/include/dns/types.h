@@ -101,6 +101,7 @@ typedef struct dns_keytable	   dns_keytable_t;
 typedef uint16_t		   dns_keytag_t;
 typedef struct dns_loadctx	   dns_loadctx_t;
 typedef struct dns_loadmgr	   dns_loadmgr_t;
+typedef struct dns_loadpool	   dns_loadpool_t;
 typedef struct dns_masterrawheader dns_masterrawheader_t;
 typedef uint64_t		   dns_masterstyle_flags_t;
 typedef struct dns_message	   dns_message_t;
@@ -207,7 +208,8 @@ typedef enum {
 	dns_masterformat_none = 0,
 	dns_masterformat_text = 1,
 	dns_masterformat_raw = 2,
-	dns_masterformat_map = 3
+	dns_masterformat_map = 3,
+	dns_masterformat_image = 4
 } dns_masterformat_t;
 
 /*
@@ -155,6 +155,7 @@ struct dns_view {
 	dns_ttl_t	      maxncachettl;
 	dns_ttl_t	      mincachettl;
 	dns_ttl_t	      minncachettl;
+	unsigned int	      cacheshards;
 	uint32_t	      nta_lifetime;
 	uint32_t	      nta_recheck;
 	char *		      nta_file;
@@ -130,6 +130,19 @@ typedef enum {
 #define DNS_ZONESTATE_ANY	   4
 #define DNS_ZONESTATE_AUTOMATIC	   5
 
+/*%
+ * Progress of the zone loads queued with dns_zone_asyncload() since the
+ * zone manager last had no loads queued or running.
+ */
+typedef struct dns_zoneloadprogress {
+	uint64_t queued;  /*%< loads queued */
+	uint64_t loaded;  /*%< loads finished, including failed ones */
+	uint64_t failed;  /*%< loads that failed */
+	uint64_t elapsed; /*%< microseconds from the first load being
+			   *   queued to the last one finishing, or to
+			   *   now if loads are still running */
+} dns_zoneloadprogress_t;
+
 ISC_LANG_BEGINDECLS
 
 /***
@@ -339,6 +352,28 @@ dns_zone_getmaxrecords(dns_zone_t *zone);
  *\li	uint32_t maxrecords.
  */
 
+void
+dns_zone_setloadthreads(dns_zone_t *zone, unsigned int nthreads);
+/*%<
+ * 	Sets the number of threads used to load the zone from a text
+ *	master file.  The threads are taken from the load pool of the
+ *	zone's manager (see dns_zonemgr_setloadpool()).  The default is 1.
+ *
+ * Requires:
+ *\li	'zone' to be valid initialised zone.
+ *\li	'nthreads' is greater than zero.
+ */
+
+unsigned int
+dns_zone_getloadthreads(dns_zone_t *zone);
+/*%<
+ * 	Gets the number of threads used to load the zone from a text
+ *	master file.
+ *
+ * Requires:
+ *\li	'zone' to be valid initialised zone.
+ */
+
 void
 dns_zone_setmaxttl(dns_zone_t *zone, uint32_t maxttl);
 /*%<
@@ -509,6 +544,22 @@ dns_zone_setdb(dns_zone_t *zone, dns_db_t *db);
  *\li	zone doesn't have a database.
  */
 
+uint64_t
+dns_zone_getdbgeneration(dns_zone_t *zone);
+/*%<
+ *	Returns the generation number of the zone's data.  It changes
+ *	whenever a database is attached to or detached from the zone, and
+ *	whenever a new version of the zone's database is committed; no
+ *	two zones ever share a generation number.
+ *
+ *	Data derived from the zone's database is still current if the
+ *	generation number, obtained before the database version the data
+ *	came from was opened, hasn't changed since.
+ *
+ * Require:
+ *\li	'zone' to be a valid zone.
+ */
+
 void
 dns_zone_setdbtype(dns_zone_t *zone, unsigned int dbargc,
 		   const char *const *dbargv);
@@ -1801,6 +1852,60 @@ dns_zonemgr_getiolimit(dns_zonemgr_t *zmgr);
  *\li	'zmgr' to be a valid zone manager.
  */
 
+void
+dns_zonemgr_setloaders(dns_zonemgr_t *zmgr, unsigned int nloaders);
+/*%<
+ *	Set the number of threads that load the zones queued with
+ *	dns_zone_asyncload().  While a thread loads a zone, it asks the
+ *	operating system to prefetch the files of the zones queued after
+ *	it.  If 'nloaders' is zero, which is the default, zones are loaded
+ *	in their load tasks, and loads that are still queued are handed
+ *	to them.
+ *
+ *	Changing the number of threads waits for the loads that are
+ *	running to finish.  dns_zonemgr_shutdown() stops the threads and
+ *	cancels the loads that are still queued.
+ *
+ * Requires:
+ *\li	'zmgr' to be a valid zone manager.
+ */
+
+unsigned int
+dns_zonemgr_getloaders(dns_zonemgr_t *zmgr);
+/*%<
+ *	Get the number of threads that load zones.
+ *
+ * Requires:
+ *\li	'zmgr' to be a valid zone manager.
+ */
+
+void
+dns_zonemgr_setloadpool(dns_zonemgr_t *zmgr, unsigned int nthreads);
+/*%<
+ *	Set the number of threads in the pool that all the zones managed
+ *	by 'zmgr' share to load the parts of large text zone files in
+ *	parallel (see dns_zone_setloadthreads()).  The threads are
+ *	started when a zone is first loaded in parallel.  If 'nthreads'
+ *	is zero, which is the default, zone files are loaded by a single
+ *	thread.
+ *
+ * Requires:
+ *\li	'zmgr' to be a valid zone manager.
+ *\li	No zone has been loaded in parallel yet.
+ */
+
+void
+dns_zonemgr_getloadprogress(dns_zonemgr_t *zmgr,
+			    dns_zoneloadprogress_t *progress);
+/*%<
+ *	Fill in '*progress' with the progress of the zone loads queued
+ *	with dns_zone_asyncload().
+ *
+ * Requires:
+ *\li	'zmgr' to be a valid zone manager.
+ *\li	'progress' is not NULL.
+ */
+
 void
 dns_zonemgr_setnotifyrate(dns_zonemgr_t *zmgr, unsigned int value);
 /*%<
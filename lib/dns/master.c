@@ -14,11 +14,22 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#ifndef WIN32
+#include <sys/mman.h>
+#else /* ifndef WIN32 */
+#define PROT_READ   0x01
+#define MAP_PRIVATE 0x0002
+#define MAP_FAILED  ((void *)-1)
+#endif /* ifndef WIN32 */
+
 #include <isc/atomic.h>
+#include <isc/condition.h>
 #include <isc/event.h>
+#include <isc/file.h>
 #include <isc/lex.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
+#include <isc/mutex.h>
 #include <isc/print.h>
 #include <isc/refcount.h>
 #include <isc/serial.h>
@@ -26,6 +37,7 @@
 #include <isc/stdtime.h>
 #include <isc/string.h>
 #include <isc/task.h>
+#include <isc/thread.h>
 #include <isc/util.h>
 
 #include <dns/callbacks.h>
@@ -44,6 +56,8 @@
 #include <dns/time.h>
 #include <dns/ttl.h>
 
+#include "imagedb.h"
+
 /*!
  * Grow the number of dns_rdatalist_t (#RDLSZ) and dns_rdata_t (#RDSZ)
  * structures by these sizes when we need to.
@@ -88,10 +102,83 @@
 
 #define CHECKNAMESFAIL(x) (((x)&DNS_MASTER_CHECKNAMESFAIL) != 0)
 
+/*%
+ * Files are only split for a parallel load into parts of at least this
+ * size; smaller files are loaded by a single thread.
+ */
+#define PAR_MINCHUNK (64 * 1024)
+
+/*%
+ * The number of parts per thread that files are split into, so that
+ * threads that get parts that are quick to load can take more of them.
+ */
+#define PAR_CHUNKSPERTHREAD 4
+
 typedef ISC_LIST(dns_rdatalist_t) rdatalist_head_t;
 
 typedef struct dns_incctx dns_incctx_t;
 
+/*%
+ * A part of a text master file that is loaded by a single thread during
+ * a parallel load, and the state that loading it starts with.
+ */
+typedef struct loadchunk {
+	size_t start;
+	size_t end;
+	unsigned long line;
+	dns_fixedname_t origin;
+	bool ttl_known;
+	uint32_t ttl;
+	isc_result_t result;
+} loadchunk_t;
+
+/*%
+ * Parallel load state.
+ */
+typedef struct loadpar {
+	char *master_file;
+	void *map;
+	size_t maplength;
+	loadchunk_t *chunks;
+	unsigned int nchunks;
+	unsigned int maxchunks;
+	dns_loadpool_t *pool;
+	unsigned int nthreads;
+	atomic_uint_fast32_t next; /*%< next chunk to load */
+	atomic_bool failed;
+	isc_mutex_t lock; /*%< serializes calls to 'callbacks->add' */
+	isc_condition_t done;
+	unsigned int running; /*%< threads still loading; locked by 'lock' */
+	dns_rdatacallbacks_t callbacks;
+} loadpar_t;
+
+/*%
+ * A request for a thread of a load pool to load parts of the file of
+ * 'lctx'.
+ */
+typedef struct loadjob loadjob_t;
+struct loadjob {
+	dns_loadctx_t *lctx;
+	ISC_LINK(loadjob_t) link;
+};
+
+#define LOADPOOL_MAGIC	      ISC_MAGIC('L', 'd', 'P', 'l')
+#define DNS_LOADPOOL_VALID(p) ISC_MAGIC_VALID(p, LOADPOOL_MAGIC)
+
+/*%
+ * Threads shared by parallel loads.
+ */
+struct dns_loadpool {
+	unsigned int magic;
+	isc_mem_t *mctx;
+	isc_mutex_t lock;
+	isc_condition_t cond;
+	ISC_LIST(loadjob_t) jobs;
+	bool exiting;
+	isc_thread_t *threads;
+	unsigned int nthreads;
+};
+
 /*%
  * Master file load state.
  */
@@ -150,6 +237,9 @@ struct dns_loadctx {
 
 	dns_masterincludecb_t include_cb;
 	void *include_arg;
+
+	/* Parallel load state, if the file is loaded in parallel */
+	loadpar_t *par;
 };
 
 struct dns_incctx {
@@ -191,6 +281,9 @@ openfile_map(dns_loadctx_t *lctx, const char *master_file);
 static isc_result_t
 load_map(dns_loadctx_t *lctx);
 
+static isc_result_t
+load_image(dns_loadctx_t *lctx);
+
 static isc_result_t
 pushfile(const char *master_file, dns_name_t *origin, dns_loadctx_t *lctx);
 
@@ -218,6 +311,9 @@ task_send(dns_loadctx_t *lctx);
 static void
 loadctx_destroy(dns_loadctx_t *lctx);
 
+static void
+loadpar_destroy(dns_loadctx_t *lctx);
+
 #define GETTOKENERR(lexer, options, token, eol, err)                      \
 	do {                                                              \
 		result = gettoken(lexer, options, token, eol, callbacks); \
@@ -464,6 +560,10 @@ loadctx_destroy(dns_loadctx_t *lctx) {
 		isc_task_detach(&lctx->task);
 	}
 
+	if (lctx->par != NULL) {
+		loadpar_destroy(lctx);
+	}
+
 	isc_mem_putanddetach(&lctx->mctx, lctx, sizeof(*lctx));
 }
 
@@ -547,6 +647,10 @@ loadctx_create(dns_masterformat_t format, isc_mem_t *mctx, unsigned int options,
 		lctx->openfile = openfile_map;
 		lctx->load = load_map;
 		break;
+	case dns_masterformat_image:
+		lctx->openfile = openfile_map;
+		lctx->load = load_image;
+		break;
 	default:
 		INSIST(0);
 		ISC_UNREACHABLE();
@@ -589,6 +693,7 @@ loadctx_create(dns_masterformat_t format, isc_mem_t *mctx, unsigned int options,
 	lctx->result = ISC_R_SUCCESS;
 	lctx->include_cb = include_cb;
 	lctx->include_arg = include_arg;
+	lctx->par = NULL;
 	isc_stdtime_get(&lctx->now);
 
 	lctx->top = dns_fixedname_initname(&lctx->fixed_top);
@@ -2252,7 +2357,8 @@ load_header(dns_loadctx_t *lctx) {
 	REQUIRE(DNS_LCTX_VALID(lctx));
 
 	if (lctx->format != dns_masterformat_raw &&
-	    lctx->format != dns_masterformat_map)
+	    lctx->format != dns_masterformat_map &&
+	    lctx->format != dns_masterformat_image)
 	{
 		return (ISC_R_NOTIMPLEMENTED);
 	}
@@ -2277,9 +2383,11 @@ load_header(dns_loadctx_t *lctx) {
 		(*callbacks->error)(callbacks,
 				    "dns_master_load: "
 				    "file format mismatch (not %s)",
-				    lctx->format == dns_masterformat_map ? "map"
-									 : "ra"
-									   "w");
+				    lctx->format == dns_masterformat_map
+					    ? "map"
+					    : lctx->format == dns_masterformat_image
+						      ? "image"
+						      : "raw");
 		return (ISC_R_NOTIMPLEMENTED);
 	}
 
@@ -2361,6 +2469,44 @@ load_map(dns_loadctx_t *lctx) {
 	return (result);
 }
 
+/*
+ * Load an image format file; an "image" database maps the image and
+ * answers queries from it, any other database is fed its rdatasets.
+ */
+static isc_result_t
+load_image(dns_loadctx_t *lctx) {
+	isc_result_t result = ISC_R_SUCCESS;
+	dns_rdatacallbacks_t *callbacks;
+
+	REQUIRE(DNS_LCTX_VALID(lctx));
+
+	callbacks = lctx->callbacks;
+
+	if (lctx->first) {
+		result = load_header(lctx);
+		if (result != ISC_R_SUCCESS) {
+			return (result);
+		}
+
+		result = dns_imagedb_load(lctx->mctx, lctx->f,
+					  sizeof(dns_masterrawheader_t),
+					  callbacks);
+		if (result != ISC_R_SUCCESS) {
+			(*callbacks->error)(callbacks,
+					    "dns_master_load: "
+					    "can't load zone image: %s",
+					    isc_result_totext(result));
+			return (result);
+		}
+
+		if (callbacks->rawdata != NULL) {
+			(*callbacks->rawdata)(callbacks->zone, &lctx->header);
+		}
+	}
+
+	return (result);
+}
+
 static isc_result_t
 openfile_raw(dns_loadctx_t *lctx, const char *master_file) {
 	isc_result_t result;
@@ -2936,6 +3082,652 @@ dns_master_loadlexerinc(isc_lex_t *lex, dns_name_t *top, dns_name_t *origin,
 	return (result);
 }
 
+/*
+ * Parallel loading of text master files.
+ *
+ * The file is mapped into memory and scanned once to find the places
+ * where it can be split: lines that start with an owner name, outside
+ * of parentheses.  The scan tracks $ORIGIN and $TTL so that each part
+ * can be loaded with the origin and default TTL in effect where it
+ * starts.  The parts are then loaded by load_text() in a number of
+ * threads, each with its own load context and lexer, and the rdatasets
+ * are added to the database one at a time.  The threads are those of a
+ * load pool shared by all parallel loads, so that loading many large
+ * files at once does not start more threads than the pool has; the
+ * caller of a load that is not incremental loads parts too while it
+ * waits.
+ *
+ * Files that use $INCLUDE or $DATE, or that have no default TTL where
+ * they would be split, are loaded by a single thread.
+ */
+
+static void
+loadpar_destroy(dns_loadctx_t *lctx) {
+	loadpar_t *par = lctx->par;
+
+	lctx->par = NULL;
+
+	if (par->chunks != NULL) {
+		isc_mem_put(lctx->mctx, par->chunks,
+			    par->maxchunks * sizeof(loadchunk_t));
+	}
+	if (par->map != NULL) {
+		(void)isc_file_munmap(par->map, par->maplength);
+	}
+	(void)isc_condition_destroy(&par->done);
+	isc_mutex_destroy(&par->lock);
+	isc_mem_free(lctx->mctx, par->master_file);
+	isc_mem_put(lctx->mctx, par, sizeof(*par));
+}
+
+/*
+ * Return the length of the word that starts at 'p' and ends before white
+ * space, a special character or 'end'.
+ */
+static size_t
+scan_word(const unsigned char *p, const unsigned char *end) {
+	const unsigned char *start = p;
+
+	while (p < end) {
+		if (*p == '\\' && p + 1 < end && p[1] != '\n') {
+			p += 2;
+			continue;
+		}
+		if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' ||
+		    *p == ';' || *p == '(' || *p == ')' || *p == '"')
+		{
+			break;
+		}
+		p++;
+	}
+
+	return (p - start);
+}
+
+/*
+ * Return the argument of the directive that starts at 'p', which is
+ * 'len' bytes long, and its length in '*arglenp'.
+ */
+static const unsigned char *
+scan_argument(const unsigned char *p, size_t len, const unsigned char *end,
+	      size_t *arglenp) {
+	p += len;
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	*arglenp = scan_word(p, end);
+	return (p);
+}
+
+static bool
+is_directive(const unsigned char *p, size_t len, const char *directive) {
+	return (len == strlen(directive) &&
+		strncasecmp((const char *)p, directive, len) == 0);
+}
+
+/*
+ * Move '*pp' past the end of the line, counting parentheses in
+ * '*depthp' and lines in '*linep'.  Return false if the parentheses or
+ * the quotes in the line are unbalanced.
+ */
+static bool
+skip_line(const unsigned char **pp, const unsigned char *end, int *depthp,
+	  unsigned long *linep) {
+	const unsigned char *p = *pp;
+	bool quoted = false;
+
+	while (p < end) {
+		switch (*p) {
+		case '\\':
+			if (p + 1 < end && p[1] == '\n') {
+				(*linep)++;
+			}
+			p++;
+			break;
+		case '"':
+			quoted = !quoted;
+			break;
+		case ';':
+			if (!quoted) {
+				p = memchr(p, '\n', end - p);
+				if (p == NULL) {
+					p = end;
+				}
+				continue;
+			}
+			break;
+		case '(':
+			if (!quoted) {
+				(*depthp)++;
+			}
+			break;
+		case ')':
+			if (!quoted && --(*depthp) < 0) {
+				return (false);
+			}
+			break;
+		case '\n':
+			(*linep)++;
+			*pp = p + 1;
+			return (!quoted);
+		}
+		p++;
+	}
+
+	*pp = end;
+	return (!quoted);
+}
+
+/*
+ * Split the mapped file into at most 'nchunks' parts.  Return false if
+ * it can't be split.
+ */
+static bool
+loadpar_split(dns_loadctx_t *lctx, unsigned int nchunks) {
+	loadpar_t *par = lctx->par;
+	const unsigned char *base = par->map;
+	const unsigned char *end = base + par->maplength;
+	const unsigned char *p = base;
+	const unsigned char *owner = NULL, *arg;
+	size_t ownerlen = 0, len, arglen;
+	size_t chunksize = par->maplength / nchunks;
+	size_t next = chunksize;
+	unsigned long line = 1;
+	int depth = 0;
+	bool ttl_known = lctx->default_ttl_known;
+	uint32_t ttl = 0;
+	dns_fixedname_t forigin, fname;
+	dns_name_t *origin, *name;
+	loadchunk_t *chunk;
+	isc_textregion_t tr;
+	isc_buffer_t b;
+	isc_result_t result;
+
+	origin = dns_fixedname_initname(&forigin);
+	name = dns_fixedname_initname(&fname);
+	dns_name_copynf(lctx->inc->origin, origin);
+
+	par->chunks = isc_mem_get(lctx->mctx, nchunks * sizeof(loadchunk_t));
+	par->maxchunks = nchunks;
+	memset(par->chunks, 0, nchunks * sizeof(loadchunk_t));
+
+	chunk = &par->chunks[0];
+	chunk->line = 1;
+	dns_name_copynf(origin, dns_fixedname_initname(&chunk->origin));
+	chunk->ttl_known = ttl_known;
+
+	while (p < end) {
+		/*
+		 * 'p' is at the start of a line.
+		 */
+		if (depth == 0 && *p == '$') {
+			len = scan_word(p, end);
+			arg = scan_argument(p, len, end, &arglen);
+			if (is_directive(p, len, "$TTL")) {
+				tr.base = (char *)(uintptr_t)arg;
+				tr.length = arglen;
+				result = dns_ttl_fromtext(&tr, &ttl);
+				if (result != ISC_R_SUCCESS) {
+					return (false);
+				}
+				if (ttl > 0x7fffffffUL) {
+					ttl = 0;
+				}
+				ttl_known = true;
+			} else if (is_directive(p, len, "$ORIGIN")) {
+				isc_buffer_constinit(&b, arg, arglen);
+				isc_buffer_add(&b, arglen);
+				result = dns_name_fromtext(name, &b, origin, 0,
+							   NULL);
+				if (result != ISC_R_SUCCESS) {
+					return (false);
+				}
+				dns_name_copynf(name, origin);
+			} else if (!is_directive(p, len, "$GENERATE")) {
+				/*
+				 * $INCLUDE and $DATE affect how the rest of
+				 * the file is loaded in ways that can't be
+				 * passed on to the threads.
+				 */
+				return (false);
+			}
+		} else if (depth == 0 && *p != ' ' && *p != '\t' && *p != '\r' &&
+			   *p != '\n' && *p != ';' && *p != '(' && *p != '"')
+		{
+			/*
+			 * A line with an owner name.  Split here unless
+			 * the owner name is the same as the previous one,
+			 * so that rdatasets aren't split between threads.
+			 */
+			len = scan_word(p, end);
+			if (ttl_known && (size_t)(p - base) >= next &&
+			    chunk < &par->chunks[nchunks - 1] &&
+			    (len != ownerlen || memcmp(p, owner, len) != 0))
+			{
+				chunk->end = p - base;
+				chunk++;
+				chunk->start = p - base;
+				chunk->line = line;
+				dns_name_copynf(
+					origin,
+					dns_fixedname_initname(&chunk->origin));
+				chunk->ttl_known = ttl_known;
+				chunk->ttl = ttl;
+				next = chunk->start + chunksize;
+			}
+			owner = p;
+			ownerlen = len;
+		}
+
+		if (!skip_line(&p, end, &depth, &line)) {
+			return (false);
+		}
+	}
+	chunk->end = par->maplength;
+
+	par->nchunks = chunk - par->chunks + 1;
+
+	return (par->nchunks > 1);
+}
+
+/*
+ * Add an rdataset loaded by one of the threads of a parallel load.
+ */
+static isc_result_t
+loadpar_add(void *arg, const dns_name_t *owner, dns_rdataset_t *rdataset) {
+	dns_loadctx_t *lctx = arg;
+	loadpar_t *par = lctx->par;
+	isc_result_t result;
+
+	LOCK(&par->lock);
+	result = (*lctx->callbacks->add)(lctx->callbacks->add_private, owner,
+					 rdataset);
+	UNLOCK(&par->lock);
+
+	return (result);
+}
+
+/*
+ * Prepare 'lctx' to load 'master_file' with up to 'nthreads' threads of
+ * 'pool'.  If the file is too small to be worth splitting, or can't be
+ * split, 'lctx->par' is left NULL and the file is opened for loading as
+ * usual.
+ */
+static isc_result_t
+loadpar_create(dns_loadctx_t *lctx, const char *master_file,
+	       dns_loadpool_t *pool, unsigned int nthreads) {
+	loadpar_t *par;
+	FILE *f = NULL;
+	off_t size;
+	void *map;
+	unsigned int nchunks;
+	int flags = MAP_PRIVATE;
+	isc_result_t result;
+
+	if (nthreads < 2) {
+		goto sequential;
+	}
+
+	result = isc_stdio_open(master_file, "rb", &f);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+	result = isc_file_getsizefd(fileno(f), &size);
+	if (result != ISC_R_SUCCESS) {
+		(void)isc_stdio_close(f);
+		return (result);
+	}
+	if (size < 2 * PAR_MINCHUNK) {
+		(void)isc_stdio_close(f);
+		goto sequential;
+	}
+
+#ifdef MAP_FILE
+	flags |= MAP_FILE;
+#endif /* ifdef MAP_FILE */
+	map = isc_file_mmap(NULL, (size_t)size, PROT_READ, flags, fileno(f),
+			    0);
+	(void)isc_stdio_close(f);
+	if (map == NULL || map == MAP_FAILED) {
+		goto sequential;
+	}
+
+	par = isc_mem_get(lctx->mctx, sizeof(*par));
+	*par = (loadpar_t){ .map = map,
+			    .maplength = (size_t)size,
+			    .pool = pool };
+	par->master_file = isc_mem_strdup(lctx->mctx, master_file);
+	isc_mutex_init(&par->lock);
+	isc_condition_init(&par->done);
+	atomic_init(&par->next, 0);
+	atomic_init(&par->failed, false);
+	lctx->par = par;
+
+	nchunks = ISC_MIN(nthreads * PAR_CHUNKSPERTHREAD,
+			  par->maplength / PAR_MINCHUNK);
+	if (!loadpar_split(lctx, nchunks)) {
+		loadpar_destroy(lctx);
+		goto sequential;
+	}
+
+	par->nthreads = ISC_MIN(nthreads, par->nchunks);
+
+	/*
+	 * Parallel loads add to the database through loadpar_add().
+	 */
+	par->callbacks = *lctx->callbacks;
+	par->callbacks.add = loadpar_add;
+	par->callbacks.add_private = lctx;
+
+	return (ISC_R_SUCCESS);
+
+sequential:
+	return ((lctx->openfile)(lctx, master_file));
+}
+
+/*
+ * Load a part of the file with a load context of its own.
+ */
+static isc_result_t
+loadpar_loadchunk(dns_loadctx_t *lctx, loadchunk_t *chunk) {
+	loadpar_t *par = lctx->par;
+	dns_loadctx_t *clctx = NULL;
+	isc_buffer_t buffer;
+	isc_result_t result;
+
+	result = loadctx_create(dns_masterformat_text, lctx->mctx,
+				lctx->options, lctx->resign, lctx->top,
+				lctx->zclass, dns_fixedname_name(&chunk->origin),
+				&par->callbacks, NULL, NULL, NULL, NULL, NULL,
+				NULL, &clctx);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+
+	clctx->maxttl = lctx->maxttl;
+	clctx->now = lctx->now;
+	if (chunk->ttl_known) {
+		clctx->ttl = chunk->ttl;
+		clctx->default_ttl = chunk->ttl;
+		clctx->default_ttl_known = true;
+	}
+
+	isc_buffer_init(&buffer, (unsigned char *)par->map + chunk->start,
+			chunk->end - chunk->start);
+	isc_buffer_add(&buffer, chunk->end - chunk->start);
+	result = isc_lex_openbuffer(clctx->lex, &buffer);
+	if (result == ISC_R_SUCCESS) {
+		RUNTIME_CHECK(isc_lex_setsourcename(clctx->lex,
+						    par->master_file) ==
+			      ISC_R_SUCCESS);
+		RUNTIME_CHECK(isc_lex_setsourceline(clctx->lex, chunk->line) ==
+			      ISC_R_SUCCESS);
+		result = load_text(clctx);
+	}
+
+	dns_loadctx_detach(&clctx);
+	return (result);
+}
+
+static void
+loadpar_done(isc_task_t *task, isc_event_t *event);
+
+/*
+ * Load parts of the file until there are none left.  The last thread to
+ * finish tells the task of an incremental load, or the caller of one
+ * that is not incremental, that the load is done.
+ */
+static void
+loadpar_work(dns_loadctx_t *lctx) {
+	loadpar_t *par = lctx->par;
+	uint_fast32_t i;
+	bool last;
+
+	while ((i = atomic_fetch_add_relaxed(&par->next, 1)) < par->nchunks) {
+		loadchunk_t *chunk = &par->chunks[i];
+
+		if (atomic_load_acquire(&lctx->canceled) ||
+		    atomic_load_acquire(&par->failed))
+		{
+			chunk->result = ISC_R_CANCELED;
+			continue;
+		}
+
+		chunk->result = loadpar_loadchunk(lctx, chunk);
+		if (chunk->result != ISC_R_SUCCESS &&
+		    (lctx->options & DNS_MASTER_MANYERRORS) == 0)
+		{
+			atomic_store_release(&par->failed, true);
+		}
+	}
+
+	LOCK(&par->lock);
+	INSIST(par->running > 0);
+	last = (--par->running == 0);
+	if (last && lctx->task == NULL) {
+		SIGNAL(&par->done);
+	}
+	UNLOCK(&par->lock);
+
+	if (last && lctx->task != NULL) {
+		isc_event_t *event = isc_event_allocate(
+			lctx->mctx, NULL, DNS_EVENT_MASTERQUANTUM,
+			loadpar_done, lctx, sizeof(*event));
+		isc_task_send(lctx->task, &event);
+	}
+}
+
+/*
+ * Queue the jobs that load the parts of the file in the load pool.  The
+ * caller of a load that is not incremental is one of the threads that
+ * load the file, so one less job is queued for it.
+ */
+static void
+loadpar_start(dns_loadctx_t *lctx) {
+	loadpar_t *par = lctx->par;
+	dns_loadpool_t *pool = par->pool;
+	unsigned int i, njobs;
+
+	par->running = par->nthreads;
+	njobs = (lctx->task == NULL) ? par->nthreads - 1 : par->nthreads;
+
+	LOCK(&pool->lock);
+	for (i = 0; i < njobs; i++) {
+		loadjob_t *job = isc_mem_get(pool->mctx, sizeof(*job));
+		*job = (loadjob_t){ .lctx = lctx };
+		ISC_LINK_INIT(job, link);
+		ISC_LIST_APPEND(pool->jobs, job, link);
+	}
+	BROADCAST(&pool->cond);
+	UNLOCK(&pool->lock);
+}
+
+/*
+ * Wait for the threads to finish, and return the result of the first
+ * part, in the order of the file, that failed to load.
+ */
+static isc_result_t
+loadpar_finish(dns_loadctx_t *lctx) {
+	loadpar_t *par = lctx->par;
+	isc_result_t result = ISC_R_SUCCESS;
+	unsigned int i;
+
+	LOCK(&par->lock);
+	while (par->running > 0) {
+		WAIT(&par->done, &par->lock);
+	}
+	UNLOCK(&par->lock);
+
+	for (i = 0; i < par->nchunks; i++) {
+		if (par->chunks[i].result != ISC_R_SUCCESS) {
+			result = par->chunks[i].result;
+			break;
+		}
+	}
+
+	return (result);
+}
+
+static void
+loadpar_done(isc_task_t *task, isc_event_t *event) {
+	dns_loadctx_t *lctx;
+	isc_result_t result;
+
+	UNUSED(task);
+
+	REQUIRE(event != NULL);
+	lctx = event->ev_arg;
+	REQUIRE(DNS_LCTX_VALID(lctx));
+
+	isc_event_free(&event);
+
+	result = loadpar_finish(lctx);
+	(lctx->done)(lctx->done_arg, result);
+	dns_loadctx_detach(&lctx);
+}
+
+isc_result_t
+dns_master_loadfileparallel(const char *master_file, dns_name_t *top,
+			    dns_name_t *origin, dns_rdataclass_t zclass,
+			    unsigned int options, uint32_t resign,
+			    dns_rdatacallbacks_t *callbacks, isc_task_t *task,
+			    dns_loaddonefunc_t done, void *done_arg,
+			    dns_loadctx_t **lctxp,
+			    dns_masterincludecb_t include_cb, void *include_arg,
+			    isc_mem_t *mctx, uint32_t maxttl,
+			    dns_loadpool_t *pool, unsigned int nthreads) {
+	dns_loadctx_t *lctx = NULL;
+	isc_result_t result;
+
+	REQUIRE(master_file != NULL);
+	REQUIRE(task == NULL || lctxp != NULL);
+	REQUIRE(DNS_LOADPOOL_VALID(pool));
+	REQUIRE(nthreads > 0);
+
+	result = loadctx_create(dns_masterformat_text, mctx, options, resign,
+				top, zclass, origin, callbacks, task, done,
+				done_arg, include_cb, include_arg, NULL, &lctx);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+
+	lctx->maxttl = maxttl;
+
+	result = loadpar_create(lctx, master_file, pool, nthreads);
+	if (result != ISC_R_SUCCESS) {
+		goto cleanup;
+	}
+
+	if (lctx->par != NULL) {
+		loadpar_start(lctx);
+		if (task == NULL) {
+			loadpar_work(lctx);
+			result = loadpar_finish(lctx);
+			goto cleanup;
+		}
+		dns_loadctx_attach(lctx, lctxp);
+		return (DNS_R_CONTINUE);
+	}
+
+	if (task == NULL) {
+		result = (lctx->load)(lctx);
+		INSIST(result != DNS_R_CONTINUE);
+		goto cleanup;
+	}
+
+	result = task_send(lctx);
+	if (result == ISC_R_SUCCESS) {
+		dns_loadctx_attach(lctx, lctxp);
+		return (DNS_R_CONTINUE);
+	}
+
+cleanup:
+	dns_loadctx_detach(&lctx);
+	return (result);
+}
+
+static isc_threadresult_t
+loadpool_thread(isc_threadarg_t arg) {
+	dns_loadpool_t *pool = arg;
+	loadjob_t *job;
+
+	LOCK(&pool->lock);
+	for (;;) {
+		while ((job = ISC_LIST_HEAD(pool->jobs)) == NULL &&
+		       !pool->exiting) {
+			WAIT(&pool->cond, &pool->lock);
+		}
+		if (job == NULL) {
+			break;
+		}
+
+		ISC_LIST_UNLINK(pool->jobs, job, link);
+		UNLOCK(&pool->lock);
+
+		loadpar_work(job->lctx);
+		isc_mem_put(pool->mctx, job, sizeof(*job));
+
+		LOCK(&pool->lock);
+	}
+	UNLOCK(&pool->lock);
+
+	return ((isc_threadresult_t)0);
+}
+
+void
+dns_loadpool_create(isc_mem_t *mctx, unsigned int nthreads,
+		    dns_loadpool_t **poolp) {
+	dns_loadpool_t *pool;
+	unsigned int i;
+
+	REQUIRE(nthreads > 0);
+	REQUIRE(poolp != NULL && *poolp == NULL);
+
+	pool = isc_mem_get(mctx, sizeof(*pool));
+	*pool = (dns_loadpool_t){ .nthreads = nthreads };
+	isc_mem_attach(mctx, &pool->mctx);
+	isc_mutex_init(&pool->lock);
+	isc_condition_init(&pool->cond);
+	ISC_LIST_INIT(pool->jobs);
+	pool->magic = LOADPOOL_MAGIC;
+
+	pool->threads = isc_mem_get(mctx, nthreads * sizeof(isc_thread_t));
+	for (i = 0; i < nthreads; i++) {
+		isc_thread_create(loadpool_thread, pool, &pool->threads[i]);
+		isc_thread_setname(pool->threads[i], "isc-load");
+	}
+
+	*poolp = pool;
+}
+
+void
+dns_loadpool_destroy(dns_loadpool_t **poolp) {
+	dns_loadpool_t *pool;
+	unsigned int i;
+
+	REQUIRE(poolp != NULL && DNS_LOADPOOL_VALID(*poolp));
+
+	pool = *poolp;
+	*poolp = NULL;
+
+	LOCK(&pool->lock);
+	pool->exiting = true;
+	BROADCAST(&pool->cond);
+	UNLOCK(&pool->lock);
+
+	for (i = 0; i < pool->nthreads; i++) {
+		isc_thread_join(pool->threads[i], NULL);
+	}
+	INSIST(ISC_LIST_EMPTY(pool->jobs));
+
+	pool->magic = 0;
+	isc_mem_put(pool->mctx, pool->threads,
+		    pool->nthreads * sizeof(isc_thread_t));
+	(void)isc_condition_destroy(&pool->cond);
+	isc_mutex_destroy(&pool->lock);
+	isc_mem_putanddetach(&pool->mctx, pool, sizeof(*pool));
+}
+
 /*
  * Grow the slab of dns_rdatalist_t structures.
  * Re-link glue and current list.
@@ -48,6 +48,8 @@
 #include <dns/time.h>
 #include <dns/ttl.h>
 
+#include "imagedb.h"
+
 #define DNS_DCTX_MAGIC	  ISC_MAGIC('D', 'c', 't', 'x')
 #define DNS_DCTX_VALID(d) ISC_MAGIC_VALID(d, DNS_DCTX_MAGIC)
 
@@ -1572,6 +1574,7 @@ dumpctx_create(isc_mem_t *mctx, dns_db_t *db, dns_dbversion_t *version,
 		dctx->dumpsets = dump_rdatasets_raw;
 		break;
 	case dns_masterformat_map:
+	case dns_masterformat_image:
 		dctx->dumpsets = dump_rdatasets_map;
 		break;
 	default:
@@ -1673,12 +1676,15 @@ writeheader(dns_dumpctx_t *dctx) {
 		break;
 	case dns_masterformat_raw:
 	case dns_masterformat_map:
+	case dns_masterformat_image:
 		r.base = (unsigned char *)&rawheader;
 		r.length = sizeof(rawheader);
 		isc_buffer_region(&buffer, &r);
 		now32 = dctx->now;
 		rawversion = 1;
-		if ((dctx->header.flags & DNS_MASTERRAW_COMPAT) != 0) {
+		if ((dctx->header.flags & DNS_MASTERRAW_COMPAT) != 0 &&
+		    dctx->format != dns_masterformat_image)
+		{
 			rawversion = 0;
 		}
 
@@ -1742,6 +1748,15 @@ dumptostreaminc(dns_dumpctx_t *dctx) {
 			goto cleanup;
 		}
 
+		/*
+		 * Zone images are built in memory and written in one go.
+		 */
+		if (dctx->format == dns_masterformat_image) {
+			result = dns_imagedb_write(dctx->mctx, dctx->db,
+						   dctx->version, dctx->f);
+			goto cleanup;
+		}
+
 		result = dns_dbiterator_first(dctx->dbiter);
 		if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE) {
 			goto cleanup;
@@ -13,6 +13,7 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <sys/stat.h>
 
 #include <isc/crc64.h>
@@ -24,8 +25,10 @@
 #include <isc/print.h>
 #include <isc/refcount.h>
 #include <isc/socket.h>
+#include <isc/stats.h>
 #include <isc/stdio.h>
 #include <isc/string.h>
+#include <isc/time.h>
 #include <isc/util.h>
 
 /*%
@@ -40,6 +43,7 @@
 #include <dns/log.h>
 #include <dns/rbt.h>
 #include <dns/result.h>
+#include <dns/stats.h>
 
 #define CHECK(x)                             \
 	do {                                 \
@@ -63,6 +67,7 @@
 #define RBT_HASH_MAX_BITS   32
 #define RBT_HASH_OVERCOMMIT 3
 #define RBT_HASH_BUCKETSIZE 4096 /* FIXME: What would be a good value here? */
+#define RBT_HASH_MOVE_BUCKETS 64 /*%< Buckets moved per rehashing step */
 
 #ifdef RBT_MEM_TEST
 #undef RBT_HASH_SIZE
@@ -73,6 +78,8 @@
 
 #define HASHSIZE(bits) (UINT64_C(1) << (bits))
 
+#define RBT_HASH_NEXTTABLE(hindex) (((hindex) == 0) ? 1 : 0)
+
 static inline uint32_t
 hash_32(uint32_t val, unsigned int bits) {
 	REQUIRE(bits <= RBT_HASH_MAX_BITS);
@@ -87,9 +94,13 @@ struct dns_rbt {
 	void (*data_deleter)(void *, void *);
 	void *deleter_arg;
 	unsigned int nodecount;
-	uint16_t hashbits;
+	uint8_t hindex;
+	uint32_t hiter;
+	uint16_t hashbits[2];
 	uint16_t maxhashbits;
-	dns_rbtnode_t **hashtable;
+	dns_rbtnode_t **hashtable[2];
+	isc_stats_t *stats;
+	uint8_t shard;
 	void *mmap_location;
 };
 
@@ -391,7 +402,7 @@ dns__rbtnode_getdistance(dns_rbtnode_t *node) {
  * Forward declarations.
  */
 static isc_result_t
-create_node(isc_mem_t *mctx, const dns_name_t *name, dns_rbtnode_t **nodep);
+create_node(dns_rbt_t *rbt, const dns_name_t *name, dns_rbtnode_t **nodep);
 
 static isc_result_t
 inithash(dns_rbt_t *rbt);
@@ -405,9 +416,17 @@ unhash_node(dns_rbt_t *rbt, dns_rbtnode_t *node);
 static uint32_t
 rehash_bits(dns_rbt_t *rbt, size_t newcount);
 static void
-rehash(dns_rbt_t *rbt, uint32_t newbits);
+hashtable_new(dns_rbt_t *rbt, uint8_t index, uint8_t bits);
+static void
+hashtable_free(dns_rbt_t *rbt, uint8_t index);
+static void
+hashtable_rehash(dns_rbt_t *rbt, uint32_t newbits);
+static void
+hashtable_rehash_one(dns_rbt_t *rbt);
 static void
 maybe_rehash(dns_rbt_t *rbt, size_t size);
+static inline bool
+rehashing_in_progress(dns_rbt_t *rbt);
 
 static inline void
 rotate_left(dns_rbtnode_t *node, dns_rbtnode_t **rootp);
@@ -1006,9 +1025,15 @@ dns_rbt_create(isc_mem_t *mctx, dns_rbtdeleter_t deleter, void *deleter_arg,
 	rbt->deleter_arg = deleter_arg;
 	rbt->root = NULL;
 	rbt->nodecount = 0;
-	rbt->hashtable = NULL;
-	rbt->hashbits = 0;
+	rbt->hindex = 0;
+	rbt->hiter = 0;
+	rbt->hashtable[0] = NULL;
+	rbt->hashtable[1] = NULL;
+	rbt->hashbits[0] = 0;
+	rbt->hashbits[1] = 0;
 	rbt->maxhashbits = RBT_HASH_MAX_BITS;
+	rbt->stats = NULL;
+	rbt->shard = 0;
 	rbt->mmap_location = NULL;
 
 	result = inithash(rbt);
@@ -1051,9 +1076,17 @@ dns_rbt_destroy2(dns_rbt_t **rbtp, unsigned int quantum) {
 
 	rbt->mmap_location = NULL;
 
-	if (rbt->hashtable != NULL) {
-		size_t size = HASHSIZE(rbt->hashbits) * sizeof(dns_rbtnode_t *);
-		isc_mem_put(rbt->mctx, rbt->hashtable, size);
+	if (rehashing_in_progress(rbt)) {
+		hashtable_free(rbt, RBT_HASH_NEXTTABLE(rbt->hindex));
+		if (rbt->stats != NULL) {
+			isc_stats_decrement(rbt->stats,
+					    dns_cachestatscounter_rehashing);
+		}
+	}
+	hashtable_free(rbt, rbt->hindex);
+
+	if (rbt->stats != NULL) {
+		isc_stats_detach(&rbt->stats);
 	}
 
 	rbt->magic = 0;
@@ -1073,7 +1106,45 @@ size_t
 dns_rbt_hashsize(dns_rbt_t *rbt) {
 	REQUIRE(VALID_RBT(rbt));
 
-	return (1 << rbt->hashbits);
+	return (1 << rbt->hashbits[rbt->hindex]);
+}
+
+bool
+dns_rbt_rehashing(dns_rbt_t *rbt) {
+	REQUIRE(VALID_RBT(rbt));
+
+	return (rehashing_in_progress(rbt));
+}
+
+void
+dns_rbt_rehashfinish(dns_rbt_t *rbt) {
+	REQUIRE(VALID_RBT(rbt));
+
+	while (rehashing_in_progress(rbt)) {
+		hashtable_rehash_one(rbt);
+	}
+}
+
+void
+dns_rbt_setstats(dns_rbt_t *rbt, isc_stats_t *stats) {
+	REQUIRE(VALID_RBT(rbt));
+	REQUIRE(stats != NULL);
+	REQUIRE(rbt->stats == NULL);
+
+	isc_stats_attach(stats, &rbt->stats);
+	if (rehashing_in_progress(rbt)) {
+		isc_stats_increment(rbt->stats,
+				    dns_cachestatscounter_rehashing);
+	}
+}
+
+void
+dns_rbt_setshard(dns_rbt_t *rbt, unsigned int shard) {
+	REQUIRE(VALID_RBT(rbt));
+	REQUIRE(shard <= DNS_RBT_SHARD_MAX);
+	REQUIRE(rbt->root == NULL);
+
+	rbt->shard = shard;
 }
 
 isc_result_t
@@ -1204,7 +1275,7 @@ dns_rbt_addnode(dns_rbt_t *rbt, const dns_name_t *name, dns_rbtnode_t **nodep) {
 	dns_name_clone(name, add_name);
 
 	if (ISC_UNLIKELY(rbt->root == NULL)) {
-		result = create_node(rbt->mctx, add_name, &new_current);
+		result = create_node(rbt, add_name, &new_current);
 		if (result == ISC_R_SUCCESS) {
 			rbt->nodecount++;
 			new_current->is_root = 1;
@@ -1328,7 +1399,7 @@ dns_rbt_addnode(dns_rbt_t *rbt, const dns_name_t *name, dns_rbtnode_t **nodep) {
 				 */
 				dns_name_split(&current_name, common_labels,
 					       prefix, suffix);
-				result = create_node(rbt->mctx, suffix,
+				result = create_node(rbt, suffix,
 						     &new_current);
 
 				if (result != ISC_R_SUCCESS) {
@@ -1437,7 +1508,7 @@ dns_rbt_addnode(dns_rbt_t *rbt, const dns_name_t *name, dns_rbtnode_t **nodep) {
 	} while (ISC_LIKELY(child != NULL));
 
 	if (ISC_LIKELY(result == ISC_R_SUCCESS)) {
-		result = create_node(rbt->mctx, add_name, &new_current);
+		result = create_node(rbt, add_name, &new_current);
 	}
 
 	if (ISC_LIKELY(result == ISC_R_SUCCESS)) {
@@ -1586,6 +1657,7 @@ dns_rbt_findnode(dns_rbt_t *rbt, const dns_name_t *name, dns_name_t *foundname,
 			unsigned int nlabels;
 			unsigned int tlabels = 1;
 			uint32_t hash;
+			uint8_t hindex;
 
 			/*
 			 * The case of current not being a subtree root,
@@ -1608,6 +1680,7 @@ dns_rbt_findnode(dns_rbt_t *rbt, const dns_name_t *name, dns_name_t *foundname,
 			dns_name_init(&hash_name, NULL);
 
 		hashagain:
+			hindex = rbt->hindex;
 			/*
 			 * Compute the hash over the full absolute
 			 * name. Look for the smallest suffix match at
@@ -1628,8 +1701,9 @@ dns_rbt_findnode(dns_rbt_t *rbt, const dns_name_t *name, dns_name_t *foundname,
 			 * Walk all the nodes in the hash bucket pointed
 			 * by the computed hash value.
 			 */
-			for (hnode = rbt->hashtable[hash_32(hash,
-							    rbt->hashbits)];
+		nexttable:
+			for (hnode = rbt->hashtable[hindex][hash_32(
+				     hash, rbt->hashbits[hindex])];
 			     hnode != NULL; hnode = hnode->hashnext)
 			{
 				dns_name_t hnode_name;
@@ -1657,6 +1731,17 @@ dns_rbt_findnode(dns_rbt_t *rbt, const dns_name_t *name, dns_name_t *foundname,
 				}
 			}
 
+			/*
+			 * While the hash table is being rehashed, the node
+			 * may still be in a bucket of the old table that
+			 * hasn't been moved to the new one yet.
+			 */
+			if (hnode == NULL && hindex == rbt->hindex &&
+			    rehashing_in_progress(rbt)) {
+				hindex = RBT_HASH_NEXTTABLE(hindex);
+				goto nexttable;
+			}
+
 			if (hnode != NULL) {
 				current = hnode;
 				/*
@@ -2225,7 +2310,7 @@ dns_rbt_formatnodename(dns_rbtnode_t *node, char *printname,
 }
 
 static isc_result_t
-create_node(isc_mem_t *mctx, const dns_name_t *name, dns_rbtnode_t **nodep) {
+create_node(dns_rbt_t *rbt, const dns_name_t *name, dns_rbtnode_t **nodep) {
 	dns_rbtnode_t *node;
 	isc_region_t region;
 	unsigned int labels;
@@ -2233,6 +2318,11 @@ create_node(isc_mem_t *mctx, const dns_name_t *name, dns_rbtnode_t **nodep) {
 
 	REQUIRE(name->offsets != NULL);
 
+	STATIC_ASSERT(offsetof(dns_rbtnode_t, parent) + sizeof(node->parent) <=
+			      DNS_RBTNODE_HOTSIZE,
+		      "dns_rbtnode_t lookup members exceed "
+		      "DNS_RBTNODE_HOTSIZE");
+
 	dns_name_toregion(name, &region);
 	labels = dns_name_countlabels(name);
 	ENSURE(labels > 0);
@@ -2241,7 +2331,7 @@ create_node(isc_mem_t *mctx, const dns_name_t *name, dns_rbtnode_t **nodep) {
 	 * Allocate space for the node structure, the name, and the offsets.
 	 */
 	nodelen = sizeof(dns_rbtnode_t) + region.length + labels + 1;
-	node = isc_mem_get(mctx, nodelen);
+	node = isc_mem_get(rbt->mctx, nodelen);
 	memset(node, 0, nodelen);
 
 	node->is_root = 0;
@@ -2257,6 +2347,7 @@ create_node(isc_mem_t *mctx, const dns_name_t *name, dns_rbtnode_t **nodep) {
 	node->parent_is_relative = 0;
 	node->data_is_relative = 0;
 	node->rpz = 0;
+	node->shard = rbt->shard;
 
 	HASHNEXT(node) = NULL;
 	HASHVAL(node) = 0;
@@ -2301,21 +2392,41 @@ create_node(isc_mem_t *mctx, const dns_name_t *name, dns_rbtnode_t **nodep) {
 	return (ISC_R_SUCCESS);
 }
 
+/*
+ * Return the index of the hash table a node with the hash value of 'node'
+ * belongs in: while the hash table is being rehashed, that's the old
+ * table if the node's bucket in the old table hasn't been moved yet.
+ */
+static inline uint8_t
+node_hindex(dns_rbt_t *rbt, dns_rbtnode_t *node) {
+	uint8_t oldindex = RBT_HASH_NEXTTABLE(rbt->hindex);
+
+	if (rbt->hashtable[oldindex] != NULL &&
+	    hash_32(HASHVAL(node), rbt->hashbits[oldindex]) >= rbt->hiter)
+	{
+		return (oldindex);
+	}
+
+	return (rbt->hindex);
+}
+
 /*
  * Add a node to the hash table
  */
 static inline void
 hash_add_node(dns_rbt_t *rbt, dns_rbtnode_t *node, const dns_name_t *name) {
+	uint8_t hindex;
 	uint32_t hash;
 
 	REQUIRE(name != NULL);
 
 	HASHVAL(node) = dns_name_fullhash(name, false);
 
-	hash = hash_32(HASHVAL(node), rbt->hashbits);
-	HASHNEXT(node) = rbt->hashtable[hash];
+	hindex = node_hindex(rbt, node);
+	hash = hash_32(HASHVAL(node), rbt->hashbits[hindex]);
+	HASHNEXT(node) = rbt->hashtable[hindex][hash];
 
-	rbt->hashtable[hash] = node;
+	rbt->hashtable[hindex][hash] = node;
 }
 
 /*
@@ -2323,19 +2434,40 @@ hash_add_node(dns_rbt_t *rbt, dns_rbtnode_t *node, const dns_name_t *name) {
  */
 static isc_result_t
 inithash(dns_rbt_t *rbt) {
+	hashtable_new(rbt, 0, RBT_HASH_MIN_BITS);
+
+	return (ISC_R_SUCCESS);
+}
+
+static void
+hashtable_new(dns_rbt_t *rbt, uint8_t index, uint8_t bits) {
 	size_t size;
 
-	rbt->hashbits = RBT_HASH_MIN_BITS;
-	size = HASHSIZE(rbt->hashbits) * sizeof(dns_rbtnode_t *);
-	rbt->hashtable = isc_mem_get(rbt->mctx, size);
-	memset(rbt->hashtable, 0, size);
+	REQUIRE(rbt->hashbits[index] == 0U);
+	REQUIRE(rbt->hashtable[index] == NULL);
+	REQUIRE(bits >= RBT_HASH_MIN_BITS);
+	REQUIRE(bits <= RBT_HASH_MAX_BITS);
 
-	return (ISC_R_SUCCESS);
+	rbt->hashbits[index] = bits;
+
+	size = HASHSIZE(rbt->hashbits[index]) * sizeof(dns_rbtnode_t *);
+
+	rbt->hashtable[index] = isc_mem_get(rbt->mctx, size);
+	memset(rbt->hashtable[index], 0, size);
+}
+
+static void
+hashtable_free(dns_rbt_t *rbt, uint8_t index) {
+	size_t size = HASHSIZE(rbt->hashbits[index]) * sizeof(dns_rbtnode_t *);
+	isc_mem_put(rbt->mctx, rbt->hashtable[index], size);
+
+	rbt->hashbits[index] = 0U;
+	rbt->hashtable[index] = NULL;
 }
 
 static uint32_t
 rehash_bits(dns_rbt_t *rbt, size_t newcount) {
-	uint32_t newbits = rbt->hashbits;
+	uint32_t newbits = rbt->hashbits[rbt->hindex];
 
 	while (newcount >= HASHSIZE(newbits) && newbits < rbt->maxhashbits) {
 		newbits += 1;
@@ -2344,60 +2476,160 @@ rehash_bits(dns_rbt_t *rbt, size_t newcount) {
 	return (newbits);
 }
 
+static inline bool
+rehashing_in_progress(dns_rbt_t *rbt) {
+	return (rbt->hashtable[RBT_HASH_NEXTTABLE(rbt->hindex)] != NULL);
+}
+
+/*
+ * Account the time spent rehashing since 'start' (a reading of the
+ * monotonic clock) in the stall-time histogram.
+ */
+static void
+rehash_stall(dns_rbt_t *rbt, uint64_t start) {
+	uint64_t usecs = (isc_time_monotonic() - start) / 1000;
+	isc_statscounter_t counter;
+
+	if (usecs < 10) {
+		counter = dns_cachestatscounter_rehashstall10us;
+	} else if (usecs < 100) {
+		counter = dns_cachestatscounter_rehashstall100us;
+	} else if (usecs < 1000) {
+		counter = dns_cachestatscounter_rehashstall1ms;
+	} else if (usecs < 10000) {
+		counter = dns_cachestatscounter_rehashstall10ms;
+	} else {
+		counter = dns_cachestatscounter_rehashstallmax;
+	}
+
+	isc_stats_increment(rbt->stats, counter);
+}
+
 /*
- * Rebuild the hashtable to reduce the load factor
+ * Start growing the hash table.  Rebuilding a large table in one go
+ * would hold the tree write lock for a long time, so the new table is
+ * set up next to the old one and hashtable_rehash_one() moves the
+ * old buckets over a few at a time whenever the tree is modified;
+ * until it is done, lookups check both tables.
  */
 static void
-rehash(dns_rbt_t *rbt, uint32_t newbits) {
-	uint32_t oldbits;
-	size_t oldsize;
-	dns_rbtnode_t **oldtable;
-	size_t newsize;
-
-	REQUIRE(rbt->hashbits <= rbt->maxhashbits);
-	REQUIRE(newbits <= rbt->maxhashbits);
-
-	oldbits = rbt->hashbits;
-	oldsize = HASHSIZE(oldbits);
-	oldtable = rbt->hashtable;
-
-	rbt->hashbits = newbits;
-	newsize = HASHSIZE(rbt->hashbits);
-	rbt->hashtable = isc_mem_get(rbt->mctx,
-				     newsize * sizeof(dns_rbtnode_t *));
-	memset(rbt->hashtable, 0, newsize * sizeof(dns_rbtnode_t *));
-
-	for (size_t i = 0; i < oldsize; i++) {
-		dns_rbtnode_t *node;
-		dns_rbtnode_t *nextnode;
-		for (node = oldtable[i]; node != NULL; node = nextnode) {
-			uint32_t hash = hash_32(HASHVAL(node), rbt->hashbits);
+hashtable_rehash(dns_rbt_t *rbt, uint32_t newbits) {
+	uint8_t oldindex = rbt->hindex;
+	uint32_t oldbits = rbt->hashbits[oldindex];
+	uint8_t newindex = RBT_HASH_NEXTTABLE(oldindex);
+	uint64_t start = 0;
+
+	REQUIRE(rbt->hashbits[oldindex] >= RBT_HASH_MIN_BITS);
+	REQUIRE(rbt->hashbits[oldindex] <= RBT_HASH_MAX_BITS);
+	REQUIRE(rbt->hashtable[oldindex] != NULL);
+
+	REQUIRE(newbits <= RBT_HASH_MAX_BITS);
+	REQUIRE(rbt->hashbits[newindex] == 0U);
+	REQUIRE(rbt->hashtable[newindex] == NULL);
+
+	REQUIRE(newbits > oldbits);
+
+	if (rbt->stats != NULL) {
+		start = isc_time_monotonic();
+	}
+
+	hashtable_new(rbt, newindex, newbits);
+
+	rbt->hindex = newindex;
+	rbt->hiter = 0;
+
+	if (rbt->nodecount == 0) {
+		/* Nothing to move. */
+		hashtable_free(rbt, oldindex);
+	} else if (rbt->stats != NULL) {
+		isc_stats_increment(rbt->stats,
+				    dns_cachestatscounter_rehashing);
+	}
+
+	if (rbt->stats != NULL) {
+		rehash_stall(rbt, start);
+	}
+}
+
+/*
+ * Move up to RBT_HASH_MOVE_BUCKETS buckets from the old hash table to
+ * the new one, and free the old table once it is empty.
+ */
+static void
+hashtable_rehash_one(dns_rbt_t *rbt) {
+	dns_rbtnode_t **newtable = rbt->hashtable[rbt->hindex];
+	uint8_t oldindex = RBT_HASH_NEXTTABLE(rbt->hindex);
+	dns_rbtnode_t **oldtable = rbt->hashtable[oldindex];
+	uint32_t oldsize = HASHSIZE(rbt->hashbits[oldindex]);
+	uint32_t limit;
+	uint64_t start = 0;
+
+	if (rbt->stats != NULL) {
+		start = isc_time_monotonic();
+	}
+
+	limit = ISC_MIN(oldsize, rbt->hiter + RBT_HASH_MOVE_BUCKETS);
+	for (; rbt->hiter < limit; rbt->hiter++) {
+		dns_rbtnode_t *node = NULL;
+		dns_rbtnode_t *nextnode = NULL;
+
+		for (node = oldtable[rbt->hiter]; node != NULL;
+		     node = nextnode) {
+			uint32_t hash = hash_32(HASHVAL(node),
+						rbt->hashbits[rbt->hindex]);
 			nextnode = HASHNEXT(node);
-			HASHNEXT(node) = rbt->hashtable[hash];
-			rbt->hashtable[hash] = node;
+			HASHNEXT(node) = newtable[hash];
+			newtable[hash] = node;
 		}
+		oldtable[rbt->hiter] = NULL;
 	}
 
-	isc_mem_put(rbt->mctx, oldtable, oldsize * sizeof(dns_rbtnode_t *));
+	if (rbt->hiter == oldsize) {
+		hashtable_free(rbt, oldindex);
+		rbt->hiter = 0;
+		if (rbt->stats != NULL) {
+			isc_stats_decrement(rbt->stats,
+					    dns_cachestatscounter_rehashing);
+		}
+	}
+
+	if (rbt->stats != NULL) {
+		rehash_stall(rbt, start);
+	}
 }
 
 static void
 maybe_rehash(dns_rbt_t *rbt, size_t newcount) {
 	uint32_t newbits = rehash_bits(rbt, newcount);
-	if (rbt->hashbits < newbits && newbits <= rbt->maxhashbits) {
-		rehash(rbt, newbits);
+
+	if (rbt->hashbits[rbt->hindex] < newbits &&
+	    newbits <= rbt->maxhashbits) {
+		/*
+		 * The table has outgrown itself again before the last
+		 * rehash finished; finish that one first.
+		 */
+		while (rehashing_in_progress(rbt)) {
+			hashtable_rehash_one(rbt);
+		}
+
+		hashtable_rehash(rbt, newbits);
 	}
 }
 
 /*
- * Add a node to the hash table. Rehash the hashtable if the node count
- * rises above a critical level.
+ * Add a node to the hash table. Start rehashing the hashtable if the
+ * node count rises above a critical level, and move a few more buckets
+ * if it's already being rehashed.
  */
 static inline void
 hash_node(dns_rbt_t *rbt, dns_rbtnode_t *node, const dns_name_t *name) {
 	REQUIRE(DNS_RBTNODE_VALID(node));
 
-	if (rbt->nodecount >= (HASHSIZE(rbt->hashbits) * RBT_HASH_OVERCOMMIT)) {
+	if (rehashing_in_progress(rbt)) {
+		hashtable_rehash_one(rbt);
+	} else if (rbt->nodecount >= (HASHSIZE(rbt->hashbits[rbt->hindex]) *
+				      RBT_HASH_OVERCOMMIT))
+	{
 		maybe_rehash(rbt, rbt->nodecount);
 	}
 
@@ -2409,22 +2641,28 @@ hash_node(dns_rbt_t *rbt, dns_rbtnode_t *node, const dns_name_t *name) {
  */
 static inline void
 unhash_node(dns_rbt_t *rbt, dns_rbtnode_t *node) {
-	uint32_t bucket;
-	dns_rbtnode_t *bucket_node;
+	uint8_t hindex;
+	uint32_t hash;
+	dns_rbtnode_t *hnode;
 
 	REQUIRE(DNS_RBTNODE_VALID(node));
 
-	bucket = hash_32(HASHVAL(node), rbt->hashbits);
-	bucket_node = rbt->hashtable[bucket];
+	hindex = node_hindex(rbt, node);
+	hash = hash_32(HASHVAL(node), rbt->hashbits[hindex]);
+	hnode = rbt->hashtable[hindex][hash];
 
-	if (bucket_node == node) {
-		rbt->hashtable[bucket] = HASHNEXT(node);
+	if (hnode == node) {
+		rbt->hashtable[hindex][hash] = HASHNEXT(node);
 	} else {
-		while (HASHNEXT(bucket_node) != node) {
-			INSIST(HASHNEXT(bucket_node) != NULL);
-			bucket_node = HASHNEXT(bucket_node);
+		while (HASHNEXT(hnode) != node) {
+			INSIST(HASHNEXT(hnode) != NULL);
+			hnode = HASHNEXT(hnode);
 		}
-		HASHNEXT(bucket_node) = HASHNEXT(node);
+		HASHNEXT(hnode) = HASHNEXT(node);
+	}
+
+	if (rehashing_in_progress(rbt)) {
+		hashtable_rehash_one(rbt);
 	}
 }
 
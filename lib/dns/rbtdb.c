@@ -36,6 +36,7 @@
 #include <isc/stdio.h>
 #include <isc/string.h>
 #include <isc/task.h>
+#include <isc/thread.h>
 #include <isc/time.h>
 #include <isc/util.h>
 
@@ -160,28 +161,28 @@ typedef uint32_t rbtdb_rdatatype_t;
  * Note that we cannot use NODE_LOCK()/NODE_UNLOCK() wherever the protected
  * section is also protected by NODE_STRONGLOCK().
  */
-typedef isc_rwlock_t nodelock_t;
+typedef struct {
+	isc_rwlock_t rwlock;
+	/* The database the lock belongs to, see write_begin(). */
+	struct dns_rbtdb *rbtdb;
+} nodelock_t;
 
-#define NODE_INITLOCK(l)    isc_rwlock_init((l), 0, 0)
-#define NODE_DESTROYLOCK(l) isc_rwlock_destroy(l)
-#define NODE_LOCK(l, t)	    RWLOCK((l), (t))
-#define NODE_UNLOCK(l, t)   RWUNLOCK((l), (t))
-#define NODE_TRYUPGRADE(l)  isc_rwlock_tryupgrade(l)
-#define NODE_DOWNGRADE(l)   isc_rwlock_downgrade(l)
+#define NODE_INITLOCK(l)    isc_rwlock_init(&(l)->rwlock, 0, 0)
+#define NODE_DESTROYLOCK(l) isc_rwlock_destroy(&(l)->rwlock)
+#define NODE_LOCK(l, t)	    node_lock((l), (t))
+#define NODE_UNLOCK(l, t)   node_unlock((l), (t))
+#define NODE_TRYUPGRADE(l)  node_tryupgrade(l)
+#define NODE_DOWNGRADE(l)   node_downgrade(l)
 
-/*%
- * Whether to rate-limit updating the LRU to avoid possible thread contention.
- * Updating LRU requires write locking, so we don't do it every time the
- * record is touched - only after some time passes.
+/*
+ * The tree lock is wrapped in the same way as the node locks; see
+ * write_begin().
  */
-#ifndef DNS_RBTDB_LIMITLRUUPDATE
-#define DNS_RBTDB_LIMITLRUUPDATE 1
-#endif
-
-/*% Time after which we update LRU for glue records, 5 minutes */
-#define DNS_RBTDB_LRUUPDATE_GLUE 300
-/*% Time after which we update LRU for all other records, 10 minutes */
-#define DNS_RBTDB_LRUUPDATE_REGULAR 600
+#define TREE_LOCK(r, t)	   tree_lock((r), (t))
+#define TREE_UNLOCK(r, t)  tree_unlock((r), (t))
+#define TREE_TRYUPGRADE(r) tree_tryupgrade(r)
+#define TREE_TRYLOCK(r)	   tree_trylock(r)
+#define TREE_DOWNGRADE(r)  tree_downgrade(r)
 
 /*
  * Allow clients with a virtual time of up to 5 minutes in the past to see
@@ -238,7 +239,6 @@ typedef struct rdatasetheader {
 	 */
 
 	dns_rbtnode_t *node;
-	isc_stdtime_t last_used;
 	ISC_LINK(struct rdatasetheader) link;
 
 	unsigned int heap_index;
@@ -273,6 +273,8 @@ typedef ISC_LIST(dns_rbtnode_t) rbtnodelist_t;
 #define RDATASET_ATTR_CASEFULLYLOWER 0x1000
 /*%< Ancient - awaiting cleanup. */
 #define RDATASET_ATTR_ANCIENT 0x2000
+/*%< Used since the eviction hand last passed it. */
+#define RDATASET_ATTR_VISITED 0x4000
 
 /*
  * XXX
@@ -326,6 +328,9 @@ typedef ISC_LIST(dns_rbtnode_t) rbtnodelist_t;
 #define ANCIENT(header)                                \
 	((atomic_load_acquire(&(header)->attributes) & \
 	  RDATASET_ATTR_ANCIENT) != 0)
+#define VISITED(header)                                \
+	((atomic_load_acquire(&(header)->attributes) & \
+	  RDATASET_ATTR_VISITED) != 0)
 #define STATCOUNT(header)                              \
 	((atomic_load_acquire(&(header)->attributes) & \
 	  RDATASET_ATTR_STATCOUNT) != 0)
@@ -489,11 +494,15 @@ struct dns_rbtdb {
 	dns_ttl_t serve_stale_ttl;
 
 	/*
-	 * This is a linked list used to implement the LRU cache.  There will
-	 * be node_lock_count linked lists here.  Nodes in bucket 1 will be
-	 * placed on the linked list rdatasets[1].
+	 * These are the queues of the SIEVE cache eviction algorithm.  There
+	 * will be node_lock_count linked lists here.  Headers of nodes in
+	 * bucket 1 are prepended to rdatasets[1] when they are added, and
+	 * are never moved after that; hands[1] points at the next header of
+	 * that list to be considered for eviction, or is NULL if eviction
+	 * is to start at the tail of the list.
 	 */
 	rdatasetheaderlist_t *rdatasets;
+	rdatasetheader_t **hands;
 
 	/*%
 	 * Temporary storage for stale cache nodes and dynamically deleted
@@ -523,6 +532,10 @@ struct dns_rbtdb {
 
 	/* Unlocked */
 	unsigned int quantum;
+
+	/* Lock-free lookups, see read_begin() and write_begin(). */
+	atomic_uint_fast32_t writers;
+	atomic_bool readers;
 };
 
 #define RBTDB_ATTR_LOADED  0x01
@@ -542,6 +555,7 @@ typedef struct {
 	bool copy_name;
 	bool need_cleanup;
 	bool wild;
+	bool lockfree;
 	dns_rbtnode_t *zonecut;
 	rdatasetheader_t *zonecut_rdataset;
 	rdatasetheader_t *zonecut_sigrdataset;
@@ -577,10 +591,8 @@ rdataset_getnoqname(dns_rdataset_t *rdataset, dns_name_t *name,
 static isc_result_t
 rdataset_getclosest(dns_rdataset_t *rdataset, dns_name_t *name,
 		    dns_rdataset_t *neg, dns_rdataset_t *negsig);
-static inline bool
-need_headerupdate(rdatasetheader_t *header, isc_stdtime_t now);
-static void
-update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header, isc_stdtime_t now);
+static inline void
+mark_header_visited(rdatasetheader_t *header);
 static void
 expire_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header, bool tree_locked,
 	      expire_t reason);
@@ -778,6 +790,206 @@ static atomic_uint_fast32_t init_count;
  * For zone databases the node for the origin of the zone MUST NOT be deleted.
  */
 
+/*
+ * Lock-free Lookups
+ *
+ * Lookups in zone databases can be done without taking the tree lock or
+ * any of the node locks, which saves them from fighting over the cache
+ * lines of the few rwlocks all queries for a zone go through.  Instead,
+ * a thread announces the database it is about to read in a read slot
+ * of its own ("read section"), and any thread that is going to change
+ * the database - i.e. that takes the tree lock or a node lock for
+ * writing, or makes a new version the current one - first marks the
+ * database as being written and waits until it is not announced in
+ * any read slot any more ("drains" the readers).  A lookup that starts
+ * while the database is being written uses the locks as before.
+ *
+ * Inside a read section, the database is therefore frozen: every node
+ * and header reachable from the tree, and the current version, stay
+ * as they are until the section ends.  In exchange, a read section must
+ * not take any of the database locks (a writer holding the lock may be
+ * waiting for us) and should be short, as writers are spinning on it.
+ *
+ * Cache and stub databases do not use read sections.
+ */
+#define READSLOTS 128
+
+typedef struct {
+	atomic_uintptr_t rbtdb;
+	char pad[128 - sizeof(atomic_uintptr_t)];
+} readslot_t;
+
+static readslot_t readslots[READSLOTS];
+static atomic_uint_fast32_t readslots_used;
+static thread_local int readslot = -1;
+static atomic_bool lockfree_reads = ATOMIC_VAR_INIT(true);
+
+#define LOCKFREE(rbtdb) (!IS_CACHE(rbtdb) && !IS_STUB(rbtdb))
+
+void
+dns__rbtdb_setlockfree(bool enable) {
+	atomic_store(&lockfree_reads, enable);
+}
+
+/*%
+ * Start a read section on 'rbtdb'; returns false if the database
+ * can only be read with the locks held at the moment.
+ */
+static inline bool
+read_begin(dns_rbtdb_t *rbtdb) {
+	uintptr_t expected = 0;
+
+	if (!LOCKFREE(rbtdb) || !atomic_load_relaxed(&lockfree_reads)) {
+		return (false);
+	}
+
+	if (readslot < 0) {
+		uint_fast32_t n = atomic_fetch_add_relaxed(&readslots_used, 1);
+		readslot = n % READSLOTS;
+	}
+
+	/*
+	 * With more than READSLOTS threads, the slot may be shared.
+	 */
+	if (!atomic_compare_exchange_strong(&readslots[readslot].rbtdb,
+					    &expected, (uintptr_t)rbtdb))
+	{
+		return (false);
+	}
+
+	if (!atomic_load(&rbtdb->readers)) {
+		atomic_store(&rbtdb->readers, true);
+	}
+
+	/*
+	 * Pairs with the increment in write_begin(): either we see the
+	 * writer, or the writer sees our slot.
+	 */
+	if (atomic_load(&rbtdb->writers) != 0) {
+		atomic_store_release(&readslots[readslot].rbtdb, 0);
+		return (false);
+	}
+
+	return (true);
+}
+
+static inline void
+read_end(void) {
+	atomic_store_release(&readslots[readslot].rbtdb, 0);
+}
+
+/*%
+ * Mark 'rbtdb' as being written and wait for the read sections in
+ * progress to end.  The caller holds the tree lock or a node lock for
+ * writing, so write sections nest.
+ */
+static inline void
+write_begin(dns_rbtdb_t *rbtdb) {
+	uint_fast32_t used;
+
+	if (!LOCKFREE(rbtdb)) {
+		return;
+	}
+
+	(void)atomic_fetch_add(&rbtdb->writers, 1);
+
+	/*
+	 * No need to look at the slots if nobody ever read this database
+	 * in a read section, as is the case while a new zone is loaded.
+	 */
+	if (!atomic_load(&rbtdb->readers)) {
+		return;
+	}
+
+	used = ISC_MIN(atomic_load(&readslots_used), READSLOTS);
+	for (uint_fast32_t i = 0; i < used; i++) {
+		while (atomic_load(&readslots[i].rbtdb) == (uintptr_t)rbtdb) {
+			isc_thread_yield();
+		}
+	}
+}
+
+static inline void
+write_end(dns_rbtdb_t *rbtdb) {
+	if (!LOCKFREE(rbtdb)) {
+		return;
+	}
+
+	INSIST(atomic_fetch_sub_release(&rbtdb->writers, 1) > 0);
+}
+
+static inline void
+node_lock(nodelock_t *lock, isc_rwlocktype_t type) {
+	RWLOCK(&lock->rwlock, type);
+	if (type == isc_rwlocktype_write) {
+		write_begin(lock->rbtdb);
+	}
+}
+
+static inline void
+node_unlock(nodelock_t *lock, isc_rwlocktype_t type) {
+	if (type == isc_rwlocktype_write) {
+		write_end(lock->rbtdb);
+	}
+	RWUNLOCK(&lock->rwlock, type);
+}
+
+static inline isc_result_t
+node_tryupgrade(nodelock_t *lock) {
+	isc_result_t result = isc_rwlock_tryupgrade(&lock->rwlock);
+	if (result == ISC_R_SUCCESS) {
+		write_begin(lock->rbtdb);
+	}
+	return (result);
+}
+
+static inline void
+node_downgrade(nodelock_t *lock) {
+	write_end(lock->rbtdb);
+	isc_rwlock_downgrade(&lock->rwlock);
+}
+
+static inline void
+tree_lock(dns_rbtdb_t *rbtdb, isc_rwlocktype_t type) {
+	RWLOCK(&rbtdb->tree_lock, type);
+	if (type == isc_rwlocktype_write) {
+		write_begin(rbtdb);
+	}
+}
+
+static inline void
+tree_unlock(dns_rbtdb_t *rbtdb, isc_rwlocktype_t type) {
+	if (type == isc_rwlocktype_write) {
+		write_end(rbtdb);
+	}
+	RWUNLOCK(&rbtdb->tree_lock, type);
+}
+
+static inline isc_result_t
+tree_tryupgrade(dns_rbtdb_t *rbtdb) {
+	isc_result_t result = isc_rwlock_tryupgrade(&rbtdb->tree_lock);
+	if (result == ISC_R_SUCCESS) {
+		write_begin(rbtdb);
+	}
+	return (result);
+}
+
+static inline isc_result_t
+tree_trylock(dns_rbtdb_t *rbtdb) {
+	isc_result_t result = isc_rwlock_trylock(&rbtdb->tree_lock,
+						 isc_rwlocktype_write);
+	if (result == ISC_R_SUCCESS) {
+		write_begin(rbtdb);
+	}
+	return (result);
+}
+
+static inline void
+tree_downgrade(dns_rbtdb_t *rbtdb) {
+	write_end(rbtdb);
+	isc_rwlock_downgrade(&rbtdb->tree_lock);
+}
+
 /*
  * Debugging routines
  */
@@ -1147,15 +1359,19 @@ free_rbtdb(dns_rbtdb_t *rbtdb, bool log, isc_event_t *event) {
 	}
 
 	/*
-	 * Clean up LRU / re-signing order lists.
+	 * Clean up the eviction queues.
 	 */
 	if (rbtdb->rdatasets != NULL) {
 		for (i = 0; i < rbtdb->node_lock_count; i++) {
 			INSIST(ISC_LIST_EMPTY(rbtdb->rdatasets[i]));
+			INSIST(rbtdb->hands[i] == NULL);
 		}
 		isc_mem_put(rbtdb->common.mctx, rbtdb->rdatasets,
 			    rbtdb->node_lock_count *
 				    sizeof(rdatasetheaderlist_t));
+		isc_mem_put(rbtdb->common.mctx, rbtdb->hands,
+			    rbtdb->node_lock_count *
+				    sizeof(rdatasetheader_t *));
 	}
 	/*
 	 * Clean up dead node buckets.
@@ -1545,6 +1761,9 @@ free_rdataset(dns_rbtdb_t *rbtdb, isc_mem_t *mctx, rdatasetheader_t *rdataset) {
 	idx = rdataset->node->locknum;
 	if (ISC_LINK_LINKED(rdataset, link)) {
 		INSIST(IS_CACHE(rbtdb));
+		if (rbtdb->hands[idx] == rdataset) {
+			rbtdb->hands[idx] = ISC_LIST_PREV(rdataset, link);
+		}
 		ISC_LIST_UNLINK(rbtdb->rdatasets[idx], rdataset, link);
 	}
 
@@ -1922,7 +2141,7 @@ delete_node(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node) {
 }
 
 /*
- * Caller must be holding the node lock.
+ * Caller must be holding the node lock, or be in a read section.
  */
 static inline void
 new_reference(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
@@ -2152,10 +2371,9 @@ decrement_reference(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 		 * we only do a trylock.
 		 */
 		if (tlock == isc_rwlocktype_read) {
-			result = isc_rwlock_tryupgrade(&rbtdb->tree_lock);
+			result = TREE_TRYUPGRADE(rbtdb);
 		} else {
-			result = isc_rwlock_trylock(&rbtdb->tree_lock,
-						    isc_rwlocktype_write);
+			result = TREE_TRYLOCK(rbtdb);
 		}
 		RUNTIME_CHECK(result == ISC_R_SUCCESS ||
 			      result == ISC_R_LOCKBUSY);
@@ -2220,19 +2438,55 @@ restore_locks:
 	 */
 	if (tlock == isc_rwlocktype_none) {
 		if (write_locked) {
-			RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+			TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
 		}
 	}
 
 	if (tlock == isc_rwlocktype_read) {
 		if (write_locked) {
-			isc_rwlock_downgrade(&rbtdb->tree_lock);
+			TREE_DOWNGRADE(rbtdb);
 		}
 	}
 
 	return (no_reference);
 }
 
+/*
+ * Release a reference to 'node' in a read section, if that can be done
+ * without changing the node (see the easy case in decrement_reference()).
+ * Returns false if the caller has to use decrement_reference() instead.
+ * '*inactivep' is set to true if the node lock became inactive.
+ */
+static bool
+decrement_reference_lockfree(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
+			     bool *inactivep) {
+	rbtdb_nodelock_t *nodelock = &rbtdb->node_locks[node->locknum];
+	uint_fast32_t refs;
+	bool done = false;
+
+	if (!read_begin(rbtdb)) {
+		return (false);
+	}
+
+	if (!node->dirty &&
+	    (node->data != NULL || node == rbtdb->origin_node ||
+	     node == rbtdb->nsec3_origin_node))
+	{
+		if (isc_refcount_decrement(&node->references) == 1) {
+			refs = isc_refcount_decrement(&nodelock->references);
+			INSIST(refs > 0);
+			if (refs == 1 && nodelock->exiting) {
+				*inactivep = true;
+			}
+		}
+		done = true;
+	}
+
+	read_end();
+
+	return (done);
+}
+
 /*
  * Prune the tree by recursively cleaning-up single leaves.  In the worst
  * case, the number of iteration is the number of tree levels, which is at
@@ -2251,7 +2505,7 @@ prune_tree(isc_task_t *task, isc_event_t *event) {
 
 	isc_event_free(&event);
 
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+	TREE_LOCK(rbtdb, isc_rwlocktype_write);
 	locknum = node->locknum;
 	NODE_LOCK(&rbtdb->node_locks[locknum].lock, isc_rwlocktype_write);
 	do {
@@ -2290,7 +2544,7 @@ prune_tree(isc_task_t *task, isc_event_t *event) {
 		node = parent;
 	} while (node != NULL);
 	NODE_UNLOCK(&rbtdb->node_locks[locknum].lock, isc_rwlocktype_write);
-	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
 
 	detach((dns_db_t **)&rbtdb);
 }
@@ -2406,7 +2660,7 @@ setnsec3parameters(dns_db_t *db, rbtdb_version_t *version) {
 	unsigned int count, length;
 	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
 
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_LOCK(rbtdb, isc_rwlocktype_read);
 	version->havensec3 = false;
 	node = rbtdb->origin_node;
 	NODE_LOCK(&(rbtdb->node_locks[node->locknum].lock),
@@ -2477,7 +2731,7 @@ setnsec3parameters(dns_db_t *db, rbtdb_version_t *version) {
 unlock:
 	NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].lock),
 		    isc_rwlocktype_read);
-	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
 }
 
 static void
@@ -2486,7 +2740,7 @@ cleanup_dead_nodes_callback(isc_task_t *task, isc_event_t *event) {
 	bool again = false;
 	unsigned int locknum;
 
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+	TREE_LOCK(rbtdb, isc_rwlocktype_write);
 	for (locknum = 0; locknum < rbtdb->node_lock_count; locknum++) {
 		NODE_LOCK(&rbtdb->node_locks[locknum].lock,
 			  isc_rwlocktype_write);
@@ -2497,7 +2751,7 @@ cleanup_dead_nodes_callback(isc_task_t *task, isc_event_t *event) {
 		NODE_UNLOCK(&rbtdb->node_locks[locknum].lock,
 			    isc_rwlocktype_write);
 	}
-	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
 	if (again) {
 		isc_task_send(task, &event);
 	} else {
@@ -2509,11 +2763,26 @@ cleanup_dead_nodes_callback(isc_task_t *task, isc_event_t *event) {
 	}
 }
 
+/*
+ * Move the remaining buckets of any hash table being grown.  This is
+ * otherwise only done as the trees are modified, so a zone that stops
+ * changing would keep both tables, and check both on every miss.
+ */
+static void
+rehash_finish(dns_rbtdb_t *rbtdb) {
+	TREE_LOCK(rbtdb, isc_rwlocktype_write);
+	dns_rbt_rehashfinish(rbtdb->tree);
+	dns_rbt_rehashfinish(rbtdb->nsec);
+	dns_rbt_rehashfinish(rbtdb->nsec3);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
+}
+
 static void
 closeversion(dns_db_t *db, dns_dbversion_t **versionp, bool commit) {
 	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
 	rbtdb_version_t *version, *cleanup_version, *least_greater;
 	bool rollback = false;
+	bool committed = false;
 	rbtdb_changedlist_t cleanup_list;
 	rdatasetheaderlist_t resigned_list;
 	rbtdb_changed_t *changed, *next_changed;
@@ -2560,7 +2829,11 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, bool commit) {
 			 * The current version is going to be replaced.
 			 * Release the (likely last) reference to it from the
 			 * DB itself and unlink it from the open list.
+			 *
+			 * Read sections use the current version without
+			 * holding a reference to it.
 			 */
+			write_begin(rbtdb);
 			cur_version = rbtdb->current_version;
 			cur_ref = isc_refcount_decrement(
 				&cur_version->references);
@@ -2626,8 +2899,10 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, bool commit) {
 			       0);
 			PREPEND(rbtdb->open_versions, rbtdb->current_version,
 				link);
+			write_end(rbtdb);
 			resigned_list = version->resigned_list;
 			ISC_LIST_INIT(version->resigned_list);
+			committed = true;
 		} else {
 			/*
 			 * We're rolling back this transaction.
@@ -2743,7 +3018,7 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, bool commit) {
 			 * expensive, but this event should be rare enough
 			 * to justify the cost.
 			 */
-			RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+			TREE_LOCK(rbtdb, isc_rwlocktype_write);
 			tlock = isc_rwlocktype_write;
 		}
 
@@ -2779,10 +3054,14 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, bool commit) {
 			isc_refcount_increment(&rbtdb->references);
 			isc_task_send(rbtdb->task, &event);
 		} else {
-			RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+			TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
 		}
 	}
 
+	if (committed) {
+		rehash_finish(rbtdb);
+	}
+
 end:
 	*versionp = NULL;
 }
@@ -2874,11 +3153,11 @@ findnodeintree(dns_rbtdb_t *rbtdb, dns_rbt_t *tree, const dns_name_t *name,
 	INSIST(tree == rbtdb->tree || tree == rbtdb->nsec3);
 
 	dns_name_init(&nodename, NULL);
-	RWLOCK(&rbtdb->tree_lock, locktype);
+	TREE_LOCK(rbtdb, locktype);
 	result = dns_rbt_findnode(tree, name, NULL, &node, NULL,
 				  DNS_RBTFIND_EMPTYDATA, NULL, NULL);
 	if (result != ISC_R_SUCCESS) {
-		RWUNLOCK(&rbtdb->tree_lock, locktype);
+		TREE_UNLOCK(rbtdb, locktype);
 		if (!create) {
 			if (result == DNS_R_PARTIALMATCH) {
 				result = ISC_R_NOTFOUND;
@@ -2890,7 +3169,7 @@ findnodeintree(dns_rbtdb_t *rbtdb, dns_rbt_t *tree, const dns_name_t *name,
 		 * unlocking then relocking.
 		 */
 		locktype = isc_rwlocktype_write;
-		RWLOCK(&rbtdb->tree_lock, locktype);
+		TREE_LOCK(rbtdb, locktype);
 		node = NULL;
 		result = dns_rbt_addnode(tree, name, &node);
 		if (result == ISC_R_SUCCESS) {
@@ -2903,8 +3182,7 @@ findnodeintree(dns_rbtdb_t *rbtdb, dns_rbt_t *tree, const dns_name_t *name,
 					result = add_wildcard_magic(rbtdb,
 								    name);
 					if (result != ISC_R_SUCCESS) {
-						RWUNLOCK(&rbtdb->tree_lock,
-							 locktype);
+						TREE_UNLOCK(rbtdb, locktype);
 						return (result);
 					}
 				}
@@ -2913,7 +3191,7 @@ findnodeintree(dns_rbtdb_t *rbtdb, dns_rbt_t *tree, const dns_name_t *name,
 				node->nsec = DNS_RBT_NSEC_NSEC3;
 			}
 		} else if (result != ISC_R_EXISTS) {
-			RWUNLOCK(&rbtdb->tree_lock, locktype);
+			TREE_UNLOCK(rbtdb, locktype);
 			return (result);
 		}
 	}
@@ -2924,7 +3202,7 @@ findnodeintree(dns_rbtdb_t *rbtdb, dns_rbt_t *tree, const dns_name_t *name,
 
 	reactivate_node(rbtdb, node, locktype);
 
-	RWUNLOCK(&rbtdb->tree_lock, locktype);
+	TREE_UNLOCK(rbtdb, locktype);
 
 	*nodep = (dns_dbnode_t *)node;
 
@@ -2973,8 +3251,10 @@ zone_zonecut_callback(dns_rbtnode_t *node, dns_name_t *name, void *arg) {
 	result = DNS_R_CONTINUE;
 	onode = search->rbtdb->origin_node;
 
-	NODE_LOCK(&(search->rbtdb->node_locks[node->locknum].lock),
-		  isc_rwlocktype_read);
+	if (!search->lockfree) {
+		NODE_LOCK(&(search->rbtdb->node_locks[node->locknum].lock),
+			  isc_rwlocktype_read);
+	}
 
 	/*
 	 * Look for an NS or DNAME rdataset active in our version.
@@ -3044,7 +3324,14 @@ zone_zonecut_callback(dns_rbtnode_t *node, dns_name_t *name, void *arg) {
 		search->zonecut_sigrdataset = NULL;
 	}
 
-	if (found != NULL) {
+	if (found != NULL && search->lockfree) {
+		/*
+		 * Zone cuts are left to the locked search; remember the
+		 * node (without a reference) and stop here.
+		 */
+		search->zonecut = node;
+		result = DNS_R_PARTIALMATCH;
+	} else if (found != NULL) {
 		/*
 		 * We increment the reference count on node to ensure that
 		 * search->zonecut_rdataset will still be valid later.
@@ -3093,8 +3380,10 @@ zone_zonecut_callback(dns_rbtnode_t *node, dns_name_t *name, void *arg) {
 		}
 	}
 
-	NODE_UNLOCK(&(search->rbtdb->node_locks[node->locknum].lock),
-		    isc_rwlocktype_read);
+	if (!search->lockfree) {
+		NODE_UNLOCK(&(search->rbtdb->node_locks[node->locknum].lock),
+			    isc_rwlocktype_read);
+	}
 
 	return (result);
 }
@@ -3974,6 +4263,175 @@ again:
 	return (result);
 }
 
+/*
+ * Look for 'name' in a read section (see read_begin()).  Only the
+ * common cases are handled here: an exact match of a name that exists
+ * in the version and is neither at nor beneath a zone cut or a DNAME.
+ * For anything else, DNS_R_CONTINUE is returned without side effects
+ * and the caller has to search again with the locks held.
+ */
+static isc_result_t
+zone_find_lockfree(dns_rbtdb_t *rbtdb, rbtdb_version_t *version,
+		   const dns_name_t *name, dns_rdatatype_t type,
+		   unsigned int options, dns_dbnode_t **nodep,
+		   dns_name_t *foundname, dns_rdataset_t *rdataset,
+		   dns_rdataset_t *sigrdataset) {
+	dns_rbtnode_t *node = NULL;
+	isc_result_t result;
+	rbtdb_search_t search;
+	bool cname_ok = true;
+	bool empty_node = true;
+	bool secure;
+	rdatasetheader_t *header, *header_next, *found, *nsecheader;
+	rdatasetheader_t *foundsig, *cnamesig, *nsecsig;
+	rbtdb_rdatatype_t sigtype;
+
+	if ((options & (DNS_DBFIND_FORCENSEC | DNS_DBFIND_FORCENSEC3)) != 0) {
+		return (DNS_R_CONTINUE);
+	}
+
+	/*
+	 * The current version can't be replaced during a read section,
+	 * so there's no need to attach to it.
+	 */
+	if (version == NULL) {
+		version = rbtdb->current_version;
+	}
+
+	search.rbtdb = rbtdb;
+	search.rbtversion = version;
+	search.serial = version->serial;
+	search.options = options;
+	search.copy_name = false;
+	search.need_cleanup = false;
+	search.wild = false;
+	search.lockfree = true;
+	search.zonecut = NULL;
+	dns_fixedname_init(&search.zonecut_name);
+	dns_rbtnodechain_init(&search.chain);
+	search.now = 0;
+
+	result = dns_rbt_findnode(rbtdb->tree, name, foundname, &node,
+				  &search.chain, DNS_RBTFIND_EMPTYDATA,
+				  zone_zonecut_callback, &search);
+	dns_rbtnodechain_reset(&search.chain);
+	if (result != ISC_R_SUCCESS || search.zonecut != NULL) {
+		return (DNS_R_CONTINUE);
+	}
+
+	/*
+	 * The node may be a zone cut itself.
+	 */
+	if (node->find_callback && node != rbtdb->origin_node &&
+	    !dns_rdatatype_atparent(type)) {
+		return (DNS_R_CONTINUE);
+	}
+
+	if (type == dns_rdatatype_key || type == dns_rdatatype_nsec) {
+		cname_ok = false;
+	}
+
+	found = NULL;
+	foundsig = NULL;
+	sigtype = RBTDB_RDATATYPE_VALUE(dns_rdatatype_rrsig, type);
+	nsecheader = NULL;
+	nsecsig = NULL;
+	cnamesig = NULL;
+	for (header = node->data; header != NULL; header = header_next) {
+		header_next = header->next;
+		do {
+			if (header->serial <= search.serial && !IGNORE(header))
+			{
+				if (NONEXISTENT(header)) {
+					header = NULL;
+				}
+				break;
+			} else {
+				header = header->down;
+			}
+		} while (header != NULL);
+		if (header == NULL) {
+			continue;
+		}
+
+		empty_node = false;
+		if (header->type == dns_rdatatype_nsec3 &&
+		    !matchparams(header, &search)) {
+			return (DNS_R_CONTINUE);
+		}
+		if (header->type == type || type == dns_rdatatype_any ||
+		    (header->type == dns_rdatatype_cname && cname_ok))
+		{
+			found = header;
+			if (header->type == dns_rdatatype_cname && cname_ok) {
+				if (cnamesig != NULL) {
+					foundsig = cnamesig;
+				} else {
+					sigtype = RBTDB_RDATATYPE_SIGCNAME;
+				}
+			}
+			if (foundsig != NULL) {
+				break;
+			}
+		} else if (header->type == sigtype) {
+			foundsig = header;
+			if (found != NULL) {
+				break;
+			}
+		} else if (header->type == dns_rdatatype_nsec &&
+			   !version->havensec3) {
+			nsecheader = header;
+		} else if (header->type == RBTDB_RDATATYPE_SIGNSEC &&
+			   !version->havensec3) {
+			nsecsig = header;
+		} else if (cname_ok && header->type == RBTDB_RDATATYPE_SIGCNAME)
+		{
+			cnamesig = header;
+		}
+	}
+
+	if (empty_node) {
+		return (DNS_R_CONTINUE);
+	}
+
+	secure = (version->secure == dns_db_secure && !version->havensec3);
+	if (found == NULL) {
+		if (secure && (nsecheader == NULL || nsecsig == NULL)) {
+			return (DNS_R_CONTINUE);
+		}
+		result = DNS_R_NXRRSET;
+	} else if (type != found->type && type != dns_rdatatype_any &&
+		   found->type == dns_rdatatype_cname)
+	{
+		result = DNS_R_CNAME;
+	} else {
+		result = ISC_R_SUCCESS;
+	}
+
+	if (nodep != NULL) {
+		new_reference(rbtdb, node, isc_rwlocktype_read);
+		*nodep = node;
+	}
+
+	if (found == NULL) {
+		if (secure) {
+			bind_rdataset(rbtdb, node, nsecheader, 0,
+				      isc_rwlocktype_read, rdataset);
+			bind_rdataset(rbtdb, node, nsecsig, 0,
+				      isc_rwlocktype_read, sigrdataset);
+		}
+	} else if (type != dns_rdatatype_any) {
+		bind_rdataset(rbtdb, node, found, 0, isc_rwlocktype_read,
+			      rdataset);
+		if (foundsig != NULL) {
+			bind_rdataset(rbtdb, node, foundsig, 0,
+				      isc_rwlocktype_read, sigrdataset);
+		}
+	}
+
+	return (result);
+}
+
 static isc_result_t
 zone_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	  dns_rdatatype_t type, unsigned int options, isc_stdtime_t now,
@@ -4006,6 +4464,16 @@ zone_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	 */
 	UNUSED(now);
 
+	if (read_begin(search.rbtdb)) {
+		result = zone_find_lockfree(search.rbtdb, version, name, type,
+					    options, nodep, foundname,
+					    rdataset, sigrdataset);
+		read_end();
+		if (result != DNS_R_CONTINUE) {
+			return (result);
+		}
+	}
+
 	/*
 	 * If the caller didn't supply a version, attach to the current
 	 * version.
@@ -4021,6 +4489,7 @@ zone_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	search.copy_name = false;
 	search.need_cleanup = false;
 	search.wild = false;
+	search.lockfree = false;
 	search.zonecut = NULL;
 	dns_fixedname_init(&search.zonecut_name);
 	dns_rbtnodechain_init(&search.chain);
@@ -4031,7 +4500,7 @@ zone_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	 */
 	wild = false;
 
-	RWLOCK(&search.rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_LOCK(search.rbtdb, isc_rwlocktype_read);
 
 	/*
 	 * Search down from the root of the tree.  If, while going down, we
@@ -4483,7 +4952,7 @@ node_exit:
 	NODE_UNLOCK(lock, isc_rwlocktype_read);
 
 tree_exit:
-	RWUNLOCK(&search.rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_UNLOCK(search.rbtdb, isc_rwlocktype_read);
 
 	/*
 	 * If we found a zonecut but aren't going to use it, we have to
@@ -4774,25 +5243,9 @@ find_deepest_zonecut(rbtdb_search_t *search, dns_rbtnode_t *node,
 					      search->now, locktype,
 					      sigrdataset);
 			}
-			if (need_headerupdate(found, search->now) ||
-			    (foundsig != NULL &&
-			     need_headerupdate(foundsig, search->now)))
-			{
-				if (locktype != isc_rwlocktype_write) {
-					NODE_UNLOCK(lock, locktype);
-					NODE_LOCK(lock, isc_rwlocktype_write);
-					locktype = isc_rwlocktype_write;
-					POST(locktype);
-				}
-				if (need_headerupdate(found, search->now)) {
-					update_header(search->rbtdb, found,
-						      search->now);
-				}
-				if (foundsig != NULL &&
-				    need_headerupdate(foundsig, search->now)) {
-					update_header(search->rbtdb, foundsig,
-						      search->now);
-				}
+			mark_header_visited(found);
+			if (foundsig != NULL) {
+				mark_header_visited(foundsig);
 			}
 		}
 
@@ -4916,7 +5369,6 @@ cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	rdatasetheader_t *header, *header_prev, *header_next;
 	rdatasetheader_t *found, *nsheader;
 	rdatasetheader_t *foundsig, *nssig, *cnamesig;
-	rdatasetheader_t *update, *updatesig;
 	rdatasetheader_t *nsecheader, *nsecsig;
 	rbtdb_rdatatype_t sigtype, negtype;
 
@@ -4937,14 +5389,13 @@ cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	search.copy_name = false;
 	search.need_cleanup = false;
 	search.wild = false;
+	search.lockfree = false;
 	search.zonecut = NULL;
 	dns_fixedname_init(&search.zonecut_name);
 	dns_rbtnodechain_init(&search.chain);
 	search.now = now;
-	update = NULL;
-	updatesig = NULL;
 
-	RWLOCK(&search.rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_LOCK(search.rbtdb, isc_rwlocktype_read);
 
 	/*
 	 * Search down from the root of the tree.  If, while going down, we
@@ -5117,16 +5568,12 @@ cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 			}
 			bind_rdataset(search.rbtdb, node, nsecheader,
 				      search.now, locktype, rdataset);
-			if (need_headerupdate(nsecheader, search.now)) {
-				update = nsecheader;
-			}
+			mark_header_visited(nsecheader);
 			if (nsecsig != NULL) {
 				bind_rdataset(search.rbtdb, node, nsecsig,
 					      search.now, locktype,
 					      sigrdataset);
-				if (need_headerupdate(nsecsig, search.now)) {
-					updatesig = nsecsig;
-				}
+				mark_header_visited(nsecsig);
 			}
 			result = DNS_R_COVERINGNSEC;
 			goto node_exit;
@@ -5143,16 +5590,12 @@ cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 			}
 			bind_rdataset(search.rbtdb, node, nsheader, search.now,
 				      locktype, rdataset);
-			if (need_headerupdate(nsheader, search.now)) {
-				update = nsheader;
-			}
+			mark_header_visited(nsheader);
 			if (nssig != NULL) {
 				bind_rdataset(search.rbtdb, node, nssig,
 					      search.now, locktype,
 					      sigrdataset);
-				if (need_headerupdate(nssig, search.now)) {
-					updatesig = nssig;
-				}
+				mark_header_visited(nssig);
 			}
 			result = DNS_R_DELEGATION;
 			goto node_exit;
@@ -5204,37 +5647,19 @@ cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	{
 		bind_rdataset(search.rbtdb, node, found, search.now, locktype,
 			      rdataset);
-		if (need_headerupdate(found, search.now)) {
-			update = found;
-		}
+		mark_header_visited(found);
 		if (!NEGATIVE(found) && foundsig != NULL) {
 			bind_rdataset(search.rbtdb, node, foundsig, search.now,
 				      locktype, sigrdataset);
-			if (need_headerupdate(foundsig, search.now)) {
-				updatesig = foundsig;
-			}
+			mark_header_visited(foundsig);
 		}
 	}
 
 node_exit:
-	if ((update != NULL || updatesig != NULL) &&
-	    locktype != isc_rwlocktype_write) {
-		NODE_UNLOCK(lock, locktype);
-		NODE_LOCK(lock, isc_rwlocktype_write);
-		locktype = isc_rwlocktype_write;
-		POST(locktype);
-	}
-	if (update != NULL && need_headerupdate(update, search.now)) {
-		update_header(search.rbtdb, update, search.now);
-	}
-	if (updatesig != NULL && need_headerupdate(updatesig, search.now)) {
-		update_header(search.rbtdb, updatesig, search.now);
-	}
-
 	NODE_UNLOCK(lock, locktype);
 
 tree_exit:
-	RWUNLOCK(&search.rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_UNLOCK(search.rbtdb, isc_rwlocktype_read);
 
 	/*
 	 * If we found a zonecut but aren't going to use it, we have to
@@ -5286,6 +5711,7 @@ cache_findzonecut(dns_db_t *db, const dns_name_t *name, unsigned int options,
 	search.copy_name = false;
 	search.need_cleanup = false;
 	search.wild = false;
+	search.lockfree = false;
 	search.zonecut = NULL;
 	dns_fixedname_init(&search.zonecut_name);
 	dns_rbtnodechain_init(&search.chain);
@@ -5299,7 +5725,7 @@ cache_findzonecut(dns_db_t *db, const dns_name_t *name, unsigned int options,
 		rbtoptions |= DNS_RBTFIND_NOEXACT;
 	}
 
-	RWLOCK(&search.rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_LOCK(search.rbtdb, isc_rwlocktype_read);
 
 	/*
 	 * Search down from the root of the tree.
@@ -5379,28 +5805,15 @@ cache_findzonecut(dns_db_t *db, const dns_name_t *name, unsigned int options,
 			      locktype, sigrdataset);
 	}
 
-	if (need_headerupdate(found, search.now) ||
-	    (foundsig != NULL && need_headerupdate(foundsig, search.now)))
-	{
-		if (locktype != isc_rwlocktype_write) {
-			NODE_UNLOCK(lock, locktype);
-			NODE_LOCK(lock, isc_rwlocktype_write);
-			locktype = isc_rwlocktype_write;
-			POST(locktype);
-		}
-		if (need_headerupdate(found, search.now)) {
-			update_header(search.rbtdb, found, search.now);
-		}
-		if (foundsig != NULL && need_headerupdate(foundsig, search.now))
-		{
-			update_header(search.rbtdb, foundsig, search.now);
-		}
+	mark_header_visited(found);
+	if (foundsig != NULL) {
+		mark_header_visited(foundsig);
 	}
 
 	NODE_UNLOCK(lock, locktype);
 
 tree_exit:
-	RWUNLOCK(&search.rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_UNLOCK(search.rbtdb, isc_rwlocktype_read);
 
 	INSIST(!search.need_cleanup);
 
@@ -5440,18 +5853,20 @@ detachnode(dns_db_t *db, dns_dbnode_t **targetp) {
 	node = (dns_rbtnode_t *)(*targetp);
 	nodelock = &rbtdb->node_locks[node->locknum];
 
-	NODE_LOCK(&nodelock->lock, isc_rwlocktype_read);
+	if (!decrement_reference_lockfree(rbtdb, node, &inactive)) {
+		NODE_LOCK(&nodelock->lock, isc_rwlocktype_read);
 
-	if (decrement_reference(rbtdb, node, 0, isc_rwlocktype_read,
-				isc_rwlocktype_none, false))
-	{
-		if (isc_refcount_current(&nodelock->references) == 0 &&
-		    nodelock->exiting) {
-			inactive = true;
+		if (decrement_reference(rbtdb, node, 0, isc_rwlocktype_read,
+					isc_rwlocktype_none, false))
+		{
+			if (isc_refcount_current(&nodelock->references) == 0 &&
+			    nodelock->exiting) {
+				inactive = true;
+			}
 		}
-	}
 
-	NODE_UNLOCK(&nodelock->lock, isc_rwlocktype_read);
+		NODE_UNLOCK(&nodelock->lock, isc_rwlocktype_read);
+	}
 
 	*targetp = NULL;
 
@@ -5682,21 +6097,32 @@ zone_findrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	rbtdb_serial_t serial;
 	rbtdb_version_t *rbtversion = version;
 	bool close_version = false;
+	bool lockfree;
 	rbtdb_rdatatype_t matchtype, sigmatchtype;
 
 	REQUIRE(VALID_RBTDB(rbtdb));
 	REQUIRE(type != dns_rdatatype_any);
 	INSIST(rbtversion == NULL || rbtversion->rbtdb == rbtdb);
 
-	if (rbtversion == NULL) {
+	/*
+	 * In a read section, neither the node lock nor a reference to
+	 * the current version is needed; see read_begin().
+	 */
+	lockfree = read_begin(rbtdb);
+
+	if (rbtversion == NULL && lockfree) {
+		rbtversion = rbtdb->current_version;
+	} else if (rbtversion == NULL) {
 		currentversion(db, (dns_dbversion_t **)(void *)(&rbtversion));
 		close_version = true;
 	}
 	serial = rbtversion->serial;
 	now = 0;
 
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
-		  isc_rwlocktype_read);
+	if (!lockfree) {
+		NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+			  isc_rwlocktype_read);
+	}
 
 	found = NULL;
 	foundsig = NULL;
@@ -5750,8 +6176,12 @@ zone_findrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		}
 	}
 
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
-		    isc_rwlocktype_read);
+	if (lockfree) {
+		read_end();
+	} else {
+		NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+			    isc_rwlocktype_read);
+	}
 
 	if (close_version) {
 		closeversion(db, (dns_dbversion_t **)(void *)(&rbtversion),
@@ -6745,14 +7175,14 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	INSIST(rbtversion == NULL || rbtversion->rbtdb == rbtdb);
 
 	if (rbtdb->common.methods == &zone_methods) {
-		RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+		TREE_LOCK(rbtdb, isc_rwlocktype_read);
 		REQUIRE(((rbtnode->nsec == DNS_RBT_NSEC_NSEC3 &&
 			  (rdataset->type == dns_rdatatype_nsec3 ||
 			   rdataset->covers == dns_rdatatype_nsec3)) ||
 			 (rbtnode->nsec != DNS_RBT_NSEC_NSEC3 &&
 			  rdataset->type != dns_rdatatype_nsec3 &&
 			  rdataset->covers != dns_rdatatype_nsec3)));
-		RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+		TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
 	}
 
 	if (rbtversion == NULL) {
@@ -6788,7 +7218,6 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	atomic_init(&newheader->count,
 		    atomic_fetch_add_relaxed(&init_count, 1));
 	newheader->trust = rdataset->trust;
-	newheader->last_used = now;
 	newheader->node = rbtnode;
 	if (rbtversion != NULL) {
 		newheader->serial = rbtversion->serial;
@@ -6851,7 +7280,7 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	/*
 	 * Add to the auxiliary NSEC tree if we're adding an NSEC record.
 	 */
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_LOCK(rbtdb, isc_rwlocktype_read);
 	if (rbtnode->nsec != DNS_RBT_NSEC_HAS_NSEC &&
 	    rdataset->type == dns_rdatatype_nsec)
 	{
@@ -6859,7 +7288,7 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	} else {
 		newnsec = false;
 	}
-	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
 
 	/*
 	 * If we're adding a delegation type, adding to the auxiliary NSEC
@@ -6873,7 +7302,7 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	}
 	if (delegating || newnsec || cache_is_overmem) {
 		tree_locked = true;
-		RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+		TREE_LOCK(rbtdb, isc_rwlocktype_write);
 	}
 
 	if (cache_is_overmem) {
@@ -6906,7 +7335,7 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		 * node lock.
 		 */
 		if (tree_locked && !delegating && !newnsec) {
-			RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+			TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
 			tree_locked = false;
 		}
 	}
@@ -6938,7 +7367,7 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		    isc_rwlocktype_write);
 
 	if (tree_locked) {
-		RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+		TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
 	}
 
 	/*
@@ -6971,14 +7400,14 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	REQUIRE(rbtversion != NULL && rbtversion->rbtdb == rbtdb);
 
 	if (rbtdb->common.methods == &zone_methods) {
-		RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+		TREE_LOCK(rbtdb, isc_rwlocktype_read);
 		REQUIRE(((rbtnode->nsec == DNS_RBT_NSEC_NSEC3 &&
 			  (rdataset->type == dns_rdatatype_nsec3 ||
 			   rdataset->covers == dns_rdatatype_nsec3)) ||
 			 (rbtnode->nsec != DNS_RBT_NSEC_NSEC3 &&
 			  rdataset->type != dns_rdatatype_nsec3 &&
 			  rdataset->covers != dns_rdatatype_nsec3)));
-		RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+		TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
 	}
 
 	nodefullname(db, node, nodename);
@@ -7000,7 +7429,6 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	newheader->closest = NULL;
 	atomic_init(&newheader->count,
 		    atomic_fetch_add_relaxed(&init_count, 1));
-	newheader->last_used = 0;
 	newheader->node = rbtnode;
 	if ((rdataset->attributes & DNS_RDATASETATTR_RESIGN) != 0) {
 		RDATASET_ATTR_SET(newheader, RDATASET_ATTR_RESIGN);
@@ -7114,7 +7542,6 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 			newheader->node = rbtnode;
 			newheader->resign = 0;
 			newheader->resign_lsb = 0;
-			newheader->last_used = 0;
 		} else {
 			free_rdataset(rbtdb, rbtdb->common.mctx, newheader);
 			goto unlock;
@@ -7219,7 +7646,6 @@ deleterdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		newheader->serial = 0;
 	}
 	atomic_init(&newheader->count, 0);
-	newheader->last_used = 0;
 	newheader->node = rbtnode;
 
 	nodefullname(db, node, nodename);
@@ -7408,7 +7834,6 @@ loading_addrdataset(void *arg, const dns_name_t *name,
 	newheader->closest = NULL;
 	atomic_init(&newheader->count,
 		    atomic_fetch_add_relaxed(&init_count, 1));
-	newheader->last_used = 0;
 	newheader->node = node;
 	setownercase(newheader, name);
 
@@ -7686,6 +8111,8 @@ endload(dns_db_t *db, dns_rdatacallbacks_t *callbacks) {
 		RBTDB_UNLOCK(&rbtdb->lock, isc_rwlocktype_write);
 	}
 
+	rehash_finish(rbtdb);
+
 	callbacks->add = NULL;
 	callbacks->add_private = NULL;
 	callbacks->deserialize = NULL;
@@ -7982,9 +8409,9 @@ nodecount(dns_db_t *db) {
 
 	REQUIRE(VALID_RBTDB(rbtdb));
 
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_LOCK(rbtdb, isc_rwlocktype_read);
 	count = dns_rbt_nodecount(rbtdb->tree);
-	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
 
 	return (count);
 }
@@ -7998,9 +8425,9 @@ hashsize(dns_db_t *db) {
 
 	REQUIRE(VALID_RBTDB(rbtdb));
 
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_LOCK(rbtdb, isc_rwlocktype_read);
 	size = dns_rbt_hashsize(rbtdb->tree);
-	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
 
 	return (size);
 }
@@ -8014,9 +8441,9 @@ adjusthashsize(dns_db_t *db, size_t size) {
 
 	REQUIRE(VALID_RBTDB(rbtdb));
 
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+	TREE_LOCK(rbtdb, isc_rwlocktype_write);
 	result = dns_rbt_adjusthashsize(rbtdb->tree, size);
-	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
 
 	return (result);
 }
@@ -8200,7 +8627,7 @@ getsigningtime(dns_db_t *db, dns_rdataset_t *rdataset, dns_name_t *foundname) {
 
 	REQUIRE(VALID_RBTDB(rbtdb));
 
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_LOCK(rbtdb, isc_rwlocktype_read);
 
 	for (i = 0; i < rbtdb->node_lock_count; i++) {
 		NODE_LOCK(&rbtdb->node_locks[i].lock, isc_rwlocktype_read);
@@ -8263,7 +8690,7 @@ getsigningtime(dns_db_t *db, dns_rdataset_t *rdataset, dns_name_t *foundname) {
 		result = ISC_R_SUCCESS;
 	}
 
-	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
 
 	return (result);
 }
@@ -8293,7 +8720,7 @@ resigned(dns_db_t *db, dns_rdataset_t *rdataset, dns_dbversion_t *version) {
 		return;
 	}
 
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+	TREE_LOCK(rbtdb, isc_rwlocktype_write);
 	NODE_LOCK(&rbtdb->node_locks[node->locknum].lock, isc_rwlocktype_write);
 	/*
 	 * Delete from heap and save to re-signed list so that it can
@@ -8302,7 +8729,23 @@ resigned(dns_db_t *db, dns_rdataset_t *rdataset, dns_dbversion_t *version) {
 	resign_delete(rbtdb, rbtversion, header);
 	NODE_UNLOCK(&rbtdb->node_locks[node->locknum].lock,
 		    isc_rwlocktype_write);
-	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
+}
+
+bool
+dns__rbtdb_rehashing(dns_db_t *db) {
+	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
+	bool rehashing;
+
+	REQUIRE(VALID_RBTDB(rbtdb));
+
+	TREE_LOCK(rbtdb, isc_rwlocktype_read);
+	rehashing = dns_rbt_rehashing(rbtdb->tree) ||
+		    dns_rbt_rehashing(rbtdb->nsec) ||
+		    dns_rbt_rehashing(rbtdb->nsec3);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
+
+	return (rehashing);
 }
 
 static isc_result_t
@@ -8314,6 +8757,10 @@ setcachestats(dns_db_t *db, isc_stats_t *stats) {
 	REQUIRE(stats != NULL);
 
 	isc_stats_attach(stats, &rbtdb->cachestats);
+
+	TREE_LOCK(rbtdb, isc_rwlocktype_write);
+	dns_rbt_setstats(rbtdb->tree, stats);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
 	return (ISC_R_SUCCESS);
 }
 
@@ -8339,6 +8786,25 @@ getrrsetstats(dns_db_t *db) {
 	return (rbtdb->rrsetstats);
 }
 
+void
+dns__rbtdb_setshard(dns_db_t *db, unsigned int shard,
+		    dns_stats_t *rrsetstats) {
+	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
+
+	REQUIRE(VALID_RBTDB(rbtdb));
+	REQUIRE(IS_CACHE(rbtdb));
+	REQUIRE(rrsetstats != NULL);
+
+	TREE_LOCK(rbtdb, isc_rwlocktype_write);
+	dns_rbt_setshard(rbtdb->tree, shard);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
+
+	if (rbtdb->rrsetstats != NULL) {
+		dns_stats_detach(&rbtdb->rrsetstats);
+	}
+	dns_stats_attach(rrsetstats, &rbtdb->rrsetstats);
+}
+
 static isc_result_t
 nodefullname(dns_db_t *db, dns_dbnode_t *node, dns_name_t *name) {
 	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
@@ -8349,9 +8815,9 @@ nodefullname(dns_db_t *db, dns_dbnode_t *node, dns_name_t *name) {
 	REQUIRE(node != NULL);
 	REQUIRE(name != NULL);
 
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_LOCK(rbtdb, isc_rwlocktype_read);
 	result = dns_rbt_fullnamefromnode(rbtnode, name);
-	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
 
 	return (result);
 }
@@ -8516,6 +8982,8 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *origin, dns_dbtype_t type,
 	}
 	rbtdb->common.rdclass = rdclass;
 	rbtdb->common.mctx = NULL;
+	atomic_init(&rbtdb->writers, 0);
+	atomic_init(&rbtdb->readers, false);
 
 	ISC_LIST_INIT(rbtdb->common.update_listeners);
 
@@ -8561,11 +9029,16 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *origin, dns_dbtype_t type,
 		rbtdb->rdatasets = isc_mem_get(
 			mctx,
 			rbtdb->node_lock_count * sizeof(rdatasetheaderlist_t));
+		rbtdb->hands = isc_mem_get(
+			mctx,
+			rbtdb->node_lock_count * sizeof(rdatasetheader_t *));
 		for (i = 0; i < (int)rbtdb->node_lock_count; i++) {
 			ISC_LIST_INIT(rbtdb->rdatasets[i]);
+			rbtdb->hands[i] = NULL;
 		}
 	} else {
 		rbtdb->rdatasets = NULL;
+		rbtdb->hands = NULL;
 	}
 
 	/*
@@ -8609,6 +9082,7 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *origin, dns_dbtype_t type,
 			}
 			goto cleanup_deadnodes;
 		}
+		rbtdb->node_locks[i].lock.rbtdb = rbtdb;
 		rbtdb->node_locks[i].exiting = false;
 	}
 
@@ -9325,10 +9799,10 @@ flush_deletions(rbtdb_dbiterator_t *rbtdbiter) {
 			      dns_rbt_nodecount(rbtdb->tree));
 
 		if (rbtdbiter->tree_locked == isc_rwlocktype_read) {
-			RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+			TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
 			was_read_locked = true;
 		}
-		RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+		TREE_LOCK(rbtdb, isc_rwlocktype_write);
 		rbtdbiter->tree_locked = isc_rwlocktype_write;
 
 		for (i = 0; i < rbtdbiter->delcnt; i++) {
@@ -9343,9 +9817,9 @@ flush_deletions(rbtdb_dbiterator_t *rbtdbiter) {
 
 		rbtdbiter->delcnt = 0;
 
-		RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+		TREE_UNLOCK(rbtdb, isc_rwlocktype_write);
 		if (was_read_locked) {
-			RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+			TREE_LOCK(rbtdb, isc_rwlocktype_read);
 			rbtdbiter->tree_locked = isc_rwlocktype_read;
 		} else {
 			rbtdbiter->tree_locked = isc_rwlocktype_none;
@@ -9360,7 +9834,7 @@ resume_iteration(rbtdb_dbiterator_t *rbtdbiter) {
 	REQUIRE(rbtdbiter->paused);
 	REQUIRE(rbtdbiter->tree_locked == isc_rwlocktype_none);
 
-	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	TREE_LOCK(rbtdb, isc_rwlocktype_read);
 	rbtdbiter->tree_locked = isc_rwlocktype_read;
 
 	rbtdbiter->paused = false;
@@ -9373,7 +9847,7 @@ dbiterator_destroy(dns_dbiterator_t **iteratorp) {
 	dns_db_t *db = NULL;
 
 	if (rbtdbiter->tree_locked == isc_rwlocktype_read) {
-		RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+		TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
 		rbtdbiter->tree_locked = isc_rwlocktype_none;
 	} else {
 		INSIST(rbtdbiter->tree_locked == isc_rwlocktype_none);
@@ -9767,7 +10241,7 @@ dbiterator_pause(dns_dbiterator_t *iterator) {
 
 	if (rbtdbiter->tree_locked != isc_rwlocktype_none) {
 		INSIST(rbtdbiter->tree_locked == isc_rwlocktype_read);
-		RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+		TREE_UNLOCK(rbtdb, isc_rwlocktype_read);
 		rbtdbiter->tree_locked = isc_rwlocktype_none;
 	}
 
@@ -10498,128 +10972,157 @@ no_glue:
 }
 
 /*%
- * Routines for LRU-based cache management.
+ * Routines for cache eviction.
+ *
+ * Cache entries are evicted with the SIEVE algorithm.  Each bucket has a
+ * queue of headers, to the head of which new headers are added, and a
+ * hand that moves from the tail of the queue towards its head.  A lookup
+ * only sets the VISITED bit of the headers it returns, which it can do
+ * while holding the node lock for reading; the hand clears that bit as it
+ * passes a header, and evicts the first header that hasn't been visited
+ * since the hand last passed it.  Unlike an LRU list, a header is never
+ * moved once it has been queued, and a burst of names that are only
+ * looked up once is evicted before the data that is used repeatedly.
  */
 
 /*%
- * See if a given cache entry that is being reused needs to be updated
- * in the LRU-list.  From the LRU management point of view, this function is
- * expected to return true for almost all cases.  When used with threads,
- * however, this may cause a non-negligible performance penalty because a
- * writer lock will have to be acquired before updating the list.
- * If DNS_RBTDB_LIMITLRUUPDATE is defined to be non 0 at compilation time, this
- * function returns true if the entry has not been updated for some period of
- * time.  We differentiate the NS or glue address case and the others since
- * experiments have shown that the former tends to be accessed relatively
- * infrequently and the cost of cache miss is higher (e.g., a missing NS records
- * may cause external queries at a higher level zone, involving more
- * transactions).
+ * Mark a given cache entry as used, so that the eviction hand passes it
+ * over the next time it reaches it.  Entries that are about to go away
+ * anyway aren't marked.
  *
  * Caller must hold the node (read or write) lock.
  */
-static inline bool
-need_headerupdate(rdatasetheader_t *header, isc_stdtime_t now) {
+static inline void
+mark_header_visited(rdatasetheader_t *header) {
 	if (RDATASET_ATTR_GET(header, (RDATASET_ATTR_NONEXISTENT |
 				       RDATASET_ATTR_ANCIENT |
-				       RDATASET_ATTR_ZEROTTL)) != 0)
+				       RDATASET_ATTR_ZEROTTL |
+				       RDATASET_ATTR_VISITED)) != 0)
 	{
-		return (false);
-	}
-
-#if DNS_RBTDB_LIMITLRUUPDATE
-	if (header->type == dns_rdatatype_ns ||
-	    (header->trust == dns_trust_glue &&
-	     (header->type == dns_rdatatype_a ||
-	      header->type == dns_rdatatype_aaaa)))
-	{
-		/*
-		 * Glue records are updated if at least DNS_RBTDB_LRUUPDATE_GLUE
-		 * seconds have passed since the previous update time.
-		 */
-		return (header->last_used + DNS_RBTDB_LRUUPDATE_GLUE <= now);
+		return;
 	}
 
-	/*
-	 * Other records are updated if DNS_RBTDB_LRUUPDATE_REGULAR seconds
-	 * have passed.
-	 */
-	return (header->last_used + DNS_RBTDB_LRUUPDATE_REGULAR <= now);
-#else
-	UNUSED(now);
-
-	return (true);
-#endif /* if DNS_RBTDB_LIMITLRUUPDATE */
+	RDATASET_ATTR_SET(header, RDATASET_ATTR_VISITED);
 }
 
 /*%
- * Update the timestamp of a given cache entry and move it to the head
- * of the corresponding LRU list.
+ * Move the hand of bucket 'locknum' towards the head of the queue until it
+ * finds a header that hasn't been visited since the hand last passed it,
+ * and expire that header.  Ancient headers are removed from the queue on
+ * the way.  If the hand reaches the head of the queue, it is reset so
+ * that the next call starts over at the tail.
  *
- * Caller must hold the node (write) lock.
+ * Returns true if a header was expired.
  *
- * Note that the we do NOT touch the heap here, as the TTL has not changed.
+ * Caller must hold the node (write) lock of the bucket.
  */
-static void
-update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header, isc_stdtime_t now) {
-	INSIST(IS_CACHE(rbtdb));
+static bool
+sieve_evict(dns_rbtdb_t *rbtdb, unsigned int locknum, bool tree_locked) {
+	rdatasetheaderlist_t *queue = &rbtdb->rdatasets[locknum];
+	rdatasetheader_t *header, *header_prev;
+	uint64_t scanned = 0, spared = 0;
+	bool evicted = false;
 
-	/* To be checked: can we really assume this? XXXMLG */
-	INSIST(ISC_LINK_LINKED(header, link));
+	header = rbtdb->hands[locknum];
+	if (header == NULL) {
+		header = ISC_LIST_TAIL(*queue);
+	}
+
+	while (header != NULL) {
+		scanned++;
+		header_prev = ISC_LIST_PREV(header, link);
+		if (ANCIENT(header)) {
+			ISC_LIST_UNLINK(*queue, header, link);
+		} else if (VISITED(header)) {
+			RDATASET_ATTR_CLR(header, RDATASET_ATTR_VISITED);
+			spared++;
+		} else {
+			/*
+			 * Unlink the entry at this point to avoid checking
+			 * it again even if it's currently used by someone
+			 * else and cannot be purged at this moment.  This
+			 * entry won't be referenced any more (so unlinking is
+			 * safe) since the TTL will be reset to 0.  The hand
+			 * has to be moved first, as expiring the header can
+			 * free other headers of the same node.
+			 */
+			ISC_LIST_UNLINK(*queue, header, link);
+			rbtdb->hands[locknum] = header_prev;
+			expire_header(rbtdb, header, tree_locked, expire_lru);
+			evicted = true;
+			break;
+		}
+		header = header_prev;
+	}
+
+	if (!evicted) {
+		rbtdb->hands[locknum] = NULL;
+	}
 
-	ISC_LIST_UNLINK(rbtdb->rdatasets[header->node->locknum], header, link);
-	header->last_used = now;
-	ISC_LIST_PREPEND(rbtdb->rdatasets[header->node->locknum], header, link);
+	if (rbtdb->cachestats != NULL) {
+		isc_stats_add(rbtdb->cachestats,
+			      dns_cachestatscounter_evictscanned, scanned);
+		isc_stats_add(rbtdb->cachestats,
+			      dns_cachestatscounter_evictspared, spared);
+	}
+
+	return (evicted);
 }
 
 /*%
- * Purge some expired and/or stale (i.e. unused for some period) cache entries
- * under an overmem condition.  To recover from this condition quickly, up to
- * 2 entries will be purged.  This process is triggered while adding a new
- * entry, and we specifically avoid purging entries in the same LRU bucket as
- * the one to which the new entry will belong.  Otherwise, we might purge
- * entries of the same name of different RR types while adding RRsets from a
- * single response (consider the case where we're adding A and AAAA glue records
+ * Purge some expired and/or unused cache entries under an overmem
+ * condition.  To recover from this condition quickly, up to 2 entries will
+ * be purged.  This process is triggered while adding a new entry, and we
+ * specifically avoid purging entries in the same bucket as the one to
+ * which the new entry will belong.  Otherwise, we might purge entries of
+ * the same name of different RR types while adding RRsets from a single
+ * response (consider the case where we're adding A and AAAA glue records
  * of the same NS name).
+ *
+ * The buckets are visited in turn until enough entries have been purged.
+ * A hand that reaches the head of its queue doesn't start over at the
+ * tail before the other buckets have been tried, so that a recently used
+ * entry isn't evicted from a bucket while unused ones are left in
+ * another.  By the third round every hand has passed over its whole
+ * queue once, so only entries used again since then are spared.
  */
 static void
 overmem_purge(dns_rbtdb_t *rbtdb, unsigned int locknum_start, isc_stdtime_t now,
 	      bool tree_locked) {
-	rdatasetheader_t *header, *header_prev;
+	rdatasetheader_t *header;
 	unsigned int locknum;
 	int purgecount = 2;
+	int round;
+	bool queued = true;
+
+	for (round = 0; round < 3 && purgecount > 0 && queued; round++) {
+		queued = false;
+		for (locknum = (locknum_start + 1) % rbtdb->node_lock_count;
+		     locknum != locknum_start && purgecount > 0;
+		     locknum = (locknum + 1) % rbtdb->node_lock_count)
+		{
+			NODE_LOCK(&rbtdb->node_locks[locknum].lock,
+				  isc_rwlocktype_write);
 
-	for (locknum = (locknum_start + 1) % rbtdb->node_lock_count;
-	     locknum != locknum_start && purgecount > 0;
-	     locknum = (locknum + 1) % rbtdb->node_lock_count)
-	{
-		NODE_LOCK(&rbtdb->node_locks[locknum].lock,
-			  isc_rwlocktype_write);
+			header = isc_heap_element(rbtdb->heaps[locknum], 1);
+			if (round == 0 && header != NULL &&
+			    header->rdh_ttl < now - RBTDB_VIRTUAL) {
+				expire_header(rbtdb, header, tree_locked,
+					      expire_ttl);
+				purgecount--;
+			}
 
-		header = isc_heap_element(rbtdb->heaps[locknum], 1);
-		if (header && header->rdh_ttl < now - RBTDB_VIRTUAL) {
-			expire_header(rbtdb, header, tree_locked, expire_ttl);
-			purgecount--;
-		}
+			if (!ISC_LIST_EMPTY(rbtdb->rdatasets[locknum])) {
+				queued = true;
+			}
+			while (purgecount > 0 &&
+			       sieve_evict(rbtdb, locknum, tree_locked)) {
+				purgecount--;
+			}
 
-		for (header = ISC_LIST_TAIL(rbtdb->rdatasets[locknum]);
-		     header != NULL && purgecount > 0; header = header_prev)
-		{
-			header_prev = ISC_LIST_PREV(header, link);
-			/*
-			 * Unlink the entry at this point to avoid checking it
-			 * again even if it's currently used someone else and
-			 * cannot be purged at this moment.  This entry won't be
-			 * referenced any more (so unlinking is safe) since the
-			 * TTL was reset to 0.
-			 */
-			ISC_LIST_UNLINK(rbtdb->rdatasets[locknum], header,
-					link);
-			expire_header(rbtdb, header, tree_locked, expire_lru);
-			purgecount--;
+			NODE_UNLOCK(&rbtdb->node_locks[locknum].lock,
+				    isc_rwlocktype_write);
 		}
-
-		NODE_UNLOCK(&rbtdb->node_locks[locknum].lock,
-			    isc_rwlocktype_write);
 	}
 }
 
@@ -12,6 +12,8 @@
 #ifndef DNS_RBTDB_H
 #define DNS_RBTDB_H 1
 
+#include <stdbool.h>
+
 #include <isc/lang.h>
 
 #include <dns/types.h>
@@ -45,6 +47,35 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *base, dns_dbtype_t type,
  * \li argc == 0 or argv[0] is a valid memory context.
  */
 
+bool
+dns__rbtdb_rehashing(dns_db_t *db);
+/*%<
+ * Return true if the hash table of any tree of the database 'db' of
+ * type "rbt" is being grown.  For testing only.
+ */
+
+void
+dns__rbtdb_setlockfree(bool enable);
+/*%<
+ * Enable or disable lock-free lookups in zone databases, which are
+ * enabled by default.  For benchmarking and testing only.
+ */
+
+void
+dns__rbtdb_setshard(dns_db_t *db, unsigned int shard, dns_stats_t *rrsetstats);
+/*%<
+ * Make the empty cache database 'db' shard number 'shard' of a sharded
+ * cache (see shardcache.h): tag its nodes with 'shard' and keep its
+ * RRset statistics in 'rrsetstats', which all the shards share, instead
+ * of a set of its own.
+ *
+ * Requires:
+ *
+ * \li 'db' is a valid, empty cache database of type "rbt".
+ * \li shard <= DNS_RBT_SHARD_MAX.
+ * \li 'rrsetstats' is a valid set of RRset statistics.
+ */
+
 ISC_LANG_ENDDECLS
 
 #endif /* DNS_RBTDB_H */
@@ -444,6 +444,14 @@ req_send(dns_request_t *request, isc_task_t *task,
 	}
 
 	request->flags |= DNS_REQUEST_F_SENDING;
+	if (sock == NULL) {
+		/*
+		 * The exclusive dispatch uses a netmgr socket, which is
+		 * connected to 'address' already.
+		 */
+		dns_dispatch_send(request->dispentry, &r, task, sendevent);
+		return (ISC_R_SUCCESS);
+	}
 	result = isc_socket_sendto2(sock, &r, task, address, NULL, sendevent,
 				    0);
 	INSIST(result == ISC_R_SUCCESS);
@@ -18,6 +18,7 @@
 #include <isc/atomic.h>
 #include <isc/counter.h>
 #include <isc/log.h>
+#include <isc/netmgr.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/random.h>
@@ -63,6 +64,9 @@
 #include <dns/stats.h>
 #include <dns/tsig.h>
 #include <dns/validator.h>
+
+#include "resolver_p.h"
+
 #ifdef WANT_QUERYTRACE
 #define RTRACE(m)                                                             \
 	isc_log_write(dns_lctx, DNS_LOGCATEGORY_RESOLVER,                     \
@@ -192,11 +196,39 @@
 #define NS_FAIL_LIMIT 4
 #define NS_RR_LIMIT   5
 
-/* Number of hash buckets for zone counters */
+/*
+ * Minimum number of hash buckets for zone counters; there are at least
+ * RES_DOMAIN_BUCKETS_PERTASK per fetch context bucket, so that their
+ * locks are spread as widely as those of the fetch context buckets.
+ */
 #ifndef RES_DOMAIN_BUCKETS
 #define RES_DOMAIN_BUCKETS 523
 #endif /* ifndef RES_DOMAIN_BUCKETS */
-#define RES_NOBUCKET 0xffffffff
+#define RES_DOMAIN_BUCKETS_PERTASK 2
+#define RES_NOBUCKET		   0xffffffff
+
+/*%
+ * Each fetch context bucket indexes its fetch contexts by name in a
+ * hash table of 2^hashbits chains, which is doubled when there are
+ * more than two fetch contexts per chain and halved when there are
+ * fewer than one per eight chains.
+ */
+#define FCTX_HASHBITS_MIN 4
+#define FCTX_HASHBITS_MAX 20
+#define FCTX_HASHINDEX(res, bucket, hashval) \
+	(((hashval) / (res)->nbuckets) & ((1U << (bucket)->hashbits) - 1))
+
+/*%
+ * When hedging is enabled, a query that has had no response within
+ * the time in which its server sends HEDGE_PERCENTILE percent of its
+ * responses is also sent to the next server.  Every query sent earns
+ * 'hedgebudget' credits and a hedged query costs HEDGE_COST, up to
+ * HEDGE_MAXCREDIT, so that hedged queries are at most 'hedgebudget'
+ * percent of the queries sent.
+ */
+#define HEDGE_PERCENTILE 95
+#define HEDGE_COST	 100
+#define HEDGE_MAXCREDIT	 (HEDGE_COST * 100)
 
 /*%
  * Maximum EDNS0 input packet size.
@@ -258,11 +290,18 @@ struct tried {
 #define QUERY_MAGIC	   ISC_MAGIC('Q', '!', '!', '!')
 #define VALID_QUERY(query) ISC_MAGIC_VALID(query, QUERY_MAGIC)
 
-#define RESQUERY_ATTR_CANCELED 0x02
+#define RESQUERY_ATTR_CANCELED  0x02
+#define RESQUERY_ATTR_COALESCED 0x04
+#define RESQUERY_ATTR_HEDGE	0x08
+#define RESQUERY_ATTR_HEDGED	0x10
 
 #define RESQUERY_CONNECTING(q) ((q)->connects > 0)
 #define RESQUERY_CANCELED(q)   (((q)->attributes & RESQUERY_ATTR_CANCELED) != 0)
-#define RESQUERY_SENDING(q)    ((q)->sends > 0)
+#define RESQUERY_COALESCED(q) \
+	(((q)->attributes & RESQUERY_ATTR_COALESCED) != 0)
+#define RESQUERY_HEDGE(q)  (((q)->attributes & RESQUERY_ATTR_HEDGE) != 0)
+#define RESQUERY_HEDGED(q) (((q)->attributes & RESQUERY_ATTR_HEDGED) != 0)
+#define RESQUERY_SENDING(q) ((q)->sends > 0)
 
 typedef enum {
 	fetchstate_init = 0, /*%< Start event has not run yet. */
@@ -286,6 +325,7 @@ struct fetchctx {
 	unsigned int options;
 	unsigned int bucketnum;
 	unsigned int dbucketnum;
+	uint32_t hashval;
 	char *info;
 	isc_mem_t *mctx;
 	isc_stdtime_t now;
@@ -300,6 +340,7 @@ struct fetchctx {
 	bool spilled;
 	isc_event_t control_event;
 	ISC_LINK(struct fetchctx) link;
+	struct fetchctx *hashnext;
 	ISC_LIST(dns_fetchevent_t) events;
 
 	/*% Locked by task event serialization. */
@@ -307,6 +348,7 @@ struct fetchctx {
 	dns_rdataset_t nameservers;
 	atomic_uint_fast32_t attributes;
 	isc_timer_t *timer;
+	isc_timer_t *hedgetimer;
 	isc_time_t expires;
 	isc_interval_t interval;
 	dns_message_t *qmessage;
@@ -454,10 +496,19 @@ struct dns_fetch {
 #define DNS_FETCH_MAGIC	       ISC_MAGIC('F', 't', 'c', 'h')
 #define DNS_FETCH_VALID(fetch) ISC_MAGIC_VALID(fetch, DNS_FETCH_MAGIC)
 
+/*%
+ * Fetch contexts are spread over one bucket per resolver task by the
+ * hash of their name.  The number of buckets is fixed, as each fetch
+ * context runs in the task of its bucket; the name index of a bucket
+ * grows and shrinks with the number of fetch contexts in it instead.
+ */
 typedef struct fctxbucket {
 	isc_task_t *task;
 	isc_mutex_t lock;
 	ISC_LIST(fetchctx_t) fctxs;
+	fetchctx_t **table; /*%< 'fctxs' by name */
+	unsigned int hashbits;
+	unsigned int count;
 	atomic_bool exiting;
 	isc_mem_t *mctx;
 } fctxbucket_t;
@@ -513,6 +564,7 @@ struct dns_resolver {
 	bool exclusivev6;
 	unsigned int nbuckets;
 	fctxbucket_t *buckets;
+	unsigned int ndbuckets;
 	zonebucket_t *dbuckets;
 	uint32_t lame_ttl;
 	ISC_LIST(alternate_t) alternates;
@@ -533,6 +585,7 @@ struct dns_resolver {
 	unsigned int query_timeout;
 	unsigned int maxdepth;
 	unsigned int maxqueries;
+	unsigned int hedgebudget; /* percent */
 	isc_result_t quotaresp[2];
 
 	/* Additions for serve-stale feature. */
@@ -542,6 +595,7 @@ struct dns_resolver {
 	/* Atomic */
 	isc_refcount_t references;
 	atomic_uint_fast32_t zspill; /* fetches-per-zone */
+	atomic_int_fast32_t hedgecredit;
 	atomic_bool exiting;
 	atomic_bool priming;
 
@@ -885,6 +939,28 @@ dec_stats(dns_resolver_t *res, isc_statscounter_t counter) {
 	}
 }
 
+/*%
+ * Lock a fetch context or zone counter bucket, counting in 'counter'
+ * the times it was already locked by another thread.
+ */
+static inline void
+lock_bucket(dns_resolver_t *res, isc_mutex_t *lock,
+	    isc_statscounter_t counter) {
+	if (isc_mutex_trylock(lock) != ISC_R_SUCCESS) {
+		inc_stats(res, counter);
+		LOCK(lock);
+	}
+}
+
+#define LOCK_BUCKET(res, b)                          \
+	lock_bucket((res), &(res)->buckets[(b)].lock, \
+		    dns_resstatscounter_bucketwait)
+#define UNLOCK_BUCKET(res, b) UNLOCK(&(res)->buckets[(b)].lock)
+#define LOCK_DBUCKET(res, dbucket)           \
+	lock_bucket((res), &(dbucket)->lock, \
+		    dns_resstatscounter_zonebucketwait)
+#define UNLOCK_DBUCKET(res, dbucket) UNLOCK(&(dbucket)->lock)
+
 static isc_result_t
 valcreate(fetchctx_t *fctx, dns_message_t *message, dns_adbaddrinfo_t *addrinfo,
 	  dns_name_t *name, dns_rdatatype_t type, dns_rdataset_t *rdataset,
@@ -1188,10 +1264,10 @@ resquery_destroy(resquery_t **queryp) {
 	res = fctx->res;
 	bucket = fctx->bucketnum;
 
-	LOCK(&res->buckets[bucket].lock);
+	LOCK_BUCKET(res, bucket);
 	fctx->nqueries--;
 	empty = fctx_decreference(query->fctx);
-	UNLOCK(&res->buckets[bucket].lock);
+	UNLOCK_BUCKET(res, bucket);
 
 	if (query->rmessage != NULL) {
 		dns_message_detach(&query->rmessage);
@@ -1235,6 +1311,7 @@ fctx_cancelquery(resquery_t **queryp, dns_dispatchevent_t **deventp,
 	dns_adbaddrinfo_t *addrinfo;
 	isc_socket_t *sock;
 	isc_stdtime_t now;
+	isc_time_t tnow;
 
 	query = *queryp;
 	fctx = query->fctx;
@@ -1245,10 +1322,17 @@ fctx_cancelquery(resquery_t **queryp, dns_dispatchevent_t **deventp,
 
 	query->attributes |= RESQUERY_ATTR_CANCELED;
 
+	if (RESQUERY_HEDGE(query)) {
+		query->attributes &= ~RESQUERY_ATTR_HEDGE;
+		(void)isc_timer_reset(fctx->hedgetimer, isc_timertype_inactive,
+				      NULL, NULL, true);
+	}
+
 	/*
-	 * Should we update the RTT?
+	 * Should we update the RTT?  Not if the query wasn't sent because
+	 * it waited for the response to an identical one.
 	 */
-	if (finish != NULL || no_response) {
+	if ((finish != NULL || no_response) && !RESQUERY_COALESCED(query)) {
 		if (finish != NULL) {
 			/*
 			 * We have both the start and finish times for this
@@ -1257,6 +1341,7 @@ fctx_cancelquery(resquery_t **queryp, dns_dispatchevent_t **deventp,
 			rtt = (unsigned int)isc_time_microdiff(finish,
 							       &query->start);
 			factor = DNS_ADB_RTTADJDEFAULT;
+			dns_adb_samplertt(fctx->adb, query->addrinfo, rtt);
 
 			rttms = rtt / 1000;
 			if (rttms < DNS_RESOLVER_QRYRTTCLASS0) {
@@ -1278,6 +1363,22 @@ fctx_cancelquery(resquery_t **queryp, dns_dispatchevent_t **deventp,
 				inc_stats(fctx->res,
 					  dns_resstatscounter_queryrtt5);
 			}
+		} else if (RESQUERY_HEDGED(query)) {
+			/*
+			 * This query was hedged and is canceled before it
+			 * timed out, usually because the other server has
+			 * answered first.  Its response would have taken at
+			 * least as long as we waited, so count that rather
+			 * than treating it as a timeout, or the slow
+			 * responses would vanish from the histogram of the
+			 * server.
+			 */
+			TIME_NOW(&tnow);
+			rtt = (unsigned int)isc_time_microdiff(&tnow,
+							       &query->start);
+			dns_adb_samplertt(fctx->adb, query->addrinfo, rtt);
+			rtt = ISC_MAX(rtt, query->addrinfo->srtt);
+			factor = DNS_ADB_RTTADJDEFAULT;
 		} else {
 			uint32_t value;
 			uint32_t mask;
@@ -1584,11 +1685,11 @@ fcount_incr(fetchctx_t *fctx, bool force) {
 
 	INSIST(fctx->dbucketnum == RES_NOBUCKET);
 	bucketnum = dns_name_fullhash(&fctx->domain, false) %
-		    RES_DOMAIN_BUCKETS;
+		    fctx->res->ndbuckets;
 
 	dbucket = &fctx->res->dbuckets[bucketnum];
 
-	LOCK(&dbucket->lock);
+	LOCK_DBUCKET(fctx->res, dbucket);
 	for (counter = ISC_LIST_HEAD(dbucket->list); counter != NULL;
 	     counter = ISC_LIST_NEXT(counter, link))
 	{
@@ -1621,7 +1722,7 @@ fcount_incr(fetchctx_t *fctx, bool force) {
 			counter->allowed++;
 		}
 	}
-	UNLOCK(&dbucket->lock);
+	UNLOCK_DBUCKET(fctx->res, dbucket);
 
 	if (result == ISC_R_SUCCESS) {
 		fctx->dbucketnum = bucketnum;
@@ -1643,7 +1744,7 @@ fcount_decr(fetchctx_t *fctx) {
 
 	dbucket = &fctx->res->dbuckets[fctx->dbucketnum];
 
-	LOCK(&dbucket->lock);
+	LOCK_DBUCKET(fctx->res, dbucket);
 	for (counter = ISC_LIST_HEAD(dbucket->list); counter != NULL;
 	     counter = ISC_LIST_NEXT(counter, link))
 	{
@@ -1663,7 +1764,7 @@ fcount_decr(fetchctx_t *fctx) {
 		}
 	}
 
-	UNLOCK(&dbucket->lock);
+	UNLOCK_DBUCKET(fctx->res, dbucket);
 }
 
 static inline void
@@ -1786,13 +1887,13 @@ fctx_done(fetchctx_t *fctx, isc_result_t result, int line) {
 
 	fctx_stopqueries(fctx, no_response, age_untried);
 
-	LOCK(&res->buckets[fctx->bucketnum].lock);
+	LOCK_BUCKET(res, fctx->bucketnum);
 
 	fctx->state = fetchstate_done;
 	FCTX_ATTR_CLR(fctx, FCTX_ATTR_ADDRWAIT);
 	fctx_sendevents(fctx, result, line);
 
-	UNLOCK(&res->buckets[fctx->bucketnum].lock);
+	UNLOCK_BUCKET(res, fctx->bucketnum);
 }
 
 static void
@@ -1976,6 +2077,41 @@ fctx_setretryinterval(fetchctx_t *fctx, unsigned int rtt) {
 	isc_interval_set(&fctx->interval, seconds, us * 1000);
 }
 
+/*
+ * Arrange for 'query' to be hedged if its server does not respond
+ * within the time it usually takes.
+ */
+static void
+fctx_starthedgetimer(fetchctx_t *fctx, resquery_t *query) {
+	isc_interval_t interval;
+	isc_result_t result;
+	unsigned int rtt;
+	uint64_t retry;
+
+	result = dns_adb_getrttpercentile(fctx->adb, query->addrinfo,
+					  HEDGE_PERCENTILE, &rtt);
+	if (result != ISC_R_SUCCESS) {
+		return;
+	}
+
+	/*
+	 * No point in hedging if the query will be retried first.
+	 */
+	retry = (uint64_t)fctx->interval.seconds * US_PER_SEC +
+		fctx->interval.nanoseconds / 1000;
+	if (rtt >= retry) {
+		return;
+	}
+
+	isc_interval_set(&interval, rtt / US_PER_SEC,
+			 (rtt % US_PER_SEC) * 1000);
+	result = isc_timer_reset(fctx->hedgetimer, isc_timertype_once, NULL,
+				 &interval, true);
+	if (result == ISC_R_SUCCESS) {
+		query->attributes |= RESQUERY_ATTR_HEDGE;
+	}
+}
+
 static isc_result_t
 fctx_query(fetchctx_t *fctx, dns_adbaddrinfo_t *addrinfo,
 	   unsigned int options) {
@@ -2221,11 +2357,26 @@ fctx_query(fetchctx_t *fctx, dns_adbaddrinfo_t *addrinfo,
 
 	fctx->querysent++;
 
+	if (fctx->hedgetimer != NULL) {
+		int_fast32_t credit;
+
+		credit = atomic_fetch_add_relaxed(&res->hedgecredit,
+						  res->hedgebudget);
+		if (credit + (int_fast32_t)res->hedgebudget > HEDGE_MAXCREDIT) {
+			atomic_fetch_sub_relaxed(&res->hedgecredit,
+						 res->hedgebudget);
+		}
+		if (ISC_LIST_EMPTY(fctx->queries) &&
+		    (query->options & DNS_FETCHOPT_TCP) == 0) {
+			fctx_starthedgetimer(fctx, query);
+		}
+	}
+
 	ISC_LIST_APPEND(fctx->queries, query, link);
 	bucketnum = fctx->bucketnum;
-	LOCK(&res->buckets[bucketnum].lock);
+	LOCK_BUCKET(res, bucketnum);
 	fctx->nqueries++;
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK_BUCKET(res, bucketnum);
 	if (isc_sockaddr_pf(&addrinfo->sockaddr) == PF_INET) {
 		inc_stats(res, dns_resstatscounter_queryv4);
 	} else {
@@ -2833,6 +2984,21 @@ resquery_send(resquery_t *query) {
 	 */
 	dns_message_reset(fctx->qmessage, DNS_MESSAGE_INTENTRENDER);
 
+	/*
+	 * If an identical query has already been sent to this server and
+	 * is waiting for its response, wait for that response instead.
+	 * TSIG-signed queries never match, as the signature covers the
+	 * message ID.
+	 */
+	if (!tcp && query->tsigkey == NULL) {
+		isc_buffer_usedregion(&query->buffer, &r);
+		if (dns_dispatch_coalesce(query->dispentry, &r)) {
+			query->attributes |= RESQUERY_ATTR_COALESCED;
+			QTRACE("coalesced");
+			return (ISC_R_SUCCESS);
+		}
+	}
+
 	sock = query2sock(query);
 
 	/*
@@ -2840,7 +3006,7 @@ resquery_send(resquery_t *query) {
 	 */
 	if (!tcp) {
 		address = &query->addrinfo->sockaddr;
-		if (query->exclusivesocket) {
+		if (query->exclusivesocket && sock != NULL) {
 			result = isc_socket_connect(sock, address, task,
 						    resquery_udpconnected,
 						    query);
@@ -2872,9 +3038,19 @@ resquery_send(resquery_t *query) {
 		}
 	}
 
-	result = isc_socket_sendto2(sock, &r, task, address, NULL,
-				    &query->sendevent, 0);
-	INSIST(result == ISC_R_SUCCESS);
+	if (sock == NULL) {
+		/*
+		 * The dispatch socket is a netmgr socket, which is
+		 * already connected to the server.
+		 */
+		INSIST(query->exclusivesocket);
+		dns_dispatch_send(query->dispentry, &r, task,
+				  &query->sendevent);
+	} else {
+		result = isc_socket_sendto2(sock, &r, task, address, NULL,
+					    &query->sendevent, 0);
+		INSIST(result == ISC_R_SUCCESS);
+	}
 
 	query->sends++;
 
@@ -2890,8 +3066,12 @@ resquery_send(resquery_t *query) {
 		dtmsgtype = DNS_DTTYPE_RQ;
 	}
 
-	result = isc_socket_getsockname(sock, &localaddr);
-	if (result == ISC_R_SUCCESS) {
+	if (sock == NULL) {
+		localaddr = isc_nmhandle_localaddr(
+			dns_dispatch_getentryhandle(query->dispentry));
+		la = &localaddr;
+	} else if (isc_socket_getsockname(sock, &localaddr) == ISC_R_SUCCESS)
+	{
 		la = &localaddr;
 	}
 
@@ -3098,7 +3278,7 @@ fctx_finddone(isc_task_t *task, isc_event_t *event) {
 	FCTXTRACE("finddone");
 
 	bucketnum = fctx->bucketnum;
-	LOCK(&res->buckets[bucketnum].lock);
+	LOCK_BUCKET(res, bucketnum);
 
 	INSIST(fctx->pending > 0);
 	fctx->pending--;
@@ -3131,7 +3311,7 @@ fctx_finddone(isc_task_t *task, isc_event_t *event) {
 			dodestroy = true;
 		}
 	}
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK_BUCKET(res, bucketnum);
 
 	isc_event_free(&event);
 	dns_adb_destroyfind(&find);
@@ -4221,9 +4401,9 @@ fctx_try(fetchctx_t *fctx, bool retrying, bool badcache) {
 			options, 0, fctx->qc, task, resume_qmin, fctx,
 			&fctx->qminrrset, NULL, &fctx->qminfetch);
 		if (result != ISC_R_SUCCESS) {
-			LOCK(&fctx->res->buckets[fctx->bucketnum].lock);
+			LOCK_BUCKET(fctx->res, fctx->bucketnum);
 			RUNTIME_CHECK(!fctx_decreference(fctx));
-			UNLOCK(&fctx->res->buckets[fctx->bucketnum].lock);
+			UNLOCK_BUCKET(fctx->res, fctx->bucketnum);
 			fctx_done(fctx, DNS_R_SERVFAIL, __LINE__);
 		}
 		return;
@@ -4243,9 +4423,9 @@ fctx_try(fetchctx_t *fctx, bool retrying, bool badcache) {
 	result = fctx_query(fctx, addrinfo, fctx->options);
 	if (result != ISC_R_SUCCESS) {
 		fctx_done(fctx, result, __LINE__);
-		LOCK(&res->buckets[bucketnum].lock);
+		LOCK_BUCKET(res, bucketnum);
 		bucket_empty = fctx_decreference(fctx);
-		UNLOCK(&res->buckets[bucketnum].lock);
+		UNLOCK_BUCKET(res, bucketnum);
 		if (bucket_empty) {
 			empty_bucket(res);
 		}
@@ -4295,13 +4475,13 @@ resume_qmin(isc_task_t *task, isc_event_t *event) {
 
 	dns_resolver_destroyfetch(&fctx->qminfetch);
 
-	LOCK(&res->buckets[bucketnum].lock);
+	LOCK_BUCKET(res, bucketnum);
 	if (SHUTTINGDOWN(fctx)) {
 		maybe_destroy(fctx, true);
-		UNLOCK(&res->buckets[bucketnum].lock);
+		UNLOCK_BUCKET(res, bucketnum);
 		goto cleanup;
 	}
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK_BUCKET(res, bucketnum);
 
 	/*
 	 * Note: fevent->rdataset must be disassociated and
@@ -4403,17 +4583,74 @@ resume_qmin(isc_task_t *task, isc_event_t *event) {
 cleanup:
 	INSIST(event == NULL);
 	INSIST(fevent == NULL);
-	LOCK(&res->buckets[bucketnum].lock);
+	LOCK_BUCKET(res, bucketnum);
 	bucket_empty = fctx_decreference(fctx);
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK_BUCKET(res, bucketnum);
 	if (bucket_empty) {
 		empty_bucket(res);
 	}
 }
 
+/*
+ * Rebuild the name index of 'bucket' with 2^'hashbits' chains.
+ *
+ * Caller must be holding the bucket lock.
+ */
+static void
+fctx_hashresize(dns_resolver_t *res, fctxbucket_t *bucket,
+		unsigned int hashbits) {
+	fetchctx_t *fctx;
+	unsigned int i;
+
+	isc_mem_put(bucket->mctx, bucket->table,
+		    sizeof(bucket->table[0]) << bucket->hashbits);
+	bucket->hashbits = hashbits;
+	bucket->table = isc_mem_get(bucket->mctx, sizeof(bucket->table[0])
+							  << hashbits);
+	memset(bucket->table, 0, sizeof(bucket->table[0]) << hashbits);
+
+	for (fctx = ISC_LIST_HEAD(bucket->fctxs); fctx != NULL;
+	     fctx = ISC_LIST_NEXT(fctx, link))
+	{
+		i = FCTX_HASHINDEX(res, bucket, fctx->hashval);
+		fctx->hashnext = bucket->table[i];
+		bucket->table[i] = fctx;
+	}
+
+	inc_stats(res, dns_resstatscounter_bucketresize);
+}
+
+/*
+ * Add 'fctx' to its bucket.
+ *
+ * Caller must be holding the bucket lock.
+ */
+static void
+fctx_link(fetchctx_t *fctx) {
+	dns_resolver_t *res = fctx->res;
+	fctxbucket_t *bucket = &res->buckets[fctx->bucketnum];
+	unsigned int i;
+
+	ISC_LIST_APPEND(bucket->fctxs, fctx, link);
+	bucket->count++;
+
+	if (bucket->count > (2U << bucket->hashbits) &&
+	    bucket->hashbits < FCTX_HASHBITS_MAX)
+	{
+		/* Also links 'fctx'. */
+		fctx_hashresize(res, bucket, bucket->hashbits + 1);
+	} else {
+		i = FCTX_HASHINDEX(res, bucket, fctx->hashval);
+		fctx->hashnext = bucket->table[i];
+		bucket->table[i] = fctx;
+	}
+}
+
 static bool
 fctx_unlink(fetchctx_t *fctx) {
 	dns_resolver_t *res;
+	fctxbucket_t *bucket;
+	fetchctx_t **fctxp;
 	unsigned int bucketnum;
 
 	/*
@@ -4436,8 +4673,22 @@ fctx_unlink(fetchctx_t *fctx) {
 
 	res = fctx->res;
 	bucketnum = fctx->bucketnum;
+	bucket = &res->buckets[bucketnum];
 
-	ISC_LIST_UNLINK(res->buckets[bucketnum].fctxs, fctx, link);
+	ISC_LIST_UNLINK(bucket->fctxs, fctx, link);
+	fctxp = &bucket->table[FCTX_HASHINDEX(res, bucket, fctx->hashval)];
+	while (*fctxp != fctx) {
+		fctxp = &(*fctxp)->hashnext;
+	}
+	*fctxp = fctx->hashnext;
+	fctx->hashnext = NULL;
+	bucket->count--;
+
+	if (bucket->count < (1U << bucket->hashbits) / 8 &&
+	    bucket->hashbits > FCTX_HASHBITS_MIN)
+	{
+		fctx_hashresize(res, bucket, bucket->hashbits - 1);
+	}
 
 	INSIST(atomic_fetch_sub_release(&res->nfctx, 1) > 0);
 
@@ -4497,6 +4748,9 @@ fctx_destroy(fetchctx_t *fctx) {
 	isc_counter_detach(&fctx->qc);
 	fcount_decr(fctx);
 	isc_timer_detach(&fctx->timer);
+	if (fctx->hedgetimer != NULL) {
+		isc_timer_detach(&fctx->hedgetimer);
+	}
 	dns_message_detach(&fctx->qmessage);
 	if (dns_name_countlabels(&fctx->domain) > 0) {
 		dns_name_free(&fctx->domain, fctx->mctx);
@@ -4552,6 +4806,19 @@ fctx_timeout(isc_task_t *task, isc_event_t *event) {
 		if (query != NULL &&
 		    isc_time_compare(&tevent->due, &query->start) >= 0) {
 			FCTXTRACE("query timed out; no response");
+			/*
+			 * Count the time waited in the histogram of the
+			 * server, so that its percentiles keep up with it
+			 * when it stops responding, and treat the query as
+			 * timed out even if it has been hedged.
+			 */
+			if (!RESQUERY_COALESCED(query)) {
+				dns_adb_samplertt(
+					fctx->adb, query->addrinfo,
+					(unsigned int)isc_time_microdiff(
+						&tevent->due, &query->start));
+			}
+			query->attributes &= ~RESQUERY_ATTR_HEDGED;
 			fctx_cancelquery(&query, NULL, NULL, true, false);
 		}
 		FCTX_ATTR_CLR(fctx, FCTX_ATTR_ADDRWAIT);
@@ -4572,6 +4839,125 @@ fctx_timeout(isc_task_t *task, isc_event_t *event) {
 	isc_event_free(&event);
 }
 
+/*
+ * Return the next address to send a hedged query to, if any.
+ */
+static dns_adbaddrinfo_t *
+fctx_nexthedge(fetchctx_t *fctx) {
+	dns_adbaddrinfo_t *addrinfo;
+
+	if (!fctx->forwarding) {
+		addrinfo = fctx_nextaddress(fctx);
+		while (addrinfo != NULL &&
+		       dns_adbentry_overquota(addrinfo->entry)) {
+			addrinfo = fctx_nextaddress(fctx);
+		}
+		return (addrinfo);
+	}
+
+	/*
+	 * Only hedge a query to a forwarder with another forwarder:
+	 * fctx_nextaddress() would stop forwarding when there are none
+	 * left, while the first query is still waiting for a response.
+	 */
+	for (addrinfo = ISC_LIST_HEAD(fctx->forwaddrs); addrinfo != NULL;
+	     addrinfo = ISC_LIST_NEXT(addrinfo, publink))
+	{
+		if (!UNMARKED(addrinfo)) {
+			continue;
+		}
+		possibly_mark(fctx, addrinfo);
+		if (UNMARKED(addrinfo)) {
+			addrinfo->flags |= FCTX_ADDRINFO_MARK;
+			if (!dns_adbentry_overquota(addrinfo->entry)) {
+				return (addrinfo);
+			}
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * The first query to a server has had no response within the time in
+ * which that server usually responds.  If the budget allows, send the
+ * query to the next server as well, without canceling the first one,
+ * and use whichever response comes first.
+ */
+static void
+fctx_hedgetimeout(isc_task_t *task, isc_event_t *event) {
+	fetchctx_t *fctx = event->ev_arg;
+	isc_timerevent_t *tevent = (isc_timerevent_t *)event;
+	dns_adbaddrinfo_t *addrinfo;
+	dns_resolver_t *res;
+	resquery_t *query;
+	unsigned int bucketnum;
+	int_fast32_t credit;
+	isc_result_t result;
+	bool bucket_empty;
+
+	REQUIRE(VALID_FCTX(fctx));
+
+	UNUSED(task);
+
+	res = fctx->res;
+
+	/*
+	 * Ignore the event if the query it was set for has already
+	 * been answered or canceled.
+	 */
+	query = ISC_LIST_HEAD(fctx->queries);
+	if (query == NULL || !RESQUERY_HEDGE(query) ||
+	    ISC_LIST_NEXT(query, link) != NULL ||
+	    isc_time_compare(&tevent->due, &query->start) < 0)
+	{
+		isc_event_free(&event);
+		return;
+	}
+	isc_event_free(&event);
+
+	query->attributes &= ~RESQUERY_ATTR_HEDGE;
+
+	credit = atomic_load_relaxed(&res->hedgecredit);
+	do {
+		if (credit < HEDGE_COST) {
+			return;
+		}
+	} while (!atomic_compare_exchange_weak_relaxed(
+		&res->hedgecredit, &credit, credit - HEDGE_COST));
+
+	addrinfo = fctx_nexthedge(fctx);
+	if (addrinfo == NULL ||
+	    isc_counter_increment(fctx->qc) != ISC_R_SUCCESS) {
+		atomic_fetch_add_relaxed(&res->hedgecredit, HEDGE_COST);
+		return;
+	}
+
+	FCTXTRACE("hedge");
+
+	fctx_increference(fctx);
+	result = fctx_query(fctx, addrinfo, fctx->options);
+	if (result == ISC_R_SUCCESS) {
+		query->attributes |= RESQUERY_ATTR_HEDGED;
+		inc_stats(res, dns_resstatscounter_hedged);
+		return;
+	}
+
+	/*
+	 * The first query is still outstanding, and still holds
+	 * a reference to 'fctx'; restore its idle timer.
+	 */
+	bucketnum = fctx->bucketnum;
+	LOCK_BUCKET(res, bucketnum);
+	bucket_empty = fctx_decreference(fctx);
+	UNLOCK_BUCKET(res, bucketnum);
+	INSIST(!bucket_empty);
+	result = fctx_startidletimer(fctx, &fctx->interval);
+	if (result != ISC_R_SUCCESS) {
+		fctx_done(fctx, result, __LINE__);
+	}
+}
+
 static void
 fctx_shutdown(fetchctx_t *fctx) {
 	isc_event_t *cevent;
@@ -4654,7 +5040,7 @@ fctx_doshutdown(isc_task_t *task, isc_event_t *event) {
 	fctx_stopqueries(fctx, false, false);
 	fctx_cleanupall(fctx);
 
-	LOCK(&res->buckets[bucketnum].lock);
+	LOCK_BUCKET(res, bucketnum);
 
 	FCTX_ATTR_SET(fctx, FCTX_ATTR_SHUTTINGDOWN);
 
@@ -4675,7 +5061,7 @@ fctx_doshutdown(isc_task_t *task, isc_event_t *event) {
 		dodestroy = true;
 	}
 
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK_BUCKET(res, bucketnum);
 
 	if (dodestroy) {
 		fctx_destroy(fctx);
@@ -4702,7 +5088,7 @@ fctx_start(isc_task_t *task, isc_event_t *event) {
 
 	FCTXTRACE("start");
 
-	LOCK(&res->buckets[bucketnum].lock);
+	LOCK_BUCKET(res, bucketnum);
 
 	INSIST(fctx->state == fetchstate_init);
 	if (fctx->want_shutdown) {
@@ -4742,7 +5128,7 @@ fctx_start(isc_task_t *task, isc_event_t *event) {
 			       NULL, NULL, NULL);
 	}
 
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK_BUCKET(res, bucketnum);
 
 	if (!done) {
 		isc_result_t result;
@@ -4895,6 +5281,7 @@ fctx_create(dns_resolver_t *res, const dns_name_t *name, dns_rdatatype_t type,
 	fctx->res = res;
 	isc_refcount_init(&fctx->references, 0);
 	fctx->bucketnum = bucketnum;
+	fctx->hashval = dns_name_fullhash(name, false);
 	fctx->dbucketnum = RES_NOBUCKET;
 	fctx->state = fetchstate_init;
 	fctx->want_shutdown = false;
@@ -5092,6 +5479,24 @@ fctx_create(dns_resolver_t *res, const dns_name_t *name, dns_rdatatype_t type,
 		goto cleanup_qmessage;
 	}
 
+	/*
+	 * The hedging timer is only needed if hedging is enabled.
+	 */
+	fctx->hedgetimer = NULL;
+	if (res->hedgebudget > 0) {
+		iresult = isc_timer_create(
+			res->timermgr, isc_timertype_inactive, NULL, NULL,
+			res->buckets[bucketnum].task, fctx_hedgetimeout, fctx,
+			&fctx->hedgetimer);
+		if (iresult != ISC_R_SUCCESS) {
+			UNEXPECTED_ERROR(__FILE__, __LINE__,
+					 "isc_timer_create: %s",
+					 isc_result_totext(iresult));
+			result = ISC_R_UNEXPECTED;
+			goto cleanup_timer;
+		}
+	}
+
 	/*
 	 * Attach to the view's cache and adb.
 	 */
@@ -5120,7 +5525,7 @@ fctx_create(dns_resolver_t *res, const dns_name_t *name, dns_rdatatype_t type,
 		}
 	}
 
-	ISC_LIST_APPEND(res->buckets[bucketnum].fctxs, fctx, link);
+	fctx_link(fctx);
 
 	INSIST(atomic_fetch_add_relaxed(&res->nfctx, 1) < UINT32_MAX);
 
@@ -5135,6 +5540,11 @@ cleanup_mctx:
 	isc_mem_detach(&fctx->mctx);
 	dns_adb_detach(&fctx->adb);
 	dns_db_detach(&fctx->cache);
+	if (fctx->hedgetimer != NULL) {
+		isc_timer_detach(&fctx->hedgetimer);
+	}
+
+cleanup_timer:
 	isc_timer_detach(&fctx->timer);
 
 cleanup_qmessage:
@@ -5399,7 +5809,7 @@ maybe_destroy(fetchctx_t *fctx, bool locked) {
 
 	bucketnum = fctx->bucketnum;
 	if (!locked) {
-		LOCK(&res->buckets[bucketnum].lock);
+		LOCK_BUCKET(res, bucketnum);
 	}
 
 	REQUIRE(SHUTTINGDOWN(fctx));
@@ -5423,7 +5833,7 @@ maybe_destroy(fetchctx_t *fctx, bool locked) {
 	}
 unlock:
 	if (!locked) {
-		UNLOCK(&res->buckets[bucketnum].lock);
+		UNLOCK_BUCKET(res, bucketnum);
 	}
 	if (dodestroy) {
 		fctx_destroy(fctx);
@@ -5480,11 +5890,11 @@ validated(isc_task_t *task, isc_event_t *event) {
 	FCTXTRACE("received validation completion event");
 
 	bucketnum = fctx->bucketnum;
-	LOCK(&res->buckets[bucketnum].lock);
+	LOCK_BUCKET(res, bucketnum);
 
 	ISC_LIST_UNLINK(fctx->validators, vevent->validator, link);
 	fctx->validator = NULL;
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK_BUCKET(res, bucketnum);
 
 	/*
 	 * Destroy the validator early so that we can
@@ -5501,7 +5911,7 @@ validated(isc_task_t *task, isc_event_t *event) {
 
 	negative = (vevent->rdataset == NULL);
 
-	LOCK(&res->buckets[bucketnum].lock);
+	LOCK_BUCKET(res, bucketnum);
 	sentresponse = ((fctx->options & DNS_FETCHOPT_NOVALIDATE) != 0);
 
 	/*
@@ -5512,7 +5922,7 @@ validated(isc_task_t *task, isc_event_t *event) {
 	if (SHUTTINGDOWN(fctx) && !sentresponse) {
 		bool bucket_empty;
 		bucket_empty = maybe_destroy(fctx, true);
-		UNLOCK(&res->buckets[bucketnum].lock);
+		UNLOCK_BUCKET(res, bucketnum);
 		if (bucket_empty) {
 			empty_bucket(res);
 		}
@@ -5615,7 +6025,7 @@ validated(isc_task_t *task, isc_event_t *event) {
 		result = fctx->vresult;
 		add_bad(fctx, message, addrinfo, result, badns_validation);
 		isc_event_free(&event);
-		UNLOCK(&res->buckets[bucketnum].lock);
+		UNLOCK_BUCKET(res, bucketnum);
 		INSIST(fctx->validator == NULL);
 		fctx->validator = ISC_LIST_HEAD(fctx->validators);
 		if (fctx->validator != NULL) {
@@ -5766,7 +6176,7 @@ validated(isc_task_t *task, isc_event_t *event) {
 		if (SHUTTINGDOWN(fctx)) {
 			bucket_empty = maybe_destroy(fctx, true);
 		}
-		UNLOCK(&res->buckets[bucketnum].lock);
+		UNLOCK_BUCKET(res, bucketnum);
 		if (bucket_empty) {
 			empty_bucket(res);
 		}
@@ -5784,7 +6194,7 @@ validated(isc_task_t *task, isc_event_t *event) {
 		 * be validated.
 		 */
 		dns_db_detachnode(fctx->cache, &node);
-		UNLOCK(&res->buckets[bucketnum].lock);
+		UNLOCK_BUCKET(res, bucketnum);
 		dns_validator_send(ISC_LIST_HEAD(fctx->validators));
 		goto cleanup_event;
 	}
@@ -5903,7 +6313,7 @@ noanswer_response:
 		dns_db_detachnode(fctx->cache, &node);
 	}
 
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK_BUCKET(res, bucketnum);
 	fctx_done(fctx, result, __LINE__); /* Locks bucket. */
 
 cleanup_event:
@@ -6538,7 +6948,7 @@ cache_message(fetchctx_t *fctx, dns_message_t *message,
 
 	FCTX_ATTR_CLR(fctx, FCTX_ATTR_WANTCACHE);
 
-	LOCK(&fctx->res->buckets[fctx->bucketnum].lock);
+	LOCK_BUCKET(fctx->res, fctx->bucketnum);
 
 	for (section = DNS_SECTION_ANSWER; section <= DNS_SECTION_ADDITIONAL;
 	     section++) {
@@ -6563,7 +6973,7 @@ cache_message(fetchctx_t *fctx, dns_message_t *message,
 		result = ISC_R_SUCCESS;
 	}
 
-	UNLOCK(&fctx->res->buckets[fctx->bucketnum].lock);
+	UNLOCK_BUCKET(fctx->res, fctx->bucketnum);
 
 	return (result);
 }
@@ -6729,7 +7139,7 @@ ncache_message(fetchctx_t *fctx, dns_message_t *message,
 		return (result);
 	}
 
-	LOCK(&res->buckets[fctx->bucketnum].lock);
+	LOCK_BUCKET(res, fctx->bucketnum);
 
 	adbp = NULL;
 	aname = NULL;
@@ -6789,7 +7199,7 @@ ncache_message(fetchctx_t *fctx, dns_message_t *message,
 	}
 
 unlock:
-	UNLOCK(&res->buckets[fctx->bucketnum].lock);
+	UNLOCK_BUCKET(res, fctx->bucketnum);
 
 	if (node != NULL) {
 		dns_db_detachnode(fctx->cache, &node);
@@ -7330,9 +7740,9 @@ cleanup:
 	if (dns_rdataset_isassociated(&nameservers)) {
 		dns_rdataset_disassociate(&nameservers);
 	}
-	LOCK(&res->buckets[fctx->bucketnum].lock);
+	LOCK_BUCKET(res, fctx->bucketnum);
 	bucket_empty = fctx_decreference(fctx);
-	UNLOCK(&res->buckets[fctx->bucketnum].lock);
+	UNLOCK_BUCKET(res, fctx->bucketnum);
 	if (bucket_empty) {
 		empty_bucket(res);
 	}
@@ -9538,9 +9948,9 @@ rctx_resend(respctx_t *rctx, dns_adbaddrinfo_t *addrinfo) {
 
 	bucketnum = fctx->bucketnum;
 	fctx_done(fctx, result, __LINE__);
-	LOCK(&res->buckets[bucketnum].lock);
+	LOCK_BUCKET(res, bucketnum);
 	bucket_empty = fctx_decreference(fctx);
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK_BUCKET(res, bucketnum);
 	if (bucket_empty) {
 		empty_bucket(res);
 	}
@@ -9741,6 +10151,12 @@ rctx_logpacket(respctx_t *rctx) {
 		if (result == ISC_R_SUCCESS) {
 			la = &localaddr;
 		}
+	} else if (rctx->query->exclusivesocket &&
+		   dns_dispatch_getentryhandle(rctx->query->dispentry) != NULL)
+	{
+		localaddr = isc_nmhandle_localaddr(
+			dns_dispatch_getentryhandle(rctx->query->dispentry));
+		la = &localaddr;
 	}
 
 	dns_dt_send(fctx->res->view, dtmsgtype, la,
@@ -9970,17 +10386,20 @@ destroy(dns_resolver_t *res) {
 		isc_task_shutdown(res->buckets[i].task);
 		isc_task_detach(&res->buckets[i].task);
 		isc_mutex_destroy(&res->buckets[i].lock);
+		isc_mem_put(res->buckets[i].mctx, res->buckets[i].table,
+			    sizeof(res->buckets[i].table[0])
+				    << res->buckets[i].hashbits);
 		isc_mem_detach(&res->buckets[i].mctx);
 	}
 	isc_mem_put(res->mctx, res->buckets,
 		    res->nbuckets * sizeof(fctxbucket_t));
-	for (i = 0; i < RES_DOMAIN_BUCKETS; i++) {
+	for (i = 0; i < res->ndbuckets; i++) {
 		INSIST(ISC_LIST_EMPTY(res->dbuckets[i].list));
 		isc_mem_detach(&res->dbuckets[i].mctx);
 		isc_mutex_destroy(&res->dbuckets[i].lock);
 	}
 	isc_mem_put(res->mctx, res->dbuckets,
-		    RES_DOMAIN_BUCKETS * sizeof(zonebucket_t));
+		    res->ndbuckets * sizeof(zonebucket_t));
 	if (res->dispatches4 != NULL) {
 		dns_dispatchset_destroy(&res->dispatches4);
 	}
@@ -10135,6 +10554,8 @@ dns_resolver_create(dns_view_t *view, isc_taskmgr_t *taskmgr,
 	res->query_timeout = DEFAULT_QUERY_TIMEOUT;
 	res->maxdepth = DEFAULT_RECURSION_DEPTH;
 	res->maxqueries = DEFAULT_MAX_QUERIES;
+	res->hedgebudget = 0;
+	atomic_init(&res->hedgecredit, 0);
 	res->quotaresp[dns_quotatype_zone] = DNS_R_DROP;
 	res->quotaresp[dns_quotatype_server] = DNS_R_SERVFAIL;
 	res->nbuckets = ntasks;
@@ -10169,13 +10590,22 @@ dns_resolver_create(dns_view_t *view, isc_taskmgr_t *taskmgr,
 		isc_mem_setname(res->buckets[i].mctx, name, NULL);
 		isc_task_setname(res->buckets[i].task, name, res);
 		ISC_LIST_INIT(res->buckets[i].fctxs);
+		res->buckets[i].hashbits = FCTX_HASHBITS_MIN;
+		res->buckets[i].count = 0;
+		res->buckets[i].table = isc_mem_get(
+			res->buckets[i].mctx,
+			sizeof(res->buckets[i].table[0]) << FCTX_HASHBITS_MIN);
+		memset(res->buckets[i].table, 0,
+		       sizeof(res->buckets[i].table[0]) << FCTX_HASHBITS_MIN);
 		atomic_init(&res->buckets[i].exiting, false);
 		buckets_created++;
 	}
 
+	res->ndbuckets = ISC_MAX(RES_DOMAIN_BUCKETS,
+				 ntasks * RES_DOMAIN_BUCKETS_PERTASK);
 	res->dbuckets = isc_mem_get(view->mctx,
-				    RES_DOMAIN_BUCKETS * sizeof(zonebucket_t));
-	for (i = 0; i < RES_DOMAIN_BUCKETS; i++) {
+				    res->ndbuckets * sizeof(zonebucket_t));
+	for (i = 0; i < res->ndbuckets; i++) {
 		ISC_LIST_INIT(res->dbuckets[i].list);
 		res->dbuckets[i].mctx = NULL;
 		isc_mem_attach(view->mctx, &res->dbuckets[i].mctx);
@@ -10280,10 +10710,13 @@ cleanup_primelock:
 		isc_mem_detach(&res->dbuckets[i].mctx);
 	}
 	isc_mem_put(view->mctx, res->dbuckets,
-		    RES_DOMAIN_BUCKETS * sizeof(zonebucket_t));
+		    res->ndbuckets * sizeof(zonebucket_t));
 
 cleanup_buckets:
 	for (i = 0; i < buckets_created; i++) {
+		isc_mem_put(res->buckets[i].mctx, res->buckets[i].table,
+			    sizeof(res->buckets[i].table[0])
+				    << res->buckets[i].hashbits);
 		isc_mem_detach(&res->buckets[i].mctx);
 		isc_mutex_destroy(&res->buckets[i].lock);
 		isc_task_shutdown(res->buckets[i].task);
@@ -10471,7 +10904,7 @@ dns_resolver_shutdown(dns_resolver_t *res) {
 		RTRACE("exiting");
 
 		for (i = 0; i < res->nbuckets; i++) {
-			LOCK(&res->buckets[i].lock);
+			LOCK_BUCKET(res, i);
 			for (fctx = ISC_LIST_HEAD(res->buckets[i].fctxs);
 			     fctx != NULL; fctx = ISC_LIST_NEXT(fctx, link))
 			{
@@ -10490,7 +10923,7 @@ dns_resolver_shutdown(dns_resolver_t *res) {
 				INSIST(res->activebuckets > 0);
 				res->activebuckets--;
 			}
-			UNLOCK(&res->buckets[i].lock);
+			UNLOCK_BUCKET(res, i);
 		}
 		if (res->activebuckets == 0) {
 			send_shutdown_events(res);
@@ -10670,6 +11103,7 @@ dns_resolver_createfetch(dns_resolver_t *res, const dns_name_t *name,
 	fetchctx_t *fctx = NULL;
 	isc_result_t result = ISC_R_SUCCESS;
 	unsigned int bucketnum;
+	uint32_t hashval;
 	bool new_fctx = false;
 	isc_event_t *event;
 	unsigned int count = 0;
@@ -10702,13 +11136,14 @@ dns_resolver_createfetch(dns_resolver_t *res, const dns_name_t *name,
 	fetch->mctx = NULL;
 	isc_mem_attach(res->mctx, &fetch->mctx);
 
-	bucketnum = dns_name_fullhash(name, false) % res->nbuckets;
+	hashval = dns_name_fullhash(name, false);
+	bucketnum = hashval % res->nbuckets;
 
 	LOCK(&res->lock);
 	spillat = res->spillat;
 	spillatmin = res->spillatmin;
 	UNLOCK(&res->lock);
-	LOCK(&res->buckets[bucketnum].lock);
+	LOCK_BUCKET(res, bucketnum);
 
 	if (atomic_load(&res->buckets[bucketnum].exiting)) {
 		result = ISC_R_SHUTTINGDOWN;
@@ -10716,10 +11151,13 @@ dns_resolver_createfetch(dns_resolver_t *res, const dns_name_t *name,
 	}
 
 	if ((options & DNS_FETCHOPT_UNSHARED) == 0) {
-		for (fctx = ISC_LIST_HEAD(res->buckets[bucketnum].fctxs);
-		     fctx != NULL; fctx = ISC_LIST_NEXT(fctx, link))
+		fctxbucket_t *bucket = &res->buckets[bucketnum];
+
+		for (fctx = bucket->table[FCTX_HASHINDEX(res, bucket, hashval)];
+		     fctx != NULL; fctx = fctx->hashnext)
 		{
-			if (fctx_match(fctx, name, type, options)) {
+			if (fctx->hashval == hashval &&
+			    fctx_match(fctx, name, type, options)) {
 				break;
 			}
 		}
@@ -10788,7 +11226,7 @@ dns_resolver_createfetch(dns_resolver_t *res, const dns_name_t *name,
 	}
 
 unlock:
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK_BUCKET(res, bucketnum);
 
 	if (dodestroy) {
 		fctx_destroy(fctx);
@@ -10818,7 +11256,7 @@ dns_resolver_cancelfetch(dns_fetch_t *fetch) {
 
 	FTRACE("cancelfetch");
 
-	LOCK(&res->buckets[fctx->bucketnum].lock);
+	LOCK_BUCKET(res, fctx->bucketnum);
 
 	/*
 	 * Find the completion event for this fetch (as opposed
@@ -10847,7 +11285,7 @@ dns_resolver_cancelfetch(dns_fetch_t *fetch) {
 	 * the answer is still cached.
 	 */
 
-	UNLOCK(&res->buckets[fctx->bucketnum].lock);
+	UNLOCK_BUCKET(res, fctx->bucketnum);
 }
 
 void
@@ -10870,7 +11308,7 @@ dns_resolver_destroyfetch(dns_fetch_t **fetchp) {
 	FTRACE("destroyfetch");
 
 	bucketnum = fctx->bucketnum;
-	LOCK(&res->buckets[bucketnum].lock);
+	LOCK_BUCKET(res, bucketnum);
 
 	/*
 	 * Sanity check: the caller should have gotten its event before
@@ -10886,7 +11324,7 @@ dns_resolver_destroyfetch(dns_fetch_t **fetchp) {
 	}
 
 	bucket_empty = fctx_decreference(fctx);
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK_BUCKET(res, bucketnum);
 
 	isc_mem_putanddetach(&fetch->mctx, fetch, sizeof(*fetch));
 
@@ -10908,7 +11346,7 @@ dns_resolver_logfetch(dns_fetch_t *fetch, isc_log_t *lctx,
 	REQUIRE(VALID_FCTX(fctx));
 	res = fctx->res;
 
-	LOCK(&res->buckets[fctx->bucketnum].lock);
+	LOCK_BUCKET(res, fctx->bucketnum);
 
 	INSIST(fctx->exitline >= 0);
 	if (!fctx->logged || duplicateok) {
@@ -10932,7 +11370,7 @@ dns_resolver_logfetch(dns_fetch_t *fetch, isc_log_t *lctx,
 		fctx->logged = true;
 	}
 
-	UNLOCK(&res->buckets[fctx->bucketnum].lock);
+	UNLOCK_BUCKET(res, fctx->bucketnum);
 }
 
 dns_dispatchmgr_t *
@@ -11526,16 +11964,29 @@ dns_resolver_getmaxqueries(dns_resolver_t *resolver) {
 	return (resolver->maxqueries);
 }
 
+void
+dns_resolver_sethedgebudget(dns_resolver_t *resolver, unsigned int percent) {
+	REQUIRE(VALID_RESOLVER(resolver));
+	REQUIRE(percent <= 100);
+	resolver->hedgebudget = percent;
+}
+
+unsigned int
+dns_resolver_gethedgebudget(dns_resolver_t *resolver) {
+	REQUIRE(VALID_RESOLVER(resolver));
+	return (resolver->hedgebudget);
+}
+
 void
 dns_resolver_dumpfetches(dns_resolver_t *resolver, isc_statsformat_t format,
 			 FILE *fp) {
-	int i;
+	unsigned int i;
 
 	REQUIRE(VALID_RESOLVER(resolver));
 	REQUIRE(fp != NULL);
 	REQUIRE(format == isc_statsformat_file);
 
-	for (i = 0; i < RES_DOMAIN_BUCKETS; i++) {
+	for (i = 0; i < resolver->ndbuckets; i++) {
 		fctxcount_t *fc;
 		LOCK(&resolver->dbuckets[i].lock);
 		for (fc = ISC_LIST_HEAD(resolver->dbuckets[i].list); fc != NULL;
@@ -11596,3 +12047,21 @@ dns_resolver_setnonbackofftries(dns_resolver_t *resolver, unsigned int tries) {
 
 	resolver->nonbackofftries = tries;
 }
+
+unsigned int
+dns__resolver_bucketsize(dns_resolver_t *res, const dns_name_t *name,
+			 unsigned int *hashbitsp) {
+	fctxbucket_t *bucket;
+	unsigned int count;
+
+	REQUIRE(VALID_RESOLVER(res));
+	REQUIRE(hashbitsp != NULL);
+
+	bucket = &res->buckets[dns_name_fullhash(name, false) % res->nbuckets];
+	LOCK(&bucket->lock);
+	count = bucket->count;
+	*hashbitsp = bucket->hashbits;
+	UNLOCK(&bucket->lock);
+
+	return (count);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef DNS_RESOLVER_P_H
+#define DNS_RESOLVER_P_H
+
+#include <dns/types.h>
+
+/*! \file */
+
+/*%
+ *     Functions below not be used outside this module and its associated
+ *     unit tests.
+ */
+
+ISC_LANG_BEGINDECLS
+
+unsigned int
+dns__resolver_bucketsize(dns_resolver_t *res, const dns_name_t *name,
+			 unsigned int *hashbitsp);
+/*%<
+ * Return the number of fetch contexts in the bucket that fetches for
+ * 'name' are put in, and store in '*hashbitsp' the log2 of the number
+ * of chains of its name index.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_RESOLVER_P_H */
@@ -0,0 +1,1231 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include <isc/mem.h>
+#include <isc/parseint.h>
+#include <isc/refcount.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/callbacks.h>
+#include <dns/db.h>
+#include <dns/dbiterator.h>
+#include <dns/fixedname.h>
+#include <dns/masterdump.h>
+#include <dns/rbt.h>
+#include <dns/rdataset.h>
+#include <dns/result.h>
+#include <dns/stats.h>
+
+#include "rbtdb.h"
+#include "shardcache.h"
+
+#define SHARDCACHE_MAGIC ISC_MAGIC('S', 'h', 'C', 'a')
+#define VALID_SHARDCACHE(sdb) \
+	((sdb) != NULL && (sdb)->common.impmagic == SHARDCACHE_MAGIC)
+
+/*%
+ * Names with fewer labels than this (the root and top level domains)
+ * are kept in shard 0; the others are sharded by their last
+ * SHARDCACHE_LABELS labels, i.e. by their second level domain.
+ */
+#define SHARDCACHE_LABELS 3
+
+typedef struct shardcache {
+	/* Unlocked. */
+	dns_db_t common;
+	isc_refcount_t references;
+	unsigned int nshards;
+	dns_db_t **shards;
+	/*%
+	 * Every shard holds a reference to a node for the root name, so
+	 * that seeking an iterator in any shard finds at least a partial
+	 * match.
+	 */
+	dns_dbnode_t **roots;
+	dns_stats_t *rrsetstats;
+} shardcache_t;
+
+typedef struct shardcache_subiterator {
+	dns_dbiterator_t *iter;
+	isc_result_t result; /* ISC_R_SUCCESS if 'name' is current */
+	dns_fixedname_t fname;
+	dns_name_t *name;
+} shardcache_subiterator_t;
+
+/*%
+ * An iterator over a sharded cache merges the iterators of the shards:
+ * the nodes are visited in DNSSEC order of their names, and nodes with
+ * the same name in several shards in order of the shards.  When moving
+ * forward, every shard iterator but the current one is positioned at
+ * its first node after the current one; when moving backward, at its
+ * last node before the current one.
+ *
+ * The shard iterators are kept paused between moves, so that no more
+ * than one shard's tree lock is held at a time.
+ */
+typedef struct shardcache_dbiterator {
+	dns_dbiterator_t common;
+	isc_result_t result;
+	bool forward;
+	unsigned int current;
+	unsigned int nsubs;
+	shardcache_subiterator_t *subs;
+} shardcache_dbiterator_t;
+
+static void
+dbiterator_destroy(dns_dbiterator_t **iteratorp);
+static isc_result_t
+dbiterator_first(dns_dbiterator_t *iterator);
+static isc_result_t
+dbiterator_last(dns_dbiterator_t *iterator);
+static isc_result_t
+dbiterator_seek(dns_dbiterator_t *iterator, const dns_name_t *name);
+static isc_result_t
+dbiterator_prev(dns_dbiterator_t *iterator);
+static isc_result_t
+dbiterator_next(dns_dbiterator_t *iterator);
+static isc_result_t
+dbiterator_current(dns_dbiterator_t *iterator, dns_dbnode_t **nodep,
+		   dns_name_t *name);
+static isc_result_t
+dbiterator_pause(dns_dbiterator_t *iterator);
+static isc_result_t
+dbiterator_origin(dns_dbiterator_t *iterator, dns_name_t *name);
+
+static dns_dbiteratormethods_t dbiterator_methods = {
+	dbiterator_destroy, dbiterator_first, dbiterator_last,
+	dbiterator_seek,    dbiterator_prev,  dbiterator_next,
+	dbiterator_current, dbiterator_pause, dbiterator_origin
+};
+
+/*%
+ * The shard that 'name' belongs in.
+ */
+static inline unsigned int
+name_shard(shardcache_t *sdb, const dns_name_t *name) {
+	unsigned int labels = dns_name_countlabels(name);
+	dns_name_t suffix;
+
+	if (labels < SHARDCACHE_LABELS) {
+		return (0);
+	}
+
+	dns_name_init(&suffix, NULL);
+	dns_name_getlabelsequence(name, labels - SHARDCACHE_LABELS,
+				  SHARDCACHE_LABELS, &suffix);
+
+	return (1 + dns_name_hash(&suffix, false) % (sdb->nshards - 1));
+}
+
+/*%
+ * The shard that 'node' was created in.
+ */
+static inline dns_db_t *
+node_shard(shardcache_t *sdb, dns_dbnode_t *node) {
+	unsigned int shard = ((dns_rbtnode_t *)node)->shard;
+
+	INSIST(shard < sdb->nshards);
+
+	return (sdb->shards[shard]);
+}
+
+/*%
+ * Whether 'name1' and 'name2' belong to the same second level domain
+ * (or are both in shard 0).
+ */
+static bool
+same_domain(const dns_name_t *name1, const dns_name_t *name2) {
+	unsigned int labels1 = dns_name_countlabels(name1);
+	unsigned int labels2 = dns_name_countlabels(name2);
+	dns_name_t suffix1, suffix2;
+
+	if (labels1 < SHARDCACHE_LABELS || labels2 < SHARDCACHE_LABELS) {
+		return (labels1 < SHARDCACHE_LABELS &&
+			labels2 < SHARDCACHE_LABELS);
+	}
+
+	dns_name_init(&suffix1, NULL);
+	dns_name_getlabelsequence(name1, labels1 - SHARDCACHE_LABELS,
+				  SHARDCACHE_LABELS, &suffix1);
+	dns_name_init(&suffix2, NULL);
+	dns_name_getlabelsequence(name2, labels2 - SHARDCACHE_LABELS,
+				  SHARDCACHE_LABELS, &suffix2);
+
+	return (dns_name_equal(&suffix1, &suffix2));
+}
+
+/*%
+ * Undo a lookup in 'shard' whose result isn't going to be returned.
+ */
+static void
+find_cleanup(dns_db_t *shard, dns_dbnode_t **nodep, dns_rdataset_t *rdataset,
+	     dns_rdataset_t *sigrdataset) {
+	if (nodep != NULL && *nodep != NULL) {
+		dns_db_detachnode(shard, nodep);
+	}
+	if (rdataset != NULL && dns_rdataset_isassociated(rdataset)) {
+		dns_rdataset_disassociate(rdataset);
+	}
+	if (sigrdataset != NULL && dns_rdataset_isassociated(sigrdataset)) {
+		dns_rdataset_disassociate(sigrdataset);
+	}
+}
+
+static void
+attach(dns_db_t *source, dns_db_t **targetp) {
+	shardcache_t *sdb = (shardcache_t *)source;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	isc_refcount_increment(&sdb->references);
+
+	*targetp = source;
+}
+
+static void
+free_shardcache(shardcache_t *sdb) {
+	for (unsigned int i = 0; i < sdb->nshards; i++) {
+		if (sdb->roots[i] != NULL) {
+			dns_db_detachnode(sdb->shards[i], &sdb->roots[i]);
+		}
+		if (sdb->shards[i] != NULL) {
+			dns_db_detach(&sdb->shards[i]);
+		}
+	}
+	isc_mem_put(sdb->common.mctx, sdb->roots,
+		    sdb->nshards * sizeof(sdb->roots[0]));
+	isc_mem_put(sdb->common.mctx, sdb->shards,
+		    sdb->nshards * sizeof(sdb->shards[0]));
+
+	if (sdb->rrsetstats != NULL) {
+		dns_stats_detach(&sdb->rrsetstats);
+	}
+	if (dns_name_dynamic(&sdb->common.origin)) {
+		dns_name_free(&sdb->common.origin, sdb->common.mctx);
+	}
+
+	isc_refcount_destroy(&sdb->references);
+	sdb->common.magic = 0;
+	sdb->common.impmagic = 0;
+	isc_mem_putanddetach(&sdb->common.mctx, sdb, sizeof(*sdb));
+}
+
+static void
+detach(dns_db_t **dbp) {
+	shardcache_t *sdb = NULL;
+
+	REQUIRE(dbp != NULL);
+
+	sdb = (shardcache_t *)(*dbp);
+	*dbp = NULL;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	if (isc_refcount_decrement(&sdb->references) == 1) {
+		free_shardcache(sdb);
+	}
+}
+
+/*%
+ * Loading a sharded cache loads each shard; the rdatasets are passed to
+ * the shard their owner name belongs in.
+ */
+typedef struct shardcache_load {
+	shardcache_t *sdb;
+	dns_rdatacallbacks_t *callbacks; /* of each shard */
+} shardcache_load_t;
+
+static isc_result_t
+loading_addrdataset(void *arg, const dns_name_t *name,
+		    dns_rdataset_t *rdataset) {
+	shardcache_load_t *loadctx = arg;
+	dns_rdatacallbacks_t *callbacks =
+		&loadctx->callbacks[name_shard(loadctx->sdb, name)];
+
+	return ((callbacks->add)(callbacks->add_private, name, rdataset));
+}
+
+static isc_result_t
+beginload(dns_db_t *db, dns_rdatacallbacks_t *callbacks) {
+	shardcache_t *sdb = (shardcache_t *)db;
+	shardcache_load_t *loadctx = NULL;
+	isc_result_t result = ISC_R_SUCCESS;
+	unsigned int i;
+
+	REQUIRE(DNS_CALLBACK_VALID(callbacks));
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	loadctx = isc_mem_get(sdb->common.mctx, sizeof(*loadctx));
+	loadctx->sdb = sdb;
+	loadctx->callbacks = isc_mem_get(
+		sdb->common.mctx, sdb->nshards * sizeof(loadctx->callbacks[0]));
+
+	for (i = 0; i < sdb->nshards; i++) {
+		dns_rdatacallbacks_init(&loadctx->callbacks[i]);
+		result = dns_db_beginload(sdb->shards[i],
+					  &loadctx->callbacks[i]);
+		if (result != ISC_R_SUCCESS) {
+			break;
+		}
+	}
+
+	if (result != ISC_R_SUCCESS) {
+		while (i-- > 0) {
+			(void)dns_db_endload(sdb->shards[i],
+					     &loadctx->callbacks[i]);
+		}
+		isc_mem_put(sdb->common.mctx, loadctx->callbacks,
+			    sdb->nshards * sizeof(loadctx->callbacks[0]));
+		isc_mem_put(sdb->common.mctx, loadctx, sizeof(*loadctx));
+		return (result);
+	}
+
+	callbacks->add = loading_addrdataset;
+	callbacks->add_private = loadctx;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+endload(dns_db_t *db, dns_rdatacallbacks_t *callbacks) {
+	shardcache_t *sdb = (shardcache_t *)db;
+	shardcache_load_t *loadctx = NULL;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+	REQUIRE(DNS_CALLBACK_VALID(callbacks));
+	loadctx = callbacks->add_private;
+	REQUIRE(loadctx != NULL);
+	REQUIRE(loadctx->sdb == sdb);
+
+	for (unsigned int i = 0; i < sdb->nshards; i++) {
+		isc_result_t tresult = dns_db_endload(sdb->shards[i],
+						      &loadctx->callbacks[i]);
+		if (tresult != ISC_R_SUCCESS && result == ISC_R_SUCCESS) {
+			result = tresult;
+		}
+	}
+
+	callbacks->add = NULL;
+	callbacks->add_private = NULL;
+
+	isc_mem_put(sdb->common.mctx, loadctx->callbacks,
+		    sdb->nshards * sizeof(loadctx->callbacks[0]));
+	isc_mem_put(sdb->common.mctx, loadctx, sizeof(*loadctx));
+
+	return (result);
+}
+
+static isc_result_t
+dump(dns_db_t *db, dns_dbversion_t *version, const char *filename,
+     dns_masterformat_t masterformat) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	return (dns_master_dump(sdb->common.mctx, db, version,
+				&dns_master_style_default, filename,
+				masterformat, NULL));
+}
+
+/*
+ * Caches don't have versions; the version methods are passed to shard
+ * 0 and the versions passed to the other methods are ignored.
+ */
+static void
+currentversion(dns_db_t *db, dns_dbversion_t **versionp) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	dns_db_currentversion(sdb->shards[0], versionp);
+}
+
+static isc_result_t
+newversion(dns_db_t *db, dns_dbversion_t **versionp) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	return (dns_db_newversion(sdb->shards[0], versionp));
+}
+
+static void
+attachversion(dns_db_t *db, dns_dbversion_t *source,
+	      dns_dbversion_t **targetp) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	dns_db_attachversion(sdb->shards[0], source, targetp);
+}
+
+static void
+closeversion(dns_db_t *db, dns_dbversion_t **versionp, bool commit) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	dns_db_closeversion(sdb->shards[0], versionp, commit);
+}
+
+static isc_result_t
+findnode(dns_db_t *db, const dns_name_t *name, bool create,
+	 dns_dbnode_t **nodep) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	return (dns_db_findnode(sdb->shards[name_shard(sdb, name)], name,
+				create, nodep));
+}
+
+static isc_result_t
+find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
+     dns_rdatatype_t type, unsigned int options, isc_stdtime_t now,
+     dns_dbnode_t **nodep, dns_name_t *foundname, dns_rdataset_t *rdataset,
+     dns_rdataset_t *sigrdataset) {
+	shardcache_t *sdb = (shardcache_t *)db;
+	unsigned int shard;
+	isc_result_t result;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	UNUSED(version);
+
+	shard = name_shard(sdb, name);
+	result = dns_db_find(sdb->shards[shard], name, NULL, type, options,
+			     now, nodep, foundname, rdataset, sigrdataset);
+
+	/*
+	 * The shard only has the NSEC records of the domains that share
+	 * it, so the NSEC record preceding 'name' there is only worth
+	 * returning if it's in the same domain as 'name'.
+	 */
+	if (result == DNS_R_COVERINGNSEC && !same_domain(name, foundname)) {
+		find_cleanup(sdb->shards[shard], nodep, rdataset, sigrdataset);
+		result = dns_db_find(sdb->shards[shard], name, NULL, type,
+				     options & ~DNS_DBFIND_COVERINGNSEC, now,
+				     nodep, foundname, rdataset, sigrdataset);
+	}
+
+	/*
+	 * If there's no zone cut in the name's own shard, look for one
+	 * above its second level domain.
+	 */
+	if (result == ISC_R_NOTFOUND && shard != 0) {
+		find_cleanup(sdb->shards[shard], nodep, rdataset, sigrdataset);
+		result = dns_db_find(sdb->shards[0], name, NULL, type, options,
+				     now, nodep, foundname, rdataset,
+				     sigrdataset);
+	}
+
+	return (result);
+}
+
+static isc_result_t
+findzonecut(dns_db_t *db, const dns_name_t *name, unsigned int options,
+	    isc_stdtime_t now, dns_dbnode_t **nodep, dns_name_t *foundname,
+	    dns_name_t *dcname, dns_rdataset_t *rdataset,
+	    dns_rdataset_t *sigrdataset) {
+	shardcache_t *sdb = (shardcache_t *)db;
+	unsigned int shard;
+	isc_result_t result;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	shard = name_shard(sdb, name);
+	result = dns_db_findzonecut(sdb->shards[shard], name, options, now,
+				    nodep, foundname, dcname, rdataset,
+				    sigrdataset);
+	if (result == ISC_R_NOTFOUND && shard != 0) {
+		find_cleanup(sdb->shards[shard], nodep, rdataset, sigrdataset);
+		result = dns_db_findzonecut(sdb->shards[0], name, options, now,
+					    nodep, foundname, dcname, rdataset,
+					    sigrdataset);
+	}
+
+	return (result);
+}
+
+static void
+attachnode(dns_db_t *db, dns_dbnode_t *source, dns_dbnode_t **targetp) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	dns_db_attachnode(node_shard(sdb, source), source, targetp);
+}
+
+static void
+detachnode(dns_db_t *db, dns_dbnode_t **targetp) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	dns_db_detachnode(node_shard(sdb, *targetp), targetp);
+}
+
+static isc_result_t
+expirenode(dns_db_t *db, dns_dbnode_t *node, isc_stdtime_t now) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	return (dns_db_expirenode(node_shard(sdb, node), node, now));
+}
+
+static void
+printnode(dns_db_t *db, dns_dbnode_t *node, FILE *out) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	dns_db_printnode(node_shard(sdb, node), node, out);
+}
+
+static isc_result_t
+createiterator(dns_db_t *db, unsigned int options,
+	       dns_dbiterator_t **iteratorp) {
+	shardcache_t *sdb = (shardcache_t *)db;
+	shardcache_dbiterator_t *sdbiter = NULL;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	sdbiter = isc_mem_get(sdb->common.mctx, sizeof(*sdbiter));
+	sdbiter->common.methods = &dbiterator_methods;
+	sdbiter->common.db = NULL;
+	dns_db_attach(db, &sdbiter->common.db);
+	/*
+	 * The names come from several trees, so they are always absolute.
+	 */
+	sdbiter->common.relative_names = false;
+	sdbiter->common.cleaning = false;
+	sdbiter->common.magic = DNS_DBITERATOR_MAGIC;
+	sdbiter->result = ISC_R_NOMORE;
+	sdbiter->forward = true;
+	sdbiter->current = 0;
+	sdbiter->nsubs = sdb->nshards;
+	sdbiter->subs = isc_mem_get(sdb->common.mctx,
+				    sdb->nshards * sizeof(sdbiter->subs[0]));
+
+	for (unsigned int i = 0; i < sdb->nshards; i++) {
+		shardcache_subiterator_t *sub = &sdbiter->subs[i];
+
+		sub->iter = NULL;
+		sub->result = ISC_R_NOMORE;
+		sub->name = dns_fixedname_initname(&sub->fname);
+		if (result == ISC_R_SUCCESS) {
+			result = dns_db_createiterator(
+				sdb->shards[i], options & ~DNS_DB_RELATIVENAMES,
+				&sub->iter);
+		}
+	}
+
+	if (result != ISC_R_SUCCESS) {
+		dns_dbiterator_t *iterator = (dns_dbiterator_t *)sdbiter;
+		dbiterator_destroy(&iterator);
+		return (result);
+	}
+
+	*iteratorp = (dns_dbiterator_t *)sdbiter;
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+findrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+	     dns_rdatatype_t type, dns_rdatatype_t covers, isc_stdtime_t now,
+	     dns_rdataset_t *rdataset, dns_rdataset_t *sigrdataset) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	UNUSED(version);
+
+	return (dns_db_findrdataset(node_shard(sdb, node), node, NULL, type,
+				    covers, now, rdataset, sigrdataset));
+}
+
+static isc_result_t
+allrdatasets(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+	     isc_stdtime_t now, dns_rdatasetiter_t **iteratorp) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	UNUSED(version);
+
+	return (dns_db_allrdatasets(node_shard(sdb, node), node, NULL, now,
+				    iteratorp));
+}
+
+static isc_result_t
+addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+	    isc_stdtime_t now, dns_rdataset_t *rdataset, unsigned int options,
+	    dns_rdataset_t *addedrdataset) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	UNUSED(version);
+
+	return (dns_db_addrdataset(node_shard(sdb, node), node, NULL, now,
+				   rdataset, options, addedrdataset));
+}
+
+static isc_result_t
+subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+		 dns_rdataset_t *rdataset, unsigned int options,
+		 dns_rdataset_t *newrdataset) {
+	shardcache_t *sdb = (shardcache_t *)db;
+	dns_db_t *shard = NULL;
+	dns_dbversion_t *shardversion = NULL;
+	isc_result_t result;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	UNUSED(version);
+
+	shard = node_shard(sdb, node);
+	dns_db_currentversion(shard, &shardversion);
+	result = dns_db_subtractrdataset(shard, node, shardversion, rdataset,
+					 options, newrdataset);
+	dns_db_closeversion(shard, &shardversion, false);
+
+	return (result);
+}
+
+static isc_result_t
+deleterdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
+	       dns_rdatatype_t type, dns_rdatatype_t covers) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	UNUSED(version);
+
+	return (dns_db_deleterdataset(node_shard(sdb, node), node, NULL, type,
+				      covers));
+}
+
+static bool
+issecure(dns_db_t *db) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	return (dns_db_issecure(sdb->shards[0]));
+}
+
+static unsigned int
+nodecount(dns_db_t *db) {
+	shardcache_t *sdb = (shardcache_t *)db;
+	unsigned int count = 0;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	for (unsigned int i = 0; i < sdb->nshards; i++) {
+		count += dns_db_nodecount(sdb->shards[i]);
+	}
+
+	return (count);
+}
+
+static bool
+ispersistent(dns_db_t *db) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	return (dns_db_ispersistent(sdb->shards[0]));
+}
+
+static void
+overmem(dns_db_t *db, bool over) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	for (unsigned int i = 0; i < sdb->nshards; i++) {
+		dns_db_overmem(sdb->shards[i], over);
+	}
+}
+
+static void
+settask(dns_db_t *db, isc_task_t *task) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	for (unsigned int i = 0; i < sdb->nshards; i++) {
+		dns_db_settask(sdb->shards[i], task);
+	}
+}
+
+static isc_result_t
+getoriginnode(dns_db_t *db, dns_dbnode_t **nodep) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	return (dns_db_getoriginnode(sdb->shards[0], nodep));
+}
+
+static bool
+isdnssec(dns_db_t *db) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	return (dns_db_isdnssec(sdb->shards[0]));
+}
+
+static dns_stats_t *
+getrrsetstats(dns_db_t *db) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	return (sdb->rrsetstats);
+}
+
+static isc_result_t
+setcachestats(dns_db_t *db, isc_stats_t *stats) {
+	shardcache_t *sdb = (shardcache_t *)db;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	for (unsigned int i = 0; i < sdb->nshards && result == ISC_R_SUCCESS;
+	     i++) {
+		result = dns_db_setcachestats(sdb->shards[i], stats);
+	}
+
+	return (result);
+}
+
+static size_t
+hashsize(dns_db_t *db) {
+	shardcache_t *sdb = (shardcache_t *)db;
+	size_t size = 0;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	for (unsigned int i = 0; i < sdb->nshards; i++) {
+		size += dns_db_hashsize(sdb->shards[i]);
+	}
+
+	return (size);
+}
+
+static isc_result_t
+nodefullname(dns_db_t *db, dns_dbnode_t *node, dns_name_t *name) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	return (dns_db_nodefullname(node_shard(sdb, node), node, name));
+}
+
+static isc_result_t
+setservestalettl(dns_db_t *db, dns_ttl_t ttl) {
+	shardcache_t *sdb = (shardcache_t *)db;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	for (unsigned int i = 0; i < sdb->nshards && result == ISC_R_SUCCESS;
+	     i++) {
+		result = dns_db_setservestalettl(sdb->shards[i], ttl);
+	}
+
+	return (result);
+}
+
+static isc_result_t
+getservestalettl(dns_db_t *db, dns_ttl_t *ttl) {
+	shardcache_t *sdb = (shardcache_t *)db;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	return (dns_db_getservestalettl(sdb->shards[0], ttl));
+}
+
+static isc_result_t
+adjusthashsize(dns_db_t *db, size_t size) {
+	shardcache_t *sdb = (shardcache_t *)db;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(VALID_SHARDCACHE(sdb));
+
+	for (unsigned int i = 0; i < sdb->nshards && result == ISC_R_SUCCESS;
+	     i++) {
+		result = dns_db_adjusthashsize(sdb->shards[i],
+					       size / sdb->nshards);
+	}
+
+	return (result);
+}
+
+static dns_dbmethods_t shardcache_methods = { attach,
+					      detach,
+					      beginload,
+					      endload,
+					      NULL, /* serialize */
+					      dump,
+					      currentversion,
+					      newversion,
+					      attachversion,
+					      closeversion,
+					      findnode,
+					      find,
+					      findzonecut,
+					      attachnode,
+					      detachnode,
+					      expirenode,
+					      printnode,
+					      createiterator,
+					      findrdataset,
+					      allrdatasets,
+					      addrdataset,
+					      subtractrdataset,
+					      deleterdataset,
+					      issecure,
+					      nodecount,
+					      ispersistent,
+					      overmem,
+					      settask,
+					      getoriginnode,
+					      NULL, /* transfernode */
+					      NULL, /* getnsec3parameters */
+					      NULL, /* findnsec3node */
+					      NULL, /* setsigningtime */
+					      NULL, /* getsigningtime */
+					      NULL, /* resigned */
+					      isdnssec,
+					      getrrsetstats,
+					      NULL, /* rpz_attach */
+					      NULL, /* rpz_ready */
+					      NULL, /* findnodeext */
+					      NULL, /* findext */
+					      setcachestats,
+					      hashsize,
+					      nodefullname,
+					      NULL, /* getsize */
+					      setservestalettl,
+					      getservestalettl,
+					      NULL, /* setgluecachestats */
+					      adjusthashsize };
+
+isc_result_t
+dns_shardcache_create(isc_mem_t *mctx, const dns_name_t *origin,
+		      dns_dbtype_t type, dns_rdataclass_t rdclass,
+		      unsigned int argc, char *argv[], void *driverarg,
+		      dns_db_t **dbp) {
+	shardcache_t *sdb = NULL;
+	isc_result_t result;
+	uint32_t nshards;
+
+	REQUIRE(type == dns_dbtype_cache);
+	REQUIRE(argc == 2);
+
+	UNUSED(driverarg);
+
+	result = isc_parse_uint32(&nshards, argv[1], 10);
+	if (result != ISC_R_SUCCESS || nshards < 2 ||
+	    nshards > DNS_SHARDCACHE_MAX) {
+		return (ISC_R_RANGE);
+	}
+
+	sdb = isc_mem_get(mctx, sizeof(*sdb));
+	memset(sdb, 0, sizeof(*sdb));
+	dns_name_init(&sdb->common.origin, NULL);
+	sdb->common.methods = &shardcache_methods;
+	sdb->common.attributes = DNS_DBATTR_CACHE;
+	sdb->common.rdclass = rdclass;
+	sdb->common.mctx = NULL;
+	ISC_LIST_INIT(sdb->common.update_listeners);
+	isc_mem_attach(mctx, &sdb->common.mctx);
+	isc_refcount_init(&sdb->references, 1);
+
+	sdb->nshards = nshards;
+	sdb->shards = isc_mem_get(mctx, nshards * sizeof(sdb->shards[0]));
+	sdb->roots = isc_mem_get(mctx, nshards * sizeof(sdb->roots[0]));
+	for (unsigned int i = 0; i < nshards; i++) {
+		sdb->shards[i] = NULL;
+		sdb->roots[i] = NULL;
+	}
+
+	sdb->common.magic = DNS_DB_MAGIC;
+	sdb->common.impmagic = SHARDCACHE_MAGIC;
+
+	result = dns_name_dupwithoffsets(origin, mctx, &sdb->common.origin);
+	if (result != ISC_R_SUCCESS) {
+		goto cleanup;
+	}
+
+	result = dns_rdatasetstats_create(mctx, &sdb->rrsetstats);
+	if (result != ISC_R_SUCCESS) {
+		goto cleanup;
+	}
+
+	for (unsigned int i = 0; i < nshards; i++) {
+		result = dns_rbtdb_create(mctx, origin, type, rdclass, 1, argv,
+					  NULL, &sdb->shards[i]);
+		if (result != ISC_R_SUCCESS) {
+			goto cleanup;
+		}
+		dns__rbtdb_setshard(sdb->shards[i], i, sdb->rrsetstats);
+
+		result = dns_db_findnode(sdb->shards[i], dns_rootname, true,
+					 &sdb->roots[i]);
+		if (result != ISC_R_SUCCESS) {
+			goto cleanup;
+		}
+	}
+
+	*dbp = (dns_db_t *)sdb;
+
+	return (ISC_R_SUCCESS);
+
+cleanup:
+	isc_refcount_decrementz(&sdb->references);
+	free_shardcache(sdb);
+	return (result);
+}
+
+/*
+ * Database Iterator Methods
+ */
+
+/*%
+ * Record where the iterator of shard 'i' is after it returned 'result',
+ * and pause it.
+ */
+static isc_result_t
+sub_load(shardcache_dbiterator_t *sdbiter, unsigned int i,
+	 isc_result_t result) {
+	shardcache_t *sdb = (shardcache_t *)sdbiter->common.db;
+	shardcache_subiterator_t *sub = &sdbiter->subs[i];
+	dns_dbnode_t *node = NULL;
+
+	if (result == ISC_R_SUCCESS || result == DNS_R_NEWORIGIN) {
+		result = dns_dbiterator_current(sub->iter, &node, sub->name);
+		if (result == DNS_R_NEWORIGIN) {
+			result = ISC_R_SUCCESS;
+		}
+		if (node != NULL) {
+			dns_db_detachnode(sdb->shards[i], &node);
+		}
+	}
+
+	sub->result = result;
+	(void)dns_dbiterator_pause(sub->iter);
+
+	return (result);
+}
+
+/*%
+ * Position the iterator of shard 'i' at the first node whose name comes
+ * after 'name' or, if 'after' is false, at 'name' itself.
+ */
+static isc_result_t
+sub_seek(shardcache_dbiterator_t *sdbiter, unsigned int i,
+	 const dns_name_t *name, bool after) {
+	shardcache_subiterator_t *sub = &sdbiter->subs[i];
+	isc_result_t result;
+
+	/*
+	 * On a partial match the iterator is at a node before 'name';
+	 * since every shard has a node for the root name, a seek can
+	 * only fail to find anything if 'name' isn't absolute.
+	 */
+	result = dns_dbiterator_seek(sub->iter, name);
+	if (result == DNS_R_PARTIALMATCH) {
+		result = ISC_R_SUCCESS;
+	} else if (result == ISC_R_NOTFOUND) {
+		result = dns_dbiterator_first(sub->iter);
+	}
+	result = sub_load(sdbiter, i, result);
+
+	while (result == ISC_R_SUCCESS) {
+		int order = dns_name_compare(sub->name, name);
+		if (order > 0 || (order == 0 && !after)) {
+			break;
+		}
+		result = sub_load(sdbiter, i, dns_dbiterator_next(sub->iter));
+	}
+
+	return (result);
+}
+
+/*%
+ * Position the iterator of shard 'i' at the last node whose name comes
+ * before 'name' or, if 'before' is false, at 'name' itself.
+ */
+static isc_result_t
+sub_seekback(shardcache_dbiterator_t *sdbiter, unsigned int i,
+	     const dns_name_t *name, bool before) {
+	shardcache_subiterator_t *sub = &sdbiter->subs[i];
+	isc_result_t result;
+
+	result = sub_seek(sdbiter, i, name, !before);
+	if (result == ISC_R_SUCCESS) {
+		result = dns_dbiterator_prev(sub->iter);
+	} else if (result == ISC_R_NOMORE) {
+		result = dns_dbiterator_last(sub->iter);
+	} else {
+		return (result);
+	}
+
+	return (sub_load(sdbiter, i, result));
+}
+
+/*%
+ * Make the shard iterator with the first (or, if moving backward, the
+ * last) node the current one.
+ */
+static isc_result_t
+pick(shardcache_dbiterator_t *sdbiter) {
+	isc_result_t result = ISC_R_NOMORE;
+
+	for (unsigned int i = 0; i < sdbiter->nsubs; i++) {
+		shardcache_subiterator_t *sub = &sdbiter->subs[i];
+		int order;
+
+		if (sub->result == ISC_R_NOMORE) {
+			continue;
+		}
+		if (sub->result != ISC_R_SUCCESS) {
+			result = sub->result;
+			break;
+		}
+		if (result == ISC_R_NOMORE) {
+			sdbiter->current = i;
+			result = ISC_R_SUCCESS;
+			continue;
+		}
+
+		/*
+		 * Of two nodes with the same name, the one in the lower
+		 * shard comes first.
+		 */
+		order = dns_name_compare(sub->name,
+					 sdbiter->subs[sdbiter->current].name);
+		if ((sdbiter->forward && order < 0) ||
+		    (!sdbiter->forward && order >= 0)) {
+			sdbiter->current = i;
+		}
+	}
+
+	sdbiter->result = result;
+
+	return (result);
+}
+
+static void
+dbiterator_destroy(dns_dbiterator_t **iteratorp) {
+	shardcache_dbiterator_t *sdbiter = (shardcache_dbiterator_t *)(*iteratorp);
+	dns_db_t *db = NULL;
+
+	*iteratorp = NULL;
+
+	for (unsigned int i = 0; i < sdbiter->nsubs; i++) {
+		if (sdbiter->subs[i].iter != NULL) {
+			dns_dbiterator_destroy(&sdbiter->subs[i].iter);
+		}
+	}
+	isc_mem_put(sdbiter->common.db->mctx, sdbiter->subs,
+		    sdbiter->nsubs * sizeof(sdbiter->subs[0]));
+
+	dns_db_attach(sdbiter->common.db, &db);
+	dns_db_detach(&sdbiter->common.db);
+
+	sdbiter->common.magic = 0;
+	isc_mem_put(db->mctx, sdbiter, sizeof(*sdbiter));
+	dns_db_detach(&db);
+}
+
+static isc_result_t
+dbiterator_first(dns_dbiterator_t *iterator) {
+	shardcache_dbiterator_t *sdbiter = (shardcache_dbiterator_t *)iterator;
+
+	for (unsigned int i = 0; i < sdbiter->nsubs; i++) {
+		(void)sub_load(sdbiter, i,
+			       dns_dbiterator_first(sdbiter->subs[i].iter));
+	}
+	sdbiter->forward = true;
+
+	return (pick(sdbiter));
+}
+
+static isc_result_t
+dbiterator_last(dns_dbiterator_t *iterator) {
+	shardcache_dbiterator_t *sdbiter = (shardcache_dbiterator_t *)iterator;
+
+	for (unsigned int i = 0; i < sdbiter->nsubs; i++) {
+		(void)sub_load(sdbiter, i,
+			       dns_dbiterator_last(sdbiter->subs[i].iter));
+	}
+	sdbiter->forward = false;
+
+	return (pick(sdbiter));
+}
+
+static isc_result_t
+dbiterator_seek(dns_dbiterator_t *iterator, const dns_name_t *name) {
+	shardcache_dbiterator_t *sdbiter = (shardcache_dbiterator_t *)iterator;
+	isc_result_t result;
+
+	for (unsigned int i = 0; i < sdbiter->nsubs; i++) {
+		result = sub_seek(sdbiter, i, name, false);
+		if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE) {
+			sdbiter->result = result;
+			return (result);
+		}
+	}
+	sdbiter->forward = true;
+
+	result = pick(sdbiter);
+	if (result == ISC_R_SUCCESS &&
+	    dns_name_equal(sdbiter->subs[sdbiter->current].name, name)) {
+		return (ISC_R_SUCCESS);
+	}
+
+	/*
+	 * Like the shards' iterators, stop at the node before 'name' if
+	 * there's no node for 'name'.
+	 */
+	if (result == ISC_R_SUCCESS) {
+		result = dbiterator_prev(iterator);
+	} else if (result == ISC_R_NOMORE) {
+		result = dbiterator_last(iterator);
+	}
+	if (result == ISC_R_SUCCESS) {
+		result = DNS_R_PARTIALMATCH;
+	} else if (result == ISC_R_NOMORE) {
+		result = ISC_R_NOTFOUND;
+	}
+
+	return (result);
+}
+
+static isc_result_t
+dbiterator_prev(dns_dbiterator_t *iterator) {
+	shardcache_dbiterator_t *sdbiter = (shardcache_dbiterator_t *)iterator;
+	shardcache_subiterator_t *cur = NULL;
+	isc_result_t result;
+
+	if (sdbiter->result != ISC_R_SUCCESS) {
+		return (sdbiter->result);
+	}
+
+	cur = &sdbiter->subs[sdbiter->current];
+	(void)dns_dbiterator_pause(cur->iter);
+
+	if (sdbiter->forward) {
+		for (unsigned int i = 0; i < sdbiter->nsubs; i++) {
+			if (i == sdbiter->current) {
+				continue;
+			}
+			result = sub_seekback(sdbiter, i, cur->name,
+					      i > sdbiter->current);
+			if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE) {
+				sdbiter->result = result;
+				return (result);
+			}
+		}
+		sdbiter->forward = false;
+	}
+
+	(void)sub_load(sdbiter, sdbiter->current,
+		       dns_dbiterator_prev(cur->iter));
+
+	return (pick(sdbiter));
+}
+
+static isc_result_t
+dbiterator_next(dns_dbiterator_t *iterator) {
+	shardcache_dbiterator_t *sdbiter = (shardcache_dbiterator_t *)iterator;
+	shardcache_subiterator_t *cur = NULL;
+	isc_result_t result;
+
+	if (sdbiter->result != ISC_R_SUCCESS) {
+		return (sdbiter->result);
+	}
+
+	cur = &sdbiter->subs[sdbiter->current];
+	(void)dns_dbiterator_pause(cur->iter);
+
+	if (!sdbiter->forward) {
+		for (unsigned int i = 0; i < sdbiter->nsubs; i++) {
+			if (i == sdbiter->current) {
+				continue;
+			}
+			result = sub_seek(sdbiter, i, cur->name,
+					  i < sdbiter->current);
+			if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE) {
+				sdbiter->result = result;
+				return (result);
+			}
+		}
+		sdbiter->forward = true;
+	}
+
+	(void)sub_load(sdbiter, sdbiter->current,
+		       dns_dbiterator_next(cur->iter));
+
+	return (pick(sdbiter));
+}
+
+static isc_result_t
+dbiterator_current(dns_dbiterator_t *iterator, dns_dbnode_t **nodep,
+		   dns_name_t *name) {
+	shardcache_dbiterator_t *sdbiter = (shardcache_dbiterator_t *)iterator;
+
+	REQUIRE(sdbiter->result == ISC_R_SUCCESS);
+
+	return (dns_dbiterator_current(sdbiter->subs[sdbiter->current].iter,
+				       nodep, name));
+}
+
+static isc_result_t
+dbiterator_pause(dns_dbiterator_t *iterator) {
+	shardcache_dbiterator_t *sdbiter = (shardcache_dbiterator_t *)iterator;
+
+	if (sdbiter->result != ISC_R_SUCCESS &&
+	    sdbiter->result != ISC_R_NOMORE) {
+		return (sdbiter->result);
+	}
+
+	for (unsigned int i = 0; i < sdbiter->nsubs; i++) {
+		(void)dns_dbiterator_pause(sdbiter->subs[i].iter);
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+dbiterator_origin(dns_dbiterator_t *iterator, dns_name_t *name) {
+	UNUSED(iterator);
+
+	dns_name_copynf(dns_rootname, name);
+
+	return (ISC_R_SUCCESS);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef DNS_SHARDCACHE_H
+#define DNS_SHARDCACHE_H 1
+
+#include <isc/lang.h>
+
+#include <dns/types.h>
+
+/*****
+***** Module Info
+*****/
+
+/*! \file
+ * \brief
+ * Sharded Cache DB Implementation
+ *
+ * A cache database of type "shardcache" is made of several cache
+ * databases of type "rbt", the shards, each with its own tree, tree lock,
+ * LRU lists and TTL heaps, so that cache updates for different names
+ * don't contend on a single tree lock.
+ *
+ * Root and top level domain names are kept in shard 0; every other name
+ * is kept in the shard chosen by a hash of its second level domain, so
+ * that a domain and the names below it are always in the same shard.
+ * Lookups that don't find a zone cut in a name's own shard continue in
+ * shard 0.
+ */
+
+/*%
+ * The most shards a sharded cache can have.
+ */
+#define DNS_SHARDCACHE_MAX 64
+
+ISC_LANG_BEGINDECLS
+
+isc_result_t
+dns_shardcache_create(isc_mem_t *mctx, const dns_name_t *base,
+		      dns_dbtype_t type, dns_rdataclass_t rdclass,
+		      unsigned int argc, char *argv[], void *driverarg,
+		      dns_db_t **dbp);
+
+/*%<
+ * Create a new database of type "shardcache".  Called via
+ * dns_db_create(); see documentation for that function for more details.
+ *
+ * argv[0] points to the memory context the shards use for heap memory
+ * (see dns_rbtdb_create()), and argv[1] is the number of shards.
+ *
+ * Requires:
+ *
+ * \li type == dns_dbtype_cache.
+ * \li argc == 2 and argv[0] is a valid memory context.
+ *
+ * Returns:
+ *
+ * \li #ISC_R_SUCCESS
+ * \li #ISC_R_RANGE		argv[1] isn't a number from 2 to
+ *				#DNS_SHARDCACHE_MAX.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_SHARDCACHE_H */
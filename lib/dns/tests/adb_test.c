@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <sched.h> /* IWYU pragma: keep */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/util.h>
+
+#include <dns/adb.h>
+
+#include "dnstest.h"
+
+/*
+ * Include the source file so that the static functions that maintain
+ * the latency histogram can be tested.
+ */
+#include "../adb.c"
+
+/* the histogram bucket of a round trip time */
+static void
+rttbucket_test(void **state) {
+	UNUSED(state);
+
+	/* Everything below 384us is counted in the first bucket */
+	assert_int_equal(rttbucket(0), 0);
+	assert_int_equal(rttbucket(255), 0);
+	assert_int_equal(rttbucket(256), 0);
+	assert_int_equal(rttbucket(383), 0);
+
+	/* Then two buckets per power of two */
+	assert_int_equal(rttbucket(384), 1);
+	assert_int_equal(rttbucket(511), 1);
+	assert_int_equal(rttbucket(512), 2);
+	assert_int_equal(rttbucket(767), 2);
+	assert_int_equal(rttbucket(768), 3);
+	assert_int_equal(rttbucket(1023), 3);
+	assert_int_equal(rttbucket(1024), 4);
+	assert_int_equal(rttbucket(10000), 10);
+
+	/* And everything from 12.6s up in the last one */
+	assert_int_equal(rttbucket(12582911), ADB_RTT_BUCKETS - 2);
+	assert_int_equal(rttbucket(12582912), ADB_RTT_BUCKETS - 1);
+	assert_int_equal(rttbucket(16777216), ADB_RTT_BUCKETS - 1);
+	assert_int_equal(rttbucket(UINT_MAX), ADB_RTT_BUCKETS - 1);
+}
+
+/* estimating a percentile from the histogram */
+static void
+rttpercentile_test(void **state) {
+	dns_adbentry_t entry;
+
+	UNUSED(state);
+
+	/*
+	 * The samples are assumed to be spread evenly within a bucket.
+	 */
+	memset(&entry, 0, sizeof(entry));
+	entry.rtthist[2] = 100;
+	entry.rttsamples = 100;
+	assert_int_equal(rttpercentile(&entry, 1), 514);
+	assert_int_equal(rttpercentile(&entry, 50), 640);
+	assert_int_equal(rttpercentile(&entry, 100), 768);
+
+	/*
+	 * A percentile falls in the bucket that holds the sample of its
+	 * rank.
+	 */
+	memset(&entry, 0, sizeof(entry));
+	entry.rtthist[0] = 90;
+	entry.rtthist[10] = 10;
+	entry.rttsamples = 100;
+	assert_int_equal(rttpercentile(&entry, 50), 327);
+	assert_int_equal(rttpercentile(&entry, 90), 384);
+	assert_int_equal(rttpercentile(&entry, 95), 10240);
+	assert_int_equal(rttpercentile(&entry, 99), 11878);
+	assert_int_equal(rttpercentile(&entry, 100), 12288);
+}
+
+/* halving the histogram when it is full */
+static void
+rttsample_test(void **state) {
+	dns_adbentry_t entry;
+	unsigned int i;
+
+	UNUSED(state);
+
+	memset(&entry, 0, sizeof(entry));
+	for (i = 0; i < ADB_RTT_MAXSAMPLES - 1; i++) {
+		rttsample(&entry, 300);
+	}
+	rttsample(&entry, 10000);
+	assert_int_equal(entry.rttsamples, ADB_RTT_MAXSAMPLES);
+	assert_int_equal(entry.rtthist[0], ADB_RTT_MAXSAMPLES - 1);
+	assert_int_equal(entry.rtthist[10], 1);
+
+	/*
+	 * The next sample halves every bucket first, dropping the lone
+	 * sample of 10ms, before it is counted.
+	 */
+	rttsample(&entry, 10000);
+	assert_int_equal(entry.rttsamples, ADB_RTT_MAXSAMPLES / 2);
+	assert_int_equal(entry.rtthist[0], ADB_RTT_MAXSAMPLES / 2 - 1);
+	assert_int_equal(entry.rtthist[10], 1);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(rttbucket_test),
+		cmocka_unit_test(rttpercentile_test),
+		cmocka_unit_test(rttsample_test),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif /* if HAVE_CMOCKA */
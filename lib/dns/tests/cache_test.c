@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <sched.h> /* IWYU pragma: keep */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/buffer.h>
+#include <isc/file.h>
+#include <isc/print.h>
+#include <isc/stdtime.h>
+#include <isc/util.h>
+
+#include <dns/cache.h>
+#include <dns/db.h>
+#include <dns/name.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+
+#include "dnstest.h"
+
+#define SNAPSHOT "cache_test.snap"
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = dns_test_begin(NULL, false);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	(void)isc_file_remove(SNAPSHOT);
+	dns_test_end();
+
+	return (0);
+}
+
+static dns_cache_t *
+create_cache(void) {
+	dns_cache_t *cache = NULL;
+	isc_result_t result;
+
+	result = dns_cache_create(dt_mctx, dt_mctx, NULL, NULL,
+				  dns_rdataclass_in, "test", "rbt", 0, NULL,
+				  &cache);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_cache_setservestalettl(cache, 3600);
+	result = dns_cache_setsnapshot(cache, SNAPSHOT);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (cache);
+}
+
+/*
+ * Add an rdataset with a single rdata to 'cache' as of 'now'.  A type
+ * of 0 adds an NXDOMAIN negative cache entry.
+ */
+static void
+add(dns_cache_t *cache, const char *owner, dns_rdatatype_t type,
+    unsigned char *data, unsigned int length, dns_ttl_t ttl,
+    dns_trust_t trust, isc_stdtime_t now) {
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_fixedname_t fname;
+	dns_dbnode_t *node = NULL;
+	dns_db_t *db = NULL;
+	isc_result_t result;
+
+	dns_test_namefromstring(owner, &fname);
+
+	rdata.data = data;
+	rdata.length = length;
+	rdata.rdclass = dns_rdataclass_in;
+	rdata.type = type;
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = type;
+	rdatalist.ttl = ttl;
+	if (type == 0) {
+		rdatalist.covers = dns_rdatatype_any;
+	}
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	rdataset.trust = trust;
+	if (type == 0) {
+		rdataset.attributes |= DNS_RDATASETATTR_NEGATIVE |
+				       DNS_RDATASETATTR_NXDOMAIN;
+	}
+
+	dns_cache_attachdb(cache, &db);
+	result = dns_db_findnode(db, dns_fixedname_name(&fname), true, &node);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_db_addrdataset(db, node, NULL, now, &rdataset, 0, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_rdataset_disassociate(&rdataset);
+	dns_db_detachnode(db, &node);
+	dns_db_detach(&db);
+}
+
+static isc_result_t
+find(dns_cache_t *cache, const char *owner, unsigned int options,
+     isc_stdtime_t now, dns_rdataset_t *rdataset) {
+	dns_fixedname_t fname, ffound;
+	dns_db_t *db = NULL;
+	isc_result_t result;
+
+	dns_test_namefromstring(owner, &fname);
+	dns_fixedname_init(&ffound);
+
+	dns_cache_attachdb(cache, &db);
+	result = dns_db_find(db, dns_fixedname_name(&fname), NULL,
+			     dns_rdatatype_a, options, now, NULL,
+			     dns_fixedname_name(&ffound), rdataset, NULL);
+	dns_db_detach(&db);
+
+	return (result);
+}
+
+/*
+ * Fill a cache and write a snapshot of it.
+ */
+static void
+make_snapshot(isc_stdtime_t now) {
+	/*
+	 * An NXDOMAIN negative cache entry: the SOA record of
+	 * "example." with empty names and 300 for all of its numbers.
+	 */
+	static unsigned char ncache[] = {
+		/* owner, type, trust, count */
+		7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0, 0, 6, 5, 0, 1,
+		/* rdata length, MNAME, RNAME */
+		0, 22, 0, 0,
+		/* SERIAL, REFRESH, RETRY, EXPIRE, MINIMUM */
+		0, 0, 1, 44, 0, 0, 1, 44, 0, 0, 1, 44, 0, 0, 1, 44, 0, 0, 1, 44
+	};
+	unsigned char a1[] = { 10, 0, 0, 1 };
+	unsigned char a2[] = { 10, 0, 0, 2 };
+	unsigned char a3[] = { 10, 0, 0, 3 };
+	dns_cache_t *cache = create_cache();
+	isc_result_t result;
+
+	add(cache, "fresh.example.", dns_rdatatype_a, a1, sizeof(a1), 600,
+	    dns_trust_answer, now);
+	/* Expired 100 seconds ago, may be served stale for another hour. */
+	add(cache, "stale.example.", dns_rdatatype_a, a2, sizeof(a2), 100,
+	    dns_trust_authanswer, now - 200);
+	/* Expired two hours ago, can't be served stale any more. */
+	add(cache, "gone.example.", dns_rdatatype_a, a3, sizeof(a3), 100,
+	    dns_trust_answer, now - 7200);
+	add(cache, "nx.example.", 0, ncache, sizeof(ncache), 300,
+	    dns_trust_authauthority, now);
+
+	result = dns_cache_dumpsnapshot(cache);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* Clearing the file name keeps the snapshot from being rewritten. */
+	result = dns_cache_setsnapshot(cache, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_cache_detach(&cache);
+}
+
+/* write a snapshot and load it into another cache */
+static void
+snapshot_test(void **state) {
+	dns_rdataset_t rdataset;
+	dns_cache_t *cache = NULL;
+	isc_stdtime_t now;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	isc_stdtime_get(&now);
+	make_snapshot(now);
+
+	cache = create_cache();
+	result = dns_cache_loadsnapshot(cache);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_rdataset_init(&rdataset);
+	result = find(cache, "fresh.example.", 0, now, &rdataset);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(rdataset.ttl <= 600 && rdataset.ttl >= 590);
+	assert_int_equal(rdataset.trust, dns_trust_answer);
+	dns_rdataset_disassociate(&rdataset);
+
+	result = find(cache, "nx.example.", 0, now, &rdataset);
+	assert_int_equal(result, DNS_R_NCACHENXDOMAIN);
+	assert_int_equal(rdataset.trust, dns_trust_authauthority);
+	dns_rdataset_disassociate(&rdataset);
+
+	result = find(cache, "stale.example.", 0, now, &rdataset);
+	assert_int_not_equal(result, ISC_R_SUCCESS);
+	if (dns_rdataset_isassociated(&rdataset)) {
+		dns_rdataset_disassociate(&rdataset);
+	}
+	result = find(cache, "stale.example.", DNS_DBFIND_STALEOK, now,
+		      &rdataset);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(rdataset.trust, dns_trust_authanswer);
+	dns_rdataset_disassociate(&rdataset);
+
+	result = find(cache, "gone.example.", DNS_DBFIND_STALEOK, now,
+		      &rdataset);
+	assert_int_not_equal(result, ISC_R_SUCCESS);
+	if (dns_rdataset_isassociated(&rdataset)) {
+		dns_rdataset_disassociate(&rdataset);
+	}
+
+	result = dns_cache_setsnapshot(cache, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_cache_detach(&cache);
+}
+
+/* damaged or missing snapshots are not loaded */
+static void
+badsnapshot_test(void **state) {
+	dns_cache_t *cache = NULL;
+	isc_stdtime_t now;
+	isc_result_t result;
+	off_t size;
+	FILE *fp;
+
+	UNUSED(state);
+
+	(void)isc_file_remove(SNAPSHOT);
+	cache = create_cache();
+	result = dns_cache_loadsnapshot(cache);
+	assert_int_equal(result, ISC_R_FILENOTFOUND);
+
+	isc_stdtime_get(&now);
+	make_snapshot(now);
+	result = isc_file_getsize(SNAPSHOT, &size);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* Damage the last byte of the file. */
+	fp = fopen(SNAPSHOT, "r+b");
+	assert_non_null(fp);
+	assert_int_equal(fseek(fp, size - 1, SEEK_SET), 0);
+	assert_int_equal(fputc(0xff, fp), 0xff);
+	assert_int_equal(fclose(fp), 0);
+
+	result = dns_cache_loadsnapshot(cache);
+	assert_int_equal(result, ISC_R_INVALIDFILE);
+
+	/* Cut it off in the middle of the header. */
+	assert_int_equal(truncate(SNAPSHOT, 16), 0);
+	result = dns_cache_loadsnapshot(cache);
+	assert_int_equal(result, ISC_R_UNEXPECTEDEND);
+
+	result = dns_cache_setsnapshot(cache, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_cache_detach(&cache);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(snapshot_test, _setup,
+						_teardown),
+		cmocka_unit_test_setup_teardown(badsnapshot_test, _setup,
+						_teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif /* if HAVE_CMOCKA */
@@ -21,12 +21,22 @@
 #define UNIT_TESTING
 #include <cmocka.h>
 
+#include <isc/os.h>
+#include <isc/print.h>
+#include <isc/stats.h>
+#include <isc/thread.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/callbacks.h>
 #include <dns/db.h>
 #include <dns/dbiterator.h>
 #include <dns/journal.h>
 #include <dns/name.h>
 #include <dns/rdatalist.h>
+#include <dns/stats.h>
 
+#include "../rbtdb.h"
 #include "dnstest.h"
 
 static int
@@ -275,6 +285,133 @@ dns_dbfind_staleok_test(void **state) {
 	isc_mem_detach(&mctx);
 }
 
+static void
+water(void *arg, int mark) {
+	UNUSED(arg);
+	UNUSED(mark);
+}
+
+static void
+add_a(dns_db_t *db, const char *owner) {
+	unsigned char data[] = { 0x0a, 0x00, 0x00, 0x01 };
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_fixedname_t fixed;
+	dns_name_t *name = dns_fixedname_initname(&fixed);
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_dbnode_t *node = NULL;
+	isc_result_t result;
+
+	result = dns_name_fromstring(name, owner, 0, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	rdata.data = data;
+	rdata.length = 4;
+	rdata.rdclass = dns_rdataclass_in;
+	rdata.type = dns_rdatatype_a;
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.ttl = 3600;
+	rdatalist.type = dns_rdatatype_a;
+	rdatalist.rdclass = dns_rdataclass_in;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_db_findnode(db, name, true, &node);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_db_addrdataset(db, node, NULL, 0, &rdataset, 0, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_db_detachnode(db, &node);
+	dns_rdataset_disassociate(&rdataset);
+}
+
+static isc_result_t
+find_a(dns_db_t *db, const char *owner) {
+	dns_fixedname_t fixed, ffound;
+	dns_name_t *name = dns_fixedname_initname(&fixed);
+	dns_name_t *found = dns_fixedname_initname(&ffound);
+	dns_rdataset_t rdataset;
+	dns_dbnode_t *node = NULL;
+	isc_result_t result;
+
+	result = dns_name_fromstring(name, owner, 0, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_rdataset_init(&rdataset);
+	result = dns_db_find(db, name, NULL, dns_rdatatype_a, 0, 0, &node,
+			     found, &rdataset, NULL);
+	if (dns_rdataset_isassociated(&rdataset)) {
+		dns_rdataset_disassociate(&rdataset);
+	}
+	if (node != NULL) {
+		dns_db_detachnode(db, &node);
+	}
+
+	return (result);
+}
+
+/* a record that is looked up is kept when the cache is over memory */
+static void
+eviction_test(void **state) {
+	dns_db_t *db = NULL;
+	isc_mem_t *mctx = NULL;
+	isc_stats_t *stats = NULL;
+	isc_result_t result;
+	size_t hiwater;
+	char name[64];
+	int i;
+
+	UNUSED(state);
+
+	isc_mem_create(&mctx);
+
+	result = dns_db_create(mctx, "rbt", dns_rootname, dns_dbtype_cache,
+			       dns_rdataclass_in, 0, NULL, &db);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	isc_stats_create(mctx, &stats, dns_cachestatscounter_max);
+	dns_db_setcachestats(db, stats);
+
+	add_a(db, "hot.example");
+
+	/*
+	 * Leave room for the TTL heaps of all the buckets as well as for
+	 * a few thousand records.
+	 */
+	hiwater = isc_mem_inuse(mctx) + 4 * 1024 * 1024;
+	isc_mem_setwater(mctx, water, NULL, hiwater, hiwater - 1024 * 1024);
+
+	/*
+	 * Fill the cache with names that are never looked up again,
+	 * looking up the first one after every addition.
+	 */
+	for (i = 0; i < 40000; i++) {
+		snprintf(name, sizeof(name), "cold%d.example", i);
+		add_a(db, name);
+		assert_int_equal(find_a(db, "hot.example"), ISC_R_SUCCESS);
+	}
+
+	assert_true(isc_stats_get_counter(stats,
+					  dns_cachestatscounter_deletelru) > 0);
+	assert_true(isc_stats_get_counter(
+			    stats, dns_cachestatscounter_evictspared) > 0);
+	assert_true(isc_stats_get_counter(
+			    stats, dns_cachestatscounter_evictscanned) >=
+		    isc_stats_get_counter(stats,
+					  dns_cachestatscounter_deletelru));
+	assert_int_equal(find_a(db, "cold0.example"), ISC_R_NOTFOUND);
+	assert_true(dns_db_nodecount(db) < 40000);
+
+	isc_mem_setwater(mctx, NULL, NULL, 0, 0);
+	dns_db_detach(&db);
+	isc_stats_detach(&stats);
+	isc_mem_detach(&mctx);
+}
+
 /* database class */
 static void
 class_test(void **state) {
@@ -395,16 +532,275 @@ version_test(void **state) {
 	dns_db_detach(&db);
 }
 
+/*
+ * Make 'rdataset' an A RRset holding the address in 'data'.
+ */
+static void
+mkrdataset(dns_rdatalist_t *rdatalist, dns_rdata_t *rdata,
+	   unsigned char *data, dns_rdataset_t *rdataset) {
+	isc_result_t result;
+	isc_region_t region = { data, 4 };
+
+	dns_rdata_init(rdata);
+	dns_rdata_fromregion(rdata, dns_rdataclass_in, dns_rdatatype_a,
+			     &region);
+	dns_rdatalist_init(rdatalist);
+	rdatalist->rdclass = dns_rdataclass_in;
+	rdatalist->type = dns_rdatatype_a;
+	rdatalist->ttl = 300;
+	ISC_LIST_APPEND(rdatalist->rdata, rdata, link);
+	dns_rdataset_init(rdataset);
+	result = dns_rdatalist_tordataset(rdatalist, rdataset);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+/* growing the hash table is finished when a load or update is done */
+static void
+rehash_test(void **state) {
+	isc_result_t result;
+	dns_db_t *db = NULL;
+	dns_dbversion_t *version = NULL;
+	dns_dbnode_t *node = NULL;
+	dns_rdatacallbacks_t callbacks;
+	dns_rdatalist_t rdatalist;
+	dns_rdata_t rdata;
+	dns_rdataset_t rdataset;
+	dns_fixedname_t fname;
+	dns_name_t *name;
+	unsigned char data[4] = { 10, 0, 0, 1 };
+	char namebuf[64];
+	unsigned int i;
+
+	UNUSED(state);
+
+	dns_test_namefromstring("test.test", &fname);
+	result = dns_db_create(dt_mctx, "rbt", dns_fixedname_name(&fname),
+			       dns_dbtype_zone, dns_rdataclass_in, 0, NULL,
+			       &db);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	mkrdataset(&rdatalist, &rdata, data, &rdataset);
+
+	/*
+	 * Load names until the hash table is being grown.  A zone that
+	 * has been loaded does not change, so the rest of the old table
+	 * has to be moved when the load is over.
+	 */
+	dns_rdatacallbacks_init(&callbacks);
+	result = dns_db_beginload(db, &callbacks);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	for (i = 0; !dns__rbtdb_rehashing(db); i++) {
+		assert_true(i < (1U << 20));
+		snprintf(namebuf, sizeof(namebuf), "n%u.test.test", i);
+		dns_test_namefromstring(namebuf, &fname);
+		name = dns_fixedname_name(&fname);
+		result = callbacks.add(callbacks.add_private, name, &rdataset);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+	result = dns_db_endload(db, &callbacks);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_false(dns__rbtdb_rehashing(db));
+
+	/*
+	 * The same goes for an update that makes the table grow.
+	 */
+	result = dns_db_newversion(db, &version);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	for (; !dns__rbtdb_rehashing(db); i++) {
+		assert_true(i < (1U << 20));
+		snprintf(namebuf, sizeof(namebuf), "n%u.test.test", i);
+		dns_test_namefromstring(namebuf, &fname);
+		name = dns_fixedname_name(&fname);
+		result = dns_db_findnode(db, name, true, &node);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		result = dns_db_addrdataset(db, node, version, 0, &rdataset,
+					    0, NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		dns_db_detachnode(db, &node);
+	}
+	dns_db_closeversion(db, &version, true);
+	assert_false(dns__rbtdb_rehashing(db));
+
+	dns_rdataset_disassociate(&rdataset);
+	dns_db_detach(&db);
+}
+
+/* lock-free lookups give the same answers as locked ones */
+static void
+lockfree_test(void **state) {
+	static const struct {
+		const char *name;
+		dns_rdatatype_t type;
+		isc_result_t result;
+		const char *foundname;
+	} tests[] = {
+		{ "b.test.test", dns_rdatatype_a, ISC_R_SUCCESS, "b.test.test" },
+		{ "b.test.test", dns_rdatatype_mx, DNS_R_NXRRSET,
+		  "b.test.test" },
+		{ "test.test", dns_rdatatype_soa, ISC_R_SUCCESS, "test.test" },
+		{ "a.test.test", dns_rdatatype_a, DNS_R_DELEGATION,
+		  "a.test.test" },
+		{ "x.a.test.test", dns_rdatatype_a, DNS_R_DELEGATION,
+		  "a.test.test" },
+		{ "c.test.test", dns_rdatatype_a, DNS_R_NXDOMAIN, NULL },
+	};
+	isc_result_t result;
+	dns_fixedname_t fname, ffound, fexpected;
+	dns_name_t *name, *foundname, *expected;
+	dns_db_t *db = NULL;
+	dns_dbnode_t *node = NULL;
+	dns_rdataset_t rdataset;
+
+	UNUSED(state);
+
+	result = dns_test_loaddb(&db, dns_dbtype_zone, "test.test",
+				 "testdata/db/data.db");
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (int lockfree = 0; lockfree < 2; lockfree++) {
+		dns__rbtdb_setlockfree(lockfree);
+
+		for (size_t i = 0; i < ARRAY_SIZE(tests); i++) {
+			dns_test_namefromstring(tests[i].name, &fname);
+			name = dns_fixedname_name(&fname);
+			foundname = dns_fixedname_initname(&ffound);
+			dns_rdataset_init(&rdataset);
+
+			result = dns_db_find(db, name, NULL, tests[i].type, 0,
+					     0, &node, foundname, &rdataset,
+					     NULL);
+			assert_int_equal(result, tests[i].result);
+
+			if (tests[i].foundname != NULL) {
+				dns_test_namefromstring(tests[i].foundname,
+							&fexpected);
+				expected = dns_fixedname_name(&fexpected);
+				assert_true(dns_name_equal(foundname,
+							   expected));
+			}
+			if (result == ISC_R_SUCCESS) {
+				assert_true(dns_rdataset_isassociated(
+					&rdataset));
+			}
+			if (dns_rdataset_isassociated(&rdataset)) {
+				dns_rdataset_disassociate(&rdataset);
+			}
+			if (node != NULL) {
+				dns_db_detachnode(db, &node);
+			}
+		}
+	}
+
+	dns__rbtdb_setlockfree(true);
+	dns_db_detach(&db);
+}
+
+#if defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__)
+
+/*
+ * Benchmark zone lookups with and without the lock-free path for a
+ * growing number of threads.
+ */
+
+#define FIND_COUNT 1000000
+
+static void *
+find_thread(void *arg) {
+	dns_db_t *db = arg;
+	dns_fixedname_t fname, ffound;
+	dns_name_t *name, *foundname;
+	dns_dbnode_t *node = NULL;
+	dns_rdataset_t rdataset;
+	isc_result_t result;
+
+	dns_test_namefromstring("b.test.test", &fname);
+	name = dns_fixedname_name(&fname);
+	foundname = dns_fixedname_initname(&ffound);
+	dns_rdataset_init(&rdataset);
+
+	for (int i = 0; i < FIND_COUNT; i++) {
+		result = dns_db_find(db, name, NULL, dns_rdatatype_a, 0, 0,
+				     &node, foundname, &rdataset, NULL);
+		INSIST(result == ISC_R_SUCCESS);
+		dns_rdataset_disassociate(&rdataset);
+		dns_db_detachnode(db, &node);
+	}
+
+	return (NULL);
+}
+
+static void
+benchmark_test(void **state) {
+	isc_result_t result;
+	isc_time_t ts1, ts2;
+	double t;
+	unsigned int i, nthreads, maxthreads;
+	isc_thread_t threads[32];
+	dns_db_t *db = NULL;
+
+	UNUSED(state);
+
+	debug_mem_record = false;
+
+	result = dns_test_loaddb(&db, dns_dbtype_zone, "test.test",
+				 "testdata/db/data.db");
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	maxthreads = ISC_MIN(isc_os_ncpus(), 32);
+	maxthreads = ISC_MAX(maxthreads, 1);
+
+	for (int lockfree = 0; lockfree < 2; lockfree++) {
+		dns__rbtdb_setlockfree(lockfree);
+
+		for (nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+			result = isc_time_now(&ts1);
+			assert_int_equal(result, ISC_R_SUCCESS);
+
+			for (i = 0; i < nthreads; i++) {
+				isc_thread_create(find_thread, db,
+						  &threads[i]);
+			}
+			for (i = 0; i < nthreads; i++) {
+				isc_thread_join(threads[i], NULL);
+			}
+
+			result = isc_time_now(&ts2);
+			assert_int_equal(result, ISC_R_SUCCESS);
+
+			t = isc_time_microdiff(&ts2, &ts1);
+
+			printf("%s, %u threads: %u dns_db_find() calls, "
+			       "%f seconds, %f calls/second\n",
+			       lockfree ? "lock-free" : "locked", nthreads,
+			       nthreads * FIND_COUNT, t / 1000000.0,
+			       (nthreads * FIND_COUNT) / (t / 1000000.0));
+		}
+	}
+
+	dns__rbtdb_setlockfree(true);
+	dns_db_detach(&db);
+}
+
+#endif /* defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__) */
+
 int
 main(void) {
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test(getoriginnode_test),
 		cmocka_unit_test(getsetservestalettl_test),
 		cmocka_unit_test(dns_dbfind_staleok_test),
+		cmocka_unit_test(eviction_test),
 		cmocka_unit_test_setup_teardown(class_test, _setup, _teardown),
 		cmocka_unit_test_setup_teardown(dbtype_test, _setup, _teardown),
 		cmocka_unit_test_setup_teardown(version_test, _setup,
 						_teardown),
+		cmocka_unit_test_setup_teardown(rehash_test, _setup,
+						_teardown),
+		cmocka_unit_test_setup_teardown(lockfree_test, _setup,
+						_teardown),
+#if defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__)
+		cmocka_unit_test_setup_teardown(benchmark_test, _setup,
+						_teardown),
+#endif /* defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__) */
 	};
 
 	return (cmocka_run_group_tests(tests, NULL, NULL));
@@ -26,16 +26,24 @@
 
 #include <isc/app.h>
 #include <isc/buffer.h>
+#include <isc/netmgr.h>
+#include <isc/os.h>
+#include <isc/print.h>
 #include <isc/refcount.h>
 #include <isc/socket.h>
+#include <isc/stats.h>
 #include <isc/task.h>
+#include <isc/thread.h>
+#include <isc/time.h>
 #include <isc/timer.h>
 #include <isc/util.h>
 
 #include <dns/dispatch.h>
 #include <dns/name.h>
+#include <dns/stats.h>
 #include <dns/view.h>
 
+#include "../dispatch_p.h"
 #include "dnstest.h"
 
 dns_dispatchmgr_t *dispatchmgr = NULL;
@@ -331,6 +339,626 @@ dispatch_getnext(void **state) {
 	dns_dispatchmgr_destroy(&dispatchmgr);
 }
 
+static void
+nmsenddone(isc_task_t *task, isc_event_t *event) {
+	isc_socketevent_t *sevent = (isc_socketevent_t *)event;
+
+	UNUSED(task);
+
+	assert_int_equal(sevent->result, ISC_R_SUCCESS);
+	isc_event_free(&event);
+}
+
+static void
+startit_nm(isc_task_t *task, isc_event_t *event) {
+	isc_socketevent_t *sendevent;
+
+	sendevent = isc_socket_socketevent(dt_mctx, NULL,
+					   ISC_SOCKEVENT_SENDDONE, nmsenddone,
+					   NULL);
+	dns_dispatch_send(dispentry, event->ev_arg, task, sendevent);
+	isc_event_free(&event);
+}
+
+/* test dispatch getnext with a netmgr dispatch socket */
+static void
+dispatch_getnext_nm(void **state) {
+	isc_region_t region;
+	isc_result_t result;
+	isc_socket_t *sock = NULL;
+	isc_task_t *task = NULL;
+	isc_nm_t *nm = NULL;
+	isc_sockaddr_t any;
+	uint16_t id;
+	struct in_addr ina;
+	unsigned char message[12];
+	unsigned int attrs;
+	unsigned char rbuf[12];
+
+	UNUSED(state);
+
+	atomic_init(&responses, 0);
+	atomic_init(&first, true);
+
+	nm = isc_nm_start(dt_mctx, isc_os_ncpus());
+	assert_non_null(nm);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_dispatchmgr_create(dt_mctx, &dispatchmgr);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_dispatchmgr_setnetmgr(dispatchmgr, nm);
+
+	isc_sockaddr_any(&any);
+	attrs = DNS_DISPATCHATTR_IPV4 | DNS_DISPATCHATTR_UDP |
+		DNS_DISPATCHATTR_EXCLUSIVE;
+	result = dns_dispatch_getudp(dispatchmgr, socketmgr, taskmgr, &any,
+				     512, 6, 1024, 17, 19, attrs, attrs,
+				     &dispatch);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Create a local udp nameserver on the loopback.
+	 */
+	result = isc_socket_create(socketmgr, AF_INET, isc_sockettype_udp,
+				   &sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	ina.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&local, &ina, 0);
+	result = isc_socket_bind(sock, &local, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_getsockname(sock, &local);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	region.base = rbuf;
+	region.length = sizeof(rbuf);
+	result = isc_socket_recv(sock, &region, 1, task, nameserver, sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_dispatch_addresponse(dispatch, 0, &local, task, response,
+					  NULL, &id, &dispentry, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_null(dns_dispatch_getentrysocket(dispentry));
+	assert_non_null(dns_dispatch_getentryhandle(dispentry));
+
+	memset(message, 0, sizeof(message));
+	message[0] = (id >> 8) & 0xff;
+	message[1] = id & 0xff;
+
+	region.base = message;
+	region.length = sizeof(message);
+	result = isc_app_onrun(dt_mctx, task, startit_nm, &region);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_app_run();
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	assert_int_equal(atomic_load_acquire(&responses), 2);
+
+	/*
+	 * Shutdown nameserver.
+	 */
+	isc_socket_cancel(sock, task, ISC_SOCKCANCEL_RECV);
+	isc_socket_detach(&sock);
+	isc_task_detach(&task);
+
+	/*
+	 * Shutdown the dispatch and the network manager.
+	 */
+	dns_dispatch_detach(&dispatch);
+	isc_nm_closedown(nm);
+	isc_nm_destroy(&nm);
+	dns_dispatchmgr_destroy(&dispatchmgr);
+}
+
+static dns_dispentry_t *centries[3];
+static dns_messageid_t cids[3];
+
+static void
+echoserver(isc_task_t *task, isc_event_t *event) {
+	isc_result_t result;
+	isc_region_t region;
+	isc_socket_t *dummy = NULL;
+	isc_socket_t *sock = event->ev_arg;
+	isc_socketevent_t *ev = (isc_socketevent_t *)event;
+	static unsigned char buf[16];
+
+	memmove(buf, ev->region.base, sizeof(buf));
+	buf[2] |= 0x80; /* qr=1 */
+
+	region.base = buf;
+	region.length = sizeof(buf);
+	isc_socket_attach(sock, &dummy);
+	result = isc_socket_sendto(sock, &region, task, senddone, sock,
+				   &ev->address, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	isc_event_free(&event);
+}
+
+static void
+coalesced_response(isc_task_t *task, isc_event_t *event) {
+	dns_dispatchevent_t *devent = (dns_dispatchevent_t *)event;
+	unsigned int i = (uintptr_t)event->ev_arg;
+	unsigned char *base;
+
+	UNUSED(task);
+
+	assert_int_equal(devent->result, ISC_R_SUCCESS);
+	assert_int_equal(devent->id, cids[i]);
+	assert_int_equal(isc_buffer_usedlength(&devent->buffer), 16);
+	base = devent->buffer.base;
+	assert_int_equal((base[0] << 8) | base[1], cids[i]);
+	assert_int_equal(base[15], 0x55);
+
+	dns_dispatch_removeresponse(&centries[i], &devent);
+	if (atomic_fetch_add_relaxed(&responses, 1) == 1) {
+		isc_app_shutdown();
+	}
+}
+
+/* test that identical queries share one response */
+static void
+dispatch_coalesce(void **state) {
+	isc_region_t region;
+	isc_result_t result;
+	isc_socket_t *sock = NULL;
+	isc_task_t *task = NULL;
+	isc_nm_t *nm = NULL;
+	isc_stats_t *stats = NULL;
+	isc_sockaddr_t any;
+	struct in_addr ina;
+	unsigned char messages[3][16];
+	unsigned int attrs, i;
+	unsigned char rbuf[16];
+
+	UNUSED(state);
+
+	atomic_init(&responses, 0);
+
+	nm = isc_nm_start(dt_mctx, isc_os_ncpus());
+	assert_non_null(nm);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_dispatchmgr_create(dt_mctx, &dispatchmgr);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_dispatchmgr_setnetmgr(dispatchmgr, nm);
+	isc_stats_create(dt_mctx, &stats, dns_resstatscounter_max);
+	dns_dispatchmgr_setstats(dispatchmgr, stats);
+
+	isc_sockaddr_any(&any);
+	attrs = DNS_DISPATCHATTR_IPV4 | DNS_DISPATCHATTR_UDP |
+		DNS_DISPATCHATTR_EXCLUSIVE;
+	result = dns_dispatch_getudp(dispatchmgr, socketmgr, taskmgr, &any,
+				     512, 6, 1024, 17, 19, attrs, attrs,
+				     &dispatch);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Create a local udp nameserver on the loopback, which answers
+	 * a single query.
+	 */
+	result = isc_socket_create(socketmgr, AF_INET, isc_sockettype_udp,
+				   &sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	ina.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&local, &ina, 0);
+	result = isc_socket_bind(sock, &local, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_getsockname(sock, &local);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	region.base = rbuf;
+	region.length = sizeof(rbuf);
+	result = isc_socket_recv(sock, &region, 1, task, echoserver, sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * The first two queries are identical apart from their IDs, the
+	 * third one differs in its last octet.
+	 */
+	for (i = 0; i < 3; i++) {
+		centries[i] = NULL;
+		result = dns_dispatch_addresponse(
+			dispatch, 0, &local, task, coalesced_response,
+			(void *)(uintptr_t)i, &cids[i], &centries[i], NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+
+		memset(messages[i], 0, sizeof(messages[i]));
+		messages[i][0] = (cids[i] >> 8) & 0xff;
+		messages[i][1] = cids[i] & 0xff;
+		messages[i][15] = (i == 2) ? 0xaa : 0x55;
+
+		region.base = messages[i];
+		region.length = sizeof(messages[i]);
+		assert_int_equal(dns_dispatch_coalesce(centries[i], &region),
+				 i == 1);
+	}
+	assert_int_equal(isc_stats_get_counter(stats,
+					       dns_resstatscounter_coalesced),
+			 1);
+
+	dispentry = centries[0];
+	region.base = messages[0];
+	region.length = sizeof(messages[0]);
+	result = isc_app_onrun(dt_mctx, task, startit_nm, &region);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_app_run();
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	assert_int_equal(atomic_load_acquire(&responses), 2);
+	assert_null(centries[0]);
+	assert_null(centries[1]);
+
+	/* The third query was never sent. */
+	dns_dispatch_removeresponse(&centries[2], NULL);
+
+	/*
+	 * Shutdown nameserver.
+	 */
+	isc_socket_cancel(sock, task, ISC_SOCKCANCEL_RECV);
+	isc_socket_detach(&sock);
+	isc_task_detach(&task);
+
+	/*
+	 * Shutdown the dispatch and the network manager.
+	 */
+	dns_dispatch_detach(&dispatch);
+	isc_nm_closedown(nm);
+	isc_nm_destroy(&nm);
+	dns_dispatchmgr_destroy(&dispatchmgr);
+	isc_stats_detach(&stats);
+}
+
+static void
+removeleader(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	dns_dispatch_removeresponse(&centries[0], NULL);
+	isc_event_free(&event);
+}
+
+/* test that queries waiting for a removed query still get a response */
+static void
+dispatch_coalesce_remove(void **state) {
+	isc_region_t region;
+	isc_result_t result;
+	isc_socket_t *sock = NULL;
+	isc_task_t *task = NULL;
+	isc_nm_t *nm = NULL;
+	isc_sockaddr_t any;
+	struct in_addr ina;
+	unsigned char messages[3][16];
+	unsigned int attrs, i;
+	unsigned char rbuf[16];
+
+	UNUSED(state);
+
+	atomic_init(&responses, 0);
+
+	nm = isc_nm_start(dt_mctx, isc_os_ncpus());
+	assert_non_null(nm);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_dispatchmgr_create(dt_mctx, &dispatchmgr);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_dispatchmgr_setnetmgr(dispatchmgr, nm);
+
+	isc_sockaddr_any(&any);
+	attrs = DNS_DISPATCHATTR_IPV4 | DNS_DISPATCHATTR_UDP |
+		DNS_DISPATCHATTR_EXCLUSIVE;
+	result = dns_dispatch_getudp(dispatchmgr, socketmgr, taskmgr, &any,
+				     512, 6, 1024, 17, 19, attrs, attrs,
+				     &dispatch);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Create a local udp nameserver on the loopback, which answers
+	 * a single query.
+	 */
+	result = isc_socket_create(socketmgr, AF_INET, isc_sockettype_udp,
+				   &sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	ina.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&local, &ina, 0);
+	result = isc_socket_bind(sock, &local, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_getsockname(sock, &local);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	region.base = rbuf;
+	region.length = sizeof(rbuf);
+	result = isc_socket_recv(sock, &region, 1, task, echoserver, sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * The second and third queries wait for the first one.
+	 */
+	for (i = 0; i < 3; i++) {
+		centries[i] = NULL;
+		result = dns_dispatch_addresponse(
+			dispatch, 0, &local, task, coalesced_response,
+			(void *)(uintptr_t)i, &cids[i], &centries[i], NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+
+		memset(messages[i], 0, sizeof(messages[i]));
+		messages[i][0] = (cids[i] >> 8) & 0xff;
+		messages[i][1] = cids[i] & 0xff;
+		messages[i][15] = 0x55;
+
+		region.base = messages[i];
+		region.length = sizeof(messages[i]);
+		assert_int_equal(dns_dispatch_coalesce(centries[i], &region),
+				 i != 0);
+	}
+
+	/*
+	 * Remove the first query without sending it: the second one is
+	 * then sent in its place, with its own ID, and its response is
+	 * shared with the third one.
+	 */
+	result = isc_app_onrun(dt_mctx, task, removeleader, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_app_run();
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	assert_int_equal(atomic_load_acquire(&responses), 2);
+	assert_null(centries[0]);
+	assert_null(centries[1]);
+	assert_null(centries[2]);
+
+	/*
+	 * Shutdown nameserver.
+	 */
+	isc_socket_cancel(sock, task, ISC_SOCKCANCEL_RECV);
+	isc_socket_detach(&sock);
+	isc_task_detach(&task);
+
+	/*
+	 * Shutdown the dispatch and the network manager.
+	 */
+	dns_dispatch_detach(&dispatch);
+	isc_nm_closedown(nm);
+	isc_nm_destroy(&nm);
+	dns_dispatchmgr_destroy(&dispatchmgr);
+}
+
+static void
+noresponse(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+	UNUSED(event);
+
+	fail();
+}
+
+/*
+ * Create a UDP dispatch on the loopback that is shared by all queries.
+ */
+static void
+make_shareddispatch(unsigned int maxrequests, unsigned int buckets,
+		    unsigned int increment) {
+	isc_result_t result;
+	struct in_addr ina;
+	unsigned int attrs;
+
+	result = dns_dispatchmgr_create(dt_mctx, &dispatchmgr);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	ina.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&local, &ina, 0);
+	attrs = DNS_DISPATCHATTR_IPV4 | DNS_DISPATCHATTR_UDP;
+	result = dns_dispatch_getudp(dispatchmgr, socketmgr, taskmgr, &local,
+				     512, 6, maxrequests, buckets, increment,
+				     attrs, attrs, &dispatch);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+/*
+ * Set 'addr' to port 'port' of the 'n'th address in 10.0.0.0/8.
+ */
+static void
+make_dest(isc_sockaddr_t *addr, unsigned int n, in_port_t port) {
+	struct in_addr ina;
+
+	ina.s_addr = htonl(0x0a000001 + n);
+	isc_sockaddr_fromin(addr, &ina, port);
+}
+
+#define MATCH_ENTRIES 200
+
+/* test matching responses against the QID table */
+static void
+dispatch_match(void **state) {
+	dns_dispentry_t *entries[MATCH_ENTRIES];
+	isc_sockaddr_t dests[MATCH_ENTRIES];
+	dns_messageid_t ids[MATCH_ENTRIES];
+	isc_sockaddr_t other;
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	unsigned int i, j;
+
+	UNUSED(state);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* A small table makes for long hash chains. */
+	make_shareddispatch(1024, 17, 19);
+
+	for (i = 0; i < MATCH_ENTRIES; i++) {
+		entries[i] = NULL;
+		make_dest(&dests[i], i % 10, 53);
+		result = dns_dispatch_addresponse(dispatch, 0, &dests[i], task,
+						  noresponse, NULL, &ids[i],
+						  &entries[i], NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	for (j = 0; j < 2; j++) {
+		dns__dispatch_setlockfree(j == 0);
+
+		for (i = 0; i < MATCH_ENTRIES; i++) {
+			assert_true(dns__dispatch_findresponse(
+				dispatch, &dests[i], ids[i]));
+
+			/* Same ID, but from another address or port. */
+			make_dest(&other, 10, 53);
+			assert_false(dns__dispatch_findresponse(
+				dispatch, &other, ids[i]));
+			make_dest(&other, i % 10, 54);
+			assert_false(dns__dispatch_findresponse(
+				dispatch, &other, ids[i]));
+		}
+	}
+	dns__dispatch_setlockfree(true);
+
+	for (i = 0; i < MATCH_ENTRIES; i += 2) {
+		dns_dispatch_removeresponse(&entries[i], NULL);
+	}
+	for (i = 0; i < MATCH_ENTRIES; i++) {
+		bool expect = (i % 2 != 0);
+
+		/*
+		 * A removed query may share its server and ID with one
+		 * that is still outstanding.
+		 */
+		for (j = 1; !expect && j < MATCH_ENTRIES; j += 2) {
+			expect = (ids[j] == ids[i] &&
+				  isc_sockaddr_equal(&dests[j], &dests[i]));
+		}
+		assert_true(dns__dispatch_findresponse(dispatch, &dests[i],
+						       ids[i]) == expect);
+	}
+
+	for (i = 1; i < MATCH_ENTRIES; i += 2) {
+		dns_dispatch_removeresponse(&entries[i], NULL);
+	}
+	for (i = 0; i < MATCH_ENTRIES; i++) {
+		assert_false(dns__dispatch_findresponse(dispatch, &dests[i],
+							ids[i]));
+	}
+
+	dns_dispatch_detach(&dispatch);
+	dns_dispatchmgr_destroy(&dispatchmgr);
+	isc_task_detach(&task);
+}
+
+#if defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__)
+
+/*
+ * Match responses against a QID table holding 100k outstanding queries,
+ * with and without the lock-free check, for a growing number of
+ * threads.  Every other response matches no query.
+ */
+
+#define BENCH_ENTRIES 100000
+#define BENCH_DESTS   1024
+#define BENCH_LOOKUPS 1000000
+
+static dns_dispentry_t *bench_entries[BENCH_ENTRIES];
+static isc_sockaddr_t bench_dests[BENCH_ENTRIES];
+static dns_messageid_t bench_ids[BENCH_ENTRIES];
+
+static void *
+match_thread(void *arg) {
+	unsigned int n = (uintptr_t)arg, i, e;
+	isc_sockaddr_t other;
+
+	for (i = 0; i < BENCH_LOOKUPS; i++) {
+		e = (n * 7919 + i * 104729) % BENCH_ENTRIES;
+		if (i % 2 == 0) {
+			RUNTIME_CHECK(dns__dispatch_findresponse(
+				dispatch, &bench_dests[e], bench_ids[e]));
+		} else {
+			other = bench_dests[e];
+			isc_sockaddr_setport(&other, 54);
+			RUNTIME_CHECK(!dns__dispatch_findresponse(
+				dispatch, &other, bench_ids[e]));
+		}
+	}
+
+	return (NULL);
+}
+
+static void
+dispatch_benchmark(void **state) {
+	isc_result_t result;
+	isc_time_t ts1, ts2;
+	double t;
+	unsigned int i, j, nthreads, maxthreads;
+	isc_thread_t threads[32];
+	isc_task_t *task = NULL;
+
+	UNUSED(state);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	make_shareddispatch(BENCH_ENTRIES, 16411, 16433);
+
+	for (i = 0; i < BENCH_ENTRIES; i++) {
+		make_dest(&bench_dests[i], i % BENCH_DESTS, 53);
+		result = dns_dispatch_addresponse(
+			dispatch, 0, &bench_dests[i], task, noresponse, NULL,
+			&bench_ids[i], &bench_entries[i], NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	maxthreads = ISC_MAX(ISC_MIN(isc_os_ncpus(), 32), 1);
+
+	for (j = 0; j < 2; j++) {
+		dns__dispatch_setlockfree(j == 0);
+
+		for (nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+			result = isc_time_now(&ts1);
+			assert_int_equal(result, ISC_R_SUCCESS);
+
+			for (i = 0; i < nthreads; i++) {
+				isc_thread_create(match_thread,
+						  (void *)(uintptr_t)i,
+						  &threads[i]);
+			}
+			for (i = 0; i < nthreads; i++) {
+				isc_thread_join(threads[i], NULL);
+			}
+
+			result = isc_time_now(&ts2);
+			assert_int_equal(result, ISC_R_SUCCESS);
+
+			t = isc_time_microdiff(&ts2, &ts1);
+
+			printf("%s, %u threads: %u lookups, "
+			       "%f seconds, %f lookups/second\n",
+			       j == 0 ? "lock-free" : "locked", nthreads,
+			       nthreads * BENCH_LOOKUPS, t / 1000000.0,
+			       (nthreads * BENCH_LOOKUPS) / (t / 1000000.0));
+		}
+	}
+	dns__dispatch_setlockfree(true);
+
+	for (i = 0; i < BENCH_ENTRIES; i++) {
+		dns_dispatch_removeresponse(&bench_entries[i], NULL);
+	}
+
+	dns_dispatch_detach(&dispatch);
+	dns_dispatchmgr_destroy(&dispatchmgr);
+	isc_task_detach(&task);
+}
+
+#endif /* defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__) */
+
 int
 main(void) {
 	const struct CMUnitTest tests[] = {
@@ -340,6 +968,18 @@ main(void) {
 						_teardown),
 		cmocka_unit_test_setup_teardown(dispatch_getnext, _setup,
 						_teardown),
+		cmocka_unit_test_setup_teardown(dispatch_getnext_nm, _setup,
+						_teardown),
+		cmocka_unit_test_setup_teardown(dispatch_coalesce, _setup,
+						_teardown),
+		cmocka_unit_test_setup_teardown(dispatch_coalesce_remove,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(dispatch_match, _setup,
+						_teardown),
+#if defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__)
+		cmocka_unit_test_setup_teardown(dispatch_benchmark, _setup,
+						_teardown),
+#endif /* defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__) */
 	};
 
 	return (cmocka_run_group_tests(tests, NULL, NULL));
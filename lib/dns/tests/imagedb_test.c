@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <sched.h> /* IWYU pragma: keep */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/file.h>
+#include <isc/print.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/dbiterator.h>
+#include <dns/masterdump.h>
+#include <dns/name.h>
+#include <dns/rdataset.h>
+#include <dns/rdatasetiter.h>
+
+#include "dnstest.h"
+
+#define TEST_ORIGIN "example"
+#define ZONEFILE    "testdata/imagedb/zone.data"
+#define IMAGEFILE   "imagedb_test.img"
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = dns_test_begin(NULL, false);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	(void)isc_file_remove(IMAGEFILE);
+	dns_test_end();
+
+	return (0);
+}
+
+/*
+ * Load the test zone into an "rbt" database and write its image.
+ */
+static void
+make_image(dns_db_t **dbp) {
+	dns_dbversion_t *version = NULL;
+	isc_result_t result;
+
+	result = dns_test_loaddb(dbp, dns_dbtype_zone, TEST_ORIGIN, ZONEFILE);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_db_currentversion(*dbp, &version);
+	result = dns_master_dump(dt_mctx, *dbp, version,
+				 &dns_master_style_default, IMAGEFILE,
+				 dns_masterformat_image, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_closeversion(*dbp, &version, false);
+}
+
+/*
+ * Read the image into a database of type 'dbtype'.
+ */
+static isc_result_t
+load_image(const char *dbtype, dns_db_t **dbp) {
+	dns_fixedname_t fname;
+	isc_result_t result;
+
+	dns_test_namefromstring(TEST_ORIGIN ".", &fname);
+	result = dns_db_create(dt_mctx, dbtype, dns_fixedname_name(&fname),
+			       dns_dbtype_zone, dns_rdataclass_in, 0, NULL,
+			       dbp);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_db_load(*dbp, IMAGEFILE, dns_masterformat_image, 0);
+	if (result != ISC_R_SUCCESS) {
+		dns_db_detach(dbp);
+	}
+
+	return (result);
+}
+
+static isc_result_t
+find(dns_db_t *db, const char *name, dns_rdatatype_t type, dns_name_t *found,
+     dns_rdataset_t *rdataset) {
+	dns_fixedname_t fname;
+	dns_dbversion_t *version = NULL;
+	isc_result_t result;
+
+	dns_test_namefromstring(name, &fname);
+
+	dns_db_currentversion(db, &version);
+	result = dns_db_find(db, dns_fixedname_name(&fname), version, type, 0,
+			     0, NULL, found, rdataset, NULL);
+	dns_db_closeversion(db, &version, false);
+
+	return (result);
+}
+
+/* an image database answers like the database it was written from */
+static void
+find_test(void **state) {
+	static const struct {
+		const char *name;
+		dns_rdatatype_t type;
+		isc_result_t result;
+	} tests[] = {
+		{ "example.", dns_rdatatype_soa, ISC_R_SUCCESS },
+		{ "example.", dns_rdatatype_ns, ISC_R_SUCCESS },
+		{ "mail.example.", dns_rdatatype_aaaa, ISC_R_SUCCESS },
+		{ "mail.example.", dns_rdatatype_mx, DNS_R_NXRRSET },
+		{ "www.example.", dns_rdatatype_a, DNS_R_CNAME },
+		{ "x.dn.example.", dns_rdatatype_a, DNS_R_DNAME },
+		{ "foo.wild.example.", dns_rdatatype_txt, ISC_R_SUCCESS },
+		{ "foo.wild.example.", dns_rdatatype_mx, DNS_R_NXRRSET },
+		{ "sub.example.", dns_rdatatype_a, DNS_R_DELEGATION },
+		{ "deep.sub.example.", dns_rdatatype_a, DNS_R_DELEGATION },
+		{ "c.ent.example.", dns_rdatatype_a, DNS_R_EMPTYNAME },
+		{ "nx.example.", dns_rdatatype_a, DNS_R_NXDOMAIN },
+		{ "WEB.Example.", dns_rdatatype_a, ISC_R_SUCCESS },
+	};
+	dns_fixedname_t ffound1, ffound2;
+	dns_name_t *found1 = dns_fixedname_initname(&ffound1);
+	dns_name_t *found2 = dns_fixedname_initname(&ffound2);
+	dns_rdataset_t rdataset1, rdataset2;
+	dns_db_t *db = NULL, *imagedb = NULL;
+	isc_result_t result;
+	size_t i;
+
+	UNUSED(state);
+
+	make_image(&db);
+	result = load_image("image", &imagedb);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_rdataset_init(&rdataset1);
+	dns_rdataset_init(&rdataset2);
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		result = find(db, tests[i].name, tests[i].type, found1,
+			      &rdataset1);
+		assert_int_equal(result, tests[i].result);
+		result = find(imagedb, tests[i].name, tests[i].type, found2,
+			      &rdataset2);
+		assert_int_equal(result, tests[i].result);
+
+		/*
+		 * The RBT doesn't have nodes for every empty
+		 * non-terminal, so the name found for one differs.
+		 */
+		if (result != DNS_R_EMPTYNAME) {
+			assert_true(dns_name_equal(found1, found2));
+		}
+		assert_int_equal(dns_rdataset_isassociated(&rdataset1),
+				 dns_rdataset_isassociated(&rdataset2));
+		if (dns_rdataset_isassociated(&rdataset1)) {
+			assert_int_equal(rdataset1.type, rdataset2.type);
+			assert_int_equal(rdataset1.ttl, rdataset2.ttl);
+			assert_int_equal(dns_rdataset_count(&rdataset1),
+					 dns_rdataset_count(&rdataset2));
+			dns_rdataset_disassociate(&rdataset1);
+			dns_rdataset_disassociate(&rdataset2);
+		}
+	}
+
+	dns_db_detach(&imagedb);
+	dns_db_detach(&db);
+}
+
+/*
+ * Move 'iter' forward from where it is (if 'result' is ISC_R_SUCCESS)
+ * to the next node that has data, and return its name in 'name'.  The
+ * RBT keeps nodes for some but not all empty non-terminals, and an
+ * image keeps them all, so these are skipped.
+ */
+static isc_result_t
+nextdata(dns_db_t *db, dns_dbiterator_t *iter, isc_result_t result,
+	 dns_name_t *name) {
+	while (result == ISC_R_SUCCESS) {
+		dns_rdatasetiter_t *rdsiter = NULL;
+		dns_dbnode_t *node = NULL;
+
+		result = dns_dbiterator_current(iter, &node, name);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		result = dns_db_allrdatasets(db, node, NULL, 0, &rdsiter);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		result = dns_rdatasetiter_first(rdsiter);
+		dns_rdatasetiter_destroy(&rdsiter);
+		dns_db_detachnode(db, &node);
+		if (result == ISC_R_SUCCESS) {
+			return (ISC_R_SUCCESS);
+		}
+
+		result = dns_dbiterator_next(iter);
+	}
+
+	return (result);
+}
+
+/* the nodes of an image database are iterated in DNSSEC order */
+static void
+iterator_test(void **state) {
+	dns_fixedname_t fname1, fname2;
+	dns_name_t *name1 = dns_fixedname_initname(&fname1);
+	dns_name_t *name2 = dns_fixedname_initname(&fname2);
+	dns_dbiterator_t *iter1 = NULL, *iter2 = NULL;
+	dns_db_t *db = NULL, *imagedb = NULL;
+	isc_result_t result, result1, result2;
+	unsigned int count = 0;
+
+	UNUSED(state);
+
+	make_image(&db);
+	result = load_image("image", &imagedb);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result1 = dns_db_createiterator(db, 0, &iter1);
+	assert_int_equal(result1, ISC_R_SUCCESS);
+	result2 = dns_db_createiterator(imagedb, 0, &iter2);
+	assert_int_equal(result2, ISC_R_SUCCESS);
+
+	result1 = nextdata(db, iter1, dns_dbiterator_first(iter1), name1);
+	result2 = nextdata(imagedb, iter2, dns_dbiterator_first(iter2), name2);
+	while (result1 == ISC_R_SUCCESS) {
+		assert_int_equal(result2, ISC_R_SUCCESS);
+		assert_true(dns_name_equal(name1, name2));
+		count++;
+
+		result1 = nextdata(db, iter1, dns_dbiterator_next(iter1),
+				   name1);
+		result2 = nextdata(imagedb, iter2, dns_dbiterator_next(iter2),
+				   name2);
+	}
+	assert_int_equal(result1, ISC_R_NOMORE);
+	assert_int_equal(result2, ISC_R_NOMORE);
+	assert_int_equal(count, 12);
+
+	dns_dbiterator_destroy(&iter1);
+	dns_dbiterator_destroy(&iter2);
+	dns_db_detach(&imagedb);
+	dns_db_detach(&db);
+}
+
+/* an image database can't be changed */
+static void
+readonly_test(void **state) {
+	dns_fixedname_t fname;
+	dns_dbnode_t *node = NULL;
+	dns_dbversion_t *version = NULL;
+	dns_db_t *db = NULL, *imagedb = NULL;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	make_image(&db);
+	result = load_image("image", &imagedb);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_test_namefromstring("new.example.", &fname);
+	result = dns_db_findnode(imagedb, dns_fixedname_name(&fname), true,
+				 &node);
+	assert_int_equal(result, ISC_R_NOTIMPLEMENTED);
+
+	dns_test_namefromstring("web.example.", &fname);
+	result = dns_db_findnode(imagedb, dns_fixedname_name(&fname), false,
+				 &node);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_currentversion(imagedb, &version);
+	result = dns_db_deleterdataset(imagedb, node, version, dns_rdatatype_a,
+				       0);
+	assert_int_equal(result, ISC_R_NOTIMPLEMENTED);
+	dns_db_closeversion(imagedb, &version, false);
+	dns_db_detachnode(imagedb, &node);
+
+	dns_db_detach(&imagedb);
+	dns_db_detach(&db);
+}
+
+/* a damaged image is rejected when it is read into another database */
+static void
+badimage_test(void **state) {
+	dns_db_t *db = NULL;
+	isc_result_t result;
+	off_t size;
+	FILE *fp;
+
+	UNUSED(state);
+
+	make_image(&db);
+	dns_db_detach(&db);
+
+	/* An undamaged image can be read into an "rbt" database. */
+	result = load_image("rbt", &db);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_detach(&db);
+
+	result = isc_file_getsize(IMAGEFILE, &size);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* Damage the last byte of the file. */
+	fp = fopen(IMAGEFILE, "r+b");
+	assert_non_null(fp);
+	assert_int_equal(fseek(fp, size - 1, SEEK_SET), 0);
+	assert_int_equal(fputc(0xff, fp), 0xff);
+	assert_int_equal(fclose(fp), 0);
+
+	result = load_image("rbt", &db);
+	assert_int_equal(result, ISC_R_INVALIDFILE);
+	assert_null(db);
+
+	/* Cut it off in the middle of the image. */
+	assert_int_equal(truncate(IMAGEFILE, size / 2), 0);
+	result = load_image("rbt", &db);
+	assert_int_not_equal(result, ISC_R_SUCCESS);
+	assert_null(db);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(find_test, _setup, _teardown),
+		cmocka_unit_test_setup_teardown(iterator_test, _setup,
+						_teardown),
+		cmocka_unit_test_setup_teardown(readonly_test, _setup,
+						_teardown),
+		cmocka_unit_test_setup_teardown(badimage_test, _setup,
+						_teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif /* if HAVE_CMOCKA */
@@ -26,6 +26,7 @@
 #include <isc/dir.h>
 #include <isc/print.h>
 #include <isc/string.h>
+#include <isc/thread.h>
 #include <isc/util.h>
 
 #include <dns/cache.h>
@@ -598,6 +599,230 @@ neworigin_test(void **state) {
 	assert_true(warn_expect_result);
 }
 
+/*
+ * Write a zone that is big enough to be split for a parallel load to
+ * 'filename'.  If 'bad' is true, the zone has an error near its end.
+ */
+static void
+write_parallel_zone(const char *filename, bool bad) {
+	FILE *f;
+	int i;
+
+	f = fopen(filename, "w");
+	assert_non_null(f);
+
+	fprintf(f, "$TTL 300\n"
+		   "@ IN SOA ns hostmaster (\n"
+		   "\t1 ; serial (\n"
+		   "\t3600 900 604800 300 )\n"
+		   "\tNS ns\n"
+		   "ns A 10.53.0.1\n");
+	for (i = 0; i < 20000; i++) {
+		switch (i % 1000) {
+		case 0:
+			fprintf(f, "$ORIGIN sub%d.test.\n", i / 1000);
+			break;
+		case 500:
+			fprintf(f, "$TTL %d\n", 600 + i);
+			break;
+		case 700:
+			fprintf(f, "$GENERATE 1-10 gen%d-$ A 10.0.0.$\n", i);
+			break;
+		}
+		fprintf(f, "name%d A 10.0.%d.%d\n", i, (i >> 8) & 0xff,
+			i & 0xff);
+		fprintf(f, "name%d 60 A 10.1.%d.%d\n", i, (i >> 8) & 0xff,
+			i & 0xff);
+		if (i % 3 == 0) {
+			fprintf(f, "\tTXT \"a;b(c\" \"d\\\"(\" ; ) (\n");
+		}
+		if (i % 7 == 0) {
+			fprintf(f, "\tMX ( 10\n\t\tmx%d ) ; mail\n", i);
+		}
+	}
+	if (bad) {
+		fprintf(f, "bad A 10.0.0.256\n");
+	}
+	fprintf(f, "last A 10.0.0.1\n");
+
+	assert_int_equal(fclose(f), 0);
+}
+
+/*
+ * The load pool of the parallel load tests.
+ */
+static dns_loadpool_t *loadpool = NULL;
+
+/*
+ * Load 'filename' into a new zone database with 'nthreads' threads and
+ * dump it to 'dumpfile'.
+ */
+static isc_result_t
+load_parallel(const char *filename, unsigned int nthreads,
+	      const char *dumpfile) {
+	isc_result_t result, tresult;
+	dns_rdatacallbacks_t dbcallbacks;
+	dns_dbversion_t *version = NULL;
+	dns_db_t *db = NULL;
+
+	result = setup_master(nullmsg, nullmsg);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_db_create(dt_mctx, "rbt", &dns_origin, dns_dbtype_zone,
+			       dns_rdataclass_in, 0, NULL, &db);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_rdatacallbacks_init(&dbcallbacks);
+	dbcallbacks.warn = nullmsg;
+	dbcallbacks.error = nullmsg;
+	result = dns_db_beginload(db, &dbcallbacks);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_master_loadfileparallel(
+		filename, &dns_origin, &dns_origin, dns_rdataclass_in, 0, 0,
+		&dbcallbacks, NULL, NULL, NULL, NULL, NULL, NULL, dt_mctx, 0,
+		loadpool, nthreads);
+	tresult = dns_db_endload(db, &dbcallbacks);
+	if (result == ISC_R_SUCCESS) {
+		result = tresult;
+	}
+
+	if (result == ISC_R_SUCCESS) {
+		dns_db_currentversion(db, &version);
+		result = dns_master_dump(dt_mctx, db, version,
+					 &dns_master_style_default, dumpfile,
+					 dns_masterformat_text, NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		dns_db_closeversion(db, &version, false);
+	}
+
+	dns_db_detach(&db);
+	return (result);
+}
+
+static void
+compare_files(const char *file1, const char *file2) {
+	char line1[1024], line2[1024];
+	FILE *f1, *f2;
+	char *r1, *r2;
+
+	f1 = fopen(file1, "r");
+	assert_non_null(f1);
+	f2 = fopen(file2, "r");
+	assert_non_null(f2);
+
+	do {
+		r1 = fgets(line1, sizeof(line1), f1);
+		r2 = fgets(line2, sizeof(line2), f2);
+		if (r1 != NULL && r2 != NULL) {
+			assert_string_equal(line1, line2);
+		}
+	} while (r1 != NULL && r2 != NULL);
+	assert_null(r1);
+	assert_null(r2);
+
+	fclose(f1);
+	fclose(f2);
+}
+
+/*
+ * Parallel load test:
+ * dns_master_loadfileparallel() loads the same data as a sequential load
+ */
+static void
+parallel_test(void **state) {
+	isc_result_t result, sresult;
+
+	UNUSED(state);
+
+	result = isc_dir_chdir(BUILDDIR);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_loadpool_create(dt_mctx, 3, &loadpool);
+
+	write_parallel_zone("test.parallel", false);
+
+	result = load_parallel("test.parallel", 1, "test.dump1");
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = load_parallel("test.parallel", 4, "test.dump4");
+	assert_int_equal(result, ISC_R_SUCCESS);
+	compare_files("test.dump1", "test.dump4");
+
+	/* Errors are reported as with a sequential load. */
+	write_parallel_zone("test.parallel", true);
+	sresult = load_parallel("test.parallel", 1, "test.dump1");
+	assert_int_not_equal(sresult, ISC_R_SUCCESS);
+	result = load_parallel("test.parallel", 4, "test.dump4");
+	assert_int_equal(result, sresult);
+
+	/* Files that can't be split are loaded by a single thread. */
+	result = isc_dir_chdir(SRCDIR);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = load_parallel("testdata/master/master8.data", 4, NULL);
+	assert_int_equal(result, DNS_R_SEENINCLUDE);
+
+	result = isc_dir_chdir(BUILDDIR);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	unlink("test.parallel");
+	unlink("test.dump1");
+	unlink("test.dump4");
+
+	dns_loadpool_destroy(&loadpool);
+	assert_null(loadpool);
+}
+
+static const char *parallel_dumps[] = { "test.dumpa", "test.dumpb",
+					"test.dumpc" };
+
+static isc_threadresult_t
+parallel_thread(isc_threadarg_t arg) {
+	uintptr_t i = (uintptr_t)arg;
+	isc_result_t result;
+
+	result = load_parallel("test.parallel", 4, parallel_dumps[i]);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return ((isc_threadresult_t)0);
+}
+
+/*
+ * Parallel load test:
+ * loads running at the same time share the threads of the load pool
+ */
+static void
+parallel_shared_test(void **state) {
+	isc_thread_t threads[ARRAY_SIZE(parallel_dumps)];
+	isc_result_t result;
+	uintptr_t i;
+
+	UNUSED(state);
+
+	result = isc_dir_chdir(BUILDDIR);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* A pool with fewer threads than any of the loads asks for. */
+	dns_loadpool_create(dt_mctx, 1, &loadpool);
+
+	write_parallel_zone("test.parallel", false);
+	result = load_parallel("test.parallel", 1, "test.dump1");
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < ARRAY_SIZE(threads); i++) {
+		isc_thread_create(parallel_thread, (isc_threadarg_t)i,
+				  &threads[i]);
+	}
+	for (i = 0; i < ARRAY_SIZE(threads); i++) {
+		isc_thread_join(threads[i], NULL);
+		compare_files("test.dump1", parallel_dumps[i]);
+		unlink(parallel_dumps[i]);
+	}
+
+	unlink("test.parallel");
+	unlink("test.dump1");
+
+	dns_loadpool_destroy(&loadpool);
+}
+
 int
 main(void) {
 	const struct CMUnitTest tests[] = {
@@ -630,6 +855,10 @@ main(void) {
 		cmocka_unit_test_setup_teardown(toobig_test, _setup, _teardown),
 		cmocka_unit_test_setup_teardown(maxrdata_test, _setup,
 						_teardown),
+		cmocka_unit_test_setup_teardown(parallel_test, _setup,
+						_teardown),
+		cmocka_unit_test_setup_teardown(parallel_shared_test, _setup,
+						_teardown),
 		cmocka_unit_test_setup_teardown(neworigin_test, _setup,
 						_teardown),
 	};
@@ -36,6 +36,7 @@
 #include <isc/print.h>
 #include <isc/random.h>
 #include <isc/socket.h>
+#include <isc/stats.h>
 #include <isc/stdio.h>
 #include <isc/string.h>
 #include <isc/task.h>
@@ -50,6 +51,7 @@
 #include <dns/name.h>
 #include <dns/rbt.h>
 #include <dns/result.h>
+#include <dns/stats.h>
 
 #include <dst/dst.h>
 
@@ -1123,6 +1125,153 @@ rbt_deletename(void **state) {
 	test_context_teardown(ctx);
 }
 
+/*
+ * Test that the hash table is grown incrementally, and that names can be
+ * found and deleted while both the old and the new table are in use.
+ */
+static void
+rbt_rehash(void **state) {
+	isc_result_t result;
+	dns_rbt_t *rbt = NULL;
+	isc_stats_t *stats = NULL;
+	dns_fixedname_t fname;
+	dns_name_t *name = NULL;
+	static int data = 1;
+	unsigned int rehashed = 0, stalls = 0;
+	unsigned int i, j;
+	char namebuf[64];
+	void *found = NULL;
+
+	UNUSED(state);
+
+	result = dns_rbt_create(dt_mctx, NULL, NULL, &rbt);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_stats_create(dt_mctx, &stats, dns_cachestatscounter_max);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_rbt_setstats(rbt, stats);
+
+	for (i = 0; i < 20000; i++) {
+		snprintf(namebuf, sizeof(namebuf), "name%u.example.", i);
+		dns_test_namefromstring(namebuf, &fname);
+		name = dns_fixedname_name(&fname);
+		result = dns_rbt_addname(rbt, name, &data);
+		assert_int_equal(result, ISC_R_SUCCESS);
+
+		assert_int_equal(isc_stats_get_counter(
+					 stats, dns_cachestatscounter_rehashing),
+				 dns_rbt_rehashing(rbt) ? 1 : 0);
+		if (!dns_rbt_rehashing(rbt)) {
+			continue;
+		}
+		rehashed++;
+
+		/*
+		 * While rehashing, every even-numbered name is deleted
+		 * and a sample of the odd-numbered ones is looked up.
+		 */
+		if (i % 2 == 1) {
+			snprintf(namebuf, sizeof(namebuf), "name%u.example.",
+				 i - 1);
+			dns_test_namefromstring(namebuf, &fname);
+			name = dns_fixedname_name(&fname);
+			result = dns_rbt_deletename(rbt, name, false);
+			assert_int_equal(result, ISC_R_SUCCESS);
+			found = NULL;
+			result = dns_rbt_findname(rbt, name, 0, NULL, &found);
+			assert_int_not_equal(result, ISC_R_SUCCESS);
+		}
+		for (j = 1; j <= i; j += 98) {
+			snprintf(namebuf, sizeof(namebuf), "name%u.example.",
+				 j);
+			dns_test_namefromstring(namebuf, &fname);
+			name = dns_fixedname_name(&fname);
+			found = NULL;
+			result = dns_rbt_findname(rbt, name, 0, NULL, &found);
+			assert_int_equal(result, ISC_R_SUCCESS);
+			assert_ptr_equal(found, &data);
+		}
+	}
+
+	/* The table has grown several times. */
+	assert_true(rehashed > 0);
+	assert_true(dns_rbt_hashsize(rbt) * 3 >= dns_rbt_nodecount(rbt));
+
+	for (i = dns_cachestatscounter_rehashstall10us;
+	     i <= dns_cachestatscounter_rehashstallmax; i++)
+	{
+		stalls += isc_stats_get_counter(stats, i);
+	}
+	assert_true(stalls > 0);
+
+	dns_rbt_destroy(&rbt);
+	assert_int_equal(
+		isc_stats_get_counter(stats, dns_cachestatscounter_rehashing),
+		0);
+	isc_stats_detach(&stats);
+}
+
+/*
+ * Test that growing the hash table can be finished without modifying
+ * the tree.
+ */
+static void
+rbt_rehashfinish(void **state) {
+	isc_result_t result;
+	dns_rbt_t *rbt = NULL;
+	isc_stats_t *stats = NULL;
+	dns_fixedname_t fname;
+	dns_name_t *name = NULL;
+	static int data = 1;
+	unsigned int i, count;
+	char namebuf[64];
+	void *found = NULL;
+
+	UNUSED(state);
+
+	result = dns_rbt_create(dt_mctx, NULL, NULL, &rbt);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_stats_create(dt_mctx, &stats, dns_cachestatscounter_max);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_rbt_setstats(rbt, stats);
+
+	/* Nothing to do if the table is not being grown. */
+	dns_rbt_rehashfinish(rbt);
+	assert_false(dns_rbt_rehashing(rbt));
+
+	for (count = 0; !dns_rbt_rehashing(rbt); count++) {
+		assert_true(count < 100000);
+		snprintf(namebuf, sizeof(namebuf), "name%u.example.", count);
+		dns_test_namefromstring(namebuf, &fname);
+		name = dns_fixedname_name(&fname);
+		result = dns_rbt_addname(rbt, name, &data);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+	assert_int_equal(
+		isc_stats_get_counter(stats, dns_cachestatscounter_rehashing),
+		1);
+
+	dns_rbt_rehashfinish(rbt);
+	assert_false(dns_rbt_rehashing(rbt));
+	assert_int_equal(
+		isc_stats_get_counter(stats, dns_cachestatscounter_rehashing),
+		0);
+
+	for (i = 0; i < count; i++) {
+		snprintf(namebuf, sizeof(namebuf), "name%u.example.", i);
+		dns_test_namefromstring(namebuf, &fname);
+		name = dns_fixedname_name(&fname);
+		found = NULL;
+		result = dns_rbt_findname(rbt, name, 0, NULL, &found);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		assert_ptr_equal(found, &data);
+	}
+
+	dns_rbt_destroy(&rbt);
+	isc_stats_detach(&stats);
+}
+
 /* Test nodechain */
 static void
 rbt_nodechain(void **state) {
@@ -1363,6 +1512,10 @@ main(void) {
 		cmocka_unit_test_setup_teardown(rbt_addname, _setup, _teardown),
 		cmocka_unit_test_setup_teardown(rbt_deletename, _setup,
 						_teardown),
+		cmocka_unit_test_setup_teardown(rbt_rehash, _setup,
+						_teardown),
+		cmocka_unit_test_setup_teardown(rbt_rehashfinish, _setup,
+						_teardown),
 		cmocka_unit_test_setup_teardown(rbt_nodechain, _setup,
 						_teardown),
 		cmocka_unit_test_setup_teardown(rbtnode_namelen, _setup,
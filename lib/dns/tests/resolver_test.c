@@ -16,24 +16,39 @@
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #define UNIT_TESTING
 #include <cmocka.h>
 
 #include <isc/app.h>
+#include <isc/atomic.h>
 #include <isc/buffer.h>
 #include <isc/print.h>
 #include <isc/socket.h>
+#include <isc/stats.h>
 #include <isc/task.h>
+#include <isc/time.h>
 #include <isc/timer.h>
 #include <isc/util.h>
 
+#include <dns/adb.h>
+#include <dns/cache.h>
+#include <dns/callbacks.h>
+#include <dns/db.h>
 #include <dns/dispatch.h>
+#include <dns/events.h>
+#include <dns/fixedname.h>
+#include <dns/forward.h>
+#include <dns/master.h>
 #include <dns/name.h>
+#include <dns/rdataset.h>
 #include <dns/resolver.h>
+#include <dns/stats.h>
 #include <dns/view.h>
 
+#include "../resolver_p.h"
 #include "dnstest.h"
 
 static dns_dispatchmgr_t *dispatchmgr = NULL;
@@ -91,6 +106,305 @@ destroy_resolver(dns_resolver_t **resolverp) {
 	dns_resolver_detach(resolverp);
 }
 
+/*
+ * Give the view a cache and a resolver with a single task, which
+ * forwards all queries to the 'naddrs' servers in 'addrs' with 'policy'.
+ */
+static void
+mkfwdview(isc_sockaddr_t *addrs, unsigned int naddrs,
+	  dns_fwdpolicy_t policy) {
+	isc_result_t result;
+	dns_cache_t *cache = NULL;
+	isc_sockaddrlist_t list;
+	unsigned int i;
+
+	result = dns_cache_create(dt_mctx, dt_mctx, taskmgr, timermgr,
+				  dns_rdataclass_in, "", "rbt", 0, NULL,
+				  &cache);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_view_setcache(view, cache, false);
+	dns_cache_detach(&cache);
+
+	result = dns_view_createresolver(view, taskmgr, 1, 1, socketmgr,
+					 timermgr, 0, dispatchmgr, dispatch,
+					 NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	ISC_LIST_INIT(list);
+	for (i = 0; i < naddrs; i++) {
+		ISC_LINK_INIT(&addrs[i], link);
+		ISC_LIST_APPEND(list, &addrs[i], link);
+	}
+	result = dns_fwdtable_add(view->fwdtable, dns_rootname, &list, policy);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+/*
+ * Put a delegation of the root zone to a name server at 127.0.0.1 in
+ * the cache of the view, so that the resolver can recurse without
+ * priming.
+ */
+static void
+mkroot(void) {
+	isc_result_t result;
+	isc_buffer_t source;
+	dns_rdatacallbacks_t callbacks;
+	dns_name_t *origin;
+	const char *text = ". 3600 IN NS ns.\n"
+			   "ns. 3600 IN A 127.0.0.1\n";
+
+	isc_buffer_constinit(&source, text, strlen(text));
+	isc_buffer_add(&source, strlen(text));
+	DE_CONST(dns_rootname, origin);
+
+	dns_rdatacallbacks_init(&callbacks);
+	result = dns_db_beginload(view->cachedb, &callbacks);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_master_loadbuffer(&source, origin, origin,
+				       dns_rdataclass_in, 0, &callbacks,
+				       dt_mctx);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_db_endload(view->cachedb, &callbacks);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+/*
+ * A UDP server on the loopback, which answers every query with REFUSED,
+ * or while 'hold' is set keeps the queries until released.
+ */
+#define HELD 16
+
+typedef struct server {
+	isc_socket_t *sock;
+	isc_task_t *task;
+	isc_sockaddr_t addr;
+	bool hold;
+	atomic_uint_fast32_t queries;
+	isc_time_t first;
+	unsigned char buf[512];
+	unsigned int nheld;
+	struct {
+		isc_sockaddr_t from;
+		unsigned int length;
+		unsigned char buf[512];
+	} held[HELD];
+} server_t;
+
+static server_t servers[2];
+
+static void
+server_senddone(isc_task_t *task, isc_event_t *event) {
+	isc_socketevent_t *ev = (isc_socketevent_t *)event;
+
+	UNUSED(task);
+
+	isc_mem_put(dt_mctx, ev->region.base, ev->region.length);
+	isc_event_free(&event);
+}
+
+static void
+server_refuse(server_t *srv, isc_sockaddr_t *to, unsigned char *query,
+	      unsigned int length) {
+	isc_result_t result;
+	isc_region_t region;
+
+	region.length = length;
+	region.base = isc_mem_get(dt_mctx, region.length);
+	memmove(region.base, query, region.length);
+	region.base[2] |= 0x80;
+	region.base[3] = (region.base[3] & 0xf0) | dns_rcode_refused;
+	result = isc_socket_sendto(srv->sock, &region, srv->task,
+				   server_senddone, NULL, to, NULL);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_put(dt_mctx, region.base, region.length);
+	}
+}
+
+static void
+server_recv(isc_task_t *task, isc_event_t *event) {
+	isc_result_t result;
+	isc_region_t region;
+	server_t *srv = event->ev_arg;
+	isc_socketevent_t *ev = (isc_socketevent_t *)event;
+
+	if (ev->result != ISC_R_SUCCESS) {
+		isc_event_free(&event);
+		return;
+	}
+
+	if (ev->n >= 12) {
+		if (atomic_load(&srv->queries) == 0) {
+			isc_time_now(&srv->first);
+		}
+		atomic_fetch_add(&srv->queries, 1);
+		if (!srv->hold) {
+			server_refuse(srv, &ev->address, srv->buf, ev->n);
+		} else if (srv->nheld < HELD) {
+			srv->held[srv->nheld].from = ev->address;
+			srv->held[srv->nheld].length = ev->n;
+			memmove(srv->held[srv->nheld].buf, srv->buf, ev->n);
+			srv->nheld++;
+		}
+	}
+	isc_event_free(&event);
+
+	region.base = srv->buf;
+	region.length = sizeof(srv->buf);
+	result = isc_socket_recv(srv->sock, &region, 1, task, server_recv,
+				 srv);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+/*
+ * Start 'srv' in 'task'.
+ */
+static void
+mkserver(isc_task_t *task, server_t *srv, bool hold) {
+	isc_result_t result;
+	isc_region_t region;
+	struct in_addr ina;
+
+	srv->sock = NULL;
+	srv->task = task;
+	srv->hold = hold;
+	srv->nheld = 0;
+	atomic_init(&srv->queries, 0);
+
+	result = isc_socket_create(socketmgr, AF_INET, isc_sockettype_udp,
+				   &srv->sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	ina.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&srv->addr, &ina, 0);
+	result = isc_socket_bind(srv->sock, &srv->addr, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_getsockname(srv->sock, &srv->addr);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	region.base = srv->buf;
+	region.length = sizeof(srv->buf);
+	result = isc_socket_recv(srv->sock, &region, 1, task, server_recv,
+				 srv);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+static void
+server_release(isc_task_t *task, isc_event_t *event) {
+	server_t *srv = event->ev_arg;
+	unsigned int i;
+
+	UNUSED(task);
+
+	srv->hold = false;
+	for (i = 0; i < srv->nheld; i++) {
+		server_refuse(srv, &srv->held[i].from, srv->held[i].buf,
+			      srv->held[i].length);
+	}
+	srv->nheld = 0;
+	isc_event_free(&event);
+}
+
+/*
+ * Answer the queries held by 'srv', and any that follow.
+ */
+static void
+releaseserver(server_t *srv) {
+	isc_event_t *event;
+
+	event = isc_event_allocate(dt_mctx, srv->task, ISC_TASKEVENT_TEST,
+				   server_release, srv, sizeof(*event));
+	isc_task_send(srv->task, &event);
+}
+
+static void
+stopserver(server_t *srv) {
+	isc_socket_cancel(srv->sock, srv->task, ISC_SOCKCANCEL_ALL);
+	isc_socket_detach(&srv->sock);
+}
+
+/*
+ * Wait for 'srv' to have received 'count' queries.
+ */
+static void
+waitqueries(server_t *srv, unsigned int count) {
+	int n;
+
+	for (n = 0; n < 5000 && atomic_load(&srv->queries) < count; n++) {
+		dns_test_nap(1000);
+	}
+	assert_true(atomic_load(&srv->queries) >= count);
+}
+
+static void
+mkname(dns_fixedname_t *fixed, const char *fmt, unsigned int n) {
+	isc_result_t result;
+	char buf[DNS_NAME_FORMATSIZE];
+
+	snprintf(buf, sizeof(buf), fmt, n);
+	result = dns_name_fromstring(dns_fixedname_initname(fixed), buf, 0,
+				     NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+#define FETCHES 65
+
+static dns_fetch_t *fetches[FETCHES];
+static dns_rdataset_t rdatasets[FETCHES];
+static atomic_bool fetchdone[FETCHES];
+
+static void
+fetch_done(isc_task_t *task, isc_event_t *event) {
+	dns_fetchevent_t *fevent = (dns_fetchevent_t *)event;
+	unsigned int i = (uintptr_t)event->ev_arg;
+
+	UNUSED(task);
+
+	if (dns_rdataset_isassociated(fevent->rdataset)) {
+		dns_rdataset_disassociate(fevent->rdataset);
+	}
+	if (fevent->node != NULL) {
+		dns_db_detachnode(fevent->db, &fevent->node);
+	}
+	if (fevent->db != NULL) {
+		dns_db_detach(&fevent->db);
+	}
+	isc_event_free(&event);
+	atomic_store(&fetchdone[i], true);
+}
+
+/*
+ * Start fetch 'i', for the A records of 'name'.
+ */
+static void
+startfetch(unsigned int i, dns_name_t *name, isc_task_t *task) {
+	isc_result_t result;
+
+	dns_rdataset_init(&rdatasets[i]);
+	atomic_init(&fetchdone[i], false);
+	fetches[i] = NULL;
+	result = dns_resolver_createfetch(
+		view->resolver, name, dns_rdatatype_a, NULL, NULL, NULL, NULL,
+		0, 0, 0, NULL, task, fetch_done, (void *)(uintptr_t)i,
+		&rdatasets[i], NULL, &fetches[i]);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+/*
+ * Cancel fetch 'i' and destroy it once its event has arrived.
+ */
+static void
+stopfetch(unsigned int i) {
+	int n;
+
+	dns_resolver_cancelfetch(fetches[i]);
+	for (n = 0; n < 5000 && !atomic_load(&fetchdone[i]); n++) {
+		dns_test_nap(1000);
+	}
+	assert_true(atomic_load(&fetchdone[i]));
+	dns_resolver_destroyfetch(&fetches[i]);
+}
+
 /* dns_resolver_create */
 static void
 create_test(void **state) {
@@ -194,6 +508,318 @@ settimeout_overmax_test(void **state) {
 	destroy_resolver(&resolver);
 }
 
+/*
+ * Number of chains of the name index of a bucket holding 'count' fetch
+ * contexts, as it grows and as it shrinks.
+ */
+#define GROWNBITS(count)  ((count) <= 32 ? 4 : (count) <= 64 ? 5 : 6)
+#define SHRUNKBITS(count) ((count) >= 8 ? 6 : (count) >= 4 ? 5 : 4)
+
+/* growing and shrinking the name index of a fetch context bucket */
+static void
+bucketindex_test(void **state) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+	unsigned int count, hashbits, i;
+	int n;
+
+	UNUSED(state);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	mkserver(task, &servers[0], false);
+	mkfwdview(&servers[0].addr, 1, dns_fwdpolicy_only);
+	dns_view_freeze(view);
+
+	/*
+	 * With a single task, all fetches share one bucket, whose index
+	 * is doubled after 32 and 64 fetch contexts.
+	 */
+	for (i = 0; i < FETCHES; i++) {
+		mkname(&fixed, "n%u.example.", i);
+		name = dns_fixedname_name(&fixed);
+		startfetch(i, name, task);
+
+		count = dns__resolver_bucketsize(view->resolver, name,
+						 &hashbits);
+		assert_int_equal(count, i + 1);
+		assert_int_equal(hashbits, GROWNBITS(count));
+	}
+
+	/*
+	 * Every fetch context must still be found in its chain after the
+	 * index has been rebuilt, and the index is halved again below 8
+	 * and 4 fetch contexts.
+	 */
+	for (i = 0; i < FETCHES; i++) {
+		stopfetch(i);
+
+		count = FETCHES;
+		for (n = 0; n < 5000 && count != FETCHES - i - 1; n++) {
+			count = dns__resolver_bucketsize(view->resolver, name,
+							 &hashbits);
+			dns_test_nap(1000);
+		}
+		assert_int_equal(count, FETCHES - i - 1);
+		assert_int_equal(hashbits, SHRUNKBITS(count));
+	}
+
+	stopserver(&servers[0]);
+	isc_task_detach(&task);
+}
+
+/*
+ * Let the resolver of the view hedge up to 'percent' percent of its
+ * queries, and count its statistics in '*statsp'.  Queries are only
+ * retried after two seconds, so that no retry is taken for a hedge.
+ */
+static void
+sethedging(unsigned int percent, isc_stats_t **statsp) {
+	isc_result_t result;
+
+	dns_resolver_sethedgebudget(view->resolver, percent);
+	dns_resolver_setretryinterval(view->resolver, 2000);
+
+	result = isc_stats_create(dt_mctx, statsp, dns_resstatscounter_max);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_view_setresstats(view, *statsp);
+}
+
+/*
+ * Give the ADB entry of 'srv' a smoothed round trip time of 'srtt'
+ * microseconds and 100 samples of 'rtt' microseconds.
+ */
+static void
+setrtt(server_t *srv, unsigned int srtt, unsigned int rtt) {
+	isc_result_t result;
+	dns_adbaddrinfo_t *addrinfo = NULL;
+	unsigned int i;
+
+	result = dns_adb_findaddrinfo(view->adb, &srv->addr, &addrinfo, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_adb_adjustsrtt(view->adb, addrinfo, srtt, DNS_ADB_RTTADJREPLACE);
+	for (i = 0; i < 100; i++) {
+		dns_adb_samplertt(view->adb, addrinfo, rtt);
+	}
+
+	dns_adb_freeaddrinfo(view->adb, &addrinfo);
+}
+
+/*
+ * Return the round trip time of 'srv' estimated for 'percent'.
+ */
+static unsigned int
+getrtt(server_t *srv, unsigned int percent) {
+	isc_result_t result;
+	dns_adbaddrinfo_t *addrinfo = NULL;
+	unsigned int rtt;
+
+	result = dns_adb_findaddrinfo(view->adb, &srv->addr, &addrinfo, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_adb_getrttpercentile(view->adb, addrinfo, percent, &rtt);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_adb_freeaddrinfo(view->adb, &addrinfo);
+
+	return (rtt);
+}
+
+static uint64_t
+hedged(isc_stats_t *stats) {
+	return (isc_stats_get_counter(stats, dns_resstatscounter_hedged));
+}
+
+/*
+ * Wait for 'count' queries to have been hedged.
+ */
+static void
+waithedged(isc_stats_t *stats, uint64_t count) {
+	int n;
+
+	for (n = 0; n < 5000 && hedged(stats) < count; n++) {
+		dns_test_nap(1000);
+	}
+	assert_true(hedged(stats) >= count);
+}
+
+/* hedging a query after the 95th percentile of its server */
+static void
+hedge_test(void **state) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_stats_t *stats = NULL;
+	isc_sockaddr_t addrs[2];
+	isc_time_t start;
+	dns_fixedname_t fixed;
+	unsigned int p50, p95;
+
+	UNUSED(state);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	mkserver(task, &servers[0], true);
+	mkserver(task, &servers[1], false);
+	addrs[0] = servers[0].addr;
+	addrs[1] = servers[1].addr;
+	mkfwdview(addrs, 2, dns_fwdpolicy_only);
+	sethedging(100, &stats);
+	dns_view_freeze(view);
+
+	/*
+	 * The first forwarder is tried first, as it usually answers
+	 * within 25ms, but this time it does not answer at all.
+	 */
+	setrtt(&servers[0], 20000, 20000);
+	setrtt(&servers[1], 100000, 100000);
+	p50 = getrtt(&servers[0], 50);
+	p95 = getrtt(&servers[0], 95);
+
+	mkname(&fixed, "n%u.example.", 0);
+	isc_time_now(&start);
+	startfetch(0, dns_fixedname_name(&fixed), task);
+
+	/*
+	 * The query is sent to the second forwarder as well, once the
+	 * first has not answered it within its 95th percentile.
+	 */
+	waitqueries(&servers[1], 1);
+	assert_true(isc_time_microdiff(&servers[1].first, &start) >= p95);
+	waithedged(stats, 1);
+	assert_int_equal(hedged(stats), 1);
+
+	/*
+	 * The second forwarder refuses it, so the query is sent to the
+	 * first one again.  The time that the first query waited for a
+	 * response has then been counted for the first forwarder.
+	 */
+	waitqueries(&servers[0], 2);
+	assert_true(getrtt(&servers[0], 50) > p50);
+
+	releaseserver(&servers[0]);
+	stopfetch(0);
+	stopserver(&servers[0]);
+	stopserver(&servers[1]);
+	isc_stats_detach(&stats);
+	isc_task_detach(&task);
+}
+
+/* limiting hedged queries to a share of the queries sent */
+static void
+hedgebudget_test(void **state) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_stats_t *stats = NULL;
+	isc_sockaddr_t addrs[2];
+	dns_fixedname_t fixed;
+	unsigned int i;
+
+	UNUSED(state);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	mkserver(task, &servers[0], true);
+	mkserver(task, &servers[1], false);
+	addrs[0] = servers[0].addr;
+	addrs[1] = servers[1].addr;
+	mkfwdview(addrs, 2, dns_fwdpolicy_only);
+	sethedging(10, &stats);
+	dns_view_freeze(view);
+
+	setrtt(&servers[0], 20000, 20000);
+	setrtt(&servers[1], 100000, 100000);
+
+	/*
+	 * A query sent earns a tenth of the credit for a hedged query.
+	 */
+	mkname(&fixed, "n%u.example.", 0);
+	startfetch(0, dns_fixedname_name(&fixed), task);
+	waitqueries(&servers[0], 1);
+	dns_test_nap(100000);
+	assert_int_equal(hedged(stats), 0);
+	assert_int_equal(atomic_load(&servers[1].queries), 0);
+
+	/*
+	 * Ten queries sent earn all of it, so one of the next nine is
+	 * hedged, and no more.
+	 */
+	for (i = 1; i < 10; i++) {
+		mkname(&fixed, "n%u.example.", i);
+		startfetch(i, dns_fixedname_name(&fixed), task);
+	}
+	waithedged(stats, 1);
+	dns_test_nap(100000);
+	assert_int_equal(hedged(stats), 1);
+	assert_int_equal(atomic_load(&servers[1].queries), 1);
+
+	releaseserver(&servers[0]);
+	for (i = 0; i < 10; i++) {
+		stopfetch(i);
+	}
+	stopserver(&servers[0]);
+	stopserver(&servers[1]);
+	isc_stats_detach(&stats);
+	isc_task_detach(&task);
+}
+
+/* hedging a query to a forwarder only with another forwarder */
+static void
+hedgeforward_test(void **state) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_stats_t *stats = NULL;
+	dns_fixedname_t fixed;
+
+	UNUSED(state);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * The second server is the name server of the root zone, which
+	 * is tried once the forwarder has failed with "forward first".
+	 */
+	mkserver(task, &servers[0], true);
+	mkserver(task, &servers[1], false);
+	mkfwdview(&servers[0].addr, 1, dns_fwdpolicy_first);
+	sethedging(100, &stats);
+	dns_view_setdstport(view, isc_sockaddr_getport(&servers[1].addr));
+	dns_view_freeze(view);
+	mkroot();
+
+	setrtt(&servers[0], 20000, 20000);
+
+	/*
+	 * While the forwarder may still answer, the query is not hedged
+	 * with the name server.
+	 */
+	mkname(&fixed, "n%u.example.", 0);
+	startfetch(0, dns_fixedname_name(&fixed), task);
+	waitqueries(&servers[0], 1);
+	dns_test_nap(100000);
+	assert_int_equal(hedged(stats), 0);
+	assert_int_equal(atomic_load(&servers[1].queries), 0);
+
+	/*
+	 * Once the forwarder has refused it, the name server is tried.
+	 */
+	releaseserver(&servers[0]);
+	waitqueries(&servers[1], 1);
+	assert_int_equal(hedged(stats), 0);
+
+	stopfetch(0);
+	stopserver(&servers[0]);
+	stopserver(&servers[1]);
+	isc_stats_detach(&stats);
+	isc_task_detach(&task);
+}
+
 int
 main(void) {
 	const struct CMUnitTest tests[] = {
@@ -208,6 +834,13 @@ main(void) {
 						_setup, _teardown),
 		cmocka_unit_test_setup_teardown(settimeout_overmax_test, _setup,
 						_teardown),
+		cmocka_unit_test_setup_teardown(bucketindex_test, _setup,
+						_teardown),
+		cmocka_unit_test_setup_teardown(hedge_test, _setup, _teardown),
+		cmocka_unit_test_setup_teardown(hedgebudget_test, _setup,
+						_teardown),
+		cmocka_unit_test_setup_teardown(hedgeforward_test, _setup,
+						_teardown),
 	};
 
 	return (cmocka_run_group_tests(tests, NULL, NULL));
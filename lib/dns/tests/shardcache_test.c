@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <sched.h> /* IWYU pragma: keep */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/print.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/dbiterator.h>
+#include <dns/name.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/rdatasetiter.h>
+
+#include "dnstest.h"
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = dns_test_begin(NULL, false);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	dns_test_end();
+
+	return (0);
+}
+
+#define NSHARDS "4"
+#define NNAMES	300
+
+static isc_result_t
+create_cache(const char *nshards, dns_db_t **dbp) {
+	char shards[16];
+	char *argv[2] = { (char *)dt_mctx, shards };
+
+	strlcpy(shards, nshards, sizeof(shards));
+
+	return (dns_db_create(dt_mctx, "shardcache", dns_rootname,
+			      dns_dbtype_cache, dns_rdataclass_in, 2, argv,
+			      dbp));
+}
+
+static void
+add_rdata(dns_db_t *db, const char *owner, dns_rdatatype_t type,
+	  const char *text) {
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_fixedname_t fname;
+	dns_dbnode_t *node = NULL;
+	unsigned char data[256];
+	isc_result_t result;
+
+	result = dns_test_rdatafromstring(&rdata, dns_rdataclass_in, type,
+					  data, sizeof(data), text, false);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.ttl = 3600;
+	rdatalist.type = type;
+	rdatalist.rdclass = dns_rdataclass_in;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	rdataset.trust = dns_trust_authanswer;
+
+	dns_test_namefromstring(owner, &fname);
+	result = dns_db_findnode(db, dns_fixedname_name(&fname), true, &node);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_db_addrdataset(db, node, NULL, 0, &rdataset, 0, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_db_detachnode(db, &node);
+	dns_rdataset_disassociate(&rdataset);
+}
+
+static void
+check_find(dns_db_t *db, const char *qname, dns_rdatatype_t type,
+	   isc_result_t expect, const char *expectname) {
+	dns_fixedname_t fname, ffound, fexpect;
+	dns_name_t *found = dns_fixedname_initname(&ffound);
+	dns_dbnode_t *node = NULL;
+	dns_rdataset_t rdataset;
+	isc_result_t result;
+
+	dns_test_namefromstring(qname, &fname);
+	dns_test_namefromstring(expectname, &fexpect);
+	dns_rdataset_init(&rdataset);
+
+	result = dns_db_find(db, dns_fixedname_name(&fname), NULL, type, 0, 0,
+			     &node, found, &rdataset, NULL);
+	assert_int_equal(result, expect);
+	assert_true(dns_name_equal(found, dns_fixedname_name(&fexpect)));
+
+	dns_rdataset_disassociate(&rdataset);
+	dns_db_detachnode(db, &node);
+}
+
+/* the number of shards must be in range */
+static void
+create_test(void **state) {
+	dns_db_t *db = NULL;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = create_cache("1", &db);
+	assert_int_equal(result, ISC_R_RANGE);
+	result = create_cache("65", &db);
+	assert_int_equal(result, ISC_R_RANGE);
+	result = create_cache("four", &db);
+	assert_int_equal(result, ISC_R_RANGE);
+
+	result = create_cache("64", &db);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(dns_db_iscache(db));
+	dns_db_detach(&db);
+}
+
+/* lookups find data and zone cuts across the shards */
+static void
+find_test(void **state) {
+	dns_fixedname_t fname, ffound;
+	dns_name_t *found = dns_fixedname_initname(&ffound);
+	dns_rdataset_t rdataset;
+	dns_dbnode_t *node = NULL;
+	dns_db_t *db = NULL;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = create_cache(NSHARDS, &db);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	add_rdata(db, ".", dns_rdatatype_ns, "a.root-servers.net.");
+	add_rdata(db, "com.", dns_rdatatype_ns, "a.gtld-servers.net.");
+	add_rdata(db, "www.example.com.", dns_rdatatype_a, "10.0.0.1");
+
+	check_find(db, "www.example.com.", dns_rdatatype_a, ISC_R_SUCCESS,
+		   "www.example.com.");
+
+	/*
+	 * Without a zone cut in its own shard, the deepest one is found
+	 * in the shard of the top level domains.
+	 */
+	check_find(db, "mail.example.com.", dns_rdatatype_a, DNS_R_DELEGATION,
+		   "com.");
+	check_find(db, "www.example.org.", dns_rdatatype_a, DNS_R_DELEGATION,
+		   ".");
+
+	add_rdata(db, "example.com.", dns_rdatatype_ns, "ns.example.com.");
+	check_find(db, "mail.example.com.", dns_rdatatype_a, DNS_R_DELEGATION,
+		   "example.com.");
+
+	/* findzonecut() follows the same rules */
+	dns_test_namefromstring("www.example.org.", &fname);
+	dns_rdataset_init(&rdataset);
+	result = dns_db_findzonecut(db, dns_fixedname_name(&fname), 0, 0,
+				    &node, found, NULL, &rdataset, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(dns_name_equal(found, dns_rootname));
+	dns_rdataset_disassociate(&rdataset);
+	dns_db_detachnode(db, &node);
+
+	dns_test_namefromstring("mail.example.com.", &fname);
+	result = dns_db_findzonecut(db, dns_fixedname_name(&fname), 0, 0,
+				    &node, found, NULL, &rdataset, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(dns_name_countlabels(found), 3);
+	dns_rdataset_disassociate(&rdataset);
+	dns_db_detachnode(db, &node);
+
+	dns_db_detach(&db);
+}
+
+static dns_fixedname_t fnames[NNAMES];
+static dns_name_t *names[NNAMES];
+
+static int
+compare_names(const void *a, const void *b) {
+	return (dns_name_compare(*(dns_name_t *const *)a,
+				 *(dns_name_t *const *)b));
+}
+
+/*
+ * Move 'iter' with 'move' until it's at a node with data, and return
+ * that node's name in 'name'.
+ */
+static isc_result_t
+move_todata(dns_db_t *db, dns_dbiterator_t *iter, isc_result_t result,
+	    isc_result_t (*move)(dns_dbiterator_t *), dns_name_t *name) {
+	while (result == ISC_R_SUCCESS) {
+		dns_rdatasetiter_t *rdsiter = NULL;
+		dns_dbnode_t *node = NULL;
+		isc_result_t tresult;
+
+		result = dns_dbiterator_current(iter, &node, name);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		result = dns_db_allrdatasets(db, node, NULL, 0, &rdsiter);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		tresult = dns_rdatasetiter_first(rdsiter);
+		dns_rdatasetiter_destroy(&rdsiter);
+		dns_db_detachnode(db, &node);
+		if (tresult == ISC_R_SUCCESS) {
+			return (ISC_R_SUCCESS);
+		}
+		result = move(iter);
+	}
+
+	return (result);
+}
+
+/* iterators visit the nodes of all the shards in order */
+static void
+iterator_test(void **state) {
+	dns_fixedname_t fname;
+	dns_name_t *name = dns_fixedname_initname(&fname);
+	dns_dbiterator_t *iter = NULL;
+	dns_db_t *db = NULL;
+	isc_result_t result;
+	int i;
+
+	UNUSED(state);
+
+	result = create_cache(NSHARDS, &db);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < NNAMES; i++) {
+		char namestr[64];
+
+		if (i % 10 == 0) {
+			snprintf(namestr, sizeof(namestr), "tld%d.", i / 10);
+		} else {
+			snprintf(namestr, sizeof(namestr), "n%d.d%d.tld%d.", i,
+				 i % 7, i % 3);
+		}
+		add_rdata(db, namestr, dns_rdatatype_a, "10.0.0.1");
+		dns_test_namefromstring(namestr, &fnames[i]);
+		names[i] = dns_fixedname_name(&fnames[i]);
+	}
+	qsort(names, NNAMES, sizeof(names[0]), compare_names);
+
+	result = dns_db_createiterator(db, 0, &iter);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* forward */
+	result = move_todata(db, iter, dns_dbiterator_first(iter),
+			     dns_dbiterator_next, name);
+	for (i = 0; result == ISC_R_SUCCESS; i++) {
+		assert_true(i < NNAMES);
+		assert_true(dns_name_equal(name, names[i]));
+		result = move_todata(db, iter, dns_dbiterator_next(iter),
+				     dns_dbiterator_next, name);
+	}
+	assert_int_equal(result, ISC_R_NOMORE);
+	assert_int_equal(i, NNAMES);
+
+	/* backward */
+	result = move_todata(db, iter, dns_dbiterator_last(iter),
+			     dns_dbiterator_prev, name);
+	for (i = NNAMES - 1; result == ISC_R_SUCCESS; i--) {
+		assert_true(i >= 0);
+		assert_true(dns_name_equal(name, names[i]));
+		result = move_todata(db, iter, dns_dbiterator_prev(iter),
+				     dns_dbiterator_prev, name);
+	}
+	assert_int_equal(result, ISC_R_NOMORE);
+	assert_int_equal(i, -1);
+
+	/* seeking an existing name, then changing direction */
+	result = dns_dbiterator_seek(iter, names[100]);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = move_todata(db, iter, dns_dbiterator_next(iter),
+			     dns_dbiterator_next, name);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(dns_name_equal(name, names[101]));
+	result = move_todata(db, iter, dns_dbiterator_prev(iter),
+			     dns_dbiterator_prev, name);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(dns_name_equal(name, names[100]));
+	result = move_todata(db, iter, dns_dbiterator_prev(iter),
+			     dns_dbiterator_prev, name);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(dns_name_equal(name, names[99]));
+	result = move_todata(db, iter, dns_dbiterator_next(iter),
+			     dns_dbiterator_next, name);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(dns_name_equal(name, names[100]));
+
+	/* seeking a missing name stops before it */
+	dns_test_namefromstring("zzz.d0.tld0.", &fname);
+	name = dns_fixedname_name(&fname);
+	result = dns_dbiterator_seek(iter, name);
+	assert_int_equal(result, DNS_R_PARTIALMATCH);
+	result = dns_dbiterator_next(iter);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = move_todata(db, iter, result, dns_dbiterator_next, name);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	for (i = 0; i < NNAMES; i++) {
+		dns_fixedname_t fzzz;
+		dns_test_namefromstring("zzz.d0.tld0.", &fzzz);
+		if (dns_name_compare(names[i],
+				     dns_fixedname_name(&fzzz)) > 0) {
+			break;
+		}
+	}
+	assert_true(i < NNAMES);
+	assert_true(dns_name_equal(name, names[i]));
+
+	result = dns_dbiterator_pause(iter);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_dbiterator_destroy(&iter);
+	dns_db_detach(&db);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(create_test, _setup, _teardown),
+		cmocka_unit_test_setup_teardown(find_test, _setup, _teardown),
+		cmocka_unit_test_setup_teardown(iterator_test, _setup,
+						_teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif /* if HAVE_CMOCKA */
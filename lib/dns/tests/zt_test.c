@@ -263,20 +263,22 @@ asyncload_zone(void **state) {
 	dns_view_detach(&view);
 }
 
-/* asynchronous zone table load */
+/*
+ * Load a zone table with three zones, one of which fails to load, using
+ * 'nloaders' zone manager loader threads.
+ */
 static void
-asyncload_zt(void **state) {
+zt_asyncload(unsigned int nloaders) {
 	isc_result_t result;
 	dns_zone_t *zone1 = NULL, *zone2 = NULL, *zone3 = NULL;
 	dns_view_t *view;
 	dns_zt_t *zt = NULL;
 	dns_db_t *db = NULL;
+	dns_zoneloadprogress_t progress;
 	atomic_bool done;
 	int i = 0;
 	struct args args;
 
-	UNUSED(state);
-
 	atomic_init(&done, false);
 
 	result = dns_test_makezone("foo", &zone1, NULL, true);
@@ -308,6 +310,9 @@ asyncload_zt(void **state) {
 	result = dns_test_managezone(zone3);
 	assert_int_equal(result, ISC_R_SUCCESS);
 
+	dns_zonemgr_setloaders(zonemgr, nloaders);
+	assert_int_equal(dns_zonemgr_getloaders(zonemgr), nloaders);
+
 	assert_false(dns__zone_loadpending(zone1));
 	assert_false(dns__zone_loadpending(zone2));
 	assert_false(atomic_load(&done));
@@ -337,6 +342,11 @@ asyncload_zt(void **state) {
 		dns_db_detach(&db);
 	}
 
+	dns_zonemgr_getloadprogress(zonemgr, &progress);
+	assert_int_equal(progress.queued, 3);
+	assert_int_equal(progress.loaded, 3);
+	assert_int_equal(progress.failed, 1);
+
 	dns_test_releasezone(zone3);
 	dns_test_releasezone(zone2);
 	dns_test_releasezone(zone1);
@@ -348,6 +358,22 @@ asyncload_zt(void **state) {
 	dns_view_detach(&view);
 }
 
+/* asynchronous zone table load */
+static void
+asyncload_zt(void **state) {
+	UNUSED(state);
+
+	zt_asyncload(0);
+}
+
+/* asynchronous zone table load in loader threads */
+static void
+asyncload_zt_loaders(void **state) {
+	UNUSED(state);
+
+	zt_asyncload(2);
+}
+
 int
 main(void) {
 	const struct CMUnitTest tests[] = {
@@ -356,6 +382,8 @@ main(void) {
 						_teardown),
 		cmocka_unit_test_setup_teardown(asyncload_zt, _setup,
 						_teardown),
+		cmocka_unit_test_setup_teardown(asyncload_zt_loaders, _setup,
+						_teardown),
 	};
 
 	return (cmocka_run_group_tests(tests, NULL, NULL));
@@ -209,6 +209,7 @@ dns_view_create(isc_mem_t *mctx, dns_rdataclass_t rdclass, const char *name,
 	view->maxncachettl = 3 * 3600;
 	view->mincachettl = 0;
 	view->minncachettl = 0;
+	view->cacheshards = 1;
 	view->nta_lifetime = 0;
 	view->nta_recheck = 0;
 	view->prefetch_eligible = 0;
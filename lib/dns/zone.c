@@ -16,6 +16,7 @@
 #include <stdbool.h>
 
 #include <isc/atomic.h>
+#include <isc/condition.h>
 #include <isc/file.h>
 #include <isc/hex.h>
 #include <isc/md.h>
@@ -152,6 +153,7 @@ typedef struct dns_nsec3chain dns_nsec3chain_t;
 typedef ISC_LIST(dns_nsec3chain_t) dns_nsec3chainlist_t;
 typedef struct dns_keyfetch dns_keyfetch_t;
 typedef struct dns_asyncload dns_asyncload_t;
+typedef ISC_LIST(dns_asyncload_t) dns_asyncloadlist_t;
 typedef struct dns_include dns_include_t;
 
 #define DNS_ZONE_CHECKLOCK
@@ -227,6 +229,7 @@ struct dns_zone {
 	dns_zonetype_t type;
 	atomic_uint_fast64_t flags;
 	atomic_uint_fast64_t options;
+	atomic_uint_fast64_t dbgeneration;
 	unsigned int db_argc;
 	char **db_argv;
 	isc_time_t expiretime;
@@ -255,6 +258,7 @@ struct dns_zone {
 	uint32_t minretry;
 
 	uint32_t maxrecords;
+	unsigned int loadthreads;
 
 	isc_sockaddr_t *masters;
 	isc_dscp_t *masterdscps;
@@ -501,6 +505,9 @@ typedef enum {
 						      * notify due to the zone
 						      * just being loaded for
 						      * the first time.  */
+	DNS_ZONEFLG_COUNTLOAD = 0x100000000U, /*%< zone_loaddone() records
+					       * the load in the zone
+					       * manager's load progress */
 	DNS_ZONEFLG___MAX = UINT64_MAX, /* trick to make the ENUM 64-bit wide */
 } dns_zoneflg_t;
 
@@ -577,6 +584,22 @@ struct dns_zonemgr {
 	dns_iolist_t high;
 	dns_iolist_t low;
 
+	/* Locked by loadlock */
+	isc_mutex_t loadlock;
+	isc_condition_t loadcond;
+	isc_thread_t *loaders;
+	unsigned int nloaders;
+	bool loadersexiting;
+	dns_asyncloadlist_t loadqueue;
+	uint64_t loadsqueued;
+	uint64_t loadsdone;
+	uint64_t loadsfailed;
+	isc_time_t loadstart;
+	isc_time_t loadfinish;
+
+	unsigned int loadpoolsize;
+	dns_loadpool_t *loadpool; /* created when first needed */
+
 	/* Locked by urlock. */
 	/* LRU cache */
 	struct dns_unreachable unreachable[UNREACH_CACHE_SIZE];
@@ -723,9 +746,12 @@ struct dns_keyfetch {
  */
 struct dns_asyncload {
 	dns_zone_t *zone;
+	dns_zonemgr_t *zmgr;
 	unsigned int flags;
 	dns_zt_zoneloaded_t loaded;
 	void *loaded_arg;
+	char *prefetch; /* file to prefetch, if not yet prefetched */
+	ISC_LINK(dns_asyncload_t) link;
 };
 
 /*%
@@ -787,6 +813,8 @@ zone_attachdb(dns_zone_t *zone, dns_db_t *db);
 static inline void
 zone_detachdb(dns_zone_t *zone);
 static isc_result_t
+zone_dbupdated(dns_db_t *db, void *fn_arg);
+static isc_result_t
 default_journal(dns_zone_t *zone);
 static void
 zone_xfrdone(dns_zone_t *zone, isc_result_t result);
@@ -854,6 +882,12 @@ zonemgr_putio(dns_io_t **iop);
 static void
 zonemgr_cancelio(dns_io_t *io);
 static void
+zonemgr_loaddone(dns_zonemgr_t *zmgr, isc_result_t result);
+static void
+zonemgr_stoploaders(dns_zonemgr_t *zmgr);
+static void
+asyncload_free(dns_asyncload_t *asl);
+static void
 rss_post(dns_zone_t *, isc_event_t *);
 
 static isc_result_t
@@ -1021,6 +1055,7 @@ dns_zone_create(dns_zone_t **zonep, isc_mem_t *mctx) {
 	zone->type = dns_zone_none;
 	atomic_init(&zone->flags, 0);
 	atomic_init(&zone->options, 0);
+	atomic_init(&zone->dbgeneration, 0);
 	atomic_init(&zone->keyopts, 0);
 	zone->db_argc = 0;
 	zone->db_argv = NULL;
@@ -1146,6 +1181,7 @@ dns_zone_create(dns_zone_t **zonep, isc_mem_t *mctx) {
 	zone->rss_state = NULL;
 	zone->updatemethod = dns_updatemethod_increment;
 	zone->maxrecords = 0U;
+	zone->loadthreads = 1;
 
 	zone->magic = ZONE_MAGIC;
 
@@ -2069,7 +2105,8 @@ zone_load(dns_zone_t *zone, unsigned int flags, bool locked) {
 	INSIST(zone->db_argc >= 1);
 
 	rbt = strcmp(zone->db_argv[0], "rbt") == 0 ||
-	      strcmp(zone->db_argv[0], "rbt64") == 0;
+	      strcmp(zone->db_argv[0], "rbt64") == 0 ||
+	      strcmp(zone->db_argv[0], "image") == 0;
 
 	if (zone->db != NULL && zone->masterfile == NULL && rbt) {
 		/*
@@ -2318,30 +2355,86 @@ dns_zone_load(dns_zone_t *zone, bool newonly) {
 	return (zone_load(zone, newonly ? DNS_ZONELOADFLAG_NOSTAT : 0, false));
 }
 
+/*
+ * Load the zone in 'asl', record the result in the zone manager's load
+ * progress, tell the zone table that the load is done and free 'asl'.
+ * If the load continues in the zone's task, or in that of its raw zone,
+ * its result is recorded by zone_loaddone() instead.
+ */
 static void
-zone_asyncload(isc_task_t *task, isc_event_t *event) {
-	dns_asyncload_t *asl = event->ev_arg;
+asyncload_run(dns_asyncload_t *asl, isc_task_t *task) {
 	dns_zone_t *zone = asl->zone;
 	isc_result_t result;
-
-	UNUSED(task);
+	bool later = false;
 
 	REQUIRE(DNS_ZONE_VALID(zone));
 
-	isc_event_free(&event);
-
 	LOCK_ZONE(zone);
 	result = zone_load(zone, asl->flags, true);
 	if (result != DNS_R_CONTINUE) {
 		DNS_ZONE_CLRFLAG(zone, DNS_ZONEFLG_LOADPENDING);
+	} else if (DNS_ZONE_FLAG(zone, DNS_ZONEFLG_LOADING)) {
+		DNS_ZONE_SETFLAG(zone, DNS_ZONEFLG_COUNTLOAD);
+		later = true;
+	} else if (inline_secure(zone)) {
+		LOCK_ZONE(zone->raw);
+		if (DNS_ZONE_FLAG(zone->raw, DNS_ZONEFLG_LOADING)) {
+			DNS_ZONE_SETFLAG(zone->raw, DNS_ZONEFLG_COUNTLOAD);
+			later = true;
+		}
+		UNLOCK_ZONE(zone->raw);
 	}
 	UNLOCK_ZONE(zone);
 
+	if (!later) {
+		zonemgr_loaddone(asl->zmgr, result);
+	}
+
 	/* Inform the zone table we've finished loading */
 	if (asl->loaded != NULL) {
 		(asl->loaded)(asl->loaded_arg, zone, task);
 	}
 
+	asyncload_free(asl);
+}
+
+static void
+zone_asyncload(isc_task_t *task, isc_event_t *event) {
+	dns_asyncload_t *asl = event->ev_arg;
+
+	isc_event_free(&event);
+
+	asyncload_run(asl, task);
+}
+
+/*
+ * Cancel a load that is still in the zone manager's load queue.
+ */
+static void
+asyncload_cancel(dns_asyncload_t *asl) {
+	dns_zone_t *zone = asl->zone;
+
+	LOCK_ZONE(zone);
+	DNS_ZONE_CLRFLAG(zone, DNS_ZONEFLG_LOADPENDING);
+	UNLOCK_ZONE(zone);
+
+	zonemgr_loaddone(asl->zmgr, ISC_R_CANCELED);
+
+	if (asl->loaded != NULL) {
+		(asl->loaded)(asl->loaded_arg, zone, zone->loadtask);
+	}
+
+	asyncload_free(asl);
+}
+
+static void
+asyncload_free(dns_asyncload_t *asl) {
+	dns_zone_t *zone = asl->zone;
+
+	if (asl->prefetch != NULL) {
+		isc_mem_free(zone->mctx, asl->prefetch);
+	}
+	dns_zonemgr_detach(&asl->zmgr);
 	isc_mem_put(zone->mctx, asl, sizeof(*asl));
 	dns_zone_idetach(&zone);
 }
@@ -2349,7 +2442,7 @@ zone_asyncload(isc_task_t *task, isc_event_t *event) {
 isc_result_t
 dns_zone_asyncload(dns_zone_t *zone, bool newonly, dns_zt_zoneloaded_t done,
 		   void *arg) {
-	isc_event_t *e;
+	dns_zonemgr_t *zmgr;
 	dns_asyncload_t *asl = NULL;
 
 	REQUIRE(DNS_ZONE_VALID(zone));
@@ -2365,19 +2458,42 @@ dns_zone_asyncload(dns_zone_t *zone, bool newonly, dns_zt_zoneloaded_t done,
 		return (ISC_R_ALREADYRUNNING);
 	}
 
+	zmgr = zone->zmgr;
 	asl = isc_mem_get(zone->mctx, sizeof(*asl));
-
-	asl->zone = NULL;
-	asl->flags = newonly ? DNS_ZONELOADFLAG_NOSTAT : 0;
-	asl->loaded = done;
-	asl->loaded_arg = arg;
-
-	e = isc_event_allocate(zone->zmgr->mctx, zone->zmgr, DNS_EVENT_ZONELOAD,
-			       zone_asyncload, asl, sizeof(isc_event_t));
-
+	*asl = (dns_asyncload_t){ .flags = newonly ? DNS_ZONELOADFLAG_NOSTAT
+						   : 0,
+				  .loaded = done,
+				  .loaded_arg = arg };
+	ISC_LINK_INIT(asl, link);
 	zone_iattach(zone, &asl->zone);
+	dns_zonemgr_attach(zmgr, &asl->zmgr);
 	DNS_ZONE_SETFLAG(zone, DNS_ZONEFLG_LOADPENDING);
-	isc_task_send(zone->loadtask, &e);
+
+	LOCK(&zmgr->loadlock);
+	if (zmgr->loadsdone == zmgr->loadsqueued) {
+		/* Nothing is loading; start counting afresh. */
+		zmgr->loadsqueued = zmgr->loadsdone = zmgr->loadsfailed = 0;
+		TIME_NOW(&zmgr->loadstart);
+		isc_time_settoepoch(&zmgr->loadfinish);
+	}
+	zmgr->loadsqueued++;
+	if (zmgr->nloaders > 0) {
+		if (zone->masterfile != NULL && zone->stream == NULL) {
+			asl->prefetch = isc_mem_strdup(zone->mctx,
+						       zone->masterfile);
+		}
+		ISC_LIST_APPEND(zmgr->loadqueue, asl, link);
+		SIGNAL(&zmgr->loadcond);
+		asl = NULL;
+	}
+	UNLOCK(&zmgr->loadlock);
+
+	if (asl != NULL) {
+		isc_event_t *e = isc_event_allocate(
+			zmgr->mctx, zmgr, DNS_EVENT_ZONELOAD, zone_asyncload,
+			asl, sizeof(isc_event_t));
+		isc_task_send(zone->loadtask, &e);
+	}
 	UNLOCK_ZONE(zone);
 
 	return (ISC_R_SUCCESS);
@@ -2495,9 +2611,36 @@ zone_registerinclude(const char *filename, void *arg) {
 	ISC_LIST_APPEND(zone->newincludes, inc, link);
 }
 
+/*
+ * Return the load pool that the zone file of 'zone' should be loaded
+ * with, or NULL if it should be loaded by a single thread.
+ */
+static dns_loadpool_t *
+zone_loadpool(dns_zone_t *zone) {
+	dns_zonemgr_t *zmgr = zone->zmgr;
+	dns_loadpool_t *pool;
+
+	if (zone->masterformat != dns_masterformat_text ||
+	    zone->loadthreads < 2 || zmgr == NULL)
+	{
+		return (NULL);
+	}
+
+	LOCK(&zmgr->loadlock);
+	if (zmgr->loadpool == NULL && zmgr->loadpoolsize > 0) {
+		dns_loadpool_create(zmgr->mctx, zmgr->loadpoolsize,
+				    &zmgr->loadpool);
+	}
+	pool = zmgr->loadpool;
+	UNLOCK(&zmgr->loadlock);
+
+	return (pool);
+}
+
 static void
 zone_gotreadhandle(isc_task_t *task, isc_event_t *event) {
 	dns_load_t *load = event->ev_arg;
+	dns_loadpool_t *pool;
 	isc_result_t result = ISC_R_SUCCESS;
 	unsigned int options;
 
@@ -2513,12 +2656,24 @@ zone_gotreadhandle(isc_task_t *task, isc_event_t *event) {
 
 	options = get_master_options(load->zone);
 
-	result = dns_master_loadfileinc(
-		load->zone->masterfile, dns_db_origin(load->db),
-		dns_db_origin(load->db), load->zone->rdclass, options, 0,
-		&load->callbacks, task, zone_loaddone, load, &load->zone->lctx,
-		zone_registerinclude, load->zone, load->zone->mctx,
-		load->zone->masterformat, load->zone->maxttl);
+	pool = zone_loadpool(load->zone);
+	if (pool != NULL) {
+		result = dns_master_loadfileparallel(
+			load->zone->masterfile, dns_db_origin(load->db),
+			dns_db_origin(load->db), load->zone->rdclass, options,
+			0, &load->callbacks, task, zone_loaddone, load,
+			&load->zone->lctx, zone_registerinclude, load->zone,
+			load->zone->mctx, load->zone->maxttl, pool,
+			load->zone->loadthreads);
+	} else {
+		result = dns_master_loadfileinc(
+			load->zone->masterfile, dns_db_origin(load->db),
+			dns_db_origin(load->db), load->zone->rdclass, options,
+			0, &load->callbacks, task, zone_loaddone, load,
+			&load->zone->lctx, zone_registerinclude, load->zone,
+			load->zone->mctx, load->zone->masterformat,
+			load->zone->maxttl);
+	}
 	if (result != ISC_R_SUCCESS && result != DNS_R_CONTINUE &&
 	    result != DNS_R_SEENINCLUDE)
 	{
@@ -2641,6 +2796,7 @@ static isc_result_t
 zone_startload(dns_db_t *db, dns_zone_t *zone, isc_time_t loadtime) {
 	const char me[] = "zone_startload";
 	dns_load_t *load;
+	dns_loadpool_t *pool;
 	isc_result_t result;
 	isc_result_t tresult;
 	unsigned int options;
@@ -2704,6 +2860,13 @@ zone_startload(dns_db_t *db, dns_zone_t *zone, isc_time_t loadtime) {
 			result = dns_master_loadstream(
 				stream, &zone->origin, &zone->origin,
 				zone->rdclass, options, &callbacks, zone->mctx);
+		} else if ((pool = zone_loadpool(zone)) != NULL) {
+			result = dns_master_loadfileparallel(
+				zone->masterfile, &zone->origin, &zone->origin,
+				zone->rdclass, options, 0, &callbacks, NULL,
+				NULL, NULL, NULL, zone_registerinclude, zone,
+				zone->mctx, zone->maxttl, pool,
+				zone->loadthreads);
 		} else {
 			result = dns_master_loadfile(
 				zone->masterfile, &zone->origin, &zone->origin,
@@ -6389,6 +6552,13 @@ dns_zone_setdb(dns_zone_t *zone, dns_db_t *db) {
 	ZONEDB_UNLOCK(&zone->dblock, isc_rwlocktype_write);
 }
 
+uint64_t
+dns_zone_getdbgeneration(dns_zone_t *zone) {
+	REQUIRE(DNS_ZONE_VALID(zone));
+
+	return (atomic_load_acquire(&zone->dbgeneration));
+}
+
 /*
  * Coordinates the starting of routine jobs.
  */
@@ -11805,6 +11975,21 @@ dns_zone_setmaxrecords(dns_zone_t *zone, uint32_t val) {
 	zone->maxrecords = val;
 }
 
+unsigned int
+dns_zone_getloadthreads(dns_zone_t *zone) {
+	REQUIRE(DNS_ZONE_VALID(zone));
+
+	return (zone->loadthreads);
+}
+
+void
+dns_zone_setloadthreads(dns_zone_t *zone, unsigned int nthreads) {
+	REQUIRE(DNS_ZONE_VALID(zone));
+	REQUIRE(nthreads > 0);
+
+	zone->loadthreads = nthreads;
+}
+
 static bool
 notify_isqueued(dns_zone_t *zone, unsigned int flags, dns_name_t *name,
 		isc_sockaddr_t *addr, dns_tsigkey_t *key) {
@@ -16861,12 +17046,37 @@ fail:
 	return (result);
 }
 
+/*
+ * Give 'zone' a database generation number that has never been used by
+ * any zone before.
+ */
+static void
+zone_newdbgeneration(dns_zone_t *zone) {
+	static atomic_uint_fast64_t dbgenerations = ATOMIC_VAR_INIT(0);
+
+	atomic_store_release(&zone->dbgeneration,
+			     atomic_fetch_add_relaxed(&dbgenerations, 1) + 1);
+}
+
+static isc_result_t
+zone_dbupdated(dns_db_t *db, void *fn_arg) {
+	dns_zone_t *zone = fn_arg;
+
+	UNUSED(db);
+
+	zone_newdbgeneration(zone);
+
+	return (ISC_R_SUCCESS);
+}
+
 /* The caller must hold the dblock as a writer. */
 static inline void
 zone_attachdb(dns_zone_t *zone, dns_db_t *db) {
 	REQUIRE(zone->db == NULL && db != NULL);
 
 	dns_db_attach(db, &zone->db);
+	(void)dns_db_updatenotify_register(zone->db, zone_dbupdated, zone);
+	zone_newdbgeneration(zone);
 }
 
 /* The caller must hold the dblock as a writer. */
@@ -16874,7 +17084,9 @@ static inline void
 zone_detachdb(dns_zone_t *zone) {
 	REQUIRE(zone->db != NULL);
 
+	(void)dns_db_updatenotify_unregister(zone->db, zone_dbupdated, zone);
 	dns_db_detach(&zone->db);
+	zone_newdbgeneration(zone);
 }
 
 static void
@@ -17163,7 +17375,8 @@ zone_loaddone(void *arg, isc_result_t result) {
 	static char me[] = "zone_loaddone";
 	dns_load_t *load = arg;
 	dns_zone_t *zone;
-	isc_result_t tresult;
+	dns_zonemgr_t *zmgr = NULL;
+	isc_result_t tresult, lresult;
 	dns_zone_t *secure = NULL;
 
 	REQUIRE(DNS_LOAD_VALID(load));
@@ -17205,9 +17418,15 @@ again:
 			goto again;
 		}
 	}
-	(void)zone_postload(zone, load->db, load->loadtime, result);
+	lresult = zone_postload(zone, load->db, load->loadtime, result);
 	zonemgr_putio(&zone->readio);
 	DNS_ZONE_CLRFLAG(zone, DNS_ZONEFLG_LOADING);
+	if (DNS_ZONE_FLAG(zone, DNS_ZONEFLG_COUNTLOAD)) {
+		DNS_ZONE_CLRFLAG(zone, DNS_ZONEFLG_COUNTLOAD);
+		if (zone->zmgr != NULL) {
+			dns_zonemgr_attach(zone->zmgr, &zmgr);
+		}
+	}
 	zone_idetach(&load->callbacks.zone);
 	/*
 	 * Leave the zone frozen if the reload fails.
@@ -17225,6 +17444,11 @@ again:
 	}
 	UNLOCK_ZONE(zone);
 
+	if (zmgr != NULL) {
+		zonemgr_loaddone(zmgr, lresult);
+		dns_zonemgr_detach(&zmgr);
+	}
+
 	load->magic = 0;
 	dns_db_detach(&load->db);
 	if (load->zone->lctx != NULL) {
@@ -17424,6 +17648,13 @@ got_transfer_quota(isc_task_t *task, isc_event_t *event) {
 		if (peer == NULL || result != ISC_R_SUCCESS) {
 			use_ixfr = zone->requestixfr;
 		}
+		/*
+		 * Zone images can't be changed in place, so every
+		 * transfer into one has to be a full one.
+		 */
+		if (strcmp(zone->db_argv[0], "image") == 0) {
+			use_ixfr = false;
+		}
 		if (!use_ixfr) {
 			dns_zone_logc(zone, DNS_LOGCATEGORY_XFER_IN,
 				      ISC_LOG_DEBUG(1),
@@ -17888,6 +18119,20 @@ dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 
 	isc_mutex_init(&zmgr->iolock);
 
+	zmgr->loaders = NULL;
+	zmgr->nloaders = 0;
+	zmgr->loadersexiting = false;
+	ISC_LIST_INIT(zmgr->loadqueue);
+	zmgr->loadsqueued = 0;
+	zmgr->loadsdone = 0;
+	zmgr->loadsfailed = 0;
+	isc_time_settoepoch(&zmgr->loadstart);
+	isc_time_settoepoch(&zmgr->loadfinish);
+	zmgr->loadpoolsize = 0;
+	zmgr->loadpool = NULL;
+	isc_mutex_init(&zmgr->loadlock);
+	isc_condition_init(&zmgr->loadcond);
+
 	zmgr->magic = ZONEMGR_MAGIC;
 
 	*zmgrp = zmgr;
@@ -18093,6 +18338,8 @@ dns_zonemgr_shutdown(dns_zonemgr_t *zmgr) {
 
 	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
 
+	zonemgr_stoploaders(zmgr);
+
 	isc_ratelimiter_shutdown(zmgr->notifyrl);
 	isc_ratelimiter_shutdown(zmgr->refreshrl);
 	isc_ratelimiter_shutdown(zmgr->startupnotifyrl);
@@ -18234,6 +18481,13 @@ zonemgr_free(dns_zonemgr_t *zmgr) {
 
 	isc_refcount_destroy(&zmgr->refs);
 	isc_mutex_destroy(&zmgr->iolock);
+	INSIST(zmgr->nloaders == 0);
+	INSIST(ISC_LIST_EMPTY(zmgr->loadqueue));
+	(void)isc_condition_destroy(&zmgr->loadcond);
+	isc_mutex_destroy(&zmgr->loadlock);
+	if (zmgr->loadpool != NULL) {
+		dns_loadpool_destroy(&zmgr->loadpool);
+	}
 	isc_ratelimiter_detach(&zmgr->notifyrl);
 	isc_ratelimiter_detach(&zmgr->refreshrl);
 	isc_ratelimiter_detach(&zmgr->startupnotifyrl);
@@ -18436,6 +18690,232 @@ dns_zonemgr_getiolimit(dns_zonemgr_t *zmgr) {
 	return (zmgr->iolimit);
 }
 
+/*%
+ * The most files a loader thread prefetches at a time.
+ */
+#define ZONEMGR_MAXPREFETCH 64
+
+/*
+ * Record that a load queued with dns_zone_asyncload() has finished.
+ */
+static void
+zonemgr_loaddone(dns_zonemgr_t *zmgr, isc_result_t result) {
+	LOCK(&zmgr->loadlock);
+	INSIST(zmgr->loadsdone < zmgr->loadsqueued);
+	zmgr->loadsdone++;
+	if (result != ISC_R_SUCCESS && result != DNS_R_UPTODATE &&
+	    result != DNS_R_SEENINCLUDE)
+	{
+		zmgr->loadsfailed++;
+	}
+	if (zmgr->loadsdone == zmgr->loadsqueued) {
+		TIME_NOW(&zmgr->loadfinish);
+	}
+	UNLOCK(&zmgr->loadlock);
+}
+
+/*
+ * Ask the operating system to read the files of the zones at the head
+ * of the load queue, up to twice as many zones as there are loader
+ * threads, so that the disk can work on them while the zones ahead of
+ * them are being loaded.  Each file is only prefetched once.
+ */
+static void
+zonemgr_prefetch(dns_zonemgr_t *zmgr, isc_mem_t **mctxs, char **files,
+		 unsigned int *countp) {
+	dns_asyncload_t *asl;
+	unsigned int i, count = 0;
+
+	for (asl = ISC_LIST_HEAD(zmgr->loadqueue), i = 0;
+	     asl != NULL && i < 2 * zmgr->nloaders && count < *countp;
+	     asl = ISC_LIST_NEXT(asl, link), i++)
+	{
+		if (asl->prefetch != NULL) {
+			mctxs[count] = asl->zone->mctx;
+			files[count++] = asl->prefetch;
+			asl->prefetch = NULL;
+		}
+	}
+	*countp = count;
+}
+
+static isc_threadresult_t
+zonemgr_loader(isc_threadarg_t arg) {
+	dns_zonemgr_t *zmgr = arg;
+	isc_mem_t *mctxs[ZONEMGR_MAXPREFETCH];
+	char *files[ZONEMGR_MAXPREFETCH];
+	dns_asyncload_t *asl;
+	unsigned int i, count;
+
+	LOCK(&zmgr->loadlock);
+	for (;;) {
+		while (ISC_LIST_EMPTY(zmgr->loadqueue) &&
+		       !zmgr->loadersexiting) {
+			WAIT(&zmgr->loadcond, &zmgr->loadlock);
+		}
+		if (zmgr->loadersexiting) {
+			break;
+		}
+
+		asl = ISC_LIST_HEAD(zmgr->loadqueue);
+		ISC_LIST_UNLINK(zmgr->loadqueue, asl, link);
+		count = ZONEMGR_MAXPREFETCH;
+		zonemgr_prefetch(zmgr, mctxs, files, &count);
+		UNLOCK(&zmgr->loadlock);
+
+		for (i = 0; i < count; i++) {
+			(void)isc_file_prefetch(files[i]);
+			isc_mem_free(mctxs[i], files[i]);
+		}
+
+		asyncload_run(asl, asl->zone->loadtask);
+
+		LOCK(&zmgr->loadlock);
+	}
+	UNLOCK(&zmgr->loadlock);
+
+	return ((isc_threadresult_t)0);
+}
+
+/*
+ * Stop the loader threads, waiting for the loads they are running to
+ * finish.  Loads still in the queue are left there.
+ */
+static void
+zonemgr_joinloaders(dns_zonemgr_t *zmgr) {
+	isc_thread_t *loaders;
+	unsigned int i, nloaders;
+
+	LOCK(&zmgr->loadlock);
+	loaders = zmgr->loaders;
+	nloaders = zmgr->nloaders;
+	zmgr->loadersexiting = true;
+	BROADCAST(&zmgr->loadcond);
+	UNLOCK(&zmgr->loadlock);
+
+	for (i = 0; i < nloaders; i++) {
+		isc_thread_join(loaders[i], NULL);
+	}
+
+	LOCK(&zmgr->loadlock);
+	zmgr->loaders = NULL;
+	zmgr->nloaders = 0;
+	zmgr->loadersexiting = false;
+	UNLOCK(&zmgr->loadlock);
+
+	if (loaders != NULL) {
+		isc_mem_put(zmgr->mctx, loaders, nloaders * sizeof(loaders[0]));
+	}
+}
+
+/*
+ * Stop the loader threads and cancel the loads that are still queued.
+ */
+static void
+zonemgr_stoploaders(dns_zonemgr_t *zmgr) {
+	dns_asyncloadlist_t queue;
+	dns_asyncload_t *asl;
+
+	zonemgr_joinloaders(zmgr);
+
+	LOCK(&zmgr->loadlock);
+	queue = zmgr->loadqueue;
+	ISC_LIST_INIT(zmgr->loadqueue);
+	UNLOCK(&zmgr->loadlock);
+
+	while ((asl = ISC_LIST_HEAD(queue)) != NULL) {
+		ISC_LIST_UNLINK(queue, asl, link);
+		asyncload_cancel(asl);
+	}
+}
+
+void
+dns_zonemgr_setloaders(dns_zonemgr_t *zmgr, unsigned int nloaders) {
+	dns_asyncloadlist_t queue;
+	dns_asyncload_t *asl;
+	unsigned int i;
+
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+
+	if (nloaders == zmgr->nloaders) {
+		return;
+	}
+
+	zonemgr_joinloaders(zmgr);
+
+	LOCK(&zmgr->loadlock);
+	if (nloaders > 0) {
+		zmgr->loaders = isc_mem_get(zmgr->mctx,
+					    nloaders * sizeof(isc_thread_t));
+		zmgr->nloaders = nloaders;
+		for (i = 0; i < nloaders; i++) {
+			isc_thread_create(zonemgr_loader, zmgr,
+					  &zmgr->loaders[i]);
+			isc_thread_setname(zmgr->loaders[i], "isc-zoneload");
+		}
+		ISC_LIST_INIT(queue);
+	} else {
+		queue = zmgr->loadqueue;
+		ISC_LIST_INIT(zmgr->loadqueue);
+	}
+	UNLOCK(&zmgr->loadlock);
+
+	/*
+	 * Without loader threads, any loads still queued are handed to
+	 * the zones' load tasks.
+	 */
+	while ((asl = ISC_LIST_HEAD(queue)) != NULL) {
+		isc_event_t *e;
+
+		ISC_LIST_UNLINK(queue, asl, link);
+		e = isc_event_allocate(zmgr->mctx, zmgr, DNS_EVENT_ZONELOAD,
+				       zone_asyncload, asl, sizeof(isc_event_t));
+		isc_task_send(asl->zone->loadtask, &e);
+	}
+}
+
+unsigned int
+dns_zonemgr_getloaders(dns_zonemgr_t *zmgr) {
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+
+	return (zmgr->nloaders);
+}
+
+void
+dns_zonemgr_setloadpool(dns_zonemgr_t *zmgr, unsigned int nthreads) {
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+
+	LOCK(&zmgr->loadlock);
+	REQUIRE(zmgr->loadpool == NULL);
+	zmgr->loadpoolsize = nthreads;
+	UNLOCK(&zmgr->loadlock);
+}
+
+void
+dns_zonemgr_getloadprogress(dns_zonemgr_t *zmgr,
+			    dns_zoneloadprogress_t *progress) {
+	isc_time_t now;
+
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+	REQUIRE(progress != NULL);
+
+	TIME_NOW(&now);
+
+	LOCK(&zmgr->loadlock);
+	progress->queued = zmgr->loadsqueued;
+	progress->loaded = zmgr->loadsdone;
+	progress->failed = zmgr->loadsfailed;
+	if (zmgr->loadsqueued == 0) {
+		progress->elapsed = 0;
+	} else if (zmgr->loadsdone == zmgr->loadsqueued) {
+		progress->elapsed = isc_time_microdiff(&zmgr->loadfinish,
+						       &zmgr->loadstart);
+	} else {
+		progress->elapsed = isc_time_microdiff(&now, &zmgr->loadstart);
+	}
+	UNLOCK(&zmgr->loadlock);
+}
+
 /*
  * Get permission to request a file handle from the OS.
  * An event will be sent to action when one is available.
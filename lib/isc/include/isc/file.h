@@ -358,6 +358,20 @@ isc_file_munmap(void *addr, size_t len);
  * this platform, then we simply free the memory.
  */
 
+isc_result_t
+isc_file_prefetch(const char *filename);
+/*%<
+ * Ask the operating system to start reading 'filename' into memory in
+ * the background, so that it can be read without waiting for the disk
+ * shortly afterwards.  The file is not read by the caller, and this
+ * returns without waiting for the read to finish.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOTIMPLEMENTED	the platform cannot prefetch files.
+ *\li	Other errors if the file cannot be opened.
+ */
+
 isc_result_t
 isc_file_sanitize(const char *dir, const char *base, const char *ext,
 		  char *path, size_t length);
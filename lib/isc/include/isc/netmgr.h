@@ -28,6 +28,16 @@ typedef enum {
 	isc_socktype_raw = 4
 } isc_socktype_t;
 
+/*%
+ * How the kernel distributes incoming datagrams among the per-thread
+ * children of a listening UDP socket.
+ */
+typedef enum {
+	isc_nm_steering_none = 0, /*%< kernel flow hash (default) */
+	isc_nm_steering_cpu,	  /*%< CPU that received the packet */
+	isc_nm_steering_random	  /*%< independently for each packet */
+} isc_nm_steering_t;
+
 typedef void (*isc_nm_recv_cb_t)(isc_nmhandle_t *handle, isc_result_t eresult,
 				 isc_region_t *region, void *cbarg);
 /*%<
@@ -177,8 +187,9 @@ isc_nmhandle_netmgr(isc_nmhandle_t *handle);
  */
 
 isc_result_t
-isc_nm_listenudp(isc_nm_t *mgr, isc_nmiface_t *iface, isc_nm_recv_cb_t cb,
-		 void *cbarg, size_t extrasize, isc_nmsocket_t **sockp);
+isc_nm_listenudp(isc_nm_t *mgr, isc_nmiface_t *iface,
+		 isc_nm_steering_t steering, isc_nm_recv_cb_t cb, void *cbarg,
+		 size_t extrasize, isc_nmsocket_t **sockp);
 /*%<
  * Start listening for UDP packets on interface 'iface' using net manager
  * 'mgr'.
@@ -191,6 +202,22 @@ isc_nm_listenudp(isc_nm_t *mgr, isc_nmiface_t *iface, isc_nm_recv_cb_t cb,
  * When handles are allocated for the socket, 'extrasize' additional bytes
  * can be allocated along with the handle for an associated object, which
  * can then be freed automatically when the handle is destroyed.
+ *
+ * 'steering' selects how datagrams are distributed among the network
+ * threads.  Anything other than isc_nm_steering_none attaches a classic
+ * BPF program to the SO_REUSEPORT group (Linux only); if that fails, a
+ * warning is logged and the kernel flow hash is used.
+ */
+
+size_t
+isc_nm_udp_recvcounts(isc_nmsocket_t *sock, uint64_t *counts, size_t ncounts);
+/*%<
+ * Store the number of datagrams received so far by each network thread
+ * on the listening UDP socket 'sock' in 'counts', up to 'ncounts' entries.
+ * Returns the number of network threads listening on 'sock'.
+ *
+ * Requires:
+ * \li	'sock' is a valid listening UDP socket.
  */
 
 isc_result_t
@@ -302,11 +329,29 @@ isc_nm_listentcp(isc_nm_t *mgr, isc_nmiface_t *iface,
  * If 'quota' is not NULL, then the socket is attached to the specified
  * quota. This allows us to enforce TCP client quota limits.
  *
+ * Where the platform supports load-balanced SO_REUSEPORT (or
+ * SO_REUSEPORT_LB), every network thread listens on a socket of its
+ * own and keeps the connections it accepts; otherwise a single socket
+ * accepts connections and passes them to random network threads.
+ *
  * NOTE: This is currently only called inside isc_nm_listentcpdns(), which
  * creates a 'wrapper' socket that sends and receives DNS messages
  * prepended with a two-byte length field, and handles buffering.
  */
 
+size_t
+isc_nm_tcp_acceptcounts(isc_nmsocket_t *sock, uint64_t *counts,
+			size_t ncounts);
+/*%<
+ * Store the number of connections accepted so far by each listening
+ * socket behind the TCP, TCPDNS or TLS listener 'sock' in 'counts', up
+ * to 'ncounts' entries. Returns the number of listening sockets, which
+ * is either the number of network threads or 1.
+ *
+ * Requires:
+ * \li	'sock' is a valid listening TCP, TCPDNS or TLS socket.
+ */
+
 isc_result_t
 isc_nm_tcpconnect(isc_nm_t *mgr, isc_nmiface_t *local, isc_nmiface_t *peer,
 		  isc_nm_cb_t cb, void *cbarg, unsigned int timeout,
@@ -390,6 +435,21 @@ isc_nm_tcpdns_keepalive(isc_nmhandle_t *handle, bool value);
  * to determine when to close a connection, rather than the idle timeout.
  */
 
+void
+isc_nm_tcpdns_setpipeline(isc_nm_t *mgr, uint32_t limit);
+/*%<
+ * Set the largest number of DNS messages that may be processed at once
+ * for one TCPDNS connection accepted from now on; further messages are
+ * not read until some of them have been answered.  While responses on a
+ * connection are being written more slowly than they are produced, the
+ * limit for that connection is halved, down to one message, and then
+ * raised by one for every write that completes without others waiting,
+ * until 'limit' is reached again.  A 'limit' of 0 is treated as 1.
+ *
+ * Requires:
+ * \li	'mgr' is a valid netmgr.
+ */
+
 void
 isc_nm_tcp_settimeouts(isc_nm_t *mgr, uint32_t init, uint32_t idle,
 		       uint32_t keepalive, uint32_t advertised);
@@ -435,6 +495,67 @@ isc_nm_maxudp(isc_nm_t *mgr, uint32_t maxudp);
  * size.
  */
 
+void
+isc_nm_setaffinity(isc_nm_t *mgr, bool enable);
+/*%<
+ * Enable or disable pinning of network threads to CPUs.
+ *
+ * When enabled, network thread 'n' is bound to CPU 'n' modulo the number
+ * of CPUs, and every UDP listening socket created afterwards asks the
+ * kernel (via SO_INCOMING_CPU, where available) to deliver datagrams
+ * received on that CPU to the listener child read by thread 'n'.
+ * Pinning is enabled when the manager is created; disabling it lets the
+ * network threads run on any CPU again, but only affects the CPU hints
+ * of sockets created afterwards.
+ *
+ * Requires:
+ * \li	'mgr' is a valid netmgr.
+ */
+
+void
+isc_nm_queuestats(isc_nm_t *mgr, uint64_t *eventsp, uint64_t *wakeupsp,
+		  uint32_t *maxdepthp);
+/*%<
+ * Report on the queues used to pass work to the network threads: the
+ * number of events processed so far in '*eventsp', the number of times a
+ * network thread had to be woken up for them in '*wakeupsp', and the
+ * largest number of events a thread found queued at once in '*maxdepthp'.
+ * The totals are summed over all network threads.
+ *
+ * Requires:
+ * \li	'mgr' is a valid netmgr.
+ * \li	'eventsp', 'wakeupsp' and 'maxdepthp' are not NULL.
+ */
+
+void
+isc_nm_udp_setbatch(isc_nm_t *mgr, uint32_t size, uint32_t deadline);
+/*%<
+ * Configure batching of outgoing UDP messages on listening sockets.
+ *
+ * Responses sent by a network thread through its own listening socket
+ * are collected and written with a single sendmmsg() call when 'size'
+ * messages are pending, when the oldest pending message has waited for
+ * 'deadline' microseconds, or at the end of the current event loop
+ * iteration, whichever comes first.  A 'deadline' of 0 means messages are
+ * only held until the end of the loop iteration.
+ *
+ * Setting 'size' to 0 or 1 disables batching.  Values larger than the
+ * internal maximum are silently lowered.  On platforms without
+ * sendmmsg() this has no effect.
+ *
+ * Requires:
+ * \li	'mgr' is a valid netmgr.
+ */
+
+void
+isc_nm_udp_setiouring(isc_nm_t *mgr, bool enable);
+/*%<
+ * Enable or disable the use of io_uring for receiving and sending on
+ * UDP listening sockets created from now on.  If io_uring cannot be set
+ * up, libuv is used as usual.  This has no effect unless BIND was built
+ * with liburing.
+ */
+
 void
 isc_nm_setstats(isc_nm_t *mgr, isc_stats_t *stats);
 /*%<
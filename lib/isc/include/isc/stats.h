@@ -99,7 +99,23 @@ enum {
 	isc_sockstatscounter_rawrecvfail = 60,
 	isc_sockstatscounter_rawactive = 61,
 
-	isc_sockstatscounter_max = 62
+	isc_sockstatscounter_udp4sendbatch = 62,
+	isc_sockstatscounter_udp6sendbatch = 63,
+	isc_sockstatscounter_udp4sendbatchmsg = 64,
+	isc_sockstatscounter_udp6sendbatchmsg = 65,
+
+	isc_sockstatscounter_nmreqcached = 66,
+	isc_sockstatscounter_nmreqalloc = 67,
+	isc_sockstatscounter_nmeventcached = 68,
+	isc_sockstatscounter_nmeventalloc = 69,
+	isc_sockstatscounter_nmhandlecached = 70,
+	isc_sockstatscounter_nmhandlealloc = 71,
+
+	isc_sockstatscounter_tcpdnswrites = 72,
+	isc_sockstatscounter_tcpdnswritemsgs = 73,
+	isc_sockstatscounter_tcpdnsbacklog = 74,
+
+	isc_sockstatscounter_max = 75
 };
 
 ISC_LANG_BEGINDECLS
@@ -173,6 +189,18 @@ isc_stats_increment(isc_stats_t *stats, isc_statscounter_t counter);
  *	on creation.
  */
 
+void
+isc_stats_add(isc_stats_t *stats, isc_statscounter_t counter, uint64_t val);
+/*%<
+ * Add 'val' to the counter-th counter of stats.
+ *
+ * Requires:
+ *\li	'stats' is a valid isc_stats_t.
+ *
+ *\li	counter is less than the maximum available ID for the stats specified
+ *	on creation.
+ */
+
 void
 isc_stats_decrement(isc_stats_t *stats, isc_statscounter_t counter);
 /*%<
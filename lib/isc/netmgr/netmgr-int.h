@@ -24,7 +24,6 @@
 #include <isc/magic.h>
 #include <isc/mem.h>
 #include <isc/netmgr.h>
-#include <isc/queue.h>
 #include <isc/quota.h>
 #include <isc/random.h>
 #include <isc/refcount.h>
@@ -52,6 +51,59 @@
 #define ISC_NETMGR_RECVBUF_SIZE (65536)
 #endif
 
+/*
+ * Upper bound on the number of outgoing UDP messages a worker will
+ * collect before writing them with a single sendmmsg() call.
+ */
+#define ISC_NETMGR_SENDBATCH_MAX 64
+
+/*
+ * Default limit on the number of DNS messages processed at once for
+ * one TCPDNS connection.
+ */
+#define ISC_NETMGR_TCPDNS_PIPELINE 23
+
+/*
+ * Listening UDP sockets read incoming datagrams with recvmmsg() directly
+ * into slots taken from a per-worker pool.  A slot stays with the handle
+ * the datagram was delivered on until that handle is released, so the
+ * receiver can keep using the data without copying it.  The first
+ * ISC_NETMGR_RECVSLOTS slots are preallocated; further slots are
+ * allocated on demand and freed when they are released.
+ *
+ * A datagram larger than ISC_NETMGR_RECVSLOT_SIZE spills over into the
+ * worker's 'recvbuf', which is split into ISC_NETMGR_RECVMMSG_WIDTH
+ * areas of 64k, and is then copied into a slot of its own.
+ */
+#define ISC_NETMGR_RECVSLOTS	  256
+#define ISC_NETMGR_RECVSLOT_SIZE  4096
+#define ISC_NETMGR_RECVMMSG_WIDTH 20
+
+#if defined(HAVE_LIBURING) && !defined(HAVE_RECVMMSG)
+#error "io_uring support requires recvmmsg() support"
+#endif
+
+/*
+ * With io_uring, listening UDP sockets receive into buffers provided to
+ * the kernel from a per-worker buffer ring.  The buffers are big enough
+ * for any datagram plus the headers the kernel puts in front of it.
+ */
+#define ISC_NETMGR_URING_ENTRIES 1024
+#define ISC_NETMGR_URING_BUFFERS 128
+#define ISC_NETMGR_URING_BUFSIZE (65536 + 256)
+
+typedef struct isc__nm_recvslot isc__nm_recvslot_t;
+struct isc__nm_recvslot {
+	isc__nm_recvslot_t *next; /* next free slot */
+	unsigned char *base;
+	size_t size;
+	bool preallocated;
+#ifdef HAVE_LIBURING
+	bool uring;	    /* an io_uring provided buffer... */
+	unsigned short bid; /* ...with this buffer ID */
+#endif
+};
+
 /*
  * Define NETMGR_TRACE to activate tracing of handles and sockets.
  * This will impair performance but enables us to quickly determine,
@@ -66,6 +118,74 @@ isc__nm_dump_active(isc_nm_t *nm);
 
 #endif
 
+/*
+ * Intrusive multi-producer, single-consumer queue of ievents (after
+ * Dmitry Vyukov's non-blocking MPSC queue).  Every ievent starts with an
+ * isc__nm_evlink_t, so enqueueing never allocates: producers swap
+ * themselves in as 'head' and then link the previous head to the new
+ * event, and the worker thread pops from 'tail'.  A pop can briefly see
+ * the queue as empty while a producer is between the two steps; that
+ * producer then wakes the worker up again (see isc__nm_enqueue_ievent()).
+ */
+typedef struct isc__nm_evlink {
+	atomic_uintptr_t next;
+} isc__nm_evlink_t;
+
+typedef struct isc__nm_evqueue {
+	atomic_uintptr_t head;	/* most recently pushed link */
+	isc__nm_evlink_t *tail; /* oldest link; worker thread only */
+	isc__nm_evlink_t stub;
+} isc__nm_evqueue_t;
+
+void
+isc__nm_evqueue_init(isc__nm_evqueue_t *queue);
+/*%<
+ * Initialize an empty event queue.
+ */
+
+void
+isc__nm_evqueue_push(isc__nm_evqueue_t *queue, isc__nm_evlink_t *link);
+/*%<
+ * Append 'link' to 'queue'.  Can be called from any thread.
+ */
+
+isc__nm_evlink_t *
+isc__nm_evqueue_pop(isc__nm_evqueue_t *queue);
+/*%<
+ * Remove and return the oldest link from 'queue', or NULL if the queue
+ * is empty or a push is still in progress.  Must only be called from
+ * one thread at a time.
+ */
+
+/*
+ * Free uvreqs and ievents cached by a worker are linked through their
+ * first word.
+ */
+typedef struct isc__nm_freeobj isc__nm_freeobj_t;
+struct isc__nm_freeobj {
+	isc__nm_freeobj_t *next;
+};
+
+typedef struct isc__nm_freelist {
+	isc__nm_freeobj_t *head;
+	size_t count;
+} isc__nm_freelist_t;
+
+/*
+ * Allocation counters kept by each worker and periodically added to
+ * the socket statistics; the order matches isc_sockstatscounter_nmreqcached
+ * and the counters following it.
+ */
+typedef enum {
+	isc__nm_allocstat_reqcached = 0,
+	isc__nm_allocstat_reqalloc,
+	isc__nm_allocstat_eventcached,
+	isc__nm_allocstat_eventalloc,
+	isc__nm_allocstat_handlecached,
+	isc__nm_allocstat_handlealloc,
+	isc__nm_allocstat_max
+} isc__nm_allocstat_t;
+
 /*
  * Single network event loop worker.
  */
@@ -80,15 +200,48 @@ typedef struct isc__networker {
 	bool paused;
 	bool finished;
 	isc_thread_t thread;
-	isc_queue_t *ievents;	   /* incoming async events */
-	isc_queue_t *ievents_prio; /* priority async events
-				    * used for listening etc.
-				    * can be processed while
-				    * worker is paused */
+	isc__nm_evqueue_t ievents;	/* incoming async events */
+	isc__nm_evqueue_t ievents_prio; /* priority async events
+					 * used for listening etc.
+					 * can be processed while
+					 * worker is paused */
+	atomic_bool ievents_signaled;	/* 'async' has been sent and
+					 * async_cb hasn't run yet */
+	atomic_uint_fast64_t nievents;	/* ievents processed */
+	atomic_uint_fast64_t nwakeups;	/* 'async' sends */
+	atomic_uint_fast32_t maxdepth;	/* most ievents processed
+					 * in one async_cb */
+	isc__nm_freelist_t freereqs;	/* uvreqs for reuse, and... */
+	isc__nm_freelist_t freeevents;	/* ...ievents; only touched by
+					 * this worker's thread */
+	uint32_t allocstats[isc__nm_allocstat_max]; /* not yet reported */
+	uint32_t allocpending;
 	isc_refcount_t references;
 	atomic_int_fast64_t pktcount;
 	char *recvbuf;
 	bool recvbuf_inuse;
+	uv_check_t tcpdns_check; /* writes out 'tcpdnsbatches' at the
+				  * end of a loop iteration */
+	uv_idle_t tcpdns_idle;	 /* active while 'tcpdnsbatches' is
+				  * not empty, so the loop doesn't
+				  * block before they're written */
+	ISC_LIST(struct isc__nm_tcpdnsbatch) tcpdnsbatches;
+#ifdef HAVE_SENDMMSG
+	uv_check_t sendbatch_check; /* flushes 'sendbatch' once the
+				     * I/O callbacks of a loop
+				     * iteration have run */
+	struct isc__nm_sendbatch *sendbatch;
+#endif
+#ifdef HAVE_RECVMMSG
+	isc__nm_recvslot_t *recvslots;	   /* preallocated slots */
+	unsigned char *recvslotbuf;	   /* ...and their memory */
+	isc__nm_recvslot_t *recvslot_free; /* unused preallocated slots */
+	size_t recvslot_extra;		   /* on-demand slots in use */
+#endif
+#ifdef HAVE_LIBURING
+	struct isc__nm_uring *uring; /* set up on first use */
+	bool uring_failed;	     /* io_uring is not available */
+#endif
 } isc__networker_t;
 
 /*
@@ -121,6 +274,8 @@ struct isc_nmhandle {
 	isc_sockaddr_t local;
 	isc_nm_opaquecb_t doreset; /* reset extra callback, external */
 	isc_nm_opaquecb_t dofree;  /* free extra callback, external */
+	isc__nm_recvslot_t *recvslot; /* received data, for UDP */
+	isc_nmhandle_t *nextfree;     /* link in 'sock->freehandles' */
 #ifdef NETMGR_TRACE
 	void *backtrace[TRACE_SIZE];
 	int backtrace_size;
@@ -171,6 +326,7 @@ typedef enum isc__netievent_type {
 	netievent_shutdown,
 	netievent_stop,
 	netievent_pause,
+	netievent_affinity,
 
 	netievent_prio = 0xff, /* event type values higher than this
 				* will be treated as high-priority
@@ -221,12 +377,56 @@ struct isc__nm_uvreq {
 		uv_udp_send_t udp_send;
 		uv_fs_t fs;
 		uv_work_t work;
+#ifdef HAVE_LIBURING
+		struct {
+			struct msghdr msg;
+			struct iovec iov;
+		} uring;
+#endif
 	} uv_req;
 	ISC_LINK(isc__nm_uvreq_t) link;
 };
 
+/*
+ * Outgoing UDP messages waiting to be written by a worker.  Only the
+ * worker's own thread touches this, so no locking is needed.
+ */
+typedef struct isc__nm_sendbatch {
+	unsigned int count;
+	uint64_t start; /* uv_hrtime() when the first entry was queued */
+	struct {
+		isc_nmsocket_t *sock;
+		isc__nm_uvreq_t *req;
+	} entries[ISC_NETMGR_SENDBATCH_MAX];
+} isc__nm_sendbatch_t;
+
+/*
+ * DNS messages to be written on a TCPDNS socket with a single send on
+ * the underlying TCP or TLS socket.  Each message is copied into 'base'
+ * after its 2-byte length, and the requests in 'reqs' are completed
+ * when the send completes.  A batch is owned by the socket's thread.
+ */
+typedef struct isc__nm_tcpdnsbatch isc__nm_tcpdnsbatch_t;
+struct isc__nm_tcpdnsbatch {
+	isc_nmsocket_t *sock; /* attached */
+	unsigned char *base;
+	size_t len;
+	size_t size;
+	unsigned int nreqs;
+	ISC_LIST(isc__nm_uvreq_t) reqs;
+	ISC_LINK(isc__nm_tcpdnsbatch_t) link; /* in 'tcpdnsbatches' */
+};
+
+/*
+ * Every ievent starts with the link of the worker's event queue,
+ * followed by the event type.
+ */
+#define NETIEVENT__HEADER      \
+	isc__nm_evlink_t link; \
+	isc__netievent_type type
+
 typedef struct isc__netievent__socket {
-	isc__netievent_type type;
+	NETIEVENT__HEADER;
 	isc_nmsocket_t *sock;
 } isc__netievent__socket_t;
 
@@ -249,7 +449,7 @@ typedef isc__netievent__socket_t isc__netievent_tlsclose_t;
 typedef isc__netievent__socket_t isc__netievent_tlsdobio_t;
 
 typedef struct isc__netievent__socket_req {
-	isc__netievent_type type;
+	NETIEVENT__HEADER;
 	isc_nmsocket_t *sock;
 	isc__nm_uvreq_t *req;
 } isc__netievent__socket_req_t;
@@ -261,7 +461,7 @@ typedef isc__netievent__socket_req_t isc__netievent_tcpsend_t;
 typedef isc__netievent__socket_req_t isc__netievent_tcpdnssend_t;
 
 typedef struct isc__netievent__socket_streaminfo_quota {
-	isc__netievent_type type;
+	NETIEVENT__HEADER;
 	isc_nmsocket_t *sock;
 	isc_uv_stream_info_t streaminfo;
 	isc_quota_t *quota;
@@ -271,7 +471,7 @@ typedef isc__netievent__socket_streaminfo_quota_t
 	isc__netievent_tcpchildaccept_t;
 
 typedef struct isc__netievent__socket_handle {
-	isc__netievent_type type;
+	NETIEVENT__HEADER;
 	isc_nmsocket_t *sock;
 	isc_nmhandle_t *handle;
 } isc__netievent__socket_handle_t;
@@ -282,7 +482,7 @@ typedef isc__netievent__socket_handle_t isc__netievent_tcpdnscancel_t;
 typedef isc__netievent__socket_handle_t isc__netievent_detach_t;
 
 typedef struct isc__netievent__socket_quota {
-	isc__netievent_type type;
+	NETIEVENT__HEADER;
 	isc_nmsocket_t *sock;
 	isc_quota_t *quota;
 } isc__netievent__socket_quota_t;
@@ -290,14 +490,14 @@ typedef struct isc__netievent__socket_quota {
 typedef isc__netievent__socket_quota_t isc__netievent_tcpaccept_t;
 
 typedef struct isc__netievent_udpsend {
-	isc__netievent_type type;
+	NETIEVENT__HEADER;
 	isc_nmsocket_t *sock;
 	isc_sockaddr_t peer;
 	isc__nm_uvreq_t *req;
 } isc__netievent_udpsend_t;
 
 typedef struct isc__netievent_tlsconnect {
-	isc__netievent_type type;
+	NETIEVENT__HEADER;
 	isc_nmsocket_t *sock;
 	SSL_CTX *ctx;
 	isc_sockaddr_t local; /* local address */
@@ -305,7 +505,7 @@ typedef struct isc__netievent_tlsconnect {
 } isc__netievent_tlsconnect_t;
 
 typedef struct isc__netievent {
-	isc__netievent_type type;
+	NETIEVENT__HEADER;
 } isc__netievent_t;
 
 typedef isc__netievent_t isc__netievent_shutdown_t;
@@ -374,6 +574,32 @@ struct isc_nm {
 	uint32_t keepalive;
 	uint32_t advertised;
 
+	/*
+	 * UDP transmit batching: the maximum number of messages written
+	 * by one sendmmsg() call (0 or 1 disables batching) and the
+	 * longest time, in microseconds, a message may be held back.
+	 */
+	atomic_uint_fast32_t sendbatch_size;
+	atomic_uint_fast32_t sendbatch_deadline;
+
+	/*
+	 * The largest number of DNS messages that may be processed at
+	 * once for one TCPDNS connection.
+	 */
+	atomic_uint_fast32_t tcpdns_pipeline;
+
+	/*
+	 * Use io_uring for new UDP listeners where available.
+	 */
+	atomic_bool uring;
+
+	/*
+	 * Network threads are pinned to CPUs, and listening sockets are
+	 * tied to the CPU of the thread that reads from them.
+	 */
+	atomic_bool affinity;
+	int ncpus;
+
 #ifdef NETMGR_TRACE
 	ISC_LIST(isc_nmsocket_t) active_sockets;
 #endif
@@ -410,7 +636,9 @@ enum { STATID_OPEN = 0,
        STATID_ACCEPT = 7,
        STATID_SENDFAIL = 8,
        STATID_RECVFAIL = 9,
-       STATID_ACTIVE = 10 };
+       STATID_ACTIVE = 10,
+       STATID_SENDBATCH = 11,
+       STATID_SENDBATCHMSG = 12 };
 
 struct isc_nmsocket {
 	/*% Unlocked, RO */
@@ -467,6 +695,12 @@ struct isc_nmsocket {
 	uint64_t read_timeout;
 	uint64_t connect_timeout;
 
+	/*%
+	 * A connect request that timed out while libuv still owned it.
+	 * It isn't reused, but freed when the socket is destroyed.
+	 */
+	isc__nm_uvreq_t *timedoutreq;
+
 	/*% outer socket is for 'wrapped' sockets - e.g. tcpdns in tcp */
 	isc_nmsocket_t *outer;
 
@@ -490,6 +724,28 @@ struct isc_nmsocket {
 	uv_os_sock_t fd;
 	union uv_any_handle uv_handle;
 
+#ifdef HAVE_RECVMMSG
+	/*%
+	 * Listening UDP sockets are read with recvmmsg() through a
+	 * duplicate of 'fd', watched by 'recvpoll'; the original
+	 * descriptor is left to 'uv_handle' for sending.
+	 */
+	bool recvmmsg;
+	uv_os_sock_t recvfd;
+	uv_poll_t recvpoll;
+#endif
+
+#ifdef HAVE_LIBURING
+	/*%
+	 * Listening UDP sockets read with an io_uring multishot receive
+	 * instead; 'uring_armed' is set while the receive is queued and
+	 * 'uring_cancel' while it is being cancelled.
+	 */
+	bool uring;
+	bool uring_armed;
+	bool uring_cancel;
+#endif
+
 	/*% Peer address */
 	isc_sockaddr_t peer;
 
@@ -497,6 +753,13 @@ struct isc_nmsocket {
 	/*% Number of running (e.g. listening) child sockets */
 	atomic_int_fast32_t rchildren;
 
+	/*%
+	 * Number of datagrams received by a listening UDP child socket,
+	 * or connections accepted by a listening TCP child socket; only
+	 * written from the socket's own thread.
+	 */
+	atomic_uint_fast64_t nreceived;
+
 	/*%
 	 * Socket is active if it's listening, working, etc. If it's
 	 * closing, then it doesn't make a sense, for example, to
@@ -560,7 +823,13 @@ struct isc_nmsocket {
 	 * for UDP.
 	 */
 	isc_astack_t *inactivehandles;
-	isc_astack_t *inactivereqs;
+
+	/*%
+	 * Handles kept for reuse by the thread the socket belongs to,
+	 * which needs no locking; other threads use 'inactivehandles'.
+	 */
+	isc_nmhandle_t *freehandles;
+	size_t nfreehandles;
 
 	/*%
 	 * Used to wait for TCP listening events to complete, and
@@ -606,6 +875,20 @@ struct isc_nmsocket {
 	size_t buf_len;
 	unsigned char *buf;
 
+	/*%
+	 * TCPDNS output: the batch of responses waiting to be written
+	 * at the end of the loop iteration, and the number of batches
+	 * that have been sent but not completed.  'pipeline' is the
+	 * current limit on the number of messages processed at once;
+	 * it is lowered while writes are backing up, and raised
+	 * again towards 'pipeline_max' as they complete.  All of
+	 * these are only used by the socket's thread.
+	 */
+	isc__nm_tcpdnsbatch_t *dnsbatch;
+	uint32_t dnswrites;
+	uint32_t pipeline;
+	uint32_t pipeline_max;
+
 	/*%
 	 * This function will be called with handle->sock
 	 * as the argument whenever a handle's references drop
@@ -660,12 +943,92 @@ isc__nm_free_uvbuf(isc_nmsocket_t *sock, const uv_buf_t *buf);
  * as "not in use".
  */
 
+#ifdef HAVE_RECVMMSG
+isc__nm_recvslot_t *
+isc__nm_recvslot_get(isc__networker_t *worker, size_t size);
+/*%<
+ * Get a receive slot of at least 'size' bytes from 'worker'.  Slots
+ * of up to ISC_NETMGR_RECVSLOT_SIZE bytes come from the preallocated
+ * pool while it lasts, anything else is allocated.
+ */
+
+void
+isc__nm_recvslot_put(isc__networker_t *worker, isc__nm_recvslot_t **slotp);
+/*%<
+ * Return a receive slot to 'worker'.  Must be called from the worker's
+ * thread.
+ */
+
+void
+isc__nm_udp_deliver(isc_nmsocket_t *sock, isc__nm_recvslot_t *slot,
+		    size_t len, const struct sockaddr *addr);
+/*%<
+ * Deliver 'len' bytes of data received from 'addr' into 'slot' to the
+ * receive callback of the listening UDP socket 'sock'.  The slot is
+ * returned to the worker when the handle passed to the callback is
+ * released.
+ */
+#endif /* HAVE_RECVMMSG */
+
+#ifdef HAVE_LIBURING
+bool
+isc__nm_uring_udplisten(isc__networker_t *worker, isc_nmsocket_t *sock);
+/*%<
+ * Start receiving on the listening UDP socket 'sock' through the
+ * worker's io_uring instance, setting it up first if necessary.
+ * Returns false if io_uring cannot be used, in which case the caller
+ * has to fall back to libuv.
+ */
+
+void
+isc__nm_uring_udpstop(isc_nmsocket_t *sock);
+/*%<
+ * Cancel the io_uring receive on 'sock'.  isc__nm_udp_recvstopped() is
+ * called once the kernel is done with the socket.
+ */
+
+isc_result_t
+isc__nm_uring_udpsend(isc_nmsocket_t *sock, isc__nm_uvreq_t *req,
+		      isc_sockaddr_t *peer);
+/*%<
+ * Queue 'req' to be sent to 'peer' from 'sock' through io_uring.  The
+ * queued messages are submitted at the end of the loop iteration.
+ */
+
+void
+isc__nm_uring_putbuf(isc__networker_t *worker, isc__nm_recvslot_t *slot);
+/*%<
+ * Give the provided buffer underlying 'slot' back to the kernel.
+ */
+
+void
+isc__nm_uring_shutdown(isc__networker_t *worker);
+/*%<
+ * Wait for outstanding sends and close the libuv handles used to drive
+ * the worker's io_uring instance.  Called when the worker is stopping.
+ */
+
+void
+isc__nm_uring_destroy(isc__networker_t *worker);
+/*%<
+ * Free the worker's io_uring instance.
+ */
+
+void
+isc__nm_udp_recvstopped(isc_nmsocket_t *sock);
+/*%<
+ * Finish closing the listening UDP socket 'sock' after its io_uring
+ * receive has ended.
+ */
+#endif /* HAVE_LIBURING */
+
 isc_nmhandle_t *
 isc__nmhandle_get(isc_nmsocket_t *sock, isc_sockaddr_t *peer,
 		  isc_sockaddr_t *local);
 /*%<
  * Get a handle for the socket 'sock', allocating a new one
- * if there isn't one available in 'sock->inactivehandles'.
+ * if there isn't one available in 'sock->freehandles' (when called
+ * from the socket's own thread) or 'sock->inactivehandles'.
  *
  * If 'peer' is not NULL, set the handle's peer address to 'peer',
  * otherwise set it to 'sock->peer'.
@@ -680,8 +1043,9 @@ isc__nmhandle_get(isc_nmsocket_t *sock, isc_sockaddr_t *peer,
 isc__nm_uvreq_t *
 isc__nm_uvreq_get(isc_nm_t *mgr, isc_nmsocket_t *sock);
 /*%<
- * Get a UV request structure for the socket 'sock', allocating a
- * new one if there isn't one available in 'sock->inactivereqs'.
+ * Get a UV request structure for the socket 'sock', taking it from
+ * the calling worker's free list if called from one of 'mgr's network
+ * threads, or from 'mgr->reqpool' otherwise.
  */
 
 void
@@ -689,8 +1053,9 @@ isc__nm_uvreq_put(isc__nm_uvreq_t **req, isc_nmsocket_t *sock);
 /*%<
  * Completes the use of a UV request structure, setting '*req' to NULL.
  *
- * The UV request is pushed onto the 'sock->inactivereqs' stack or,
- * if that doesn't work, freed.
+ * The UV request is pushed onto the calling worker's free list or,
+ * if not called from a network thread, returned to 'mgr->reqpool'.
+ * If it is 'sock->timedoutreq', it is kept until 'sock' is destroyed.
  */
 
 void
@@ -803,6 +1168,14 @@ isc__nm_udp_settimeout(isc_nmhandle_t *handle, uint32_t timeout);
  * Set the recv timeout for the UDP socket associated with 'handle'.
  */
 
+void
+isc__nm_udp_sendbatch_flush(isc__networker_t *worker);
+/*%<
+ * Write out all UDP messages queued in the transmit batch of 'worker'
+ * and invoke their send callbacks.  Must be called from the worker's
+ * thread.
+ */
+
 void
 isc__nm_async_udplisten(isc__networker_t *worker, isc__netievent_t *ev0);
 void
@@ -932,6 +1305,14 @@ isc__nm_tcpdns_send(isc_nmhandle_t *handle, isc_region_t *region,
  * Back-end implementation of isc_nm_send() for TCPDNS handles.
  */
 
+void
+isc__nm_tcpdns_flush(isc__networker_t *worker);
+/*%<
+ * Write out the batches of DNS messages queued on the TCPDNS sockets
+ * of 'worker', one send per socket.  Must be called from the worker's
+ * thread.
+ */
+
 void
 isc__nm_tcpdns_close(isc_nmsocket_t *sock);
 /*%<
@@ -1049,6 +1430,12 @@ isc__nm_socket(int domain, int type, int protocol, uv_os_sock_t *sockp);
  * Platform independent socket() version
  */
 
+void
+isc__nm_closesocket(uv_os_sock_t sock);
+/*%<
+ * Platform independent closesocket() version
+ */
+
 isc_result_t
 isc__nm_socket_freebind(uv_os_sock_t fd, sa_family_t sa_family);
 /*%<
@@ -1068,9 +1455,26 @@ isc__nm_socket_reuse_lb(uv_os_sock_t fd);
  */
 
 isc_result_t
-isc__nm_socket_incoming_cpu(uv_os_sock_t fd);
+isc__nm_socket_incoming_cpu(uv_os_sock_t fd, int cpu);
+/*%<
+ * Set the SO_INCOMING_CPU socket option on the fd to 'cpu' if available;
+ * -1 leaves the choice to the kernel.
+ */
+
+isc_result_t
+isc__nm_socket_steering(uv_os_sock_t fd, isc_nm_steering_t steering,
+			uint32_t nchildren);
+/*%<
+ * Attach a SO_ATTACH_REUSEPORT_CBPF program selecting one of 'nchildren'
+ * sockets in the SO_REUSEPORT group of fd according to 'steering', if
+ * available.
+ */
+
+int
+isc__nm_worker_cpu(isc_nm_t *mgr, int tid);
 /*%<
- * Set the SO_INCOMING_CPU socket option on the fd if available
+ * Return the CPU network thread 'tid' is pinned to, or -1 if CPU
+ * affinity is not enabled.
  */
 
 isc_result_t
@@ -12,14 +12,19 @@
 #include <inttypes.h>
 #include <unistd.h>
 #include <uv.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif /* ifdef __linux__ */
 
 #include <isc/atomic.h>
 #include <isc/buffer.h>
 #include <isc/condition.h>
 #include <isc/errno.h>
+#include <isc/log.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
 #include <isc/netmgr.h>
+#include <isc/os.h>
 #include <isc/print.h>
 #include <isc/quota.h>
 #include <isc/random.h>
@@ -40,11 +45,23 @@
 #endif
 
 /*%
- * How many isc_nmhandles and isc_nm_uvreqs will we be
- * caching for reuse in a socket.
+ * How many isc_nmhandles will we be caching for reuse in a socket.
  */
 #define ISC_NM_HANDLES_STACK_SIZE 600
-#define ISC_NM_REQS_STACK_SIZE	  600
+
+/*%
+ * How many isc__nm_uvreqs and ievents each worker keeps for reuse;
+ * when a free list reaches this size, half of it is returned to the
+ * shared memory pool.
+ */
+#define ISC_NM_WORKER_REQS_CACHE   1024
+#define ISC_NM_WORKER_EVENTS_CACHE 1024
+
+/*%
+ * How many allocation events a worker counts before adding them
+ * to the socket statistics.
+ */
+#define ISC_NM_ALLOCSTATS_FLUSH 64
 
 /*%
  * Shortcut index arrays to get access to statistics counters.
@@ -61,7 +78,9 @@ static const isc_statscounter_t udp4statsindex[] = {
 	-1,
 	isc_sockstatscounter_udp4sendfail,
 	isc_sockstatscounter_udp4recvfail,
-	isc_sockstatscounter_udp4active
+	isc_sockstatscounter_udp4active,
+	isc_sockstatscounter_udp4sendbatch,
+	isc_sockstatscounter_udp4sendbatchmsg
 };
 
 static const isc_statscounter_t udp6statsindex[] = {
@@ -75,7 +94,9 @@ static const isc_statscounter_t udp6statsindex[] = {
 	-1,
 	isc_sockstatscounter_udp6sendfail,
 	isc_sockstatscounter_udp6recvfail,
-	isc_sockstatscounter_udp6active
+	isc_sockstatscounter_udp6active,
+	isc_sockstatscounter_udp6sendbatch,
+	isc_sockstatscounter_udp6sendbatchmsg
 };
 
 static const isc_statscounter_t tcp4statsindex[] = {
@@ -84,7 +105,8 @@ static const isc_statscounter_t tcp4statsindex[] = {
 	isc_sockstatscounter_tcp4connectfail, isc_sockstatscounter_tcp4connect,
 	isc_sockstatscounter_tcp4acceptfail,  isc_sockstatscounter_tcp4accept,
 	isc_sockstatscounter_tcp4sendfail,    isc_sockstatscounter_tcp4recvfail,
-	isc_sockstatscounter_tcp4active
+	isc_sockstatscounter_tcp4active,	      -1,
+	-1
 };
 
 static const isc_statscounter_t tcp6statsindex[] = {
@@ -93,7 +115,8 @@ static const isc_statscounter_t tcp6statsindex[] = {
 	isc_sockstatscounter_tcp6connectfail, isc_sockstatscounter_tcp6connect,
 	isc_sockstatscounter_tcp6acceptfail,  isc_sockstatscounter_tcp6accept,
 	isc_sockstatscounter_tcp6sendfail,    isc_sockstatscounter_tcp6recvfail,
-	isc_sockstatscounter_tcp6active
+	isc_sockstatscounter_tcp6active,	      -1,
+	-1
 };
 
 #if 0
@@ -123,6 +146,7 @@ static const isc_statscounter_t unixstatsindex[] = {
  */
 
 static thread_local int isc__nm_tid_v = ISC_NETMGR_TID_UNKNOWN;
+static thread_local isc__networker_t *isc__nm_worker_v = NULL;
 
 static void
 nmsocket_maybe_destroy(isc_nmsocket_t *sock);
@@ -133,7 +157,7 @@ nm_thread(isc_threadarg_t worker0);
 static void
 async_cb(uv_async_t *handle);
 static bool
-process_queue(isc__networker_t *worker, isc_queue_t *queue);
+process_queue(isc__networker_t *worker, isc__nm_evqueue_t *queue);
 static bool
 process_priority_queue(isc__networker_t *worker);
 static bool
@@ -146,12 +170,20 @@ isc__nm_async_stopcb(isc__networker_t *worker, isc__netievent_t *ev0);
 static void
 isc__nm_async_pausecb(isc__networker_t *worker, isc__netievent_t *ev0);
 static void
+isc__nm_async_affinitycb(isc__networker_t *worker, isc__netievent_t *ev0);
+static void
 isc__nm_async_resumecb(isc__networker_t *worker, isc__netievent_t *ev0);
 static void
 isc__nm_async_detach(isc__networker_t *worker, isc__netievent_t *ev0);
 
 static void
 nmhandle_detach_cb(isc_nmhandle_t **handlep);
+static void
+tcpdns_check_cb(uv_check_t *handle);
+#ifdef HAVE_SENDMMSG
+static void
+sendbatch_check_cb(uv_check_t *handle);
+#endif
 
 int
 isc_nm_tid(void) {
@@ -163,6 +195,95 @@ isc__nm_in_netthread(void) {
 	return (isc__nm_tid_v >= 0);
 }
 
+/*
+ * Return the worker running in the current thread if it belongs
+ * to 'mgr', NULL otherwise.
+ */
+static isc__networker_t *
+current_worker(isc_nm_t *mgr) {
+	isc__networker_t *worker = isc__nm_worker_v;
+
+	if (worker != NULL && worker->mgr == mgr) {
+		return (worker);
+	}
+
+	return (NULL);
+}
+
+static void *
+freelist_get(isc__nm_freelist_t *list) {
+	isc__nm_freeobj_t *obj = list->head;
+
+	if (obj != NULL) {
+		list->head = obj->next;
+		list->count--;
+	}
+
+	return (obj);
+}
+
+static void
+freelist_put(isc__nm_freelist_t *list, void *ptr, size_t max,
+	     isc_mempool_t *pool) {
+	isc__nm_freeobj_t *obj = ptr;
+
+	if (list->count >= max) {
+		while (list->count > max / 2) {
+			void *old = freelist_get(list);
+			isc_mempool_put(pool, old);
+		}
+	}
+
+	obj->next = list->head;
+	list->head = obj;
+	list->count++;
+}
+
+static void
+freelist_drain(isc__nm_freelist_t *list, isc_mempool_t *pool) {
+	void *obj = NULL;
+
+	while ((obj = freelist_get(list)) != NULL) {
+		isc_mempool_put(pool, obj);
+	}
+}
+
+static void
+allocstats_flush(isc__networker_t *worker) {
+	isc_nm_t *mgr = worker->mgr;
+
+	for (int i = 0; i < isc__nm_allocstat_max; i++) {
+		if (mgr->stats != NULL && worker->allocstats[i] > 0) {
+			isc_stats_add(mgr->stats,
+				      isc_sockstatscounter_nmreqcached + i,
+				      worker->allocstats[i]);
+		}
+		worker->allocstats[i] = 0;
+	}
+	worker->allocpending = 0;
+}
+
+/*
+ * Count an allocation; workers batch their counts to keep the shared
+ * statistics counters off the fast path.
+ */
+static void
+allocstat(isc_nm_t *mgr, isc__networker_t *worker, isc__nm_allocstat_t stat) {
+	if (worker == NULL) {
+		if (mgr->stats != NULL) {
+			isc_stats_increment(mgr->stats,
+					    isc_sockstatscounter_nmreqcached +
+						    stat);
+		}
+		return;
+	}
+
+	worker->allocstats[stat]++;
+	if (++worker->allocpending >= ISC_NM_ALLOCSTATS_FLUSH) {
+		allocstats_flush(worker);
+	}
+}
+
 isc_nm_t *
 isc_nm_start(isc_mem_t *mctx, uint32_t workers) {
 	isc_nm_t *mgr = NULL;
@@ -179,6 +300,12 @@ isc_nm_start(isc_mem_t *mctx, uint32_t workers) {
 	isc_refcount_init(&mgr->references, 1);
 	atomic_init(&mgr->maxudp, 0);
 	atomic_init(&mgr->interlocked, false);
+	atomic_init(&mgr->sendbatch_size, 0);
+	atomic_init(&mgr->sendbatch_deadline, 0);
+	atomic_init(&mgr->tcpdns_pipeline, ISC_NETMGR_TCPDNS_PIPELINE);
+	atomic_init(&mgr->uring, false);
+	atomic_init(&mgr->affinity, true);
+	mgr->ncpus = isc_os_ncpus();
 
 #ifdef NETMGR_TRACE
 	ISC_LIST_INIT(mgr->active_sockets);
@@ -228,10 +355,58 @@ isc_nm_start(isc_mem_t *mctx, uint32_t workers) {
 		isc_mutex_init(&worker->lock);
 		isc_condition_init(&worker->cond);
 
-		worker->ievents = isc_queue_new(mgr->mctx, 128);
-		worker->ievents_prio = isc_queue_new(mgr->mctx, 128);
+		isc__nm_evqueue_init(&worker->ievents);
+		isc__nm_evqueue_init(&worker->ievents_prio);
+		atomic_init(&worker->ievents_signaled, false);
+		atomic_init(&worker->nievents, 0);
+		atomic_init(&worker->nwakeups, 0);
+		atomic_init(&worker->maxdepth, 0);
 		worker->recvbuf = isc_mem_get(mctx, ISC_NETMGR_RECVBUF_SIZE);
 
+		ISC_LIST_INIT(worker->tcpdnsbatches);
+		r = uv_check_init(&worker->loop, &worker->tcpdns_check);
+		RUNTIME_CHECK(r == 0);
+
+		r = uv_check_start(&worker->tcpdns_check, tcpdns_check_cb);
+		RUNTIME_CHECK(r == 0);
+
+		r = uv_idle_init(&worker->loop, &worker->tcpdns_idle);
+		RUNTIME_CHECK(r == 0);
+
+#ifdef HAVE_SENDMMSG
+		worker->sendbatch = isc_mem_get(mctx,
+						sizeof(*worker->sendbatch));
+		worker->sendbatch->count = 0;
+
+		r = uv_check_init(&worker->loop, &worker->sendbatch_check);
+		RUNTIME_CHECK(r == 0);
+
+		r = uv_check_start(&worker->sendbatch_check,
+				   sendbatch_check_cb);
+		RUNTIME_CHECK(r == 0);
+#endif
+
+#ifdef HAVE_RECVMMSG
+		worker->recvslots = isc_mem_get(
+			mctx, ISC_NETMGR_RECVSLOTS * sizeof(worker->recvslots[0]));
+		worker->recvslotbuf = isc_mem_get(
+			mctx, ISC_NETMGR_RECVSLOTS * ISC_NETMGR_RECVSLOT_SIZE);
+		worker->recvslot_free = NULL;
+		worker->recvslot_extra = 0;
+		for (size_t j = 0; j < ISC_NETMGR_RECVSLOTS; j++) {
+			isc__nm_recvslot_t *slot = &worker->recvslots[j];
+
+			*slot = (isc__nm_recvslot_t){
+				.next = worker->recvslot_free,
+				.base = worker->recvslotbuf +
+					j * ISC_NETMGR_RECVSLOT_SIZE,
+				.size = ISC_NETMGR_RECVSLOT_SIZE,
+				.preallocated = true
+			};
+			worker->recvslot_free = slot;
+		}
+#endif
+
 		/*
 		 * We need to do this here and not in nm_thread to avoid a
 		 * race - we could exit isc_nm_start, launch nm_destroy,
@@ -278,33 +453,48 @@ nm_destroy(isc_nm_t **mgr0) {
 
 	for (size_t i = 0; i < mgr->nworkers; i++) {
 		isc__networker_t *worker = &mgr->workers[i];
-		isc__netievent_t *ievent = NULL;
+		isc__nm_evlink_t *link = NULL;
 		int r;
 
 		/* Empty the async event queues */
-		while ((ievent = (isc__netievent_t *)isc_queue_dequeue(
-				worker->ievents)) != NULL)
-		{
-			isc_mempool_put(mgr->evpool, ievent);
+		while ((link = isc__nm_evqueue_pop(&worker->ievents)) != NULL) {
+			isc_mempool_put(mgr->evpool, link);
 		}
 
-		while ((ievent = (isc__netievent_t *)isc_queue_dequeue(
-				worker->ievents_prio)) != NULL)
-		{
-			isc_mempool_put(mgr->evpool, ievent);
+		while ((link = isc__nm_evqueue_pop(&worker->ievents_prio)) !=
+		       NULL) {
+			isc_mempool_put(mgr->evpool, link);
 		}
 
 		r = uv_loop_close(&worker->loop);
 		INSIST(r == 0);
 
-		isc_queue_destroy(worker->ievents);
-		isc_queue_destroy(worker->ievents_prio);
 		isc_mutex_destroy(&worker->lock);
 		isc_condition_destroy(&worker->cond);
 
 		isc_mem_put(mgr->mctx, worker->recvbuf,
 			    ISC_NETMGR_RECVBUF_SIZE);
+		INSIST(ISC_LIST_EMPTY(worker->tcpdnsbatches));
+#ifdef HAVE_SENDMMSG
+		INSIST(worker->sendbatch->count == 0);
+		isc_mem_put(mgr->mctx, worker->sendbatch,
+			    sizeof(*worker->sendbatch));
+#endif
+#ifdef HAVE_LIBURING
+		isc__nm_uring_destroy(worker);
+#endif
+#ifdef HAVE_RECVMMSG
+		INSIST(worker->recvslot_extra == 0);
+		isc_mem_put(mgr->mctx, worker->recvslotbuf,
+			    ISC_NETMGR_RECVSLOTS * ISC_NETMGR_RECVSLOT_SIZE);
+		isc_mem_put(mgr->mctx, worker->recvslots,
+			    ISC_NETMGR_RECVSLOTS *
+				    sizeof(worker->recvslots[0]));
+#endif
 		isc_thread_join(worker->thread, NULL);
+
+		freelist_drain(&worker->freeevents, mgr->evpool);
+		freelist_drain(&worker->freereqs, mgr->reqpool);
 	}
 
 	if (mgr->stats != NULL) {
@@ -451,6 +641,91 @@ isc_nm_maxudp(isc_nm_t *mgr, uint32_t maxudp) {
 	atomic_store(&mgr->maxudp, maxudp);
 }
 
+void
+isc_nm_udp_setbatch(isc_nm_t *mgr, uint32_t size, uint32_t deadline) {
+	REQUIRE(VALID_NM(mgr));
+
+	if (size > ISC_NETMGR_SENDBATCH_MAX) {
+		size = ISC_NETMGR_SENDBATCH_MAX;
+	}
+
+	atomic_store(&mgr->sendbatch_size, size);
+	atomic_store(&mgr->sendbatch_deadline, deadline);
+}
+
+void
+isc_nm_tcpdns_setpipeline(isc_nm_t *mgr, uint32_t limit) {
+	REQUIRE(VALID_NM(mgr));
+
+	if (limit == 0) {
+		limit = 1;
+	}
+
+	atomic_store(&mgr->tcpdns_pipeline, limit);
+}
+
+void
+isc_nm_udp_setiouring(isc_nm_t *mgr, bool enable) {
+	REQUIRE(VALID_NM(mgr));
+
+#ifdef HAVE_LIBURING
+	atomic_store(&mgr->uring, enable);
+#else
+	UNUSED(enable);
+#endif
+}
+
+void
+isc_nm_setaffinity(isc_nm_t *mgr, bool enable) {
+	REQUIRE(VALID_NM(mgr));
+
+	if (atomic_exchange(&mgr->affinity, enable) == enable) {
+		return;
+	}
+
+	for (size_t i = 0; i < mgr->nworkers; i++) {
+		isc__networker_t *worker = &mgr->workers[i];
+		isc__netievent_t *event =
+			isc__nm_get_ievent(mgr, netievent_affinity);
+		isc__nm_enqueue_ievent(worker, event);
+	}
+}
+
+void
+isc_nm_queuestats(isc_nm_t *mgr, uint64_t *eventsp, uint64_t *wakeupsp,
+		  uint32_t *maxdepthp) {
+	uint64_t events = 0, wakeups = 0;
+	uint32_t maxdepth = 0;
+
+	REQUIRE(VALID_NM(mgr));
+	REQUIRE(eventsp != NULL && wakeupsp != NULL && maxdepthp != NULL);
+
+	for (size_t i = 0; i < mgr->nworkers; i++) {
+		isc__networker_t *worker = &mgr->workers[i];
+		uint32_t depth = atomic_load_relaxed(&worker->maxdepth);
+
+		events += atomic_load_relaxed(&worker->nievents);
+		wakeups += atomic_load_relaxed(&worker->nwakeups);
+		maxdepth = ISC_MAX(maxdepth, depth);
+	}
+
+	*eventsp = events;
+	*wakeupsp = wakeups;
+	*maxdepthp = maxdepth;
+}
+
+int
+isc__nm_worker_cpu(isc_nm_t *mgr, int tid) {
+	REQUIRE(VALID_NM(mgr));
+	REQUIRE(tid >= 0 && (uint32_t)tid < mgr->nworkers);
+
+	if (!atomic_load(&mgr->affinity)) {
+		return (-1);
+	}
+
+	return (tid % mgr->ncpus);
+}
+
 void
 isc_nm_tcp_settimeouts(isc_nm_t *mgr, uint32_t init, uint32_t idle,
 		       uint32_t keepalive, uint32_t advertised) {
@@ -488,13 +763,35 @@ isc_nm_tcp_gettimeouts(isc_nm_t *mgr, uint32_t *initial, uint32_t *idle,
  * nm_thread is a single worker thread, that runs uv_run event loop
  * until asked to stop.
  */
+/*
+ * Pin the current network thread to its CPU, or let it run on any CPU
+ * again, depending on the manager's affinity setting.
+ */
+static void
+nm_setaffinity(isc__networker_t *worker) {
+	bool pin = atomic_load(&worker->mgr->affinity);
+	isc_result_t result;
+
+	result = isc_thread_setaffinity(pin ? worker->id % worker->mgr->ncpus
+					    : -1);
+	if (result != ISC_R_SUCCESS) {
+		isc_log_write(isc_lctx, ISC_LOGCATEGORY_GENERAL,
+			      ISC_LOGMODULE_NETMGR, ISC_LOG_WARNING,
+			      "unable to %s network thread %d",
+			      pin ? "pin" : "unpin", worker->id);
+	}
+}
+
 static isc_threadresult_t
 nm_thread(isc_threadarg_t worker0) {
 	isc__networker_t *worker = (isc__networker_t *)worker0;
 	isc_nm_t *mgr = worker->mgr;
 
 	isc__nm_tid_v = worker->id;
-	isc_thread_setaffinity(isc__nm_tid_v);
+	isc__nm_worker_v = worker;
+	if (atomic_load(&mgr->affinity)) {
+		nm_setaffinity(worker);
+	}
 
 	while (true) {
 		int r = uv_run(&worker->loop, UV_RUN_DEFAULT);
@@ -540,6 +837,8 @@ nm_thread(isc_threadarg_t worker0) {
 		process_queues(worker);
 	}
 
+	allocstats_flush(worker);
+
 	LOCK(&mgr->lock);
 	mgr->workers_running--;
 	SIGNAL(&mgr->wkstatecond);
@@ -553,17 +852,64 @@ nm_thread(isc_threadarg_t worker0) {
  * It's the only way to safely pass data to the libuv event loop. We use a
  * single async event and a lockless queue of 'isc__netievent_t' structures
  * passed from other threads.
+ *
+ * 'ievents_signaled' is cleared before the queues are emptied, so that
+ * any event enqueued from now on, including one whose push was still in
+ * progress when it was missed below, sends a new wakeup.
  */
 static void
 async_cb(uv_async_t *handle) {
 	isc__networker_t *worker = (isc__networker_t *)handle->loop->data;
+	atomic_store(&worker->ievents_signaled, false);
 	process_queues(worker);
 }
 
+/*
+ * tcpdns_check_cb runs right after the I/O callbacks of every loop
+ * iteration, so DNS responses that became ready on the same TCP
+ * connection during the iteration are written together.
+ */
+static void
+tcpdns_check_cb(uv_check_t *handle) {
+	isc__networker_t *worker = (isc__networker_t *)handle->loop->data;
+
+	if (!ISC_LIST_EMPTY(worker->tcpdnsbatches)) {
+		isc__nm_tcpdns_flush(worker);
+	}
+}
+
+#ifdef HAVE_SENDMMSG
+/*
+ * sendbatch_check_cb runs right after the I/O callbacks of every loop
+ * iteration, so anything queued for transmission while processing
+ * incoming packets or async events is written before the loop blocks
+ * again.
+ */
+static void
+sendbatch_check_cb(uv_check_t *handle) {
+	isc__networker_t *worker = (isc__networker_t *)handle->loop->data;
+
+	if (worker->sendbatch->count > 0) {
+		isc__nm_udp_sendbatch_flush(worker);
+	}
+}
+#endif
+
 static void
 isc__nm_async_stopcb(isc__networker_t *worker, isc__netievent_t *ev0) {
 	UNUSED(ev0);
 	worker->finished = true;
+	isc__nm_tcpdns_flush(worker);
+	uv_close((uv_handle_t *)&worker->tcpdns_check, NULL);
+	uv_close((uv_handle_t *)&worker->tcpdns_idle, NULL);
+#ifdef HAVE_SENDMMSG
+	/* Push out anything still pending and close the batch handler */
+	isc__nm_udp_sendbatch_flush(worker);
+	uv_close((uv_handle_t *)&worker->sendbatch_check, NULL);
+#endif
+#ifdef HAVE_LIBURING
+	isc__nm_uring_shutdown(worker);
+#endif
 	/* Close the async handler */
 	uv_close((uv_handle_t *)&worker->async, NULL);
 	/* uv_stop(&worker->loop); */
@@ -577,6 +923,13 @@ isc__nm_async_pausecb(isc__networker_t *worker, isc__netievent_t *ev0) {
 	uv_stop(&worker->loop);
 }
 
+static void
+isc__nm_async_affinitycb(isc__networker_t *worker, isc__netievent_t *ev0) {
+	UNUSED(ev0);
+
+	nm_setaffinity(worker);
+}
+
 static void
 isc__nm_async_resumecb(isc__networker_t *worker, isc__netievent_t *ev0) {
 	UNUSED(ev0);
@@ -586,12 +939,12 @@ isc__nm_async_resumecb(isc__networker_t *worker, isc__netievent_t *ev0) {
 
 static bool
 process_priority_queue(isc__networker_t *worker) {
-	return (process_queue(worker, worker->ievents_prio));
+	return (process_queue(worker, &worker->ievents_prio));
 }
 
 static bool
 process_normal_queue(isc__networker_t *worker) {
-	return (process_queue(worker, worker->ievents));
+	return (process_queue(worker, &worker->ievents));
 }
 
 static void
@@ -603,12 +956,15 @@ process_queues(isc__networker_t *worker) {
 }
 
 static bool
-process_queue(isc__networker_t *worker, isc_queue_t *queue) {
-	isc__netievent_t *ievent = NULL;
+process_queue(isc__networker_t *worker, isc__nm_evqueue_t *queue) {
+	isc__nm_evlink_t *link = NULL;
+	uint_fast32_t n = 0;
 	bool more = true;
 
-	while ((ievent = (isc__netievent_t *)isc_queue_dequeue(queue)) != NULL)
-	{
+	while ((link = isc__nm_evqueue_pop(queue)) != NULL) {
+		isc__netievent_t *ievent = (isc__netievent_t *)link;
+
+		n++;
 		switch (ievent->type) {
 		case netievent_stop:
 			isc__nm_async_stopcb(worker, ievent);
@@ -718,6 +1074,9 @@ process_queue(isc__networker_t *worker, isc_queue_t *queue) {
 			/* Don't process more ievents when we are pausing */
 			more = false;
 			break;
+		case netievent_affinity:
+			isc__nm_async_affinitycb(worker, ievent);
+			break;
 		default:
 			INSIST(0);
 			ISC_UNREACHABLE();
@@ -728,12 +1087,32 @@ process_queue(isc__networker_t *worker, isc_queue_t *queue) {
 			break;
 		}
 	}
+
+	/* Only this thread writes the counters */
+	if (n > 0) {
+		atomic_fetch_add_relaxed(&worker->nievents, n);
+		if (n > atomic_load_relaxed(&worker->maxdepth)) {
+			atomic_store_relaxed(&worker->maxdepth, n);
+		}
+	}
+
 	return (more);
 }
 
 void *
 isc__nm_get_ievent(isc_nm_t *mgr, isc__netievent_type type) {
-	isc__netievent_storage_t *event = isc_mempool_get(mgr->evpool);
+	isc__networker_t *worker = current_worker(mgr);
+	isc__netievent_storage_t *event = NULL;
+
+	if (worker != NULL) {
+		event = freelist_get(&worker->freeevents);
+	}
+	if (event != NULL) {
+		allocstat(mgr, worker, isc__nm_allocstat_eventcached);
+	} else {
+		event = isc_mempool_get(mgr->evpool);
+		allocstat(mgr, worker, isc__nm_allocstat_eventalloc);
+	}
 
 	*event = (isc__netievent_storage_t){ .ni.type = type };
 	return (event);
@@ -741,7 +1120,14 @@ isc__nm_get_ievent(isc_nm_t *mgr, isc__netievent_type type) {
 
 void
 isc__nm_put_ievent(isc_nm_t *mgr, void *ievent) {
-	isc_mempool_put(mgr->evpool, ievent);
+	isc__networker_t *worker = current_worker(mgr);
+
+	if (worker != NULL) {
+		freelist_put(&worker->freeevents, ievent,
+			     ISC_NM_WORKER_EVENTS_CACHE, mgr->evpool);
+	} else {
+		isc_mempool_put(mgr->evpool, ievent);
+	}
 }
 
 void
@@ -752,13 +1138,81 @@ isc__nm_enqueue_ievent(isc__networker_t *worker, isc__netievent_t *event) {
 		 * the queue will be processed.
 		 */
 		LOCK(&worker->lock);
-		isc_queue_enqueue(worker->ievents_prio, (uintptr_t)event);
+		isc__nm_evqueue_push(&worker->ievents_prio, &event->link);
 		SIGNAL(&worker->cond);
 		UNLOCK(&worker->lock);
 	} else {
-		isc_queue_enqueue(worker->ievents, (uintptr_t)event);
+		isc__nm_evqueue_push(&worker->ievents, &event->link);
 	}
-	uv_async_send(&worker->async);
+
+	/*
+	 * Wake the worker up, unless a wakeup is already pending: async_cb
+	 * clears the flag before it empties the queues, so it will find
+	 * this event.  The plain load spares the cache line an exclusive
+	 * access while the worker is busy.
+	 */
+	if (!atomic_load(&worker->ievents_signaled) &&
+	    !atomic_exchange(&worker->ievents_signaled, true))
+	{
+		atomic_fetch_add_relaxed(&worker->nwakeups, 1);
+		uv_async_send(&worker->async);
+	}
+}
+
+void
+isc__nm_evqueue_init(isc__nm_evqueue_t *queue) {
+	atomic_init(&queue->stub.next, 0);
+	atomic_init(&queue->head, (uintptr_t)&queue->stub);
+	queue->tail = &queue->stub;
+}
+
+void
+isc__nm_evqueue_push(isc__nm_evqueue_t *queue, isc__nm_evlink_t *link) {
+	isc__nm_evlink_t *prev = NULL;
+
+	atomic_store_relaxed(&link->next, 0);
+	prev = (isc__nm_evlink_t *)atomic_exchange(&queue->head,
+						   (uintptr_t)link);
+	atomic_store(&prev->next, (uintptr_t)link);
+}
+
+isc__nm_evlink_t *
+isc__nm_evqueue_pop(isc__nm_evqueue_t *queue) {
+	isc__nm_evlink_t *tail = queue->tail;
+	isc__nm_evlink_t *next =
+		(isc__nm_evlink_t *)atomic_load_acquire(&tail->next);
+
+	if (tail == &queue->stub) {
+		if (next == NULL) {
+			return (NULL);
+		}
+		queue->tail = next;
+		tail = next;
+		next = (isc__nm_evlink_t *)atomic_load_acquire(&tail->next);
+	}
+
+	if (next != NULL) {
+		queue->tail = next;
+		return (tail);
+	}
+
+	if (tail != (isc__nm_evlink_t *)atomic_load(&queue->head)) {
+		/* A push is in progress */
+		return (NULL);
+	}
+
+	/*
+	 * 'tail' is the last link; put the stub behind it so that it can
+	 * be unlinked.
+	 */
+	isc__nm_evqueue_push(queue, &queue->stub);
+	next = (isc__nm_evlink_t *)atomic_load_acquire(&tail->next);
+	if (next != NULL) {
+		queue->tail = next;
+		return (tail);
+	}
+
+	return (NULL);
 }
 
 bool
@@ -805,7 +1259,6 @@ isc__nmsocket_attach(isc_nmsocket_t *sock, isc_nmsocket_t **target) {
 static void
 nmsocket_cleanup(isc_nmsocket_t *sock, bool dofree) {
 	isc_nmhandle_t *handle = NULL;
-	isc__nm_uvreq_t *uvreq = NULL;
 
 	REQUIRE(VALID_NMSOCK(sock));
 	REQUIRE(!isc__nmsocket_active(sock));
@@ -845,6 +1298,12 @@ nmsocket_cleanup(isc_nmsocket_t *sock, bool dofree) {
 		isc__nmsocket_detach(&sock->outer);
 	}
 
+	while ((handle = sock->freehandles) != NULL) {
+		sock->freehandles = handle->nextfree;
+		nmhandle_free(sock, handle);
+	}
+	sock->nfreehandles = 0;
+
 	while ((handle = isc_astack_pop(sock->inactivehandles)) != NULL) {
 		nmhandle_free(sock, handle);
 	}
@@ -853,6 +1312,13 @@ nmsocket_cleanup(isc_nmsocket_t *sock, bool dofree) {
 		isc_mem_free(sock->mgr->mctx, sock->buf);
 	}
 
+	if (sock->timedoutreq != NULL) {
+		isc_mempool_put(sock->mgr->reqpool, sock->timedoutreq);
+		sock->timedoutreq = NULL;
+	}
+
+	INSIST(sock->dnsbatch == NULL);
+
 	if (sock->quota != NULL) {
 		isc_quota_detach(&sock->quota);
 	}
@@ -869,12 +1335,6 @@ nmsocket_cleanup(isc_nmsocket_t *sock, bool dofree) {
 	}
 
 	isc_astack_destroy(sock->inactivehandles);
-
-	while ((uvreq = isc_astack_pop(sock->inactivereqs)) != NULL) {
-		isc_mempool_put(sock->mgr->reqpool, uvreq);
-	}
-
-	isc_astack_destroy(sock->inactivereqs);
 	sock->magic = 0;
 
 	isc_mem_free(sock->mgr->mctx, sock->ah_frees);
@@ -1045,9 +1505,7 @@ isc__nmsocket_init(isc_nmsocket_t *sock, isc_nm_t *mgr, isc_nmsocket_type type,
 				  .fd = -1,
 				  .ah_size = 32,
 				  .inactivehandles = isc_astack_new(
-					  mgr->mctx, ISC_NM_HANDLES_STACK_SIZE),
-				  .inactivereqs = isc_astack_new(
-					  mgr->mctx, ISC_NM_REQS_STACK_SIZE) };
+					  mgr->mctx, ISC_NM_HANDLES_STACK_SIZE) };
 
 #ifdef NETMGR_TRACE
 	sock->backtrace_size = backtrace(sock->backtrace, TRACE_SIZE);
@@ -1104,6 +1562,7 @@ isc__nmsocket_init(isc_nmsocket_t *sock, isc_nm_t *mgr, isc_nmsocket_type type,
 	atomic_init(&sock->processing, false);
 	atomic_init(&sock->readpaused, false);
 	atomic_init(&sock->closing, false);
+	atomic_init(&sock->nreceived, 0);
 
 	sock->magic = NMSOCK_MAGIC;
 }
@@ -1143,6 +1602,63 @@ isc__nm_free_uvbuf(isc_nmsocket_t *sock, const uv_buf_t *buf) {
 	worker->recvbuf_inuse = false;
 }
 
+#ifdef HAVE_RECVMMSG
+isc__nm_recvslot_t *
+isc__nm_recvslot_get(isc__networker_t *worker, size_t size) {
+	isc__nm_recvslot_t *slot = NULL;
+
+	REQUIRE(worker->id == isc_nm_tid());
+
+	if (size <= ISC_NETMGR_RECVSLOT_SIZE && worker->recvslot_free != NULL)
+	{
+		slot = worker->recvslot_free;
+		worker->recvslot_free = slot->next;
+		slot->next = NULL;
+		return (slot);
+	}
+
+	if (size < ISC_NETMGR_RECVSLOT_SIZE) {
+		size = ISC_NETMGR_RECVSLOT_SIZE;
+	}
+
+	slot = isc_mem_get(worker->mgr->mctx, sizeof(*slot) + size);
+	*slot = (isc__nm_recvslot_t){ .base = (unsigned char *)(slot + 1),
+				      .size = size,
+				      .preallocated = false };
+	worker->recvslot_extra++;
+
+	return (slot);
+}
+
+void
+isc__nm_recvslot_put(isc__networker_t *worker, isc__nm_recvslot_t **slotp) {
+	isc__nm_recvslot_t *slot = NULL;
+
+	REQUIRE(worker->id == isc_nm_tid());
+	REQUIRE(slotp != NULL && *slotp != NULL);
+
+	slot = *slotp;
+	*slotp = NULL;
+
+#ifdef HAVE_LIBURING
+	if (slot->uring) {
+		isc__nm_uring_putbuf(worker, slot);
+		return;
+	}
+#endif
+
+	if (slot->preallocated) {
+		slot->next = worker->recvslot_free;
+		worker->recvslot_free = slot;
+	} else {
+		INSIST(worker->recvslot_extra > 0);
+		worker->recvslot_extra--;
+		isc_mem_put(worker->mgr->mctx, slot,
+			    sizeof(*slot) + slot->size);
+	}
+}
+#endif /* HAVE_RECVMMSG */
+
 static isc_nmhandle_t *
 alloc_handle(isc_nmsocket_t *sock) {
 	isc_nmhandle_t *handle =
@@ -1167,13 +1683,24 @@ isc__nmhandle_get(isc_nmsocket_t *sock, isc_sockaddr_t *peer,
 
 	REQUIRE(VALID_NMSOCK(sock));
 
-	handle = isc_astack_pop(sock->inactivehandles);
+	if (sock->tid == isc_nm_tid() && sock->freehandles != NULL) {
+		handle = sock->freehandles;
+		sock->freehandles = handle->nextfree;
+		sock->nfreehandles--;
+		handle->nextfree = NULL;
+	} else {
+		handle = isc_astack_pop(sock->inactivehandles);
+	}
 
 	if (handle == NULL) {
 		handle = alloc_handle(sock);
+		allocstat(sock->mgr, current_worker(sock->mgr),
+			  isc__nm_allocstat_handlealloc);
 	} else {
 		isc_refcount_init(&handle->references, 1);
 		INSIST(VALID_NMHANDLE(handle));
+		allocstat(sock->mgr, current_worker(sock->mgr),
+			  isc__nm_allocstat_handlecached);
 	}
 
 	isc__nmsocket_attach(sock, &handle->sock);
@@ -1301,7 +1828,14 @@ nmhandle_deactivate(isc_nmsocket_t *sock, isc_nmhandle_t *handle) {
 	handlenum = atomic_fetch_sub(&sock->ah, 1) - 1;
 	sock->ah_frees[handlenum] = handle->ah_pos;
 	handle->ah_pos = 0;
-	if (atomic_load(&sock->active)) {
+	if (atomic_load(&sock->active) && sock->tid == isc_nm_tid() &&
+	    sock->nfreehandles < ISC_NM_HANDLES_STACK_SIZE)
+	{
+		handle->nextfree = sock->freehandles;
+		sock->freehandles = handle;
+		sock->nfreehandles++;
+		reuse = true;
+	} else if (atomic_load(&sock->active)) {
 		reuse = isc_astack_trypush(sock->inactivehandles, handle);
 	}
 	if (!reuse) {
@@ -1359,6 +1893,17 @@ nmhandle_detach_cb(isc_nmhandle_t **handlep) {
 		handle->doreset(handle->opaque);
 	}
 
+#ifdef HAVE_RECVMMSG
+	/*
+	 * The receiver is done with the data the handle was created
+	 * for, so the receive slot can be reused.
+	 */
+	if (handle->recvslot != NULL) {
+		isc__nm_recvslot_put(&sock->mgr->workers[sock->tid],
+				     &handle->recvslot);
+	}
+#endif
+
 	nmhandle_deactivate(sock, handle);
 
 	/*
@@ -1458,18 +2003,22 @@ isc_nmhandle_netmgr(isc_nmhandle_t *handle) {
 
 isc__nm_uvreq_t *
 isc__nm_uvreq_get(isc_nm_t *mgr, isc_nmsocket_t *sock) {
+	isc__networker_t *worker = current_worker(mgr);
 	isc__nm_uvreq_t *req = NULL;
 
 	REQUIRE(VALID_NM(mgr));
 	REQUIRE(VALID_NMSOCK(sock));
 
-	if (sock != NULL && isc__nmsocket_active(sock)) {
+	if (worker != NULL) {
 		/* Try to reuse one */
-		req = isc_astack_pop(sock->inactivereqs);
+		req = freelist_get(&worker->freereqs);
 	}
 
-	if (req == NULL) {
+	if (req != NULL) {
+		allocstat(mgr, worker, isc__nm_allocstat_reqcached);
+	} else {
 		req = isc_mempool_get(mgr->reqpool);
+		allocstat(mgr, worker, isc__nm_allocstat_reqalloc);
 	}
 
 	*req = (isc__nm_uvreq_t){ .magic = 0 };
@@ -1483,6 +2032,7 @@ isc__nm_uvreq_get(isc_nm_t *mgr, isc_nmsocket_t *sock) {
 
 void
 isc__nm_uvreq_put(isc__nm_uvreq_t **req0, isc_nmsocket_t *sock) {
+	isc__networker_t *worker = NULL;
 	isc__nm_uvreq_t *req = NULL;
 	isc_nmhandle_t *handle = NULL;
 
@@ -1503,8 +2053,13 @@ isc__nm_uvreq_put(isc__nm_uvreq_t **req0, isc_nmsocket_t *sock) {
 	handle = req->handle;
 	req->handle = NULL;
 
-	if (!isc__nmsocket_active(sock) ||
-	    !isc_astack_trypush(sock->inactivereqs, req)) {
+	worker = current_worker(sock->mgr);
+	if (req == sock->timedoutreq) {
+		/* libuv may still use it; freed in nmsocket_cleanup() */
+	} else if (worker != NULL) {
+		freelist_put(&worker->freereqs, req, ISC_NM_WORKER_REQS_CACHE,
+			     sock->mgr->reqpool);
+	} else {
 		isc_mempool_put(sock->mgr->reqpool, req);
 	}
 
@@ -1794,6 +2349,15 @@ isc__nm_socket(int domain, int type, int protocol, uv_os_sock_t *sockp) {
 	return (ISC_R_SUCCESS);
 }
 
+void
+isc__nm_closesocket(uv_os_sock_t sock) {
+#ifdef WIN32
+	closesocket(sock);
+#else
+	close(sock);
+#endif
+}
+
 #define setsockopt_on(socket, level, name) \
 	setsockopt(socket, level, name, &(int){ 1 }, sizeof(int))
 
@@ -1902,15 +2466,68 @@ isc__nm_socket_reuse_lb(uv_os_sock_t fd) {
 }
 
 isc_result_t
-isc__nm_socket_incoming_cpu(uv_os_sock_t fd) {
+isc__nm_socket_incoming_cpu(uv_os_sock_t fd, int cpu) {
 #ifdef SO_INCOMING_CPU
-	if (setsockopt_on(fd, SOL_SOCKET, SO_INCOMING_CPU) == -1) {
+	if (setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) ==
+	    -1) {
 		return (ISC_R_FAILURE);
 	} else {
 		return (ISC_R_SUCCESS);
 	}
 #else
 	UNUSED(fd);
+	UNUSED(cpu);
+#endif
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
+isc_result_t
+isc__nm_socket_steering(uv_os_sock_t fd, isc_nm_steering_t steering,
+			uint32_t nchildren) {
+	/*
+	 * The program returns the index of the socket in the SO_REUSEPORT
+	 * group that receives the packet: the receiving CPU or a random
+	 * number, modulo the number of sockets.  The kernel falls back to
+	 * the flow hash while fewer sockets than that are bound.
+	 */
+#if defined(SO_ATTACH_REUSEPORT_CBPF) && defined(SKF_AD_CPU) && \
+	defined(SKF_AD_RANDOM)
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU),
+		BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, nchildren),
+		BPF_STMT(BPF_RET | BPF_A, 0),
+	};
+	struct sock_fprog prog = { .len = ARRAY_SIZE(code), .filter = code };
+
+	REQUIRE(nchildren > 0);
+
+	switch (steering) {
+	case isc_nm_steering_none:
+		return (ISC_R_SUCCESS);
+	case isc_nm_steering_cpu:
+		break;
+	case isc_nm_steering_random:
+		code[0].k = SKF_AD_OFF + SKF_AD_RANDOM;
+		break;
+	default:
+		INSIST(0);
+		ISC_UNREACHABLE();
+	}
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+		       sizeof(prog)) == -1)
+	{
+		return (ISC_R_FAILURE);
+	} else {
+		return (ISC_R_SUCCESS);
+	}
+#else
+	UNUSED(fd);
+	UNUSED(nchildren);
+
+	if (steering == isc_nm_steering_none) {
+		return (ISC_R_SUCCESS);
+	}
 #endif
 	return (ISC_R_NOTIMPLEMENTED);
 }
@@ -149,6 +149,12 @@ connecttimeout_cb(uv_timer_t *handle) {
 
 	REQUIRE(sock->tid == isc_nm_tid());
 
+	/*
+	 * libuv still owns the connect request, and will pass it to
+	 * tcp_connect_cb() when the connection completes or the socket
+	 * is closed, so it must not be reused before the socket is gone.
+	 */
+	sock->timedoutreq = req;
 	failed_connect_cb(sock, req, ISC_R_TIMEDOUT);
 }
 
@@ -368,18 +374,59 @@ isc_nm_tcpconnect(isc_nm_t *mgr, isc_nmiface_t *local, isc_nmiface_t *peer,
 	return (result);
 }
 
+/*
+ * Whether every child of the listening socket 'sock' has either started
+ * listening or failed to; called with sock->lock held.
+ */
+static bool
+tcplisten_done(isc_nmsocket_t *sock) {
+	for (int i = 0; i < sock->nchildren; i++) {
+		if (!atomic_load(&sock->children[i].listening) &&
+		    !atomic_load(&sock->children[i].listen_error))
+		{
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
 isc_result_t
 isc_nm_listentcp(isc_nm_t *mgr, isc_nmiface_t *iface,
 		 isc_nm_accept_cb_t accept_cb, void *accept_cbarg,
 		 size_t extrahandlesize, int backlog, isc_quota_t *quota,
 		 isc_nmsocket_t **sockp) {
 	isc_nmsocket_t *nsock = NULL;
-	isc__netievent_tcplisten_t *ievent = NULL;
+	sa_family_t sa_family = iface->addr.type.sa.sa_family;
+	isc_result_t result = ISC_R_SUCCESS;
+	int nchildren;
+	uv_os_sock_t fd = -1;
 
 	REQUIRE(VALID_NM(mgr));
 
+	/*
+	 * If the platform can balance connections between several
+	 * sockets bound to the same address, every worker accepts
+	 * connections on a socket of its own.  Otherwise (or if we're
+	 * called from a network thread and can't wait for the other
+	 * workers), a single socket accepts and hands connections out.
+	 */
+	result = isc__nm_socket(sa_family, SOCK_STREAM, 0, &fd);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+	nchildren = mgr->nworkers;
+	if (isc__nm_in_netthread() ||
+	    isc__nm_socket_reuse_lb(fd) != ISC_R_SUCCESS) {
+		nchildren = 1;
+	}
+
 	nsock = isc_mem_get(mgr->mctx, sizeof(*nsock));
 	isc__nmsocket_init(nsock, mgr, isc_nm_tcplistener, iface);
+	nsock->nchildren = nchildren;
+	atomic_init(&nsock->rchildren, 0);
+	nsock->children = isc_mem_get(mgr->mctx, nchildren * sizeof(*nsock));
+	memset(nsock->children, 0, nchildren * sizeof(*nsock));
 
 	nsock->accept_cb = accept_cb;
 	nsock->accept_cbarg = accept_cbarg;
@@ -393,43 +440,152 @@ isc_nm_listentcp(isc_nm_t *mgr, isc_nmiface_t *iface,
 		 */
 		nsock->pquota = quota;
 	}
-	isc_quota_cb_init(&nsock->quotacb, quota_accept_cb, nsock);
 
-	ievent = isc__nm_get_ievent(mgr, netievent_tcplisten);
-	ievent->sock = nsock;
 	if (isc__nm_in_netthread()) {
 		nsock->tid = isc_nm_tid();
-		isc__nm_async_tcplisten(&mgr->workers[nsock->tid],
-					(isc__netievent_t *)ievent);
-		isc__nm_put_ievent(mgr, ievent);
 	} else {
 		nsock->tid = isc_random_uniform(mgr->nworkers);
-		isc__nm_enqueue_ievent(&mgr->workers[nsock->tid],
-				       (isc__netievent_t *)ievent);
+	}
 
-		LOCK(&nsock->lock);
-		while (!atomic_load(&nsock->listening) &&
-		       !atomic_load(&nsock->listen_error)) {
-			WAIT(&nsock->cond, &nsock->lock);
+	for (int i = 0; i < nchildren; i++) {
+		isc__netievent_tcplisten_t *ievent = NULL;
+		isc_nmsocket_t *csock = &nsock->children[i];
+
+		isc__nmsocket_init(csock, mgr, isc_nm_tcplistener, iface);
+		csock->parent = nsock;
+		csock->tid = (nchildren == 1) ? nsock->tid : i;
+		csock->accept_cb = accept_cb;
+		csock->accept_cbarg = accept_cbarg;
+		csock->extrahandlesize = extrahandlesize;
+		csock->backlog = backlog;
+		csock->pquota = nsock->pquota;
+		isc_quota_cb_init(&csock->quotacb, quota_accept_cb, csock);
+		atomic_init(&csock->result, ISC_R_SUCCESS);
+
+		if (i == 0) {
+			csock->fd = fd;
+		} else {
+			result = isc__nm_socket(sa_family, SOCK_STREAM, 0,
+						&csock->fd);
+			RUNTIME_CHECK(result == ISC_R_SUCCESS);
+			result = isc__nm_socket_reuse_lb(csock->fd);
+			RUNTIME_CHECK(result == ISC_R_SUCCESS);
+		}
+		if (nchildren > 1) {
+			(void)isc__nm_socket_reuse(csock->fd);
+			(void)isc__nm_socket_incoming_cpu(
+				csock->fd, isc__nm_worker_cpu(mgr, i));
+		}
+
+		ievent = isc__nm_get_ievent(mgr, netievent_tcplisten);
+		ievent->sock = csock;
+		if (csock->tid == isc_nm_tid()) {
+			isc__nm_async_tcplisten(&mgr->workers[csock->tid],
+						(isc__netievent_t *)ievent);
+			isc__nm_put_ievent(mgr, ievent);
+		} else {
+			isc__nm_enqueue_ievent(&mgr->workers[csock->tid],
+					       (isc__netievent_t *)ievent);
 		}
-		UNLOCK(&nsock->lock);
 	}
 
-	if (atomic_load(&nsock->result) == ISC_R_SUCCESS) {
-		*sockp = nsock;
-		return (ISC_R_SUCCESS);
-	} else {
-		isc_result_t result = atomic_load(&nsock->result);
+	LOCK(&nsock->lock);
+	while (!tcplisten_done(nsock)) {
+		WAIT(&nsock->cond, &nsock->lock);
+	}
+	UNLOCK(&nsock->lock);
+
+	for (int i = 0; i < nchildren && result == ISC_R_SUCCESS; i++) {
+		result = atomic_load(&nsock->children[i].result);
+	}
+
+	if (result != ISC_R_SUCCESS) {
+		/*
+		 * Close the children that did start listening; the
+		 * socket is freed once they are all gone.
+		 */
+		atomic_store(&nsock->result, result);
+		isc__nm_tcp_stoplistening(nsock);
 		isc__nmsocket_detach(&nsock);
 		return (result);
 	}
+
+	atomic_store(&nsock->listening, true);
+	*sockp = nsock;
+	return (ISC_R_SUCCESS);
+}
+
+size_t
+isc_nm_tcp_acceptcounts(isc_nmsocket_t *sock, uint64_t *counts,
+			size_t ncounts) {
+	REQUIRE(VALID_NMSOCK(sock));
+	REQUIRE(counts != NULL || ncounts == 0);
+
+	while (sock->type != isc_nm_tcplistener) {
+		REQUIRE(sock->type == isc_nm_tcpdnslistener ||
+			sock->type == isc_nm_tlslistener);
+		sock = sock->outer;
+		REQUIRE(VALID_NMSOCK(sock));
+	}
+
+	for (int i = 0; i < sock->nchildren && (size_t)i < ncounts; i++) {
+		counts[i] = atomic_load_relaxed(&sock->children[i].nreceived);
+	}
+
+	return ((size_t)sock->nchildren);
 }
 
 /*
- * For multi-threaded TCP listening, we create a single socket,
- * bind to it, and start listening. On an incoming connection we accept
- * it, and then pass the accepted socket using the uv_export/uv_import
- * mechanism to a child thread.
+ * Tell the listening socket that its child 'sock' has either started
+ * listening or failed to.
+ */
+static void
+tcplisten_signal(isc_nmsocket_t *sock, isc_result_t result) {
+	isc_nmsocket_t *psock = sock->parent;
+
+	LOCK(&psock->lock);
+	if (result == ISC_R_SUCCESS) {
+		atomic_fetch_add(&psock->rchildren, 1);
+		atomic_store(&sock->listening, true);
+	} else {
+		atomic_store(&sock->result, result);
+		atomic_store(&sock->listen_error, true);
+	}
+	BROADCAST(&psock->cond);
+	UNLOCK(&psock->lock);
+}
+
+/*
+ * Close callback for a child socket that failed to start listening.
+ */
+static void
+tcplisten_failclose_cb(uv_handle_t *handle) {
+	isc_nmsocket_t *sock = uv_handle_get_data(handle);
+
+	atomic_store(&sock->closed, true);
+	isc__nmsocket_detach(&sock);
+}
+
+static void
+tcplisten_fail(isc_nmsocket_t *sock, isc_result_t result) {
+	isc_nmsocket_t *tsock = NULL;
+
+	/*
+	 * The listening socket may be torn down as soon as we signal it;
+	 * hold a reference until the handle is closed.
+	 */
+	isc__nmsocket_attach(sock, &tsock);
+	uv_close(&sock->uv_handle.handle, tcplisten_failclose_cb);
+	tcplisten_signal(sock, result);
+}
+
+/*
+ * Start listening on a child of a TCP listening socket.  If every
+ * worker has a child, the children are bound to the same address with
+ * SO_REUSEPORT (or SO_REUSEPORT_LB) and the kernel balances incoming
+ * connections between them; with a single child, accepted connections
+ * are passed to a random worker using the uv_export/uv_import
+ * mechanism.
  */
 void
 isc__nm_async_tcplisten(isc__networker_t *worker, isc__netievent_t *ev0) {
@@ -438,19 +594,29 @@ isc__nm_async_tcplisten(isc__networker_t *worker, isc__netievent_t *ev0) {
 	struct sockaddr_storage sname;
 	int r, flags = 0, snamelen = sizeof(sname);
 	sa_family_t sa_family;
-	uv_os_sock_t fd;
 
 	REQUIRE(isc__nm_in_netthread());
 	REQUIRE(sock->type == isc_nm_tcplistener);
+	REQUIRE(sock->parent != NULL);
+	REQUIRE(sock->tid == isc_nm_tid());
 
 	r = uv_tcp_init(&worker->loop, &sock->uv_handle.tcp);
 	if (r != 0) {
 		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_OPENFAIL]);
 		/* The socket was never opened, so no need for uv_close() */
+		isc__nm_closesocket(sock->fd);
 		atomic_store(&sock->closed, true);
-		atomic_store(&sock->result, isc__nm_uverr2result(r));
-		atomic_store(&sock->listen_error, true);
-		goto done;
+		tcplisten_signal(sock, isc__nm_uverr2result(r));
+		return;
+	}
+	uv_handle_set_data(&sock->uv_handle.handle, sock);
+
+	r = uv_tcp_open(&sock->uv_handle.tcp, sock->fd);
+	if (r != 0) {
+		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_OPENFAIL]);
+		isc__nm_closesocket(sock->fd);
+		tcplisten_fail(sock, isc__nm_uverr2result(r));
+		return;
 	}
 
 	isc__nm_incstats(sock->mgr, sock->statsindex[STATID_OPEN]);
@@ -461,14 +627,6 @@ isc__nm_async_tcplisten(isc__networker_t *worker, isc__netievent_t *ev0) {
 	}
 
 	uv_tcp_bind(&sock->uv_handle.tcp, &sock->iface->addr.type.sa, flags);
-	r = uv_fileno(&sock->uv_handle.handle, (uv_os_fd_t *)&fd);
-	if (r != 0) {
-		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_BINDFAIL]);
-		uv_close(&sock->uv_handle.handle, tcp_close_cb);
-		atomic_store(&sock->result, isc__nm_uverr2result(r));
-		atomic_store(&sock->listen_error, true);
-		goto done;
-	}
 
 	/*
 	 * uv_tcp_bind() uses a delayed error, initially returning
@@ -478,8 +636,9 @@ isc__nm_async_tcplisten(isc__networker_t *worker, isc__netievent_t *ev0) {
 	r = uv_tcp_getsockname(&sock->uv_handle.tcp, (struct sockaddr *)&sname,
 			       &snamelen);
 
-	if (r == UV_EADDRINUSE && isc__nm_socket_reuse(fd) == ISC_R_SUCCESS &&
-	    isc__nm_socket_reuse_lb(fd) == ISC_R_SUCCESS)
+	if (r == UV_EADDRINUSE && sock->parent->nchildren == 1 &&
+	    isc__nm_socket_reuse(sock->fd) == ISC_R_SUCCESS &&
+	    isc__nm_socket_reuse_lb(sock->fd) == ISC_R_SUCCESS)
 	{
 		/*
 		 * Retry bind() with REUSEADDR/REUSEPORT if the address
@@ -492,7 +651,7 @@ isc__nm_async_tcplisten(isc__networker_t *worker, isc__netievent_t *ev0) {
 	}
 
 	if (r == UV_EADDRNOTAVAIL &&
-	    isc__nm_socket_freebind(fd, sa_family) == ISC_R_SUCCESS)
+	    isc__nm_socket_freebind(sock->fd, sa_family) == ISC_R_SUCCESS)
 	{
 		/*
 		 * Retry binding with IP_FREEBIND (or equivalent option) if the
@@ -508,25 +667,8 @@ isc__nm_async_tcplisten(isc__networker_t *worker, isc__netievent_t *ev0) {
 
 	if (r != 0) {
 		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_BINDFAIL]);
-		uv_close(&sock->uv_handle.handle, tcp_close_cb);
-		atomic_store(&sock->result, isc__nm_uverr2result(r));
-		atomic_store(&sock->listen_error, true);
-		goto done;
-	}
-
-	/*
-	 * By doing this now, we can find out immediately whether bind()
-	 * failed, and quit if so. (uv_bind() uses a delayed error,
-	 * initially returning success even if bind() fails, and this
-	 * could cause a deadlock later if we didn't check first.)
-	 */
-	r = uv_tcp_getsockname(&sock->uv_handle.tcp, (struct sockaddr *)&sname,
-			       &snamelen);
-	if (r != 0) {
-		uv_close(&sock->uv_handle.handle, tcp_close_cb);
-		atomic_store(&sock->result, isc__nm_uverr2result(r));
-		atomic_store(&sock->listen_error, true);
-		goto done;
+		tcplisten_fail(sock, isc__nm_uverr2result(r));
+		return;
 	}
 
 	/*
@@ -540,21 +682,11 @@ isc__nm_async_tcplisten(isc__networker_t *worker, isc__netievent_t *ev0) {
 			      ISC_LOGMODULE_NETMGR, ISC_LOG_ERROR,
 			      "uv_listen failed: %s",
 			      isc_result_totext(isc__nm_uverr2result(r)));
-		uv_close(&sock->uv_handle.handle, tcp_close_cb);
-		atomic_store(&sock->result, isc__nm_uverr2result(r));
-		atomic_store(&sock->listen_error, true);
-		goto done;
+		tcplisten_fail(sock, isc__nm_uverr2result(r));
+		return;
 	}
 
-	uv_handle_set_data(&sock->uv_handle.handle, sock);
-
-	atomic_store(&sock->listening, true);
-
-done:
-	LOCK(&sock->lock);
-	SIGNAL(&sock->cond);
-	UNLOCK(&sock->lock);
-	return;
+	tcplisten_signal(sock, ISC_R_SUCCESS);
 }
 
 static void
@@ -576,11 +708,12 @@ tcp_connection_cb(uv_stream_t *server, int status) {
 	}
 }
 
-void
-isc__nm_async_tcpchildaccept(isc__networker_t *worker, isc__netievent_t *ev0) {
-	isc__netievent_tcpchildaccept_t *ievent =
-		(isc__netievent_tcpchildaccept_t *)ev0;
-	isc_nmsocket_t *sock = ievent->sock;
+/*
+ * Finish accepting a connection once the child socket 'sock' owns the
+ * accepted stream: fill in the addresses and call the accept callback.
+ */
+static void
+accept_child(isc_nmsocket_t *sock) {
 	isc_nmhandle_t *handle;
 	isc_result_t result;
 	struct sockaddr_storage ss;
@@ -589,42 +722,6 @@ isc__nm_async_tcpchildaccept(isc__networker_t *worker, isc__netievent_t *ev0) {
 	isc_nm_accept_cb_t accept_cb;
 	void *accept_cbarg;
 
-	REQUIRE(isc__nm_in_netthread());
-	REQUIRE(sock->tid == isc_nm_tid());
-
-	if (!sock->accepting) {
-		return;
-	}
-
-	/* Socket was closed midflight by isc__nm_tcp_shutdown() */
-	if (!isc__nmsocket_active(sock)) {
-		failed_accept_cb(sock, ISC_R_CANCELED);
-		return;
-	}
-
-	INSIST(sock->server != NULL);
-
-	if (!isc__nmsocket_active(sock->server)) {
-		failed_accept_cb(sock, ISC_R_CANCELED);
-		return;
-	}
-
-	sock->quota = ievent->quota;
-	ievent->quota = NULL;
-
-	worker = &sock->mgr->workers[isc_nm_tid()];
-	uv_tcp_init(&worker->loop, &sock->uv_handle.tcp);
-
-	r = isc_uv_import(&sock->uv_handle.stream, &ievent->streaminfo);
-	if (r != 0) {
-		isc_log_write(isc_lctx, ISC_LOGCATEGORY_GENERAL,
-			      ISC_LOGMODULE_NETMGR, ISC_LOG_ERROR,
-			      "uv_import failed: %s",
-			      isc_result_totext(isc__nm_uverr2result(r)));
-		result = isc__nm_uverr2result(r);
-		goto error;
-	}
-
 	r = uv_tcp_getpeername(&sock->uv_handle.tcp, (struct sockaddr *)&ss,
 			       &(int){ sizeof(ss) });
 	if (r != 0) {
@@ -675,10 +772,57 @@ error:
 	failed_accept_cb(sock, result);
 }
 
+void
+isc__nm_async_tcpchildaccept(isc__networker_t *worker, isc__netievent_t *ev0) {
+	isc__netievent_tcpchildaccept_t *ievent =
+		(isc__netievent_tcpchildaccept_t *)ev0;
+	isc_nmsocket_t *sock = ievent->sock;
+	int r;
+
+	REQUIRE(isc__nm_in_netthread());
+	REQUIRE(sock->tid == isc_nm_tid());
+
+	if (!sock->accepting) {
+		return;
+	}
+
+	/* Socket was closed midflight by isc__nm_tcp_shutdown() */
+	if (!isc__nmsocket_active(sock)) {
+		failed_accept_cb(sock, ISC_R_CANCELED);
+		return;
+	}
+
+	INSIST(sock->server != NULL);
+
+	if (!isc__nmsocket_active(sock->server)) {
+		failed_accept_cb(sock, ISC_R_CANCELED);
+		return;
+	}
+
+	sock->quota = ievent->quota;
+	ievent->quota = NULL;
+
+	worker = &sock->mgr->workers[isc_nm_tid()];
+	uv_tcp_init(&worker->loop, &sock->uv_handle.tcp);
+
+	r = isc_uv_import(&sock->uv_handle.stream, &ievent->streaminfo);
+	if (r != 0) {
+		isc_log_write(isc_lctx, ISC_LOGCATEGORY_GENERAL,
+			      ISC_LOGMODULE_NETMGR, ISC_LOG_ERROR,
+			      "uv_import failed: %s",
+			      isc_result_totext(isc__nm_uverr2result(r)));
+		failed_accept_cb(sock, isc__nm_uverr2result(r));
+		return;
+	}
+
+	accept_child(sock);
+}
+
 void
 isc__nm_tcp_stoplistening(isc_nmsocket_t *sock) {
 	REQUIRE(VALID_NMSOCK(sock));
 	REQUIRE(sock->type == isc_nm_tcplistener);
+	REQUIRE(sock->parent == NULL);
 
 	isc__netievent_tcpstop_t *ievent =
 		isc__nm_get_ievent(sock->mgr, netievent_tcpstop);
@@ -687,10 +831,19 @@ isc__nm_tcp_stoplistening(isc_nmsocket_t *sock) {
 			       (isc__netievent_t *)ievent);
 }
 
+static void
+stop_tcp_child(isc_nmsocket_t *sock) {
+	REQUIRE(sock->type == isc_nm_tcplistener);
+	REQUIRE(sock->tid == isc_nm_tid());
+
+	uv_close((uv_handle_t *)&sock->uv_handle.tcp, tcp_listenclose_cb);
+}
+
 void
 isc__nm_async_tcpstop(isc__networker_t *worker, isc__netievent_t *ev0) {
 	isc__netievent_tcpstop_t *ievent = (isc__netievent_tcpstop_t *)ev0;
 	isc_nmsocket_t *sock = ievent->sock;
+	bool stopping = false;
 
 	UNUSED(worker);
 
@@ -698,6 +851,15 @@ isc__nm_async_tcpstop(isc__networker_t *worker, isc__netievent_t *ev0) {
 	REQUIRE(VALID_NMSOCK(sock));
 	REQUIRE(sock->type == isc_nm_tcplistener);
 
+	/*
+	 * If this is a child socket, stop listening and return; the
+	 * reference is dropped when the handle has been closed.
+	 */
+	if (sock->parent != NULL) {
+		stop_tcp_child(sock);
+		return;
+	}
+
 	/*
 	 * If network manager is interlocked, re-enqueue the event for later.
 	 */
@@ -708,25 +870,62 @@ isc__nm_async_tcpstop(isc__networker_t *worker, isc__netievent_t *ev0) {
 		event->sock = sock;
 		isc__nm_enqueue_ievent(&sock->mgr->workers[sock->tid],
 				       (isc__netievent_t *)event);
-	} else {
-		uv_close((uv_handle_t *)&sock->uv_handle.tcp,
-			 tcp_listenclose_cb);
-		isc__nm_drop_interlocked(sock->mgr);
+		return;
+	}
+
+	for (int i = 0; i < sock->nchildren; i++) {
+		isc_nmsocket_t *csock = &sock->children[i];
+		isc_nmsocket_t *tsock = NULL;
+		isc__netievent_tcpstop_t *event = NULL;
+
+		if (!atomic_load(&csock->listening)) {
+			continue;
+		}
+
+		stopping = true;
+		isc__nmsocket_attach(csock, &tsock);
+		if (csock->tid == isc_nm_tid()) {
+			stop_tcp_child(csock);
+			continue;
+		}
+
+		event = isc__nm_get_ievent(sock->mgr, netievent_tcpstop);
+		event->sock = tsock;
+		isc__nm_enqueue_ievent(&sock->mgr->workers[csock->tid],
+				       (isc__netievent_t *)event);
 	}
+
+	if (!stopping) {
+		LOCK(&sock->lock);
+		atomic_store(&sock->closed, true);
+		atomic_store(&sock->listening, false);
+		sock->pquota = NULL;
+		UNLOCK(&sock->lock);
+	}
+
+	isc__nm_drop_interlocked(sock->mgr);
+	isc__nmsocket_detach(&ievent->sock);
 }
 
 /*
- * This callback is used for closing listening sockets.
+ * This callback is used for closing listening child sockets; the last
+ * one to close marks the whole listening socket closed.
  */
 static void
 tcp_listenclose_cb(uv_handle_t *handle) {
 	isc_nmsocket_t *sock = uv_handle_get_data(handle);
+	isc_nmsocket_t *psock = sock->parent;
 
-	LOCK(&sock->lock);
+	LOCK(&psock->lock);
 	atomic_store(&sock->closed, true);
 	atomic_store(&sock->listening, false);
 	sock->pquota = NULL;
-	UNLOCK(&sock->lock);
+	if (atomic_fetch_sub(&psock->rchildren, 1) == 1) {
+		atomic_store(&psock->closed, true);
+		atomic_store(&psock->listening, false);
+		psock->pquota = NULL;
+	}
+	UNLOCK(&psock->lock);
 
 	isc__nmsocket_detach(&sock);
 }
@@ -1065,6 +1264,26 @@ free_uvtcpt(uv_handle_t *uvs) {
 	isc_mem_putanddetach(&mctx, uvs, sizeof(uv_tcp_t));
 }
 
+/*
+ * Create the socket for a connection accepted on 'ssock' that will be
+ * served by worker 'tid'.
+ */
+static isc_nmsocket_t *
+accept_newchild(isc_nmsocket_t *ssock, int tid) {
+	isc_nmsocket_t *csock = NULL;
+
+	csock = isc_mem_get(ssock->mgr->mctx, sizeof(isc_nmsocket_t));
+	isc__nmsocket_init(csock, ssock->mgr, isc_nm_tcpsocket, ssock->iface);
+	csock->tid = tid;
+	csock->extrahandlesize = ssock->extrahandlesize;
+	isc__nmsocket_attach(ssock, &csock->server);
+	csock->accept_cb = ssock->accept_cb;
+	csock->accept_cbarg = ssock->accept_cbarg;
+	csock->accepting = true;
+
+	return (csock);
+}
+
 static isc_result_t
 accept_connection(isc_nmsocket_t *ssock, isc_quota_t *quota) {
 	isc_result_t result;
@@ -1114,6 +1333,48 @@ accept_connection(isc_nmsocket_t *ssock, isc_quota_t *quota) {
 	isc__nm_incstats(ssock->mgr, ssock->statsindex[STATID_ACCEPT]);
 
 	worker = &ssock->mgr->workers[isc_nm_tid()];
+
+	/*
+	 * If every worker listens on a socket of its own, the accepted
+	 * socket stays with this one; otherwise pass it to a random
+	 * worker.
+	 */
+	if (ssock->parent != NULL && ssock->parent->nchildren > 1) {
+		w = isc_nm_tid();
+	} else {
+		w = isc_random_uniform(ssock->mgr->nworkers);
+	}
+
+	if (w == isc_nm_tid()) {
+		/*
+		 * The connection is served by this worker, so accept it
+		 * straight into the child socket.
+		 */
+		csock = accept_newchild(ssock, w);
+		uv_tcp_init(&worker->loop, &csock->uv_handle.tcp);
+
+		r = uv_accept(&ssock->uv_handle.stream,
+			      &csock->uv_handle.stream);
+		if (r != 0) {
+			csock->accepting = false;
+			isc__nmsocket_detach(&csock);
+			if (quota != NULL) {
+				isc_quota_detach(&quota);
+			}
+			return (isc__nm_uverr2result(r));
+		}
+
+		atomic_fetch_add_relaxed(&ssock->nreceived, 1);
+
+		csock->quota = quota;
+		accept_child(csock);
+		return (ISC_R_SUCCESS);
+	}
+
+	/*
+	 * Otherwise accept it here and pass a duplicate of the accepted
+	 * socket to the chosen worker.
+	 */
 	uvstream = isc_mem_get(ssock->mgr->mctx, sizeof(uv_tcp_t));
 
 	isc_mem_attach(ssock->mgr->mctx, &mctx);
@@ -1132,8 +1393,8 @@ accept_connection(isc_nmsocket_t *ssock, isc_quota_t *quota) {
 		return (result);
 	}
 
-	/* We have an accepted TCP socket, pass it to a random worker */
-	w = isc_random_uniform(ssock->mgr->nworkers);
+	atomic_fetch_add_relaxed(&ssock->nreceived, 1);
+
 	event = isc__nm_get_ievent(ssock->mgr, netievent_tcpchildaccept);
 
 	/* Duplicate the server socket */
@@ -1148,28 +1409,15 @@ accept_connection(isc_nmsocket_t *ssock, isc_quota_t *quota) {
 		return (result);
 	}
 
-	csock = isc_mem_get(ssock->mgr->mctx, sizeof(isc_nmsocket_t));
-	isc__nmsocket_init(csock, ssock->mgr, isc_nm_tcpsocket, ssock->iface);
-	csock->tid = w;
-	csock->extrahandlesize = ssock->extrahandlesize;
-	isc__nmsocket_attach(ssock, &csock->server);
-	csock->accept_cb = ssock->accept_cb;
-	csock->accept_cbarg = ssock->accept_cbarg;
-	csock->accepting = true;
+	csock = accept_newchild(ssock, w);
 
 	event->sock = csock;
 	event->quota = quota;
 
 	uv_close((uv_handle_t *)uvstream, free_uvtcpt);
 
-	if (w == isc_nm_tid()) {
-		isc__nm_async_tcpchildaccept(&ssock->mgr->workers[w],
-					     (isc__netievent_t *)event);
-		isc__nm_put_ievent(ssock->mgr, event);
-	} else {
-		isc__nm_enqueue_ievent(&ssock->mgr->workers[w],
-				       (isc__netievent_t *)event);
-	}
+	isc__nm_enqueue_ievent(&ssock->mgr->workers[w],
+			       (isc__netievent_t *)event);
 
 	return (ISC_R_SUCCESS);
 }
@@ -29,12 +29,11 @@
 #include "netmgr-int.h"
 #include "uv-compat.h"
 
-#define TCPDNS_CLIENTS_PER_CONN 23
+#define TCPDNS_BATCH_MAX (64 * 1024)
 /*%<
  *
- * Maximum number of simultaneous handles in flight supported for a single
- * connected TCPDNS socket. This value was chosen arbitrarily, and may be
- * changed in the future.
+ * Responses queued on one connection are written out early once they
+ * would take up more than this many bytes.
  */
 
 static void
@@ -147,6 +146,8 @@ dnslisten_acceptcb(isc_nmhandle_t *handle, isc_result_t result, void *cbarg) {
 	dnssock->read_timeout = handle->sock->mgr->init;
 	dnssock->tid = isc_nm_tid();
 	dnssock->closehandle_cb = resume_processing;
+	dnssock->pipeline_max = atomic_load(&dnssock->mgr->tcpdns_pipeline);
+	dnssock->pipeline = dnssock->pipeline_max;
 
 	uv_timer_init(&dnssock->mgr->workers[isc_nm_tid()].loop,
 		      &dnssock->timer);
@@ -354,13 +355,12 @@ dnslisten_readcb(isc_nmhandle_t *handle, isc_result_t eresult,
 		} else {
 			/*
 			 * We're pipelining, so we now resume processing
-			 * packets until the clients-per-connection limit
-			 * is reached (as determined by the number of
-			 * active handles on the socket). When the limit
-			 * is reached, pause reading.
+			 * packets until the pipeline limit is reached
+			 * (as determined by the number of active handles
+			 * on the socket). When the limit is reached,
+			 * pause reading.
 			 */
-			if (atomic_load(&dnssock->ah) >=
-			    TCPDNS_CLIENTS_PER_CONN) {
+			if (atomic_load(&dnssock->ah) >= dnssock->pipeline) {
 				isc_nm_pauseread(dnssock->outerhandle);
 				done = true;
 			}
@@ -572,8 +572,8 @@ resume_processing(void *arg) {
 	}
 
 	/*
-	 * For pipelined sockets: If we're under the clients-per-connection
-	 * limit, resume processing until we reach the limit again.
+	 * For pipelined sockets: If we're under the pipeline limit,
+	 * resume processing until we reach the limit again.
 	 */
 	do {
 		isc_nmhandle_t *dnshandle = NULL;
@@ -595,20 +595,7 @@ resume_processing(void *arg) {
 		}
 		atomic_store(&sock->outerhandle->sock->processing, true);
 		isc_nmhandle_detach(&dnshandle);
-	} while (atomic_load(&sock->ah) < TCPDNS_CLIENTS_PER_CONN);
-}
-
-static void
-tcpdnssend_cb(isc_nmhandle_t *handle, isc_result_t result, void *cbarg) {
-	isc__nm_uvreq_t *req = (isc__nm_uvreq_t *)cbarg;
-	REQUIRE(VALID_UVREQ(req));
-
-	UNUSED(handle);
-
-	req->cb.send(req->handle, result, req->cbarg);
-	isc_mem_put(req->sock->mgr->mctx, req->uvbuf.base, req->uvbuf.len);
-	isc__nm_uvreq_put(&req, req->handle->sock);
-	isc_nmhandle_detach(&handle);
+	} while (atomic_load(&sock->ah) < sock->pipeline);
 }
 
 /*
@@ -625,14 +612,182 @@ inactive(isc_nmsocket_t *sock) {
 		atomic_load(&sock->mgr->closing));
 }
 
+/*
+ * Run the send callbacks of all messages in 'batch' and free it.
+ */
+static void
+tcpdnsbatch_done(isc__nm_tcpdnsbatch_t *batch, isc_result_t result) {
+	isc_nmsocket_t *sock = batch->sock;
+	isc__nm_uvreq_t *req = NULL;
+
+	while ((req = ISC_LIST_HEAD(batch->reqs)) != NULL) {
+		ISC_LIST_UNLINK(batch->reqs, req, link);
+		req->cb.send(req->handle, result, req->cbarg);
+		isc__nm_uvreq_put(&req, sock);
+	}
+
+	isc_mem_put(sock->mgr->mctx, batch->base, batch->size);
+	isc_mem_put(sock->mgr->mctx, batch, sizeof(*batch));
+	isc__nmsocket_detach(&sock);
+}
+
+static void
+tcpdnsbatch_cb(isc_nmhandle_t *handle, isc_result_t result, void *cbarg) {
+	isc__nm_tcpdnsbatch_t *batch = (isc__nm_tcpdnsbatch_t *)cbarg;
+	isc_nmsocket_t *sock = batch->sock;
+
+	REQUIRE(VALID_NMSOCK(sock));
+	REQUIRE(sock->tid == isc_nm_tid());
+	INSIST(sock->dnswrites > 0);
+
+	/*
+	 * If nothing else is waiting to be written, the peer is keeping
+	 * up with us, so we can let one more message into the pipeline.
+	 * This is done before running the send callbacks, which release
+	 * the handles and resume processing.
+	 */
+	sock->dnswrites--;
+	if (result == ISC_R_SUCCESS && sock->dnswrites == 0 &&
+	    sock->pipeline < sock->pipeline_max)
+	{
+		sock->pipeline++;
+	}
+
+	tcpdnsbatch_done(batch, result);
+	isc_nmhandle_detach(&handle);
+}
+
+/*
+ * Write out all the messages in 'batch' with a single send on the
+ * underlying socket.
+ */
+static void
+tcpdnsbatch_write(isc__nm_tcpdnsbatch_t *batch) {
+	isc_nmsocket_t *sock = batch->sock;
+	isc_nmhandle_t *sendhandle = NULL;
+	isc_region_t r;
+
+	REQUIRE(sock->tid == isc_nm_tid());
+
+	if (sock->dnsbatch == batch) {
+		sock->dnsbatch = NULL;
+	}
+
+	if (inactive(sock)) {
+		tcpdnsbatch_done(batch, ISC_R_CANCELED);
+		return;
+	}
+
+	if (sock->dnswrites > 0 && sock->pipeline > 1) {
+		/*
+		 * The previous write hasn't completed by the end of the
+		 * next loop iteration, so the peer isn't reading as fast
+		 * as we're answering: process fewer messages at once
+		 * until it has caught up.
+		 */
+		sock->pipeline /= 2;
+		isc__nm_incstats(sock->mgr,
+				 isc_sockstatscounter_tcpdnsbacklog);
+	}
+
+	isc__nm_incstats(sock->mgr, isc_sockstatscounter_tcpdnswrites);
+	if (sock->mgr->stats != NULL) {
+		isc_stats_add(sock->mgr->stats,
+			      isc_sockstatscounter_tcpdnswritemsgs,
+			      batch->nreqs);
+	}
+
+	sock->dnswrites++;
+	r.base = batch->base;
+	r.length = batch->len;
+	isc_nmhandle_attach(sock->outerhandle, &sendhandle);
+	isc_nm_send(sendhandle, &r, tcpdnsbatch_cb, batch);
+}
+
+void
+isc__nm_tcpdns_flush(isc__networker_t *worker) {
+	isc__nm_tcpdnsbatch_t *batch = NULL;
+
+	REQUIRE(worker->id == isc_nm_tid());
+
+	while ((batch = ISC_LIST_HEAD(worker->tcpdnsbatches)) != NULL) {
+		ISC_LIST_UNLINK(worker->tcpdnsbatches, batch, link);
+		tcpdnsbatch_write(batch);
+	}
+
+	uv_idle_stop(&worker->tcpdns_idle);
+}
+
+/*
+ * Batches queued outside the I/O callbacks (e.g. from a write
+ * completion) would otherwise wait for the next I/O event; as long as
+ * the idle handle is active, the loop doesn't block, and the batches
+ * are written in this iteration or the next.
+ */
+static void
+tcpdns_idle_cb(uv_idle_t *handle) {
+	isc__networker_t *worker = (isc__networker_t *)handle->loop->data;
+
+	isc__nm_tcpdns_flush(worker);
+}
+
+/*
+ * Add the message in 'req' to the batch of the socket, which is written
+ * out at the end of the current loop iteration; messages that become
+ * ready on one connection at the same time go out with a single write,
+ * in the order in which they were completed.
+ */
+static void
+tcpdns_queue(isc_nmsocket_t *sock, isc__nm_uvreq_t *req) {
+	isc__networker_t *worker = &sock->mgr->workers[sock->tid];
+	isc__nm_tcpdnsbatch_t *batch = sock->dnsbatch;
+	size_t len = req->uvbuf.len + 2;
+
+	REQUIRE(sock->tid == isc_nm_tid());
+
+	if (batch != NULL && batch->len + len > TCPDNS_BATCH_MAX) {
+		ISC_LIST_UNLINK(worker->tcpdnsbatches, batch, link);
+		tcpdnsbatch_write(batch);
+		batch = NULL;
+	}
+
+	if (batch == NULL) {
+		batch = isc_mem_get(sock->mgr->mctx, sizeof(*batch));
+		*batch = (isc__nm_tcpdnsbatch_t){ .size = ISC_MAX(len,
+								  NM_REG_BUF) };
+		batch->base = isc_mem_get(sock->mgr->mctx, batch->size);
+		ISC_LIST_INIT(batch->reqs);
+		ISC_LINK_INIT(batch, link);
+		isc__nmsocket_attach(sock, &batch->sock);
+		if (ISC_LIST_EMPTY(worker->tcpdnsbatches)) {
+			uv_idle_start(&worker->tcpdns_idle, tcpdns_idle_cb);
+		}
+		ISC_LIST_APPEND(worker->tcpdnsbatches, batch, link);
+		sock->dnsbatch = batch;
+	} else if (batch->len + len > batch->size) {
+		size_t size = ISC_MAX(batch->size * 2, batch->len + len);
+		unsigned char *base = isc_mem_get(sock->mgr->mctx, size);
+
+		memmove(base, batch->base, batch->len);
+		isc_mem_put(sock->mgr->mctx, batch->base, batch->size);
+		batch->base = base;
+		batch->size = size;
+	}
+
+	batch->base[batch->len] = (uint8_t)(req->uvbuf.len >> 8);
+	batch->base[batch->len + 1] = (uint8_t)(req->uvbuf.len & 0xff);
+	memmove(batch->base + batch->len + 2, req->uvbuf.base, req->uvbuf.len);
+	batch->len += len;
+	batch->nreqs++;
+	ISC_LIST_APPEND(batch->reqs, req, link);
+}
+
 void
 isc__nm_async_tcpdnssend(isc__networker_t *worker, isc__netievent_t *ev0) {
 	isc__netievent_tcpdnssend_t *ievent =
 		(isc__netievent_tcpdnssend_t *)ev0;
 	isc__nm_uvreq_t *req = ievent->req;
 	isc_nmsocket_t *sock = ievent->sock;
-	isc_nmhandle_t *sendhandle = NULL;
-	isc_region_t r;
 
 	REQUIRE(VALID_NMSOCK(sock));
 	REQUIRE(VALID_UVREQ(req));
@@ -642,19 +797,17 @@ isc__nm_async_tcpdnssend(isc__networker_t *worker, isc__netievent_t *ev0) {
 
 	if (inactive(sock)) {
 		req->cb.send(req->handle, ISC_R_CANCELED, req->cbarg);
-		isc_mem_put(sock->mgr->mctx, req->uvbuf.base, req->uvbuf.len);
-		isc__nm_uvreq_put(&req, req->handle->sock);
+		isc__nm_uvreq_put(&req, sock);
 		return;
 	}
 
-	r.base = (unsigned char *)req->uvbuf.base;
-	r.length = req->uvbuf.len;
-	isc_nmhandle_attach(sock->outerhandle, &sendhandle);
-	isc_nm_send(sendhandle, &r, tcpdnssend_cb, req);
+	tcpdns_queue(sock, req);
 }
 
 /*
- * isc__nm_tcp_send sends buf to a peer on a socket.
+ * isc__nm_tcpdns_send sends buf to a peer on a socket.  The message
+ * is copied when it is queued for writing, but as with TCP, the caller
+ * must keep 'region' valid until the callback has been called.
  */
 void
 isc__nm_tcpdns_send(isc_nmhandle_t *handle, isc_region_t *region,
@@ -667,6 +820,7 @@ isc__nm_tcpdns_send(isc_nmhandle_t *handle, isc_region_t *region,
 
 	REQUIRE(VALID_NMSOCK(sock));
 	REQUIRE(sock->type == isc_nm_tcpdnssocket);
+	REQUIRE(region->length <= UINT16_MAX);
 
 	if (inactive(sock)) {
 		cb(handle, ISC_R_CANCELED, cbarg);
@@ -677,11 +831,13 @@ isc__nm_tcpdns_send(isc_nmhandle_t *handle, isc_region_t *region,
 	isc_nmhandle_attach(handle, &uvreq->handle);
 	uvreq->cb.send = cb;
 	uvreq->cbarg = cbarg;
+	uvreq->uvbuf.base = (char *)region->base;
+	uvreq->uvbuf.len = region->length;
 
-	uvreq->uvbuf.base = isc_mem_get(sock->mgr->mctx, region->length + 2);
-	uvreq->uvbuf.len = region->length + 2;
-	*(uint16_t *)uvreq->uvbuf.base = htons(region->length);
-	memmove(uvreq->uvbuf.base + 2, region->base, region->length);
+	if (sock->tid == isc_nm_tid()) {
+		tcpdns_queue(sock, uvreq);
+		return;
+	}
 
 	isc__netievent_tcpdnssend_t *ievent = NULL;
 
@@ -9,13 +9,19 @@
  * information regarding copyright ownership.
  */
 
+#include <errno.h>
 #include <unistd.h>
 #include <uv.h>
 
+#if defined(HAVE_SENDMMSG) || defined(HAVE_RECVMMSG)
+#include <sys/socket.h>
+#endif /* if defined(HAVE_SENDMMSG) || defined(HAVE_RECVMMSG) */
+
 #include <isc/atomic.h>
 #include <isc/buffer.h>
 #include <isc/condition.h>
 #include <isc/errno.h>
+#include <isc/log.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
 #include <isc/netmgr.h>
@@ -34,6 +40,9 @@ static isc_result_t
 udp_send_direct(isc_nmsocket_t *sock, isc__nm_uvreq_t *req,
 		isc_sockaddr_t *peer);
 
+static isc_result_t
+udp_send(isc_nmsocket_t *sock, isc__nm_uvreq_t *req, isc_sockaddr_t *peer);
+
 static void
 udp_recv_cb(uv_udp_t *handle, ssize_t nrecv, const uv_buf_t *buf,
 	    const struct sockaddr *addr, unsigned flags);
@@ -44,6 +53,14 @@ udp_send_cb(uv_udp_send_t *req, int status);
 static void
 udp_close_cb(uv_handle_t *uvhandle);
 
+#ifdef HAVE_RECVMMSG
+static void
+udp_recvmmsg_cb(uv_poll_t *handle, int status, int events);
+
+static bool
+udp_recvmmsg_start(isc__networker_t *worker, isc_nmsocket_t *sock);
+#endif /* HAVE_RECVMMSG */
+
 static void
 udp_close_direct(isc_nmsocket_t *sock);
 
@@ -54,10 +71,50 @@ static void
 failed_connect_cb(isc_nmsocket_t *sock, isc__nm_uvreq_t *req,
 		  isc_result_t eresult);
 
+/*
+ * Bind a listening child socket to the listener's address.  This is
+ * done by isc_nm_listenudp() itself, one child after another, rather
+ * than by the network threads, so that child 'i' is always socket 'i'
+ * of the SO_REUSEPORT group: the steering program returns the index of
+ * the socket in the group, and isc_nm_steering_cpu relies on it being
+ * the child read by the thread pinned to the receiving CPU.
+ */
+static void
+udp_bind(isc_nmsocket_t *sock, sa_family_t sa_family) {
+	const struct sockaddr *sa = &sock->parent->iface->addr.type.sa;
+	socklen_t salen = (sa_family == AF_INET6) ? sizeof(struct sockaddr_in6)
+						  : sizeof(struct sockaddr_in);
+	int r;
+
+	if (sa_family == AF_INET6) {
+		(void)setsockopt(sock->fd, IPPROTO_IPV6, IPV6_V6ONLY,
+				 &(int){ 1 }, sizeof(int));
+	}
+
+	r = bind(sock->fd, sa, salen);
+	if (r == -1 && errno == EADDRNOTAVAIL &&
+	    isc__nm_socket_freebind(sock->fd, sa_family) == ISC_R_SUCCESS)
+	{
+		/*
+		 * Retry binding with IP_FREEBIND (or equivalent option) if the
+		 * address is not available. This helps with IPv6 tentative
+		 * addresses which are reported by the route socket, although
+		 * named is not yet able to properly bind to them.
+		 */
+		r = bind(sock->fd, sa, salen);
+	}
+
+	if (r == -1) {
+		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_BINDFAIL]);
+	}
+}
+
 isc_result_t
-isc_nm_listenudp(isc_nm_t *mgr, isc_nmiface_t *iface, isc_nm_recv_cb_t cb,
-		 void *cbarg, size_t extrahandlesize, isc_nmsocket_t **sockp) {
+isc_nm_listenudp(isc_nm_t *mgr, isc_nmiface_t *iface,
+		 isc_nm_steering_t steering, isc_nm_recv_cb_t cb, void *cbarg,
+		 size_t extrahandlesize, isc_nmsocket_t **sockp) {
 	isc_nmsocket_t *nsock = NULL;
+	isc_result_t steered = ISC_R_SUCCESS;
 
 	REQUIRE(VALID_NM(mgr));
 
@@ -104,24 +161,63 @@ isc_nm_listenudp(isc_nm_t *mgr, isc_nmiface_t *iface, isc_nm_recv_cb_t cb,
 		RUNTIME_CHECK(result == ISC_R_SUCCESS ||
 			      result == ISC_R_NOTIMPLEMENTED);
 
+		/*
+		 * The steering program is attached to every child before
+		 * it is bound: the first child to be bound creates the
+		 * SO_REUSEPORT group (with its program) that the others
+		 * join in order.
+		 */
+		result = isc__nm_socket_steering(csock->fd, steering,
+						 mgr->nworkers);
+		if (result != ISC_R_SUCCESS) {
+			steered = result;
+		}
+
 		/* We don't check for the result, because SO_INCOMING_CPU can be
 		 * available without the setter on Linux kernel version 4.4, and
-		 * setting SO_INCOMING_CPU is just an optimization.
+		 * setting SO_INCOMING_CPU is just an optimization.  When
+		 * the network threads are pinned, steer each child to the
+		 * CPU of the thread that reads from it.
 		 */
-		(void)isc__nm_socket_incoming_cpu(csock->fd);
+		(void)isc__nm_socket_incoming_cpu(csock->fd,
+						  isc__nm_worker_cpu(mgr, i));
 
 		(void)isc__nm_socket_dontfrag(csock->fd, sa_family);
 
+		udp_bind(csock, sa_family);
+
 		ievent = isc__nm_get_ievent(mgr, netievent_udplisten);
 		ievent->sock = csock;
 		isc__nm_enqueue_ievent(&mgr->workers[i],
 				       (isc__netievent_t *)ievent);
 	}
 
+	if (steered != ISC_R_SUCCESS) {
+		isc_log_write(isc_lctx, ISC_LOGCATEGORY_GENERAL,
+			      ISC_LOGMODULE_NETMGR, ISC_LOG_WARNING,
+			      "unable to attach UDP steering program, "
+			      "using the kernel flow hash: %s",
+			      isc_result_totext(steered));
+	}
+
 	*sockp = nsock;
 	return (ISC_R_SUCCESS);
 }
 
+size_t
+isc_nm_udp_recvcounts(isc_nmsocket_t *sock, uint64_t *counts,
+		      size_t ncounts) {
+	REQUIRE(VALID_NMSOCK(sock));
+	REQUIRE(sock->type == isc_nm_udplistener);
+	REQUIRE(counts != NULL || ncounts == 0);
+
+	for (int i = 0; i < sock->nchildren && (size_t)i < ncounts; i++) {
+		counts[i] = atomic_load_relaxed(&sock->children[i].nreceived);
+	}
+
+	return ((size_t)sock->nchildren);
+}
+
 /*%<
  * Allocator for UDP recv operations. Limited to size 20 * (2^16 + 2),
  * which allows enough space for recvmmsg() to get multiple messages at
@@ -155,16 +251,15 @@ void
 isc__nm_async_udplisten(isc__networker_t *worker, isc__netievent_t *ev0) {
 	isc__netievent_udplisten_t *ievent = (isc__netievent_udplisten_t *)ev0;
 	isc_nmsocket_t *sock = ievent->sock;
-	int r, uv_bind_flags = 0;
+	int r;
 	int uv_init_flags = 0;
-	sa_family_t sa_family;
 
 	REQUIRE(sock->type == isc_nm_udpsocket);
 	REQUIRE(sock->iface != NULL);
 	REQUIRE(sock->parent != NULL);
 	REQUIRE(sock->tid == isc_nm_tid());
 
-#ifdef UV_UDP_RECVMMSG
+#if defined(UV_UDP_RECVMMSG) && !defined(HAVE_RECVMMSG)
 	uv_init_flags |= UV_UDP_RECVMMSG;
 #endif
 	uv_udp_init_ex(&worker->loop, &sock->uv_handle.udp, uv_init_flags);
@@ -172,6 +267,7 @@ isc__nm_async_udplisten(isc__networker_t *worker, isc__netievent_t *ev0) {
 	isc__nmsocket_attach(sock,
 			     (isc_nmsocket_t **)&sock->uv_handle.udp.data);
 
+	/* The socket was bound by isc_nm_listenudp(). */
 	r = uv_udp_open(&sock->uv_handle.udp, sock->fd);
 	if (r == 0) {
 		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_OPEN]);
@@ -179,30 +275,6 @@ isc__nm_async_udplisten(isc__networker_t *worker, isc__netievent_t *ev0) {
 		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_OPENFAIL]);
 	}
 
-	sa_family = sock->iface->addr.type.sa.sa_family;
-	if (sa_family == AF_INET6) {
-		uv_bind_flags |= UV_UDP_IPV6ONLY;
-	}
-
-	r = uv_udp_bind(&sock->uv_handle.udp,
-			&sock->parent->iface->addr.type.sa, uv_bind_flags);
-	if (r == UV_EADDRNOTAVAIL &&
-	    isc__nm_socket_freebind(sock->fd, sa_family) == ISC_R_SUCCESS)
-	{
-		/*
-		 * Retry binding with IP_FREEBIND (or equivalent option) if the
-		 * address is not available. This helps with IPv6 tentative
-		 * addresses which are reported by the route socket, although
-		 * named is not yet able to properly bind to them.
-		 */
-		r = uv_udp_bind(&sock->uv_handle.udp,
-				&sock->parent->iface->addr.type.sa,
-				uv_bind_flags);
-	}
-
-	if (r < 0) {
-		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_BINDFAIL]);
-	}
 #ifdef ISC_RECV_BUFFER_SIZE
 	uv_recv_buffer_size(&sock->uv_handle.handle,
 			    &(int){ ISC_RECV_BUFFER_SIZE });
@@ -211,6 +283,17 @@ isc__nm_async_udplisten(isc__networker_t *worker, isc__netievent_t *ev0) {
 	uv_send_buffer_size(&sock->uv_handle.handle,
 			    &(int){ ISC_SEND_BUFFER_SIZE });
 #endif
+#ifdef HAVE_LIBURING
+	if (atomic_load(&sock->mgr->uring) &&
+	    isc__nm_uring_udplisten(worker, sock)) {
+		return;
+	}
+#endif /* HAVE_LIBURING */
+#ifdef HAVE_RECVMMSG
+	if (udp_recvmmsg_start(worker, sock)) {
+		return;
+	}
+#endif /* HAVE_RECVMMSG */
 	uv_udp_recv_start(&sock->uv_handle.udp, udp_alloc_cb, udp_recv_cb);
 }
 
@@ -223,19 +306,74 @@ udp_stop_cb(uv_handle_t *handle) {
 	isc__nmsocket_detach((isc_nmsocket_t **)&sock->uv_handle.udp.data);
 }
 
+#ifdef HAVE_LIBURING
+void
+isc__nm_udp_recvstopped(isc_nmsocket_t *sock) {
+	REQUIRE(VALID_NMSOCK(sock));
+	REQUIRE(sock->tid == isc_nm_tid());
+	REQUIRE(atomic_load(&sock->closing));
+
+	uv_close(&sock->uv_handle.handle, udp_stop_cb);
+}
+#endif /* HAVE_LIBURING */
+
+#ifdef HAVE_RECVMMSG
+/*
+ * The receive poller is closed before the UDP handle so that the socket
+ * stays attached until both are gone.
+ */
+static void
+udp_recvpoll_close_cb(uv_handle_t *handle) {
+	isc_nmsocket_t *sock = uv_handle_get_data(handle);
+
+	(void)close(sock->recvfd);
+	sock->recvfd = -1;
+	uv_close(&sock->uv_handle.handle, udp_stop_cb);
+}
+#endif /* HAVE_RECVMMSG */
+
+/*
+ * Close the handles of a listening child socket, starting with whichever
+ * is used for receiving.
+ */
+static void
+udp_close_child(isc_nmsocket_t *sock) {
+#ifdef HAVE_LIBURING
+	if (sock->uring) {
+		isc__nm_uring_udpstop(sock);
+		return;
+	}
+#endif /* HAVE_LIBURING */
+#ifdef HAVE_RECVMMSG
+	if (sock->recvmmsg) {
+		uv_close((uv_handle_t *)&sock->recvpoll, udp_recvpoll_close_cb);
+		return;
+	}
+#endif /* HAVE_RECVMMSG */
+	uv_close(&sock->uv_handle.handle, udp_stop_cb);
+}
+
 static void
 stop_udp_child(isc_nmsocket_t *sock) {
 	REQUIRE(sock->type == isc_nm_udpsocket);
 	REQUIRE(sock->tid == isc_nm_tid());
 
+#ifdef HAVE_RECVMMSG
+	if (sock->recvmmsg) {
+		uv_poll_stop(&sock->recvpoll);
+	} else {
+		uv_udp_recv_stop(&sock->uv_handle.udp);
+	}
+#else
 	uv_udp_recv_stop(&sock->uv_handle.udp);
+#endif /* HAVE_RECVMMSG */
 
 	if (!atomic_compare_exchange_strong(&sock->closing, &(bool){ false },
 					    true)) {
 		return;
 	}
 
-	uv_close(&sock->uv_handle.handle, udp_stop_cb);
+	udp_close_child(sock);
 
 	LOCK(&sock->parent->lock);
 	atomic_fetch_sub(&sock->parent->rchildren, 1);
@@ -360,6 +498,16 @@ udp_recv_cb(uv_udp_t *handle, ssize_t nrecv, const uv_buf_t *buf,
 	UNUSED(flags);
 #endif
 
+	/*
+	 * A read error on a connected socket is passed on to the
+	 * caller; this is how an ICMP port unreachable message is
+	 * reported.
+	 */
+	if (nrecv < 0 && atomic_load(&sock->client)) {
+		failed_read_cb(sock, isc__nm_uverr2result(nrecv));
+		goto done;
+	}
+
 	/*
 	 * Three possible reasons to return now without processing:
 	 * - If addr == NULL, in which case it's the end of stream;
@@ -397,11 +545,6 @@ udp_recv_cb(uv_udp_t *handle, ssize_t nrecv, const uv_buf_t *buf,
 	}
 
 	if (atomic_load(&sock->client)) {
-		if (nrecv < 0) {
-			failed_read_cb(sock, isc__nm_uverr2result(nrecv));
-			return;
-		}
-
 		cb(sock->statichandle, ISC_R_SUCCESS, &region, cbarg);
 	} else {
 		result = isc_sockaddr_fromsockaddr(&sockaddr, addr);
@@ -409,6 +552,7 @@ udp_recv_cb(uv_udp_t *handle, ssize_t nrecv, const uv_buf_t *buf,
 
 		nmhandle = isc__nmhandle_get(sock, &sockaddr, NULL);
 
+		atomic_fetch_add_relaxed(&sock->nreceived, 1);
 		cb(nmhandle, ISC_R_SUCCESS, &region, cbarg);
 
 		/*
@@ -424,6 +568,169 @@ done:
 	}
 }
 
+#ifdef HAVE_RECVMMSG
+STATIC_ASSERT(ISC_NETMGR_RECVBUF_SIZE >=
+		      ISC_NETMGR_RECVMMSG_WIDTH * 65536,
+	      "recvbuf is too small for the recvmmsg() overflow areas");
+
+/*
+ * Start reading a listening socket with recvmmsg().  The descriptor is
+ * duplicated because libuv allows only one watcher per descriptor, and
+ * the original one remains in use by the uv_udp_t handle for sending.
+ * Returns false if libuv should be used for reading instead.
+ */
+static bool
+udp_recvmmsg_start(isc__networker_t *worker, isc_nmsocket_t *sock) {
+	int r;
+
+	REQUIRE(sock->parent != NULL);
+
+	sock->recvfd = dup(sock->fd);
+	if (sock->recvfd < 0) {
+		return (false);
+	}
+
+	r = uv_poll_init(&worker->loop, &sock->recvpoll, sock->recvfd);
+	if (r != 0) {
+		(void)close(sock->recvfd);
+		sock->recvfd = -1;
+		return (false);
+	}
+	uv_handle_set_data((uv_handle_t *)&sock->recvpoll, sock);
+	sock->recvmmsg = true;
+
+	r = uv_poll_start(&sock->recvpoll, UV_READABLE, udp_recvmmsg_cb);
+	RUNTIME_CHECK(r == 0);
+
+	return (true);
+}
+
+void
+isc__nm_udp_deliver(isc_nmsocket_t *sock, isc__nm_recvslot_t *slot,
+		    size_t len, const struct sockaddr *addr) {
+	isc__networker_t *worker = &sock->mgr->workers[sock->tid];
+	isc_nmhandle_t *nmhandle = NULL;
+	isc_sockaddr_t sockaddr;
+	isc_region_t region;
+	isc_result_t result;
+	uint32_t maxudp = atomic_load(&sock->mgr->maxudp);
+
+	if ((maxudp != 0 && len > maxudp) || !isc__nmsocket_active(sock)) {
+		isc__nm_recvslot_put(worker, &slot);
+		return;
+	}
+
+	result = isc_sockaddr_fromsockaddr(&sockaddr, addr);
+	RUNTIME_CHECK(result == ISC_R_SUCCESS);
+
+	nmhandle = isc__nmhandle_get(sock, &sockaddr, NULL);
+	nmhandle->recvslot = slot;
+
+	region.base = slot->base;
+	region.length = len;
+
+	atomic_fetch_add_relaxed(&sock->nreceived, 1);
+	sock->recv_cb(nmhandle, ISC_R_SUCCESS, &region, sock->recv_cbarg);
+
+	/*
+	 * If the recv callback wants to hold on to the handle (and
+	 * with it the data), it needs to attach to it.
+	 */
+	isc_nmhandle_detach(&nmhandle);
+}
+
+static void
+udp_recvmmsg_cb(uv_poll_t *handle, int status, int events) {
+	isc_nmsocket_t *sock = uv_handle_get_data((uv_handle_t *)handle);
+	isc__networker_t *worker = NULL;
+	isc__nm_recvslot_t *slots[ISC_NETMGR_RECVMMSG_WIDTH];
+	struct mmsghdr msgs[ISC_NETMGR_RECVMMSG_WIDTH];
+	struct iovec iovs[ISC_NETMGR_RECVMMSG_WIDTH][2];
+	struct sockaddr_storage addrs[ISC_NETMGR_RECVMMSG_WIDTH];
+	int n;
+
+	UNUSED(events);
+
+	REQUIRE(VALID_NMSOCK(sock));
+	REQUIRE(sock->tid == isc_nm_tid());
+
+	if (status < 0) {
+		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_RECVFAIL]);
+		return;
+	}
+
+	if (!isc__nmsocket_active(sock)) {
+		return;
+	}
+
+	worker = &sock->mgr->workers[sock->tid];
+	INSIST(!worker->recvbuf_inuse);
+
+	for (int i = 0; i < ISC_NETMGR_RECVMMSG_WIDTH; i++) {
+		slots[i] = isc__nm_recvslot_get(worker, 0);
+		iovs[i][0] = (struct iovec){ .iov_base = slots[i]->base,
+					     .iov_len = slots[i]->size };
+		iovs[i][1] = (struct iovec){
+			.iov_base = worker->recvbuf + i * 65536,
+			.iov_len = 65536
+		};
+		msgs[i] = (struct mmsghdr){
+			.msg_hdr = { .msg_name = &addrs[i],
+				     .msg_namelen = sizeof(addrs[i]),
+				     .msg_iov = iovs[i],
+				     .msg_iovlen = 2 }
+		};
+	}
+
+	do {
+		n = recvmmsg(sock->recvfd, msgs, ISC_NETMGR_RECVMMSG_WIDTH,
+			     MSG_DONTWAIT, NULL);
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_RECVFAIL]);
+	}
+
+	/*
+	 * Move datagrams that didn't fit into their slot out of 'recvbuf'
+	 * before any of them is delivered, so 'recvbuf' is free again
+	 * when the receive callbacks run.
+	 */
+	for (int i = 0; i < n; i++) {
+		size_t len = msgs[i].msg_len;
+		isc__nm_recvslot_t *slot = NULL;
+
+		if ((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+			isc__nm_recvslot_put(worker, &slots[i]);
+			continue;
+		}
+
+		if (len <= slots[i]->size) {
+			continue;
+		}
+
+		slot = isc__nm_recvslot_get(worker, len);
+		memmove(slot->base, slots[i]->base, slots[i]->size);
+		memmove(slot->base + slots[i]->size, iovs[i][1].iov_base,
+			len - slots[i]->size);
+		isc__nm_recvslot_put(worker, &slots[i]);
+		slots[i] = slot;
+	}
+
+	for (int i = (n > 0) ? n : 0; i < ISC_NETMGR_RECVMMSG_WIDTH; i++) {
+		isc__nm_recvslot_put(worker, &slots[i]);
+	}
+
+	for (int i = 0; i < n; i++) {
+		if (slots[i] == NULL) {
+			continue;
+		}
+		isc__nm_udp_deliver(sock, slots[i], msgs[i].msg_len,
+				    (struct sockaddr *)&addrs[i]);
+	}
+}
+#endif /* HAVE_RECVMMSG */
+
 /*
  * Send the data in 'region' to a peer via a UDP socket. We try to find
  * a proper sibling/child socket so that we won't have to jump to another
@@ -460,14 +767,11 @@ isc__nm_udp_send(isc_nmhandle_t *handle, isc_region_t *region, isc_nm_cb_t cb,
 
 	/*
 	 * We're simulating a firewall blocking UDP packets bigger than
-	 * 'maxudp' bytes, for testing purposes.
-	 *
-	 * The client would ordinarily have unreferenced the handle
-	 * in the callback, but that won't happen in this case, so
-	 * we need to do so here.
+	 * 'maxudp' bytes, for testing purposes: the packet is dropped,
+	 * but as far as the caller can tell, it was sent.
 	 */
 	if (maxudp != 0 && region->length > maxudp) {
-		isc_nmhandle_detach(&handle);
+		cb(handle, ISC_R_SUCCESS, cbarg);
 		return;
 	}
 
@@ -514,7 +818,7 @@ isc__nm_udp_send(isc_nmhandle_t *handle, isc_region_t *region, isc_nm_cb_t cb,
 		 * the data directly, but we still need to return errors
 		 * via the callback for API consistency.
 		 */
-		isc_result_t result = udp_send_direct(rsock, uvreq, peer);
+		isc_result_t result = udp_send(rsock, uvreq, peer);
 		if (result != ISC_R_SUCCESS) {
 			isc__nm_incstats(rsock->mgr,
 					 rsock->statsindex[STATID_SENDFAIL]);
@@ -554,7 +858,7 @@ isc__nm_async_udpsend(isc__networker_t *worker, isc__netievent_t *ev0) {
 		return;
 	}
 
-	result = udp_send_direct(sock, uvreq, &ievent->peer);
+	result = udp_send(sock, uvreq, &ievent->peer);
 	if (result != ISC_R_SUCCESS) {
 		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_SENDFAIL]);
 		uvreq->cb.send(uvreq->handle, result, uvreq->cbarg);
@@ -625,6 +929,205 @@ udp_send_direct(isc_nmsocket_t *sock, isc__nm_uvreq_t *req,
 	return (ISC_R_SUCCESS);
 }
 
+#ifdef HAVE_SENDMMSG
+static void
+udp_send_complete(isc_nmsocket_t *sock, isc__nm_uvreq_t *req,
+		  isc_result_t result) {
+	if (result != ISC_R_SUCCESS) {
+		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_SENDFAIL]);
+	}
+
+	req->cb.send(req->handle, result, req->cbarg);
+	isc__nm_uvreq_put(&req, req->sock);
+}
+
+/*
+ * Write 'nreqs' messages queued for 'sock' using as few sendmmsg() calls
+ * as possible.  If the socket buffer fills up, the remaining messages are
+ * handed over to libuv, which will queue them until the socket becomes
+ * writable again.
+ */
+static void
+udp_sendmmsg(isc_nmsocket_t *sock, isc__nm_uvreq_t **reqs,
+	     unsigned int nreqs) {
+	struct mmsghdr msgs[ISC_NETMGR_SENDBATCH_MAX];
+	struct iovec iovs[ISC_NETMGR_SENDBATCH_MAX];
+	unsigned int sent = 0;
+
+	REQUIRE(nreqs <= ISC_NETMGR_SENDBATCH_MAX);
+
+	if (!isc__nmsocket_active(sock) ||
+	    uv_is_closing(&sock->uv_handle.handle) ||
+	    (sock->server != NULL && !isc__nmsocket_active(sock->server)) ||
+	    atomic_load(&sock->mgr->closing))
+	{
+		for (unsigned int i = 0; i < nreqs; i++) {
+			udp_send_complete(sock, reqs[i], ISC_R_CANCELED);
+		}
+		return;
+	}
+
+	for (unsigned int i = 0; i < nreqs; i++) {
+		isc__nm_uvreq_t *req = reqs[i];
+
+		iovs[i] = (struct iovec){ .iov_base = req->uvbuf.base,
+					  .iov_len = req->uvbuf.len };
+		msgs[i] = (struct mmsghdr){
+			.msg_hdr = { .msg_name = &req->peer.type.sa,
+				     .msg_namelen = req->peer.length,
+				     .msg_iov = &iovs[i],
+				     .msg_iovlen = 1 }
+		};
+	}
+
+	isc__nm_incstats(sock->mgr, sock->statsindex[STATID_SENDBATCH]);
+	if (sock->mgr->stats != NULL) {
+		isc_stats_add(sock->mgr->stats,
+			      sock->statsindex[STATID_SENDBATCHMSG], nreqs);
+	}
+
+	while (sent < nreqs) {
+		int r = sendmmsg(sock->fd, &msgs[sent], nreqs - sent, 0);
+		if (r > 0) {
+			for (int i = 0; i < r; i++) {
+				udp_send_complete(sock, reqs[sent++],
+						  ISC_R_SUCCESS);
+			}
+			continue;
+		}
+
+		if (errno == EINTR) {
+			continue;
+		}
+
+		if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		    errno == ENOBUFS) {
+			while (sent < nreqs) {
+				isc__nm_uvreq_t *req = reqs[sent++];
+				isc_result_t result =
+					udp_send_direct(sock, req, &req->peer);
+				if (result != ISC_R_SUCCESS) {
+					udp_send_complete(sock, req, result);
+				}
+			}
+			break;
+		}
+
+		/*
+		 * The first unsent message could not be sent at all;
+		 * report the error for it and carry on with the rest.
+		 */
+		udp_send_complete(sock, reqs[sent++],
+				  isc_errno_toresult(errno));
+	}
+}
+
+void
+isc__nm_udp_sendbatch_flush(isc__networker_t *worker) {
+	isc__nm_sendbatch_t *batch = worker->sendbatch;
+	isc__nm_sendbatch_t pending;
+
+	REQUIRE(worker->id == isc_nm_tid());
+
+	/*
+	 * The send callbacks may queue new messages, so take the
+	 * current contents of the batch out of the way first.
+	 */
+	pending.count = batch->count;
+	memmove(pending.entries, batch->entries,
+		batch->count * sizeof(batch->entries[0]));
+	batch->count = 0;
+
+	/*
+	 * sendmmsg() works on a single socket, so group the messages by
+	 * the listening socket they are to be sent from.  A worker only
+	 * owns a handful of those, one per interface.
+	 */
+	for (unsigned int i = 0; i < pending.count; i++) {
+		isc__nm_uvreq_t *reqs[ISC_NETMGR_SENDBATCH_MAX];
+		isc_nmsocket_t *sock = pending.entries[i].sock;
+		unsigned int nreqs = 0;
+
+		if (pending.entries[i].req == NULL) {
+			continue;
+		}
+
+		for (unsigned int j = i; j < pending.count; j++) {
+			if (pending.entries[j].sock == sock &&
+			    pending.entries[j].req != NULL) {
+				reqs[nreqs++] = pending.entries[j].req;
+				pending.entries[j].req = NULL;
+			}
+		}
+
+		udp_sendmmsg(sock, reqs, nreqs);
+	}
+}
+
+/*
+ * Queue a message in the worker's transmit batch, flushing the batch if
+ * it is full or if its oldest message has been waiting too long.
+ */
+static void
+udp_send_batch(isc_nmsocket_t *sock, isc__nm_uvreq_t *req, isc_sockaddr_t *peer,
+	       uint32_t size) {
+	isc__networker_t *worker = &sock->mgr->workers[sock->tid];
+	isc__nm_sendbatch_t *batch = worker->sendbatch;
+	uint32_t deadline = atomic_load_relaxed(&sock->mgr->sendbatch_deadline);
+	uint64_t now = uv_hrtime();
+
+	req->peer = *peer;
+
+	if (batch->count == 0) {
+		batch->start = now;
+	}
+	batch->entries[batch->count].sock = sock;
+	batch->entries[batch->count].req = req;
+	batch->count++;
+
+	if (batch->count >= size ||
+	    (deadline > 0 && now - batch->start >= (uint64_t)deadline * 1000))
+	{
+		isc__nm_udp_sendbatch_flush(worker);
+	}
+}
+#endif /* HAVE_SENDMMSG */
+
+/*
+ * Send a message on a UDP socket owned by the current thread, either
+ * right away or, for listening sockets with batching enabled, as part
+ * of the worker's next sendmmsg() call.
+ */
+static isc_result_t
+udp_send(isc_nmsocket_t *sock, isc__nm_uvreq_t *req, isc_sockaddr_t *peer) {
+#ifdef HAVE_SENDMMSG
+	uint32_t size = atomic_load_relaxed(&sock->mgr->sendbatch_size);
+#endif /* HAVE_SENDMMSG */
+
+	REQUIRE(VALID_NMSOCK(sock));
+	REQUIRE(VALID_UVREQ(req));
+	REQUIRE(sock->tid == isc_nm_tid());
+
+#ifdef HAVE_LIBURING
+	/*
+	 * Messages sent through io_uring are batched by the submission
+	 * queue already.
+	 */
+	if (sock->uring) {
+		return (isc__nm_uring_udpsend(sock, req, peer));
+	}
+#endif /* HAVE_LIBURING */
+
+#ifdef HAVE_SENDMMSG
+	if (size > 1 && sock->parent != NULL) {
+		udp_send_batch(sock, req, peer, size);
+		return (ISC_R_SUCCESS);
+	}
+#endif /* HAVE_SENDMMSG */
+
+	return (udp_send_direct(sock, req, peer));
+}
+
 static int
 udp_connect_direct(isc_nmsocket_t *sock, isc__nm_uvreq_t *req) {
 	isc__networker_t *worker = NULL;
@@ -809,7 +1312,7 @@ isc_nm_udpconnect(isc_nm_t *mgr, isc_nmiface_t *local, isc_nmiface_t *peer,
 	RUNTIME_CHECK(result == ISC_R_SUCCESS ||
 		      result == ISC_R_NOTIMPLEMENTED);
 
-	(void)isc__nm_socket_incoming_cpu(sock->fd);
+	(void)isc__nm_socket_incoming_cpu(sock->fd, -1);
 
 	(void)isc__nm_socket_dontfrag(sock->fd, sa_family);
 
@@ -861,8 +1364,15 @@ udp_read_cb(uv_udp_t *handle, ssize_t nrecv, const uv_buf_t *buf,
 	    const struct sockaddr *addr, unsigned flags) {
 	isc_nmsocket_t *sock = uv_handle_get_data((uv_handle_t *)handle);
 
+	/*
+	 * Stop reading after each datagram or error, before the callback
+	 * is called, so that the callback can start reading again.  An
+	 * empty read only returns the buffer.
+	 */
+	if (addr != NULL || nrecv < 0) {
+		uv_udp_recv_stop(&sock->uv_handle.udp);
+	}
 	udp_recv_cb(handle, nrecv, buf, addr, flags);
-	uv_udp_recv_stop(&sock->uv_handle.udp);
 }
 
 static void
@@ -911,17 +1421,11 @@ isc__nm_async_udpread(isc__networker_t *worker, isc__netievent_t *ev0) {
 	isc__netievent_udpread_t *ievent = (isc__netievent_udpread_t *)ev0;
 	isc_nmsocket_t *sock = ievent->sock;
 
-	if (!isc__nmsocket_active(sock)) {
-		failed_read_cb(sock, ISC_R_CANCELED);
-		return;
-	}
-
-	if (sock->server != NULL && !isc__nmsocket_active(sock->server)) {
-		failed_read_cb(sock, ISC_R_CANCELED);
-		return;
-	}
-
-	if (atomic_load(&sock->mgr->closing)) {
+	if (!isc__nmsocket_active(sock) ||
+	    (sock->server != NULL && !isc__nmsocket_active(sock->server)) ||
+	    atomic_load(&sock->mgr->closing))
+	{
+		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_RECVFAIL]);
 		failed_read_cb(sock, ISC_R_CANCELED);
 		return;
 	}
@@ -950,25 +1454,11 @@ isc__nm_udp_read(isc_nmhandle_t *handle, isc_nm_recv_cb_t cb, void *cbarg) {
 	REQUIRE(VALID_NMSOCK(handle->sock));
 	REQUIRE(handle->sock->type == isc_nm_udpsocket);
 
-	if (!isc__nmsocket_active(sock)) {
-		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_RECVFAIL]);
-		cb(handle, ISC_R_CANCELED, NULL, cbarg);
-		return;
-	}
-
-	if (sock->server != NULL && !isc__nmsocket_active(sock->server)) {
-		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_SENDFAIL]);
-		cb(handle, ISC_R_CANCELED, NULL, cbarg);
-		return;
-	}
-
-	if (atomic_load(&sock->mgr->closing)) {
-		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_SENDFAIL]);
-		cb(handle, ISC_R_CANCELED, NULL, cbarg);
-		return;
-	}
-
-	REQUIRE(sock->tid == isc_nm_tid());
+	/*
+	 * If the socket is going away, the callback is called from the
+	 * network thread, like for any other failed read, and it is not
+	 * called again.
+	 */
 	sock->recv_cb = cb;
 	sock->recv_cbarg = cbarg;
 
@@ -0,0 +1,508 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <errno.h>
+#include <liburing.h>
+#include <string.h>
+#include <unistd.h>
+#include <uv.h>
+
+#include <isc/atomic.h>
+#include <isc/errno.h>
+#include <isc/log.h>
+#include <isc/mem.h>
+#include <isc/netmgr.h>
+#include <isc/result.h>
+#include <isc/sockaddr.h>
+#include <isc/util.h>
+
+#include "netmgr-int.h"
+#include "uv-compat.h"
+
+/*
+ * io_uring support for listening UDP sockets.
+ *
+ * Each worker that has a UDP listener using io_uring gets its own ring.
+ * Every listening socket has a multishot receive queued that picks its
+ * buffers from a buffer ring shared by all the worker's sockets; sends
+ * are queued as individual sendmsg requests.  Requests are submitted
+ * once per event loop iteration from a uv_check handle, and completions
+ * are reaped when libuv reports the ring's file descriptor as readable,
+ * so the rest of the worker keeps running on the libuv loop as before.
+ */
+
+/*
+ * The kernel hands back the 64-bit user data of a request with each of
+ * its completions.  The objects the requests refer to are at least
+ * 8-byte aligned, so the low bits are used to tell the request types
+ * apart.
+ */
+#define URING_RECV	0x0
+#define URING_SEND	0x1
+#define URING_CANCEL	0x2
+#define URING_TYPEMASK	0x3
+#define URING_DATA(p, t) ((uint64_t)(uintptr_t)(p) | (t))
+#define URING_PTR(d)	 ((void *)(uintptr_t)((d) & ~(uint64_t)URING_TYPEMASK))
+
+#define URING_BGID	 0  /* buffer group of the buffer ring */
+#define URING_REAP_BATCH 64 /* completions handled at a time */
+
+/*
+ * Received datagrams are passed on in the buffer they were received
+ * into, unless fewer than a quarter of the buffers are left to the
+ * kernel; then they're copied, and the buffer given back straight away,
+ * so that clients which hold on to their requests for a long time cannot
+ * starve the receive.
+ */
+#define URING_LOWATER (ISC_NETMGR_URING_BUFFERS / 4)
+
+struct isc__nm_uring {
+	struct io_uring ring;
+	uv_poll_t poll;	  /* readable when completions are pending */
+	uv_check_t check; /* submits queued requests */
+	struct io_uring_buf_ring *bufring;
+	unsigned char *bufs;
+	isc__nm_recvslot_t slots[ISC_NETMGR_URING_BUFFERS];
+	unsigned int nfree;  /* buffers owned by the kernel */
+	unsigned int nsends; /* sends in flight */
+	struct msghdr msg;   /* layout of the multishot receive buffers */
+};
+
+static void
+uring_poll_cb(uv_poll_t *handle, int status, int events);
+
+static void
+uring_check_cb(uv_check_t *handle);
+
+static struct io_uring_sqe *
+uring_get_sqe(struct isc__nm_uring *uring) {
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&uring->ring);
+
+	if (sqe == NULL) {
+		/* The submission queue is full, make room */
+		(void)io_uring_submit(&uring->ring);
+		sqe = io_uring_get_sqe(&uring->ring);
+	}
+
+	return (sqe);
+}
+
+static void
+uring_addbuf(struct isc__nm_uring *uring, unsigned short bid) {
+	io_uring_buf_ring_add(uring->bufring,
+			      uring->bufs + (size_t)bid *
+						    ISC_NETMGR_URING_BUFSIZE,
+			      ISC_NETMGR_URING_BUFSIZE, bid,
+			      io_uring_buf_ring_mask(ISC_NETMGR_URING_BUFFERS),
+			      0);
+	io_uring_buf_ring_advance(uring->bufring, 1);
+	uring->nfree++;
+}
+
+static isc_result_t
+uring_init(isc__networker_t *worker) {
+	isc_mem_t *mctx = worker->mgr->mctx;
+	struct isc__nm_uring *uring = NULL;
+	int r;
+
+	uring = isc_mem_get(mctx, sizeof(*uring));
+	*uring = (struct isc__nm_uring){ .nfree = 0 };
+
+	r = io_uring_queue_init(ISC_NETMGR_URING_ENTRIES, &uring->ring, 0);
+	if (r < 0) {
+		isc_mem_put(mctx, uring, sizeof(*uring));
+		return (isc_errno_toresult(-r));
+	}
+
+	uring->bufring = io_uring_setup_buf_ring(&uring->ring,
+						 ISC_NETMGR_URING_BUFFERS,
+						 URING_BGID, 0, &r);
+	if (uring->bufring == NULL) {
+		io_uring_queue_exit(&uring->ring);
+		isc_mem_put(mctx, uring, sizeof(*uring));
+		return (isc_errno_toresult(-r));
+	}
+
+	uring->bufs = isc_mem_get(mctx, ISC_NETMGR_URING_BUFFERS *
+						ISC_NETMGR_URING_BUFSIZE);
+	for (unsigned int i = 0; i < ISC_NETMGR_URING_BUFFERS; i++) {
+		uring_addbuf(uring, (unsigned short)i);
+	}
+
+	uring->msg.msg_namelen = sizeof(struct sockaddr_storage);
+
+	r = uv_poll_init(&worker->loop, &uring->poll, uring->ring.ring_fd);
+	RUNTIME_CHECK(r == 0);
+	uv_handle_set_data((uv_handle_t *)&uring->poll, worker);
+	r = uv_poll_start(&uring->poll, UV_READABLE, uring_poll_cb);
+	RUNTIME_CHECK(r == 0);
+
+	r = uv_check_init(&worker->loop, &uring->check);
+	RUNTIME_CHECK(r == 0);
+	uv_handle_set_data((uv_handle_t *)&uring->check, worker);
+	r = uv_check_start(&uring->check, uring_check_cb);
+	RUNTIME_CHECK(r == 0);
+
+	worker->uring = uring;
+
+	return (ISC_R_SUCCESS);
+}
+
+static void
+uring_recv_arm(isc__networker_t *worker, isc_nmsocket_t *sock) {
+	struct io_uring_sqe *sqe = uring_get_sqe(worker->uring);
+
+	RUNTIME_CHECK(sqe != NULL);
+
+	io_uring_prep_recvmsg_multishot(sqe, sock->fd, &worker->uring->msg, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BGID;
+	io_uring_sqe_set_data64(sqe, URING_DATA(sock, URING_RECV));
+
+	sock->uring_armed = true;
+}
+
+static void
+uring_recv_buffer(isc__networker_t *worker, isc_nmsocket_t *sock,
+		  unsigned short bid, int res) {
+	struct isc__nm_uring *uring = worker->uring;
+	unsigned char *buf = uring->bufs + (size_t)bid *
+						   ISC_NETMGR_URING_BUFSIZE;
+	isc__nm_recvslot_t *slot = NULL;
+	struct io_uring_recvmsg_out *out = NULL;
+	struct sockaddr_storage addr;
+	unsigned char *payload = NULL;
+	size_t len;
+
+	INSIST(uring->nfree > 0);
+	uring->nfree--;
+
+	out = io_uring_recvmsg_validate(buf, res, &uring->msg);
+	if (out == NULL || (out->flags & MSG_TRUNC) != 0 ||
+	    out->namelen > sizeof(addr))
+	{
+		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_RECVFAIL]);
+		uring_addbuf(uring, bid);
+		return;
+	}
+
+	memmove(&addr, io_uring_recvmsg_name(out), out->namelen);
+	payload = io_uring_recvmsg_payload(out, &uring->msg);
+	len = io_uring_recvmsg_payload_length(out, res, &uring->msg);
+
+	if (uring->nfree < URING_LOWATER) {
+		slot = isc__nm_recvslot_get(worker, len);
+		memmove(slot->base, payload, len);
+		uring_addbuf(uring, bid);
+	} else {
+		slot = &uring->slots[bid];
+		*slot = (isc__nm_recvslot_t){ .base = payload,
+					      .size = len,
+					      .uring = true,
+					      .bid = bid };
+	}
+
+	isc__nm_udp_deliver(sock, slot, len, (struct sockaddr *)&addr);
+}
+
+static void
+uring_recv_done(isc__networker_t *worker, isc_nmsocket_t *sock, int res,
+		unsigned int flags) {
+	REQUIRE(VALID_NMSOCK(sock));
+	REQUIRE(sock->uring_armed);
+
+	if ((flags & IORING_CQE_F_MORE) == 0) {
+		sock->uring_armed = false;
+	}
+
+	if ((flags & IORING_CQE_F_BUFFER) != 0) {
+		uring_recv_buffer(worker, sock,
+				  (unsigned short)(flags >>
+						   IORING_CQE_BUFFER_SHIFT),
+				  res);
+	} else if (res < 0 && res != -ECANCELED && res != -ENOBUFS) {
+		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_RECVFAIL]);
+	}
+
+	if (sock->uring_armed) {
+		return;
+	}
+
+	/*
+	 * The multishot receive has ended; it is cancelled when the
+	 * socket is closed, and the kernel also ends it when it runs out
+	 * of buffers.
+	 */
+	if (atomic_load(&sock->closing)) {
+		if (!sock->uring_cancel) {
+			isc__nm_udp_recvstopped(sock);
+		}
+	} else if (isc__nmsocket_active(sock)) {
+		uring_recv_arm(worker, sock);
+	}
+}
+
+static void
+uring_send_done(isc__networker_t *worker, isc__nm_uvreq_t *req, int res) {
+	isc_nmsocket_t *sock = req->sock;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	REQUIRE(VALID_UVREQ(req));
+	INSIST(worker->uring->nsends > 0);
+
+	worker->uring->nsends--;
+
+	if (res < 0) {
+		result = isc_errno_toresult(-res);
+		isc__nm_incstats(sock->mgr, sock->statsindex[STATID_SENDFAIL]);
+	}
+
+	req->cb.send(req->handle, result, req->cbarg);
+	isc__nm_uvreq_put(&req, sock);
+}
+
+static void
+uring_cancel_done(isc_nmsocket_t *sock, int res) {
+	REQUIRE(VALID_NMSOCK(sock));
+	REQUIRE(sock->uring_cancel);
+
+	sock->uring_cancel = false;
+
+	if (sock->uring_armed) {
+		if (res == -ENOENT) {
+			/*
+			 * The receive was re-armed after the cancel
+			 * request had been queued; try again.
+			 */
+			isc__nm_uring_udpstop(sock);
+		}
+		return;
+	}
+
+	isc__nm_udp_recvstopped(sock);
+}
+
+static void
+uring_reap(isc__networker_t *worker) {
+	struct isc__nm_uring *uring = worker->uring;
+	struct io_uring_cqe *cqes[URING_REAP_BATCH];
+	struct {
+		uint64_t data;
+		int res;
+		unsigned int flags;
+	} done[URING_REAP_BATCH];
+	unsigned int n;
+
+	while ((n = io_uring_peek_batch_cqe(&uring->ring, cqes,
+					    URING_REAP_BATCH)) > 0)
+	{
+		/*
+		 * Handling the completions may queue new requests, so
+		 * release the completion queue entries first.
+		 */
+		for (unsigned int i = 0; i < n; i++) {
+			done[i].data = io_uring_cqe_get_data64(cqes[i]);
+			done[i].res = cqes[i]->res;
+			done[i].flags = cqes[i]->flags;
+		}
+		io_uring_cq_advance(&uring->ring, n);
+
+		for (unsigned int i = 0; i < n; i++) {
+			void *ptr = URING_PTR(done[i].data);
+
+			switch (done[i].data & URING_TYPEMASK) {
+			case URING_RECV:
+				uring_recv_done(worker, ptr, done[i].res,
+						done[i].flags);
+				break;
+			case URING_SEND:
+				uring_send_done(worker, ptr, done[i].res);
+				break;
+			case URING_CANCEL:
+				uring_cancel_done(ptr, done[i].res);
+				break;
+			default:
+				INSIST(0);
+				ISC_UNREACHABLE();
+			}
+		}
+	}
+}
+
+static void
+uring_poll_cb(uv_poll_t *handle, int status, int events) {
+	isc__networker_t *worker = uv_handle_get_data((uv_handle_t *)handle);
+
+	UNUSED(status);
+	UNUSED(events);
+
+	uring_reap(worker);
+}
+
+static void
+uring_check_cb(uv_check_t *handle) {
+	isc__networker_t *worker = uv_handle_get_data((uv_handle_t *)handle);
+
+	if (io_uring_sq_ready(&worker->uring->ring) > 0) {
+		(void)io_uring_submit(&worker->uring->ring);
+	}
+}
+
+bool
+isc__nm_uring_udplisten(isc__networker_t *worker, isc_nmsocket_t *sock) {
+	isc_result_t result;
+
+	REQUIRE(VALID_NMSOCK(sock));
+	REQUIRE(sock->type == isc_nm_udpsocket);
+	REQUIRE(sock->parent != NULL);
+	REQUIRE(sock->tid == isc_nm_tid());
+	REQUIRE(worker->id == sock->tid);
+
+	if (worker->uring == NULL) {
+		if (worker->uring_failed) {
+			return (false);
+		}
+
+		result = uring_init(worker);
+		if (result != ISC_R_SUCCESS) {
+			worker->uring_failed = true;
+			isc_log_write(isc_lctx, ISC_LOGCATEGORY_GENERAL,
+				      ISC_LOGMODULE_NETMGR, ISC_LOG_WARNING,
+				      "io_uring is not available, "
+				      "using libuv instead: %s",
+				      isc_result_totext(result));
+			return (false);
+		}
+	}
+
+	sock->uring = true;
+	uring_recv_arm(worker, sock);
+
+	return (true);
+}
+
+void
+isc__nm_uring_udpstop(isc_nmsocket_t *sock) {
+	isc__networker_t *worker = NULL;
+	struct io_uring_sqe *sqe = NULL;
+
+	REQUIRE(VALID_NMSOCK(sock));
+	REQUIRE(sock->uring);
+	REQUIRE(sock->tid == isc_nm_tid());
+
+	if (!sock->uring_armed) {
+		isc__nm_udp_recvstopped(sock);
+		return;
+	}
+
+	if (sock->uring_cancel) {
+		return;
+	}
+
+	worker = &sock->mgr->workers[sock->tid];
+	sqe = uring_get_sqe(worker->uring);
+	RUNTIME_CHECK(sqe != NULL);
+
+	io_uring_prep_cancel64(sqe, URING_DATA(sock, URING_RECV), 0);
+	io_uring_sqe_set_data64(sqe, URING_DATA(sock, URING_CANCEL));
+	sock->uring_cancel = true;
+}
+
+isc_result_t
+isc__nm_uring_udpsend(isc_nmsocket_t *sock, isc__nm_uvreq_t *req,
+		      isc_sockaddr_t *peer) {
+	isc__networker_t *worker = NULL;
+	struct io_uring_sqe *sqe = NULL;
+
+	REQUIRE(VALID_NMSOCK(sock));
+	REQUIRE(VALID_UVREQ(req));
+	REQUIRE(sock->uring);
+	REQUIRE(sock->tid == isc_nm_tid());
+
+	if (!isc__nmsocket_active(sock)) {
+		return (ISC_R_CANCELED);
+	}
+	if (sock->server != NULL && !isc__nmsocket_active(sock->server)) {
+		return (ISC_R_CANCELED);
+	}
+	if (atomic_load(&sock->mgr->closing)) {
+		return (ISC_R_CANCELED);
+	}
+
+	worker = &sock->mgr->workers[sock->tid];
+	sqe = uring_get_sqe(worker->uring);
+	if (sqe == NULL) {
+		return (ISC_R_NORESOURCES);
+	}
+
+	if (peer != &req->peer) {
+		req->peer = *peer;
+	}
+
+	req->uv_req.uring.iov = (struct iovec){ .iov_base = req->uvbuf.base,
+						.iov_len = req->uvbuf.len };
+	req->uv_req.uring.msg = (struct msghdr){
+		.msg_name = &req->peer.type.sa,
+		.msg_namelen = req->peer.length,
+		.msg_iov = &req->uv_req.uring.iov,
+		.msg_iovlen = 1
+	};
+
+	io_uring_prep_sendmsg(sqe, sock->fd, &req->uv_req.uring.msg, 0);
+	io_uring_sqe_set_data64(sqe, URING_DATA(req, URING_SEND));
+	worker->uring->nsends++;
+
+	return (ISC_R_SUCCESS);
+}
+
+void
+isc__nm_uring_putbuf(isc__networker_t *worker, isc__nm_recvslot_t *slot) {
+	REQUIRE(worker->uring != NULL);
+	REQUIRE(slot->uring);
+	REQUIRE(slot == &worker->uring->slots[slot->bid]);
+
+	uring_addbuf(worker->uring, slot->bid);
+}
+
+void
+isc__nm_uring_shutdown(isc__networker_t *worker) {
+	struct isc__nm_uring *uring = worker->uring;
+
+	if (uring == NULL) {
+		return;
+	}
+
+	while (uring->nsends > 0) {
+		(void)io_uring_submit_and_wait(&uring->ring, 1);
+		uring_reap(worker);
+	}
+
+	uv_close((uv_handle_t *)&uring->poll, NULL);
+	uv_close((uv_handle_t *)&uring->check, NULL);
+}
+
+void
+isc__nm_uring_destroy(isc__networker_t *worker) {
+	struct isc__nm_uring *uring = worker->uring;
+	isc_mem_t *mctx = worker->mgr->mctx;
+
+	if (uring == NULL) {
+		return;
+	}
+
+	(void)io_uring_free_buf_ring(&uring->ring, uring->bufring,
+				     ISC_NETMGR_URING_BUFFERS, URING_BGID);
+	io_uring_queue_exit(&uring->ring);
+	isc_mem_put(mctx, uring->bufs,
+		    ISC_NETMGR_URING_BUFFERS * ISC_NETMGR_URING_BUFSIZE);
+	isc_mem_put(mctx, uring, sizeof(*uring));
+	worker->uring = NULL;
+}
@@ -128,12 +128,21 @@ isc_thread_yield(void) {
 #endif /* if defined(HAVE_SCHED_YIELD) */
 }
 
+/*
+ * A negative 'cpu' lets the calling thread run on any CPU again.
+ */
 isc_result_t
 isc_thread_setaffinity(int cpu) {
 #if defined(HAVE_CPUSET_SETAFFINITY)
 	cpuset_t cpuset;
 	CPU_ZERO(&cpuset);
-	CPU_SET(cpu, &cpuset);
+	if (cpu < 0) {
+		for (int i = 0; i < CPU_SETSIZE; i++) {
+			CPU_SET(i, &cpuset);
+		}
+	} else {
+		CPU_SET(cpu, &cpuset);
+	}
 	if (cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1,
 			       sizeof(cpuset), &cpuset) != 0)
 	{
@@ -146,7 +155,13 @@ isc_thread_setaffinity(int cpu) {
 	if (cset == NULL) {
 		return (ISC_R_FAILURE);
 	}
-	cpuset_set(cpu, cset);
+	if (cpu < 0) {
+		for (cpuid_t i = 0; cpuset_set(i, cset) == 0; i++) {
+			;
+		}
+	} else {
+		cpuset_set(cpu, cset);
+	}
 	if (pthread_setaffinity_np(pthread_self(), cpuset_size(cset), cset) !=
 	    0) {
 		cpuset_destroy(cset);
@@ -156,14 +171,21 @@ isc_thread_setaffinity(int cpu) {
 #else  /* linux? */
 	cpu_set_t set;
 	CPU_ZERO(&set);
-	CPU_SET(cpu, &set);
+	if (cpu < 0) {
+		for (int i = 0; i < CPU_SETSIZE; i++) {
+			CPU_SET(i, &set);
+		}
+	} else {
+		CPU_SET(cpu, &set);
+	}
 	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) !=
 	    0) {
 		return (ISC_R_FAILURE);
 	}
 #endif /* __NetBSD__ */
 #elif defined(HAVE_PROCESSOR_BIND)
-	if (processor_bind(P_LWPID, P_MYID, cpu, NULL) != 0) {
+	if (processor_bind(P_LWPID, P_MYID, cpu < 0 ? PBIND_NONE : cpu,
+			   NULL) != 0) {
 		return (ISC_R_FAILURE);
 	}
 #else  /* if defined(HAVE_CPUSET_SETAFFINITY) */
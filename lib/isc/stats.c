@@ -111,6 +111,14 @@ isc_stats_increment(isc_stats_t *stats, isc_statscounter_t counter) {
 	atomic_fetch_add_relaxed(&stats->counters[counter], 1);
 }
 
+void
+isc_stats_add(isc_stats_t *stats, isc_statscounter_t counter, uint64_t val) {
+	REQUIRE(ISC_STATS_VALID(stats));
+	REQUIRE(counter < stats->ncounters);
+
+	atomic_fetch_add_relaxed(&stats->counters[counter], val);
+}
+
 void
 isc_stats_decrement(isc_stats_t *stats, isc_statscounter_t counter) {
 	REQUIRE(ISC_STATS_VALID(stats));
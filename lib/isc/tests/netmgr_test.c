@@ -10,12 +10,14 @@
  */
 
 #if HAVE_CMOCKA
+#include <poll.h>
 #include <sched.h> /* IWYU pragma: keep */
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 #include <uv.h>
@@ -32,9 +34,12 @@
 #include <isc/netmgr.h>
 #include <isc/nonce.h>
 #include <isc/os.h>
+#include <isc/queue.h>
 #include <isc/refcount.h>
 #include <isc/sockaddr.h>
+#include <isc/stats.h>
 #include <isc/thread.h>
+#include <isc/time.h>
 
 #include "../netmgr/netmgr-int.h"
 #include "isctest.h"
@@ -58,6 +63,7 @@ static atomic_uint_fast64_t nsends;
 
 static atomic_uint_fast64_t ssends;
 static atomic_uint_fast64_t sreads;
+static atomic_uint_fast64_t saccepts;
 
 static atomic_uint_fast64_t cconnects;
 static atomic_uint_fast64_t csends;
@@ -222,6 +228,7 @@ nm_setup(void **state) {
 	atomic_store(&csends, 0);
 	atomic_store(&creads, 0);
 	atomic_store(&sreads, 0);
+	atomic_store(&saccepts, 0);
 	atomic_store(&ssends, 0);
 	atomic_store(&ctimeouts, 0);
 	atomic_store(&cconnects, 0);
@@ -402,7 +409,8 @@ tcp_noop(void **state) {
 	isc_sockaddr_fromin6(&tcp_connect_addr, &in6addr_loopback, 0);
 
 	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&tcp_listen_addr,
-				  noop_recv_cb, NULL, 0, &listen_sock);
+				  isc_nm_steering_none, noop_recv_cb, NULL, 0,
+				  &listen_sock);
 	assert_int_equal(result, ISC_R_SUCCESS);
 
 	isc_nm_stoplistening(listen_sock);
@@ -511,6 +519,57 @@ tcp_recv_send(void **state) {
 	assert_true(atomic_load(&creads) >= atomic_load(&ctimeouts));
 }
 
+static void
+tcp_recv_send_acceptcounts(void **state) {
+	isc_nm_t **nm = (isc_nm_t **)*state;
+	isc_nm_t *listen_nm = nm[0];
+	isc_nm_t *connect_nm = nm[1];
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_nmsocket_t *listen_sock = NULL;
+	size_t nthreads = ISC_MAX(ISC_MIN(workers, 32), 1);
+	isc_thread_t threads[32] = { 0 };
+	uint64_t counts[64] = { 0 };
+	uint64_t total = 0;
+	size_t nchildren;
+
+	result = isc_nm_listentcp(listen_nm, (isc_nmiface_t *)&tcp_listen_addr,
+				  tcp_listen_accept_cb, NULL, 0, 0, NULL,
+				  &listen_sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (size_t i = 0; i < nthreads; i++) {
+		isc_thread_create(tcp_connect_thread, connect_nm, &threads[i]);
+	}
+
+	for (size_t i = 0; i < nthreads; i++) {
+		isc_thread_join(threads[i], NULL);
+	}
+
+	isc_nm_closedown(connect_nm);
+	isc_nm_stoplistening(listen_sock);
+
+	/*
+	 * Every connection was counted by the listening socket that
+	 * accepted it, whether there is one per worker or just one.
+	 */
+	nchildren = isc_nm_tcp_acceptcounts(listen_sock, counts,
+					    ARRAY_SIZE(counts));
+	assert_true(nchildren == 1 || nchildren == workers);
+	for (size_t i = 0; i < ISC_MIN(nchildren, ARRAY_SIZE(counts)); i++) {
+		total += counts[i];
+	}
+	assert_true(total > 0);
+	assert_true(total >= atomic_load(&saccepts));
+
+	isc_nmsocket_close(&listen_sock);
+	assert_null(listen_sock);
+
+	X(cconnects);
+	X(saccepts);
+	X(sreads);
+	X(ssends);
+}
+
 static void
 tcp_recv_half_send(void **state) {
 	isc_nm_t **nm = (isc_nm_t **)*state;
@@ -733,7 +792,7 @@ tcp_listen_accept_cb(isc_nmhandle_t *handle, isc_result_t result, void *cbarg) {
 
 	tcp_buffer_length = 0;
 
-	/* atomic_fetch_add(&saccept, 1); */
+	atomic_fetch_add(&saccepts, 1);
 
 	isc_nmhandle_attach(handle, &readhandle);
 	isc_nm_read(readhandle, tcp_listen_read_cb, readhandle);
@@ -793,7 +852,8 @@ udp_noop(void **state) {
 	isc_sockaddr_fromin6(&udp_connect_addr, &in6addr_loopback, 0);
 
 	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
-				  noop_recv_cb, NULL, 0, &listen_sock);
+				  isc_nm_steering_none, noop_recv_cb, NULL, 0,
+				  &listen_sock);
 	assert_int_equal(result, ISC_R_SUCCESS);
 
 	isc_nm_stoplistening(listen_sock);
@@ -932,7 +992,8 @@ udp_noresponse(void **state) {
 	isc_sockaddr_fromin6(&udp_connect_addr, &in6addr_loopback, 0);
 
 	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
-				  noop_recv_cb, NULL, 0, &listen_sock);
+				  isc_nm_steering_none, noop_recv_cb, NULL, 0,
+				  &listen_sock);
 	assert_int_equal(result, ISC_R_SUCCESS);
 
 	(void)isc_nm_udpconnect(connect_nm, (isc_nmiface_t *)&udp_connect_addr,
@@ -970,7 +1031,8 @@ udp_recv_send(void **state) {
 	isc_thread_t threads[32] = { 0 };
 
 	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
-				  udp_listen_recv_cb, NULL, 0, &listen_sock);
+				  isc_nm_steering_none, udp_listen_recv_cb, NULL,
+				  0, &listen_sock);
 	assert_int_equal(result, ISC_R_SUCCESS);
 
 	for (size_t i = 0; i < nthreads; i++) {
@@ -1004,6 +1066,267 @@ udp_recv_send(void **state) {
 	assert_true(atomic_load(&creads) >= atomic_load(&ctimeouts));
 }
 
+/*
+ * Send 'n' datagrams to the UDP listener from the calling thread after
+ * pinning it to 'cpu'.  On the loopback interface, the datagrams are
+ * then received on that same CPU.  Returns false if the thread cannot
+ * be pinned to the CPU.
+ */
+static bool
+udp_send_from_cpu(int cpu, size_t n) {
+	int fd;
+
+	if (isc_thread_setaffinity(cpu) != ISC_R_SUCCESS) {
+		return (false);
+	}
+
+	fd = socket(AF_INET6, SOCK_DGRAM, 0);
+	assert_true(fd >= 0);
+	for (size_t i = 0; i < n; i++) {
+		ssize_t r = sendto(fd, &send_magic, sizeof(send_magic), 0,
+				   &udp_listen_addr.type.sa,
+				   sizeof(udp_listen_addr.type.sin6));
+		assert_int_equal(r, sizeof(send_magic));
+	}
+	close(fd);
+
+	return (true);
+}
+
+static uint64_t
+udp_recvtotal(isc_nmsocket_t *sock, uint64_t *counts, size_t ncounts) {
+	size_t nchildren = isc_nm_udp_recvcounts(sock, counts, ncounts);
+	uint64_t total = 0;
+
+	assert_true(nchildren > 0 && nchildren <= ncounts);
+	for (size_t i = 0; i < nchildren; i++) {
+		total += counts[i];
+	}
+
+	return (total);
+}
+
+static void
+udp_recv_steered_cpu(void **state) {
+	isc_nm_t **nm = (isc_nm_t **)*state;
+	isc_nm_t *listen_nm = nm[0];
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_nmsocket_t *listen_sock = NULL;
+	uint64_t counts[64] = { 0 };
+	uint64_t before[64] = { 0 };
+	uint64_t total = 0;
+	size_t nchildren;
+	int ncpus = ISC_MIN(isc_os_ncpus(), 64);
+	int fd;
+
+	/* Skip the test if the kernel can't run steering programs. */
+	fd = socket(AF_INET6, SOCK_DGRAM, 0);
+	assert_true(fd >= 0);
+	result = isc__nm_socket_reuse_lb(fd);
+	if (result == ISC_R_SUCCESS) {
+		result = isc__nm_socket_steering(fd, isc_nm_steering_cpu, 1);
+	}
+	close(fd);
+	if (result != ISC_R_SUCCESS) {
+		skip();
+	}
+
+	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
+				  isc_nm_steering_cpu, noop_recv_cb, NULL, 0,
+				  &listen_sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	nchildren = (size_t)listen_sock->nchildren;
+
+	/*
+	 * Everything sent from a CPU must be read by the child whose
+	 * thread is pinned to that CPU, i.e. child 'cpu' modulo the
+	 * number of children, no matter in which order the children
+	 * started listening.
+	 */
+	for (int cpu = 0; cpu < ncpus; cpu++) {
+		size_t expected = (size_t)cpu % nchildren;
+
+		total = udp_recvtotal(listen_sock, before, ARRAY_SIZE(before));
+		if (!udp_send_from_cpu(cpu, NSENDS)) {
+			continue;
+		}
+		for (size_t i = 0; i < 5000; i++) {
+			if (udp_recvtotal(listen_sock, counts,
+					  ARRAY_SIZE(counts)) >= total + NSENDS)
+			{
+				break;
+			}
+			usleep(1000);
+		}
+
+		for (size_t i = 0; i < nchildren; i++) {
+			uint64_t n = counts[i] - before[i];
+			assert_int_equal(n, (i == expected) ? NSENDS : 0);
+		}
+	}
+
+	(void)isc_thread_setaffinity(-1);
+
+	isc_nm_stoplistening(listen_sock);
+	isc_nmsocket_close(&listen_sock);
+	assert_null(listen_sock);
+}
+
+static void
+udp_recv_send_steered(void **state) {
+	isc_nm_t **nm = (isc_nm_t **)*state;
+	isc_nm_t *listen_nm = nm[0];
+	isc_nm_t *connect_nm = nm[1];
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_nmsocket_t *listen_sock = NULL;
+	size_t nthreads = ISC_MAX(ISC_MIN(workers, 32), 1);
+	isc_thread_t threads[32] = { 0 };
+	uint64_t counts[64] = { 0 };
+	uint64_t total = 0;
+	size_t nchildren;
+
+	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
+				  isc_nm_steering_random, udp_listen_recv_cb,
+				  NULL, 0, &listen_sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (size_t i = 0; i < nthreads; i++) {
+		isc_thread_create(udp_connect_thread, connect_nm, &threads[i]);
+	}
+
+	for (size_t i = 0; i < nthreads; i++) {
+		isc_thread_join(threads[i], NULL);
+	}
+
+	isc_nm_stoplistening(listen_sock);
+
+	/*
+	 * Whichever way the datagrams were distributed, every one of
+	 * them was counted by the child that received it.
+	 */
+	nchildren = isc_nm_udp_recvcounts(listen_sock, counts,
+					  ARRAY_SIZE(counts));
+	assert_true(nchildren > 0 && nchildren <= ARRAY_SIZE(counts));
+	for (size_t i = 0; i < nchildren; i++) {
+		total += counts[i];
+	}
+	assert_int_equal(total, atomic_load(&sreads));
+
+	isc_nmsocket_close(&listen_sock);
+	assert_null(listen_sock);
+
+	isc_nm_closedown(connect_nm);
+
+	X(cconnects);
+	X(csends);
+	X(creads);
+	X(ctimeouts);
+	X(sreads);
+	X(ssends);
+
+	assert_true(atomic_load(&cconnects) >= (NSENDS - 1) * NWRITES);
+	assert_true(atomic_load(&csends) <= atomic_load(&cconnects));
+	assert_true(atomic_load(&sreads) >= atomic_load(&ssends));
+	assert_true(atomic_load(&creads) <= atomic_load(&csends));
+}
+
+#ifdef HAVE_LIBURING
+/*
+ * Returns true if every child of the listening socket 'sock' is
+ * receiving through io_uring; skips the test if the kernel doesn't
+ * let the workers set up an io_uring instance at all.
+ */
+static bool
+udp_children_uring(isc_nm_t *mgr, isc_nmsocket_t *sock) {
+	for (size_t i = 0; i < sock->nchildren; i++) {
+		isc_nmsocket_t *csock = &sock->children[i];
+
+		if (mgr->workers[csock->tid].uring_failed) {
+			skip();
+		}
+		if (!csock->uring) {
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
+static void
+udp_noop_uring(void **state) {
+	isc_nm_t **nm = (isc_nm_t **)*state;
+	isc_nm_t *listen_nm = nm[0];
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_nmsocket_t *listen_sock = NULL;
+
+	isc_nm_udp_setiouring(listen_nm, true);
+
+	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
+				  isc_nm_steering_none, udp_listen_recv_cb, NULL,
+				  0, &listen_sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(udp_children_uring(listen_nm, listen_sock));
+
+	/* Cancel the multishot receives before anything arrives. */
+	isc_nm_stoplistening(listen_sock);
+	isc_nmsocket_close(&listen_sock);
+	assert_null(listen_sock);
+
+	assert_int_equal(0, atomic_load(&sreads));
+}
+
+static void
+udp_recv_send_uring(void **state) {
+	isc_nm_t **nm = (isc_nm_t **)*state;
+	isc_nm_t *listen_nm = nm[0];
+	isc_nm_t *connect_nm = nm[1];
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_nmsocket_t *listen_sock = NULL;
+	size_t nthreads = ISC_MAX(ISC_MIN(workers, 32), 1);
+	isc_thread_t threads[32] = { 0 };
+
+	isc_nm_udp_setiouring(listen_nm, true);
+
+	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
+				  isc_nm_steering_none, udp_listen_recv_cb, NULL,
+				  0, &listen_sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(udp_children_uring(listen_nm, listen_sock));
+
+	for (size_t i = 0; i < nthreads; i++) {
+		isc_thread_create(udp_connect_thread, connect_nm, &threads[i]);
+	}
+
+	for (size_t i = 0; i < nthreads; i++) {
+		isc_thread_join(threads[i], NULL);
+	}
+
+	isc_nm_stoplistening(listen_sock);
+	isc_nmsocket_close(&listen_sock);
+	assert_null(listen_sock);
+
+	isc_nm_closedown(connect_nm);
+
+	X(cconnects);
+	X(csends);
+	X(creads);
+	X(ctimeouts);
+	X(sreads);
+	X(ssends);
+
+	/*
+	 * The datagrams were received into provided buffers and the
+	 * answers sent through the ring; both must have made it.
+	 */
+	assert_true(atomic_load(&cconnects) >= (NSENDS - 1) * NWRITES);
+	assert_true(atomic_load(&csends) <= atomic_load(&cconnects));
+	assert_true(atomic_load(&sreads) > 0);
+	assert_true(atomic_load(&sreads) >= atomic_load(&ssends));
+	assert_true(atomic_load(&creads) > 0);
+	assert_true(atomic_load(&creads) <= atomic_load(&csends));
+}
+#endif /* HAVE_LIBURING */
+
 static void
 udp_recv_half_send(void **state) {
 	isc_nm_t **nm = (isc_nm_t **)*state;
@@ -1015,7 +1338,8 @@ udp_recv_half_send(void **state) {
 	isc_thread_t threads[32] = { 0 };
 
 	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
-				  udp_listen_recv_cb, NULL, 0, &listen_sock);
+				  isc_nm_steering_none, udp_listen_recv_cb, NULL,
+				  0, &listen_sock);
 	assert_int_equal(result, ISC_R_SUCCESS);
 
 	for (size_t i = 0; i < nthreads; i++) {
@@ -1064,7 +1388,8 @@ udp_half_recv_send(void **state) {
 	isc_thread_t threads[32] = { 0 };
 
 	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
-				  udp_listen_recv_cb, NULL, 0, &listen_sock);
+				  isc_nm_steering_none, udp_listen_recv_cb, NULL,
+				  0, &listen_sock);
 	assert_int_equal(result, ISC_R_SUCCESS);
 
 	for (size_t i = 0; i < nthreads; i++) {
@@ -1113,7 +1438,8 @@ udp_half_recv_half_send(void **state) {
 	isc_thread_t threads[32] = { 0 };
 
 	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
-				  udp_listen_recv_cb, NULL, 0, &listen_sock);
+				  isc_nm_steering_none, udp_listen_recv_cb, NULL,
+				  0, &listen_sock);
 	assert_int_equal(result, ISC_R_SUCCESS);
 
 	for (size_t i = 0; i < nthreads; i++) {
@@ -1150,6 +1476,441 @@ udp_half_recv_half_send(void **state) {
 	assert_true(atomic_load(&creads) >= atomic_load(&ctimeouts));
 }
 
+#ifdef HAVE_RECVMMSG
+#define NHELD 16
+
+static isc_mutex_t held_lock;
+static bool held_done;
+static size_t nheld;
+static isc_nmhandle_t *held_handles[NHELD];
+static isc_region_t held_regions[NHELD];
+
+static void
+udp_hold_recv_cb(isc_nmhandle_t *handle, isc_result_t eresult,
+		 isc_region_t *region, void *cbarg) {
+	UNUSED(cbarg);
+
+	if (eresult != ISC_R_SUCCESS) {
+		return;
+	}
+
+	assert_int_equal(region->length, sizeof(stop_magic));
+	atomic_fetch_add(&sreads, 1);
+
+	/* Keep the handle, and with it the received data, around */
+	LOCK(&held_lock);
+	if (!held_done && nheld < NHELD) {
+		isc_nmhandle_attach(handle, &held_handles[nheld]);
+		held_regions[nheld] = *region;
+		nheld++;
+	}
+	UNLOCK(&held_lock);
+}
+
+static void
+udp_recv_hold(void **state) {
+	isc_nm_t **nm = (isc_nm_t **)*state;
+	isc_nm_t *listen_nm = nm[0];
+	isc_nm_t *connect_nm = nm[1];
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_nmsocket_t *listen_sock = NULL;
+	size_t n;
+
+	isc_mutex_init(&held_lock);
+	held_done = false;
+	nheld = 0;
+
+	udp_connect_addr = (isc_sockaddr_t){ .length = 0 };
+	isc_sockaddr_fromin6(&udp_connect_addr, &in6addr_loopback, 0);
+
+	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
+				  isc_nm_steering_none, udp_hold_recv_cb, NULL,
+				  0, &listen_sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (size_t i = 0; i < NSENDS && atomic_load(&sreads) < NHELD; i++) {
+		(void)isc_nm_udpconnect(connect_nm,
+					(isc_nmiface_t *)&udp_connect_addr,
+					(isc_nmiface_t *)&udp_listen_addr,
+					udp_connect_connect_cb, NULL, 1, 0);
+		usleep(1000);
+	}
+
+	LOCK(&held_lock);
+	held_done = true;
+	n = nheld;
+	UNLOCK(&held_lock);
+
+	/*
+	 * Every datagram must still be intact in a buffer of its own,
+	 * even though more datagrams were received after it.
+	 */
+	assert_true(n > 0);
+	for (size_t i = 0; i < n; i++) {
+		assert_memory_equal(held_regions[i].base, &stop_magic,
+				    sizeof(stop_magic));
+		for (size_t j = 0; j < i; j++) {
+			assert_ptr_not_equal(held_regions[i].base,
+					     held_regions[j].base);
+		}
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		isc_nmhandle_detach(&held_handles[i]);
+	}
+
+	isc_nm_stoplistening(listen_sock);
+	isc_nmsocket_close(&listen_sock);
+	assert_null(listen_sock);
+	isc_nm_closedown(connect_nm);
+
+	isc_mutex_destroy(&held_lock);
+}
+#endif /* HAVE_RECVMMSG */
+
+/* UDP transmit batching */
+
+#define NBATCHED 64
+
+/*
+ * When 'batch_badpeers' is set, every fourth reply is addressed to port
+ * 0, which makes sendmmsg() fail with EINVAL for that message alone.
+ * libuv may fail every message it has queued along with it, so this is
+ * only done when the replies are batched.
+ */
+#define BATCH_BAD(i) (batch_badpeers && (i) % 4 == 3)
+
+static bool batch_badpeers;
+static atomic_uint_fast32_t batch_sendcbs[NBATCHED];
+static atomic_uint_fast32_t batch_results[NBATCHED];
+
+static void
+udp_batch_send_cb(isc_nmhandle_t *handle, isc_result_t eresult, void *cbarg) {
+	isc_nmhandle_t *sendhandle = handle;
+	uintptr_t i = (uintptr_t)cbarg;
+
+	assert_non_null(handle);
+	assert_true(i < NBATCHED);
+
+	atomic_store(&batch_results[i], eresult);
+	atomic_fetch_add(&batch_sendcbs[i], 1);
+	atomic_fetch_add(&ssends, 1);
+
+	isc_nmhandle_detach(&sendhandle);
+}
+
+static void
+udp_batch_recv_cb(isc_nmhandle_t *handle, isc_result_t eresult,
+		  isc_region_t *region, void *cbarg) {
+	isc_nmhandle_t *sendhandle = NULL;
+	uint64_t i;
+
+	UNUSED(cbarg);
+
+	if (eresult != ISC_R_SUCCESS) {
+		return;
+	}
+
+	assert_int_equal(region->length, sizeof(i));
+	memmove(&i, region->base, sizeof(i));
+	assert_true(i < NBATCHED);
+	atomic_fetch_add(&sreads, 1);
+
+	isc_nmhandle_attach(handle, &sendhandle);
+	if (BATCH_BAD(i)) {
+		isc_sockaddr_setport(&sendhandle->peer, 0);
+	}
+	isc_nm_send(sendhandle, region, udp_batch_send_cb, (void *)(uintptr_t)i);
+}
+
+/*
+ * Send 'n' datagrams to a UDP listener whose replies are batched 'size'
+ * at a time, and check that every reply that can be sent arrives once,
+ * and that every send callback is called once with the right result.
+ */
+static void
+udp_sendbatch(isc_nm_t **nm, uint32_t size, uint64_t n) {
+	isc_nm_t *listen_nm = nm[0];
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_nmsocket_t *listen_sock = NULL;
+	isc_stats_t *stats = NULL;
+	bool replied[NBATCHED] = { false };
+	uint64_t nbad = 0, nreplies = 0;
+	uint64_t batches, batchmsgs;
+	int fd;
+
+	REQUIRE(n <= NBATCHED);
+
+	batch_badpeers = (size > 1);
+	for (uint64_t i = 0; i < n; i++) {
+		atomic_store(&batch_sendcbs[i], 0);
+		atomic_store(&batch_results[i], ISC_R_UNSET);
+		if (BATCH_BAD(i)) {
+			nbad++;
+		}
+	}
+
+	result = isc_stats_create(test_mctx, &stats, isc_sockstatscounter_max);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	isc_nm_setstats(listen_nm, stats);
+	isc_nm_udp_setbatch(listen_nm, size, 0);
+
+	result = isc_nm_listenudp(listen_nm, (isc_nmiface_t *)&udp_listen_addr,
+				  isc_nm_steering_none, udp_batch_recv_cb, NULL,
+				  0, &listen_sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	fd = socket(AF_INET6, SOCK_DGRAM, 0);
+	assert_true(fd >= 0);
+	for (uint64_t i = 0; i < n; i++) {
+		ssize_t r = sendto(fd, &i, sizeof(i), 0,
+				   &udp_listen_addr.type.sa,
+				   sizeof(udp_listen_addr.type.sin6));
+		assert_int_equal(r, sizeof(i));
+	}
+
+	while (nreplies < n - nbad) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		uint64_t i;
+
+		assert_int_equal(poll(&pfd, 1, 5000), 1);
+		assert_int_equal(recv(fd, &i, sizeof(i), 0), sizeof(i));
+		assert_true(i < n);
+		assert_false(BATCH_BAD(i));
+		assert_false(replied[i]);
+		replied[i] = true;
+		nreplies++;
+	}
+
+	for (size_t i = 0; i < 5000 && atomic_load(&ssends) < n; i++) {
+		usleep(1000);
+	}
+
+	isc_nm_stoplistening(listen_sock);
+	isc_nmsocket_close(&listen_sock);
+	assert_null(listen_sock);
+	close(fd);
+
+	assert_int_equal(atomic_load(&sreads), n);
+	assert_int_equal(atomic_load(&ssends), n);
+	for (uint64_t i = 0; i < n; i++) {
+		assert_int_equal(atomic_load(&batch_sendcbs[i]), 1);
+		assert_int_equal(atomic_load(&batch_results[i]),
+				 BATCH_BAD(i) ? ISC_R_INVALIDFILE
+					      : ISC_R_SUCCESS);
+	}
+	assert_int_equal(
+		isc_stats_get_counter(stats, isc_sockstatscounter_udp6sendfail),
+		nbad);
+
+	/*
+	 * Every message went through a batch, and every batch held at
+	 * most 'size' messages.
+	 */
+	batches = isc_stats_get_counter(stats,
+					isc_sockstatscounter_udp6sendbatch);
+	batchmsgs = isc_stats_get_counter(
+		stats, isc_sockstatscounter_udp6sendbatchmsg);
+#ifdef HAVE_SENDMMSG
+	if (size > 1) {
+		assert_int_equal(batchmsgs, n);
+		assert_true(batches >= (n + size - 1) / size);
+		assert_true(batches <= n);
+	} else {
+		assert_int_equal(batches, 0);
+		assert_int_equal(batchmsgs, 0);
+	}
+#else  /* HAVE_SENDMMSG */
+	assert_int_equal(batches, 0);
+	assert_int_equal(batchmsgs, 0);
+#endif /* HAVE_SENDMMSG */
+
+	isc_stats_detach(&stats);
+}
+
+/* A batch size of 1 sends every message on its own */
+static void
+udp_sendbatch_single(void **state) {
+	udp_sendbatch((isc_nm_t **)*state, 1, 16);
+}
+
+/* A batch that doesn't fill up is sent at the end of the loop iteration */
+static void
+udp_sendbatch_partial(void **state) {
+	udp_sendbatch((isc_nm_t **)*state, 16, 10);
+}
+
+/* A batch is sent as soon as it is full */
+static void
+udp_sendbatch_full(void **state) {
+	udp_sendbatch((isc_nm_t **)*state, 16, 16);
+}
+
+/* Event queue */
+
+#define QUEUE_PRODUCERS 8
+#define QUEUE_ITEMS	(1 << 16)
+
+typedef struct queue_item {
+	isc__nm_evlink_t link;
+	size_t producer;
+	size_t seq;
+} queue_item_t;
+
+static queue_item_t *queue_items = NULL;
+static isc__nm_evqueue_t evqueue;
+static isc_queue_t *isc_queue = NULL;
+
+static isc_threadresult_t
+evqueue_producer(isc_threadarg_t arg) {
+	queue_item_t *items = arg;
+
+	for (size_t i = 0; i < QUEUE_ITEMS; i++) {
+		isc__nm_evqueue_push(&evqueue, &items[i].link);
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+static isc_threadresult_t
+isc_queue_producer(isc_threadarg_t arg) {
+	queue_item_t *items = arg;
+
+	for (size_t i = 0; i < QUEUE_ITEMS; i++) {
+		isc_queue_enqueue(isc_queue, (uintptr_t)&items[i]);
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+static void
+queue_setup(void) {
+	queue_items = isc_mem_get(test_mctx, QUEUE_PRODUCERS * QUEUE_ITEMS *
+						     sizeof(queue_items[0]));
+	for (size_t p = 0; p < QUEUE_PRODUCERS; p++) {
+		for (size_t i = 0; i < QUEUE_ITEMS; i++) {
+			queue_item_t *item = &queue_items[p * QUEUE_ITEMS + i];
+			item->producer = p;
+			item->seq = i;
+		}
+	}
+}
+
+static void
+queue_teardown(void) {
+	isc_mem_put(test_mctx, queue_items,
+		    QUEUE_PRODUCERS * QUEUE_ITEMS * sizeof(queue_items[0]));
+	queue_items = NULL;
+}
+
+/*
+ * Every item pushed by concurrent producers must be popped exactly once,
+ * in the order its producer pushed it.
+ */
+static void
+evqueue_mpsc(void **state) {
+	isc_thread_t threads[QUEUE_PRODUCERS];
+	size_t next[QUEUE_PRODUCERS] = { 0 };
+	size_t npopped = 0;
+
+	UNUSED(state);
+
+	queue_setup();
+	isc__nm_evqueue_init(&evqueue);
+	assert_null(isc__nm_evqueue_pop(&evqueue));
+
+	for (size_t p = 0; p < QUEUE_PRODUCERS; p++) {
+		isc_thread_create(evqueue_producer,
+				  &queue_items[p * QUEUE_ITEMS], &threads[p]);
+	}
+
+	while (npopped < QUEUE_PRODUCERS * QUEUE_ITEMS) {
+		queue_item_t *item =
+			(queue_item_t *)isc__nm_evqueue_pop(&evqueue);
+		if (item == NULL) {
+			isc_thread_yield();
+			continue;
+		}
+		assert_int_equal(item->seq, next[item->producer]);
+		next[item->producer]++;
+		npopped++;
+	}
+
+	for (size_t p = 0; p < QUEUE_PRODUCERS; p++) {
+		isc_thread_join(threads[p], NULL);
+		assert_int_equal(next[p], QUEUE_ITEMS);
+	}
+	assert_null(isc__nm_evqueue_pop(&evqueue));
+
+	queue_teardown();
+}
+
+#if defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__)
+static double
+queue_benchmark(bool evq) {
+	isc_thread_t threads[QUEUE_PRODUCERS];
+	size_t npopped = 0;
+	isc_time_t ts1, ts2;
+	isc_result_t result;
+
+	queue_setup();
+
+	result = isc_time_now(&ts1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (size_t p = 0; p < QUEUE_PRODUCERS; p++) {
+		isc_thread_create(evq ? evqueue_producer : isc_queue_producer,
+				  &queue_items[p * QUEUE_ITEMS], &threads[p]);
+	}
+
+	while (npopped < QUEUE_PRODUCERS * QUEUE_ITEMS) {
+		void *item = evq ? (void *)isc__nm_evqueue_pop(&evqueue)
+				 : (void *)isc_queue_dequeue(isc_queue);
+		if (item == NULL) {
+			isc_thread_yield();
+			continue;
+		}
+		npopped++;
+	}
+
+	for (size_t p = 0; p < QUEUE_PRODUCERS; p++) {
+		isc_thread_join(threads[p], NULL);
+	}
+
+	result = isc_time_now(&ts2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	queue_teardown();
+
+	return (isc_time_microdiff(&ts2, &ts1) / 1000000.0);
+}
+
+static void
+evqueue_benchmark(void **state) {
+	double t;
+
+	UNUSED(state);
+
+	isc__nm_evqueue_init(&evqueue);
+	t = queue_benchmark(true);
+	printf("[ TIME     ] evqueue_benchmark: "
+	       "%d isc__nm_evqueue_{push,pop} calls, %f seconds, "
+	       "%f calls/second\n",
+	       QUEUE_PRODUCERS * QUEUE_ITEMS, t,
+	       (QUEUE_PRODUCERS * QUEUE_ITEMS) / t);
+
+	isc_queue = isc_queue_new(test_mctx, 128);
+	t = queue_benchmark(false);
+	isc_queue_destroy(isc_queue);
+	isc_queue = NULL;
+	printf("[ TIME     ] evqueue_benchmark: "
+	       "%d isc_queue_{enqueue,dequeue} calls, %f seconds, "
+	       "%f calls/second\n",
+	       QUEUE_PRODUCERS * QUEUE_ITEMS, t,
+	       (QUEUE_PRODUCERS * QUEUE_ITEMS) / t);
+}
+#endif /* defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__) */
+
 int
 main(void) {
 	const struct CMUnitTest tests[] = {
@@ -1159,24 +1920,50 @@ main(void) {
 						nm_teardown),
 		cmocka_unit_test_setup_teardown(udp_recv_send, nm_setup,
 						nm_teardown),
+		cmocka_unit_test_setup_teardown(udp_recv_send_steered, nm_setup,
+						nm_teardown),
+		cmocka_unit_test_setup_teardown(udp_recv_steered_cpu, nm_setup,
+						nm_teardown),
+#ifdef HAVE_LIBURING
+		cmocka_unit_test_setup_teardown(udp_noop_uring, nm_setup,
+						nm_teardown),
+		cmocka_unit_test_setup_teardown(udp_recv_send_uring, nm_setup,
+						nm_teardown),
+#endif /* HAVE_LIBURING */
 		cmocka_unit_test_setup_teardown(udp_recv_half_send, nm_setup,
 						nm_teardown),
 		cmocka_unit_test_setup_teardown(udp_half_recv_send, nm_setup,
 						nm_teardown),
 		cmocka_unit_test_setup_teardown(udp_half_recv_half_send,
 						nm_setup, nm_teardown),
+#ifdef HAVE_RECVMMSG
+		cmocka_unit_test_setup_teardown(udp_recv_hold, nm_setup,
+						nm_teardown),
+#endif /* HAVE_RECVMMSG */
+		cmocka_unit_test_setup_teardown(udp_sendbatch_single, nm_setup,
+						nm_teardown),
+		cmocka_unit_test_setup_teardown(udp_sendbatch_partial,
+						nm_setup, nm_teardown),
+		cmocka_unit_test_setup_teardown(udp_sendbatch_full, nm_setup,
+						nm_teardown),
 		cmocka_unit_test_setup_teardown(tcp_noop, nm_setup,
 						nm_teardown),
 		cmocka_unit_test_setup_teardown(tcp_noresponse, nm_setup,
 						nm_teardown),
 		cmocka_unit_test_setup_teardown(tcp_recv_send, nm_setup,
 						nm_teardown),
+		cmocka_unit_test_setup_teardown(tcp_recv_send_acceptcounts,
+						nm_setup, nm_teardown),
 		cmocka_unit_test_setup_teardown(tcp_recv_half_send, nm_setup,
 						nm_teardown),
 		cmocka_unit_test_setup_teardown(tcp_half_recv_send, nm_setup,
 						nm_teardown),
 		cmocka_unit_test_setup_teardown(tcp_half_recv_half_send,
 						nm_setup, nm_teardown),
+		cmocka_unit_test(evqueue_mpsc),
+#if defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__)
+		cmocka_unit_test(evqueue_benchmark),
+#endif /* defined(DNS_BENCHMARK_TESTS) && !defined(__SANITIZE_THREAD__) */
 	};
 
 	return (cmocka_run_group_tests(tests, _setup, _teardown));
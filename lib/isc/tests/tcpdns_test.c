@@ -0,0 +1,434 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+#include <sched.h> /* IWYU pragma: keep */
+#include <setjmp.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <uv.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/atomic.h>
+#include <isc/netmgr.h>
+#include <isc/print.h>
+#include <isc/sockaddr.h>
+#include <isc/stats.h>
+#include <isc/util.h>
+
+#include "../netmgr/netmgr-int.h"
+#include "isctest.h"
+
+static isc_sockaddr_t tcp_listen_addr;
+
+static unsigned int workers = 2;
+
+/*
+ * Each query carries the index of the message and the size of the
+ * response to send; the response starts with the same index.
+ */
+#define NMSGS	 32
+#define NBIG	 8
+#define BIGSIZE	 40000
+#define SMALL	 64
+#define PIPELINE 8
+
+static uint8_t responses[NMSGS][BIGSIZE];
+
+static atomic_uint_fast32_t sreads;
+static atomic_uint_fast32_t scbs[NMSGS];
+static atomic_uint_fast32_t scbtotal;
+static atomic_uint_fast32_t pipelines[NMSGS];
+
+static int
+setup_ephemeral_port(isc_sockaddr_t *addr) {
+	socklen_t addrlen = sizeof(*addr);
+	int fd;
+	int r;
+
+	isc_sockaddr_fromin6(addr, &in6addr_loopback, 0);
+
+	fd = socket(AF_INET6, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("setup_ephemeral_port: socket()");
+		return (-1);
+	}
+
+	r = bind(fd, (const struct sockaddr *)&addr->type.sa,
+		 sizeof(addr->type.sin6));
+	if (r != 0) {
+		perror("setup_ephemeral_port: bind()");
+		close(fd);
+		return (r);
+	}
+
+	r = getsockname(fd, (struct sockaddr *)&addr->type.sa, &addrlen);
+	if (r != 0) {
+		perror("setup_ephemeral_port: getsockname()");
+		close(fd);
+		return (r);
+	}
+
+	return (fd);
+}
+
+static int
+_setup(void **state) {
+	UNUSED(state);
+
+	if (isc_test_begin(NULL, true, workers) != ISC_R_SUCCESS) {
+		return (-1);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	isc_test_end();
+
+	return (0);
+}
+
+static int
+nm_setup(void **state) {
+	isc_nm_t *nm = NULL;
+	int fd;
+
+	tcp_listen_addr = (isc_sockaddr_t){ .length = 0 };
+	fd = setup_ephemeral_port(&tcp_listen_addr);
+	if (fd < 0) {
+		return (-1);
+	}
+	close(fd);
+
+	atomic_store(&sreads, 0);
+	atomic_store(&scbtotal, 0);
+	for (size_t i = 0; i < NMSGS; i++) {
+		atomic_store(&scbs[i], 0);
+		atomic_store(&pipelines[i], 0);
+	}
+
+	nm = isc_nm_start(test_mctx, workers);
+	assert_non_null(nm);
+
+	*state = nm;
+
+	return (0);
+}
+
+static int
+nm_teardown(void **state) {
+	isc_nm_t *nm = (isc_nm_t *)*state;
+
+	isc_nm_destroy(&nm);
+	assert_null(nm);
+
+	return (0);
+}
+
+/*
+ * Server side: answer every query as soon as it is read.
+ */
+
+static void
+listen_send_cb(isc_nmhandle_t *handle, isc_result_t eresult, void *cbarg) {
+	uintptr_t idx = (uintptr_t)cbarg;
+
+	assert_int_equal(eresult, ISC_R_SUCCESS);
+	assert_true(idx < NMSGS);
+
+	atomic_fetch_add(&scbs[idx], 1);
+	atomic_fetch_add(&scbtotal, 1);
+	isc_nmhandle_detach(&handle);
+}
+
+static void
+listen_read_cb(isc_nmhandle_t *handle, isc_result_t eresult,
+	       isc_region_t *region, void *cbarg) {
+	isc_nmhandle_t *sendhandle = NULL;
+	isc_region_t r;
+	unsigned int idx, size;
+
+	UNUSED(cbarg);
+
+	if (eresult != ISC_R_SUCCESS) {
+		return;
+	}
+
+	assert_int_equal(region->length, 4);
+	idx = (region->base[0] << 8) | region->base[1];
+	size = (region->base[2] << 8) | region->base[3];
+	assert_true(idx < NMSGS);
+	assert_true(size >= 2 && size <= BIGSIZE);
+
+	/* The current pipeline limit of the connection. */
+	atomic_store(&pipelines[idx], handle->sock->pipeline);
+	atomic_fetch_add(&sreads, 1);
+
+	responses[idx][0] = idx >> 8;
+	responses[idx][1] = idx & 0xff;
+	r.base = responses[idx];
+	r.length = size;
+
+	isc_nmhandle_attach(handle, &sendhandle);
+	isc_nm_send(sendhandle, &r, listen_send_cb, (void *)(uintptr_t)idx);
+}
+
+static isc_nmsocket_t *
+listen_start(isc_nm_t *nm) {
+	isc_nmsocket_t *listen_sock = NULL;
+	isc_result_t result;
+
+	result = isc_nm_listentcpdns(nm, (isc_nmiface_t *)&tcp_listen_addr,
+				     listen_read_cb, NULL, NULL, NULL, 0, 0,
+				     NULL, &listen_sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (listen_sock);
+}
+
+static void
+listen_stop(isc_nm_t *nm, isc_nmsocket_t **listen_sockp) {
+	isc_nm_stoplistening(*listen_sockp);
+	isc_nmsocket_close(listen_sockp);
+	assert_null(*listen_sockp);
+
+	isc_nm_closedown(nm);
+}
+
+/*
+ * Client side: a plain blocking socket, so that the test controls
+ * exactly what is written at once and when responses are read.
+ */
+
+static int
+client_connect(void) {
+	struct timeval tv = { .tv_sec = 10 };
+	int fd;
+	int r;
+
+	fd = socket(AF_INET6, SOCK_STREAM, 0);
+	assert_true(fd >= 0);
+
+	r = setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	assert_int_equal(r, 0);
+
+	r = connect(fd, &tcp_listen_addr.type.sa,
+		    sizeof(tcp_listen_addr.type.sin6));
+	assert_int_equal(r, 0);
+
+	return (fd);
+}
+
+/*
+ * Send 'n' queries, numbered from 'first', with a single write.
+ */
+static void
+client_send(int fd, unsigned int first, unsigned int n, unsigned int size) {
+	uint8_t buf[NMSGS * 6];
+	size_t len = 0;
+
+	assert_true(n <= NMSGS);
+
+	for (unsigned int i = first; i < first + n; i++) {
+		buf[len++] = 0;
+		buf[len++] = 4;
+		buf[len++] = i >> 8;
+		buf[len++] = i & 0xff;
+		buf[len++] = size >> 8;
+		buf[len++] = size & 0xff;
+	}
+
+	assert_int_equal(write(fd, buf, len), len);
+}
+
+static void
+client_read(int fd, uint8_t *buf, size_t len) {
+	while (len > 0) {
+		ssize_t r = read(fd, buf, len);
+		assert_true(r > 0);
+		buf += r;
+		len -= r;
+	}
+}
+
+/*
+ * Read the response to query 'idx', which must be the next one.
+ */
+static void
+client_recv(int fd, unsigned int idx, unsigned int size) {
+	static uint8_t buf[BIGSIZE];
+
+	client_read(fd, buf, 2);
+	assert_int_equal((buf[0] << 8) | buf[1], size);
+
+	client_read(fd, buf, size);
+	assert_int_equal((buf[0] << 8) | buf[1], idx);
+}
+
+static void
+wait_for_sends(unsigned int n) {
+	for (size_t i = 0; i < 5000; i++) {
+		if (atomic_load(&scbtotal) >= n) {
+			break;
+		}
+		usleep(1000);
+	}
+	assert_int_equal(atomic_load(&scbtotal), n);
+}
+
+/*
+ * Responses to queries that arrive together are written together, and
+ * the send callback of every response is called once.
+ */
+static void
+tcpdns_batched_send(void **state) {
+	isc_nm_t *nm = (isc_nm_t *)*state;
+	isc_nmsocket_t *listen_sock = NULL;
+	isc_stats_t *stats = NULL;
+	int fd;
+
+	isc_stats_create(test_mctx, &stats, isc_sockstatscounter_max);
+	isc_nm_setstats(nm, stats);
+
+	listen_sock = listen_start(nm);
+	fd = client_connect();
+
+	client_send(fd, 0, NBIG, SMALL);
+	for (unsigned int i = 0; i < NBIG; i++) {
+		client_recv(fd, i, SMALL);
+	}
+
+	wait_for_sends(NBIG);
+	assert_int_equal(atomic_load(&sreads), NBIG);
+	for (unsigned int i = 0; i < NBIG; i++) {
+		assert_int_equal(atomic_load(&scbs[i]), 1);
+	}
+
+	/*
+	 * The first query of a read is answered on its own; the others
+	 * are processed together once its handle has been released.
+	 */
+	assert_in_range(isc_stats_get_counter(
+				stats, isc_sockstatscounter_tcpdnswrites),
+			1, 2);
+	assert_int_equal(isc_stats_get_counter(
+				 stats, isc_sockstatscounter_tcpdnswritemsgs),
+			 NBIG);
+	assert_int_equal(isc_stats_get_counter(
+				 stats, isc_sockstatscounter_tcpdnsbacklog),
+			 0);
+
+	close(fd);
+	listen_stop(nm, &listen_sock);
+	isc_stats_detach(&stats);
+}
+
+/*
+ * Responses that don't fit into one write make the writes back up,
+ * which halves the pipeline limit of the connection; afterwards, every
+ * write that completes with nothing else outstanding raises the limit
+ * by one until the configured limit is reached again.
+ */
+static void
+tcpdns_pipeline_adapt(void **state) {
+	isc_nm_t *nm = (isc_nm_t *)*state;
+	isc_nmsocket_t *listen_sock = NULL;
+	isc_stats_t *stats = NULL;
+	uint32_t lowest = PIPELINE;
+	uint32_t pipeline;
+	int fd;
+
+	isc_stats_create(test_mctx, &stats, isc_sockstatscounter_max);
+	isc_nm_setstats(nm, stats);
+	isc_nm_tcpdns_setpipeline(nm, PIPELINE);
+
+	listen_sock = listen_start(nm);
+	fd = client_connect();
+
+	client_send(fd, 0, NBIG, BIGSIZE);
+	for (unsigned int i = 0; i < NBIG; i++) {
+		client_recv(fd, i, BIGSIZE);
+	}
+	wait_for_sends(NBIG);
+
+	assert_int_equal(atomic_load(&pipelines[0]), PIPELINE);
+	for (unsigned int i = 0; i < NBIG; i++) {
+		lowest = ISC_MIN(lowest, atomic_load(&pipelines[i]));
+	}
+	assert_true(lowest <= PIPELINE / 2);
+	assert_true(isc_stats_get_counter(
+			    stats, isc_sockstatscounter_tcpdnsbacklog) > 0);
+
+	/*
+	 * One query at a time: each response is written on its own and
+	 * completes before the next query is read.
+	 */
+	for (unsigned int i = NBIG; i < NMSGS; i++) {
+		client_send(fd, i, 1, SMALL);
+		client_recv(fd, i, SMALL);
+	}
+	wait_for_sends(NMSGS);
+	assert_int_equal(atomic_load(&sreads), NMSGS);
+
+	pipeline = atomic_load(&pipelines[NBIG]);
+	for (unsigned int i = NBIG + 1; i < NMSGS; i++) {
+		pipeline = ISC_MIN(pipeline + 1, PIPELINE);
+		assert_int_equal(atomic_load(&pipelines[i]), pipeline);
+	}
+	assert_int_equal(pipeline, PIPELINE);
+
+	for (unsigned int i = 0; i < NMSGS; i++) {
+		assert_int_equal(atomic_load(&scbs[i]), 1);
+	}
+
+	close(fd);
+	listen_stop(nm, &listen_sock);
+	isc_stats_detach(&stats);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(tcpdns_batched_send, nm_setup,
+						nm_teardown),
+		cmocka_unit_test_setup_teardown(tcpdns_pipeline_adapt,
+						nm_setup, nm_teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, _setup, _teardown));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif /* if HAVE_CMOCKA */
@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define UNIT_TESTING
 #include <cmocka.h>
@@ -292,6 +293,20 @@ isc_time_formatshorttimestamp_test(void **state) {
 	assert_string_equal(buf, "20151213094640123");
 }
 
+/* the monotonic clock doesn't go backwards and measures elapsed time */
+static void
+isc_time_monotonic_test(void **state) {
+	uint64_t t1, t2;
+
+	UNUSED(state);
+
+	t1 = isc_time_monotonic();
+	usleep(10000);
+	t2 = isc_time_monotonic();
+	assert_true(t2 >= t1 + 10000000);
+	assert_true(isc_time_monotonic() >= t2);
+}
+
 int
 main(void) {
 	const struct CMUnitTest tests[] = {
@@ -303,6 +318,7 @@ main(void) {
 		cmocka_unit_test(isc_time_formatISO8601Lms_test),
 		cmocka_unit_test(isc_time_formatISO8601Lus_test),
 		cmocka_unit_test(isc_time_formatshorttimestamp_test),
+		cmocka_unit_test(isc_time_monotonic_test),
 	};
 
 	return (cmocka_run_group_tests(tests, NULL, NULL));
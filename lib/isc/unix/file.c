@@ -733,6 +733,31 @@ isc_file_munmap(void *addr, size_t len) {
 #endif /* ifdef HAVE_MMAP */
 }
 
+isc_result_t
+isc_file_prefetch(const char *filename) {
+#ifdef POSIX_FADV_WILLNEED
+	int fd, ret;
+
+	REQUIRE(filename != NULL);
+
+	fd = open(filename, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		return (isc__errno2result(errno));
+	}
+	ret = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	(void)close(fd);
+	if (ret != 0) {
+		return (isc__errno2result(ret));
+	}
+
+	return (ISC_R_SUCCESS);
+#else  /* ifdef POSIX_FADV_WILLNEED */
+	REQUIRE(filename != NULL);
+
+	return (ISC_R_NOTIMPLEMENTED);
+#endif /* ifdef POSIX_FADV_WILLNEED */
+}
+
 #define DISALLOW "\\/ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 
 static isc_result_t
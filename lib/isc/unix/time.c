@@ -106,14 +106,14 @@ isc_time_isepoch(const isc_time_t *t) {
 	return (false);
 }
 
-isc_result_t
-isc_time_now(isc_time_t *t) {
+static inline isc_result_t
+time_now(isc_time_t *t, clockid_t clock) {
 	struct timespec ts;
 	char strbuf[ISC_STRERRORSIZE];
 
 	REQUIRE(t != NULL);
 
-	if (clock_gettime(CLOCKSOURCE, &ts) == -1) {
+	if (clock_gettime(clock, &ts) == -1) {
 		strerror_r(errno, strbuf, sizeof(strbuf));
 		UNEXPECTED_ERROR(__FILE__, __LINE__, "%s", strbuf);
 		return (ISC_R_UNEXPECTED);
@@ -138,6 +138,25 @@ isc_time_now(isc_time_t *t) {
 	return (ISC_R_SUCCESS);
 }
 
+isc_result_t
+isc_time_now(isc_time_t *t) {
+	return (time_now(t, CLOCKSOURCE));
+}
+
+isc_result_t
+isc_time_now_hires(isc_time_t *t) {
+	return (time_now(t, CLOCK_REALTIME));
+}
+
+uint64_t
+isc_time_monotonic(void) {
+	struct timespec ts;
+
+	RUNTIME_CHECK(clock_gettime(CLOCK_MONOTONIC, &ts) != -1);
+
+	return ((uint64_t)ts.tv_sec * NS_PER_S + ts.tv_nsec);
+}
+
 isc_result_t
 isc_time_nowplusinterval(isc_time_t *t, const isc_interval_t *i) {
 	struct timespec ts;
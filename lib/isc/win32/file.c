@@ -815,6 +815,13 @@ isc_file_munmap(void *addr, size_t len) {
 	return (0);
 }
 
+isc_result_t
+isc_file_prefetch(const char *filename) {
+	REQUIRE(filename != NULL);
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
+
 #define DISALLOW "\\/:ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 
 static isc_result_t
@@ -164,6 +164,30 @@ isc_time_now(isc_time_t *t);
  *		in the current definition of isc_time_t.
  */
 
+isc_result_t
+isc_time_now_hires(isc_time_t *t);
+/*
+ * Set 't' to the current absolute time. Uses higher resolution clocks
+ * recommended when microsecond accuracy is required.
+ *
+ * Requires:
+ *
+ *	't' is a valid pointer.
+ *
+ * Returns:
+ *
+ *	Success
+ */
+
+uint64_t
+isc_time_monotonic(void);
+/*
+ * Return the current value of a monotonic clock, in nanoseconds.  The
+ * value is unrelated to the time of day, but unlike the clocks used by
+ * isc_time_now() and isc_time_now_hires(), it is not affected by changes
+ * to the system time, so it is suitable for measuring elapsed time.
+ */
+
 isc_result_t
 isc_time_nowplusinterval(isc_time_t *t, const isc_interval_t *i);
 /*
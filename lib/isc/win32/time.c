@@ -124,6 +124,30 @@ isc_time_now(isc_time_t *t) {
 	return (ISC_R_SUCCESS);
 }
 
+isc_result_t
+isc_time_now_hires(isc_time_t *t) {
+	REQUIRE(t != NULL);
+
+	GetSystemTimePreciseAsFileTime(&t->absolute);
+
+	return (ISC_R_SUCCESS);
+}
+
+uint64_t
+isc_time_monotonic(void) {
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&count);
+
+	return ((uint64_t)(count.QuadPart / freq.QuadPart) * NS_PER_S +
+		(uint64_t)(count.QuadPart % freq.QuadPart) * NS_PER_S /
+			freq.QuadPart);
+}
+
 isc_result_t
 isc_time_nowplusinterval(isc_time_t *t, const isc_interval_t *i) {
 	ULARGE_INTEGER i1;
@@ -59,6 +59,7 @@
 #include <ns/interfacemgr.h>
 #include <ns/log.h>
 #include <ns/notify.h>
+#include <ns/respcache.h>
 #include <ns/server.h>
 #include <ns/stats.h>
 #include <ns/update.h>
@@ -329,6 +330,15 @@ client_sendpkg(ns_client_t *client, isc_buffer_t *buffer) {
 
 	REQUIRE(client->sendhandle == NULL);
 
+	/*
+	 * Count responses that are not sent from the network thread
+	 * that received the request, e.g. after recursion.
+	 */
+	if (client->tid != isc_nm_tid()) {
+		ns_stats_increment(client->sctx->nsstats,
+				   ns_statscounter_threadhop);
+	}
+
 	isc_buffer_usedregion(buffer, &r);
 	isc_nmhandle_attach(client->handle, &client->sendhandle);
 	isc_nm_send(client->handle, &r, client_senddone, client);
@@ -400,24 +410,263 @@ done:
 	ns_client_drop(client, result);
 }
 
+/*
+ * Send the response rendered in 'buffer' to the client, and update the
+ * response statistics.
+ */
+static void
+client_sendbuffer(ns_client_t *client, isc_buffer_t *buffer,
+		  bool opt_included) {
+	isc_region_t r;
+	size_t respsize;
+#ifdef HAVE_DNSTAP
+	dns_dtmsgtype_t dtmsgtype;
+	isc_region_t zr;
+
+	memset(&zr, 0, sizeof(zr));
+	if (((client->message->flags & DNS_MESSAGEFLAG_AA) != 0) &&
+	    (client->query.authzone != NULL))
+	{
+		dns_name_toregion(dns_zone_getorigin(client->query.authzone),
+				  &zr);
+	}
+
+	if (client->message->opcode == dns_opcode_update) {
+		dtmsgtype = DNS_DTTYPE_UR;
+	} else if ((client->message->flags & DNS_MESSAGEFLAG_RD) != 0) {
+		dtmsgtype = DNS_DTTYPE_CR;
+	} else {
+		dtmsgtype = DNS_DTTYPE_AR;
+	}
+#endif /* HAVE_DNSTAP */
+
+	if (client->sendcb != NULL) {
+		client->sendcb(buffer);
+	} else if (TCP_CLIENT(client)) {
+		isc_buffer_usedregion(buffer, &r);
+#ifdef HAVE_DNSTAP
+		if (client->view != NULL) {
+			dns_dt_send(client->view, dtmsgtype, &client->peeraddr,
+				    &client->destsockaddr, true, &zr,
+				    &client->requesttime, NULL, buffer);
+		}
+#endif /* HAVE_DNSTAP */
+
+		respsize = isc_buffer_usedlength(buffer);
+
+		client_sendpkg(client, buffer);
+
+		switch (isc_sockaddr_pf(&client->peeraddr)) {
+		case AF_INET:
+			isc_stats_increment(client->sctx->tcpoutstats4,
+					    ISC_MIN((int)respsize / 16, 256));
+			break;
+		case AF_INET6:
+			isc_stats_increment(client->sctx->tcpoutstats6,
+					    ISC_MIN((int)respsize / 16, 256));
+			break;
+		default:
+			INSIST(0);
+			ISC_UNREACHABLE();
+		}
+	} else {
+#ifdef HAVE_DNSTAP
+		/*
+		 * Log dnstap data first, because client_sendpkg() may
+		 * leave client->view set to NULL.
+		 */
+		if (client->view != NULL) {
+			dns_dt_send(client->view, dtmsgtype, &client->peeraddr,
+				    &client->destsockaddr, false, &zr,
+				    &client->requesttime, NULL, buffer);
+		}
+#endif /* HAVE_DNSTAP */
+
+		respsize = isc_buffer_usedlength(buffer);
+
+		client_sendpkg(client, buffer);
+
+		switch (isc_sockaddr_pf(&client->peeraddr)) {
+		case AF_INET:
+			isc_stats_increment(client->sctx->udpoutstats4,
+					    ISC_MIN((int)respsize / 16, 256));
+			break;
+		case AF_INET6:
+			isc_stats_increment(client->sctx->udpoutstats6,
+					    ISC_MIN((int)respsize / 16, 256));
+			break;
+		default:
+			INSIST(0);
+			ISC_UNREACHABLE();
+		}
+	}
+
+	/* update statistics (XXXJT: is it okay to access message->xxxkey?) */
+	ns_stats_increment(client->sctx->nsstats, ns_statscounter_response);
+
+	dns_rcodestats_increment(client->sctx->rcodestats,
+				 client->message->rcode);
+	if (opt_included) {
+		ns_stats_increment(client->sctx->nsstats,
+				   ns_statscounter_edns0out);
+	}
+	if (client->message->tsigkey != NULL) {
+		ns_stats_increment(client->sctx->nsstats,
+				   ns_statscounter_tsigout);
+	}
+	if (client->message->sig0key != NULL) {
+		ns_stats_increment(client->sctx->nsstats,
+				   ns_statscounter_sig0out);
+	}
+	if ((client->message->flags & DNS_MESSAGEFLAG_TC) != 0) {
+		ns_stats_increment(client->sctx->nsstats,
+				   ns_statscounter_truncatedresp);
+	}
+}
+
+/*
+ * Add the response rendered in 'buffer' to the response cache.  Only
+ * the first 'bodylen' bytes are stored, leaving out the OPT record,
+ * which ns_client_sendcached() builds again for each client.
+ */
+static void
+client_respcache_add(ns_client_t *client, isc_buffer_t *buffer,
+		     unsigned int bodylen, bool opt_included) {
+	isc_region_t key, r;
+	uint16_t arcount;
+
+	if (client->sctx->respcache == NULL ||
+	    (client->message->flags & DNS_MESSAGEFLAG_TC) != 0 ||
+	    (client->message->rcode != dns_rcode_noerror &&
+	     client->message->rcode != dns_rcode_nxdomain))
+	{
+		return;
+	}
+
+	isc_buffer_usedregion(buffer, &r);
+	INSIST(bodylen >= DNS_MESSAGE_HEADERLEN && bodylen <= r.length);
+	r.length = bodylen;
+
+	arcount = (r.base[10] << 8) | r.base[11];
+	if (opt_included) {
+		INSIST(arcount > 0);
+		r.base[10] = ((arcount - 1) >> 8) & 0xff;
+		r.base[11] = (arcount - 1) & 0xff;
+	}
+
+	key.base = client->query.respcache.key;
+	key.length = client->query.respcache.keylen;
+	ns_respcache_add(client->sctx->respcache, client->view, &key,
+			 client->query.respcache.generation,
+			 client->query.respcache.counter, &r);
+
+	r.base[10] = (arcount >> 8) & 0xff;
+	r.base[11] = arcount & 0xff;
+}
+
+isc_result_t
+ns_client_sendcached(ns_client_t *client, isc_statscounter_t *counterp) {
+	isc_result_t result;
+	unsigned char *data;
+	isc_buffer_t buffer = { .magic = 0 };
+	isc_region_t key, r;
+	dns_compress_t cctx;
+	unsigned int info = 0, count = 0;
+	bool opt_included = false;
+	uint16_t flags, arcount;
+
+	REQUIRE(NS_CLIENT_VALID(client));
+	REQUIRE(client->sctx->respcache != NULL);
+	REQUIRE(client->query.respcache.keylen != 0);
+	REQUIRE(counterp != NULL);
+
+	CTRACE("sendcached");
+
+	if ((client->attributes & NS_CLIENTATTR_WANTOPT) != 0) {
+		result = ns_client_addopt(client, client->message,
+					  &client->opt);
+		if (result != ISC_R_SUCCESS) {
+			return (result);
+		}
+	}
+
+	client_allocsendbuf(client, &buffer, &data);
+
+	key.base = client->query.respcache.key;
+	key.length = client->query.respcache.keylen;
+	result = ns_respcache_find(client->sctx->respcache, client->view, &key,
+				   client->query.respcache.generation, &buffer,
+				   &info);
+	if (result == ISC_R_SUCCESS && client->opt != NULL) {
+		result = dns_compress_init(&cctx, -1, client->mctx);
+		if (result == ISC_R_SUCCESS) {
+			dns_compress_setmethods(&cctx, DNS_COMPRESS_NONE);
+			result = dns_rdataset_towire(client->opt, dns_rootname,
+						     &cctx, &buffer, 0, &count);
+			dns_compress_invalidate(&cctx);
+		}
+		opt_included = true;
+	}
+	if (client->opt != NULL) {
+		dns_rdataset_disassociate(client->opt);
+		dns_message_puttemprdataset(client->message, &client->opt);
+	}
+	if (result != ISC_R_SUCCESS) {
+		if (client->tcpbuf != NULL) {
+			isc_mem_put(client->mctx, client->tcpbuf,
+				    NS_CLIENT_TCP_BUFFER_SIZE);
+			client->tcpbuf = NULL;
+		}
+		return (result);
+	}
+
+	/*
+	 * Fix up the ID, the RD and RA flags, and the additional
+	 * section count of the cached response for this client.
+	 */
+	isc_buffer_usedregion(&buffer, &r);
+	r.base[0] = (client->message->id >> 8) & 0xff;
+	r.base[1] = client->message->id & 0xff;
+
+	flags = (r.base[2] << 8) | r.base[3];
+	flags &= ~(DNS_MESSAGEFLAG_RD | DNS_MESSAGEFLAG_RA);
+	flags |= client->message->flags & DNS_MESSAGEFLAG_RD;
+	if ((client->attributes & NS_CLIENTATTR_RA) != 0) {
+		flags |= DNS_MESSAGEFLAG_RA;
+	}
+	r.base[2] = (flags >> 8) & 0xff;
+	r.base[3] = flags & 0xff;
+
+	arcount = ((r.base[10] << 8) | r.base[11]) + count;
+	r.base[10] = (arcount >> 8) & 0xff;
+	r.base[11] = arcount & 0xff;
+
+	/*
+	 * Update the flags and rcode of client->message as
+	 * dns_message_parse() would, for the statistics.
+	 */
+	client->message->flags = flags & 0x8ff0U;
+	client->message->rcode = (dns_rcode_t)(flags & 0x000fU);
+
+	client_sendbuffer(client, &buffer, opt_included);
+
+	*counterp = info;
+	return (ISC_R_SUCCESS);
+}
+
 void
 ns_client_send(ns_client_t *client) {
 	isc_result_t result;
 	unsigned char *data;
 	isc_buffer_t buffer = { .magic = 0 };
-	isc_region_t r;
 	dns_compress_t cctx;
 	bool cleanup_cctx = false;
 	unsigned int render_opts;
 	unsigned int preferred_glue;
 	bool opt_included = false;
-	size_t respsize;
+	bool complete = false;
+	unsigned int bodylen = 0;
 	dns_aclenv_t *env;
-#ifdef HAVE_DNSTAP
-	unsigned char zone[DNS_NAME_MAXWIRE];
-	dns_dtmsgtype_t dtmsgtype;
-	isc_region_t zr;
-#endif /* HAVE_DNSTAP */
 
 	REQUIRE(NS_CLIENT_VALID(client));
 
@@ -551,124 +800,24 @@ ns_client_send(ns_client_t *client) {
 	if (result != ISC_R_SUCCESS && result != ISC_R_NOSPACE) {
 		goto cleanup;
 	}
+	complete = (result == ISC_R_SUCCESS);
+	bodylen = isc_buffer_usedlength(&buffer);
 renderend:
 	result = dns_message_renderend(client->message);
 	if (result != ISC_R_SUCCESS) {
 		goto cleanup;
 	}
 
-#ifdef HAVE_DNSTAP
-	memset(&zr, 0, sizeof(zr));
-	if (((client->message->flags & DNS_MESSAGEFLAG_AA) != 0) &&
-	    (client->query.authzone != NULL))
-	{
-		isc_result_t eresult;
-		isc_buffer_t b;
-		dns_name_t *zo = dns_zone_getorigin(client->query.authzone);
-
-		isc_buffer_init(&b, zone, sizeof(zone));
-		dns_compress_setmethods(&cctx, DNS_COMPRESS_NONE);
-		eresult = dns_name_towire(zo, &cctx, &b);
-		if (eresult == ISC_R_SUCCESS) {
-			isc_buffer_usedregion(&b, &zr);
-		}
-	}
-
-	if (client->message->opcode == dns_opcode_update) {
-		dtmsgtype = DNS_DTTYPE_UR;
-	} else if ((client->message->flags & DNS_MESSAGEFLAG_RD) != 0) {
-		dtmsgtype = DNS_DTTYPE_CR;
-	} else {
-		dtmsgtype = DNS_DTTYPE_AR;
-	}
-#endif /* HAVE_DNSTAP */
-
 	if (cleanup_cctx) {
 		dns_compress_invalidate(&cctx);
+		cleanup_cctx = false;
 	}
 
-	if (client->sendcb != NULL) {
-		client->sendcb(&buffer);
-	} else if (TCP_CLIENT(client)) {
-		isc_buffer_usedregion(&buffer, &r);
-#ifdef HAVE_DNSTAP
-		if (client->view != NULL) {
-			dns_dt_send(client->view, dtmsgtype, &client->peeraddr,
-				    &client->destsockaddr, true, &zr,
-				    &client->requesttime, NULL, &buffer);
-		}
-#endif /* HAVE_DNSTAP */
-
-		respsize = isc_buffer_usedlength(&buffer);
-
-		client_sendpkg(client, &buffer);
-
-		switch (isc_sockaddr_pf(&client->peeraddr)) {
-		case AF_INET:
-			isc_stats_increment(client->sctx->tcpoutstats4,
-					    ISC_MIN((int)respsize / 16, 256));
-			break;
-		case AF_INET6:
-			isc_stats_increment(client->sctx->tcpoutstats6,
-					    ISC_MIN((int)respsize / 16, 256));
-			break;
-		default:
-			INSIST(0);
-			ISC_UNREACHABLE();
-		}
-	} else {
-#ifdef HAVE_DNSTAP
-		/*
-		 * Log dnstap data first, because client_sendpkg() may
-		 * leave client->view set to NULL.
-		 */
-		if (client->view != NULL) {
-			dns_dt_send(client->view, dtmsgtype, &client->peeraddr,
-				    &client->destsockaddr, false, &zr,
-				    &client->requesttime, NULL, &buffer);
-		}
-#endif /* HAVE_DNSTAP */
-
-		respsize = isc_buffer_usedlength(&buffer);
-
-		client_sendpkg(client, &buffer);
-
-		switch (isc_sockaddr_pf(&client->peeraddr)) {
-		case AF_INET:
-			isc_stats_increment(client->sctx->udpoutstats4,
-					    ISC_MIN((int)respsize / 16, 256));
-			break;
-		case AF_INET6:
-			isc_stats_increment(client->sctx->udpoutstats6,
-					    ISC_MIN((int)respsize / 16, 256));
-			break;
-		default:
-			INSIST(0);
-			ISC_UNREACHABLE();
-		}
+	if (complete && client->query.respcache.keylen != 0) {
+		client_respcache_add(client, &buffer, bodylen, opt_included);
 	}
 
-	/* update statistics (XXXJT: is it okay to access message->xxxkey?) */
-	ns_stats_increment(client->sctx->nsstats, ns_statscounter_response);
-
-	dns_rcodestats_increment(client->sctx->rcodestats,
-				 client->message->rcode);
-	if (opt_included) {
-		ns_stats_increment(client->sctx->nsstats,
-				   ns_statscounter_edns0out);
-	}
-	if (client->message->tsigkey != NULL) {
-		ns_stats_increment(client->sctx->nsstats,
-				   ns_statscounter_tsigout);
-	}
-	if (client->message->sig0key != NULL) {
-		ns_stats_increment(client->sctx->nsstats,
-				   ns_statscounter_sig0out);
-	}
-	if ((client->message->flags & DNS_MESSAGEFLAG_TC) != 0) {
-		ns_stats_increment(client->sctx->nsstats,
-				   ns_statscounter_truncatedresp);
-	}
+	client_sendbuffer(client, &buffer, opt_included);
 
 	return;
 
@@ -1637,6 +1786,7 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 	dns_messageid_t id;
 	unsigned int flags;
 	bool notimp;
+	bool fastpath;
 	size_t reqsize;
 	dns_aclenv_t *env;
 #ifdef HAVE_DNSTAP
@@ -1675,7 +1825,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 
 	client->state = NS_CLIENTSTATE_READY;
 
-	isc_task_pause(client->task);
 	if (client->handle == NULL) {
 		isc_nmhandle_setdata(handle, client, ns__client_reset_cb,
 				     ns__client_put_cb);
@@ -1698,6 +1847,7 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 
 	client->peeraddr = isc_nmhandle_peeraddr(handle);
 	client->peeraddr_valid = true;
+	client->tid = isc_nm_tid();
 
 	reqsize = isc_buffer_usedlength(buffer);
 
@@ -1716,7 +1866,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 		ns_client_log(client, DNS_LOGCATEGORY_SECURITY,
 			      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(10),
 			      "dropped request: suspicious port");
-		isc_task_unpause(client->task);
 		return;
 	}
 #endif /* if NS_CLIENT_DROPPORT */
@@ -1730,7 +1879,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 		ns_client_log(client, DNS_LOGCATEGORY_SECURITY,
 			      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(10),
 			      "dropped request: blackholed peer");
-		isc_task_unpause(client->task);
 		return;
 	}
 
@@ -1744,7 +1892,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 		 * There isn't enough header to determine whether
 		 * this was a request or a response.  Drop it.
 		 */
-		isc_task_unpause(client->task);
 		return;
 	}
 
@@ -1761,7 +1908,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 	 */
 	if ((flags & DNS_MESSAGEFLAG_QR) != 0) {
 		CTRACE("unexpected response");
-		isc_task_unpause(client->task);
 		return;
 	}
 
@@ -1829,7 +1975,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 			result = DNS_R_FORMERR;
 		}
 		ns_client_error(client, result);
-		isc_task_unpause(client->task);
 		return;
 	}
 
@@ -1880,7 +2025,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 		 */
 		if ((client->sctx->options & NS_SERVER_EDNSFORMERR) != 0) {
 			ns_client_error(client, DNS_R_FORMERR);
-			isc_task_unpause(client->task);
 			return;
 		}
 
@@ -1889,7 +2033,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 		 */
 		if ((client->sctx->options & NS_SERVER_EDNSNOTIMP) != 0) {
 			ns_client_error(client, DNS_R_NOTIMP);
-			isc_task_unpause(client->task);
 			return;
 		}
 
@@ -1898,7 +2041,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 		 */
 		if ((client->sctx->options & NS_SERVER_EDNSREFUSED) != 0) {
 			ns_client_error(client, DNS_R_REFUSED);
-			isc_task_unpause(client->task);
 			return;
 		}
 
@@ -1907,13 +2049,11 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 		 */
 		if ((client->sctx->options & NS_SERVER_DROPEDNS) != 0) {
 			ns_client_drop(client, ISC_R_SUCCESS);
-			isc_task_unpause(client->task);
 			return;
 		}
 
 		result = process_opt(client, opt);
 		if (result != ISC_R_SUCCESS) {
-			isc_task_unpause(client->task);
 			return;
 		}
 	}
@@ -1926,7 +2066,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 			result = dns_message_reply(client->message, true);
 			if (result != ISC_R_SUCCESS) {
 				ns_client_error(client, result);
-				isc_task_unpause(client->task);
 				return;
 			}
 
@@ -1935,7 +2074,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 			}
 
 			ns_client_send(client);
-			isc_task_unpause(client->task);
 			return;
 		}
 
@@ -1945,7 +2083,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 		ns_client_dumpmessage(client, "message class could not be "
 					      "determined");
 		ns_client_error(client, notimp ? DNS_R_NOTIMP : DNS_R_FORMERR);
-		isc_task_unpause(client->task);
 		return;
 	}
 
@@ -2000,7 +2137,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 			      "no matching view in class '%s'", classname);
 		ns_client_dumpmessage(client, "no matching view in class");
 		ns_client_error(client, notimp ? DNS_R_NOTIMP : DNS_R_REFUSED);
-		isc_task_unpause(client->task);
 		return;
 	}
 
@@ -2101,7 +2237,6 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 		      client->message->opcode == dns_opcode_update))
 		{
 			ns_client_error(client, sigresult);
-			isc_task_unpause(client->task);
 			return;
 		}
 	}
@@ -2153,6 +2288,26 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 		}
 	}
 
+	/*
+	 * Nothing can be posted to the client task before the request
+	 * is dispatched, so the task only needs to be paused from here
+	 * on, to keep fetch events from running while we work on the
+	 * client.  A UDP query to a view that can never start a fetch
+	 * is answered entirely on this network thread, without touching
+	 * the task at all, if "auth-fast-path" is enabled.
+	 */
+	fastpath = client->sctx->authfastpath && !TCP_CLIENT(client) &&
+		   client->message->opcode == dns_opcode_query &&
+		   !client->view->recursion &&
+		   client->view->redirectzone == NULL &&
+		   client->view->rpzs == NULL;
+	if (fastpath) {
+		ns_stats_increment(client->sctx->nsstats,
+				   ns_statscounter_fastpath);
+	} else {
+		isc_task_pause(client->task);
+	}
+
 	/*
 	 * Dispatch the request.
 	 */
@@ -2197,7 +2352,9 @@ ns__client_request(isc_nmhandle_t *handle, isc_result_t eresult,
 		ns_client_error(client, DNS_R_NOTIMP);
 	}
 
-	isc_task_unpause(client->task);
+	if (!fastpath) {
+		isc_task_unpause(client->task);
+	}
 }
 
 isc_result_t
@@ -2237,12 +2394,20 @@ get_clientmctx(ns_clientmgr_t *manager, isc_mem_t **mctxp) {
 	isc_mem_t *clientmctx;
 	MTRACE("clientmctx");
 
+	/*
+	 * Pool entry 'n * ncpus + tid' belongs to network thread 'tid';
+	 * a thread hands out its own entries in turn, so that client
+	 * memory stays with the thread (and CPU) that serves the client.
+	 */
 	int tid = isc_nm_tid();
+	unsigned int slot;
 	if (tid < 0) {
 		tid = isc_random_uniform(manager->ncpus);
+		slot = isc_random_uniform(CLIENT_NMCTXS_PERCPU);
+	} else {
+		slot = manager->nextmctx[tid]++ % CLIENT_NMCTXS_PERCPU;
 	}
-	int rand = isc_random_uniform(CLIENT_NMCTXS_PERCPU);
-	int nextmctx = (rand * manager->ncpus) + tid;
+	int nextmctx = (slot * manager->ncpus) + tid;
 	clientmctx = manager->mctxpool[nextmctx];
 
 	isc_mem_attach(clientmctx, mctxp);
@@ -2253,12 +2418,15 @@ get_clienttask(ns_clientmgr_t *manager, isc_task_t **taskp) {
 	MTRACE("clienttask");
 
 	int tid = isc_nm_tid();
+	unsigned int slot;
 	if (tid < 0) {
 		tid = isc_random_uniform(manager->ncpus);
+		slot = isc_random_uniform(CLIENT_NTASKS_PERCPU);
+	} else {
+		slot = manager->nexttask[tid]++ % CLIENT_NTASKS_PERCPU;
 	}
 
-	int rand = isc_random_uniform(CLIENT_NTASKS_PERCPU);
-	int nexttask = (rand * manager->ncpus) + tid;
+	int nexttask = (slot * manager->ncpus) + tid;
 	isc_task_attach(manager->taskpool[nexttask], taskp);
 }
 
@@ -2420,6 +2588,10 @@ clientmgr_destroy(ns_clientmgr_t *manager) {
 	isc_mem_put(manager->mctx, manager->mctxpool,
 		    manager->ncpus * CLIENT_NMCTXS_PERCPU *
 			    sizeof(isc_mem_t *));
+	isc_mem_put(manager->mctx, manager->nextmctx,
+		    manager->ncpus * sizeof(manager->nextmctx[0]));
+	isc_mem_put(manager->mctx, manager->nexttask,
+		    manager->ncpus * sizeof(manager->nexttask[0]));
 
 	if (manager->interface != NULL) {
 		ns_interface_detach(&manager->interface);
@@ -2478,9 +2650,12 @@ ns_clientmgr_create(isc_mem_t *mctx, ns_server_t *sctx, isc_taskmgr_t *taskmgr,
 	manager->taskpool = isc_mem_get(mctx, ntasks * sizeof(isc_task_t *));
 	for (i = 0; i < ntasks; i++) {
 		manager->taskpool[i] = NULL;
+		/*
+		 * Bind the task to the thread get_clienttask() picks it for.
+		 */
 		result = isc_task_create_bound(manager->taskmgr, 20,
 					       &manager->taskpool[i],
-					       i % CLIENT_NTASKS_PERCPU);
+					       i % manager->ncpus);
 		RUNTIME_CHECK(result == ISC_R_SUCCESS);
 	}
 	isc_refcount_init(&manager->references, 1);
@@ -2498,6 +2673,15 @@ ns_clientmgr_create(isc_mem_t *mctx, ns_server_t *sctx, isc_taskmgr_t *taskmgr,
 		isc_mem_setname(manager->mctxpool[i], "client", NULL);
 	}
 
+	manager->nextmctx = isc_mem_get(
+		mctx, manager->ncpus * sizeof(manager->nextmctx[0]));
+	manager->nexttask = isc_mem_get(
+		mctx, manager->ncpus * sizeof(manager->nexttask[0]));
+	for (i = 0; i < manager->ncpus; i++) {
+		manager->nextmctx[i] = 0;
+		manager->nexttask[i] = 0;
+	}
+
 	manager->magic = MANAGER_MAGIC;
 
 	MTRACE("create");
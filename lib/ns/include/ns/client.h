@@ -167,6 +167,13 @@ struct ns_clientmgr {
 
 	/*%< mctx pool for clients. */
 	isc_mem_t **mctxpool;
+
+	/*%<
+	 * Next mctx and task, per network thread, to hand out from
+	 * that thread's share of the pools above.
+	 */
+	unsigned int *nextmctx;
+	unsigned int *nexttask;
 };
 
 /*% nameserver client structure */
@@ -211,6 +218,7 @@ struct ns_client {
 
 	isc_sockaddr_t peeraddr;
 	bool	       peeraddr_valid;
+	int	       tid; /*%< network thread the request arrived on */
 	isc_netaddr_t  destaddr;
 	isc_sockaddr_t destsockaddr;
 
@@ -310,6 +318,29 @@ ns_client_sendraw(ns_client_t *client, dns_message_t *msg);
  * send msg as a response using client->message->id for the id.
  */
 
+isc_result_t
+ns_client_sendcached(ns_client_t *client, isc_statscounter_t *counterp);
+/*%<
+ * Finish processing the current client request by sending the response
+ * stored in the server's response cache under the key and generation
+ * in client->query.respcache, with the ID, RD and RA flags, and OPT
+ * record of this client.  The query statistics counter that was in
+ * effect when the response was added is returned in '*counterp'.
+ *
+ * If the response is not sent, nothing is changed, and the request
+ * must be processed as usual.
+ *
+ * Requires:
+ *\li	'client' is valid and the server has a response cache.
+ *\li	'counterp' is not NULL.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS		the response was sent.
+ *\li	#ISC_R_NOTFOUND		the response isn't in the cache.
+ *\li	#ISC_R_NOSPACE		the response doesn't fit in the client's
+ *				buffer.
+ */
+
 void
 ns_client_error(ns_client_t *client, isc_result_t result);
 /*%<
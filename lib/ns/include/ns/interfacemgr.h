@@ -81,6 +81,7 @@ struct ns_interface {
 	isc_nmsocket_t *udplistensocket;
 	isc_nmsocket_t *tcplistensocket;
 	isc_dscp_t	dscp;	       /*%< "listen-on" DSCP value */
+	isc_nm_steering_t steering;    /*%< "listen-on" UDP steering */
 	isc_refcount_t	ntcpaccepting; /*%< Number of clients
 					*   ready to accept new
 					*   TCP connections on this
@@ -194,6 +195,14 @@ ns_interface_shutdown(ns_interface_t *ifp);
 void
 ns_interfacemgr_dumprecursing(FILE *f, ns_interfacemgr_t *mgr);
 
+isc_result_t
+ns_interfacemgr_dumpbalance(ns_interfacemgr_t *mgr, isc_buffer_t **text);
+/*%<
+ * Append lines to '*text' showing, for each listening interface, the
+ * number of UDP queries received and TCP connections accepted by each
+ * network thread on it. '*text' is grown as needed.
+ */
+
 bool
 ns_interfacemgr_listeningon(ns_interfacemgr_t *mgr, const isc_sockaddr_t *addr);
 
@@ -28,6 +28,7 @@
 #include <stdbool.h>
 
 #include <isc/net.h>
+#include <isc/netmgr.h>
 
 #include <dns/types.h>
 
@@ -46,6 +47,7 @@ struct ns_listenelt {
 	isc_dscp_t dscp; /* -1 = not set, 0..63 */
 	dns_acl_t *acl;
 	SSL_CTX *  sslctx;
+	isc_nm_steering_t steering; /* UDP load steering */
 	ISC_LINK(ns_listenelt_t) link;
 };
 
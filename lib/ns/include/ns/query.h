@@ -25,6 +25,7 @@
 #include <dns/rpz.h>
 #include <dns/types.h>
 
+#include <ns/respcache.h>
 #include <ns/types.h>
 
 /*% nameserver database version structure */
@@ -96,6 +97,19 @@ struct ns_query {
 	dns_keytag_t root_key_sentinel_keyid;
 	bool	     root_key_sentinel_is_ta;
 	bool	     root_key_sentinel_not_ta;
+
+	/*%
+	 * Response cache state: the key of a query that may be answered
+	 * from the response cache, or 0 if it may not; the generation of
+	 * the zone that answers it; and the statistics counter for the
+	 * response.
+	 */
+	struct {
+		unsigned int	   keylen;
+		unsigned char	   key[NS_RESPCACHE_MAXKEY];
+		uint64_t	   generation;
+		isc_statscounter_t counter;
+	} respcache;
 };
 
 #define NS_QUERYATTR_RECURSIONOK     0x00001
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef NS_RESPCACHE_H
+#define NS_RESPCACHE_H 1
+
+/*****
+***** Module Info
+*****/
+
+/*! \file
+ * \brief
+ * The response cache holds complete responses, in wire format, to
+ * queries that were answered from authoritative data, so that the same
+ * query can be answered again by copying the response instead of looking
+ * up and rendering its contents.
+ *
+ * Responses are stored under a key built by the caller from everything
+ * in the query that the response depends on, and a view.  Each response
+ * is tagged with a generation number, and is only returned to callers
+ * that look it up with the same generation number; callers use the
+ * generation number of the zone that answered the query (see
+ * dns_zone_getdbgeneration()), so that a response is never served once
+ * the zone has changed.
+ *
+ * The cache is split into shards, each with its own lock and an equal
+ * share of the cache's size.  Lookups only hold the lock of their shard
+ * for reading.  When a shard is full, responses are evicted with the
+ * SIEVE algorithm.
+ */
+
+/***
+ *** Imports
+ ***/
+
+#include <inttypes.h>
+
+#include <isc/buffer.h>
+#include <isc/lang.h>
+#include <isc/region.h>
+#include <isc/types.h>
+
+#include <dns/name.h>
+#include <dns/types.h>
+
+#include <ns/types.h>
+
+/*%
+ * The maximum length of a key: a name in wire format and a few bytes of
+ * query parameters.
+ */
+#define NS_RESPCACHE_MAXKEY (DNS_NAME_MAXWIRE + 8)
+
+/***
+ *** Functions
+ ***/
+
+ISC_LANG_BEGINDECLS
+
+isc_result_t
+ns_respcache_create(isc_mem_t *mctx, size_t maxsize, ns_respcache_t **rcp);
+/*%<
+ * Create a response cache that holds up to 'maxsize' bytes of responses
+ * and their keys.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	'maxsize' is greater than zero.
+ *\li	'rcp' is not NULL and '*rcp' is NULL.
+ */
+
+void
+ns_respcache_destroy(ns_respcache_t **rcp);
+/*%<
+ * Destroy a response cache and all the responses it holds.
+ *
+ * Requires:
+ *\li	'*rcp' is a valid response cache that is no longer in use.
+ *
+ * Ensures:
+ *\li	'*rcp' is NULL.
+ */
+
+size_t
+ns_respcache_getmaxsize(ns_respcache_t *rc);
+/*%<
+ * Return the size 'rc' was created with.
+ */
+
+void
+ns_respcache_flush(ns_respcache_t *rc);
+/*%<
+ * Remove all responses from 'rc'.
+ */
+
+isc_result_t
+ns_respcache_find(ns_respcache_t *rc, const dns_view_t *view,
+		  const isc_region_t *key, uint64_t generation,
+		  isc_buffer_t *target, unsigned int *infop);
+/*%<
+ * Look for the response stored under 'key' for 'view' with the given
+ * 'generation', and append it to 'target'.  The value passed as 'info'
+ * when the response was added is returned in '*infop'.
+ *
+ * 'view' is only compared with the view that responses were added for;
+ * it is never dereferenced.
+ *
+ * Requires:
+ *\li	'rc' is a valid response cache.
+ *\li	'key' and 'target' are not NULL.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOTFOUND		there is no such response, or it was
+ *				added with another generation number.
+ *\li	#ISC_R_NOSPACE		the response doesn't fit in 'target'; it
+ *				is left unchanged.
+ */
+
+void
+ns_respcache_add(ns_respcache_t *rc, const dns_view_t *view,
+		 const isc_region_t *key, uint64_t generation, unsigned int info,
+		 const isc_region_t *response);
+/*%<
+ * Store a copy of 'response' under 'key' for 'view', tagged with
+ * 'generation', replacing any response already stored under the same
+ * key for the same view.  Responses are evicted as needed to make room.
+ * Responses that would take up more than a shard of the cache are not
+ * stored.
+ *
+ * Requires:
+ *\li	'rc' is a valid response cache.
+ *\li	'key' is no longer than #NS_RESPCACHE_MAXKEY bytes.
+ *\li	'response' is no longer than 65535 bytes.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* NS_RESPCACHE_H */
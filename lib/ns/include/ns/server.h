@@ -80,6 +80,12 @@ struct ns_server {
 	ns_altsecretlist_t altsecrets;
 	bool		   answercookie;
 
+	/*% Answer authoritative UDP queries on the receiving thread */
+	bool authfastpath;
+
+	/*% Cache of rendered authoritative responses */
+	ns_respcache_t *respcache;
+
 	/*% Quotas */
 	isc_quota_t recursionquota;
 	isc_quota_t tcpquota;
@@ -105,7 +105,13 @@ enum { ns_statscounter_requestv4 = 0,
 
        ns_statscounter_reclimitdropped = 66,
 
-       ns_statscounter_max = 67,
+       ns_statscounter_fastpath = 67,
+       ns_statscounter_threadhop = 68,
+
+       ns_statscounter_respcachehit = 69,
+       ns_statscounter_respcachemiss = 70,
+
+       ns_statscounter_max = 71,
 };
 
 void
@@ -11,11 +11,14 @@
 
 /*! \file */
 
+#include <inttypes.h>
 #include <stdbool.h>
 
+#include <isc/buffer.h>
 #include <isc/interfaceiter.h>
 #include <isc/netmgr.h>
 #include <isc/os.h>
+#include <isc/print.h>
 #include <isc/random.h>
 #include <isc/string.h>
 #include <isc/task.h>
@@ -456,8 +459,8 @@ ns_interface_listenudp(ns_interface_t *ifp) {
 
 	/* Reserve space for an ns_client_t with the netmgr handle */
 	result = isc_nm_listenudp(ifp->mgr->nm, (isc_nmiface_t *)&ifp->addr,
-				  ns__client_request, ifp, sizeof(ns_client_t),
-				  &ifp->udplistensocket);
+				  ifp->steering, ns__client_request, ifp,
+				  sizeof(ns_client_t), &ifp->udplistensocket);
 	return (result);
 }
 
@@ -555,6 +558,7 @@ ns_interface_setup(ns_interfacemgr_t *mgr, isc_sockaddr_t *addr,
 	}
 
 	ifp->dscp = elt->dscp;
+	ifp->steering = elt->steering;
 
 	if (elt->sslctx != NULL) {
 		result = ns_interface_listentls(ifp, elt->sslctx);
@@ -1292,6 +1296,85 @@ ns_interfacemgr_dumprecursing(FILE *f, ns_interfacemgr_t *mgr) {
 	UNLOCK(&mgr->lock);
 }
 
+static const char *steering_text[] = { "none", "cpu", "random" };
+
+static isc_result_t
+putstr(isc_buffer_t **b, const char *str) {
+	isc_result_t result;
+	unsigned int len = strlen(str);
+
+	result = isc_buffer_reserve(b, len);
+	if (result != ISC_R_SUCCESS) {
+		return (ISC_R_NOSPACE);
+	}
+
+	isc_buffer_putmem(*b, (const unsigned char *)str, len);
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+putcounts(isc_buffer_t **b, const char *label, const uint64_t *counts,
+	  size_t n) {
+	char num[32];
+	isc_result_t result = putstr(b, label);
+
+	for (size_t i = 0; i < n && result == ISC_R_SUCCESS; i++) {
+		snprintf(num, sizeof(num), " %" PRIu64, counts[i]);
+		result = putstr(b, num);
+	}
+	if (result == ISC_R_SUCCESS) {
+		result = putstr(b, "\n");
+	}
+
+	return (result);
+}
+
+isc_result_t
+ns_interfacemgr_dumpbalance(ns_interfacemgr_t *mgr, isc_buffer_t **text) {
+	isc_result_t result = ISC_R_SUCCESS;
+	ns_interface_t *interface;
+	char addrbuf[ISC_SOCKADDR_FORMATSIZE];
+	char line[1024];
+	uint64_t counts[64];
+
+	REQUIRE(NS_INTERFACEMGR_VALID(mgr));
+	REQUIRE(text != NULL && *text != NULL);
+
+	LOCK(&mgr->lock);
+	for (interface = ISC_LIST_HEAD(mgr->interfaces);
+	     interface != NULL && result == ISC_R_SUCCESS;
+	     interface = ISC_LIST_NEXT(interface, link))
+	{
+		isc_sockaddr_format(&interface->addr, addrbuf,
+				    sizeof(addrbuf));
+
+		if (interface->udplistensocket != NULL) {
+			size_t n = isc_nm_udp_recvcounts(
+				interface->udplistensocket, counts,
+				ARRAY_SIZE(counts));
+			snprintf(line, sizeof(line),
+				 "UDP queries on %s (steering %s):", addrbuf,
+				 steering_text[interface->steering]);
+			result = putcounts(text, line, counts,
+					   ISC_MIN(n, ARRAY_SIZE(counts)));
+		}
+
+		if (interface->tcplistensocket != NULL &&
+		    result == ISC_R_SUCCESS) {
+			size_t n = isc_nm_tcp_acceptcounts(
+				interface->tcplistensocket, counts,
+				ARRAY_SIZE(counts));
+			snprintf(line, sizeof(line),
+				 "TCP connections on %s:", addrbuf);
+			result = putcounts(text, line, counts,
+					   ISC_MIN(n, ARRAY_SIZE(counts)));
+		}
+	}
+	UNLOCK(&mgr->lock);
+
+	return (result);
+}
+
 bool
 ns_interfacemgr_listeningon(ns_interfacemgr_t *mgr,
 			    const isc_sockaddr_t *addr) {
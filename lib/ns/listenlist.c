@@ -38,6 +38,7 @@ ns_listenelt_create(isc_mem_t *mctx, in_port_t port, isc_dscp_t dscp,
 	elt->dscp = dscp;
 	elt->acl = acl;
 	elt->sslctx = NULL;
+	elt->steering = isc_nm_steering_none;
 	if (tls) {
 		result = isc_nm_tls_create_server_ctx(key, cert, &elt->sslctx);
 		if (result != ISC_R_SUCCESS) {
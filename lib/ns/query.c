@@ -63,6 +63,7 @@
 #include <ns/hooks.h>
 #include <ns/interfacemgr.h>
 #include <ns/log.h>
+#include <ns/respcache.h>
 #include <ns/server.h>
 #include <ns/sortlist.h>
 #include <ns/stats.h>
@@ -549,6 +550,7 @@ query_send(ns_client_t *client) {
 	}
 
 	inc_stats(client, counter);
+	client->query.respcache.counter = counter;
 	ns_client_send(client);
 	isc_nmhandle_detach(&client->reqhandle);
 }
@@ -735,6 +737,7 @@ query_reset(ns_client_t *client, bool everything) {
 	client->query.root_key_sentinel_keyid = 0;
 	client->query.root_key_sentinel_is_ta = false;
 	client->query.root_key_sentinel_not_ta = false;
+	client->query.respcache.keylen = 0;
 }
 
 static void
@@ -1074,6 +1077,17 @@ query_getzonedb(ns_client_t *client, const dns_name_t *name,
 		partial = true;
 	}
 	if (result == ISC_R_SUCCESS || result == DNS_R_PARTIALMATCH) {
+		/*
+		 * A response stored in the response cache must not be
+		 * tagged with a generation that is newer than the data it
+		 * was built from, so note the generation before the
+		 * database version is opened.
+		 */
+		if (client->sctx->respcache != NULL &&
+		    client->query.restarts == 0) {
+			client->query.respcache.generation =
+				dns_zone_getdbgeneration(zone);
+		}
 		result = dns_zone_getdb(zone, &db);
 	}
 
@@ -5297,6 +5311,143 @@ root_key_sentinel_detect(query_ctx_t *qctx) {
 	}
 }
 
+/*%
+ * Bits of the response cache key that record how the query asked for
+ * the response to be built.
+ */
+#define RESPCACHE_DO	       0x01
+#define RESPCACHE_AD	       0x02
+#define RESPCACHE_CD	       0x04
+#define RESPCACHE_NOAUTHORITY  0x08
+#define RESPCACHE_NOADDITIONAL 0x10
+#define RESPCACHE_INET6	       0x20
+#define RESPCACHE_TCP	       0x40
+
+/*%
+ * Return true if the response to the query in 'qctx' may be taken from,
+ * or stored in, the response cache: it must be answered from a primary
+ * or secondary zone, in a view that neither recurses nor builds
+ * responses differently for each client, and the query must not be
+ * signed.
+ */
+static bool
+query_respcache_ok(query_ctx_t *qctx) {
+	ns_client_t *client = qctx->client;
+	dns_view_t *view = qctx->view;
+	dns_zonetype_t zonetype;
+
+	if (client->sctx->respcache == NULL || !qctx->is_zone ||
+	    !qctx->authoritative || qctx->zone == NULL)
+	{
+		return (false);
+	}
+
+	zonetype = dns_zone_gettype(qctx->zone);
+	if (zonetype != dns_zone_master && zonetype != dns_zone_slave) {
+		return (false);
+	}
+
+	if (view->recursion || view->sortlist != NULL ||
+	    view->nocasecompress != NULL || view->rrl != NULL ||
+	    view->rpzs != NULL || view->redirect != NULL ||
+	    view->redirectzone != NULL || view->hooktable != NULL ||
+	    view->padding > 0 || !ISC_LIST_EMPTY(view->dns64) ||
+	    !ISC_LIST_EMPTY(view->dlz_searched))
+	{
+		return (false);
+	}
+
+	if (client->message->tsigkey != NULL ||
+	    client->message->sig0key != NULL ||
+	    (client->attributes & NS_CLIENTATTR_WANTEXPIRE) != 0)
+	{
+		return (false);
+	}
+
+	if (dns_rdatatype_ismeta(qctx->qtype) ||
+	    qctx->qtype == dns_rdatatype_rrsig ||
+	    qctx->qtype == dns_rdatatype_sig)
+	{
+		return (false);
+	}
+
+	return (true);
+}
+
+/*%
+ * Build the response cache key for the query in 'qctx' from the query
+ * name, exactly as it was sent, the query type and class, and everything
+ * else in the query that changes how the response is built.  Then try
+ * to send the response from the cache.  If it isn't there, the key is
+ * kept so that the response can be added to the cache once it has been
+ * rendered.
+ *
+ * Returns ISC_R_SUCCESS if the response was sent.
+ */
+static isc_result_t
+query_respcache_lookup(query_ctx_t *qctx) {
+	ns_client_t *client = qctx->client;
+	isc_statscounter_t counter;
+	unsigned int flags = 0;
+	isc_result_t result;
+	isc_buffer_t b;
+	isc_region_t r;
+
+	if (WANTDNSSEC(client)) {
+		flags |= RESPCACHE_DO;
+	}
+	if (WANTAD(client)) {
+		flags |= RESPCACHE_AD;
+	}
+	if ((client->message->flags & DNS_MESSAGEFLAG_CD) != 0) {
+		flags |= RESPCACHE_CD;
+	}
+	if (NOAUTHORITY(client)) {
+		flags |= RESPCACHE_NOAUTHORITY;
+	}
+	if (NOADDITIONAL(client)) {
+		flags |= RESPCACHE_NOADDITIONAL;
+	}
+	if (isc_sockaddr_pf(&client->peeraddr) == AF_INET6) {
+		flags |= RESPCACHE_INET6;
+	}
+	if (TCP(client)) {
+		flags |= RESPCACHE_TCP;
+	}
+
+	isc_buffer_init(&b, client->query.respcache.key,
+			sizeof(client->query.respcache.key));
+	isc_buffer_putuint8(&b, flags);
+	isc_buffer_putuint16(&b, qctx->qtype);
+	isc_buffer_putuint16(&b, client->message->rdclass);
+	dns_name_toregion(client->query.qname, &r);
+	isc_buffer_copyregion(&b, &r);
+	client->query.respcache.keylen = isc_buffer_usedlength(&b);
+
+	result = ns_client_sendcached(client, &counter);
+	if (result != ISC_R_SUCCESS) {
+		ns_stats_increment(client->sctx->nsstats,
+				   ns_statscounter_respcachemiss);
+		return (result);
+	}
+
+	ns_stats_increment(client->sctx->nsstats,
+			   ns_statscounter_respcachehit);
+	if ((client->message->flags & DNS_MESSAGEFLAG_AA) == 0) {
+		inc_stats(client, ns_statscounter_nonauthans);
+	} else {
+		inc_stats(client, ns_statscounter_authans);
+	}
+	inc_stats(client, counter);
+
+	qctx_clean(qctx);
+	qctx_freedata(qctx);
+	isc_nmhandle_detach(&client->reqhandle);
+	qctx->detach_client = true;
+
+	return (ISC_R_SUCCESS);
+}
+
 /*%
  * Starting point for a client query or a chaining query.
  *
@@ -5434,6 +5585,17 @@ ns__query_start(query_ctx_t *qctx) {
 			}
 		}
 	}
+	/*
+	 * A response that follows a CNAME or DNAME out of the zone that
+	 * the query was first answered from depends on more than that
+	 * zone, so it can't be cached.
+	 */
+	if (qctx->client->query.restarts > 0 &&
+	    qctx->db != qctx->client->query.authdb)
+	{
+		qctx->client->query.respcache.keylen = 0;
+	}
+
 	/*
 	 * If we did not find a database from which we can answer the query,
 	 * respond with either REFUSED or SERVFAIL, depending on what the
@@ -5502,6 +5664,14 @@ ns__query_start(query_ctx_t *qctx) {
 		} else {
 			inc_stats(qctx->client, ns_statscounter_udp);
 		}
+
+		/*
+		 * Answer from the response cache if we can.
+		 */
+		if (query_respcache_ok(qctx) &&
+		    query_respcache_lookup(qctx) == ISC_R_SUCCESS) {
+			return (ISC_R_SUCCESS);
+		}
 	}
 
 	return (query_lookup(qctx));
@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <isc/atomic.h>
+#include <isc/buffer.h>
+#include <isc/hash.h>
+#include <isc/magic.h>
+#include <isc/mem.h>
+#include <isc/rwlock.h>
+#include <isc/util.h>
+
+#include <ns/respcache.h>
+
+#define RESPCACHE_MAGIC	   ISC_MAGIC('R', 's', 'p', 'C')
+#define VALID_RESPCACHE(r) ISC_MAGIC_VALID(r, RESPCACHE_MAGIC)
+
+/*%
+ * The number of shards, which must be a power of two.
+ */
+#define RESPCACHE_SHARDS 16
+
+/*%
+ * The expected average size of an entry, used to size the hash tables.
+ */
+#define RESPCACHE_ENTRYSIZE 512
+
+#define RESPCACHE_MINBUCKETS 16
+#define RESPCACHE_MAXBUCKETS (1U << 20)
+
+typedef struct rcentry rcentry_t;
+
+struct rcentry {
+	rcentry_t *next; /* hash chain */
+	ISC_LINK(rcentry_t) link; /* SIEVE queue */
+	const dns_view_t *view;
+	uint64_t generation;
+	uint64_t hashval;
+	atomic_bool visited;
+	unsigned int info;
+	uint16_t keylen;
+	uint16_t length;
+	/* Followed by the key and the response. */
+};
+
+#define ENTRY_KEY(e)	  ((unsigned char *)((e) + 1))
+#define ENTRY_RESPONSE(e) (ENTRY_KEY(e) + (e)->keylen)
+#define ENTRY_SIZE(e)	  (sizeof(rcentry_t) + (e)->keylen + (e)->length)
+
+typedef struct rcshard {
+	isc_rwlock_t lock;
+	rcentry_t **table;
+	ISC_LIST(rcentry_t) queue;
+	rcentry_t *hand;
+	size_t size;
+} rcshard_t;
+
+struct ns_respcache {
+	unsigned int magic;
+	isc_mem_t *mctx;
+	size_t maxsize;
+	size_t shardsize;
+	unsigned int nbuckets;
+	rcshard_t shards[RESPCACHE_SHARDS];
+};
+
+static inline rcshard_t *
+shardof(ns_respcache_t *rc, uint64_t hashval) {
+	return (&rc->shards[hashval & (RESPCACHE_SHARDS - 1)]);
+}
+
+static inline rcentry_t **
+bucketof(ns_respcache_t *rc, rcshard_t *shard, uint64_t hashval) {
+	return (&shard->table[(hashval / RESPCACHE_SHARDS) &
+			      (rc->nbuckets - 1)]);
+}
+
+/*
+ * Find the entry for 'key' and 'view' in 'shard', and the pointer to it
+ * in its hash chain.  The caller must hold the shard lock.
+ */
+static rcentry_t *
+findentry(ns_respcache_t *rc, rcshard_t *shard, const dns_view_t *view,
+	  const isc_region_t *key, uint64_t hashval, rcentry_t ***nextpp) {
+	rcentry_t **nextp = bucketof(rc, shard, hashval);
+	rcentry_t *entry;
+
+	for (entry = *nextp; entry != NULL; entry = *nextp) {
+		if (entry->hashval == hashval && entry->view == view &&
+		    entry->keylen == key->length &&
+		    memcmp(ENTRY_KEY(entry), key->base, key->length) == 0)
+		{
+			break;
+		}
+		nextp = &entry->next;
+	}
+
+	if (nextpp != NULL) {
+		*nextpp = nextp;
+	}
+	return (entry);
+}
+
+/*
+ * Remove 'entry', which '*nextp' points to, from 'shard' and free it.  The
+ * caller must hold the shard lock for writing.
+ */
+static void
+freeentry(ns_respcache_t *rc, rcshard_t *shard, rcentry_t **nextp,
+	  rcentry_t *entry) {
+	size_t size = ENTRY_SIZE(entry);
+
+	*nextp = entry->next;
+	if (shard->hand == entry) {
+		shard->hand = ISC_LIST_PREV(entry, link);
+	}
+	ISC_LIST_UNLINK(shard->queue, entry, link);
+	INSIST(shard->size >= size);
+	shard->size -= size;
+	isc_mem_put(rc->mctx, entry, size);
+}
+
+/*
+ * Move the hand of 'shard' from the tail of the queue towards its head,
+ * clearing the visited flag of each entry it passes, until it reaches
+ * an entry that hasn't been visited since the hand last passed it, and
+ * evict that entry.  The caller must hold the shard lock for writing.
+ */
+static void
+evict(ns_respcache_t *rc, rcshard_t *shard) {
+	rcentry_t *entry = shard->hand;
+	rcentry_t **nextp = NULL;
+
+	if (entry == NULL) {
+		entry = ISC_LIST_TAIL(shard->queue);
+	}
+	INSIST(entry != NULL);
+
+	while (atomic_load_relaxed(&entry->visited)) {
+		atomic_store_relaxed(&entry->visited, false);
+		entry = ISC_LIST_PREV(entry, link);
+		if (entry == NULL) {
+			entry = ISC_LIST_TAIL(shard->queue);
+		}
+	}
+
+	shard->hand = entry;
+	for (nextp = bucketof(rc, shard, entry->hashval); *nextp != entry;
+	     nextp = &(*nextp)->next)
+	{
+		INSIST(*nextp != NULL);
+	}
+	freeentry(rc, shard, nextp, entry);
+}
+
+isc_result_t
+ns_respcache_create(isc_mem_t *mctx, size_t maxsize, ns_respcache_t **rcp) {
+	ns_respcache_t *rc;
+	unsigned int i;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(maxsize > 0);
+	REQUIRE(rcp != NULL && *rcp == NULL);
+
+	rc = isc_mem_get(mctx, sizeof(*rc));
+	*rc = (ns_respcache_t){ .maxsize = maxsize,
+				.shardsize = maxsize / RESPCACHE_SHARDS,
+				.nbuckets = RESPCACHE_MINBUCKETS };
+	isc_mem_attach(mctx, &rc->mctx);
+
+	while (rc->nbuckets < RESPCACHE_MAXBUCKETS &&
+	       rc->nbuckets < rc->shardsize / RESPCACHE_ENTRYSIZE)
+	{
+		rc->nbuckets *= 2;
+	}
+
+	for (i = 0; i < RESPCACHE_SHARDS; i++) {
+		rcshard_t *shard = &rc->shards[i];
+
+		isc_rwlock_init(&shard->lock, 0, 0);
+		shard->table = isc_mem_get(rc->mctx,
+					   rc->nbuckets * sizeof(rcentry_t *));
+		memset(shard->table, 0, rc->nbuckets * sizeof(rcentry_t *));
+		ISC_LIST_INIT(shard->queue);
+	}
+
+	rc->magic = RESPCACHE_MAGIC;
+	*rcp = rc;
+
+	return (ISC_R_SUCCESS);
+}
+
+void
+ns_respcache_destroy(ns_respcache_t **rcp) {
+	ns_respcache_t *rc;
+	unsigned int i;
+
+	REQUIRE(rcp != NULL && VALID_RESPCACHE(*rcp));
+
+	rc = *rcp;
+	*rcp = NULL;
+
+	ns_respcache_flush(rc);
+
+	rc->magic = 0;
+	for (i = 0; i < RESPCACHE_SHARDS; i++) {
+		rcshard_t *shard = &rc->shards[i];
+
+		isc_mem_put(rc->mctx, shard->table,
+			    rc->nbuckets * sizeof(rcentry_t *));
+		isc_rwlock_destroy(&shard->lock);
+	}
+	isc_mem_putanddetach(&rc->mctx, rc, sizeof(*rc));
+}
+
+size_t
+ns_respcache_getmaxsize(ns_respcache_t *rc) {
+	REQUIRE(VALID_RESPCACHE(rc));
+
+	return (rc->maxsize);
+}
+
+void
+ns_respcache_flush(ns_respcache_t *rc) {
+	unsigned int i, j;
+
+	REQUIRE(VALID_RESPCACHE(rc));
+
+	for (i = 0; i < RESPCACHE_SHARDS; i++) {
+		rcshard_t *shard = &rc->shards[i];
+
+		RWLOCK(&shard->lock, isc_rwlocktype_write);
+		for (j = 0; j < rc->nbuckets; j++) {
+			while (shard->table[j] != NULL) {
+				freeentry(rc, shard, &shard->table[j],
+					  shard->table[j]);
+			}
+		}
+		INSIST(ISC_LIST_EMPTY(shard->queue));
+		INSIST(shard->size == 0);
+		shard->hand = NULL;
+		RWUNLOCK(&shard->lock, isc_rwlocktype_write);
+	}
+}
+
+isc_result_t
+ns_respcache_find(ns_respcache_t *rc, const dns_view_t *view,
+		  const isc_region_t *key, uint64_t generation,
+		  isc_buffer_t *target, unsigned int *infop) {
+	isc_result_t result = ISC_R_NOTFOUND;
+	uint64_t hashval;
+	rcshard_t *shard;
+	rcentry_t *entry;
+
+	REQUIRE(VALID_RESPCACHE(rc));
+	REQUIRE(key != NULL);
+	REQUIRE(target != NULL);
+
+	hashval = isc_hash_function(key->base, key->length, true);
+	shard = shardof(rc, hashval);
+
+	RWLOCK(&shard->lock, isc_rwlocktype_read);
+	entry = findentry(rc, shard, view, key, hashval, NULL);
+	if (entry == NULL || entry->generation != generation) {
+		result = ISC_R_NOTFOUND;
+	} else if (entry->length > isc_buffer_availablelength(target)) {
+		result = ISC_R_NOSPACE;
+	} else {
+		isc_buffer_putmem(target, ENTRY_RESPONSE(entry),
+				  entry->length);
+		if (infop != NULL) {
+			*infop = entry->info;
+		}
+		if (!atomic_load_relaxed(&entry->visited)) {
+			atomic_store_relaxed(&entry->visited, true);
+		}
+		result = ISC_R_SUCCESS;
+	}
+	RWUNLOCK(&shard->lock, isc_rwlocktype_read);
+
+	return (result);
+}
+
+void
+ns_respcache_add(ns_respcache_t *rc, const dns_view_t *view,
+		 const isc_region_t *key, uint64_t generation, unsigned int info,
+		 const isc_region_t *response) {
+	rcentry_t *entry, *old, **nextp = NULL;
+	uint64_t hashval;
+	rcshard_t *shard;
+	size_t size;
+
+	REQUIRE(VALID_RESPCACHE(rc));
+	REQUIRE(key != NULL && key->length <= NS_RESPCACHE_MAXKEY);
+	REQUIRE(response != NULL && response->length <= UINT16_MAX);
+
+	size = sizeof(*entry) + key->length + response->length;
+	if (size > rc->shardsize) {
+		return;
+	}
+
+	entry = isc_mem_get(rc->mctx, size);
+	*entry = (rcentry_t){ .view = view,
+			      .generation = generation,
+			      .info = info,
+			      .keylen = key->length,
+			      .length = response->length };
+	ISC_LINK_INIT(entry, link);
+	atomic_init(&entry->visited, false);
+	memmove(ENTRY_KEY(entry), key->base, key->length);
+	memmove(ENTRY_RESPONSE(entry), response->base, response->length);
+
+	hashval = isc_hash_function(key->base, key->length, true);
+	entry->hashval = hashval;
+	shard = shardof(rc, hashval);
+
+	RWLOCK(&shard->lock, isc_rwlocktype_write);
+	old = findentry(rc, shard, view, key, hashval, &nextp);
+	if (old != NULL) {
+		freeentry(rc, shard, nextp, old);
+	}
+	while (shard->size + size > rc->shardsize) {
+		evict(rc, shard);
+	}
+
+	nextp = bucketof(rc, shard, hashval);
+	entry->next = *nextp;
+	*nextp = entry;
+	ISC_LIST_PREPEND(shard->queue, entry, link);
+	shard->size += size;
+	RWUNLOCK(&shard->lock, isc_rwlocktype_write);
+}
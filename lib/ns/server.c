@@ -21,6 +21,7 @@
 #include <dns/tkey.h>
 
 #include <ns/query.h>
+#include <ns/respcache.h>
 #include <ns/server.h>
 #include <ns/stats.h>
 
@@ -96,6 +97,8 @@ ns_server_create(isc_mem_t *mctx, ns_matchview_t matchingview,
 
 	sctx->matchingview = matchingview;
 	sctx->answercookie = true;
+	sctx->authfastpath = false;
+	sctx->respcache = NULL;
 
 	ISC_LIST_INIT(sctx->altsecrets);
 
@@ -148,6 +151,9 @@ ns_server_detach(ns_server_t **sctxp) {
 		if (sctx->tkeyctx != NULL) {
 			dns_tkeyctx_destroy(&sctx->tkeyctx);
 		}
+		if (sctx->respcache != NULL) {
+			ns_respcache_destroy(&sctx->respcache);
+		}
 
 		if (sctx->nsstats != NULL) {
 			ns_stats_detach(&sctx->nsstats);
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#include <isc/util.h>
+
+#if HAVE_CMOCKA
+
+#include <sched.h> /* IWYU pragma: keep */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/buffer.h>
+#include <isc/print.h>
+
+#include <ns/respcache.h>
+
+#include "nstest.h"
+
+/*
+ * The response cache never dereferences views, so any distinct
+ * addresses will do.
+ */
+static int views[2];
+#define VIEW1 ((const dns_view_t *)&views[0])
+#define VIEW2 ((const dns_view_t *)&views[1])
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = ns_test_begin(NULL, false);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	ns_test_end();
+
+	return (0);
+}
+
+static void
+add(ns_respcache_t *rc, const dns_view_t *view, const char *key,
+    uint64_t generation, unsigned int info, const char *response) {
+	isc_region_t k = { (unsigned char *)key, strlen(key) };
+	isc_region_t r = { (unsigned char *)response, strlen(response) };
+
+	ns_respcache_add(rc, view, &k, generation, info, &r);
+}
+
+static isc_result_t
+find(ns_respcache_t *rc, const dns_view_t *view, const char *key,
+     uint64_t generation, isc_buffer_t *target, unsigned int *infop) {
+	isc_region_t k = { (unsigned char *)key, strlen(key) };
+
+	isc_buffer_clear(target);
+	return (ns_respcache_find(rc, view, &k, generation, target, infop));
+}
+
+/* responses are only found for the same key, view and generation */
+static void
+respcache_find_test(void **state) {
+	ns_respcache_t *rc = NULL;
+	unsigned char data[64];
+	unsigned int info = 0;
+	isc_buffer_t b;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	isc_buffer_init(&b, data, sizeof(data));
+
+	result = ns_respcache_create(mctx, 1024 * 1024, &rc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(ns_respcache_getmaxsize(rc), 1024 * 1024);
+
+	add(rc, VIEW1, "key1", 1, 7, "response1");
+
+	result = find(rc, VIEW1, "key1", 1, &b, &info);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(info, 7);
+	assert_int_equal(isc_buffer_usedlength(&b), strlen("response1"));
+	assert_memory_equal(data, "response1", strlen("response1"));
+
+	result = find(rc, VIEW1, "key2", 1, &b, &info);
+	assert_int_equal(result, ISC_R_NOTFOUND);
+	result = find(rc, VIEW2, "key1", 1, &b, &info);
+	assert_int_equal(result, ISC_R_NOTFOUND);
+	result = find(rc, VIEW1, "key1", 2, &b, &info);
+	assert_int_equal(result, ISC_R_NOTFOUND);
+
+	/* Adding the same key again replaces the response. */
+	add(rc, VIEW1, "key1", 2, 8, "response2");
+	result = find(rc, VIEW1, "key1", 1, &b, &info);
+	assert_int_equal(result, ISC_R_NOTFOUND);
+	result = find(rc, VIEW1, "key1", 2, &b, &info);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(info, 8);
+	assert_memory_equal(data, "response2", strlen("response2"));
+
+	/* A response that doesn't fit leaves the target unchanged. */
+	isc_buffer_init(&b, data, 4);
+	result = find(rc, VIEW1, "key1", 2, &b, &info);
+	assert_int_equal(result, ISC_R_NOSPACE);
+	assert_int_equal(isc_buffer_usedlength(&b), 0);
+
+	isc_buffer_init(&b, data, sizeof(data));
+	ns_respcache_flush(rc);
+	result = find(rc, VIEW1, "key1", 2, &b, &info);
+	assert_int_equal(result, ISC_R_NOTFOUND);
+
+	ns_respcache_destroy(&rc);
+	assert_null(rc);
+}
+
+/* a full cache evicts responses, and keeps those that are in use */
+static void
+respcache_evict_test(void **state) {
+	ns_respcache_t *rc = NULL;
+	unsigned char data[64];
+	char key[32];
+	isc_buffer_t b;
+	isc_result_t result;
+	unsigned int i, found = 0;
+
+	UNUSED(state);
+
+	isc_buffer_init(&b, data, sizeof(data));
+
+	result = ns_respcache_create(mctx, 64 * 1024, &rc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	add(rc, VIEW1, "popular", 1, 0, "response");
+
+	for (i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "key%u", i);
+		add(rc, VIEW1, key, 1, 0, "response");
+
+		result = find(rc, VIEW1, "popular", 1, &b, NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+
+	for (i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "key%u", i);
+		if (find(rc, VIEW1, key, 1, &b, NULL) == ISC_R_SUCCESS) {
+			found++;
+		}
+	}
+	assert_true(found > 0);
+	assert_true(found < 10000);
+
+	/* The last key added must still be there. */
+	result = find(rc, VIEW1, "key9999", 1, &b, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	ns_respcache_destroy(&rc);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(respcache_find_test, _setup,
+						_teardown),
+		cmocka_unit_test_setup_teardown(respcache_evict_test, _setup,
+						_teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif /* HAVE_CMOCKA */